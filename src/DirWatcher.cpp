@@ -16,15 +16,30 @@
 #ifdef __WXGTK__
 
 #include <sys/inotify.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <errno.h>
 
 #define EVENT_SIZE  (sizeof (struct inotify_event))
-#define BUF_LEN (32 * (EVENT_SIZE + 16))
+#define BUF_LEN (1024 * (EVENT_SIZE + 16))
+#define WATCH_MASK (IN_CREATE | IN_DELETE | IN_MODIFY | IN_MOVE | IN_ONLYDIR)
 
 #endif
 
 DEFINE_EVENT_TYPE(wxEVT_DIRWATCHER)
 
+using namespace std;
+
+#ifdef __WXGTK__
+// Initializing static constants
+const unsigned int DirWatcher::COALESCE_DELAY = 100; // ms without events before changes are sent
+const unsigned int DirWatcher::COALESCE_MAXDELAY = 500; // ms (unless flooded)
+const unsigned int DirWatcher::RESCAN_LIMIT = 1000; // changes per batch
+#endif
+
 #ifdef __WXMSW__
 class FileNotifyInformation {
 public:
@@ -63,9 +78,24 @@ protected:
 DirWatcher::DirWatcher() : wxThread(wxTHREAD_DETACHED) {
 #if defined(__WXGTK__)
 	wxLogDebug(wxT("DirWatcher::%s()"), wxString(__FUNCTION__, wxConvUTF8).c_str());
+	m_batchStart = -1;
+	m_lastEvent = 0;
+	m_isFlooded = false;
+	m_moveCookie = 0;
+	m_moveInfo = NULL;
+	m_moveIsDir = false;
+
 	if (-1 == (m_fd = inotify_init())) {
 		wxLogDebug(wxT("inotify_init() failed! errno=%i (%s)"), errno, wxString(strerror(errno), wxConvUTF8).c_str());
+	} else if (-1 == pipe(m_wakePipe)) {
+		wxLogDebug(wxT("pipe() failed! errno=%i (%s)"), errno, wxString(strerror(errno), wxConvUTF8).c_str());
+		close(m_fd);
+		m_fd = -1;
 	} else {
+		// Wake-ups are never waited for, a full pipe wakes the thread anyway
+		fcntl(m_wakePipe[0], F_SETFL, O_NONBLOCK);
+		fcntl(m_wakePipe[1], F_SETFL, O_NONBLOCK);
+
 		wxThreadError err;
 		if (wxTHREAD_NO_ERROR != (err = Create())) {
 			wxLogDebug(wxT("Thread creation failed! Error: %i"), err);
@@ -93,83 +123,42 @@ DirWatcher::~DirWatcher() {
 void* DirWatcher::Entry() {
 #if defined(__WXGTK__)
 	wxLogDebug(wxT("DirWatcher::%s()"), wxString(__FUNCTION__, wxConvUTF8).c_str());
-	unsigned int iSize, iTmp;
-	char buf[BUF_LEN];
-	struct inotify_event *pEvent;
 
-	wxDirWatcherEvent wdEvent; // watch dir event for appropriate window
-	DirWatchInfo* DirWatchInfo = NULL;
-	wxEvtHandler* EventHandler = NULL;
+	struct pollfd fds[2];
+	fds[0].fd = m_fd;
+	fds[0].events = POLLIN;
+	fds[1].fd = m_wakePipe[0];
+	fds[1].events = POLLIN;
 
 	while (true) {
-		iSize = read(m_fd, buf, BUF_LEN);
-		iTmp = 0;
-		if (0 < iSize) {
-			while (iTmp < iSize) {
-		        	pEvent = (struct inotify_event *) &buf[iTmp];
-		        	if (pEvent->len <= 0) {
-					break;
-				}
-				wxLogDebug(wxT("Event: wd=%d mask=%u cookie=%u len=%u name=%s"),
-					pEvent->wd, pEvent->mask, pEvent->cookie, pEvent->len,\
-					wxString(pEvent->name, wxConvUTF8).c_str());
-				if (NULL == (DirWatchInfo = getDirWatchInfoByWD(pEvent->wd))) {
-					wxLogDebug(wxT("Can't obtain dir watch info"));
-					iTmp += EVENT_SIZE + pEvent->len; //process next event
-					continue;
-				}
-				if (NULL == (EventHandler = &DirWatchInfo->GetHandler())) {
-					wxLogDebug(wxT("Can't obtain event handler"));
-					iTmp += EVENT_SIZE + pEvent->len; //process next event
-					continue;
-				}
-				// process inotify event
-				bool bIsNeedtoProcess = true;
-				bool bIsDir = false;
-
-				switch (pEvent->mask) {
-					case IN_ISDIR | IN_CREATE: // new directory
-						bIsDir = true;
-					case IN_CREATE:
-						wdEvent.SetChangeType(DIRWATCHER_FILE_ADDED);
-						break;
-					case IN_ISDIR | IN_DELETE: // remove directory
-						bIsDir = true;
-					case IN_DELETE:
-						wdEvent.SetChangeType(DIRWATCHER_FILE_REMOVED);
-						break;
-					case IN_ISDIR | IN_MOVED_FROM: // rename directory
-						bIsDir = true;
-					case IN_MOVED_FROM:
-						wdEvent.SetChangeType(DIRWATCHER_FILE_RENAMED);
-						bIsNeedtoProcess = false;
-						break;
-					case IN_ISDIR | IN_MOVED_TO: // rename directory
-						bIsDir = true;
-					case IN_MOVED_TO:
-						if (DIRWATCHER_FILE_RENAMED == wdEvent.GetChangeType()) {
-							wdEvent.SetNewFile(DirWatchInfo->GetPath() + wxT("/") +
-								wxString(pEvent->name, wxConvUTF8));
-						} else {
-							wxLogDebug(wxT("Previous event was wrong"));
-							bIsNeedtoProcess = false;
-						}
-						break;
-					default:
-						bIsNeedtoProcess = false;
-						break;
-				} // switch (pEvent->mask)
-				if (IN_MOVED_TO != (IN_MOVED_TO & pEvent->mask)) {
-					wdEvent.SetChangedFile(DirWatchInfo->GetPath() + wxT("/") +
-						wxString(pEvent->name, wxConvUTF8));
-				}
-				if (true == bIsNeedtoProcess) {
-					wdEvent.SetDirFlag(bIsDir);
-					EventHandler->AddPendingEvent(wdEvent); // Send the event
-				}
-				iTmp += EVENT_SIZE + pEvent->len; //process next event
+		// Changes are held back until the events stop for a moment, so
+		// that each path is only sent once (and floods become rescans)
+		int timeout = -1;
+		{
+			wxCriticalSectionLocker lock(m_watchLock);
+			if (m_batchStart != -1) {
+				const long delay = GetSendDelay();
+				if (delay <= 0) SendChanges();
+				else timeout = delay;
 			}
-		} // if (0 < iSize) {
+		}
+
+		if (-1 == poll(fds, 2, timeout)) {
+			if (EINTR == errno) continue;
+			wxLogDebug(wxT("poll() failed! errno=%i (%s)"), errno, wxString(strerror(errno), wxConvUTF8).c_str());
+			break;
+		}
+
+		if ((fds[1].revents & POLLIN) && !DrainWakePipe()) break;
+		if (fds[0].revents & POLLIN) ReadEvents();
+
+		// Watch new dirs (and the dirs requested)
+		vector<Watch> dirs;
+		{
+			wxCriticalSectionLocker lock(m_watchLock);
+			dirs.swap(m_toWalk);
+		}
+		if (!dirs.empty()) WalkDirs(dirs);
 	} // main loop
 	return NULL;
 #elif defined(__WXMSW__)
@@ -324,29 +313,29 @@ void* DirWatcher::Entry() {
 
 void* DirWatcher::WatchDirectory(const wxString& path, wxEvtHandler& changeHandler, bool watchSubDirs) {
 #if defined(__WXGTK__)
-	int mask = IN_CREATE | IN_DELETE | IN_MODIFY | IN_MOVE_SELF | IN_MOVE | IN_DELETE_SELF;
-	int wd;
-
 	wxLogDebug(wxT("DirWatcher::%s() path=%s"), wxString(__FUNCTION__, wxConvUTF8).c_str(), path.c_str());
 	if (-1 == m_fd) {
 		wxLogDebug(wxT("inotify was not init!"));
 		return NULL;
 	}
-	wd = inotify_add_watch (m_fd, (const char*)path.mb_str(wxConvUTF8), mask);
-	//wd = inotify_add_watch (m_fd, "/proj/e_port/project", mask);
-	if (0 > wd) {
-		wxLogDebug(wxT("inotify_add_watch() failed! errno=%i (%s)"), errno, wxString(strerror(errno), wxConvUTF8).c_str());
+
+	wxCriticalSectionLocker lock(m_watchLock);
+
+	// The dir is watched right away, the subdirs by the thread
+	DirWatchInfo* pDirInfo = new DirWatchInfo(changeHandler, path, watchSubDirs);
+	if (!AddWatch(pDirInfo, pDirInfo->path)) {
+		delete pDirInfo;
 		return NULL;
 	}
-	// Add descriptor to the list of active watches
-	DirWatchInfo * pDirInfo = new DirWatchInfo(wd, changeHandler, path);
-	if (NULL != pDirInfo) {
-		m_dirsWatched.push_back(pDirInfo);
-		return pDirInfo;
-	} else {
-		wxLogDebug(wxT("Memory allocation failed!"));
-		return NULL;
+	m_dirsWatched.push_back(pDirInfo);
+
+	if (watchSubDirs) {
+		const Watch dir = {pDirInfo, pDirInfo->path};
+		m_toWalk.push_back(dir);
+		WakeThread();
 	}
+
+	return pDirInfo;
 #elif defined(__WXMSW__)
 	// Check that it is really a directory
 
@@ -404,6 +393,7 @@ void DirWatcher::UnwatchDirectory(void* handle) {
 		wxLogDebug(wxT("inotify was not init!"));
 		return;
 	}
+	wxCriticalSectionLocker lock(m_watchLock);
 #elif defined(__WXMSW__)
 	if (m_hCompPort == NULL) return; // all dirs are already unwatched
 #endif
@@ -415,7 +405,25 @@ void DirWatcher::UnwatchDirectory(void* handle) {
 
 	// Unwatch the dir
 #if defined(__WXGTK__)
-	inotify_rm_watch(m_fd, pDirInfo->GetWD());
+	// Remove the watches for all subdirs
+	for (map<int, Watch>::iterator w = m_watches.begin(); w != m_watches.end();) {
+		if (w->second.info == pDirInfo) {
+			inotify_rm_watch(m_fd, w->first);
+			m_watchedPaths.erase(w->second.path);
+			m_watches.erase(w++);
+		}
+		else ++w;
+	}
+
+	// Drop pending changes (the handler may be going away)
+	for (vector<Change>::iterator c = m_changes.begin(); c != m_changes.end(); ++c) {
+		if (c->info == pDirInfo) c->info = NULL;
+	}
+	for (vector<Watch>::iterator d = m_toWalk.begin(); d != m_toWalk.end();) {
+		if (d->info == pDirInfo) d = m_toWalk.erase(d);
+		else ++d;
+	}
+	if (m_moveInfo == pDirInfo) m_moveInfo = NULL;
 #elif defined(__WXMSW__)
 	pDirInfo->UnwatchDirectory(m_hCompPort);
 #endif
@@ -423,46 +431,16 @@ void DirWatcher::UnwatchDirectory(void* handle) {
 	delete pDirInfo;
 }
 
-#ifdef __WXGTK__
-void DirWatcher::UnwatchDirByName(const wxString& path, bool unwatchSubDir /* = false */) {
-	DirWatchInfo * pDirInfo;
-	wxLogDebug(wxT("DirWatcher::%s() path=%s"), wxString(__FUNCTION__, wxConvUTF8).c_str(), path.c_str());
-	for (unsigned int i = 0; i < m_dirsWatched.size(); ++i) {
-		if((pDirInfo = m_dirsWatched[i]) != NULL ) {
-			bool isNeedToRemove = false;
-			if (true == unwatchSubDir) {
-				// remove it in case of child directory
-				if (-1 != pDirInfo->GetPath().Find(path.c_str())) {
-					isNeedToRemove = true;
-					wxLogDebug(wxT("DirWatcher::%s() remove subdir"), wxString(__FUNCTION__,
-						 wxConvUTF8).c_str());
-				}
-			}
-			if ((pDirInfo->GetPath() == path) || (true == isNeedToRemove)) {
-				// this one
-				std::vector<DirWatchInfo*>::iterator p = find(m_dirsWatched.begin(),
-					m_dirsWatched.end(), pDirInfo);
-				if (p != m_dirsWatched.end()) {
-					m_dirsWatched.erase(p);
-				}
-			}
-		}
-	}
-
-}
-#endif
-
 void DirWatcher::UnwatchAllDirectories() {
 	DirWatchInfo * pDirInfo;
 #if defined(__WXGTK__)
 	wxLogDebug(wxT("DirWatcher::%s()"), wxString(__FUNCTION__, wxConvUTF8).c_str());
-	for(unsigned int i = 0; i < m_dirsWatched.size(); ++i) {
-		if( (pDirInfo = m_dirsWatched[i]) != NULL ) {
+	const std::vector<DirWatchInfo*> dirsWatched = m_dirsWatched;
+	for(unsigned int i = 0; i < dirsWatched.size(); ++i) {
+		if( (pDirInfo = dirsWatched[i]) != NULL ) {
 			UnwatchDirectory(pDirInfo);
-			m_dirsWatched[i] = NULL;
 		}
 	}
-	m_dirsWatched.clear();
 #elif defined(__WXMSW__)
 	wxASSERT(m_hCompPort);
 
@@ -486,29 +464,364 @@ void DirWatcher::UnwatchAllDirectories() {
 }
 
 #ifdef __WXGTK__
-wxEvtHandler* DirWatcher::getEvtHandlerByWD(int desc) {
-	wxEvtHandler *res = NULL;
-	for(unsigned int i = 0; i < m_dirsWatched.size(); ++i) {
-		if (NULL != m_dirsWatched[i]) {
-			if(desc == m_dirsWatched[i]->GetWD()) {
-				res = &m_dirsWatched[i]->GetHandler();
-				break;
+void DirWatcher::WakeThread() {
+	while (-1 == write(m_wakePipe[1], "w", 1)) {
+		if (EINTR == errno) continue;
+		if (EAGAIN != errno) wxLogDebug(wxT("write() to wake pipe failed! errno=%i (%s)"), errno, wxString(strerror(errno), wxConvUTF8).c_str());
+		break; // if full, the thread will wake up anyway
+	}
+}
+
+bool DirWatcher::DrainWakePipe() {
+	char buf[64];
+	while (true) {
+		const ssize_t len = read(m_wakePipe[0], buf, sizeof(buf));
+		if (len > 0) continue;
+		if (-1 == len && EINTR == errno) continue;
+		if (-1 == len && EAGAIN == errno) return true; // empty
+		return false; // closed or failed
+	}
+}
+
+long DirWatcher::GetSendDelay() const {
+	const long now = m_clock.Time();
+	long delay = (long)COALESCE_DELAY - (now - m_lastEvent);
+
+	// A flood is held back until it is over, as
+	// there is only a single rescan to send anyway
+	if (!m_isFlooded) {
+		const long maxDelay = (long)COALESCE_MAXDELAY - (now - m_batchStart);
+		if (maxDelay < delay) delay = maxDelay;
+	}
+
+	return delay;
+}
+
+void DirWatcher::ReadEvents() {
+	union {
+		long m_alignment; // events have to be aligned
+		char buf[BUF_LEN];
+	} buffer;
+
+	const ssize_t len = read(m_fd, buffer.buf, BUF_LEN);
+	if (len <= 0) return;
+
+	wxCriticalSectionLocker lock(m_watchLock);
+
+	const long now = m_clock.Time();
+	if (m_batchStart == -1) m_batchStart = now;
+	m_lastEvent = now;
+
+	for (ssize_t i = 0; i < len;) {
+		const inotify_event* pEvent = (const inotify_event*)&buffer.buf[i];
+		AddEvent(*pEvent);
+		i += EVENT_SIZE + pEvent->len; //process next event
+	}
+}
+
+void DirWatcher::AddEvent(const inotify_event& event) {
+	// Events have been lost, so all dirs have to be rescanned
+	if (event.mask & IN_Q_OVERFLOW) {
+		wxLogDebug(wxT("DirWatcher: event queue overflow"));
+		ResolveMove();
+
+		// The rescans make the pending changes redundant
+		for (vector<Change>::iterator c = m_changes.begin(); c != m_changes.end(); ++c) c->info = NULL;
+		m_lastChange.clear();
+
+		for (vector<DirWatchInfo*>::const_iterator p = m_dirsWatched.begin(); p != m_dirsWatched.end(); ++p) {
+			Rescan(*p, (*p)->path);
+
+			// New subdirs may also have been missed
+			if ((*p)->watchSubDirs) {
+				const Watch dir = {*p, (*p)->path};
+				m_toWalk.push_back(dir);
+			}
+		}
+		return;
+	}
+
+	map<int, Watch>::iterator w = m_watches.find(event.wd);
+	if (w == m_watches.end()) return; // already unwatched
+
+	// The dir is gone (or unwatched)
+	if (event.mask & IN_IGNORED) {
+		m_watchedPaths.erase(w->second.path);
+		m_watches.erase(w);
+		return;
+	}
+	if (event.len == 0) return; // changes to a dir are reported by its parent
+
+	DirWatchInfo* info = w->second.info;
+	const wxString name(event.name, wxConvUTF8);
+	const wxString path = w->second.path + wxT("/") + name;
+	const bool isDir = (event.mask & IN_ISDIR) != 0;
+	const bool watchDir = isDir && info->watchSubDirs && !name.StartsWith(wxT("."));
+
+	// A move is reported as a pair of events with the same cookie
+	if (m_moveInfo) {
+		if (!(event.mask & IN_MOVED_TO) || event.cookie != m_moveCookie || m_moveInfo != info) ResolveMove();
+	}
+
+	if (event.mask & IN_CREATE) {
+		AddChange(info, DIRWATCHER_FILE_ADDED, path, wxEmptyString, isDir);
+		if (watchDir) {
+			const Watch dir = {info, path};
+			m_toWalk.push_back(dir);
+		}
+	}
+	else if (event.mask & IN_DELETE) {
+		AddChange(info, DIRWATCHER_FILE_REMOVED, path, wxEmptyString, isDir);
+	}
+	else if (event.mask & IN_MODIFY) {
+		AddChange(info, DIRWATCHER_FILE_MODIFIED, path, wxEmptyString, isDir);
+	}
+	else if (event.mask & IN_MOVED_FROM) {
+		m_moveCookie = event.cookie;
+		m_moveInfo = info;
+		m_movePath = path;
+		m_moveIsDir = isDir;
+	}
+	else if (event.mask & IN_MOVED_TO) {
+		if (m_moveInfo) {
+			// The watches move with the dir
+			if (isDir) MoveWatches(m_movePath, path);
+			AddChange(info, DIRWATCHER_FILE_RENAMED, m_movePath, path, isDir);
+			m_moveInfo = NULL;
+		}
+		else {
+			// Moved here from outside the watched dirs
+			AddChange(info, DIRWATCHER_FILE_ADDED, path, wxEmptyString, isDir);
+			if (watchDir) {
+				const Watch dir = {info, path};
+				m_toWalk.push_back(dir);
 			}
 		}
 	}
-	return res;
 }
-DirWatcher::DirWatchInfo* DirWatcher::getDirWatchInfoByWD(int desc) {
-	DirWatcher::DirWatchInfo* res = NULL;
-	for(unsigned int i = 0; i < m_dirsWatched.size(); ++i) {
-		if (NULL != m_dirsWatched[i]) {
-			if(desc == m_dirsWatched[i]->GetWD()) {
-				res = m_dirsWatched[i];
+
+void DirWatcher::ResolveMove() {
+	if (!m_moveInfo) return;
+
+	// No IN_MOVED_TO, so it was moved out of the watched dirs
+	if (m_moveIsDir) RemoveWatches(m_movePath);
+	AddChange(m_moveInfo, DIRWATCHER_FILE_REMOVED, m_movePath, wxEmptyString, m_moveIsDir);
+	m_moveInfo = NULL;
+}
+
+void DirWatcher::AddChange(DirWatchInfo* info, int changeType, const wxString& path, const wxString& newPath, bool isDir) {
+	// When flooded we only keep track of where the changes are
+	if (!info->rescanPath.empty()) {
+		Rescan(info, path.BeforeLast(wxT('/')));
+		if (changeType == DIRWATCHER_FILE_RENAMED) Rescan(info, newPath.BeforeLast(wxT('/')));
+		return;
+	}
+
+	if (changeType == DIRWATCHER_FILE_RENAMED) {
+		// Changes before a rename can not be merged with changes after it
+		m_lastChange.clear();
+	}
+	else {
+		// Merge with the last change to the same path
+		map<wxString, size_t>::iterator p = m_lastChange.find(path);
+		if (p != m_lastChange.end() && m_changes[p->second].info == info) {
+			Change& last = m_changes[p->second];
+
+			switch (changeType) {
+			case DIRWATCHER_FILE_ADDED:
+				if (last.changeType == DIRWATCHER_FILE_REMOVED && !isDir && !last.isDir) {
+					last.changeType = DIRWATCHER_FILE_MODIFIED; // replaced
+					return;
+				}
+				break;
+
+			case DIRWATCHER_FILE_MODIFIED:
+				if (last.changeType == DIRWATCHER_FILE_ADDED || last.changeType == DIRWATCHER_FILE_MODIFIED) return;
+				break;
+
+			case DIRWATCHER_FILE_REMOVED:
+				if (last.changeType == DIRWATCHER_FILE_ADDED) {
+					// Never seen, so neither has to be sent
+					last.info = NULL;
+					m_lastChange.erase(p);
+					--info->changeCount;
+					return;
+				}
+				if (last.changeType == DIRWATCHER_FILE_MODIFIED) {
+					last.changeType = DIRWATCHER_FILE_REMOVED;
+					last.isDir = isDir;
+					return;
+				}
 				break;
 			}
 		}
 	}
-	return res;
+
+	const Change change = {info, changeType, path, newPath, isDir};
+	m_changes.push_back(change);
+	if (changeType != DIRWATCHER_FILE_RENAMED) m_lastChange[path] = m_changes.size()-1;
+
+	// Too many changes to send one by one, so instead the
+	// handler rescans the dir that contains all of them
+	if (++info->changeCount > RESCAN_LIMIT) {
+		for (vector<Change>::iterator c = m_changes.begin(); c != m_changes.end(); ++c) {
+			if (c->info != info) continue;
+
+			Rescan(info, c->path.BeforeLast(wxT('/')));
+			if (c->changeType == DIRWATCHER_FILE_RENAMED) Rescan(info, c->newPath.BeforeLast(wxT('/')));
+			c->info = NULL;
+		}
+		m_lastChange.clear();
+	}
+}
+
+void DirWatcher::Rescan(DirWatchInfo* info, const wxString& path) {
+	m_isFlooded = true;
+
+	wxString& rescanPath = info->rescanPath;
+	if (rescanPath.empty()) rescanPath = path;
+
+	// Find the dir containing both
+	while (rescanPath.size() > info->path.size()) {
+		if (path.StartsWith(rescanPath) && (path.size() == rescanPath.size() || path[rescanPath.size()] == wxT('/'))) return;
+		rescanPath = rescanPath.BeforeLast(wxT('/'));
+	}
+
+	// Never above the watched dir
+	rescanPath = info->path;
+}
+
+void DirWatcher::SendChanges() {
+	ResolveMove();
+
+	wxDirWatcherEvent event;
+
+	for (vector<Change>::const_iterator p = m_changes.begin(); p != m_changes.end(); ++p) {
+		if (!p->info) continue; // merged or unwatched
+
+		event.SetChangeType(p->changeType);
+		event.SetChangedFile(p->path);
+		event.SetNewFile(p->newPath);
+		event.SetDirFlag(p->isDir);
+		p->info->handler.AddPendingEvent(event); // Send the event
+	}
+
+	for (vector<DirWatchInfo*>::iterator p = m_dirsWatched.begin(); p != m_dirsWatched.end(); ++p) {
+		DirWatchInfo& info = **p;
+		if (!info.rescanPath.empty()) {
+			event.SetChangeType(DIRWATCHER_RESCAN);
+			event.SetChangedFile(info.rescanPath);
+			event.SetNewFile(wxEmptyString);
+			event.SetDirFlag(true);
+			info.handler.AddPendingEvent(event);
+			info.rescanPath.clear();
+		}
+		info.changeCount = 0;
+	}
+
+	m_changes.clear();
+	m_lastChange.clear();
+	m_batchStart = -1;
+	m_isFlooded = false;
+}
+
+void DirWatcher::WalkDirs(const vector<Watch>& dirs) {
+	// Called without lock, as walking big trees takes a while
+	vector<Watch> stack(dirs);
+	while (!stack.empty()) {
+		const Watch dir = stack.back();
+		stack.pop_back();
+		{
+			wxCriticalSectionLocker lock(m_watchLock);
+			if (!IsWatched(dir.info)) continue; // unwatched while walking
+			if (!AddWatch(dir.info, dir.path)) continue;
+		}
+
+		DIR* pDir = opendir(dir.path.mb_str(wxConvUTF8));
+		if (!pDir) continue;
+
+		while (const struct dirent* pEntry = readdir(pDir)) {
+			// Hidden dirs are not watched (they are not in the project either)
+			if (pEntry->d_name[0] == '.') continue;
+
+			const wxString path = dir.path + wxT("/") + wxString(pEntry->d_name, wxConvUTF8);
+			bool isDir = (pEntry->d_type == DT_DIR);
+			if (pEntry->d_type == DT_UNKNOWN) {
+				struct stat st;
+				isDir = (0 == lstat(path.mb_str(wxConvUTF8), &st) && S_ISDIR(st.st_mode));
+			}
+
+			if (isDir) {
+				const Watch subDir = {dir.info, path};
+				stack.push_back(subDir);
+			}
+		}
+		closedir(pDir);
+	}
+}
+
+bool DirWatcher::AddWatch(DirWatchInfo* info, const wxString& path) {
+	if (m_watchedPaths.find(path) != m_watchedPaths.end()) return true;
+
+	const int wd = inotify_add_watch(m_fd, path.mb_str(wxConvUTF8), WATCH_MASK);
+	if (0 > wd) {
+		// ENOSPC means that max_user_watches is reached
+		wxLogDebug(wxT("inotify_add_watch() failed! errno=%i (%s)"), errno, wxString(strerror(errno), wxConvUTF8).c_str());
+		return false;
+	}
+
+	// Same dir may have been watched under another path
+	map<int, Watch>::iterator p = m_watches.find(wd);
+	if (p != m_watches.end()) m_watchedPaths.erase(p->second.path);
+
+	const Watch watch = {info, path};
+	m_watches[wd] = watch;
+	m_watchedPaths[path] = wd;
+	return true;
+}
+
+void DirWatcher::RemoveWatches(const wxString& path) {
+	const wxString prefix = path + wxT("/");
+
+	map<wxString, int>::iterator p = m_watchedPaths.find(path);
+	if (p != m_watchedPaths.end()) {
+		inotify_rm_watch(m_fd, p->second);
+		m_watches.erase(p->second);
+		m_watchedPaths.erase(p);
+	}
+
+	p = m_watchedPaths.lower_bound(prefix);
+	while (p != m_watchedPaths.end() && p->first.StartsWith(prefix)) {
+		inotify_rm_watch(m_fd, p->second);
+		m_watches.erase(p->second);
+		m_watchedPaths.erase(p++);
+	}
+}
+
+void DirWatcher::MoveWatches(const wxString& path, const wxString& newPath) {
+	const wxString prefix = path + wxT("/");
+
+	// Collect the watches for dir and subdirs
+	vector<pair<wxString, int> > moved;
+	map<wxString, int>::iterator p = m_watchedPaths.find(path);
+	if (p != m_watchedPaths.end()) {
+		moved.push_back(make_pair(newPath, p->second));
+		m_watchedPaths.erase(p);
+	}
+	p = m_watchedPaths.lower_bound(prefix);
+	while (p != m_watchedPaths.end() && p->first.StartsWith(prefix)) {
+		moved.push_back(make_pair(newPath + p->first.substr(path.size()), p->second));
+		m_watchedPaths.erase(p++);
+	}
+
+	for (vector<pair<wxString, int> >::const_iterator m = moved.begin(); m != moved.end(); ++m) {
+		m_watchedPaths[m->first] = m->second;
+		m_watches[m->second].path = m->first;
+	}
+}
+
+bool DirWatcher::IsWatched(const DirWatchInfo* info) const {
+	return find(m_dirsWatched.begin(), m_dirsWatched.end(), info) != m_dirsWatched.end();
 }
 #endif
 
@@ -20,8 +20,13 @@
 #endif
 
 #include <wx/thread.h>
+#include <wx/stopwatch.h>
 
 #include <vector>
+#ifdef __WXGTK__
+#include <map>
+struct inotify_event;
+#endif
 
 #define READ_DIR_CHANGE_BUFFER_SIZE 4096
 
@@ -32,9 +37,6 @@ public:
 
 	void* WatchDirectory(const wxString& path, wxEvtHandler& changeHandler, bool watchSubDirs);
 	void UnwatchDirectory(void* handle);
-#ifdef __WXGTK__
-	void UnwatchDirByName(const wxString& path, bool unwatchSubDir = false);
-#endif
 	void UnwatchAllDirectories();
 
 	virtual void* Entry();
@@ -42,21 +44,75 @@ public:
 private:
 #if defined(__WXGTK__)
 	int m_fd; // file descriptor associated with inotify event
+	int m_wakePipe[2]; // wakes the thread when there are dirs to walk
 
+	// A dir watched on request (subdirs get their own watches)
 	class DirWatchInfo {
 	public:
-		DirWatchInfo(int desc, wxEvtHandler& hndl, const wxString& dir) : wd(desc), handler(hndl), path(dir) {};
-		int GetWD() {return wd;};
-		wxEvtHandler& GetHandler() {return handler;};
-		wxString GetPath() {return path;};
-	private:
-		int wd;
+		DirWatchInfo(wxEvtHandler& hndl, const wxString& dir, bool subDirs)
+		: handler(hndl), path(dir.c_str()), watchSubDirs(subDirs), changeCount(0) {};
+
 		wxEvtHandler& handler;
+		const wxString path;
+		const bool watchSubDirs;
+
+		// Coalescing (in current batch)
+		unsigned int changeCount;
+		wxString rescanPath; // set when too many changes to send
+	};
+
+	struct Watch {
+		DirWatchInfo* info;
+		wxString path;
+	};
+
+	struct Change {
+		DirWatchInfo* info;
+		int changeType;
 		wxString path;
+		wxString newPath;
+		bool isDir;
 	};
 
-	wxEvtHandler* getEvtHandlerByWD(int desc);
-	DirWatcher::DirWatchInfo* getDirWatchInfoByWD(int desc);
+	void WakeThread();
+	bool DrainWakePipe();
+	long GetSendDelay() const;
+	void ReadEvents();
+	void AddEvent(const inotify_event& event);
+	void AddChange(DirWatchInfo* info, int changeType, const wxString& path, const wxString& newPath, bool isDir);
+	void ResolveMove();
+	void SendChanges();
+	void Rescan(DirWatchInfo* info, const wxString& path);
+
+	void WalkDirs(const std::vector<Watch>& dirs);
+	bool AddWatch(DirWatchInfo* info, const wxString& path);
+	void RemoveWatches(const wxString& path);
+	void MoveWatches(const wxString& path, const wxString& newPath);
+	bool IsWatched(const DirWatchInfo* info) const;
+
+	static const unsigned int COALESCE_DELAY;
+	static const unsigned int COALESCE_MAXDELAY;
+	static const unsigned int RESCAN_LIMIT;
+
+	// Watches (guarded by m_watchLock)
+	mutable wxCriticalSection m_watchLock;
+	std::map<int, Watch> m_watches; // by watch descriptor
+	std::map<wxString, int> m_watchedPaths;
+	std::vector<Watch> m_toWalk; // dirs to watch with their subdirs
+
+	// Pending changes (also guarded by m_watchLock)
+	std::vector<Change> m_changes;
+	std::map<wxString, size_t> m_lastChange; // index in m_changes by path
+	wxStopWatch m_clock;
+	long m_batchStart; // -1 if no changes
+	long m_lastEvent;
+	bool m_isFlooded; // some dirs will be rescanned
+
+	// Pending move (waiting for the IN_MOVED_TO with same cookie)
+	unsigned int m_moveCookie;
+	DirWatchInfo* m_moveInfo;
+	wxString m_movePath;
+	bool m_moveIsDir;
 
 #elif defined(__WXMSW__)
 	class DirWatchInfo {
@@ -118,7 +174,8 @@ enum {
 	DIRWATCHER_FILE_ADDED,
 	DIRWATCHER_FILE_REMOVED,
 	DIRWATCHER_FILE_MODIFIED,
-	DIRWATCHER_FILE_RENAMED
+	DIRWATCHER_FILE_RENAMED,
+	DIRWATCHER_RESCAN // changes in dir not known (too many or lost)
 };
 
 // Declare custom event
@@ -16,11 +16,19 @@
 #include <wx/fontmap.h>
 #include <wx/wfstream.h>
 #include "doc_byte_iter.h"
+#include "doc_chunk_iter.h"
+#include "LiteralMatcher.h"
+#include "RegexCache.h"
 #include "cx_pcre.h"
 #include "Utf.h"
 #include "eSettings.h"
 #include "Strings.h"
 #include "eDocumentPath.h"
+#include "NewlineScanner.h"
+#include "ILoadProgress.h"
+
+// Initializing static constants
+const unsigned int Document::LOADCHUNKSIZE = 1024*1024;
 
 
 Document::Document(const doc_id& di, CatalystWrapper cw):
@@ -28,7 +36,6 @@ Document::Document(const doc_id& di, CatalystWrapper cw):
 	dispatcher(cw.GetDispatcher()),
 	do_notify(true),
 	m_textData(cw.m_catalyst),
-	m_re(NULL),
 	m_trackChanges(NULL)
 {
 	SetDocument(di);
@@ -43,7 +50,6 @@ Document::Document(CatalystWrapper cw):
 	m_docId(DRAFT,-1,-1),
 	do_notify(true),
 	m_textData(cw.m_catalyst),
-	m_re(NULL),
 	m_trackChanges(NULL)
 {
 	// Make sure we get notified if the document gets deleted
@@ -55,9 +61,6 @@ Document::~Document() {
 
 	// Do standard clean-up
 	if (IsOk()) Close();
-
-	// Clean up stuff not handled by Close()
-	if (m_re) free(m_re); // check if we have a cached regex
 }
 
 
@@ -398,7 +401,20 @@ void Document::Clear(bool initialRevision) {
 	if (initialRevision) NewRevision();
 }
 
-cxFileResult Document::LoadText(const wxFileName& path, vector<unsigned int>& offsets, wxFontEncoding enc, const wxString& mirror) {
+// Returns end if there are no null chars
+static const char* FindNullChar(const char* start, const char* end, unsigned int char_len) {
+	if (char_len == 1) {
+		const char* const p = (const char*)memchr(start, '\0', end - start);
+		return p ? p : end;
+	}
+
+	for (const char* p = start; p + char_len <= end; p += char_len) {
+		if (memcmp("\0\0\0\0", p, char_len) == 0) return p;
+	}
+	return end;
+}
+
+cxFileResult Document::LoadText(const wxFileName& path, vector<unsigned int>& offsets, wxFontEncoding enc, const wxString& mirror, ILoadProgress* progress) {
 	wxASSERT(IsOk());
 	wxASSERT(path.IsOk());
 	wxASSERT(path.IsAbsolute());
@@ -515,65 +531,21 @@ cxFileResult Document::LoadText(const wxFileName& path, vector<unsigned int>& of
 	// Pre-reserve entries to avoid unneeded allocs in vector
 	offsets.reserve(len/35);
 
+	// The text is converted and saved a chunk at a time, while
+	// the scanner converts and counts newlines
+	NewlineScanner scanner(offsets);
+	vector<char> chunk;
 	unsigned int pos = 0;
-	unsigned int nl_count_dos = 0;
-	unsigned int nl_count_mac = 0;
-	unsigned int nl_count_unix = 0;
 
 	if (enc == wxFONTENCODING_UTF8) {
-		// Convert and save one line at a time while counting newlines
-		char nl = '\n';
-		bool prev_r = false;
-		int linestart = 0;
-		int utf_bytes = 0;
-
-		for (off_t i = 0; i < len; ++i) {
-			const char c = bufptr[i];
-
-			// Detect invalid UTF-8 sequences
-			if (utf_bytes == 0) {
-				if ((c & 0xC0) == 0x80 || c == 0) goto decode_error;
-				else {
-					utf_bytes = utf8_len(c) - 1;
-					if (utf_bytes > 3) goto decode_error;
-				}
-			}
-			else if ((c & 0xC0) == 0x80) --utf_bytes;
-			else goto decode_error;
-
-			switch (c) {
-			case '\r':
-				if (prev_r) ++nl_count_mac;
-				bufferfile.Write(&bufptr[linestart], i - linestart);
-				pos += i - linestart;
-				bufferfile.Write(&nl, 1); ++pos;
-				offsets.push_back(pos);
-				linestart = i+1;
-				prev_r = true;
-				break;
-
-			case '\n':
-				if (!prev_r) {
-					++nl_count_unix;
-					bufferfile.Write(&bufptr[linestart], (i - linestart)+1);
-					pos += (i - linestart)+1;
-					offsets.push_back(pos);
-				} else ++nl_count_dos;
-				linestart = i+1;
-				prev_r = false;
-				break;
+		for (wxFileOffset i = 0; i < len; i += LOADCHUNKSIZE) {
+			const size_t chunk_len = (size_t)wxMin(len - i, (wxFileOffset)LOADCHUNKSIZE);
 
-			default:
-				if (prev_r) ++nl_count_mac;
-				prev_r = false;
-			}
-		}
+			chunk.clear();
+			if (!scanner.Scan(&bufptr[i], chunk_len, chunk)) goto decode_error; // invalid utf-8
+			if (!chunk.empty()) bufferfile.Write(&*chunk.begin(), chunk.size());
 
-		// Add text after last newline
-		if (linestart < len) {
-			bufferfile.Write(&bufptr[linestart], len - linestart);
-			pos += len - linestart;
-			offsets.push_back(pos);
+			if (progress) progress->OnLoadProgress((unsigned int)(i + chunk_len), (unsigned int)len);
 		}
 	}
 	else {
@@ -584,104 +556,87 @@ cxFileResult Document::LoadText(const wxFileName& path, vector<unsigned int>& of
 		wxWCharBuffer wchar_buff(wchar_buff_len);
 		size_t utf8_buff_len = 128;
 		wxCharBuffer utf8_buff(utf8_buff_len);
+		vector<char> converted;
 
 		// Initialize variables
 		wxCSConv conv(enc);
 		unsigned int char_len;
-		const char* nulls = "\0\0\0\0";
 		const char* nl;
-		const char* cr;
 		switch (enc) {
 		case wxFONTENCODING_UTF32BE:
 			char_len = 4;
 			nl = "\x00\x00\x00\x0A";
-			cr = "\x00\x00\x00\x0D";
 			break;
 		case wxFONTENCODING_UTF32LE:
 			char_len = 4;
 			nl = "\x0A\x00\x00\x00";
-			cr = "\x0D\x00\x00\x00";
 			break;
 		case wxFONTENCODING_UTF16BE:
 			char_len = 2;
 			nl = "\x00\x0A";
-			cr = "\x00\x0D";
 			break;
 		case wxFONTENCODING_UTF16LE:
 			char_len = 2;
 			nl = "\x0A\x00";
-			cr = "\x0D\x00";
 			break;
 		default:
 			char_len = 1;
 			nl = "\n";
-			cr = "\r";
 		}
 
-		// Convert and save one line at a time while counting newlines
-		bool prev_r = false;
-		int linestart = 0;
-		for (off_t i = 0; i < len; i += char_len) {
-			if (memcmp(cr, &bufptr[i], char_len) == 0)  { // '\r'
-				if (prev_r) ++nl_count_mac;
-				if (i - linestart > 0) {
-					size_t convlen = ConvertToUTF8(&bufptr[linestart], i - linestart, conv, temp_buff, temp_buff_len, wchar_buff, wchar_buff_len, utf8_buff, utf8_buff_len, char_len);
-					if (convlen == (size_t)-1) goto decode_error; // conversion failed
-					bufferfile.Write(utf8_buff, convlen);
-					pos += convlen;
-				}
-				bufferfile.Write("\n", 1); pos += 1;
-				offsets.push_back(pos);
-				linestart = i+char_len;
-				prev_r = true;
-			}
-			else if (memcmp(nl, &bufptr[i], char_len) == 0)  { // '\n'
-				if (!prev_r) {
-					++nl_count_unix;
-					size_t convlen = ConvertToUTF8(&bufptr[linestart], (i - linestart)+char_len, conv, temp_buff, temp_buff_len, wchar_buff, wchar_buff_len, utf8_buff, utf8_buff_len, char_len);
-					if (convlen == (size_t)-1) goto decode_error; // conversion failed
-					bufferfile.Write(utf8_buff, convlen);
-					pos += convlen;
-					offsets.push_back(pos);
-				} else ++nl_count_dos;
-				linestart = i+char_len;
-				prev_r = false;
+		// Convert a chunk of whole lines at a time
+		off_t chunk_start = 0;
+		while (chunk_start < len) {
+			// Find first newline after chunk size
+			off_t chunk_end = len;
+			if (len - chunk_start > (off_t)LOADCHUNKSIZE) {
+				chunk_end = chunk_start + LOADCHUNKSIZE - (LOADCHUNKSIZE % char_len);
+				while (chunk_end < len && memcmp(nl, &bufptr[chunk_end - char_len], char_len) != 0) chunk_end += char_len;
+				if (chunk_end > len) chunk_end = len;
 			}
-			else if (memcmp(nulls, &bufptr[i], char_len) == 0) { // conversion fails on null bytes
-				if (i - linestart > 0) {
-					size_t convlen = ConvertToUTF8(&bufptr[linestart], i - linestart, conv, temp_buff, temp_buff_len, wchar_buff, wchar_buff_len, utf8_buff, utf8_buff_len, char_len);
+
+			// Conversion fails on null bytes, so these are converted separately
+			converted.clear();
+			const char* const end = bufptr + chunk_end;
+			const char* segstart = bufptr + chunk_start;
+			for (;;) {
+				const char* const null_char = FindNullChar(segstart, end, char_len);
+
+				if (segstart < null_char) {
+					const size_t convlen = ConvertToUTF8(segstart, null_char - segstart, conv, temp_buff, temp_buff_len, wchar_buff, wchar_buff_len, utf8_buff, utf8_buff_len, char_len);
 					if (convlen == (size_t)-1) goto decode_error; // conversion failed
-					bufferfile.Write(utf8_buff, convlen);
-					pos += convlen;
+					converted.insert(converted.end(), utf8_buff.data(), utf8_buff.data() + convlen);
 				}
-				bufferfile.Write("\xEF\xA3\xBF", 3); pos += 3; // Private use character as stand-in for null
-				linestart = i+char_len;
-				prev_r = false;
+				if (null_char == end) break;
+
+				const char* const null_standin = "\xEF\xA3\xBF"; // Private use character as stand-in for null
+				converted.insert(converted.end(), null_standin, null_standin + 3);
+				segstart = null_char + char_len;
 			}
-			else {
-				if (prev_r) ++nl_count_mac;
-				prev_r = false;
+
+			chunk.clear();
+			if (!converted.empty()) {
+				if (!scanner.Scan(&*converted.begin(), converted.size(), chunk)) goto decode_error;
+				if (!chunk.empty()) bufferfile.Write(&*chunk.begin(), chunk.size());
 			}
-		}
 
-		// Add text after last newline
-		if (linestart < len) {
-			size_t convlen = ConvertToUTF8(&bufptr[linestart], len - linestart, conv, temp_buff, temp_buff_len, wchar_buff, wchar_buff_len, utf8_buff, utf8_buff_len, char_len);
-			if (convlen == (size_t)-1) goto decode_error; // conversion failed
-			bufferfile.Write(utf8_buff, convlen);
-			pos += convlen;
-			offsets.push_back(pos);
+			chunk_start = chunk_end;
+			if (progress) progress->OnLoadProgress((unsigned int)chunk_start, (unsigned int)len);
 		}
-
-		// With null bytes in the text the end offset might not have been set yet.
-		if (pos && (offsets.empty() || offsets.back() != pos)) offsets.push_back(pos);
 	}
+	scanner.Finish();
+	pos = scanner.GetLength();
+
 	if (buff_offset + pos != bufferfile.Length()) goto decode_error;
 
 	// Close buffer file to ensure changes af flushed to disk
 	bufferfile.Close();
 
 	// Create the new revision
+	// TODO: Show the first screen before the tail is loaded. This needs the
+	// revision to be created after the first chunk and extended (before it
+	// is frozen) as the rest is written, with the offsets of each chunk
+	// handed to Lines through the progress interface.
 	StartChange();
 	{
 		// We want the new revision to either be the first (base) revision
@@ -706,6 +661,9 @@ cxFileResult Document::LoadText(const wxFileName& path, vector<unsigned int>& of
 		SetPropertyName(filename);
 
 		// Determine newline type
+		const unsigned int nl_count_dos = scanner.GetDosCount();
+		const unsigned int nl_count_unix = scanner.GetUnixCount();
+		const unsigned int nl_count_mac = scanner.GetMacCount();
 		wxTextFileType nl_type = wxTextFileType_None;
 		if (nl_count_dos >= nl_count_unix && nl_count_dos >= nl_count_mac) nl_type = wxTextFileType_Dos;
 		else if (nl_count_unix >= nl_count_dos && nl_count_unix >= nl_count_mac) nl_type = wxTextFileType_Unix;
@@ -1047,9 +1005,12 @@ void Document::GetLines(vector<unsigned int>& list) const {
 
 	list.reserve(len/35); // Aprox characters per line.
 
-	for (doc_byte_iter subject(*this); subject.GetIndex() < len; ++subject) {
-		if (*subject == '\n') // Lines end right after newlines
-			list.push_back(subject.GetIndex()+1);
+	for (doc_chunk_iter chunk(*this, 0, len); !chunk.AtEnd(); ++chunk) {
+		const char* const end = chunk.end();
+		for (const char* p = chunk.begin(); (p = (const char*)memchr(p, '\n', end - p)) != NULL; ++p) {
+			// Lines end right after newlines
+			list.push_back(chunk.GetStart() + (p - chunk.begin()) + 1);
+		}
 	}
 
 	// If the text does not end with a newline, put the rest of the text in as the last
@@ -1340,44 +1301,16 @@ search_result Document::RegExFind(const wxString& searchtext, int start_pos, boo
 	int options = PCRE_UTF8|PCRE_MULTILINE;
 	if (!matchcase) options |= PCRE_CASELESS;
 
-	// Check if we have the regex cached
-	if (m_re) {
-		if (searchtext == m_regex_cache && options == m_options_cache) {
-			// We might want the study the regex the first time we end here
-		}
-		else {
-			free(m_re);
-			m_re = NULL;
-		}
-	}
-
-	// Compile the pattern
-	if (!m_re) {
-		const char *error;
-		int erroffset;
-
-		m_re = pcre_compile(
-			searchtext.mb_str(wxConvUTF8),   // the pattern
-			options,              // options
-			&error,               // for error message
-			&erroffset,           // for error offset
-			NULL);                // use default character tables
-
-		if (m_re == 0) {
-			search_result sr;
-			sr.error_code = -4; // invalid pattern
-			return sr;
-		}
-		else {
-			// The compiled regex (m_re) is cached for possible reuse in next search
-			// it is finally free'd in destructor
-			m_options_cache = options;
-			m_regex_cache = searchtext;
-		}
+	// Get the compiled pattern (from cache if available)
+	const CompiledRegex re = RegexCache::Get().Lookup(searchtext, options);
+	if (!re.IsOk()) {
+		search_result sr;
+		sr.error_code = -4; // invalid pattern
+		return sr;
 	}
 
 	// Do the search
-	return RegExFind(m_re, NULL, start_pos, captures, end_pos);
+	return RegExFind(re.GetPattern(), re.GetStudy(), start_pos, captures, end_pos);
 }
 
 search_result Document::RegExFindBackwards(const wxString& searchtext, int start_pos, bool matchcase) const {
@@ -1467,58 +1400,30 @@ search_result Document::Find(const wxString& searchtext, int start_pos, bool mat
 	int maxsearch = GetLength() - byte_len;
 	if (start_pos > maxsearch) return sr;
 
-	unsigned int last_char_pos = byte_len-1;
-
-	// Build a dictionary of char-to-last distances in the search string
-	map<char, int> charmap;
-	map<char, int> charmap_upper;
-	for (unsigned int i = 0; i < byte_len-1; ++i) {
-		charmap[UTF8buffer[i]] = last_char_pos-i;
-		if (!matchcase) charmap_upper[UTF8bufferUpper[i]] = last_char_pos-i;
-	}
-
-	// Prepare vars to avoid lookups in loop
-	char lastChar = UTF8buffer[last_char_pos];
-	char lastCharUpper = '\0';
-	if (!matchcase) lastCharUpper = UTF8bufferUpper[last_char_pos];
-
-	// Search
-	doc_byte_iter subject(*this, start_pos + last_char_pos); // start from last char in search string
-
 	// WARNING: This algorithm assumes that UTF8 upper- & lowercase chars have same byte width
-	while (subject < end_pos) {
-		const char c = *subject; // Get candidate for last char
-
-		if (c == lastChar || (!matchcase && c == lastCharUpper)) {
-			// Match indiviual chars
-			doc_byte_iter byte_ptr = subject-1;
-			int first_byte_pos = subject.GetIndex() - last_char_pos;
-			unsigned int char_pos = last_char_pos-1;
-			while (byte_ptr.GetIndex() >= first_byte_pos) {
-				const char c2 = *byte_ptr;
-				if (c2 != UTF8buffer[char_pos]) {
-					if (matchcase || c2 != UTF8bufferUpper[char_pos]) break;
-				}
-				--byte_ptr; --char_pos;
-			}
-
-			if (byte_ptr.GetIndex() < first_byte_pos) {
-				sr.error_code = 0;
-				sr.start = first_byte_pos;
-				sr.end = sr.start + byte_len;
-				return sr; // text found!
-			}
+	const LiteralMatcher matcher(UTF8buffer.data(), matchcase ? NULL : UTF8bufferUpper.data(), byte_len);
+
+	// Search the text in chunks. The chunks overlap by the length
+	// of the pattern, so that we can find matches crossing borders.
+	const unsigned int chunk_size = wxMax(64*1024u, 2*byte_len);
+	vector<char> buffer(chunk_size);
+	const char* const chunk = &*buffer.begin();
+
+	unsigned int pos = start_pos;
+	while (pos + byte_len <= (unsigned int)end_pos) {
+		const unsigned int chunk_end = wxMin(pos + chunk_size, (unsigned int)end_pos);
+		m_textData.GetTextPart(pos, chunk_end, (unsigned char*)chunk);
+
+		const char* match = matcher.Find(chunk, chunk + (chunk_end - pos));
+		if (match) {
+			sr.error_code = 0;
+			sr.start = pos + (match - chunk);
+			sr.end = sr.start + byte_len;
+			return sr; // text found!
 		}
 
-		// If we don't have a match, see how far we can move char_pos
-		map<char, int>::iterator result = charmap.find(c);
-		map<char, int>::iterator result_upper = charmap_upper.find(c);
-		if (result != charmap.end()) subject += result->second;
-		else if (!matchcase && result_upper != charmap_upper.end()) subject += result_upper->second;
-		else subject += byte_len;
-
-		// Make sure that we end on a valid UTF8 char
-		//while ((*subject & 0xC0) == 0x80) ++subject;
+		if (chunk_end == (unsigned int)end_pos) break;
+		pos = chunk_end - (byte_len-1);
 	}
 
 	return sr; // reached end without finding text
@@ -28,6 +28,7 @@ struct real_pcre;                 // This double pre-definition is needed
 typedef struct real_pcre pcre;    // because of the way it is defined in pcre.h
 struct pcre_extra;
 class ISettings;
+class ILoadProgress;
 
 class Document {
 public:
@@ -75,7 +76,7 @@ public:
 	unsigned int GetLineEnd(unsigned int pos) const;
 
 	// Loading & Saving
-	cxFileResult LoadText(const wxFileName& path, vector<unsigned int>& offsets, wxFontEncoding enc=wxFONTENCODING_SYSTEM, const wxString& mirror=wxEmptyString);
+	cxFileResult LoadText(const wxFileName& path, vector<unsigned int>& offsets, wxFontEncoding enc=wxFONTENCODING_SYSTEM, const wxString& mirror=wxEmptyString, ILoadProgress* progress=NULL);
 	cxFileResult SaveText(const wxFileName& path, bool forceNativeEOL=false, const wxString& realpath=wxEmptyString, bool keepMirrorDate=false, bool noAtomic=false);
 	void GetLines(vector<unsigned int>& list) const;
 
@@ -169,10 +170,8 @@ private:
 	bool do_notify;
 	DataText m_textData;
 
-	// Cache of last compiled regex
-	mutable wxString m_regex_cache;
-	mutable int m_options_cache;
-	mutable pcre *m_re;
+	// Constants
+	static const unsigned int LOADCHUNKSIZE;
 
 	// Change Tracking Callback
 	void(*m_trackChanges)(cxChangeType, unsigned int, unsigned int, void*);
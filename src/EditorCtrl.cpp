@@ -17,8 +17,11 @@
 #include <wx/filename.h>
 #include <wx/tipwin.h>
 #include <wx/file.h>
+#include <wx/stopwatch.h>
+#include <wx/progdlg.h>
 
 #include <algorithm>
+#include <set>
 
 #include "pcre.h"
 
@@ -45,6 +48,10 @@
 #include "IAppPaths.h"
 #include "Strings.h"
 #include "ReplaceStringParser.h"
+#include "RegexCache.h"
+#include "LiteralMatcher.h"
+#include "FoldMatcher.h"
+#include "ILoadProgress.h"
 
 // Document Icons
 #include "document.xpm"
@@ -82,6 +89,19 @@ inline bool Isalnum(wxChar c) {
 #endif
 }
 
+// Embedded class: Gives the word index access to the document
+class EditorTextSource : public TextSource {
+public:
+	EditorTextSource(const EditorCtrl& editor) : m_editor(editor) {};
+	unsigned int GetLength() const {return m_editor.GetLength();};
+	void GetTextPart(unsigned int start, unsigned int end, vector<char>& text) const {
+		text.clear();
+		m_editor.GetTextPart(start, end, text);
+	};
+private:
+	const EditorCtrl& m_editor;
+};
+
 // Embedded class: Sort list based on bundle
 class CompareActionBundle : public binary_function<size_t, size_t, bool> {
 public:
@@ -110,6 +130,28 @@ private:
 	wxDataObjectComposite* m_dataObject;
 };
 
+// Embedded class: Shows progress when loading big files takes a while
+class LoadProgressDlg : public ILoadProgress {
+public:
+	LoadProgressDlg(wxWindow* parent, const wxString& filename)
+		: m_parent(parent), m_msg(_("Loading ") + filename), m_dlg(NULL) {};
+	~LoadProgressDlg() {delete m_dlg;};
+
+	void OnLoadProgress(unsigned int done, unsigned int total) {
+		if (!m_dlg) {
+			if (done >= total || m_timer.Time() < 500) return;
+			m_dlg = new wxProgressDialog(wxT("Progress"), m_msg, 100, m_parent, wxPD_APP_MODAL|wxPD_SMOOTH|wxPD_AUTO_HIDE);
+		}
+		m_dlg->Update((int)(((wxLongLong_t)done * 100) / total));
+	};
+
+private:
+	wxWindow* m_parent;
+	const wxString m_msg;
+	wxStopWatch m_timer;
+	wxProgressDialog* m_dlg;
+};
+
 
 enum ShellOutput {soDISCARD, soREPLACESEL, soREPLACEDOC, soINSERT, soSNIPPET, soHTML, soTOOLTIP, soNEWDOC};
 
@@ -184,8 +226,6 @@ EditorCtrl::EditorCtrl(const int page_id, CatalystWrapper& cw, wxBitmap& bitmap,
 	lastpos(0), 
 	m_currentSel(-1), 
 	do_freeze(true), 
-	m_options_cache(0), 
-	m_re(NULL), 
 	m_symbolCacheToken(0),
 
 	bookmarks(m_lines)
@@ -234,8 +274,6 @@ EditorCtrl::EditorCtrl(const doc_id di, const wxString& mirrorPath, CatalystWrap
 	lastpos(0),
 	m_currentSel(-1), 
 	do_freeze(true),
-	m_options_cache(0),
-	m_re(NULL),
 	m_symbolCacheToken(0),
 
 	bookmarks(m_lines)
@@ -298,8 +336,6 @@ EditorCtrl::EditorCtrl(CatalystWrapper& cw, wxBitmap& bitmap, wxWindow* parent,
 	lastpos(0), 
 	m_currentSel(-1), 
 	do_freeze(true), 
-	m_options_cache(0), 
-	m_re(NULL), 
 	m_symbolCacheToken(0),
 
 	bookmarks(m_lines)
@@ -365,9 +401,8 @@ void EditorCtrl::RestoreSettings(unsigned int page_id, eFrameSettings& settings,
 
 		for (vector<unsigned int>::const_iterator p = folds.begin(); p != folds.end(); ++p) {
 			const unsigned int line_id = *p;
-			const cxFold target(line_id);
-			vector<cxFold>::iterator f = lower_bound(m_folds.begin(), m_folds.end(), target);
-			if (f != m_folds.end() && f->line_id == line_id && f->type == cxFOLD_START)
+			const size_t f = m_foldIndex.Find(line_id);
+			if (f < m_foldIndex.size() && m_foldIndex.GetLine(f) == line_id && m_foldIndex.GetType(f) == cxFOLD_START)
 				Fold(*p);
 		}
 	}
@@ -441,6 +476,13 @@ void EditorCtrl::Init() {
 	m_lines.AddStyler(m_variable_hl_styler);
 	m_lines.AddStyler(m_html_hl_styler);
 
+	// Background jobs (budgets in microseconds). Wrapping and syntax
+	// affect the visible text, so they go before the document-wide jobs.
+	m_idleJobs.AddJob(wxT("lines"), IdleScheduler::PRIORITY_VIEWPORT, 10000, (IdleScheduler::JOB_CALLBACK)OnIdleLines, this);
+	m_idleJobs.AddJob(wxT("syntax"), IdleScheduler::PRIORITY_VIEWPORT, 15000, (IdleScheduler::JOB_CALLBACK)OnIdleSyntax, this);
+	m_idleJobs.AddJob(wxT("folds"), IdleScheduler::PRIORITY_DOCUMENT, 5000, (IdleScheduler::JOB_CALLBACK)OnIdleFolds, this);
+	m_idleJobs.AddJob(wxT("stylers"), IdleScheduler::PRIORITY_DOCUMENT, 5000, (IdleScheduler::JOB_CALLBACK)OnIdleStylers, this);
+
 	// Set initial tabsize
 	SetTabWidth(m_parentFrame.GetTabWidth(), m_parentFrame.IsSoftTabs());
 
@@ -2598,7 +2640,8 @@ cxFileResult EditorCtrl::LoadLinesIntoDocument(const wxString& whence_to_load, w
 	// Invalidate all stylers
 	StylersInvalidate();
 
-	return m_lines.LoadText(localPath, enc, m_remotePath);
+	LoadProgressDlg progress(&m_parentFrame, localPath.GetFullName());
+	return m_lines.LoadText(localPath, enc, m_remotePath, &progress);
 }
 
 bool EditorCtrl::SaveText(bool askforpath) {
@@ -3027,27 +3070,32 @@ interval EditorCtrl::UndoSelection(const cxDiffEntry& de) {
 void EditorCtrl::StylersClear() {
 	m_lines.StylersClear();
 	FoldingClear();
+	m_wordIndex.Clear();
 }
 
 void EditorCtrl::StylersInvalidate() {
 	m_lines.StylersInvalidate();
 	FoldingClear();
+	m_wordIndex.Clear();
 }
 
 void EditorCtrl::StylersInsert(unsigned int pos, unsigned int length) {
 	m_lines.StylersInsert(pos, length);
 	FoldingInsert(pos, length);
 	bookmarks.InsertChars(pos, length);
+	m_wordIndex.Insert(pos, length);
 }
 
 void EditorCtrl::StylersDelete(unsigned int start, unsigned int end) {
 	m_lines.StylersDelete(start, end);
 	FoldingDelete(start, end);
 	bookmarks.DeleteChars(start, end);
+	m_wordIndex.Delete(start, end);
 }
 
 void EditorCtrl::StylersApplyDiff(vector<cxChange>& changes) {
 	m_lines.StylersApplyDiff(changes);
+	m_wordIndex.ApplyDiff(changes);
 }
 
 unsigned int EditorCtrl::GetChangePos(const doc_id& old_version_id) const {
@@ -4482,25 +4530,37 @@ void EditorCtrl::SelectAll() {
 }
 
 interval EditorCtrl::GetWordIv(unsigned int pos) const {
-	unsigned int wordstart = pos;
+	vector<char> text;
 
 	cxLOCKDOC_READ(m_doc)
-		while (wordstart) {
-			const unsigned int prevpos = doc.GetPrevCharPos(wordstart);
-			const wxChar c = doc.GetChar(prevpos);
-			if (!Isalnum(c) && c != '_') break;
-			wordstart = prevpos;
-		}
+		// Read the text around pos in one part (growing it if the word
+		// goes beyond it), instead of getting it a char at a time
+		const unsigned int len = doc.GetLength();
+		for (unsigned int margin = 64;; margin *= 4) {
+			const unsigned int start = pos > margin ? doc.GetValidCharPos(pos - margin) : 0;
+			const unsigned int end = pos + margin < len ? doc.GetValidCharPos(pos + margin) : len;
+			if (start == end) return interval(pos, pos);
+
+			text.clear();
+			doc.GetTextPart(start, end, text);
+			const char* const textStart = &*text.begin();
+			const char* const textEnd = textStart + text.size();
+			const char* const textPos = textStart + (pos - start);
+
+			const char* wordstart = textStart;
+			unsigned int charLen;
+			for (const char* p = textStart; p < textPos; p += charLen) {
+				if (!WordIndex::IsWordChar(WordIndex::DecodeChar(p, textEnd, charLen))) wordstart = p + charLen;
+			}
 
-		unsigned int wordend = pos;
-		while (wordend < doc.GetLength()) {
-			const unsigned int nextpos = doc.GetNextCharPos(wordend);
-			const wxChar c = doc.GetChar(wordend);
-			if (!Isalnum(c) && c != '_') break;
-			wordend = nextpos;
-		}
+			const char* wordend = textPos;
+			while (wordend < textEnd && WordIndex::IsWordChar(WordIndex::DecodeChar(wordend, textEnd, charLen))) {
+				wordend += charLen;
+			}
 
-		return interval(wordstart, wordend);
+			if ((wordstart == textStart && start > 0) || (wordend == textEnd && end < len)) continue;
+			return interval(start + (wordstart - textStart), start + (wordend - textStart));
+		}
 	cxENDLOCK
 }
 
@@ -4638,74 +4698,49 @@ void EditorCtrl::SelectParentTag() {
 void EditorCtrl::GetCompletionMatches(interval wordIv, wxArrayString& result, bool precharbase) const {
 	wxASSERT(wordIv.start <= wordIv.end && wordIv.end <= GetLength());
 	wxASSERT(!precharbase || wordIv.end - wordIv.start == 1);
-
-	map<wxString,unsigned int> completions;
+	if (wordIv.empty()) return;
 
 	// Get target word
-	cxLOCKDOC_READ(m_doc)
-		const unsigned int doclen = doc.GetLength();
-		const wxString target = doc.GetTextPart(wordIv.start, wordIv.end);
-
-		unsigned int pos = 0;
-		while (pos < doclen) {
-			const search_result sr = doc.Find(target, pos, true);
-			if (sr.error_code != 0) break;
-
-			// Ignore current word
-			if (sr.start == wordIv.start && sr.end == wordIv.end) {
-				pos = sr.end;
-				continue;
-			}
+	const wxString target = GetText(wordIv.start, wordIv.end);
 
-			// Check if it is the start of a word
-			if (sr.start) {
-				const unsigned int prevpos = doc.GetPrevCharPos(sr.start);
-				const wxChar c = doc.GetChar(prevpos);
-				if (Isalnum(c) || c == '_') {
-					pos = doc.GetNextCharPos(sr.start);
-					continue;
-				}
-			}
+	// Words in doc, sorted by distance. Only the parts of the
+	// doc that have changed since last completion are read again.
+	vector<wxString> words;
+	m_wordIndex.Update(EditorTextSource(*this));
+	m_wordIndex.Find(target, wordIv.start, words);
 
-			// Get the rest of the word
-			unsigned int wordend = sr.end;
-			while (wordend < doclen) {
-				const unsigned int nextpos = doc.GetNextCharPos(wordend);
-				const wxChar c = doc.GetChar(wordend);
-				if (!Isalnum(c) && c != '_') break;
-				wordend = nextpos;
-			}
-
-			if (wordend > sr.end) {
-				// Add to completion list
-				const unsigned int wordstart = precharbase ? sr.start+1 : sr.start; // remove base char
-				const wxString word = doc.GetTextPart(wordstart, wordend);
-				const unsigned int dist = sr.start < wordIv.start ? wordIv.start - sr.start : sr.start - wordIv.start;
+	// Words in the other open docs
+	bool completeFromAllTabs = false;
+	eGetSettings().GetSettingBool(wxT("completeFromAllTabs"), completeFromAllTabs);
+	if (completeFromAllTabs) {
+		vector<EditorCtrl*> editors;
+		m_parentFrame.GetEditorCtrls(editors);
 
-				map<wxString,unsigned int>::const_iterator p = completions.find(word);
-				if (p == completions.end() || p->second < dist)
-					completions[word] = dist;
-			}
-
-			pos = wordend;
+		vector<wxString> tabWords;
+		for (vector<EditorCtrl*>::const_iterator p = editors.begin(); p != editors.end(); ++p) {
+			if (*p != this) (*p)->GetCompletionWords(target, tabWords);
 		}
-	cxENDLOCK
+		sort(tabWords.begin(), tabWords.end());
+		words.insert(words.end(), tabWords.begin(), tabWords.end());
+	}
 
 	// remove entries that already are in list
-	for (unsigned int i = 0; i < result.GetCount(); ++i) {
-		map<wxString,unsigned int>::iterator p = completions.find(result[i]);
-		if (p != completions.end()) completions.erase(p);
+	set<wxString> found;
+	for (unsigned int i = 0; i < result.GetCount(); ++i) found.insert(result[i]);
+
+	// return list of completions, sorted by distance
+	result.Alloc(result.GetCount() + words.size());
+	for (vector<wxString>::const_iterator p = words.begin(); p != words.end(); ++p) {
+		const wxString word = precharbase ? p->substr(target.size()) : *p; // remove base char
+		if (found.insert(word).second) result.Add(word);
 	}
+}
 
-	// reverse map to be indexed by distance
-	map<unsigned int, wxString> sorted;
-	for (map<wxString,unsigned int>::const_iterator p = completions.begin(); p != completions.end(); ++p)
-		sorted[p->second] = p->first;
+void EditorCtrl::GetCompletionWords(const wxString& prefix, vector<wxString>& words) {
+	if (!m_doc.IsOk()) return;
 
-	// return list of completions, sorted by distance
-	result.Alloc(result.GetCount() + sorted.size());
-	for (map<unsigned int,wxString>::const_iterator p2 = sorted.begin(); p2 != sorted.end(); ++p2)
-		result.Add(p2->second);
+	m_wordIndex.Update(EditorTextSource(*this));
+	m_wordIndex.GetWords(prefix, words);
 }
 
 wxArrayString EditorCtrl::GetCompletionList() {
@@ -5130,42 +5165,16 @@ search_result EditorCtrl::RegExFind(const wxString& searchtext, unsigned int sta
 	int options = PCRE_UTF8;
 	if (!matchcase) options |= PCRE_CASELESS;
 
-	// Check if we have the regex cached
-	if (m_re) {
-		// We might want to study the regex the first time we end here
-		if (searchtext == m_regex_cache && options == m_options_cache) {}
-		else {
-			free(m_re);
-			m_re = NULL;
-		}
-	}
-
-	// Compile the pattern
-	if (!m_re) {
-		const char *error;
-		int erroffset;
-
-		m_re = pcre_compile(
-			searchtext.mb_str(wxConvUTF8),   // the pattern
-			options,              // options
-			&error,               // for error message
-			&erroffset,           // for error offset
-			NULL);                // use default character tables
-		if (m_re == 0) {
-			search_result sr;
-			sr.error_code = -4; // invalid pattern
-			return sr;
-		}
-		else {
-			// The compiled regex (m_re) is cached for possible reuse in next search
-			// it is finally free'd in destructor
-			m_options_cache = options;
-			m_regex_cache = searchtext;
-		}
+	// Get the compiled pattern (from cache if available)
+	const CompiledRegex re = RegexCache::Get().Lookup(searchtext, options);
+	if (!re.IsOk()) {
+		search_result sr;
+		sr.error_code = -4; // invalid pattern
+		return sr;
 	}
 
 	// Do the search
-	return RegExFind(m_re, NULL, start_pos, captures, end_pos);
+	return RegExFind(re.GetPattern(), re.GetStudy(), start_pos, captures, end_pos);
 }
 
 search_result EditorCtrl::RawRegexSearch(const char* regex, unsigned int subjectStart, unsigned int subjectEnd, unsigned int pos, map<unsigned int,interval> *captures) const {
@@ -5176,17 +5185,9 @@ search_result EditorCtrl::RawRegexSearch(const char* regex, unsigned int subject
 
 	search_result sr;
 
-	// Compile the pattern
-	const char *error;
-	int erroffset;
-	pcre* re = pcre_compile(
-		regex,      // the pattern
-		PCRE_UTF8,  // options
-		&error,     // for error message
-		&erroffset, // for error offset
-		NULL);      // use default character tables
-
-	if (!re) {
+	// Get the compiled pattern (from cache if available)
+	const CompiledRegex re = RegexCache::Get().Lookup(regex, PCRE_UTF8);
+	if (!re.IsOk()) {
 		sr.error_code = -4; // invalid pattern
 		return sr;
 	}
@@ -5207,8 +5208,8 @@ search_result EditorCtrl::RawRegexSearch(const char* regex, unsigned int subject
 	const int OVECCOUNT = 30;
 	int ovector[OVECCOUNT];
 	rc = pcre_exec(
-		re,                   // the compiled pattern
-		NULL,                 // extra data - if we study the pattern
+		re.GetPattern(),      // the compiled pattern
+		re.GetStudy(),        // extra data - if we study the pattern
 		subject,              // the subject string
 		subjectLen,           // the length of the subject
 		pos - subjectStart,   // start at offset in the subject
@@ -5216,8 +5217,6 @@ search_result EditorCtrl::RawRegexSearch(const char* regex, unsigned int subject
 		ovector,              // output vector for substring information
 		OVECCOUNT);           // number of elements in the output vector
 
-	pcre_free(re); // clean up
-
 	// Copy match info from ovector to result struct
 	sr.error_code = rc;
 	if (rc >= 0) {
@@ -5248,17 +5247,9 @@ search_result EditorCtrl::RawRegexSearch(const char* regex, const vector<char>&
 		return sr;
 	}
 
-	// Compile the pattern
-	const char *error;
-	int erroffset;
-	pcre* re = pcre_compile(
-		regex,      // the pattern
-		PCRE_UTF8,  // options
-		&error,     // for error message
-		&erroffset, // for error offset
-		NULL);      // use default character tables
-
-	if (!re) {
+	// Get the compiled pattern (from cache if available)
+	const CompiledRegex re = RegexCache::Get().Lookup(regex, PCRE_UTF8);
+	if (!re.IsOk()) {
 		sr.error_code = -4; // invalid pattern
 		return sr;
 	}
@@ -5268,8 +5259,8 @@ search_result EditorCtrl::RawRegexSearch(const char* regex, const vector<char>&
 	const int OVECCOUNT = 30;
 	int ovector[OVECCOUNT];
 	rc = pcre_exec(
-		re,                   // the compiled pattern
-		NULL,                 // extra data - if we study the pattern
+		re.GetPattern(),      // the compiled pattern
+		re.GetStudy(),        // extra data - if we study the pattern
 		&*subject.begin(),      // the subject string
 		(int)subject.size(),           // the length of the subject
 		pos,   // start at offset in the subject
@@ -5277,8 +5268,6 @@ search_result EditorCtrl::RawRegexSearch(const char* regex, const vector<char>&
 		ovector,              // output vector for substring information
 		OVECCOUNT);           // number of elements in the output vector
 
-	pcre_free(re); // clean up
-
 	// Copy match info from ovector to result struct
 	sr.error_code = rc;
 	if (rc >= 0) {
@@ -5306,39 +5295,12 @@ search_result EditorCtrl::RegExFindBackwards(const wxString& searchtext, unsigne
 	int options = PCRE_UTF8;
 	if (!matchcase) options |= PCRE_CASELESS;
 
-	// Check if we have the regex cached
-	if (m_re) {
-		// We might want to study the regex the first time we end here
-		if (searchtext == m_regex_cache && options == m_options_cache) {}
-		else {
-			free(m_re);
-			m_re = NULL;
-		}
-	}
-
-	// Compile the pattern
-	if (!m_re) {
-		const char *error;
-		int erroffset;
-
-		m_re = pcre_compile(
-			searchtext.mb_str(wxConvUTF8),   // the pattern
-			options,              // options
-			&error,               // for error message
-			&erroffset,           // for error offset
-			NULL);                // use default character tables
-
-		if (m_re == 0) {
-			search_result sr;
-			sr.error_code = -4; // invalid pattern
-			return sr;
-		}
-		else {
-			// The compiled regex (m_re) is cached for possible reuse in next search
-			// it is finally free'd in destructor
-			m_options_cache = options;
-			m_regex_cache = searchtext;
-		}
+	// Get the compiled pattern (from cache if available)
+	const CompiledRegex re = RegexCache::Get().Lookup(searchtext, options);
+	if (!re.IsOk()) {
+		search_result sr;
+		sr.error_code = -4; // invalid pattern
+		return sr;
 	}
 
 	// Do the search
@@ -5364,8 +5326,8 @@ search_result EditorCtrl::RegExFindBackwards(const wxString& searchtext, unsigne
 	// Do the search (one line at a time)
 	for (;;) {
 		rc = pcre_exec(
-			m_re,                   // the compiled pattern
-			NULL,                // extra data - if we study the pattern
+			re.GetPattern(),      // the compiled pattern
+			re.GetStudy(),        // extra data - if we study the pattern
 			&*line.begin(),         // the subject string
 			lineLen,              // the length of the subject
 			pos - lineStart,      // start at offset in the subject
@@ -5450,6 +5412,207 @@ bool EditorCtrl::Replace(const wxString& searchtext, const wxString& replacetext
 	return DoFind(searchtext, m_lines.GetPos(), options);
 }
 
+// Returns true if the pattern can not look at text before the start of
+// the match (^, \b, \B or lookbehind). Matches of such patterns do not
+// depend on earlier replacements, so they can all be found in one pass
+// over the original text.
+static bool is_context_free_regex(const wxString& pattern) {
+	for (unsigned int i = 0; i < pattern.size(); ++i) {
+		const wxChar c = pattern[i];
+		if (c == wxT('\\')) {
+			if (++i == pattern.size()) break;
+			const wxChar esc = pattern[i];
+			if (esc == wxT('b') || esc == wxT('B')) return false;
+		}
+		else if (c == wxT('^')) {
+			if (i == 0 || pattern[i-1] != wxT('[')) return false;
+		}
+		else if (c == wxT('(') && pattern.Mid(i, 3) == wxT("(?<")) return false;
+	}
+	return true;
+}
+
+bool EditorCtrl::BatchReplaceAll(const wxString& searchtext, const wxString& replacetext, int options, unsigned int& replacements, int& caretPos) {
+	const bool matchcase = (options & FIND_MATCHCASE) != 0;
+	const bool useRegex = (options & FIND_USE_REGEX) != 0;
+	if (useRegex && !is_context_free_regex(searchtext)) return false;
+
+	// Prepare the matcher
+	CompiledRegex re;
+	LiteralMatcher matcher;
+	wxCharBuffer literalReplacement;
+	if (useRegex) {
+		int reOptions = PCRE_UTF8|PCRE_MULTILINE;
+		if (!matchcase) reOptions |= PCRE_CASELESS;
+		re = RegexCache::Get().Lookup(searchtext, reOptions);
+		if (!re.IsOk()) return false; // let the normal path handle errors
+	}
+	else {
+		wxString text = searchtext;
+		wxString textUpper;
+		if (!matchcase) {
+			text.MakeLower();
+			textUpper = searchtext;
+			textUpper.MakeUpper();
+		}
+		const wxCharBuffer UTF8buffer = wxConvUTF8.cWC2MB(text);
+		const unsigned int byte_len = strlen(UTF8buffer);
+		wxCharBuffer UTF8bufferUpper;
+		if (!matchcase) {
+			UTF8bufferUpper = wxConvUTF8.cWC2MB(textUpper);
+			if (strlen(UTF8bufferUpper) != byte_len) return false;
+		}
+		if (byte_len == 0) return false;
+		matcher.Set(UTF8buffer.data(), matchcase ? NULL : UTF8bufferUpper.data(), byte_len);
+		literalReplacement = wxConvUTF8.cWC2MB(replacetext);
+	}
+
+	// The search ranges in original coordinates
+	vector<interval> ranges = m_searchRanges;
+	const bool inRanges = !ranges.empty();
+
+	vector<char> text;
+	vector<interval> matches;
+	vector<string> newTexts;
+
+	cxLOCKDOC_WRITE(m_doc)
+		const unsigned int docLen = doc.GetLength();
+		if (inRanges) {
+			// Avoid copying the text after the last range (but include the char
+			// after it, as we check for newlines after matches)
+			doc.GetTextPart(0, wxMin(ranges.back().end + 1, docLen), text);
+		}
+		else {
+			ranges.push_back(interval(0, docLen));
+			doc.GetTextPart(0, docLen, text);
+		}
+		const char* const subject = text.empty() ? NULL : &*text.begin();
+
+		// Find all matches in the original text. The rules for where to continue
+		// after a match mirror the incremental replace exactly, so that we end up
+		// with the same revision.
+		const int OVECCOUNT = 30;
+		int ovector[OVECCOUNT];
+		map<unsigned int,interval> captures;
+		unsigned int start_pos = ranges[0].start;
+		vector<interval>::const_iterator p = ranges.begin();
+		while (1) {
+			interval result;
+			bool found = false;
+			for (; p != ranges.end(); ++p) {
+				if (start_pos < p->start) start_pos = p->start;
+				if (start_pos > p->end) continue;
+
+				if (useRegex) {
+					captures.clear();
+					const int rc = pcre_exec(re.GetPattern(), re.GetStudy(), subject, p->end, start_pos, PCRE_NO_UTF8_CHECK, ovector, OVECCOUNT);
+					if (rc >= 0) {
+						result.Set(ovector[0], ovector[1]);
+						for (int i = 0; i < rc; ++i) {
+							if (ovector[2*i] != -1) captures[i] = interval(ovector[2*i], ovector[2*i+1]);
+						}
+						found = true;
+					}
+				}
+				else if (start_pos < docLen) {
+					const char* match = matcher.Find(subject + start_pos, subject + p->end);
+					if (match) {
+						result.start = match - subject;
+						result.end = result.start + matcher.Length();
+						found = true;
+					}
+				}
+				if (found) break;
+				if (!inRanges) break;
+			}
+			if (!found) break;
+
+			// Get the replacement string
+			if (useRegex) {
+				if (replacetext.empty()) newTexts.push_back(string());
+				else {
+					const wxString textNew = ParseReplaceString(replacetext, captures, &text);
+					const wxCharBuffer buf = wxConvUTF8.cWC2MB(textNew);
+					newTexts.push_back(string(buf.data()));
+				}
+			}
+			else newTexts.push_back(string(literalReplacement.data()));
+			matches.push_back(result);
+
+			// If we have replaced upto end-of-line, move to next
+			// line to avoid infinite replace of ($).
+			start_pos = result.end;
+			if (start_pos == docLen) break;
+			if (subject[start_pos] == '\n') {
+				++start_pos;
+				if (start_pos == docLen) break;
+			}
+
+			// We also want to avoid infinite loop when replacing a possible
+			// zero-len match with nothing
+			if (result.start == result.end && newTexts.back().empty()) ++start_pos;
+		}
+
+		replacements = matches.size();
+		if (matches.empty()) return true;
+
+		// Everything between the first and the last match is rewritten in a single
+		// delete & insert. The text node can not hold embedded nulls in an insertion,
+		// and when there are only a few matches we keep the changes fine grained.
+		const unsigned int spanStart = matches.front().start;
+		const unsigned int spanEnd = matches.back().end;
+		const bool singleSpan = matches.size() > 16 && memchr(subject + spanStart, '\0', spanEnd - spanStart) == NULL;
+
+		doc.StartChange();
+		if (singleSpan) {
+			string span;
+			span.reserve(spanEnd - spanStart);
+			unsigned int pos = spanStart;
+			for (unsigned int i = 0; i < matches.size(); ++i) {
+				span.append(subject + pos, matches[i].start - pos);
+				span += newTexts[i];
+				pos = matches[i].end;
+			}
+
+			doc.Delete(spanStart, spanEnd);
+			if (!span.empty()) doc.Insert(spanStart, span.c_str());
+		}
+		else {
+			// Going backwards keeps the positions of earlier matches valid
+			for (unsigned int i = matches.size(); i > 0; --i) {
+				const interval& iv = matches[i-1];
+				if (iv.start != iv.end) doc.Delete(iv.start, iv.end);
+				if (!newTexts[i-1].empty()) doc.Insert(iv.start, newTexts[i-1].c_str());
+			}
+		}
+		doc.EndChange();
+	cxENDLOCK
+
+	// Adjust searchranges
+	if (!m_searchRanges.empty()) {
+		for (vector<interval>::iterator r = m_searchRanges.begin(); r != m_searchRanges.end(); ++r) {
+			int startDiff = 0;
+			int endDiff = 0;
+			for (unsigned int i = 0; i < matches.size(); ++i) {
+				const int diff = (int)newTexts[i].size() - (int)(matches[i].end - matches[i].start);
+				if (r->start > matches[i].start) startDiff += diff;
+				if (r->end > matches[i].start) endDiff += diff;
+			}
+			r->start += startDiff;
+			r->end += endDiff;
+		}
+	}
+
+	// Caret goes after the last replacement
+	int totalDiff = 0;
+	for (unsigned int i = 0; i+1 < matches.size(); ++i) {
+		totalDiff += (int)newTexts[i].size() - (int)(matches[i].end - matches[i].start);
+	}
+	caretPos = matches.back().start + totalDiff + newTexts.back().size();
+
+	return true;
+}
+
 int EditorCtrl::ReplaceAll(const wxString& searchtext, const wxString& replacetext, int options) {
 	bool matchcase = options & FIND_MATCHCASE;
 
@@ -5476,95 +5639,100 @@ int EditorCtrl::ReplaceAll(const wxString& searchtext, const wxString& replacete
 	unsigned int byte_len = 0;
 
 	unsigned int replacements = 0;
+	int caretPos = -1;
 
-	// Replace and continue search
-	cxLOCKDOC_WRITE(m_doc)
-		doc.StartChange();
-	cxENDLOCK
-	while(1) {
-		captures.clear();
-
-		// Find match
-		if (m_searchRanges.empty()) {
-			cxLOCKDOC_READ(m_doc)
-				if (options & FIND_USE_REGEX) result = doc.RegExFind(searchtext, start_pos, matchcase, &captures);
-				else result = doc.Find(searchtext, start_pos, matchcase);
-			cxENDLOCK
-		}
-		else {
-			for (; p != m_searchRanges.end(); ++p) {
-				if (start_pos < p->start) start_pos = p->start;
+	// Replace all matches in one pass if possible, otherwise
+	// replace and continue search
+	if (!BatchReplaceAll(searchtext, replacetext, options, replacements, caretPos)) {
+		cxLOCKDOC_WRITE(m_doc)
+			doc.StartChange();
+		cxENDLOCK
+		while(1) {
+			captures.clear();
 
+			// Find match
+			if (m_searchRanges.empty()) {
 				cxLOCKDOC_READ(m_doc)
-					if (options & FIND_USE_REGEX) result = doc.RegExFind(searchtext, start_pos, matchcase, &captures, p->end);
-					else result = doc.Find(searchtext, start_pos, matchcase, p->end);
+					if (options & FIND_USE_REGEX) result = doc.RegExFind(searchtext, start_pos, matchcase, &captures);
+					else result = doc.Find(searchtext, start_pos, matchcase);
 				cxENDLOCK
-				if (result.error_code >= 0) break; // match found or error
 			}
-			if (p == m_searchRanges.end()) break; // outside ranges
-		}
+			else {
+				for (; p != m_searchRanges.end(); ++p) {
+					if (start_pos < p->start) start_pos = p->start;
 
-		// Handle result
-		if (result.error_code < 0) break; // no match found
-		lastresult = result;
+					cxLOCKDOC_READ(m_doc)
+						if (options & FIND_USE_REGEX) result = doc.RegExFind(searchtext, start_pos, matchcase, &captures, p->end);
+						else result = doc.Find(searchtext, start_pos, matchcase, p->end);
+					cxENDLOCK
+					if (result.error_code >= 0) break; // match found or error
+				}
+				if (p == m_searchRanges.end()) break; // outside ranges
+			}
 
-		// Get the replacement string
-		wxString textNew;
-		if (!replacetext.empty()) {
-			textNew = (options & FIND_USE_REGEX) ? ParseReplaceString(replacetext, captures) : replacetext;
-		}
+			// Handle result
+			if (result.error_code < 0) break; // no match found
+			lastresult = result;
 
-		// Delete original
-		if (result.start != result.end) {
-			cxLOCKDOC_WRITE(m_doc)
-				doc.Delete(result.start, result.end);
-			cxENDLOCK
-		}
+			// Get the replacement string
+			wxString textNew;
+			if (!replacetext.empty()) {
+				textNew = (options & FIND_USE_REGEX) ? ParseReplaceString(replacetext, captures) : replacetext;
+			}
 
-		// Insert replacement
-		if (!textNew.empty()) {
-			cxLOCKDOC_WRITE(m_doc)
-				byte_len = doc.Insert(result.start, textNew);
-			cxENDLOCK
-		}
-		else byte_len = 0;
+			// Delete original
+			if (result.start != result.end) {
+				cxLOCKDOC_WRITE(m_doc)
+					doc.Delete(result.start, result.end);
+				cxENDLOCK
+			}
 
-		// Adjust searchranges
-		if (!m_searchRanges.empty()) {
-			const int diff = byte_len - (result.end - result.start);
-			for (vector<interval>::iterator p2 = p; p2 != m_searchRanges.end(); ++p2) {
-				if (p2->start > result.start) p2->start += diff;
-				if (p2->end > result.start) p2->end += diff;
+			// Insert replacement
+			if (!textNew.empty()) {
+				cxLOCKDOC_WRITE(m_doc)
+					byte_len = doc.Insert(result.start, textNew);
+				cxENDLOCK
+			}
+			else byte_len = 0;
+
+			// Adjust searchranges
+			if (!m_searchRanges.empty()) {
+				const int diff = byte_len - (result.end - result.start);
+				for (vector<interval>::iterator p2 = p; p2 != m_searchRanges.end(); ++p2) {
+					if (p2->start > result.start) p2->start += diff;
+					if (p2->end > result.start) p2->end += diff;
+				}
 			}
-		}
 
-		replacements++;
+			replacements++;
 
-		// If we have replaced upto end-of-line, move to next
-		// line to avoid infinite replace of ($).
-		start_pos = result.start+byte_len;
-		cxLOCKDOC_READ(m_doc)
-			if (start_pos == doc.GetLength()) break;
-			if (doc.GetChar(start_pos) == wxT('\n')) {
-				++start_pos;
+			// If we have replaced upto end-of-line, move to next
+			// line to avoid infinite replace of ($).
+			start_pos = result.start+byte_len;
+			cxLOCKDOC_READ(m_doc)
 				if (start_pos == doc.GetLength()) break;
-			}
-		cxENDLOCK
+				if (*doc_byte_iter(doc, start_pos) == '\n') {
+					++start_pos;
+					if (start_pos == doc.GetLength()) break;
+				}
+			cxENDLOCK
 
-		// We also want to avoid infinite loop when replacing a possible
-		// zero-len match with nothing
-		if (result.start == result.end && byte_len == 0) ++start_pos;
+			// We also want to avoid infinite loop when replacing a possible
+			// zero-len match with nothing
+			if (result.start == result.end && byte_len == 0) ++start_pos;
 
+		}
+		cxLOCKDOC_WRITE(m_doc)
+			doc.EndChange();
+		cxENDLOCK
+		if (lastresult.error_code >= 0) caretPos = lastresult.start + byte_len;
 	}
-	cxLOCKDOC_WRITE(m_doc)
-		doc.EndChange();
-	cxENDLOCK
 
 	// Update lines and stylers
 	ApplyDiff(oldDoc);
 
 	// Update the caret position
-	if (lastresult.error_code >= 0) m_lines.SetPos(lastresult.start + byte_len);
+	if (caretPos != -1) m_lines.SetPos(caretPos);
 	// else no change
 
 	MarkAsModified();
@@ -7704,15 +7872,8 @@ void EditorCtrl::OnIdle(wxIdleEvent& event) {
 	const int topline = m_lines.GetLineFromYPos(scrollPos);
 	const int lineoffset = scrollPos - m_lines.GetYPosFromLine(topline);
 
-	// Update lines
-	if (m_lines.NeedIdle())
-		m_lines.OnIdle();
-
-	// Update syntax and variable stylers
-	bool syntaxNeedIdle = m_lines.StylersOnIdle();
-
-	// Update foldings
-	ParseFoldMarkers();
+	// Update lines, syntax, foldings and stylers
+	const bool needIdle = m_idleJobs.Run();
 
 	// ScrollPos may no longer be valid, calc new scrollpos
 	if (HasScrollbar()) {
@@ -7722,10 +7883,35 @@ void EditorCtrl::OnIdle(wxIdleEvent& event) {
 	}
 
 	// Check if we should request more idle events
-	if (syntaxNeedIdle || m_lines.NeedIdle()) {
-		//wxLogDebug(wxT("EditorCtrl::OnIdle - RequestMore %d %d"), syntaxNeedIdle, lines.NeedIdle());
-		event.RequestMore();
-	}
+	if (needIdle) event.RequestMore();
+}
+
+bool EditorCtrl::OnIdleLines(EditorCtrl* self, const IdleScheduler::Slice& WXUNUSED(slice)) {
+	// Each call lays out a limited number of lines (the rest is measured in the background)
+	if (self->m_lines.NeedIdle())
+		self->m_lines.OnIdle();
+	return self->m_lines.NeedIdle();
+}
+
+bool EditorCtrl::OnIdleSyntax(EditorCtrl* self, const IdleScheduler::Slice& slice) {
+	// Extend syntax until the slice is used (bigger parts are parsed in the background)
+	bool needIdle;
+	do needIdle = self->m_syntaxstyler.OnIdle();
+	while (needIdle && !slice.IsExpired());
+
+	// Redraw text that was drawn before the background parser got to it
+	if (self->m_syntaxstyler.NeedRedraw()) self->DrawLayout();
+
+	return needIdle;
+}
+
+bool EditorCtrl::OnIdleFolds(EditorCtrl* self, const IdleScheduler::Slice& slice) {
+	return self->ParseFoldMarkers(&slice);
+}
+
+bool EditorCtrl::OnIdleStylers(EditorCtrl* self, const IdleScheduler::Slice& WXUNUSED(slice)) {
+	// Search and variable highlights (their searches run in threads)
+	return self->m_lines.StylersOnIdle(&self->m_syntaxstyler);
 }
 
 void EditorCtrl::OnClose(wxCloseEvent& WXUNUSED(event)) {}
@@ -8265,104 +8451,114 @@ void EditorCtrl::Print() {
 #endif  //__WXDEBUG__
 
 vector<unsigned int> EditorCtrl::GetFoldedLines() const {
-	vector<unsigned int> folds;
-	for (vector<cxFold>::const_iterator p = m_folds.begin(); p != m_folds.end(); ++p)
-		if (p->type == cxFOLD_START_FOLDED) folds.push_back(p->line_id);
-	return folds;
+	const vector<cxFold>& folds = m_foldIndex.GetFolds();
+	vector<unsigned int> foldedLines;
+	for (vector<cxFold>::const_iterator p = folds.begin(); p != folds.end(); ++p)
+		if (p->type == cxFOLD_START_FOLDED) foldedLines.push_back(p->line_id);
+	return foldedLines;
 }
 
 bool EditorCtrl::HasFoldedFolds() const {
-	for (vector<cxFold>::const_iterator p = m_folds.begin(); p != m_folds.end(); ++p)
+	const vector<cxFold>& folds = m_foldIndex.GetFolds();
+	for (vector<cxFold>::const_iterator p = folds.begin(); p != folds.end(); ++p)
 		if (p->type == cxFOLD_START_FOLDED) return true;
 	return false;
 }
 
 void EditorCtrl::FoldingClear() {
-	m_folds.clear();
+	m_foldIndex.Clear();
 	m_foldedLines = 0;
 	m_foldLineCount = 0;
 }
 
-void EditorCtrl::ParseFoldMarkers() {
-	if (!m_syntaxstyler.IsOk()) return; // no syntax
+bool EditorCtrl::ParseFoldMarkers(const IdleScheduler::Slice* slice) {
+	if (!m_syntaxstyler.IsOk()) return false; // no syntax
 
 	// Get fold status for each line in doc
 	const unsigned int lineCount = m_lines.GetLineCount(false/*includeVirtual*/);
 	if (m_foldLineCount == 0) m_foldLineCount = lineCount; // first run after invalidate
 	wxASSERT(m_foldLineCount == lineCount);
 	wxASSERT(m_foldedLines <= lineCount);
-	if (m_foldedLines == lineCount) return;
+	if (m_foldedLines == lineCount) return false;
 
-	unsigned int i = m_foldedLines;
-	unsigned int lineStart = m_lines.GetLineStartpos(i);
 	const unsigned int lastSyntaxedLine = m_lines.GetLineFromCharPos(m_syntaxstyler.GetLastParsedPos());
+	const unsigned int endLine = wxMin(lineCount, lastSyntaxedLine);
+	if (m_foldedLines >= endLine) return false;
+
+	// All parsed lines are after the existing folds, so they can just be appended.
+	vector<cxFold>& folds = m_foldIndex.GetFolds();
+	if (!slice) {
+		ParseFoldLines(m_foldedLines, endLine, false, folds);
+		m_foldedLines = endLine;
+		return false;
+	}
 
-	while (i < lineCount && i < lastSyntaxedLine) {
-		const unsigned int lineEnd = m_lines.GetLineEndpos(i, false);
+	// In idle time it is done in blocks, until the time slice is used.
+	const unsigned int FOLDIDLELINES = 2000;
+	do {
+		const unsigned int blockEnd = wxMin(endLine, m_foldedLines + FOLDIDLELINES);
+		ParseFoldLines(m_foldedLines, blockEnd, false, folds);
+		m_foldedLines = blockEnd;
+	} while (m_foldedLines < endLine && !slice->IsExpired());
 
-		// Check if we have a fold rule
-		const deque<const wxString*> scope = m_syntaxstyler.GetScope(lineStart);
-		if (const TmSyntaxHandler::cxFoldRule* rule = m_syntaxHandler.GetFoldRule(scope)) {
-			// Do we match fold starter
-			const search_result sr = RawRegexSearch(&*rule->foldingStartMarker.begin(), lineStart, lineEnd, lineStart);
-			const bool matchStartMarker = (sr.error_code > 0);
+	return m_foldedLines < endLine;
+}
 
-			// Do we match fold ender
-			const search_result sr2 = RawRegexSearch(&*rule->foldingEndMarker.begin(), lineStart, lineEnd, lineStart);
-			const bool matchEndMarker = (sr2.error_code > 0);
+void EditorCtrl::ParseFoldLines(unsigned int firstLine, unsigned int endLine, bool refoldFirst, vector<cxFold>& folds) {
+	wxASSERT(firstLine <= endLine && endLine <= m_lines.GetLineCount());
 
-			if (matchStartMarker) {
-				if (!matchEndMarker) // starter and ender on same line cancels out
-					m_folds.push_back(cxFold(i, cxFOLD_START, m_lines.GetLineIndentLevel(i)));
-			}
-			else if (matchEndMarker)
-				m_folds.push_back(cxFold(i, cxFOLD_END, m_lines.GetLineIndentLevel(i)));
+	// The text is copied in blocks of lines, so that we do not have to
+	// lock the document for each line
+	const unsigned int FOLDBLOCKSIZE = 64 * 1024;
+	const unsigned int docLen = GetLength();
+	vector<char> text;
+
+	deque<const wxString*> ruleScope;
+	const TmSyntaxHandler::cxFoldRule* rule = NULL;
+	bool haveRule = false;
+
+	unsigned int i = firstLine;
+	while (i < endLine) {
+		const unsigned int blockStart = m_lines.GetLineStartpos(i);
+		unsigned int blockLast = endLine - 1;
+		if (blockStart + FOLDBLOCKSIZE < docLen)
+			blockLast = wxMin(blockLast, m_lines.GetLineFromCharPos(blockStart + FOLDBLOCKSIZE));
+		const unsigned int blockEnd = m_lines.GetLineEndpos(blockLast, false);
+
+		text.clear();
+		if (blockEnd > blockStart) {
+			cxLOCKDOC_READ(m_doc)
+				doc.GetTextPart(blockStart, blockEnd, text);
+			cxENDLOCK
 		}
 
-		lineStart = lineEnd;
-		++i;
-	}
+		unsigned int lineStart = blockStart;
+		for (; i <= blockLast; ++i) {
+			const unsigned int lineEnd = m_lines.GetLineEndpos(i, false);
 
-	m_foldedLines = i;
-}
+			// Neighbouring lines mostly share scope, so only look up the rule when it changes
+			const deque<const wxString*> scope = m_syntaxstyler.GetScope(lineStart);
+			if (!haveRule || scope != ruleScope) {
+				rule = m_syntaxHandler.GetFoldRule(scope);
+				ruleScope = scope;
+				haveRule = true;
+			}
 
-vector<cxFold>::iterator EditorCtrl::ParseFoldLine(unsigned int line_id, vector<cxFold>::iterator insertPos, bool doFold) {
-	wxASSERT(line_id < m_lines.GetLineCount());
+			if (rule) {
+				const char* line = text.empty() ? "" : &*text.begin() + (lineStart - blockStart);
+				const FoldMatcher::Result res = rule->matcher.Match(line, lineEnd - lineStart);
 
-	const unsigned int lineStart = m_lines.GetLineStartpos(line_id);
-
-	// Check if we have a fold rule
-	const deque<const wxString*> scope = m_syntaxstyler.GetScope(lineStart);
-	if (const TmSyntaxHandler::cxFoldRule* rule = m_syntaxHandler.GetFoldRule(scope)) {
-		const unsigned int lineEnd = m_lines.GetLineEndpos(line_id, false);
-
-		// Do we match fold starter
-		const char* const startMarker = &*rule->foldingStartMarker.begin();
-		const search_result sr = RawRegexSearch(startMarker, lineStart, lineEnd, lineStart);
-		const bool matchStartMarker = (sr.error_code > 0);
-
-		// Do we match fold ender
-		const char* const endMarker = &*rule->foldingEndMarker.begin();
-		const search_result sr2 = RawRegexSearch(endMarker, lineStart, lineEnd, lineStart);
-		const bool matchEndMarker = (sr2.error_code > 0);
-
-		if (matchStartMarker) {
-			if (!matchEndMarker) { // starter and ender on same line cancels out
-				return m_folds.insert(
-						insertPos, 
-						cxFold(line_id, (doFold ? cxFOLD_START_FOLDED : cxFOLD_START), m_lines.GetLineIndentLevel(line_id))
-					) + 1;
+				if (res == FoldMatcher::FOLD_START) {
+					const bool doFold = refoldFirst && i == firstLine;
+					folds.push_back(cxFold(i, (doFold ? cxFOLD_START_FOLDED : cxFOLD_START), m_lines.GetLineIndentLevel(i)));
+				}
+				else if (res == FoldMatcher::FOLD_END)
+					folds.push_back(cxFold(i, cxFOLD_END, m_lines.GetLineIndentLevel(i)));
 			}
-		}
-		else if (matchEndMarker) {
-			return m_folds.insert(
-					insertPos, 
-					cxFold(line_id, cxFOLD_END, m_lines.GetLineIndentLevel(line_id))
-				) + 1;
+
+			lineStart = lineEnd;
 		}
 	}
-
-	return insertPos; // nothing inserted
 }
 
 void EditorCtrl::FoldingInsert(unsigned int pos, unsigned int len) {
@@ -8377,26 +8573,22 @@ void EditorCtrl::FoldingInsert(unsigned int pos, unsigned int len) {
 	if (firstline == m_foldLineCount) ++newLines; // adjust for first insertion in last line (creating it)
 	wxASSERT(newLines == lineCount - m_foldLineCount);
 
-	// Find (and erase for re-parsing) the first modified line
+	// Find (and replace for re-parsing) the first modified line
 	bool doRefold = false;
-	const cxFold target(firstline);
-	vector<cxFold>::iterator p = lower_bound(m_folds.begin(), m_folds.end(), target);
-	if (p != m_folds.end() && p->line_id == firstline) {
-		if (p->type == cxFOLD_START_FOLDED && newLines == 0) doRefold = true;
-		p = m_folds.erase(p);
+	const size_t first = m_foldIndex.Find(firstline);
+	size_t last = first;
+	if (first < m_foldIndex.size() && m_foldIndex.GetLine(first) == firstline) {
+		if (m_foldIndex.GetType(first) == cxFOLD_START_FOLDED && newLines == 0) doRefold = true;
+		++last;
 	}
 
 	// Parse the new lines
-	for (unsigned int i = firstline; i <= lastline; ++i)
-		p = ParseFoldLine(i, p, doRefold);
+	vector<cxFold> newFolds;
+	ParseFoldLines(firstline, lastline+1, doRefold, newFolds);
+	const size_t next = m_foldIndex.Replace(first, last, newFolds);
 
 	// Adjust line ids in following
-	if (newLines) {
-		while (p != m_folds.end()) {
-			p->line_id += newLines;
-			++p;
-		}
-	}
+	m_foldIndex.Shift(next, newLines);
 
 	m_foldedLines += newLines;
 	wxASSERT(m_foldedLines <= lineCount);
@@ -8404,7 +8596,8 @@ void EditorCtrl::FoldingInsert(unsigned int pos, unsigned int len) {
 }
 
 void EditorCtrl::FoldingReIndent() {
-	for (vector<cxFold>::iterator p = m_folds.begin(); p != m_folds.end(); ++p)
+	vector<cxFold>& folds = m_foldIndex.GetFolds();
+	for (vector<cxFold>::iterator p = folds.begin(); p != folds.end(); ++p)
 		p->indent = m_lines.GetLineIndentLevel(p->line_id);
 }
 
@@ -8421,30 +8614,27 @@ void EditorCtrl::FoldingDelete(unsigned int start, unsigned int WXUNUSED(end)) {
 	// How many lines was deleted
 	const unsigned int newLines = m_foldLineCount - m_lines.GetLineCount(false/*includeVirtual*/);
 
-	// Find (and re-parse) the modified line
+	// Find the modified line
 	bool doRefold = false;
-	const cxFold target(line_id);
-	vector<cxFold>::iterator p = lower_bound(m_folds.begin(), m_folds.end(), target);
-	if (p != m_folds.end() && p->line_id == line_id) {
-		if (p->type == cxFOLD_START_FOLDED) doRefold = true;
-		p = m_folds.erase(p);
+	const size_t first = m_foldIndex.Find(line_id);
+	size_t last = first;
+	if (first < m_foldIndex.size() && m_foldIndex.GetLine(first) == line_id) {
+		if (m_foldIndex.GetType(first) == cxFOLD_START_FOLDED) doRefold = true;
+		++last;
 	}
 
-	if (!m_lines.IsLineVirtual(line_id))
-		p = ParseFoldLine(line_id, p, doRefold);
-
 	// Remove deleted lines
 	const unsigned int lastline = line_id + newLines;
-	while (p != m_folds.end() && p->line_id <= lastline)
-		p = m_folds.erase(p);
+	last = m_foldIndex.Find(lastline+1, last);
+
+	// Re-parse the modified line
+	vector<cxFold> newFolds;
+	if (!m_lines.IsLineVirtual(line_id))
+		ParseFoldLines(line_id, line_id+1, doRefold, newFolds);
+	const size_t next = m_foldIndex.Replace(first, last, newFolds);
 
 	// Adjust line ids in following
-	if (newLines) {
-		while (p != m_folds.end()) {
-			p->line_id -= newLines;
-			++p;
-		}
-	}
+	m_foldIndex.Shift(next, -(int)newLines);
 
 	m_foldedLines -= newLines;
 	const unsigned int lineCount = m_lines.GetLineCount(false/*includeVirtual*/);
@@ -8459,49 +8649,43 @@ void EditorCtrl::FoldingApplyDiff(const vector<cxLineChange>& linechanges) {
 		return;
 	}
 
+	vector<cxFold> newFolds;
 	for (vector<cxLineChange>::const_iterator l = linechanges.begin(); l != linechanges.end(); ++l) {
 		const unsigned int line_id = m_lines.GetLineFromCharPos(l->start);
 
 		if (line_id > m_foldedLines) return;
 		
 		// Find the first line of modification
-		const cxFold target(line_id);
-		vector<cxFold>::iterator f = lower_bound(m_folds.begin(), m_folds.end(), target);
+		const size_t first = m_foldIndex.Find(line_id);
+		size_t last = first;
 
-		// Erase for re-parsing the first modified line
+		// Replace for re-parsing the first modified line
 		bool doRefold = false;
-		if (f != m_folds.end() && f->line_id == line_id) {
-			if (f->type == cxFOLD_START_FOLDED) doRefold = true;
-			f = m_folds.erase(f);
+		if (first < m_foldIndex.size() && m_foldIndex.GetLine(first) == line_id) {
+			if (m_foldIndex.GetType(first) == cxFOLD_START_FOLDED) doRefold = true;
+			++last;
 		}
 
+		newFolds.clear();
 		if (l->lines >= 0) { // INSERTION or edit on single line
+			// Parse the new lines (only refold first line)
 			const unsigned int lastline = line_id + l->lines;
-
-			// Parse the new lines
-			for (unsigned int i = line_id; i <= lastline; ++i) {
-				f = ParseFoldLine(i, f, doRefold);
-				if (doRefold) doRefold = false; // only refold first line
-			}
+			ParseFoldLines(line_id, lastline+1, doRefold, newFolds);
 		}
 		else { // DELETION
 			// Reparse line with partial deletion
 			if (!m_lines.IsLineVirtual(line_id))
-				f = ParseFoldLine(line_id, f, doRefold);
+				ParseFoldLines(line_id, line_id+1, doRefold, newFolds);
 
 			// Remove deleted lines
 			const unsigned int lastline = line_id - l->lines;
-			while (f != m_folds.end() && f->line_id <= lastline)
-				f = m_folds.erase(f);
+			last = m_foldIndex.Find(lastline+1, last);
 		}
+		const size_t next = m_foldIndex.Replace(first, last, newFolds);
 
 		// Adjust line id's in following
-		if (l->lines != 0) {
-			for (; f != m_folds.end(); ++f)
-				f->line_id += l->lines;
-
-			m_foldedLines += l->lines;
-		}
+		m_foldIndex.Shift(next, l->lines);
+		m_foldedLines += l->lines;
 	}
 
 	m_foldLineCount = m_lines.GetLineCount(false/*includeVirtual*/);
@@ -8517,10 +8701,11 @@ unsigned int EditorCtrl::GetLastLineInFold(const vector<cxFold*>& fStack) const
 	for (vector<cxFold*>::const_iterator s = fStack.begin(); s != fStack.end(); ++s) foldStack.push_back(*s);
 
     // Convert pointer to iterator
-	vector<cxFold>::const_iterator p = m_folds.begin() + (foldStack.back() - &*m_folds.begin());
+	const vector<cxFold>& folds = m_foldIndex.GetFolds();
+	vector<cxFold>::const_iterator p = folds.begin() + (foldStack.back() - &*folds.begin());
 	const unsigned int foldLine = p->line_id;
 
-	for (vector<cxFold>::const_iterator f = p+1; f != m_folds.end(); ++f) {
+	for (vector<cxFold>::const_iterator f = p+1; f != folds.end(); ++f) {
 		if (f->type != cxFOLD_END){
 			foldStack.push_back(&*f);
 			continue;
@@ -8552,8 +8737,9 @@ void EditorCtrl::Fold(unsigned int line_id) {
 	// Find the foldmarker
 	vector<cxFold*> foldStack = GetFoldStack(line_id);
 	wxASSERT(!foldStack.empty());
-	vector<cxFold>::iterator p = m_folds.begin() + (foldStack.back() - &*m_folds.begin()); // convert pointer to iterator
-	wxASSERT(p != m_folds.end() && p->type == cxFOLD_START);
+	vector<cxFold>& folds = m_foldIndex.GetFolds();
+	vector<cxFold>::iterator p = folds.begin() + (foldStack.back() - &*folds.begin()); // convert pointer to iterator
+	wxASSERT(p != folds.end() && p->type == cxFOLD_START);
 	wxASSERT(p->line_id == line_id);
 
 	// Do the fold
@@ -8578,7 +8764,8 @@ void EditorCtrl::Fold(unsigned int line_id) {
 }
 
 void EditorCtrl::FoldAll() {
-	for (vector<cxFold>::iterator p = m_folds.begin(); p != m_folds.end(); ++p)
+	vector<cxFold>& folds = m_foldIndex.GetFolds();
+	for (vector<cxFold>::iterator p = folds.begin(); p != folds.end(); ++p)
 		if (p->type == cxFOLD_START) Fold(p->line_id);
 }
 
@@ -8595,9 +8782,10 @@ void EditorCtrl::UnFold(unsigned int line_id) {
 	wxASSERT(line_id < m_lines.GetLineCount());
 
 	// Find the foldmarker
+	vector<cxFold>& folds = m_foldIndex.GetFolds();
 	const cxFold target(line_id);
-	vector<cxFold>::iterator p = lower_bound(m_folds.begin(), m_folds.end(), target);
-	wxASSERT(p != m_folds.end() && p->type == cxFOLD_START_FOLDED);
+	vector<cxFold>::iterator p = lower_bound(folds.begin(), folds.end(), target);
+	wxASSERT(p != folds.end() && p->type == cxFOLD_START_FOLDED);
 
 	p->type = cxFOLD_START;
 	p->count = 0;
@@ -8617,7 +8805,8 @@ void EditorCtrl::UnFoldParents(unsigned int line_id) {
 }
 
 void EditorCtrl::UnFoldAll() {
-	for (vector<cxFold>::iterator p = m_folds.begin(); p != m_folds.end(); ++p) {
+	vector<cxFold>& folds = m_foldIndex.GetFolds();
+	for (vector<cxFold>::iterator p = folds.begin(); p != folds.end(); ++p) {
 		if (p->type == cxFOLD_START_FOLDED) {
 			p->type = cxFOLD_START;
 			p->count = 0;
@@ -8651,7 +8840,8 @@ void EditorCtrl::SelectFold(unsigned int line_id) {
 	while (foldStack.size() > 1 && foldStack.back()->type == cxFOLD_START_FOLDED) foldStack.pop_back();
 
 	// Find start of fold
-	vector<cxFold>::iterator p = m_folds.begin() + (foldStack.back() - &*m_folds.begin()); // convert pointer to iterator
+	vector<cxFold>& folds = m_foldIndex.GetFolds();
+	vector<cxFold>::iterator p = folds.begin() + (foldStack.back() - &*folds.begin()); // convert pointer to iterator
 	const unsigned int fold_start = m_lines.GetLineStartpos(p->line_id);
 
 	// Find the end of fold
@@ -8667,24 +8857,30 @@ void EditorCtrl::SelectFold(unsigned int line_id) {
 bool EditorCtrl::IsLineFolded(unsigned int line_id) const {
 	wxASSERT(line_id < m_lines.GetLineCount());
 
-	const cxFold target(line_id);
-	vector<cxFold>::const_iterator p = lower_bound(m_folds.begin(), m_folds.end(), target);
-	return p != m_folds.end() && p->line_id == line_id && p->type == cxFOLD_START_FOLDED;
+	const size_t f = m_foldIndex.Find(line_id);
+	return f < m_foldIndex.size() && m_foldIndex.GetLine(f) == line_id && m_foldIndex.GetType(f) == cxFOLD_START_FOLDED;
 }
 
 bool EditorCtrl::IsPosInFold(unsigned int pos, unsigned int* fold_start, unsigned int* fold_end) {
 	wxASSERT(pos <= GetLength());
 	const unsigned int line_id = m_lines.GetLineFromCharPos(pos);
 
-	vector<cxFold>::const_iterator p = m_folds.begin();
-	while (p != m_folds.end()) {
-		if (p->type == cxFOLD_START_FOLDED) {
+	// Only folds before the line can contain it, so this is done on
+	// the fold index (the caret is checked after each edit, and the
+	// folds after it may still have a pending shift)
+	const size_t foldCount = m_foldIndex.size();
+	size_t f = 0;
+	while (f < foldCount) {
+		const unsigned int foldLine = m_foldIndex.GetLine(f);
+		if (foldLine >= line_id) break;
+
+		if (m_foldIndex.GetType(f) == cxFOLD_START_FOLDED) {
 			// Check if we have passed pos
-			const unsigned int line_end = m_lines.GetLineEndpos(p->line_id, true);
+			const unsigned int line_end = m_lines.GetLineEndpos(foldLine, true);
 			if (line_end >= pos) return false;
 
 			// Check if we are in fold
-			const unsigned int lastline = p->line_id + p->count;
+			const unsigned int lastline = foldLine + m_foldIndex.GetCount(f);
 			if (line_id <= lastline) {
 				if (fold_start) *fold_start = line_end;
 				if (fold_end) *fold_end = m_lines.GetLineEndpos(lastline, false);
@@ -8692,9 +8888,9 @@ bool EditorCtrl::IsPosInFold(unsigned int pos, unsigned int* fold_start, unsigne
 			}
 
 			// Advance to end of fold
-			while (p != m_folds.end() && p->line_id <= lastline) ++p;
+			f = m_foldIndex.Find(lastline+1, f);
 		}
-		else ++p;
+		else ++f;
 	}
 
 	return false;
@@ -8707,7 +8903,8 @@ vector<cxFold*> EditorCtrl::GetFoldStack(unsigned int line_id) {
 
 	wxASSERT(line_id < m_foldLineCount);
 
-	for (vector<cxFold>::iterator p = m_folds.begin(); p != m_folds.end(); ++p) {
+	vector<cxFold>& folds = m_foldIndex.GetFolds();
+	for (vector<cxFold>::iterator p = folds.begin(); p != folds.end(); ++p) {
 
 		if (p->type == cxFOLD_END) {
 			// Check if end marker matches any starter on the stack (ignore unmatched)
@@ -35,6 +35,9 @@
 #include "DetectTripleClicks.h"
 #include "AutoPairs.h"
 #include "Bookmarks.h"
+#include "FoldIndex.h"
+#include "WordIndex.h"
+#include "IdleScheduler.h"
 
 #include "IFoldingEditor.h"
 #include "IEditorDoAction.h"
@@ -259,6 +262,9 @@ public:
 	const wxString& GetSyntaxName() const {return m_syntaxstyler.GetName();};
 	void SetSyntax(const wxString& syntaxName, bool isManual=false);
 	void AddStyler(Styler& styler) {m_lines.AddStyler(styler);};
+
+	// Background jobs (with timings for profiling)
+	const IdleScheduler& GetIdleJobs() const {return m_idleJobs;};
 	const deque<const wxString*> GetScope();
 
 	// Indentation
@@ -317,6 +323,7 @@ public:
 	// Completion
 	void DoCompletion();
 	wxArrayString GetCompletionList();
+	void GetCompletionWords(const wxString& prefix, vector<wxString>& words);
 
 	// Symbols
 	virtual int GetSymbols(vector<SymbolRef>& symbols) const;
@@ -328,7 +335,7 @@ public:
 
 	// Folding
 	vector<unsigned int> GetFoldedLines() const;
-	virtual const vector<cxFold>& GetFolds() const {return m_folds;};
+	virtual const vector<cxFold>& GetFolds() const {return m_foldIndex.GetFolds();};
 	void UpdateFolds() {ParseFoldMarkers();};
 	void Fold(unsigned int line_id);
 	void FoldAll();
@@ -412,6 +419,12 @@ private:
 	static void OnBundlesReloaded(EditorCtrl* self, void* data, int filter);
 	static void OnSettingsChanged(EditorCtrl* self, void* data, int filter);
 
+	// Idle jobs
+	static bool OnIdleLines(EditorCtrl* self, const IdleScheduler::Slice& slice);
+	static bool OnIdleSyntax(EditorCtrl* self, const IdleScheduler::Slice& slice);
+	static bool OnIdleFolds(EditorCtrl* self, const IdleScheduler::Slice& slice);
+	static bool OnIdleStylers(EditorCtrl* self, const IdleScheduler::Slice& slice);
+
 	void SetMate(const wxString& mate) {m_mate = mate;}
 	void NotifyParentMate();
 	void ClearRemoteInfo();
@@ -467,6 +480,7 @@ protected:
 	wxString GetCurrentLine();
 
 	bool DoFind(const wxString& text, unsigned int start_pos, int options=0, bool dir_forward = true);
+	bool BatchReplaceAll(const wxString& searchtext, const wxString& replacetext, int options, unsigned int& replacements, int& caretPos);
 
 	void GetCompletionMatches(interval wordIv, wxArrayString& result, bool precharbase) const;
 
@@ -502,8 +516,8 @@ protected:
 	void FoldingDelete(unsigned int start, unsigned int end);
 	void FoldingApplyDiff(const vector<cxLineChange>& linechanges);
 	void FoldingReIndent();
-	void ParseFoldMarkers();
-	vector<cxFold>::iterator ParseFoldLine(unsigned int line_id, vector<cxFold>::iterator insertPos, bool doFold);
+	bool ParseFoldMarkers(const IdleScheduler::Slice* slice=NULL);
+	void ParseFoldLines(unsigned int firstLine, unsigned int endLine, bool refoldFirst, vector<cxFold>& folds);
 	unsigned int GetLastLineInFold(const vector<cxFold*>& foldStack) const;
 
 	// Commands
@@ -533,6 +547,8 @@ protected:
 	Styler_HtmlHL m_html_hl_styler;
 	Styler_Syntax m_syntaxstyler;
 
+	IdleScheduler m_idleJobs;
+
 	wxTimer m_foldTooltipTimer;
 	TextTip* m_activeTooltip;
 
@@ -551,8 +567,6 @@ protected:
 	unsigned int lastpos;
 	int m_currentSel;
 	bool do_freeze;
-	mutable int m_options_cache; // for compiled regex
-	mutable pcre *m_re; // for last compiled regex
 	mutable unsigned int m_symbolCacheToken;
 
 	// Above: set in constructors' intializer list
@@ -583,7 +597,7 @@ protected:
 	void* m_callbackData;
 
 	// Folding vars
-	vector<cxFold> m_folds;
+	FoldIndex m_foldIndex;
 	unsigned int m_foldedLines;
 	unsigned int m_foldLineCount;
 	unsigned int m_foldTooltipLine;
@@ -591,6 +605,9 @@ protected:
 	// Bookmarks
 	Bookmarks bookmarks;
 
+	// Words for completion (built on first completion)
+	mutable WordIndex m_wordIndex;
+
 	action lastaction;
 	wxPoint lastMousePos; // Used to check if mouse have really moved
 
@@ -644,9 +661,6 @@ protected:
 	// Symbol cache
 	mutable vector<SymbolRef> m_symbolCache;
 
-	// Cache of last compiled regex
-	mutable wxString m_regex_cache;
-
 	// Key state
 	static unsigned long s_ctrlDownTime;
 	static bool s_altGrDown;
@@ -1369,6 +1369,14 @@ void EditorFrame::FocusEditor() {
 	if (editorCtrl != NULL) editorCtrl->SetFocus();
 }
 
+void EditorFrame::GetEditorCtrls(vector<EditorCtrl*>& editors) {
+	const unsigned int pageCount = m_tabBar->GetPageCount();
+	for (unsigned int i = 0; i < pageCount; ++i) {
+		EditorCtrl* page = GetEditorCtrlFromPage(i);
+		if (page) editors.push_back(page);
+	}
+}
+
 EditorCtrl* EditorFrame::GetEditorCtrlFromPage(size_t page_idx) {
 	wxWindow* page = m_tabBar->GetPage(page_idx);
 	if (!page) return NULL;
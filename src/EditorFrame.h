@@ -196,6 +196,7 @@ public:
 	void GotoPos(int line, int column);
 	bool CloseTab(unsigned int tab_id, bool removetab=true);
 	EditorCtrl* GetEditorCtrl();
+	void GetEditorCtrls(vector<EditorCtrl*>& editors);
 	virtual IEditorSearch* GetSearch();
 
 	// Editor Service methods.
@@ -32,10 +32,11 @@ BEGIN_EVENT_TABLE(FindCmdDlg, wxDialog)
 	EVT_TEXT(CTRL_SEARCH, FindCmdDlg::OnSearch)
 	EVT_TEXT_ENTER(CTRL_SEARCH, FindCmdDlg::OnAction)
 	EVT_LISTBOX_DCLICK(CTRL_ALIST, FindCmdDlg::OnAction)
+	EVT_IDLE(FindCmdDlg::OnIdle)
 END_EVENT_TABLE()
 
 FindCmdDlg::FindCmdDlg(wxWindow *parent,  const vector<const tmAction*>& actions):
-	wxDialog (parent, -1, wxEmptyString, wxDefaultPosition, wxDefaultSize, wxDEFAULT_DIALOG_STYLE|wxRESIZE_BORDER), m_actions(actions) 
+	wxDialog (parent, -1, wxEmptyString, wxDefaultPosition, wxDefaultSize, wxDEFAULT_DIALOG_STYLE|wxRESIZE_BORDER), m_actions(actions), m_searchPending(false)
 {
 	SetTitle (_("Select Bundle Item"));
 
@@ -62,11 +63,23 @@ FindCmdDlg::~FindCmdDlg() {
 	m_searchCtrl->PopEventHandler(true);
 }
 
-void FindCmdDlg::OnSearch(wxCommandEvent& event) {
-	m_cmdList->Find(event.GetString());
+void FindCmdDlg::OnSearch(wxCommandEvent& WXUNUSED(event)) {
+	// Wait for idle, so that fast typing does not
+	// search for text that has already been changed
+	m_searchPending = true;
+}
+
+void FindCmdDlg::OnIdle(wxIdleEvent& WXUNUSED(event)) {
+	if (m_searchPending) UpdateSearch();
+}
+
+void FindCmdDlg::UpdateSearch() {
+	m_searchPending = false;
+	m_cmdList->Find(m_searchCtrl->GetValue());
 }
 
 void FindCmdDlg::OnAction(wxCommandEvent& WXUNUSED(event)) {
+	if (m_searchPending) UpdateSearch();
 	if(m_cmdList->GetSelectedCount() == 1) EndModal(wxID_OK);
 }
 
@@ -80,9 +93,11 @@ void FindCmdDlg::SearchEvtHandler::OnChar(wxKeyEvent& event) {
 	switch ( event.GetKeyCode() )
     {
 	case WXK_UP:
+		if (m_parent.m_searchPending) m_parent.UpdateSearch();
 		m_actionList.SelectPrev();
 		return;
 	case WXK_DOWN:
+		if (m_parent.m_searchPending) m_parent.UpdateSearch();
 		m_actionList.SelectNext();
 		return;
 	case WXK_ESCAPE:
@@ -96,6 +111,15 @@ void FindCmdDlg::SearchEvtHandler::OnChar(wxKeyEvent& event) {
 
 // --- ActionList --------------------------------------------------------
 
+// Orders action indices by the name of the actions
+class ActionNameLess {
+public:
+	ActionNameLess(const vector<const tmAction*>& actions) : m_actions(actions) {};
+	bool operator()(unsigned int a, unsigned int b) const {return m_actions[a]->name < m_actions[b]->name;};
+private:
+	const vector<const tmAction*>& m_actions;
+};
+
 FindCmdDlg::ActionList::ActionList(wxWindow* parent, wxWindowID id, const vector<const tmAction*>& actions)
 : SearchListBox(parent, id), m_actions(actions) {
 	// We need a unicode font
@@ -103,6 +127,14 @@ FindCmdDlg::ActionList::ActionList(wxWindow* parent, wxWindowID id, const vector
 	m_unifont = wxFont(fontsize, wxFONTFAMILY_DEFAULT, wxFONTSTYLE_NORMAL, wxFONTWEIGHT_NORMAL,
 		false, wxT("Lucida Sans Unicode"));
 
+	// The actions are listed by name when there is no search
+	m_sorted.resize(m_actions.size());
+	for (unsigned int i = 0; i < m_actions.size(); ++i) {
+		m_sorted[i] = i;
+		m_matcher.AddName(m_actions[i]->name);
+	}
+	sort(m_sorted.begin(), m_sorted.end(), ActionNameLess(m_actions));
+
 	SetAllItems();
 }
 
@@ -113,8 +145,12 @@ void FindCmdDlg::ActionList::OnDrawItem(wxDC& dc, const wxRect& rect, size_t n)
 	const unsigned int ypos = rect.y + m_topMargin;
 	unsigned int rightBorder = rect.GetRight();
 
-	const tmAction& action = *m_items[n].action;
-	const vector<unsigned int>& hl = m_items[n].hlChars;
+	const unsigned int index = GetActionIndex(n);
+	const tmAction& action = *m_actions[index];
+
+	// Only the rows that are drawn need the matched chars
+	if (m_matcher.GetText().empty()) m_hlChars.clear();
+	else m_matcher.GetHighlights(index, m_hlChars);
 
 	wxString name = action.name;
 	if (action.bundle) {
@@ -180,19 +216,13 @@ void FindCmdDlg::ActionList::OnDrawItem(wxDC& dc, const wxRect& rect, size_t n)
 	}
 
 	// Draw action name
-	DrawItemText(dc, rect, name, hl, isCurrent);
+	DrawItemText(dc, rect, name, m_hlChars, isCurrent);
 }
 
 void FindCmdDlg::ActionList::SetAllItems() {
-	m_items.clear();
-	m_items.resize(m_actions.size());
-
-	for (unsigned int i = 0; i < m_actions.size(); ++i) {
-		m_items[i].action = m_actions[i];
-	}
+	m_matcher.Find(wxEmptyString);
 
-	sort(m_items.begin(), m_items.end());
-	SetItemCount(m_items.size());
+	SetItemCount(m_actions.size());
 	SetSelection(-1);
 	RefreshAll();
 }
@@ -203,57 +233,21 @@ void FindCmdDlg::ActionList::Find(const wxString& searchtext) {
 		return;
 	}
 
-	// Convert to upper case for case insensitive search
-	const wxString text = searchtext.Upper();
+	// Matching ignores case (ranked when drawn)
+	m_matcher.Find(searchtext);
+	SetItemCount(m_matcher.GetMatchCount());
 
-	m_items.clear();
-	vector<unsigned int> hlChars;
-	for (unsigned int i = 0; i < m_actions.size(); ++i) {
-		const wxString& name = m_actions[i]->name;
-		unsigned int charpos = 0;
-		wxChar c = text[charpos];
-		hlChars.clear();
-
-		for (unsigned int textpos = 0; textpos < name.size(); ++textpos) {
-			if ((wxChar)wxToupper(name[textpos]) == c) {
-				hlChars.push_back(textpos);
-				++charpos;
-				if (charpos == text.size()) {
-					// All chars found.
-					m_items.push_back(aItem(m_actions[i], hlChars));
-					break;
-				}
-				else c = text[charpos];
-			}
-		}
-	}
-
-	sort(m_items.begin(), m_items.end());
-	SetItemCount(m_items.size());
-
-	if (m_items.empty()) SetSelection(-1); // deselect
+	if (m_matcher.GetMatchCount() == 0) SetSelection(-1); // deselect
 	else SetSelection(0);
 
 	RefreshAll();
 }
 
-const tmAction* FindCmdDlg::ActionList::GetSelectedAction() {
-	const int sel = GetSelection();
-	return sel == -1 ? NULL : m_items[sel].action;
+unsigned int FindCmdDlg::ActionList::GetActionIndex(unsigned int n) const {
+	return m_matcher.GetText().empty() ? m_sorted[n] : m_matcher.GetMatch(n);
 }
 
-
-// --- aItem --------------------------------------------------------
-
-FindCmdDlg::ActionList::aItem::aItem(const tmAction* a, const vector<unsigned int>& hl)
-: action(a), hlChars(hl) {
-	// Calculate rank (total distance between chars)
-	rank = 0;
-	if (hlChars.size() <= 1) return;
-
-	unsigned int prev = hlChars[0]+1;
-	for (vector<unsigned int>::const_iterator p = hlChars.begin()+1; p != hlChars.end(); ++p) {
-		rank += *p - prev;
-		prev = *p+1;
-	}
+const tmAction* FindCmdDlg::ActionList::GetSelectedAction() {
+	const int sel = GetSelection();
+	return sel == -1 ? NULL : m_actions[GetActionIndex(sel)];
 }
@@ -21,6 +21,7 @@
 #endif
 
 #include "SearchListBox.h"
+#include "FuzzyMatcher.h"
 #include "tmAction.h"
 
 #include <vector>
@@ -33,9 +34,12 @@ public:
 	const tmAction* GetSelection() {return m_cmdList->GetSelectedAction();};
 
 private:
+	void UpdateSearch();
+
 	// Event handlers
 	void OnSearch(wxCommandEvent& event);
 	void OnAction(wxCommandEvent& event);
+	void OnIdle(wxIdleEvent& event);
 	DECLARE_EVENT_TABLE();
 
 	class ActionList : public SearchListBox {
@@ -47,27 +51,17 @@ private:
 	private:
 		void OnDrawItem(wxDC& dc, const wxRect& rect, size_t n) const;
 		void SetAllItems();
-
-		class aItem {
-		public:
-			aItem() : action(NULL), rank(0) {};
-			aItem(const tmAction* a, const std::vector<unsigned int>& hl);
-			bool operator<(const aItem& ai) const {
-				if (rank < ai.rank) return true;
-				if (rank > ai.rank) return false;
-				if (action && ai.action) return action->name < ai.action->name;
-				return false;
-			}
-			const tmAction* action;
-			std::vector<unsigned int> hlChars;
-			unsigned int rank;
-		};
+		unsigned int GetActionIndex(unsigned int n) const;
 
 		const std::vector<const tmAction*>& m_actions;
-		std::vector<aItem> m_items;
+		std::vector<unsigned int> m_sorted; // by name
+		FuzzyMatcher m_matcher;
+		mutable std::vector<unsigned int> m_hlChars;
 		wxFont m_unifont;
 	};
 
+	class SearchEvtHandler;
+	friend class SearchEvtHandler;
 	class SearchEvtHandler : public wxEvtHandler {
 	public:
 		SearchEvtHandler(FindCmdDlg& parent, ActionList& alist)
@@ -84,6 +78,7 @@ private:
 	const std::vector<const tmAction*>& m_actions;
 	wxTextCtrl* m_searchCtrl;
 	ActionList* m_cmdList;
+	bool m_searchPending;
 };
 
 #endif // __FINDCMDDLG_H_
@@ -15,26 +15,40 @@
 #include "MMapBuffer.h"
 #include "EditorFrame.h"
 #include "ProjectInfoHandler.h"
+#include "ProjectFileIndex.h"
 #include "Strings.h"
+#include "LiteralMatcher.h"
 #include "pcre.h"
 
 #include "eBrowser.h"
 
+#include <wx/thread.h>
+#include <wx/stopwatch.h>
+#include <deque>
+#include <map>
+#include <vector>
+
+using namespace std;
+
 class SearchThread : public wxThread {
 public:
 	SearchThread();
 	virtual void* Entry();
 	void DeleteThread();
 
-	void StartSearch(const wxString& path, const wxString& pattern, bool matchCase, bool regex);
+	void StartSearch(const wxString& path, const ProjectFileIndex& fileIndex, const wxString& pattern, bool matchCase, bool regex);
 	void CancelSearch();
 	bool IsSearching() const {return m_isSearching;};
 	bool LastError() const {return m_lastError;};
 
 	bool GetCurrentPath(wxString& currentPath);
 	bool UpdateOutput(wxString& output);
+	void GetStats(unsigned int& files, wxFileOffset& bytes, long& msecs);
 
 private:
+	class SearchWorker;
+	friend class SearchWorker;
+
 	struct FileMatch {
 		unsigned int line;
 		unsigned int column;
@@ -48,23 +62,46 @@ private:
 		wxCharBuffer UTF8buffer;
 		wxCharBuffer UTF8bufferUpper;
 		size_t byte_len;
-		char charmap[256];
-		char lastChar;
+		LiteralMatcher matcher;
 		bool matchCase;
 		pcre* regex;
 		wxString output;
 	};
 
-	void SearchDir(const wxString& path, const SearchInfo& si, ProjectInfoHandler& infoHandler);
+	// A file waiting to be searched. The sequence number is the
+	// position in the (depth-first) enumeration order, so that
+	// results can be merged back in a deterministic order.
+	struct FileJob {
+		unsigned int seq;
+		wxString path;
+	};
+
+	// Each worker owns a queue. The enumerator deals jobs out round-robin,
+	// workers pop from the front of their own queue and steal from the
+	// back of the others when they run dry.
+	struct WorkQueue {
+		deque<FileJob> jobs;
+	};
+
+	void SearchDir(const wxString& path, ProjectInfoHandler& infoHandler);
 	void DoSearch(const MMapBuffer& buf, const SearchInfo& si, vector<FileMatch>& matches) const;
-	void WriteResult(const MMapBuffer& buf, const wxFileName& filepath, vector<FileMatch>& matches);
+	void WriteResult(const MMapBuffer& buf, const wxFileName& filepath, vector<FileMatch>& matches, wxString& output) const;
 	bool PrepareSearchInfo(SearchInfo& si, const wxString& pattern, bool matchCase, bool regex);
 
+	// Work pool
+	void StartWorkers(const SearchInfo& si);
+	void StopWorkers();
+	void AddJob(const wxString& path);
+	bool TakeJob(size_t workerNdx, FileJob& job);
+	void SearchFile(const FileJob& job, const SearchInfo& si, MMapBuffer& buf, vector<FileMatch>& matches);
+	void MergeResult(unsigned int seq, const wxString& result, wxFileOffset bytes);
+
 	// Member variables
 	bool m_isSearching;
 	bool m_isWaiting;
 	bool m_stopSearch;
 	wxString m_path;
+	const ProjectFileIndex* m_fileIndex;
 	wxString m_pattern;
 	bool m_matchCase;
 	bool m_regex;
@@ -75,8 +112,50 @@ private:
 
 	wxMutex m_condMutex;
 	wxCondition m_startSearchCond;
+
+	// Work pool (only valid while searching)
+	vector<SearchWorker*> m_workers;
+	vector<WorkQueue*> m_queues;
+	wxCriticalSection m_queueCrit; // guards all the queues
+	wxSemaphore m_jobSemaphore;
+	unsigned int m_jobCount;
+	bool m_stopWorkers; // set when all jobs have been added
+
+	// Merge state (protected by m_outputCrit)
+	map<unsigned int, wxString> m_pendingResults;
+	unsigned int m_nextSeq;
+
+	// Throughput stats (protected by m_outputCrit)
+	unsigned int m_filesSearched;
+	wxFileOffset m_bytesSearched;
+	wxStopWatch m_searchTime;
+	long m_searchMsecs;
 };
 
+class SearchThread::SearchWorker : public wxThread {
+public:
+	SearchWorker(SearchThread& parent, const SearchInfo& si, size_t ndx)
+	: wxThread(wxTHREAD_JOINABLE), m_parent(parent), m_si(si), m_ndx(ndx) {
+		Create();
+		Run();
+	};
+
+	virtual void* Entry() {
+		MMapBuffer buf;
+		vector<FileMatch> matches;
+		FileJob job;
+
+		while (m_parent.TakeJob(m_ndx, job)) {
+			m_parent.SearchFile(job, m_si, buf, matches);
+		}
+		return NULL;
+	};
+
+private:
+	SearchThread& m_parent;
+	const SearchInfo& m_si;
+	const size_t m_ndx;
+};
 
 // Ctrl id's
 enum {
@@ -165,7 +244,7 @@ void FindInProjectDlg::OnSearch(wxCommandEvent& WXUNUSED(event)) {
 
 	wxLogDebug(wxT("Searching:"));
 	const wxString path = projectDir.GetPath() + wxFILE_SEP_PATH;
-	m_searchThread->StartSearch(path, searchtext, m_caseCheck->GetValue(), m_regexCheck->GetValue());
+	m_searchThread->StartSearch(path, m_projectPane.GetFileIndex(), searchtext, m_caseCheck->GetValue(), m_regexCheck->GetValue());
 
 	m_inSearch = true;
 	m_searchButton->SetLabel(_("Cancel"));
@@ -179,7 +258,7 @@ void FindInProjectDlg::OnIdle(wxIdleEvent& event) {
 				m_searchThread->GetCurrentPath(errorMsg);
 				m_pathStatic->SetLabel(errorMsg);
 			}
-			else if (!m_pathStatic->GetLabel().empty()) m_pathStatic->SetLabel(wxT(""));
+			else m_pathStatic->SetLabel(GetStatsLabel());
 
 			m_searchButton->SetLabel(_("Search"));
 			m_inSearch = false;
@@ -187,8 +266,9 @@ void FindInProjectDlg::OnIdle(wxIdleEvent& event) {
 		return;
 	}
 
-	wxString currentPath = m_pathStatic->GetLabel();
-	if (m_searchThread->GetCurrentPath(currentPath)) m_pathStatic->SetLabel(currentPath);
+	m_searchThread->GetCurrentPath(m_currentPath);
+	const wxString status = m_currentPath + wxT("  ") + GetStatsLabel();
+	if (status != m_pathStatic->GetLabel()) m_pathStatic->SetLabel(status);
 
 	if (m_searchThread->UpdateOutput(m_output)) {
 		m_browser->LoadString(m_output);
@@ -197,6 +277,17 @@ void FindInProjectDlg::OnIdle(wxIdleEvent& event) {
 	event.RequestMore(); // we don't want the search to look slow :-)
 }
 
+wxString FindInProjectDlg::GetStatsLabel() const {
+	unsigned int files;
+	wxFileOffset bytes;
+	long msecs;
+	m_searchThread->GetStats(files, bytes, msecs);
+
+	const double secs = wxMax(msecs, 1L) / 1000.0;
+	const double mb = bytes / (1024.0 * 1024.0);
+	return wxString::Format(_("(%u files, %.1f MB in %.1fs - %.0f files/s, %.1f MB/s)"), files, mb, msecs / 1000.0, files / secs, mb / secs);
+}
+
 void FindInProjectDlg::OnClose(wxCloseEvent& event) {
 	Hide();
 	if (m_searchThread->IsSearching()) m_searchThread->CancelSearch();
@@ -218,7 +309,8 @@ void FindInProjectDlg::OnBeforeLoad(IHtmlWndBeforeLoadEvent& event) {
 // ---- SearchThread ---------------------------------------------------------------------------------------
 
 SearchThread::SearchThread():
-	m_isSearching(false), m_isWaiting(false), m_stopSearch(false), m_lastError(false), m_startSearchCond(m_condMutex) 
+	m_isSearching(false), m_isWaiting(false), m_stopSearch(false), m_fileIndex(NULL), m_lastError(false), m_startSearchCond(m_condMutex),
+	m_jobCount(0), m_stopWorkers(false), m_nextSeq(0), m_filesSearched(0), m_bytesSearched(0), m_searchMsecs(0)
 {
 	// Create and run the thread
 	Create();
@@ -244,16 +336,42 @@ void* SearchThread::Entry() {
 		if (!PrepareSearchInfo(si, m_pattern, m_matchCase, m_regex)) continue;
 
 		m_isSearching = true;
-		
-		ProjectInfoHandler infoHandler;
-		infoHandler.SetRoot(m_path);
 
 		// Write the html header for output
 		m_outputCrit.Enter();
 		m_output = wxT("<head><style type=\"text/css\">#match {background-color: yellow}</style></head>");
+		m_pendingResults.clear();
+		m_nextSeq = 0;
+		m_filesSearched = 0;
+		m_bytesSearched = 0;
+		m_searchMsecs = 0;
+		m_searchTime.Start();
 		m_outputCrit.Leave();
 
-		SearchDir(m_path, si, infoHandler);
+		// The file index may still be doing its first scan
+		while (m_isSearching && !m_fileIndex->IsReady() && m_fileIndex->IsScanning()) Sleep(100);
+
+		// Deal out the files while the workers search them
+		StartWorkers(si);
+		if (m_fileIndex->IsReady()) {
+			vector<wxString> paths;
+			m_fileIndex->GetFiles(paths);
+
+			for (vector<wxString>::const_iterator p = paths.begin(); p != paths.end() && m_isSearching; ++p) {
+				AddJob(*p);
+			}
+		}
+		else {
+			// No index for this project (like remote projects), so walk the dirs
+			ProjectInfoHandler infoHandler;
+			infoHandler.SetRoot(m_path);
+			SearchDir(m_path, infoHandler);
+		}
+		StopWorkers();
+
+		m_outputCrit.Enter();
+			m_searchMsecs = m_searchTime.Time();
+		m_outputCrit.Leave();
 		m_isSearching = false;
 
 		// Clean up
@@ -273,8 +391,9 @@ void SearchThread::DeleteThread() {
 	m_startSearchCond.Signal();
 }
 
-void SearchThread::StartSearch(const wxString& path, const wxString& pattern, bool matchCase, bool regex) {
-	m_path = path;
+void SearchThread::StartSearch(const wxString& path, const ProjectFileIndex& fileIndex, const wxString& pattern, bool matchCase, bool regex) {
+	m_path = path.c_str(); // wxString is not threadsafe, so we have to force copy
+	m_fileIndex = &fileIndex;
 	m_pattern = pattern.c_str(); // wxString is not threadsafe, so we have to force copy
 	m_matchCase = matchCase;
 	m_regex = regex;
@@ -310,6 +429,14 @@ bool SearchThread::UpdateOutput(wxString& output) {
 	return true;
 }
 
+void SearchThread::GetStats(unsigned int& files, wxFileOffset& bytes, long& msecs) {
+	wxCriticalSectionLocker locker(m_outputCrit);
+
+	files = m_filesSearched;
+	bytes = m_bytesSearched;
+	msecs = m_isSearching ? m_searchTime.Time() : m_searchMsecs;
+}
+
 bool SearchThread::PrepareSearchInfo(SearchInfo& si, const wxString& pattern, bool matchCase, bool regex) {
 	si.pattern = pattern;
 	si.matchCase = matchCase;
@@ -364,53 +491,148 @@ bool SearchThread::PrepareSearchInfo(SearchInfo& si, const wxString& pattern, bo
 			wxASSERT(si.byte_len == strlen(si.UTF8bufferUpper));
 		}
 
-		// Build a dictionary of char-to-last distances in the search string
-		// since this is a char, distances in the searchstring can not be longer than 256
-		memset(si.charmap, si.byte_len, 256);
-		const size_t last_char_pos = si.byte_len-1;
-		for (size_t i = 0; i < last_char_pos; ++i) {
-			si.charmap[si.UTF8buffer[i]] = last_char_pos-i;
-			if (!matchCase) si.charmap[si.UTF8bufferUpper[i]] = last_char_pos-i;
-		}
+		si.matcher.Set(si.UTF8buffer.data(), matchCase ? NULL : si.UTF8bufferUpper.data(), si.byte_len);
 	}
 	return true;
 }
 
-void SearchThread::SearchDir(const wxString& path, const SearchInfo& si, ProjectInfoHandler& infoHandler) {
-	MMapBuffer buf;
-	wxFileName filepath;
-	vector<FileMatch> matches;
+void SearchThread::StartWorkers(const SearchInfo& si) {
+	wxASSERT(m_workers.empty());
+
+	// Leave one core for the enumerator and the gui
+	const int cpus = wxThread::GetCPUCount();
+	const size_t workerCount = (cpus > 2) ? wxMin(cpus-1, 16) : 1;
+
+	m_jobCount = 0;
+	m_stopWorkers = false;
+	for (size_t i = 0; i < workerCount; ++i) m_queues.push_back(new WorkQueue);
+	for (size_t i = 0; i < workerCount; ++i) m_workers.push_back(new SearchWorker(*this, si, i));
+}
+
+void SearchThread::StopWorkers() {
+	// Wake up all workers. When the queues are empty
+	// (or the search is cancelled) they will exit.
+	m_stopWorkers = true;
+	for (size_t i = 0; i < m_workers.size(); ++i) m_jobSemaphore.Post();
+
+	for (vector<SearchWorker*>::iterator w = m_workers.begin(); w != m_workers.end(); ++w) {
+		(*w)->Wait();
+		delete *w;
+	}
+	m_workers.clear();
+
+	// Cancelled searches may leave jobs (and their semaphore counts) behind
+	while (m_jobSemaphore.TryWait() == wxSEMA_NO_ERROR) {}
+	for (vector<WorkQueue*>::iterator q = m_queues.begin(); q != m_queues.end(); ++q) delete *q;
+	m_queues.clear();
+}
+
+void SearchThread::AddJob(const wxString& path) {
+	WorkQueue& queue = *m_queues[m_jobCount % m_queues.size()];
+
+	FileJob job;
+	job.seq = m_jobCount++;
+	job.path = path.c_str(); // wxString is not threadsafe, so we have to force copy
+
+	m_queueCrit.Enter();
+		queue.jobs.push_back(job);
+	m_queueCrit.Leave();
 
+	m_jobSemaphore.Post();
+}
+
+bool SearchThread::TakeJob(size_t workerNdx, FileJob& job) {
+	// Each post of the semaphore is either a job or a stop signal
+	m_jobSemaphore.Wait();
+	if (!m_isSearching) return false;
+
+	// The queues are scanned under one lock, so finding them all empty
+	// means that every job has been taken. Then we were woken by a stop
+	// signal, or another worker took our job after waking by one.
+	wxCriticalSectionLocker locker(m_queueCrit);
+
+	// Try own queue first, then steal from the others
+	const size_t queueCount = m_queues.size();
+	for (size_t i = 0; i < queueCount; ++i) {
+		WorkQueue& queue = *m_queues[(workerNdx + i) % queueCount];
+		if (queue.jobs.empty()) continue;
+
+		const FileJob& j = (i == 0) ? queue.jobs.front() : queue.jobs.back();
+		job.seq = j.seq;
+		job.path = j.path.c_str(); // wxString is not threadsafe, so we have to force copy
+		if (i == 0) queue.jobs.pop_front();
+		else queue.jobs.pop_back();
+		return true;
+	}
+
+	wxASSERT(m_stopWorkers);
+	return false; // stop signal
+}
+
+void SearchThread::SearchDir(const wxString& path, ProjectInfoHandler& infoHandler) {
 	wxArrayString dirs;
 	wxArrayString filenames;
 	infoHandler.GetDirAndFileLists(path, dirs, filenames);
 
 	for (size_t f = 0; f < filenames.size(); ++f) {
 		if (!m_isSearching) return;
-		m_outputCrit.Enter();
-			m_currentPath = path + filenames[f];
-		m_outputCrit.Leave();
-		filepath = m_currentPath;
-	
-		// Map the file to memory
-		buf.Open(filepath);
-		if (!buf.IsMapped()) {
-			wxLogDebug(wxT(" Mapping failed!"));
-			continue;
-		}
+		AddJob(path + filenames[f]);
+	}
 
-		// Search the file
-		DoSearch(buf, si, matches);
-		if (matches.empty()) continue; 
+	for (size_t d = 0; d < dirs.size(); ++d) {
+		if (!m_isSearching) return;
+		const wxString dirpath = path + dirs[d] + wxFILE_SEP_PATH;
+		SearchDir(dirpath, infoHandler);
+	}
+}
+
+void SearchThread::SearchFile(const FileJob& job, const SearchInfo& si, MMapBuffer& buf, vector<FileMatch>& matches) {
+	m_outputCrit.Enter();
+		m_currentPath = job.path.c_str(); // wxString is not threadsafe, so we have to force copy
+	m_outputCrit.Leave();
+	const wxFileName filepath = job.path;
 
-		// Show matches
-		WriteResult(buf, filepath, matches);
+	// Map the file to memory
+	buf.Open(filepath);
+	if (!buf.IsMapped()) {
+		wxLogDebug(wxT(" Mapping failed!"));
+		MergeResult(job.seq, wxEmptyString, 0);
+		return;
+	}
+
+	// Search the file
+	wxString result;
+	DoSearch(buf, si, matches);
+	if (!matches.empty()) {
+		WriteResult(buf, filepath, matches, result);
 		matches.clear();
 	}
 
-	for (size_t d = 0; d < dirs.size(); ++d) {
-		const wxString dirpath = path + dirs[d] + wxFILE_SEP_PATH;
-		SearchDir(dirpath, si, infoHandler);
+	MergeResult(job.seq, result, buf.Length());
+	buf.Close();
+}
+
+void SearchThread::MergeResult(unsigned int seq, const wxString& result, wxFileOffset bytes) {
+	wxCriticalSectionLocker locker(m_outputCrit);
+
+	++m_filesSearched;
+	m_bytesSearched += bytes;
+
+	// Results have to be output in enumeration order, so
+	// we keep out-of-order results until their turn comes.
+	if (seq != m_nextSeq) {
+		m_pendingResults[seq] = result.c_str(); // wxString is not threadsafe, so we have to force copy
+		return;
+	}
+
+	m_output += result;
+	++m_nextSeq;
+
+	map<unsigned int, wxString>::iterator p = m_pendingResults.begin();
+	while (p != m_pendingResults.end() && p->first == m_nextSeq) {
+		m_output += p->second;
+		m_pendingResults.erase(p++);
+		++m_nextSeq;
 	}
 }
 
@@ -448,54 +670,29 @@ void SearchThread::DoSearch(const MMapBuffer& buf, const SearchInfo& si, vector<
 		}
 	}
 	else {
-		// Prepare vars to avoid lookups in loop
-		const size_t last_char_pos = si.byte_len-1;
-		const char lastChar = si.UTF8buffer[last_char_pos];
-		const char lastCharUpper = si.matchCase ? '\0' : si.UTF8bufferUpper[last_char_pos];
-
-		subject = buf.data() + last_char_pos;
+		subject = buf.data();
 		end_pos = buf.data() + len;
 
 		while (subject < end_pos) {
-			const char c = *subject; // Get candidate for last char
-
-			if (c == lastChar || (!si.matchCase && c == lastCharUpper)) {
-				// Match indiviual chars
-				const char* byte_ptr = subject-1;
-				const char* const first_byte_pos = subject - last_char_pos;
-				unsigned int char_pos = last_char_pos-1;
-				while (byte_ptr >= first_byte_pos) {
-					const char c2 = *byte_ptr;
-					if (c2 != si.UTF8buffer[char_pos]) {
-						if (si.matchCase || c2 != si.UTF8bufferUpper[char_pos]) break;
-					}
-					--byte_ptr; --char_pos;
-				}
-
-				if (byte_ptr < first_byte_pos) {
-					// We got a match
-					const wxFileOffset matchStart = first_byte_pos - buf.data();
-					const FileMatch m = {0, 0, matchStart, matchStart + si.byte_len};
-					matches.push_back(m);
-
-					subject += si.byte_len;
-					continue;
-				}
-			}
+			const char* match = si.matcher.Find(subject, end_pos);
+			if (!match) break;
 
-			// If we don't have a match, see how far we can move char_pos
-			subject += si.charmap[(unsigned char)c];
+			const wxFileOffset matchStart = match - buf.data();
+			const FileMatch m = {0, 0, matchStart, matchStart + si.byte_len};
+			matches.push_back(m);
+
+			subject = match + si.byte_len;
 		}
 	}
 }
 
-void SearchThread::WriteResult(const MMapBuffer& buf, const wxFileName& filepath, vector<FileMatch>& matches) {
+void SearchThread::WriteResult(const MMapBuffer& buf, const wxFileName& filepath, vector<FileMatch>& matches, wxString& output) const {
 	if (matches.empty()) return;
 
 	// Header
 	const wxString path = filepath.GetFullPath();
 	const wxString format = (matches.size() == 1) ? _("<b>%s - %d match</b>") : _("<b>%s - %d matches</b>");
-	wxString output = wxString::Format(format, path.c_str(), matches.size());
+	output = wxString::Format(format, path.c_str(), matches.size());
 	output += wxT("<br><table cellspacing=0>");
 
 	unsigned int linecount = 1;
@@ -558,8 +755,4 @@ void SearchThread::WriteResult(const MMapBuffer& buf, const wxFileName& filepath
 	}
 
 	output += wxT("</table><p>");
-
-	m_outputCrit.Enter();
-		m_output += output;
-	m_outputCrit.Leave();
 }
@@ -41,6 +41,7 @@ private:
 	void OnIdle(wxIdleEvent& event);
 	void OnClose(wxCloseEvent& event);
 	void OnBeforeLoad(IHtmlWndBeforeLoadEvent& event);
+	wxString GetStatsLabel() const;
 	DECLARE_EVENT_TABLE();
 
 	// member ctrl's
@@ -56,6 +57,7 @@ private:
 	const ProjectInfoHandler& m_projectPane;
 	SearchThread* m_searchThread;
 	wxString m_output;
+	wxString m_currentPath;
 	bool m_inSearch;
 };
 
@@ -42,6 +42,8 @@ FixedLine::FixedLine(wxDC& dc, const DocumentWrapper& dw, const vector<interval>
 	m_indentWidth(0),
 	bmFold(1, 1), bmNewline(1, 1), bmSpace(1, 1), bmTab(1, 1)
 {
+	m_isFontFixedWidth = false;
+
 #ifdef __WXDEBUG__
 	m_inSetLine = false;
 #endif
@@ -129,6 +131,15 @@ void FixedLine::UpdateFont() {
 	mdc.SelectObject(wxNullBitmap);
 	bmFold.SetMask(new wxMask(bmMask));
 
+	// Cache widths of the most common glyphs for quick line breaking
+	m_breaker.ClearAdvances();
+	if (m_isFontFixedWidth) {
+		vector<unsigned int> chars;
+		for (unsigned int c = 1; c < 256; ++c) chars.push_back(c);
+		CacheGlyphs(chars);
+	}
+	UpdateBreaker();
+
 	// Invalidate cache
 	textstart = 0;
 	textend = 0;
@@ -303,6 +314,7 @@ int FixedLine::SetWidth(int newwidth) {
 
 	if (newwidth != width) {
 		width = newwidth;
+		UpdateBreaker();
 
 		// Changing the width invalidates cache
 		textstart = 0;
@@ -316,6 +328,7 @@ void FixedLine::SetTabWidth(unsigned int tabChars) {
 
 	tabwidth = tabChars * charwidth;
 	m_tabChars = tabChars;
+	UpdateBreaker();
 
 	// Draw hidden tab arrow
 	bmTab = wxBitmap(tabwidth, charheight, 1);
@@ -364,6 +377,18 @@ unsigned int FixedLine::GetQuickLineHeight(unsigned int startpos, unsigned int e
 	// This function gives a quick (and very rough) approximation of the total height of the line.
 	// It ignores elements like tabs, bold chars and asian extra-wide chars.
 	if (m_isFontFixedWidth) {
+		// Break the line using the cached glyph widths
+		if (m_breaker.IsValid()) {
+			cxLOCKDOC_READ(m_doc)
+				doc.GetTextPart(startpos, endpos, m_quickBuffer);
+			cxENDLOCK
+
+			if (!m_quickBuffer.empty()) {
+				const unsigned int lineheight = m_breaker.GetHeight(&*m_quickBuffer.begin(), m_quickBuffer.size(), m_quickExtents);
+				if (lineheight) return lineheight;
+			}
+		}
+
 		const unsigned int len = endpos - startpos;
 		const unsigned int linewidth = len * charwidth;
 		unsigned int breaklines = linewidth / width;
@@ -396,6 +421,44 @@ unsigned int FixedLine::GetQuickLineHeight(unsigned int startpos, unsigned int e
 	return breaklines * charheight;
 }
 
+void FixedLine::UpdateBreaker() {
+	// Lines can only be broken without the dc if all glyphs have fixed widths
+	if (!m_isFontFixedWidth || m_wrapMode == cxWRAP_NONE) m_breaker.SetLayout(0, 0, 0, false);
+	else m_breaker.SetLayout(width, tabwidth, charheight, m_wrapMode == cxWRAP_SMART);
+}
+
+void FixedLine::CacheGlyphs(const vector<unsigned int>& chars) {
+	if (!m_isFontFixedWidth) return;
+
+	// Surrogates can not be measured on their own
+	vector<unsigned int> glyphs;
+	for (vector<unsigned int>::const_iterator p = chars.begin(); p != chars.end(); ++p) {
+		const unsigned int c = *p;
+		if (c == 0 || c > LineBreaker::MAXCHAR || (c >= 0xD800 && c <= 0xDFFF)) continue;
+		if (!m_breaker.IsCached(c)) glyphs.push_back(c);
+	}
+	if (glyphs.empty()) return;
+	sort(glyphs.begin(), glyphs.end());
+	glyphs.erase(unique(glyphs.begin(), glyphs.end()), glyphs.end());
+
+	wxString text;
+	for (vector<unsigned int>::const_iterator g = glyphs.begin(); g != glyphs.end(); ++g) {
+		text += (wxChar)*g;
+	}
+
+	// Get the widths in normal font style
+	m_sr.ApplyFontStyle(wxFONTFLAG_DEFAULT);
+	m_extsBuf.clear();
+	dc.GetPartialTextExtents(text, m_extsBuf);
+	if (m_extsBuf.size() != glyphs.size()) return;
+
+	int xpos = 0;
+	for (size_t i = 0; i < glyphs.size(); ++i) {
+		m_breaker.SetAdvance(glyphs[i], m_extsBuf[i] - xpos);
+		xpos = m_extsBuf[i];
+	}
+}
+
 wxPoint FixedLine::GetCaretPos(unsigned int pos, bool tryfront) const {
 	wxASSERT(width > 0);
 	wxASSERT(textstart + pos <= textend);
@@ -1100,9 +1163,10 @@ void FixedLine::StylersApplyDiff(vector<cxChange>& changes) {
 	}
 }
 
-bool FixedLine::StylersOnIdle() {
+bool FixedLine::StylersOnIdle(const Styler* skip) {
 	bool ret = false;
 	for(unsigned int c = 0; c < m_stylers.size(); c++) {
+		if (m_stylers[c] == skip) continue;
 		ret = m_stylers[c]->OnIdle() || ret;
 	}
 	return ret;
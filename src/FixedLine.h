@@ -22,6 +22,7 @@
 #include "Catalyst.h"
 #include "StyleRun.h"
 #include "WrapMode.h"
+#include "LineBreaker.h"
 
 class FastDC;
 struct tmTheme;
@@ -60,7 +61,7 @@ public:
 
 	void UpdateFont();
 	void SetTabWidth(unsigned int width);
-	void SetWordWrap(cxWrapMode wrapMode) {m_wrapMode = wrapMode; FlushCache();};
+	void SetWordWrap(cxWrapMode wrapMode) {m_wrapMode = wrapMode; FlushCache(); UpdateBreaker();};
 	void ShowIndentGuides(bool showIndent) {m_showIndent = showIndent;};
 
 	unsigned int GetLineWidth() const;
@@ -70,6 +71,7 @@ public:
 	int GetHeight() const;
 	int GetCharHeight() const {return charheight;};
 	int GetCharWidth() const {return charwidth;}; // width of a whitespace char 
+	bool IsFontFixedWidth() const {return m_isFontFixedWidth;};
 	wxPoint GetCaretPos(unsigned int pos, bool tryfront=false) const;
 	wxRect GetFoldIndicatorRect() const;
 	full_pos ClickOnLine(int xpos, int ypos) const;
@@ -78,6 +80,10 @@ public:
 	unsigned int GetQuickLineWidth(unsigned int startpos, unsigned int endpos);
 	unsigned int GetQuickLineHeight(unsigned int startpos, unsigned int endpos);
 
+	// Breaking lines without a dc (only with fixed-width fonts)
+	const LineBreaker& GetLineBreaker() const {return m_breaker;};
+	void CacheGlyphs(const vector<unsigned int>& chars);
+
 	bool IsTabPos(unsigned int pos) const;
 	bool IsOverFoldIndicator(const wxPoint& point) const;
 
@@ -87,11 +93,12 @@ public:
 	void StylersInsert(unsigned int pos, unsigned int len);
 	void StylersDelete(unsigned int start, unsigned int end);
 	void StylersApplyDiff(vector<cxChange>& changes);
-	bool StylersOnIdle();
+	bool StylersOnIdle(const Styler* skip=NULL);
 
 private:
 	unsigned int DrawText(int xoffset, int x, int y, unsigned int start, unsigned int end);
 	void BreakLine();
+	void UpdateBreaker();
 	int GetTabPoint(int xpos) const;
 
 	// Member variables
@@ -136,6 +143,9 @@ private:
 	vector<unsigned int> breakpoints;
 	vector<Styler*> m_stylers;
 	bool m_isFontFixedWidth;
+	LineBreaker m_breaker;
+	vector<char> m_quickBuffer;
+	vector<unsigned int> m_quickExtents;
 
 	unsigned int m_foldWidth;
 	unsigned int m_foldHeight;
@@ -0,0 +1,81 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#include "FixedPool.h"
+#include <new>
+#include <stdlib.h>
+
+using namespace std;
+
+// Initializing static constants
+const unsigned int FixedPool::DEFAULTCHUNKBLOCKS = 1024;
+
+// Blocks are rounded up to pointer size, so they can hold the free list link
+// and stay aligned for objects made of pointers and ints
+static inline size_t BlockSize(size_t size) {
+	const size_t align = sizeof(void*);
+	return size < align ? align : (size + align - 1) & ~(align - 1);
+}
+
+FixedPool::FixedPool(size_t blockSize, unsigned int blocksPerChunk)
+: m_blockSize(BlockSize(blockSize)), m_blocksPerChunk(blocksPerChunk), m_free(NULL), m_used(0) {
+	wxASSERT(blocksPerChunk > 0);
+}
+
+FixedPool::~FixedPool() {
+	for (vector<char*>::iterator p = m_chunks.begin(); p != m_chunks.end(); ++p) {
+		free(*p);
+	}
+}
+
+void* FixedPool::Alloc() {
+	if (!m_free) AddChunk();
+
+	void* const block = m_free;
+	m_free = *(void**)block;
+	++m_used;
+	return block;
+}
+
+void FixedPool::Free(void* block) {
+	if (!block) return;
+	wxASSERT(m_used > 0);
+
+	*(void**)block = m_free;
+	m_free = block;
+	--m_used;
+}
+
+bool FixedPool::Release() {
+	if (m_used) return false;
+
+	for (vector<char*>::iterator p = m_chunks.begin(); p != m_chunks.end(); ++p) {
+		free(*p);
+	}
+	m_chunks.clear();
+	m_free = NULL;
+	return true;
+}
+
+void FixedPool::AddChunk() {
+	char* const chunk = (char*)malloc(m_blockSize * m_blocksPerChunk);
+	if (!chunk) throw bad_alloc();
+	m_chunks.push_back(chunk);
+
+	// Link the blocks backwards, so that they are handed out in address order
+	for (unsigned int i = m_blocksPerChunk; i > 0; --i) {
+		void* const block = chunk + (i-1) * m_blockSize;
+		*(void**)block = m_free;
+		m_free = block;
+	}
+}
@@ -0,0 +1,59 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#ifndef __FIXEDPOOL_H__
+#define __FIXEDPOOL_H__
+
+#include "wx/wxprec.h"
+#ifndef WX_PRECOMP
+	#include <wx/wx.h>
+#endif
+
+#include <vector>
+
+// Allocator for many small objects of the same size (like the nodes of
+// the syntax tree). Blocks are cut from large chunks, so there is no
+// per-object overhead and objects allocated together lie together in
+// memory. Freed blocks go on a free list for reuse, and the chunks are
+// only given back to the system on Release().
+//
+// It is not thread safe; the users have to serialize access.
+class FixedPool {
+public:
+	FixedPool(size_t blockSize, unsigned int blocksPerChunk=DEFAULTCHUNKBLOCKS);
+	~FixedPool();
+
+	void* Alloc();
+	void Free(void* block);
+
+	// Frees all chunks (only when no blocks are in use)
+	bool Release();
+
+	size_t GetBlockSize() const {return m_blockSize;};
+	unsigned int GetUsedCount() const {return m_used;};
+	size_t GetReservedSize() const {return m_chunks.size() * m_blockSize * m_blocksPerChunk;};
+
+	static const unsigned int DEFAULTCHUNKBLOCKS;
+
+private:
+	void AddChunk();
+
+	// Member variables
+	const size_t m_blockSize;
+	const unsigned int m_blocksPerChunk;
+	std::vector<char*> m_chunks;
+	void* m_free;
+	unsigned int m_used;
+};
+
+#endif // __FIXEDPOOL_H__
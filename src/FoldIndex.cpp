@@ -0,0 +1,95 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#include "FoldIndex.h"
+#include <algorithm>
+
+void FoldIndex::Clear() {
+	m_folds.clear();
+	m_shiftIndex = 0;
+	m_shift = 0;
+}
+
+const std::vector<cxFold>& FoldIndex::GetFolds() const {
+	ApplyShift(m_folds.size());
+	return m_folds;
+}
+
+std::vector<cxFold>& FoldIndex::GetFolds() {
+	ApplyShift(m_folds.size());
+	return m_folds;
+}
+
+void FoldIndex::ApplyShift(size_t end) const {
+	// Apply the pending shift to the folds before end
+	if (m_shift == 0 || end <= m_shiftIndex) return;
+
+	for (size_t i = m_shiftIndex; i < end; ++i) m_folds[i].line_id += m_shift;
+
+	if (end == m_folds.size()) m_shift = 0;
+	else m_shiftIndex = end;
+}
+
+unsigned int FoldIndex::GetLine(size_t index) const {
+	const unsigned int line_id = m_folds[index].line_id;
+	return (index < m_shiftIndex) ? line_id : line_id + m_shift;
+}
+
+size_t FoldIndex::Find(unsigned int line_id, size_t first) const {
+	// Lines are in order across the pending shift, so it is
+	// a normal binary search, just on the shifted lines
+	size_t last = m_folds.size();
+	while (first < last) {
+		const size_t mid = first + (last - first) / 2;
+		if (GetLine(mid) < line_id) first = mid + 1;
+		else last = mid;
+	}
+	return first;
+}
+
+size_t FoldIndex::Replace(size_t first, size_t last, const std::vector<cxFold>& folds) {
+	// The replaced folds (and the ones before them) should not get the
+	// pending shift, so it has to start after them
+	ApplyShift(last);
+
+	// Overwrite in place, so that the following folds only have
+	// to be moved if the number of folds changes
+	const size_t count = last - first;
+	const size_t common = std::min(count, folds.size());
+	std::copy(folds.begin(), folds.begin() + common, m_folds.begin() + first);
+	if (count > common) m_folds.erase(m_folds.begin() + (first + common), m_folds.begin() + last);
+	else m_folds.insert(m_folds.begin() + last, folds.begin() + common, folds.end());
+
+	const size_t end = first + folds.size();
+	if (m_shift) m_shiftIndex = (m_shiftIndex + folds.size()) - count;
+	return end;
+}
+
+void FoldIndex::Shift(size_t index, int lines) {
+	if (lines == 0) return;
+
+	if (m_shift != 0) {
+		if (index > m_shiftIndex) {
+			// Folds up to this edit only get the pending shift
+			for (size_t i = m_shiftIndex; i < index; ++i) m_folds[i].line_id += m_shift;
+		}
+		else {
+			// Folds between this edit and the pending shift only get this one
+			for (size_t i = index; i < m_shiftIndex; ++i) m_folds[i].line_id += lines;
+			index = m_shiftIndex;
+		}
+	}
+
+	m_shiftIndex = index;
+	m_shift += lines;
+}
@@ -0,0 +1,63 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#ifndef __FOLDINDEX_H__
+#define __FOLDINDEX_H__
+
+#include "Fold.h"
+#include <stddef.h>
+#include <vector>
+
+// The fold markers of a document, sorted by line.
+//
+// When lines are inserted or deleted, all the folds after the edit have to
+// move. Rather than updating them all on each edit, the shift is kept
+// pending from the first fold after the edit, and only applied to the
+// folds between that and the next edit. So edits at (or near) the same place
+// cost O(log n) plus the edited folds. The rest of the shift is applied
+// when the whole list is asked for (which readers iterate through anyway).
+class FoldIndex {
+public:
+	FoldIndex() : m_shiftIndex(0), m_shift(0) {};
+
+	void Clear();
+	size_t size() const {return m_folds.size();};
+
+	// The full list (with all shifts applied)
+	const std::vector<cxFold>& GetFolds() const;
+	std::vector<cxFold>& GetFolds();
+
+	// Access by index, without applying the pending shift
+	size_t Find(unsigned int line_id, size_t first=0) const; // first fold at or after line
+	unsigned int GetLine(size_t index) const;
+	cxFoldType GetType(size_t index) const {return m_folds[index].type;};
+	unsigned int GetCount(size_t index) const {return m_folds[index].count;};
+
+	// Replaces the folds in [first, last). The new folds have to follow the
+	// ones before them (the ones after are moved with Shift). Returns the
+	// index after the new folds.
+	size_t Replace(size_t first, size_t last, const std::vector<cxFold>& folds);
+
+	// Moves all folds from index and on by a number of lines
+	void Shift(size_t index, int lines);
+
+private:
+	void ApplyShift(size_t end) const;
+
+	// Member variables
+	mutable std::vector<cxFold> m_folds;
+	mutable size_t m_shiftIndex; // folds from here on are to be moved
+	mutable int m_shift;         // by this number of lines
+};
+
+#endif // __FOLDINDEX_H__
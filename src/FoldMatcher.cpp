@@ -0,0 +1,162 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#include "FoldMatcher.h"
+#include "pcre.h"
+#include <string>
+#include <vector>
+
+using namespace std;
+
+FoldMatcher::FoldMatcher(const char* startMarker, const char* endMarker)
+: m_combined(NULL), m_combinedStudy(NULL), m_startGroup(-1), m_endGroup(-1), m_ovecCount(0),
+  m_start(NULL), m_startStudy(NULL), m_end(NULL), m_endStudy(NULL) {
+	if (!startMarker) startMarker = "";
+	if (!endMarker) endMarker = "";
+
+	// Each marker gets its own optional lookahead. As both always succeed, the
+	// pattern matches (empty) at the start of the line, and the named groups
+	// tell which of the markers were found somewhere in the line.
+	if (!HasGroupReferences(startMarker) && !HasGroupReferences(endMarker)) {
+		string pattern = "(?=(?:[\\s\\S]*?(?<foldStart>";
+		pattern += startMarker;
+		pattern += "))?)(?=(?:[\\s\\S]*?(?<foldEnd>";
+		pattern += endMarker;
+		pattern += "))?)";
+
+		m_combined = Compile(pattern.c_str(), m_combinedStudy);
+		if (m_combined) {
+			int captureCount = 0;
+			pcre_fullinfo(m_combined, m_combinedStudy, PCRE_INFO_CAPTURECOUNT, &captureCount);
+			m_startGroup = pcre_get_stringnumber(m_combined, "foldStart");
+			m_endGroup = pcre_get_stringnumber(m_combined, "foldEnd");
+			m_ovecCount = (captureCount + 1) * 3;
+
+			if (m_startGroup > 0 && m_endGroup > 0) return;
+
+			// Markers may have defined the names themselves
+			if (m_combinedStudy) pcre_free(m_combinedStudy);
+			pcre_free(m_combined);
+			m_combined = NULL;
+			m_combinedStudy = NULL;
+		}
+	}
+
+	m_start = Compile(startMarker, m_startStudy);
+	m_end = Compile(endMarker, m_endStudy);
+}
+
+FoldMatcher::~FoldMatcher() {
+	if (m_combinedStudy) pcre_free(m_combinedStudy);
+	if (m_combined) pcre_free(m_combined);
+	if (m_startStudy) pcre_free(m_startStudy);
+	if (m_start) pcre_free(m_start);
+	if (m_endStudy) pcre_free(m_endStudy);
+	if (m_end) pcre_free(m_end);
+}
+
+FoldMatcher::Result FoldMatcher::Match(const char* line, size_t len) const {
+	if (!line) line = "";
+
+	bool matchStart = false;
+	bool matchEnd = false;
+
+	if (m_combined) {
+		int ovecBuf[90];
+		vector<int> ovecLarge;
+		int* ovector = ovecBuf;
+		if (m_ovecCount > 90) {
+			ovecLarge.resize(m_ovecCount);
+			ovector = &*ovecLarge.begin();
+		}
+
+		const int rc = pcre_exec(
+			m_combined,           // the compiled pattern
+			m_combinedStudy,      // extra data - if we study the pattern
+			line,                 // the subject string
+			(int)len,             // the length of the subject
+			0,                    // start at offset in the subject
+			PCRE_ANCHORED|PCRE_NO_UTF8_CHECK, // options
+			ovector,              // output vector for substring information
+			m_ovecCount);         // number of elements in the output vector
+
+		// rc is one more than the highest group that was set
+		if (rc > m_startGroup) matchStart = (ovector[2*m_startGroup] != -1);
+		if (rc > m_endGroup) matchEnd = (ovector[2*m_endGroup] != -1);
+	}
+	else {
+		matchStart = Search(m_start, m_startStudy, line, len);
+		matchEnd = Search(m_end, m_endStudy, line, len);
+	}
+
+	if (matchStart) {
+		// starter and ender on same line cancels out
+		return matchEnd ? FOLD_NONE : FOLD_START;
+	}
+	return matchEnd ? FOLD_END : FOLD_NONE;
+}
+
+bool FoldMatcher::HasGroupReferences(const char* pattern) { // static
+	// Back references and subroutine calls would point to the wrong groups
+	// once the marker is wrapped. Be conservative and also count \1-\9 in
+	// character classes (octal) as references.
+	for (const char* p = pattern; *p; ++p) {
+		if (*p == '\\') {
+			const char c = p[1];
+			if (c == '\0') break;
+			if ((c >= '1' && c <= '9') || c == 'g' || c == 'k') return true;
+			++p; // skip escaped char
+		}
+		else if (*p == '(' && p[1] == '?') {
+			const char c = p[2];
+			if ((c >= '0' && c <= '9') || c == 'R' || c == '&') return true;
+			if ((c == '+' || c == '-') && p[3] >= '0' && p[3] <= '9') return true;
+			if (c == 'P' && (p[3] == '=' || p[3] == '>')) return true;
+		}
+	}
+	return false;
+}
+
+pcre* FoldMatcher::Compile(const char* pattern, pcre_extra*& study) { // static
+	const char *error;
+	int erroffset;
+	study = NULL;
+
+	pcre* re = pcre_compile(
+		pattern,              // the pattern
+		PCRE_UTF8,            // options
+		&error,               // for error message
+		&erroffset,           // for error offset
+		NULL);                // use default character tables
+	if (re) study = pcre_study(re, 0, &error);
+
+	return re;
+}
+
+bool FoldMatcher::Search(const pcre* re, const pcre_extra* study, const char* line, size_t len) { // static
+	if (!re) return false; // invalid pattern
+
+	const int OVECCOUNT = 30;
+	int ovector[OVECCOUNT];
+	const int rc = pcre_exec(
+		re,                   // the compiled pattern
+		study,                // extra data - if we study the pattern
+		line,                 // the subject string
+		(int)len,             // the length of the subject
+		0,                    // start at offset in the subject
+		PCRE_NO_UTF8_CHECK,   // options
+		ovector,              // output vector for substring information
+		OVECCOUNT);           // number of elements in the output vector
+
+	return rc >= 0;
+}
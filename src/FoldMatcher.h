@@ -0,0 +1,69 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#ifndef __FOLDMATCHER_H__
+#define __FOLDMATCHER_H__
+
+#include <stddef.h>
+
+struct real_pcre;                 // This double pre-definition is needed
+typedef struct real_pcre pcre;    // because of the way it is defined in pcre.h
+struct pcre_extra;
+
+// Classifies lines against the start and end fold markers of a language.
+//
+// The markers are compiled once, into a single anchored pattern made of two
+// optional lookaheads (one per marker), so that each line is scanned with a
+// single pcre_exec call. Markers that can not be combined safely (because
+// they refer to groups by number, or fail to compile when wrapped) are
+// compiled as two separate patterns instead.
+class FoldMatcher {
+public:
+	enum Result {
+		FOLD_NONE,
+		FOLD_START,
+		FOLD_END
+	};
+
+	FoldMatcher(const char* startMarker, const char* endMarker);
+	~FoldMatcher();
+
+	bool IsCombined() const {return m_combined != NULL;};
+
+	// A line matching both markers cancels out (FOLD_NONE)
+	Result Match(const char* line, size_t len) const;
+
+private:
+	static bool HasGroupReferences(const char* pattern);
+	static pcre* Compile(const char* pattern, pcre_extra*& study);
+	static bool Search(const pcre* re, const pcre_extra* study, const char* line, size_t len);
+
+	// Not copyable (owns the compiled patterns)
+	FoldMatcher(const FoldMatcher&);
+	FoldMatcher& operator=(const FoldMatcher&);
+
+	// Member variables
+	pcre* m_combined;
+	pcre_extra* m_combinedStudy;
+	int m_startGroup;
+	int m_endGroup;
+	int m_ovecCount;
+
+	// Fallback if markers could not be combined
+	pcre* m_start;
+	pcre_extra* m_startStudy;
+	pcre* m_end;
+	pcre_extra* m_endStudy;
+};
+
+#endif // __FOLDMATCHER_H__
@@ -0,0 +1,290 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#include "FuzzyMatcher.h"
+#include <algorithm>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+	#define FM_HAVE_PREFETCH
+	#include <xmmintrin.h>
+#endif
+
+using namespace std;
+
+// Initializing static constants
+const unsigned int FuzzyMatcher::THREADLIMIT = 20000;
+const unsigned int FuzzyMatcher::MATCHRANGE = 4096;
+const unsigned int FuzzyMatcher::SORTCHUNK = 256;
+const unsigned int FuzzyMatcher::MAXTHREADS = 8;
+const unsigned int FuzzyMatcher::KEYCHARS = 8;
+const unsigned int FuzzyMatcher::PREFETCHAHEAD = 16;
+const unsigned int FuzzyMatcher::NOTLOCATED = (unsigned int)-1;
+
+FuzzyMatcher::FuzzyMatcher()
+: m_textMask(0), m_sortedCount(0), m_nameCount(0), m_prevTextLen(0), m_refining(false),
+  m_runner(wxMin(TaskRunner::GetDefaultThreadCount(), MAXTHREADS)) {
+	m_offsets.push_back(0);
+}
+
+void FuzzyMatcher::Clear() {
+	m_chars.clear();
+	m_offsets.clear();
+	m_offsets.push_back(0);
+	m_masks.clear();
+	m_keys.clear();
+	Find(wxEmptyString);
+}
+
+void FuzzyMatcher::AddName(const wxString& name) {
+	// Note that Find has to be called again to match the new name
+	unsigned int mask = 0;
+	wxUint64 key = 0;
+	for (unsigned int i = 0; i < name.size(); ++i) {
+		const wxChar c = (wxChar)wxTolower(name[i]);
+		m_chars.push_back(c);
+		mask |= CharMask(c);
+		if (i < KEYCHARS) key |= (wxUint64)wxMin((unsigned int)c, 0xFFu) << (8 * (KEYCHARS-1 - i));
+	}
+
+	m_masks.push_back(mask);
+	m_keys.push_back(key);
+	m_offsets.push_back(m_chars.size());
+}
+
+unsigned int FuzzyMatcher::CharMask(wxChar c) { // static
+	// A bit for each letter and a few common path chars,
+	// all other chars (and digits) share a bit
+	if (c >= wxT('a') && c <= wxT('z')) return 1 << (c - wxT('a'));
+	if (c >= wxT('0') && c <= wxT('9')) return 1 << 26;
+	switch (c) {
+	case wxT('.'): return 1 << 27;
+	case wxT('_'): return 1 << 28;
+	case wxT('-'): return 1 << 29;
+	case wxT(' '): return 1 << 30;
+	default: return 1u << 31;
+	}
+}
+
+void FuzzyMatcher::Find(const wxString& text) {
+	m_text = text;
+
+	// If chars were only added to the end of the text, we
+	// can refine the matches we have (unless names were added)
+	unsigned int commonLen = 0;
+	if (m_nameCount == GetNameCount()) {
+		while (commonLen < m_textChars.size() && commonLen < text.size()
+			&& m_textChars[commonLen] == (wxChar)wxTolower(text[commonLen])) ++commonLen;
+	}
+	const bool refine = commonLen > 0 && commonLen == m_textChars.size();
+	if (refine && commonLen == text.size()) return; // same text
+
+	m_prevTextLen = m_textChars.size();
+	m_textChars.resize(commonLen);
+	for (unsigned int i = commonLen; i < text.size(); ++i) {
+		m_textChars.push_back((wxChar)wxTolower(text[i]));
+	}
+	m_textMask = 0;
+	for (vector<wxChar>::const_iterator p = m_textChars.begin(); p != m_textChars.end(); ++p) {
+		m_textMask |= CharMask(*p);
+	}
+
+	m_nameCount = GetNameCount();
+	m_refining = refine;
+	if (refine) m_candidates.swap(m_matches);
+	m_matches.clear();
+	m_sortedCount = 0;
+	if (text.empty()) return;
+
+	const unsigned int jobSize = refine ? m_candidates.size() : GetNameCount();
+	if (jobSize <= THREADLIMIT || TaskRunner::GetDefaultThreadCount() == 1) {
+		MatchRange(0, jobSize, m_matches);
+		return;
+	}
+
+	// Big lists are matched in ranges (on all cpus), and
+	// the matches joined in order when all are done
+	const unsigned int rangeCount = (jobSize + MATCHRANGE - 1) / MATCHRANGE;
+	if (m_rangeMatches.size() < rangeCount) m_rangeMatches.resize(rangeCount);
+	m_runner.RunBatch(rangeCount, OnMatchRange, this);
+
+	for (unsigned int i = 0; i < rangeCount; ++i) {
+		m_matches.insert(m_matches.end(), m_rangeMatches[i].begin(), m_rangeMatches[i].end());
+	}
+}
+
+// static
+void FuzzyMatcher::OnMatchRange(void* data, unsigned int index) {
+	FuzzyMatcher& matcher = *(FuzzyMatcher*)data;
+	const unsigned int count = matcher.m_refining ? matcher.m_candidates.size() : matcher.GetNameCount();
+	const unsigned int start = index * MATCHRANGE;
+
+	vector<Match>& matches = matcher.m_rangeMatches[index];
+	matches.clear();
+	matcher.MatchRange(start, wxMin(start + MATCHRANGE, count), matches);
+}
+
+void FuzzyMatcher::MatchRange(unsigned int start, unsigned int end, vector<Match>& matches) const {
+	Match m;
+
+	// A single letter has its own bit in the masks, so the mask is all
+	// it takes to match it. Where it is in the name is found if the
+	// text grows (or when it is drawn).
+	if (!m_refining && m_textChars.size() == 1 && m_textChars[0] >= wxT('a') && m_textChars[0] <= wxT('z')) {
+		// Written without branches, as about half the names tend to match
+		m.rank = 0;
+		m.first = m.last = NOTLOCATED;
+		size_t n = matches.size();
+		matches.resize(n + (end - start), m);
+		for (unsigned int i = start; i < end; ++i) {
+			matches[n].index = i;
+			n += (m_masks[i] & m_textMask) ? 1 : 0;
+		}
+		matches.resize(n);
+		return;
+	}
+
+	for (unsigned int i = start; i < end; ++i) {
+		if (m_refining) {
+			m = m_candidates[i];
+#ifdef FM_HAVE_PREFETCH
+			// The candidates are spread over the names, so their chars
+			// are fetched ahead to not wait for memory on each of them
+			if (i + PREFETCHAHEAD < end) {
+				const unsigned int ahead = m_candidates[i + PREFETCHAHEAD].index;
+				_mm_prefetch((const char*)&m_chars[m_offsets[ahead]], _MM_HINT_T0);
+			}
+#endif
+		}
+		else m.index = i;
+
+		// Skip names that lack some of the chars
+		if ((m_masks[m.index] & m_textMask) != m_textMask) continue;
+
+		if (MatchName(m, m_refining ? m_prevTextLen : 0)) {
+			matches.push_back(m);
+		}
+	}
+}
+
+bool FuzzyMatcher::MatchName(Match& m, unsigned int charpos) const {
+	// Continues from the last matched char if some are matched already
+	const unsigned int textLen = m_textChars.size();
+	const unsigned int len = m_offsets[m.index+1] - m_offsets[m.index];
+	if (textLen == 0 || len < textLen) return false;
+
+	const wxChar* name = &m_chars[m_offsets[m.index]];
+	const wxChar* text = &m_textChars[0];
+	if (m.first == NOTLOCATED) charpos = 0; // matched on mask only
+
+	for (unsigned int i = charpos ? m.last + 1 : 0; i < len; ++i) {
+		if (len - i < textLen - charpos) return false; // not enough chars left
+		if (name[i] != text[charpos]) continue;
+
+		if (charpos == 0) m.first = i;
+		m.last = i;
+		if (++charpos == textLen) {
+			// Rank is the number of chars skipped between the matches
+			m.rank = (m.last - m.first) - (textLen - 1);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool FuzzyMatcher::GetHighlights(unsigned int index, vector<unsigned int>& hl) const {
+	wxASSERT(index < GetNameCount());
+	hl.clear();
+
+	const unsigned int textLen = m_textChars.size();
+	const unsigned int len = m_offsets[index+1] - m_offsets[index];
+	if (textLen == 0 || len < textLen) return false;
+
+	const wxChar* name = &m_chars[m_offsets[index]];
+	for (unsigned int i = 0; i < len; ++i) {
+		if (name[i] != m_textChars[hl.size()]) continue;
+
+		hl.push_back(i);
+		if (hl.size() == textLen) return true;
+	}
+
+	hl.clear();
+	return false;
+}
+
+void FuzzyMatcher::SortUntil(unsigned int n) const {
+	if (n < m_sortedCount) return;
+
+	// Only the part of the ranking that is shown has to be sorted.
+	// The rest stays unsorted until it is needed (when scrolling).
+	const unsigned int matchCount = m_matches.size();
+	unsigned int count = wxMax(n + 1, wxMax(m_sortedCount * 2, SORTCHUNK));
+	if (count > matchCount) count = matchCount;
+
+	partial_sort(m_matches.begin() + m_sortedCount, m_matches.begin() + count, m_matches.end(), RankLess(*this));
+	m_sortedCount = count;
+}
+
+unsigned int FuzzyMatcher::GetMatch(unsigned int n) const {
+	wxASSERT(n < m_matches.size());
+	SortUntil(n);
+	return m_matches[n].index;
+}
+
+unsigned int FuzzyMatcher::GetRank(unsigned int n) const {
+	wxASSERT(n < m_matches.size());
+	SortUntil(n);
+	return m_matches[n].rank;
+}
+
+int FuzzyMatcher::FindMatch(unsigned int index) const {
+	unsigned int slot = 0;
+	while (slot < m_matches.size() && m_matches[slot].index != index) ++slot;
+	if (slot == m_matches.size()) return wxNOT_FOUND;
+	if (slot < m_sortedCount) return slot;
+
+	// Count the unsorted matches that will be ranked before it
+	const RankLess less(*this);
+	const Match& match = m_matches[slot];
+	unsigned int pos = m_sortedCount;
+	for (vector<Match>::const_iterator p = m_matches.begin() + m_sortedCount; p != m_matches.end(); ++p) {
+		if (less(*p, match)) ++pos;
+	}
+
+	return pos;
+}
+
+// --- RankLess --------------------------------------------------------
+
+bool FuzzyMatcher::RankLess::operator()(const Match& a, const Match& b) const {
+	if (a.rank != b.rank) return a.rank < b.rank;
+
+	// Same rank, so we order by name. Most names differ in the
+	// first chars, which the keys can compare without the names.
+	const wxUint64 key1 = m_matcher.m_keys[a.index];
+	const wxUint64 key2 = m_matcher.m_keys[b.index];
+	if (key1 != key2) return key1 < key2;
+
+	const vector<wxChar>& chars = m_matcher.m_chars;
+	vector<wxChar>::const_iterator p1 = chars.begin() + m_matcher.m_offsets[a.index];
+	vector<wxChar>::const_iterator p2 = chars.begin() + m_matcher.m_offsets[b.index];
+	const vector<wxChar>::const_iterator end1 = chars.begin() + m_matcher.m_offsets[a.index+1];
+	const vector<wxChar>::const_iterator end2 = chars.begin() + m_matcher.m_offsets[b.index+1];
+
+	for (; p1 != end1 && p2 != end2; ++p1, ++p2) {
+		if (*p1 != *p2) return *p1 < *p2;
+	}
+	if (p1 != end1 || p2 != end2) return p1 == end1; // shortest first
+
+	return a.index < b.index;
+}
@@ -0,0 +1,122 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#ifndef __FUZZYMATCHER_H__
+#define __FUZZYMATCHER_H__
+
+#include "wx/wxprec.h"
+#ifndef WX_PRECOMP
+	#include <wx/wx.h>
+#endif
+
+#include "TaskRunner.h"
+#include <vector>
+
+// Finds the names that contain all chars of a search text in order
+// (ignoring case), as in Go to File and the symbol list. Matches are
+// ranked by the distance between the matched chars, then by name.
+//
+// Names are kept as folded chars in a single buffer, each with a mask
+// of the chars it contains, so that most names can be rejected without
+// looking at the chars. Big lists are matched on a pool of threads.
+// The ranked order is only sorted as far as it is asked for (names of
+// the same rank are mostly ordered by a key of their first chars), and
+// the positions of the matched chars are found again when they are drawn.
+//
+// When the text grows by appending chars, only the names that matched
+// the previous text are searched, continuing from where they matched.
+class FuzzyMatcher {
+public:
+	FuzzyMatcher();
+
+	// Names are indexed in the order they are added
+	void Clear();
+	void AddName(const wxString& name);
+	unsigned int GetNameCount() const {return m_offsets.size() - 1;};
+
+	// Matching (an empty text matches nothing)
+	void Find(const wxString& text);
+	const wxString& GetText() const {return m_text;};
+	unsigned int GetMatchCount() const {return m_matches.size();};
+
+	// Access in ranked order (sorted as needed)
+	unsigned int GetMatch(unsigned int n) const;
+	unsigned int GetRank(unsigned int n) const;
+	int FindMatch(unsigned int index) const; // ranked pos of name or wxNOT_FOUND
+
+	// Positions of the matched chars in a name
+	bool GetHighlights(unsigned int index, std::vector<unsigned int>& hl) const;
+
+	static unsigned int CharMask(wxChar c);
+
+private:
+	struct Match {
+		unsigned int index;
+		unsigned int rank;
+		unsigned int first; // pos of first matched char
+		unsigned int last;  // pos of last matched char
+	};
+
+	class RankLess;
+	friend class RankLess;
+	class RankLess {
+	public:
+		RankLess(const FuzzyMatcher& matcher) : m_matcher(matcher) {};
+		bool operator()(const Match& a, const Match& b) const;
+	private:
+		const FuzzyMatcher& m_matcher;
+	};
+
+	bool MatchName(Match& m, unsigned int charpos) const;
+	void SortUntil(unsigned int n) const;
+
+	void MatchRange(unsigned int start, unsigned int end, std::vector<Match>& matches) const;
+	static void OnMatchRange(void* data, unsigned int index); // called from runner
+
+	static const unsigned int THREADLIMIT; // names matched on the calling thread
+	static const unsigned int MATCHRANGE; // names claimed at a time
+	static const unsigned int SORTCHUNK; // minimum part of the ranking to sort
+	static const unsigned int MAXTHREADS;
+	static const unsigned int KEYCHARS; // first chars of name in the sort keys
+	static const unsigned int PREFETCHAHEAD; // candidates to fetch the chars of ahead
+	static const unsigned int NOTLOCATED; // first/last of mask-only matches
+
+	// Names
+	std::vector<wxChar> m_chars;
+	std::vector<unsigned int> m_offsets;
+	std::vector<unsigned int> m_masks;
+	std::vector<wxUint64> m_keys; // for ordering by name
+
+	// Current search
+	wxString m_text;
+	std::vector<wxChar> m_textChars;
+	unsigned int m_textMask;
+	mutable std::vector<Match> m_matches; // ranked up to m_sortedCount
+	mutable unsigned int m_sortedCount;
+	unsigned int m_nameCount; // when search was done
+
+	// Refining (only the previous matches are searched)
+	std::vector<Match> m_candidates;
+	unsigned int m_prevTextLen;
+	bool m_refining;
+
+	// Big searches (each range has its own matches)
+	TaskRunner m_runner;
+	std::vector<std::vector<Match> > m_rangeMatches;
+
+private:
+	FuzzyMatcher(const FuzzyMatcher&);
+	FuzzyMatcher& operator=(const FuzzyMatcher&);
+};
+
+#endif // __FUZZYMATCHER_H__
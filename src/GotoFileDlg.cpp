@@ -16,122 +16,47 @@
 #include <map>
 #include <algorithm>
 
-#include <wx/dir.h>
-
 #include "ProjectInfoHandler.h"
+#include "ProjectFileIndex.h"
 #include "SearchListBox.h"
+#include "FuzzyMatcher.h"
 
 class FileEntry {
 public:
 	FileEntry() {};
-	FileEntry(const wxString& dirpath, const wxString& filename);
+	FileEntry(const wxString& filepath);
 	void SetPath(const wxString& path);
 	void Clear();
 
 	wxString name;
-	wxString nameLower;
 	wxString path;
 };
 
-class DirState {
-public:
-	static DirState* FromPath(const wxString& path) {
-		DirState* dirState = new DirState(path);
-		if (dirState->IsOpened()) return dirState;
-
-		delete dirState;
-		return NULL;
-	}
-
-	DirState(const wxString& path):
-		walkingFiles(false),
-		prefix(path + wxFILE_SEP_PATH)
-	{
-		dir.Open(path);
-	}
-
-	bool WalkFolders() {
-		// Find next folder included by our filters.
-		bool found = false, included = false;
-		do {
-			if (nextDirName.empty())
-				found = dir.GetFirst(&nextDirName, wxEmptyString, wxDIR_DIRS);
-			else
-				found = dir.GetNext(&nextDirName);
-
-			included = found && (!filter || filter->IsDirectoryIncluded(nextDirName));
-		} while (found && !included);
-		return found;
-	}
-
-	bool WalkFiles(wxString& file) {
-		// Find next file included by our filters.
-		bool found = false, included = false;
-		do {
-			if (walkingFiles) found = dir.GetNext(&file);
-			else {
-				found = dir.GetFirst(&file, wxEmptyString, wxDIR_FILES);
-				walkingFiles = true;
-			}
-
-			included = found && (!filter || filter->IsFileIncluded(file));
-		} while (found && !included);
-		return found;
-	}
-
-	wxString FullFolderName() const { return prefix + nextDirName; }
-
-	cxProjectInfo* info;
-	const cxProjectInfo* filter;
-	wxString prefix;
-	wxString nextDirName;
-
-private:
-	bool IsOpened() const {return dir.IsOpened();}
-	wxDir dir;
-	bool walkingFiles;
-};
-
 class GotoFileList : public SearchListBox {
 public:
 	GotoFileList(wxWindow* parent, wxWindowID id, const std::vector<FileEntry*>& actions, const wxString& project_root=wxEmptyString);
 	~GotoFileList();
 
+	void ReloadFiles();
 	void Find(const wxString& text, const std::map<wxString,wxString>& triggers);
 	const FileEntry* GetSelectedAction();
 
-	void UpdateList(const bool reloadAll = false);
-
 private:
 	void OnDrawItem(wxDC& dc, const wxRect& rect, size_t n) const;
+	int GetFileIndex(unsigned int n) const;
+	const FileEntry* GetItem(unsigned int n) const;
 	int FindPath(const wxString& path) const;
-	void AddFileIfMatching(const wxString& searchtext, FileEntry* file_entry);
 	int FindMatchesAndSelection(const std::map<wxString,wxString>& triggers);
 
-	class aItem {
-	public:
-		aItem() : file_entry(NULL), rank(0) {};
-		aItem(const FileEntry* a, const std::vector<unsigned int>& hl);
-		bool operator<(const aItem& ai) const;
-		void swap(aItem& ai);
-
-		const FileEntry* file_entry;
-		std::vector<unsigned int> hlChars;
-		unsigned int rank;
-	};
-
-	void iter_swap(std::vector<aItem>::iterator a, std::vector<aItem>::iterator b) {
-		a->swap(*b);
-	};
-
 	const wxString m_project_root;
 	const std::vector<FileEntry*>& m_actions;
-	unsigned int m_actionCount;
 
-	std::vector<aItem> m_items;
+	FuzzyMatcher m_matcher; // on file names
 	wxString m_searchText;
+	mutable std::vector<unsigned int> m_hlChars;
 
-	FileEntry* m_tempEntry;	// What is this used for, exactly?
+	// A trigger target that is not in the list (shown first)
+	FileEntry* m_tempEntry;
 };
 
 
@@ -152,7 +77,7 @@ END_EVENT_TABLE()
 
 GotoFileDlg::GotoFileDlg(wxWindow *parent, ProjectInfoHandler& project):
 	wxDialog (parent, -1, _("Go to File"), wxDefaultPosition, wxDefaultSize, wxDEFAULT_DIALOG_STYLE|wxRESIZE_BORDER),
-	m_project(project), m_isDone(false), m_filesLoaded(false)
+	m_project(project), m_isDone(false), m_generation(0), m_searchPending(false)
 {
 	// Create controls
 	m_searchCtrl = new wxTextCtrl(this, CTRL_SEARCH, wxEmptyString, wxDefaultPosition, wxDefaultSize, wxTE_PROCESS_ENTER);
@@ -173,6 +98,9 @@ GotoFileDlg::GotoFileDlg(wxWindow *parent, ProjectInfoHandler& project):
 	SetSizer(mainSizer);
 	SetSize(400, 500);
 	Centre();
+
+	// Show the files that are already in the index
+	if (m_project.HasProject()) LoadFiles();
 }
 
 GotoFileDlg::~GotoFileDlg() {
@@ -180,84 +108,61 @@ GotoFileDlg::~GotoFileDlg() {
 	for (std::vector<FileEntry*>::iterator p = m_files.begin(); p != m_files.end(); ++p) {
 		delete *p;
 	}
-
-	// Clean up allocated dir traversing state
-	for (std::vector<DirState*>::iterator d = m_dirStack.begin(); d != m_dirStack.end(); ++d) {
-		delete *d;
-	}
 }
 
 const wxString& GotoFileDlg::GetSelection() const {return m_cmdList->GetSelectedAction()->path;}
 const wxString GotoFileDlg::GetTrigger() const {return m_searchCtrl->GetValue();}
 
-void GotoFileDlg::OnIdle(wxIdleEvent& event) {
-	if (!m_project.HasProject()) return; // No project, so no files to load.
-	if (m_filesLoaded) return; // Already done loading files.
+void GotoFileDlg::OnIdle(wxIdleEvent& WXUNUSED(event)) {
+	// Search when all queued keystrokes have been handled
+	if (m_searchPending) UpdateSearch();
 
-	if (m_dirStack.empty()) {
-		const wxString root_path = m_project.GetRoot().GetPath();
-		m_files.reserve(100);
-		BuildFileList(root_path);
-	}
-	else {
-		DirState& dirState = *m_dirStack.back();
-
-		// Get next subdir
-		if (dirState.WalkFolders()) {
-			const wxString fulldirname = dirState.FullFolderName();
-			wxLogDebug(fulldirname);
-			BuildFileList(fulldirname);
-		}
-		else {
-			// All sub-dirs visited
-			if (dirState.info) {
-				m_filters.pop_back();
-				delete dirState.info;
-			}
-
-			delete m_dirStack.back();
-			m_dirStack.pop_back();
-
-			if (m_dirStack.empty())
-				m_filesLoaded = true;
-		}
-	}
+	if (!m_project.HasProject()) return; // No project, so no files to load.
 
-	m_cmdList->UpdateList();
-	if (!m_dirStack.empty()) event.RequestMore();
+	// Reload if the index has been replaced (when the
+	// first scan is done or a snapshot has been loaded)
+	if (m_project.GetFileIndex().GetGeneration() != m_generation) LoadFiles();
 }
 
-void GotoFileDlg::BuildFileList(const wxString& path) {
-	DirState* dirState = DirState::FromPath(path);
-	if (!dirState) return;
-	
-	m_dirStack.push_back(dirState);
+void GotoFileDlg::LoadFiles() {
+	const ProjectFileIndex& fileIndex = m_project.GetFileIndex();
+	m_generation = fileIndex.GetGeneration();
 
-	// Load filters for this dir
-	dirState->info = new cxProjectInfo;
-	if (dirState->info->Load(m_project.GetRoot(), path, true)) {
-		m_filters.push_back(dirState->info);
-	}
-	else {
-		delete dirState->info;
-		dirState->info = NULL;
+	std::vector<wxString> paths;
+	fileIndex.GetFiles(paths);
+
+	// The list refers to the old entries until it is updated
+	std::vector<FileEntry*> oldFiles;
+	oldFiles.swap(m_files);
+
+	m_files.reserve(paths.size());
+	for (std::vector<wxString>::const_iterator p = paths.begin(); p != paths.end(); ++p) {
+		m_files.push_back(new FileEntry(*p));
 	}
 
-	// Set active filter
-	dirState->filter = m_filters.empty() ? NULL : m_filters.back();
+	m_cmdList->ReloadFiles();
+	UpdateSearch();
+
+	for (std::vector<FileEntry*>::iterator p = oldFiles.begin(); p != oldFiles.end(); ++p) {
+		delete *p;
+	}
+}
 
-	// Get all files
-	wxString eachFilename;
-	while(dirState->WalkFiles(eachFilename))
-		m_files.push_back(new FileEntry(dirState->prefix, eachFilename));
+void GotoFileDlg::OnSearch(wxCommandEvent& WXUNUSED(event)) {
+	// Wait for idle, so that fast typing does not
+	// search for text that has already been changed
+	m_searchPending = true;
 }
 
-void GotoFileDlg::OnSearch(wxCommandEvent& event) {
-	m_cmdList->Find(event.GetString(), m_project.GetTriggers());
+void GotoFileDlg::UpdateSearch() {
+	m_searchPending = false;
+	m_cmdList->Find(m_searchCtrl->GetValue(), m_project.GetTriggers());
 	UpdateStatusbar();
 }
 
 void GotoFileDlg::OnAction(wxCommandEvent& WXUNUSED(event)) {
+	if (m_searchPending) UpdateSearch();
+
 	if(m_cmdList->GetSelectedCount() == 1) {
 		m_project.SetTrigger(m_searchCtrl->GetValue(), m_cmdList->GetSelectedAction()->path);
 		m_isDone = true;
@@ -269,10 +174,12 @@ void GotoFileDlg::OnSearchChar(wxKeyEvent& event) {
 	switch ( event.GetKeyCode() )
     {
 	case WXK_UP:
+		if (m_searchPending) UpdateSearch();
 		m_cmdList->SelectPrev();
 		UpdateStatusbar();
 		return;
 	case WXK_DOWN:
+		if (m_searchPending) UpdateSearch();
 		m_cmdList->SelectNext();
 		UpdateStatusbar();
 		return;
@@ -328,22 +235,19 @@ void GotoFileDlg::UpdateStatusbar() {
 
 // ---- FileEntry ----------------------------------------------------
 
-FileEntry::FileEntry(const wxString& dirpath, const wxString& filename) {
-	name = filename;
-	nameLower = name.Lower();
-	path = dirpath + filename;
+FileEntry::FileEntry(const wxString& filepath) {
+	name = filepath.AfterLast(wxFILE_SEP_PATH);
+	path = filepath;
 }
 
 void FileEntry::SetPath(const wxString& p) {
 	wxFileName filepath(p);
 	name = filepath.GetFullName();
-	nameLower = name.Lower();
 	path = p;
 }
 
 void FileEntry::Clear() {
 	name.clear();
-	nameLower.clear();
 	path.clear();
 }
 
@@ -352,10 +256,11 @@ void FileEntry::Clear() {
 GotoFileList::GotoFileList(wxWindow* parent, wxWindowID id, const std::vector<FileEntry*>& actions, const wxString& project_root):
 	SearchListBox(parent, id),
 	m_project_root(project_root),
-	m_actions(actions), m_actionCount(0) 
+	m_actions(actions)
 {
 	m_tempEntry = new FileEntry();
-	UpdateList();
+	ReloadFiles();
+	SetItemCount(m_actions.size());
 }
 
 GotoFileList::~GotoFileList(){
@@ -368,7 +273,8 @@ void GotoFileList::OnDrawItem(wxDC& dc, const wxRect& rect, size_t n) const {
 	if (isCurrent) dc.SetTextForeground(m_hlTextColor);
 	else dc.SetTextForeground(m_textColor);
 
-	const FileEntry& file_entry = *m_items[n].file_entry;
+	const int index = GetFileIndex(n);
+	const FileEntry& file_entry = (index == wxNOT_FOUND) ? *m_tempEntry : *m_actions[index];
 
 	// m_project_root
 	wxFileName displayPath(file_entry.path);
@@ -379,10 +285,13 @@ void GotoFileList::OnDrawItem(wxDC& dc, const wxRect& rect, size_t n) const {
 
 	const int path_size = displayPath.GetPath().size() + 1;
 
-	const std::vector<unsigned int>& hl = m_items[n].hlChars;
-	std::vector<unsigned int> offsets(hl.size());
-	for(unsigned int i = 0; i < hl.size(); i++) {
-		offsets[i] = hl[i] + path_size;
+	// Only the rows that are drawn need the matched chars
+	m_hlChars.clear();
+	if (!m_searchText.empty() && index != wxNOT_FOUND) {
+		m_matcher.GetHighlights(index, m_hlChars);
+		for(unsigned int i = 0; i < m_hlChars.size(); i++) {
+			m_hlChars[i] += path_size;
+		}
 	}
 
 	/*// Calc extension width
@@ -405,68 +314,20 @@ void GotoFileList::OnDrawItem(wxDC& dc, const wxRect& rect, size_t n) const {
 	}*/
 
 	// Draw action name
-	DrawItemText(dc, rect, name, offsets, isCurrent);
+	DrawItemText(dc, rect, name, m_hlChars, isCurrent);
 }
 
-void GotoFileList::UpdateList(const bool reloadAll) {
-	const FileEntry* selEntry = GetSelectedAction();
-	const int topLine = GetFirstVisibleLine();
-	int selection = -1;
-	const unsigned int startItem = reloadAll ? 0 : m_items.size();
-
-	// Insert new items
-	if (m_searchText.empty()) {
-		// Copy all actions to items
-		m_items.resize(m_actions.size());
-		for (unsigned int i = startItem; i < m_actions.size(); ++i) {
-			m_items[i].file_entry = m_actions[i];
-			m_items[i].hlChars.clear();
-		}
-	}
-	else {
-		// Copy matching actions to items
-		for (unsigned int i = m_actionCount; i < m_actions.size(); ++i) {
-			if (m_tempEntry->path.empty() || m_actions[i]->path != m_tempEntry->path)
-				AddFileIfMatching(m_searchText, m_actions[i]);
-		}
-	}
-
-	// Sort the items
-	if (startItem) {
-		sort(m_items.begin() + startItem, m_items.end());
-		inplace_merge(m_items.begin(), m_items.begin() + startItem, m_items.end());
+void GotoFileList::ReloadFiles() {
+	// Has to be followed by a new Find
+	m_matcher.Clear();
+	for (std::vector<FileEntry*>::const_iterator p = m_actions.begin(); p != m_actions.end(); ++p) {
+		m_matcher.AddName((*p)->name);
 	}
-	else sort(m_items.begin(), m_items.end());
-
-	// Keep same selection
-	if (selEntry) {
-		for (unsigned int i = 0; i < m_items.size(); ++i) {
-			if (m_items[i].file_entry == selEntry) {
-				selection = i;
-				break;
-			}
-		}
-	}
-
-	// Refresh and redraw listCtrl
-	Freeze();
-	SetItemCount(m_items.size());
-	SetSelection(selection);
-
-	if (selection == -1)
-		ScrollToLine(topLine);
-	else if (!IsVisible(selection))
-		ScrollToLine(selection);
-
-	RefreshAll();
-	Thaw();
-
-	m_actionCount = m_actions.size();
 }
 
 // Check if we have a matching trigger
 int GotoFileList::FindMatchesAndSelection(const std::map<wxString,wxString>& triggers) {
-	if (!m_items.size()) return wxNOT_FOUND;
+	if (!m_matcher.GetMatchCount()) return wxNOT_FOUND;
 
 	int selection = wxNOT_FOUND;
 	std::map<wxString,wxString>::const_iterator p = triggers.find(m_searchText);
@@ -487,19 +348,7 @@ int GotoFileList::FindMatchesAndSelection(const std::map<wxString,wxString>& tri
 		// Let's check if it exists and add it temporarily
 		if (wxFileExists(p->second)) {
 			m_tempEntry->SetPath(p->second);
-
-			// Add entry with highlighted search chars
-			AddFileIfMatching(m_searchText, m_tempEntry);
-
-			// Find position it will end up after sort
-			std::vector<aItem>::iterator insPos = lower_bound(m_items.begin(), m_items.end()-1, m_items.back());
-			selection = distance(m_items.begin(), insPos);
-
-			// Move item to correct position
-			if (m_items.size() > 1)
-				inplace_merge(m_items.begin(), m_items.end()-1, m_items.end());
-
-			return selection;
+			return 0;
 		}
 	}
 
@@ -512,31 +361,32 @@ void GotoFileList::Find(const wxString& searchtext, const std::map<wxString,wxSt
 	if (searchtext.empty()) {
 		// Remove highlights
 		m_searchText.clear();
+		m_matcher.Find(wxEmptyString);
+
+		Freeze();
+		SetItemCount(m_actions.size());
 		SetSelection(-1); // de-select
 		ScrollToLine(0);
-		UpdateList(true);
+		RefreshAll();
+		Thaw();
 		return;
 	}
 
 	// Convert to lower case for case insensitive search
 	m_searchText = searchtext.Lower();
 
-	// Find all matching filenames
-	m_items.clear();
-	std::vector<unsigned int> hlChars;
-	for (unsigned int i = 0; i < m_actions.size(); ++i)
-		AddFileIfMatching(m_searchText, m_actions[i]);
-
-	sort(m_items.begin(), m_items.end());
+	// Find all matching filenames (ranked when drawn)
+	m_matcher.Find(m_searchText);
 
 	// Check if we have a matching trigger
 	int selection = FindMatchesAndSelection(triggers);
+	const unsigned int itemCount = m_matcher.GetMatchCount() + (m_tempEntry->path.empty() ? 0 : 1);
 
 	// Update display
 	Freeze();
-	SetItemCount(m_items.size());
+	SetItemCount(itemCount);
 
-	if (m_items.empty())
+	if (itemCount == 0)
 		SetSelection(-1); // deselect
 	else if (selection != wxNOT_FOUND)
 		SetSelection(selection);
@@ -547,75 +397,30 @@ void GotoFileList::Find(const wxString& searchtext, const std::map<wxString,wxSt
 	Thaw();
 }
 
-void GotoFileList::AddFileIfMatching(const wxString& text, FileEntry* file_entry) {
-	wxASSERT(!text.empty());
-
-	const wxString& name = file_entry->nameLower;
-
-	// The string positions of the characters to highlight. (Note, variable is static!)
-	static std::vector<unsigned int> hlChars;
-	hlChars.clear();
+int GotoFileList::GetFileIndex(unsigned int n) const {
+	if (m_searchText.empty()) return n;
 
-	unsigned int charpos = 0;
-	wxChar c = text[charpos];
-	for (unsigned int textpos = 0; textpos < name.size(); ++textpos) {
-		if (name[textpos] != c) continue;
-
-		hlChars.push_back(textpos);
-		++charpos;
-		if (charpos == text.size()) {
-			// All chars found.
-			m_items.push_back(aItem(file_entry, hlChars));
-			break;
-		}
-		else c = text[charpos];
+	if (!m_tempEntry->path.empty()) {
+		if (n == 0) return wxNOT_FOUND;
+		--n;
 	}
+	return m_matcher.GetMatch(n);
+}
+
+const FileEntry* GotoFileList::GetItem(unsigned int n) const {
+	const int index = GetFileIndex(n);
+	return (index == wxNOT_FOUND) ? m_tempEntry : m_actions[index];
 }
 
 int GotoFileList::FindPath(const wxString& path) const {
-	for (unsigned int i = 0; i < m_items.size(); ++i)
-		if (m_items[i].file_entry->path == path)
-			return i;
+	for (unsigned int i = 0; i < m_actions.size(); ++i)
+		if (m_actions[i]->path == path)
+			return m_matcher.FindMatch(i);
 
 	return wxNOT_FOUND;
 }
 
 const FileEntry* GotoFileList::GetSelectedAction() {
 	const int sel = GetSelection();
-	return (sel == -1) ? NULL : m_items[sel].file_entry;
-}
-
-// --- aItem --------------------------------------------------------
-
-GotoFileList::aItem::aItem(const FileEntry* a, const std::vector<unsigned int>& hl):
-	file_entry(a), hlChars(hl) 
-{
-	// Calculate rank (total distance between chars)
-	this->rank = 0;
-	if (hlChars.size() <= 1) return;
-
-	unsigned int prev = hlChars[0]+1;
-	for (std::vector<unsigned int>::const_iterator p = hlChars.begin()+1; p != hlChars.end(); ++p) {
-		this->rank += *p - prev;
-		prev = *p+1;
-	}
-}
-
-void GotoFileList::aItem::swap(aItem& ai) {
-	const FileEntry* const tempEntry = file_entry;
-	file_entry = ai.file_entry;
-	ai.file_entry = tempEntry;
-
-	const unsigned int tempRank = rank;
-	rank = ai.rank;
-	ai.rank = tempRank;
-
-	hlChars.swap(ai.hlChars);
-}
-
-bool GotoFileList::aItem::operator < (const aItem& ai) const {
-	if (rank < ai.rank) return true;
-	if (rank > ai.rank) return false;
-	if (file_entry && ai.file_entry) return (file_entry->name) < (ai.file_entry->name);
-	return false;
+	return (sel == -1) ? NULL : GetItem(sel);
 }
@@ -22,10 +22,8 @@
 #include <vector>
 
 class ProjectInfoHandler;
-class cxProjectInfo;
 class GotoFileList;
 class FileEntry;
-class DirState;
 
 class GotoFileDlg : public wxDialog {
 public:
@@ -36,7 +34,8 @@ public:
 	const wxString GetTrigger() const;
 
 private:
-	void BuildFileList(const wxString& path);
+	void LoadFiles();
+	void UpdateSearch();
 	void UpdateStatusbar();
 
 	// Event handlers
@@ -52,11 +51,8 @@ private:
 	ProjectInfoHandler& m_project;
 	std::vector<FileEntry*> m_files;
 	bool m_isDone;
-
-	// Dir traversing state
-	bool m_filesLoaded;
-	std::vector<DirState*> m_dirStack;
-	std::vector<cxProjectInfo*> m_filters;
+	unsigned int m_generation; // of file index when loaded
+	bool m_searchPending;
 
 	// Ctrls
 	wxTextCtrl* m_searchCtrl;
@@ -0,0 +1,291 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#include "GrammarCache.h"
+#include <wx/ffile.h>
+#include <wx/filename.h>
+#include "pcre.h"
+#include <vector>
+
+using namespace std;
+
+// Initializing static constants
+const unsigned int GrammarCache::FORMAT_VERSION = 1;
+
+static const char s_magic[4] = {'e', 'G', 'R', 'C'};
+static const wxUint32 s_byteOrder = 0x01020304;
+
+GrammarCache GrammarCache::s_instance;
+
+namespace {
+	// Header of the cache file. Compiled patterns can only be reused
+	// by the same pcre version on the same kind of machine.
+	struct CacheHeader {
+		char magic[4];
+		wxUint32 version;
+		wxUint32 byteOrder;
+		wxUint32 pointerSize;
+		wxUint32 pcreMajor;
+		wxUint32 pcreMinor;
+		wxUint32 stamp;
+		wxUint32 convertedCount;
+		wxUint32 compiledCount;
+	};
+
+	class CacheReader {
+	public:
+		CacheReader(const vector<char>& buffer) : m_buffer(buffer), m_pos(0) {};
+
+		bool Read(void* data, size_t len) {
+			if (len > m_buffer.size() - m_pos) return false;
+			if (len) memcpy(data, &m_buffer[m_pos], len);
+			m_pos += len;
+			return true;
+		};
+
+		bool ReadString(string& str) {
+			wxUint32 len;
+			if (!Read(&len, sizeof(len)) || len > m_buffer.size() - m_pos) return false;
+			str.assign(m_buffer.begin() + m_pos, m_buffer.begin() + m_pos + len);
+			m_pos += len;
+			return true;
+		};
+
+	private:
+		const vector<char>& m_buffer;
+		size_t m_pos;
+	};
+
+	void WriteString(wxFFile& file, const string& str) {
+		const wxUint32 len = str.size();
+		file.Write(&len, sizeof(len));
+		if (len) file.Write(str.data(), len);
+	}
+}
+
+// static
+GrammarCache& GrammarCache::Get() {
+	return s_instance;
+}
+
+GrammarCache::GrammarCache() : m_stamp(0), m_isModified(false) {
+}
+
+bool GrammarCache::Load(const wxString& path, unsigned int stamp) {
+	wxCriticalSectionLocker lock(m_crit);
+
+	m_converted.clear();
+	m_compiled.clear();
+	m_stamp = stamp;
+	m_isModified = true; // until we know the file is current
+
+	if (!wxFileExists(path)) return false;
+
+	// Read it all in one go
+	wxFFile file(path, wxT("rb"));
+	if (!file.IsOpened()) return false;
+	vector<char> buffer(file.Length());
+	if (buffer.empty() || file.Read(&buffer[0], buffer.size()) != buffer.size()) return false;
+	file.Close();
+
+	CacheReader reader(buffer);
+	CacheHeader header;
+	if (!reader.Read(&header, sizeof(header))) return false;
+	if (memcmp(header.magic, s_magic, sizeof(s_magic)) != 0 ||
+		header.version != FORMAT_VERSION ||
+		header.byteOrder != s_byteOrder ||
+		header.pointerSize != sizeof(void*) ||
+		header.pcreMajor != PCRE_MAJOR ||
+		header.pcreMinor != PCRE_MINOR) {
+		wxLogDebug(wxT("Grammar cache has old format, ignoring it"));
+		return false;
+	}
+	if (header.stamp != stamp) {
+		wxLogDebug(wxT("Grammars have changed, rebuilding grammar cache"));
+		return false;
+	}
+
+	for (unsigned int i = 0; i < header.convertedCount; ++i) {
+		string pattern;
+		string converted;
+		if (!reader.ReadString(pattern) || !reader.ReadString(converted)) goto error;
+		m_converted[pattern] = converted;
+	}
+	for (unsigned int c = 0; c < header.compiledCount; ++c) {
+		string key;
+		Compiled compiled;
+		if (!reader.ReadString(key) || !reader.ReadString(compiled.re) || !reader.ReadString(compiled.study)) goto error;
+		m_compiled[key] = compiled;
+	}
+
+	m_isModified = false;
+	return true;
+
+error:
+	wxLogDebug(wxT("Grammar cache is corrupt, ignoring it"));
+	m_converted.clear();
+	m_compiled.clear();
+	return false;
+}
+
+bool GrammarCache::Save(const wxString& path) {
+	wxCriticalSectionLocker lock(m_crit);
+	if (!m_isModified) return true;
+
+	// Write to a temp file first, so that we never leave a partial cache
+	const wxString tempPath = path + wxT(".tmp");
+	{
+		wxFFile file(tempPath, wxT("wb"));
+		if (!file.IsOpened()) return false;
+
+		CacheHeader header;
+		memcpy(header.magic, s_magic, sizeof(s_magic));
+		header.version = FORMAT_VERSION;
+		header.byteOrder = s_byteOrder;
+		header.pointerSize = sizeof(void*);
+		header.pcreMajor = PCRE_MAJOR;
+		header.pcreMinor = PCRE_MINOR;
+		header.stamp = m_stamp;
+		header.convertedCount = m_converted.size();
+		header.compiledCount = m_compiled.size();
+		file.Write(&header, sizeof(header));
+
+		for (ConvertedMap::const_iterator p = m_converted.begin(); p != m_converted.end(); ++p) {
+			WriteString(file, p->first);
+			WriteString(file, p->second);
+		}
+		for (CompiledMap::const_iterator c = m_compiled.begin(); c != m_compiled.end(); ++c) {
+			WriteString(file, c->first);
+			WriteString(file, c->second.re);
+			WriteString(file, c->second.study);
+		}
+
+		if (file.Error() || !file.Close()) {
+			wxRemoveFile(tempPath);
+			return false;
+		}
+	}
+
+	if (!wxRenameFile(tempPath, path, true)) return false;
+
+	m_isModified = false;
+	return true;
+}
+
+void GrammarCache::SetStamp(unsigned int stamp) {
+	wxCriticalSectionLocker lock(m_crit);
+	if (stamp == m_stamp) return;
+
+	// Drop the patterns of the old grammars
+	m_converted.clear();
+	m_compiled.clear();
+	m_stamp = stamp;
+	m_isModified = true;
+}
+
+void GrammarCache::Clear() {
+	wxCriticalSectionLocker lock(m_crit);
+	m_converted.clear();
+	m_compiled.clear();
+	m_isModified = true;
+}
+
+bool GrammarCache::GetConverted(const wxString& pattern, wxString& converted) const {
+	const wxCharBuffer key = pattern.mb_str(wxConvUTF8);
+
+	wxCriticalSectionLocker lock(m_crit);
+	ConvertedMap::const_iterator p = m_converted.find(key.data());
+	if (p == m_converted.end()) return false;
+
+	converted = wxString(p->second.c_str(), wxConvUTF8);
+	return true;
+}
+
+void GrammarCache::AddConverted(const wxString& pattern, const wxString& converted) {
+	const wxCharBuffer key = pattern.mb_str(wxConvUTF8);
+	const wxCharBuffer value = converted.mb_str(wxConvUTF8);
+
+	wxCriticalSectionLocker lock(m_crit);
+	m_converted[key.data()] = value.data();
+	m_isModified = true;
+}
+
+// static
+string GrammarCache::MakeKey(const char* pattern, int options) {
+	string key((const char*)&options, sizeof(options));
+	key += pattern;
+	return key;
+}
+
+bool GrammarCache::GetCompiled(const char* pattern, int options, pcre*& re, pcre_extra*& study) const {
+	const string key = MakeKey(pattern, options);
+
+	wxCriticalSectionLocker lock(m_crit);
+	CompiledMap::const_iterator p = m_compiled.find(key);
+	if (p == m_compiled.end()) return false;
+	const Compiled& compiled = p->second;
+
+	// The users free the patterns, so they get their own copies
+	re = (pcre*)malloc(compiled.re.size());
+	memcpy(re, compiled.re.data(), compiled.re.size());
+
+	// Verify that it is a valid pattern
+	size_t size = 0;
+	if (pcre_fullinfo(re, NULL, PCRE_INFO_SIZE, &size) != 0 || size != compiled.re.size()) {
+		wxASSERT(false);
+		free(re);
+		re = NULL;
+		return false;
+	}
+
+	if (compiled.study.empty()) study = NULL;
+	else {
+		// Study data is stored after the pcre_extra block, like pcre_study() does it
+		study = (pcre_extra*)malloc(sizeof(pcre_extra) + compiled.study.size());
+		memset(study, 0, sizeof(pcre_extra));
+		study->flags = PCRE_EXTRA_STUDY_DATA;
+		study->study_data = (char*)study + sizeof(pcre_extra);
+		memcpy(study->study_data, compiled.study.data(), compiled.study.size());
+	}
+
+	return true;
+}
+
+void GrammarCache::AddCompiled(const char* pattern, int options, const pcre* re, const pcre_extra* study) {
+	wxASSERT(re);
+
+	size_t size = 0;
+	size_t studySize = 0;
+	if (pcre_fullinfo(re, NULL, PCRE_INFO_SIZE, &size) != 0) return;
+	if (study && pcre_fullinfo(re, study, PCRE_INFO_STUDYSIZE, &studySize) != 0) return;
+
+	Compiled compiled;
+	compiled.re.assign((const char*)re, size);
+	if (studySize) compiled.study.assign((const char*)study->study_data, studySize);
+
+	const string key = MakeKey(pattern, options);
+
+	wxCriticalSectionLocker lock(m_crit);
+	m_compiled[key] = compiled;
+	m_isModified = true;
+}
+
+size_t GrammarCache::GetConvertedCount() const {
+	wxCriticalSectionLocker lock(m_crit);
+	return m_converted.size();
+}
+
+size_t GrammarCache::GetCompiledCount() const {
+	wxCriticalSectionLocker lock(m_crit);
+	return m_compiled.size();
+}
@@ -0,0 +1,85 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#ifndef __GRAMMARCACHE_H__
+#define __GRAMMARCACHE_H__
+
+#include "wx/wxprec.h"
+#ifndef WX_PRECOMP
+	#include <wx/wx.h>
+#endif
+
+#include <wx/thread.h>
+#include <map>
+#include <string>
+
+struct real_pcre;                 // This double pre-definition is needed
+typedef struct real_pcre pcre;    // because of the way it is defined in pcre.h
+struct pcre_extra;
+
+// Cache of the work done on the grammar patterns before they can be used:
+// the conversion from Oniguruma syntax (RegExConvert) and the compiled
+// and studied pcre patterns. It is saved to disk between sessions, so that
+// the first document opened does not have to wait for compilation.
+//
+// Entries are keyed on the pattern text, so they can never be stale. The
+// stamp (from the modification dates of the syntaxes) is only used to drop
+// the saved entries when the grammars change, so that the file does not
+// grow with patterns that are no longer in use.
+class GrammarCache {
+public:
+	static GrammarCache& Get();
+
+	bool Load(const wxString& path, unsigned int stamp);
+	bool Save(const wxString& path);
+	void SetStamp(unsigned int stamp);
+	void Clear();
+
+	// Pattern conversion
+	bool GetConverted(const wxString& pattern, wxString& converted) const;
+	void AddConverted(const wxString& pattern, const wxString& converted);
+
+	// Compiled patterns. The returned pattern and study are malloc'ed copies
+	// owned by the caller (study may be NULL).
+	bool GetCompiled(const char* pattern, int options, pcre*& re, pcre_extra*& study) const;
+	void AddCompiled(const char* pattern, int options, const pcre* re, const pcre_extra* study);
+
+	size_t GetConvertedCount() const;
+	size_t GetCompiledCount() const;
+
+	static const unsigned int FORMAT_VERSION;
+
+private:
+	GrammarCache();
+
+	struct Compiled {
+		std::string re;
+		std::string study; // empty if not studied
+	};
+
+	static std::string MakeKey(const char* pattern, int options);
+
+	typedef std::map<std::string, std::string> ConvertedMap;
+	typedef std::map<std::string, Compiled> CompiledMap;
+
+	static GrammarCache s_instance;
+
+	// Member variables
+	mutable wxCriticalSection m_crit;
+	ConvertedMap m_converted;
+	CompiledMap m_compiled;
+	unsigned int m_stamp;
+	bool m_isModified;
+};
+
+#endif // __GRAMMARCACHE_H__
@@ -0,0 +1,11 @@
+#ifndef __ILOADPROGRESS_H__
+#define __ILOADPROGRESS_H__
+
+// Gets notified while a file is loaded into a document,
+// so that progress can be shown for big files.
+class ILoadProgress {
+public:
+	virtual void OnLoadProgress(unsigned int done, unsigned int total) = 0;
+};
+
+#endif // __ILOADPROGRESS_H__
@@ -0,0 +1,140 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#include "IdleScheduler.h"
+#include <algorithm>
+
+#ifdef __WXMSW__
+	#include <windows.h>
+#else
+	#include <time.h>
+#endif
+
+using namespace std;
+
+// Initializing static constants
+const unsigned int IdleScheduler::DEFAULTPASSBUDGET = 30000;
+
+wxLongLong IdleScheduler::Slice::GetRemaining() const {
+	const wxLongLong remaining = m_deadline - m_scheduler.GetTime();
+	return remaining > 0 ? remaining : wxLongLong(0);
+}
+
+IdleScheduler::IdleScheduler(unsigned int passBudget)
+: m_passBudget(passBudget), m_pass(0) {
+}
+
+unsigned int IdleScheduler::AddJob(const wxString& name, Priority priority, unsigned int budget, JOB_CALLBACK callback, void* owner) {
+	wxASSERT(callback);
+
+	Job job;
+	job.stats.name = name;
+	job.stats.priority = priority;
+	job.stats.budget = budget;
+	job.stats.runs = 0;
+	job.stats.overruns = 0;
+	job.stats.deferred = 0;
+	job.callback = callback;
+	job.owner = owner;
+	job.lastPass = 0;
+	m_jobs.push_back(job);
+
+	m_order.push_back(m_jobs.size()-1);
+	return m_jobs.size()-1;
+}
+
+bool IdleScheduler::Run() {
+	++m_pass;
+	const wxLongLong passEnd = GetTime() + m_passBudget;
+
+	// Viewport jobs first, then the ones that have waited longest
+	sort(m_order.begin(), m_order.end(), RunOrder(m_jobs));
+
+	bool needIdle = false;
+	for (vector<unsigned int>::const_iterator p = m_order.begin(); p != m_order.end(); ++p) {
+		Job& job = m_jobs[*p];
+		JobStats& stats = job.stats;
+		const bool isViewport = (stats.priority == PRIORITY_VIEWPORT);
+		const wxLongLong start = GetTime();
+
+		// Document-wide jobs only get what is left of the pass
+		if (!isViewport && start >= passEnd) {
+			++stats.deferred;
+			needIdle = true;
+			continue;
+		}
+		wxLongLong deadline = start + stats.budget;
+		if (!isViewport && passEnd < deadline) deadline = passEnd;
+
+		if (job.callback(job.owner, Slice(*this, deadline))) needIdle = true;
+		job.lastPass = m_pass;
+
+		const wxLongLong elapsed = GetTime() - start;
+		++stats.runs;
+		stats.totalTime += elapsed;
+		if (elapsed > stats.maxTime) stats.maxTime = elapsed;
+		if (elapsed > stats.budget) ++stats.overruns;
+	}
+
+	return needIdle;
+}
+
+const IdleScheduler::JobStats& IdleScheduler::GetJobStats(unsigned int job) const {
+	wxASSERT(job < m_jobs.size());
+	return m_jobs[job].stats;
+}
+
+void IdleScheduler::ResetStats() {
+	for (vector<Job>::iterator p = m_jobs.begin(); p != m_jobs.end(); ++p) {
+		JobStats& stats = p->stats;
+		stats.runs = 0;
+		stats.overruns = 0;
+		stats.deferred = 0;
+		stats.totalTime = 0;
+		stats.maxTime = 0;
+	}
+}
+
+void IdleScheduler::LogStats() const {
+	for (vector<Job>::const_iterator p = m_jobs.begin(); p != m_jobs.end(); ++p) {
+		const JobStats& stats = p->stats;
+		const wxLongLong average = stats.runs ? stats.totalTime / stats.runs : wxLongLong(0);
+		wxLogDebug(wxT("Idle job %s: %u runs, total %sus, avg %sus, max %sus, %u over budget (%uus), %u deferred"),
+			stats.name.c_str(), stats.runs, stats.totalTime.ToString().c_str(), average.ToString().c_str(),
+			stats.maxTime.ToString().c_str(), stats.overruns, stats.budget, stats.deferred);
+	}
+}
+
+// static
+wxLongLong IdleScheduler::GetTicks() {
+#ifdef __WXMSW__
+	static LARGE_INTEGER frequency = {0};
+	if (frequency.QuadPart == 0) QueryPerformanceFrequency(&frequency);
+
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	return wxLongLong((counter.QuadPart / frequency.QuadPart) * 1000000 + ((counter.QuadPart % frequency.QuadPart) * 1000000) / frequency.QuadPart);
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return wxLongLong(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+bool IdleScheduler::RunOrder::operator()(unsigned int a, unsigned int b) const {
+	const Job& ja = m_jobs[a];
+	const Job& jb = m_jobs[b];
+	if (ja.stats.priority != jb.stats.priority) return ja.stats.priority < jb.stats.priority;
+	if (ja.lastPass != jb.lastPass) return ja.lastPass < jb.lastPass;
+	return a < b;
+}
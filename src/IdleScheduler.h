@@ -0,0 +1,109 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#ifndef __IDLESCHEDULER_H__
+#define __IDLESCHEDULER_H__
+
+#include "wx/wxprec.h"
+#ifndef WX_PRECOMP
+	#include <wx/wx.h>
+#endif
+
+#include <vector>
+
+// Runs the background jobs of an editor in idle time, so that a slow
+// job can not hold up the handling of input.
+//
+// Each job gets a slice of time (its budget) on each idle pass, and is
+// expected to return when the slice has expired. Jobs for what is in the
+// viewport always run first. Document-wide jobs get what is left of the
+// pass budget; if it is used up they wait for the next pass, and the
+// ones that have waited longest go first then.
+//
+// Times are in microseconds, from a monotonic clock.
+class IdleScheduler {
+public:
+	enum Priority {
+		PRIORITY_VIEWPORT, // affects the visible text
+		PRIORITY_DOCUMENT  // document-wide
+	};
+
+	// The time a job has been given
+	class Slice {
+	public:
+		Slice(const IdleScheduler& scheduler, wxLongLong deadline) : m_scheduler(scheduler), m_deadline(deadline) {};
+		bool IsExpired() const {return m_scheduler.GetTime() >= m_deadline;};
+		wxLongLong GetRemaining() const;
+	private:
+		const IdleScheduler& m_scheduler;
+		const wxLongLong m_deadline;
+	};
+
+	// Returns true if the job has more work to do
+	typedef bool (*JOB_CALLBACK)(void* owner, const Slice& slice);
+
+	// Timings for profiling
+	struct JobStats {
+		wxString name;
+		Priority priority;
+		unsigned int budget;
+		unsigned int runs;
+		unsigned int overruns; // slices that went over budget
+		unsigned int deferred; // passes skipped as the pass budget was used
+		wxLongLong totalTime;
+		wxLongLong maxTime;
+	};
+
+	IdleScheduler(unsigned int passBudget=DEFAULTPASSBUDGET);
+	virtual ~IdleScheduler() {};
+
+	unsigned int AddJob(const wxString& name, Priority priority, unsigned int budget, JOB_CALLBACK callback, void* owner);
+
+	// Runs the jobs once. Returns true if any of them needs more idle time
+	bool Run();
+
+	unsigned int GetJobCount() const {return m_jobs.size();};
+	const JobStats& GetJobStats(unsigned int job) const;
+	void ResetStats();
+	void LogStats() const;
+
+	// Current time on the clock used for the budgets
+	virtual wxLongLong GetTime() const {return GetTicks();};
+	static wxLongLong GetTicks();
+
+	static const unsigned int DEFAULTPASSBUDGET;
+
+private:
+	struct Job {
+		JobStats stats;
+		JOB_CALLBACK callback;
+		void* owner;
+		unsigned int lastPass;
+	};
+
+	class RunOrder {
+	public:
+		RunOrder(const std::vector<Job>& jobs) : m_jobs(jobs) {};
+		bool operator()(unsigned int a, unsigned int b) const;
+	private:
+		const std::vector<Job>& m_jobs;
+	};
+
+	// Member variables
+	std::vector<Job> m_jobs;
+	std::vector<unsigned int> m_order;
+	const unsigned int m_passBudget;
+	unsigned int m_pass;
+};
+
+#endif // __IDLESCHEDULER_H__
@@ -0,0 +1,160 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#include "LineBreaker.h"
+#include <algorithm>
+
+using namespace std;
+
+LineBreaker::LineBreaker()
+: m_width(0), m_tabWidth(0), m_charHeight(0), m_smartWrap(false), m_pages(MAXCHAR / PAGESIZE + 1) {
+}
+
+void LineBreaker::SetLayout(unsigned int width, unsigned int tabWidth, unsigned int charHeight, bool smartWrap) {
+	m_width = width;
+	m_tabWidth = tabWidth;
+	m_charHeight = charHeight;
+	m_smartWrap = smartWrap;
+}
+
+void LineBreaker::ClearAdvances() {
+	for (vector<vector<unsigned short> >::iterator p = m_pages.begin(); p != m_pages.end(); ++p) {
+		vector<unsigned short>().swap(*p);
+	}
+}
+
+bool LineBreaker::IsCached(unsigned int c) const {
+	if (c > MAXCHAR) return false;
+
+	const vector<unsigned short>& page = m_pages[c / PAGESIZE];
+	return !page.empty() && page[c % PAGESIZE] != NOADVANCE;
+}
+
+void LineBreaker::SetAdvance(unsigned int c, unsigned int advance) {
+	if (c > MAXCHAR || advance >= NOADVANCE) return;
+
+	vector<unsigned short>& page = m_pages[c / PAGESIZE];
+	if (page.empty()) page.resize(PAGESIZE, NOADVANCE);
+	page[c % PAGESIZE] = (unsigned short)advance;
+}
+
+bool LineBreaker::GetExtents(const char* text, unsigned int len, vector<unsigned int>& extents, vector<unsigned int>* missing) const {
+	// There is one extent per byte in the text (totalling). In utf8 chars
+	// composed out of multiple bytes, they will all have same value.
+	extents.clear();
+	extents.reserve(len);
+
+	const unsigned char* const dbi = (const unsigned char*)text;
+	unsigned int xpos = 0;
+	bool allCached = true;
+
+	for (unsigned int i = 0; i < len;) {
+		const unsigned char b = dbi[i];
+
+		if (b == '\t') {
+			xpos = ((xpos / m_tabWidth)+1) * m_tabWidth;
+			extents.push_back(xpos);
+			++i;
+			continue;
+		}
+
+		// Decode utf8 char
+		unsigned int c;
+		unsigned int charLen;
+		if (b < 0x80) {c = b; charLen = 1;}
+		else if ((b & 0xE0) == 0xC0) {c = b & 0x1F; charLen = 2;}
+		else if ((b & 0xF0) == 0xE0) {c = b & 0x0F; charLen = 3;}
+		else return false; // outside basic multilingual plane (or invalid)
+
+		if (i + charLen > len) return false;
+		for (unsigned int n = 1; n < charLen; ++n) {
+			const unsigned char cb = dbi[i+n];
+			if ((cb & 0xC0) != 0x80) return false;
+			c = (c << 6) | (cb & 0x3F);
+		}
+
+		const vector<unsigned short>& page = m_pages[c / PAGESIZE];
+		const unsigned short advance = page.empty() ? (unsigned short)NOADVANCE : page[c % PAGESIZE];
+		if (advance == NOADVANCE) {
+			// Keep going, so that we find all the missing chars in the line
+			if (!missing) return false;
+			missing->push_back(c);
+			allCached = false;
+		}
+		else xpos += advance;
+
+		for (unsigned int n = 0; n < charLen; ++n) extents.push_back(xpos);
+		i += charLen;
+	}
+
+	return allCached;
+}
+
+unsigned int LineBreaker::GetHeight(const char* text, unsigned int len, vector<unsigned int>& extents, vector<unsigned int>* missing) const {
+	if (!IsValid()) return 0;
+	if (len == 0) return m_charHeight;
+	if (!GetExtents(text, len, extents, missing)) return 0;
+
+	// No need to break line if it all fits
+	if (extents.back() <= m_width) return m_charHeight;
+
+	// Find width of smartwrap
+	unsigned int indentWidth = 0;
+	if (m_smartWrap) {
+		for (unsigned int i = 0; i < len; ++i) {
+			if (text[i] == '\t' || text[i] == ' ') indentWidth = extents[i];
+			else break;
+		}
+	}
+
+	// Break the line the same way as FixedLine::BreakLine()
+	unsigned int rows = 0;
+	unsigned int adj_width = m_width;
+	unsigned int lastbreak = 0;
+	vector<unsigned int>::iterator p = lower_bound(extents.begin(), extents.end(), adj_width);
+	while (p != extents.end()) {
+		const unsigned int lastchar_id = distance(extents.begin(), p);
+
+		// Find the breakpoint
+		if (text[lastchar_id] == ' ') lastbreak = lastchar_id+1; // It is ok for whitespace to extend beyond view
+		else if (lastchar_id == lastbreak) lastbreak = lastchar_id+1; // Not even room for the first char, put it there anyways.
+		else {
+			unsigned int char_id = lastchar_id;
+			const unsigned int limit = lastbreak;
+
+			// Go back until we find a breaking char
+			do {
+				--char_id;
+
+				const char c = text[char_id];
+				if (c == ' ' || c == '\t' || c == '-') {
+					lastbreak = char_id+1;
+					break;
+				}
+			} while (char_id != limit);
+
+			// If word is too long to fit line, break at char level
+			if (lastbreak == limit) lastbreak = lastchar_id;
+		}
+		++rows;
+
+		// Adjust width to end of next line
+		const unsigned int lastbreakpos = extents[lastbreak-1];
+		adj_width = lastbreakpos + (m_width - indentWidth);
+
+		p = lower_bound(extents.begin()+lastbreak, extents.end(), adj_width);
+	}
+	if (rows == 0 || lastbreak < len) ++rows;
+
+	return m_charHeight * rows;
+}
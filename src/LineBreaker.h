@@ -0,0 +1,60 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#ifndef __LINEBREAKER_H__
+#define __LINEBREAKER_H__
+
+#include <stddef.h>
+#include <vector>
+
+// Calculates the wrapped height of lines from cached glyph advance widths,
+// using the same breaking rules as FixedLine::BreakLine(). As it does not
+// need a dc, it can be used from worker threads.
+//
+// The advances are only valid for fixed-width fonts, where they do not
+// depend on the surrounding text. Font styles (bold, italic) are ignored.
+class LineBreaker {
+public:
+	LineBreaker();
+
+	void SetLayout(unsigned int width, unsigned int tabWidth, unsigned int charHeight, bool smartWrap);
+	bool IsValid() const {return m_width != 0 && m_tabWidth != 0;};
+
+	// Glyph cache (only chars in the basic multilingual plane)
+	bool IsCached(unsigned int c) const;
+	void SetAdvance(unsigned int c, unsigned int advance);
+	void ClearAdvances();
+
+	// Returns zero if the line contains chars that are not in the cache.
+	// Missing chars that can be cached are added to missing (if given).
+	unsigned int GetHeight(const char* text, unsigned int len, std::vector<unsigned int>& extents, std::vector<unsigned int>* missing=NULL) const;
+
+	enum {MAXCHAR = 0xFFFF};
+
+private:
+	enum {
+		PAGESIZE = 256,
+		NOADVANCE = 0xFFFF
+	};
+
+	bool GetExtents(const char* text, unsigned int len, std::vector<unsigned int>& extents, std::vector<unsigned int>* missing) const;
+
+	// Member variables
+	unsigned int m_width;
+	unsigned int m_tabWidth;
+	unsigned int m_charHeight;
+	bool m_smartWrap;
+	std::vector<std::vector<unsigned short> > m_pages; // allocated on demand
+};
+
+#endif // __LINEBREAKER_H__
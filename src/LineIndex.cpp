@@ -0,0 +1,540 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#include "LineIndex.h"
+
+using namespace std;
+
+LineIndex::LineIndex() : m_root(new Node(true)), m_approxHeight(1) {
+}
+
+LineIndex::~LineIndex() {
+	FreeNode(m_root);
+}
+
+void LineIndex::clear() {
+	FreeNode(m_root);
+	m_root = new Node(true);
+}
+
+void LineIndex::assign(const vector<unsigned int>& ends, const vector<unsigned int>* widths) {
+	clear();
+	if (ends.empty()) return;
+
+	vector<Line> lines(ends.size());
+	unsigned int start = 0;
+	for (size_t i = 0; i < ends.size(); ++i) {
+		lines[i].length = ends[i] - start;
+		lines[i].height = 0;
+		lines[i].width = widths ? (*widths)[i] : 0;
+		start = ends[i];
+	}
+
+	InsertLines(0, &*lines.begin(), &*lines.begin() + lines.size());
+}
+
+void LineIndex::get_ends(vector<unsigned int>& ends) const {
+	ends.clear();
+	ends.reserve(size());
+
+	// Walk the leaves in order
+	vector<const Node*> stack;
+	stack.push_back(m_root);
+	unsigned int pos = 0;
+	while (!stack.empty()) {
+		const Node* n = stack.back();
+		stack.pop_back();
+
+		if (n->leaf) {
+			for (vector<Line>::const_iterator p = n->lines.begin(); p != n->lines.end(); ++p) {
+				pos += p->length;
+				ends.push_back(pos);
+			}
+		}
+		else {
+			for (vector<Node*>::const_reverse_iterator c = n->children.rbegin(); c != n->children.rend(); ++c)
+				stack.push_back(*c);
+		}
+	}
+}
+
+unsigned int LineIndex::offset(unsigned int index) const {
+	const Node* n = m_root;
+	unsigned int pos = 0;
+
+	while (!n->leaf) {
+		for (vector<Node*>::const_iterator c = n->children.begin(); c != n->children.end(); ++c) {
+			if (index < (*c)->count) {
+				n = *c;
+				break;
+			}
+			index -= (*c)->count;
+			pos += (*c)->length;
+		}
+	}
+
+	for (unsigned int i = 0; i < index; ++i)
+		pos += n->lines[i].length;
+	return pos;
+}
+
+unsigned int LineIndex::end(unsigned int index) const {
+	return offset(index) + GetLine(index).length;
+}
+
+unsigned int LineIndex::top(unsigned int index) const {
+	const Node* n = m_root;
+	unsigned int ypos = 0;
+
+	while (!n->leaf) {
+		for (vector<Node*>::const_iterator c = n->children.begin(); c != n->children.end(); ++c) {
+			if (index < (*c)->count) {
+				n = *c;
+				break;
+			}
+			index -= (*c)->count;
+			ypos += FullHeight(*c);
+		}
+	}
+
+	for (unsigned int i = 0; i < index; ++i)
+		ypos += LineHeight(n->lines[i]);
+	return ypos;
+}
+
+unsigned int LineIndex::bottom(unsigned int index) const {
+	return top(index) + LineHeight(GetLine(index));
+}
+
+unsigned int LineIndex::line_length(unsigned int index) const {
+	return GetLine(index).length;
+}
+
+unsigned int LineIndex::line_height(unsigned int index) const {
+	return GetLine(index).height;
+}
+
+unsigned int LineIndex::line_width(unsigned int index) const {
+	return GetLine(index).width;
+}
+
+unsigned int LineIndex::find_offset(unsigned int pos) const {
+	if (pos > length()) return size();
+
+	const Node* n = m_root;
+	unsigned int index = 0;
+
+	while (!n->leaf) {
+		for (vector<Node*>::const_iterator c = n->children.begin(); c != n->children.end(); ++c) {
+			if (pos <= (*c)->length) {
+				n = *c;
+				break;
+			}
+			pos -= (*c)->length;
+			index += (*c)->count;
+		}
+	}
+
+	for (vector<Line>::const_iterator p = n->lines.begin(); p != n->lines.end(); ++p) {
+		if (pos <= p->length) break;
+		pos -= p->length;
+		++index;
+	}
+	return index;
+}
+
+unsigned int LineIndex::find_ypos(unsigned int ypos) const {
+	if (ypos > height()) return size();
+
+	const Node* n = m_root;
+	unsigned int index = 0;
+
+	while (!n->leaf) {
+		for (vector<Node*>::const_iterator c = n->children.begin(); c != n->children.end(); ++c) {
+			const unsigned int h = FullHeight(*c);
+			if (ypos <= h) {
+				n = *c;
+				break;
+			}
+			ypos -= h;
+			index += (*c)->count;
+		}
+	}
+
+	for (vector<Line>::const_iterator p = n->lines.begin(); p != n->lines.end(); ++p) {
+		const unsigned int h = LineHeight(*p);
+		if (ypos <= h) break;
+		ypos -= h;
+		++index;
+	}
+	return index;
+}
+
+unsigned int LineIndex::find_unmeasured() const {
+	if (m_root->unmeasured == 0) return size();
+
+	const Node* n = m_root;
+	unsigned int index = 0;
+
+	while (!n->leaf) {
+		for (vector<Node*>::const_iterator c = n->children.begin(); c != n->children.end(); ++c) {
+			if ((*c)->unmeasured) {
+				n = *c;
+				break;
+			}
+			index += (*c)->count;
+		}
+	}
+
+	for (vector<Line>::const_iterator p = n->lines.begin(); p != n->lines.end(); ++p) {
+		if (p->height == 0) break;
+		++index;
+	}
+	return index;
+}
+
+void LineIndex::insert(unsigned int index, unsigned int length) {
+	Line line;
+	line.length = length;
+	line.height = 0;
+	line.width = 0;
+
+	InsertLines(index, &line, &line + 1);
+}
+
+void LineIndex::insert(unsigned int index, const vector<unsigned int>& lengths) {
+	if (lengths.empty()) return;
+
+	vector<Line> lines(lengths.size());
+	for (size_t i = 0; i < lengths.size(); ++i) {
+		lines[i].length = lengths[i];
+		lines[i].height = 0;
+		lines[i].width = 0;
+	}
+
+	InsertLines(index, &*lines.begin(), &*lines.begin() + lines.size());
+}
+
+void LineIndex::erase(unsigned int first, unsigned int last) {
+	if (first >= last) return;
+	if (first == 0 && last >= size()) {
+		clear();
+		return;
+	}
+
+	Erase(m_root, first, last);
+
+	// Remove levels that no longer branch
+	while (!m_root->leaf && m_root->children.size() == 1) {
+		Node* n = m_root->children.front();
+		m_root->children.clear();
+		FreeNode(m_root);
+		m_root = n;
+	}
+}
+
+void LineIndex::set_length(unsigned int index, unsigned int length) {
+	Node* path[MAXDEPTH];
+	unsigned int depth;
+	Line& line = ModifyLine(index, path, depth);
+
+	line.length = length;
+	UpdatePath(path, depth);
+}
+
+void LineIndex::set_height(unsigned int index, unsigned int height) {
+	Node* path[MAXDEPTH];
+	unsigned int depth;
+	Line& line = ModifyLine(index, path, depth);
+
+	if (line.height == height) return;
+	line.height = height;
+	UpdatePath(path, depth);
+}
+
+void LineIndex::set_width(unsigned int index, unsigned int width) {
+	Node* path[MAXDEPTH];
+	unsigned int depth;
+	Line& line = ModifyLine(index, path, depth);
+
+	if (line.width == width) return;
+	line.width = width;
+	UpdatePath(path, depth);
+}
+
+void LineIndex::clear_heights() {
+	ClearHeights(m_root);
+}
+
+void LineIndex::clear_widths() {
+	ClearWidths(m_root);
+}
+
+const LineIndex::Line& LineIndex::GetLine(unsigned int index) const {
+	const Node* n = m_root;
+
+	while (!n->leaf) {
+		for (vector<Node*>::const_iterator c = n->children.begin(); c != n->children.end(); ++c) {
+			if (index < (*c)->count) {
+				n = *c;
+				break;
+			}
+			index -= (*c)->count;
+		}
+	}
+
+	return n->lines[index];
+}
+
+LineIndex::Line& LineIndex::ModifyLine(unsigned int index, Node** path, unsigned int& depth) {
+	Node* n = m_root;
+	depth = 0;
+	path[depth++] = n;
+
+	while (!n->leaf) {
+		for (vector<Node*>::iterator c = n->children.begin(); c != n->children.end(); ++c) {
+			if (index < (*c)->count) {
+				n = *c;
+				break;
+			}
+			index -= (*c)->count;
+		}
+		path[depth++] = n;
+	}
+
+	return n->lines[index];
+}
+
+void LineIndex::UpdatePath(Node** path, unsigned int depth) {
+	// Update sums from the leaf and up
+	while (depth) UpdateSums(path[--depth]);
+}
+
+void LineIndex::InsertLines(unsigned int index, const Line* first, const Line* last) {
+	Insert(m_root, index, first, last);
+
+	// Grow the tree at the root
+	while (IsOverfull(m_root)) {
+		Node* n = new Node(false);
+		n->children.push_back(m_root);
+		m_root = n;
+		Split(n, 0);
+		UpdateSums(n);
+	}
+}
+
+void LineIndex::Insert(Node* n, unsigned int index, const Line* first, const Line* last) {
+	if (n->leaf) n->lines.insert(n->lines.begin() + index, first, last);
+	else {
+		// Appending to the end of a child is preferred over
+		// inserting at the start of the next one
+		size_t i = 0;
+		for (; i+1 < n->children.size(); ++i) {
+			if (index <= n->children[i]->count) break;
+			index -= n->children[i]->count;
+		}
+
+		Insert(n->children[i], index, first, last);
+		if (IsOverfull(n->children[i])) Split(n, i);
+	}
+
+	UpdateSums(n);
+}
+
+void LineIndex::Erase(Node* n, unsigned int first, unsigned int last) {
+	if (n->leaf) n->lines.erase(n->lines.begin() + first, n->lines.begin() + last);
+	else {
+		// Children fully inside the range are removed, the rest are trimmed
+		unsigned int start = 0;
+		size_t i = 0;
+		while (i < n->children.size() && start < last) {
+			Node* c = n->children[i];
+			const unsigned int cEnd = start + c->count;
+
+			if (cEnd <= first) ++i;
+			else if (first <= start && cEnd <= last) {
+				FreeNode(c);
+				n->children.erase(n->children.begin() + i);
+			}
+			else {
+				const unsigned int cFirst = (first > start) ? first - start : 0;
+				const unsigned int cLast = (last < cEnd) ? last - start : c->count;
+				Erase(c, cFirst, cLast);
+				++i;
+			}
+
+			start = cEnd;
+		}
+
+		// Merge trimmed children with their neighbours
+		i = 0;
+		while (i < n->children.size()) {
+			if (n->children.size() > 1 && IsUnderfull(n->children[i])) {
+				const size_t j = (i+1 < n->children.size()) ? i : i-1;
+				Merge(n, j);
+				i = j;
+				if (IsUnderfull(n->children[i])) continue;
+			}
+			++i;
+		}
+	}
+
+	UpdateSums(n);
+}
+
+void LineIndex::Split(Node* parent, size_t childIndex) {
+	Node* c = parent->children[childIndex];
+	const size_t maxItems = c->leaf ? MAXLINES : MAXCHILDREN;
+	const size_t items = c->leaf ? c->lines.size() : c->children.size();
+
+	// Divide evenly in as few nodes as possible
+	const size_t pieces = (items + maxItems - 1) / maxItems;
+	if (pieces < 2) return;
+
+	vector<Node*> newNodes;
+	newNodes.reserve(pieces-1);
+	size_t pos = (items * 1) / pieces;
+	for (size_t p = 1; p < pieces; ++p) {
+		const size_t next = (items * (p+1)) / pieces;
+		Node* n = new Node(c->leaf);
+		if (c->leaf) n->lines.assign(c->lines.begin() + pos, c->lines.begin() + next);
+		else n->children.assign(c->children.begin() + pos, c->children.begin() + next);
+		UpdateSums(n);
+		newNodes.push_back(n);
+		pos = next;
+	}
+
+	const size_t firstSize = items / pieces;
+	if (c->leaf) {
+		c->lines.resize(firstSize);
+		vector<Line>(c->lines).swap(c->lines); // release excess memory
+	}
+	else c->children.resize(firstSize);
+	UpdateSums(c);
+
+	parent->children.insert(parent->children.begin() + childIndex + 1, newNodes.begin(), newNodes.end());
+}
+
+void LineIndex::Merge(Node* parent, size_t childIndex) {
+	Node* c = parent->children[childIndex];
+	Node* next = parent->children[childIndex+1];
+
+	if (c->leaf) c->lines.insert(c->lines.end(), next->lines.begin(), next->lines.end());
+	else {
+		c->children.insert(c->children.end(), next->children.begin(), next->children.end());
+		next->children.clear(); // now owned by c
+	}
+
+	FreeNode(next);
+	parent->children.erase(parent->children.begin() + childIndex + 1);
+	UpdateSums(c);
+
+	if (IsOverfull(c)) Split(parent, childIndex);
+}
+
+void LineIndex::UpdateSums(Node* n) { // static
+	n->length = 0;
+	n->height = 0;
+	n->unmeasured = 0;
+	n->maxWidth = 0;
+
+	if (n->leaf) {
+		n->count = n->lines.size();
+		for (vector<Line>::const_iterator p = n->lines.begin(); p != n->lines.end(); ++p) {
+			n->length += p->length;
+			if (p->height) n->height += p->height;
+			else ++n->unmeasured;
+			if (p->width > n->maxWidth) n->maxWidth = p->width;
+		}
+	}
+	else {
+		n->count = 0;
+		for (vector<Node*>::const_iterator c = n->children.begin(); c != n->children.end(); ++c) {
+			n->count += (*c)->count;
+			n->length += (*c)->length;
+			n->height += (*c)->height;
+			n->unmeasured += (*c)->unmeasured;
+			if ((*c)->maxWidth > n->maxWidth) n->maxWidth = (*c)->maxWidth;
+		}
+	}
+}
+
+bool LineIndex::IsOverfull(const Node* n) { // static
+	return n->leaf ? (n->lines.size() > MAXLINES) : (n->children.size() > MAXCHILDREN);
+}
+
+bool LineIndex::IsUnderfull(const Node* n) { // static
+	return n->leaf ? (n->lines.size() < MAXLINES/4) : (n->children.size() < MAXCHILDREN/4);
+}
+
+void LineIndex::FreeNode(Node* n) { // static
+	for (vector<Node*>::iterator c = n->children.begin(); c != n->children.end(); ++c)
+		FreeNode(*c);
+	delete n;
+}
+
+void LineIndex::ClearHeights(Node* n) { // static
+	if (n->leaf) {
+		for (vector<Line>::iterator p = n->lines.begin(); p != n->lines.end(); ++p)
+			p->height = 0;
+	}
+	else {
+		for (vector<Node*>::iterator c = n->children.begin(); c != n->children.end(); ++c)
+			ClearHeights(*c);
+	}
+	n->height = 0;
+	n->unmeasured = n->count;
+}
+
+void LineIndex::ClearWidths(Node* n) { // static
+	if (n->leaf) {
+		for (vector<Line>::iterator p = n->lines.begin(); p != n->lines.end(); ++p)
+			p->width = 0;
+	}
+	else {
+		for (vector<Node*>::iterator c = n->children.begin(); c != n->children.end(); ++c)
+			ClearWidths(*c);
+	}
+	n->maxWidth = 0;
+}
+
+bool LineIndex::verify() const {
+	unsigned int leafDepth = 0;
+	return VerifyNode(m_root, 0, leafDepth);
+}
+
+bool LineIndex::VerifyNode(const Node* n, unsigned int depth, unsigned int& leafDepth) const {
+	if (IsOverfull(n)) return false;
+	if (depth >= MAXDEPTH) return false;
+
+	// Cached sums have to match content
+	Node sums(n->leaf);
+	sums.lines = n->lines;
+	sums.children = n->children;
+	UpdateSums(&sums);
+	if (sums.count != n->count || sums.length != n->length || sums.height != n->height ||
+		sums.unmeasured != n->unmeasured || sums.maxWidth != n->maxWidth) return false;
+
+	if (n->leaf) {
+		// All leaves at same depth
+		if (leafDepth == 0) leafDepth = depth+1;
+		return leafDepth == depth+1;
+	}
+
+	if (n->children.empty()) return false;
+	for (vector<Node*>::const_iterator c = n->children.begin(); c != n->children.end(); ++c) {
+		if ((*c)->count == 0) return false;
+		if (!VerifyNode(*c, depth+1, leafDepth)) return false;
+	}
+	return true;
+}
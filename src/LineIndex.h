@@ -0,0 +1,133 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#ifndef __LINEINDEX_H__
+#define __LINEINDEX_H__
+
+#include <stddef.h>
+#include <vector>
+
+// Balanced tree (B+tree) of lines, used by the LineLists to map between
+// line numbers, text offsets and y-positions.
+//
+// Each line only stores its own length, height and width. Every node caches
+// the sums (and max width) of its subtree, so absolute offsets and positions
+// are found by a single descent, and an edit only has to update the nodes
+// on the path to the root. All operations are O(log n).
+//
+// A height of zero means that the line has not been measured yet. Such
+// lines count with the approximate height, so that the total height can
+// be estimated before all lines have been laid out.
+class LineIndex {
+public:
+	LineIndex();
+	~LineIndex();
+
+	void clear();
+	void assign(const std::vector<unsigned int>& ends, const std::vector<unsigned int>* widths=NULL); // from absolute end offsets
+	void get_ends(std::vector<unsigned int>& ends) const;
+
+	unsigned int size() const {return m_root->count;};
+	unsigned int length() const {return m_root->length;};
+	unsigned int height() const {return FullHeight(m_root);};
+	unsigned int max_width() const {return m_root->maxWidth;};
+	unsigned int unmeasured() const {return m_root->unmeasured;};
+	unsigned int measured_height() const {return m_root->height;};
+
+	unsigned int approx_height() const {return m_approxHeight;};
+	void set_approx_height(unsigned int height) {m_approxHeight = height;};
+
+	// Absolute values for line at index
+	unsigned int offset(unsigned int index) const;
+	unsigned int end(unsigned int index) const;
+	unsigned int top(unsigned int index) const;
+	unsigned int bottom(unsigned int index) const;
+
+	// Values for the line itself
+	unsigned int line_length(unsigned int index) const;
+	unsigned int line_height(unsigned int index) const; // zero if not measured
+	unsigned int line_width(unsigned int index) const;
+
+	// Searches (returns size() if not found)
+	unsigned int find_offset(unsigned int pos) const; // first line with end >= pos
+	unsigned int find_ypos(unsigned int ypos) const;  // first line with bottom >= ypos
+	unsigned int find_unmeasured() const;             // first line with no height
+
+	// Modifications
+	void insert(unsigned int index, unsigned int length);
+	void insert(unsigned int index, const std::vector<unsigned int>& lengths);
+	void erase(unsigned int first, unsigned int last);
+	void set_length(unsigned int index, unsigned int length);
+	void set_height(unsigned int index, unsigned int height);
+	void set_width(unsigned int index, unsigned int width);
+	void clear_heights();
+	void clear_widths();
+
+	bool verify() const;
+
+private:
+	struct Line {
+		unsigned int length;
+		unsigned int height;
+		unsigned int width;
+	};
+
+	struct Node {
+		Node(bool isLeaf) : leaf(isLeaf), count(0), length(0), height(0), unmeasured(0), maxWidth(0) {};
+		bool leaf;
+		unsigned int count;
+		unsigned int length;
+		unsigned int height; // of measured lines
+		unsigned int unmeasured;
+		unsigned int maxWidth;
+		std::vector<Line> lines;     // if leaf
+		std::vector<Node*> children; // if not leaf
+	};
+
+	enum {
+		MAXLINES = 128,    // per leaf
+		MAXCHILDREN = 64,  // per internal node
+		MAXDEPTH = 16
+	};
+
+	unsigned int FullHeight(const Node* n) const {return n->height + (n->unmeasured * m_approxHeight);};
+	unsigned int LineHeight(const Line& l) const {return l.height ? l.height : m_approxHeight;};
+
+	const Line& GetLine(unsigned int index) const;
+	Line& ModifyLine(unsigned int index, Node** path, unsigned int& depth);
+	void UpdatePath(Node** path, unsigned int depth);
+
+	void Insert(Node* n, unsigned int index, const Line* first, const Line* last);
+	void InsertLines(unsigned int index, const Line* first, const Line* last);
+	void Erase(Node* n, unsigned int first, unsigned int last);
+	void Split(Node* parent, size_t childIndex);
+	void Merge(Node* parent, size_t childIndex);
+
+	static void UpdateSums(Node* n);
+	static bool IsOverfull(const Node* n);
+	static bool IsUnderfull(const Node* n);
+	static void FreeNode(Node* n);
+	static void ClearHeights(Node* n);
+	static void ClearWidths(Node* n);
+	bool VerifyNode(const Node* n, unsigned int depth, unsigned int& leafDepth) const;
+
+	// Not copyable
+	LineIndex(const LineIndex&);
+	LineIndex& operator=(const LineIndex&);
+
+	// Member variables
+	Node* m_root;
+	unsigned int m_approxHeight;
+};
+
+#endif // __LINEINDEX_H__
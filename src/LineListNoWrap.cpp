@@ -16,20 +16,20 @@
 #include "FixedLine.h"
 
 LineListNoWrap::LineListNoWrap(FixedLine& l, const DocumentWrapper& dw):
-	m_line(l), m_doc(dw), m_maxWidth(0) {}
+	m_line(l), m_doc(dw) {}
 
 bool LineListNoWrap::IsValidIndex(unsigned int index) const {
-	return (index < m_textOffsets.size());
+	return (index < m_lines.size());
 }
 
 unsigned int LineListNoWrap::offset(unsigned int index) {
 	wxASSERT(IsValidIndex(index));
-	return index ? m_textOffsets[index-1] : 0;
+	return index ? m_lines.offset(index) : 0;
 }
 
 unsigned int LineListNoWrap::end(unsigned int index) {
 	wxASSERT(IsValidIndex(index));
-	return m_textOffsets[index];
+	return m_lines.end(index);
 }
 
 unsigned int LineListNoWrap::top(unsigned int index) {
@@ -43,126 +43,109 @@ unsigned int LineListNoWrap::bottom(unsigned int index) {
 }
 
 unsigned int LineListNoWrap::size() const {
-	return m_textOffsets.size();
+	return m_lines.size();
 }
 
 unsigned int LineListNoWrap::last() const {
-	wxASSERT(!m_textOffsets.empty());
-	return m_textOffsets.size()-1;
+	wxASSERT(m_lines.size());
+	return m_lines.size()-1;
 }
 
 unsigned int LineListNoWrap::height() const {
-	return m_textOffsets.size() * m_line.GetCharHeight();
+	return m_lines.size() * m_line.GetCharHeight();
 }
 
 unsigned int LineListNoWrap::length() const {
-	return (!m_textOffsets.empty()) ? m_textOffsets.back() : 0;
+	return m_lines.length();
 }
 
 bool LineListNoWrap::IsLineEnd(unsigned int pos) {
 	if (!size()) return false;
-	wxASSERT(pos <= m_textOffsets.back());
+	wxASSERT(pos <= m_lines.length());
 
-	std::vector<unsigned int>::const_iterator posline = lower_bound(m_textOffsets.begin(), m_textOffsets.end(), pos);
-	return (pos == *posline);
+	const unsigned int posline = m_lines.find_offset(pos);
+	return (pos == m_lines.end(posline));
 }
 
 unsigned int LineListNoWrap::EndFromPos(unsigned int pos) {
 	if (!size()) return 0;
-	wxASSERT(pos <= m_textOffsets.back());
+	wxASSERT(pos <= m_lines.length());
 
-	std::vector<unsigned int>::const_iterator posline = lower_bound(m_textOffsets.begin(), m_textOffsets.end(), pos);
-	if (pos != *posline) return *posline;
-	return pos == m_textOffsets.back() ? pos : *(++posline);
+	const unsigned int posline = m_lines.find_offset(pos);
+	const unsigned int lineend = m_lines.end(posline);
+	if (pos != lineend) return lineend;
+	return pos == m_lines.length() ? pos : lineend + m_lines.line_length(posline+1);
 }
 
 unsigned int LineListNoWrap::StartFromPos(unsigned int pos) {
 	if (!size()) return 0;
-	wxASSERT(pos <= m_textOffsets.back());
+	wxASSERT(pos <= m_lines.length());
 
-	std::vector<unsigned int>::const_iterator posline = lower_bound(m_textOffsets.begin(), m_textOffsets.end(), pos);
-	if (pos == *posline) return pos;
-	return (posline == m_textOffsets.begin()) ? 0 : *(--posline);
+	const unsigned int posline = m_lines.find_offset(pos);
+	const unsigned int linestart = m_lines.offset(posline);
+	if (pos == linestart + m_lines.line_length(posline)) return pos;
+	return linestart;
 }
 
+// The offsets are kept in the tree, so this is a copy. If it is
+// modified, NewOffsets() has to be called to put it into effect.
 std::vector<unsigned int>& LineListNoWrap::GetOffsets() {
-	return m_textOffsets;
+	m_lines.get_ends(m_offsets);
+	return m_offsets;
 }
 
 void LineListNoWrap::SetOffsets(const vector<unsigned int>& offsets) {
-	m_textOffsets = offsets;
+	m_offsets = offsets;
 	NewOffsets();
 }
 
 // You have to call this after textOffsets heve been modified using GetOffsets()
 void LineListNoWrap::NewOffsets() {
-	m_lineWidths.resize(m_textOffsets.size());
-
 	// Get all line widths
-	m_maxWidth = 0;
+	vector<unsigned int> lineWidths(m_offsets.size());
 	unsigned int lineStart = 0;
-	for (unsigned int i = 0; i < m_textOffsets.size(); ++i) {
-		const unsigned int lineWidth = m_line.GetQuickLineWidth(lineStart, m_textOffsets[i]);
-
-		m_lineWidths[i] = lineWidth;
-		lineStart = m_textOffsets[i];
-		if (lineWidth > m_maxWidth) m_maxWidth = lineWidth;
+	for (unsigned int i = 0; i < m_offsets.size(); ++i) {
+		lineWidths[i] = m_line.GetQuickLineWidth(lineStart, m_offsets[i]);
+		lineStart = m_offsets[i];
 	}
+
+	m_lines.assign(m_offsets, &lineWidths);
+	vector<unsigned int>().swap(m_offsets); // release memory
 }
 
 void LineListNoWrap::insert(unsigned int index, int newend) {
-	wxASSERT(index >= 0 && index <= m_textOffsets.size());
+	wxASSERT(index >= 0 && index <= m_lines.size());
 	wxASSERT(newend <= (int)m_doc.GetLength());
 
-	// Insert the text
-	m_textOffsets.insert(m_textOffsets.begin()+index, newend);
-
-	// Update the following offsets
-	const unsigned int diff = newend - (index ? m_textOffsets[index-1] : 0);
-	for (std::vector<unsigned int>::iterator p = m_textOffsets.begin()+index+1; p != m_textOffsets.end(); ++p) {
-		*p += diff;
-	}
-
 	// Width of new line depends on syntax and theme
-	// so just set it to 0 for now, it will be updated when parsed
-	m_lineWidths.insert(m_lineWidths.begin()+index, 0);
+	// so just set it to 0 for now, it will be updated when parsed.
+	// The following lines keep their lengths, so they move with it.
+	m_lines.insert(index, newend - (index ? m_lines.end(index-1) : 0));
 }
 
 void LineListNoWrap::insertlines(unsigned int index, vector<unsigned int>& newlines) {
-	wxASSERT(index >= 0 && index <= m_textOffsets.size());
+	wxASSERT(index >= 0 && index <= m_lines.size());
 	wxASSERT(!newlines.empty());
 
-	// Insert the lines
-	m_textOffsets.insert(m_textOffsets.begin()+index, newlines.begin(), newlines.end());
-
-	// Update the following offsets
-	const unsigned int diff = newlines.back() - (index ? m_textOffsets[index-1] : 0);
-	for (std::vector<unsigned int>::iterator p = m_textOffsets.begin() + index + newlines.size(); p != m_textOffsets.end(); ++p) {
-		*p += diff;
+	// Convert to line lengths
+	vector<unsigned int> lengths(newlines.size());
+	unsigned int lineStart = index ? m_lines.end(index-1) : 0;
+	for (unsigned int i = 0; i < newlines.size(); ++i) {
+		lengths[i] = newlines[i] - lineStart;
+		lineStart = newlines[i];
 	}
 
-	// Insert width of the new lines
-	m_lineWidths.insert(m_lineWidths.begin()+index, newlines.size(), 0);
-	const unsigned int newlinesEnd = index + newlines.size();
-
 	// Width of new lines depends on syntax and theme
 	// so just set it to 0 for now, it will be updated when parsed
-	for (unsigned int i = index; i < newlinesEnd; ++i) {
-		m_lineWidths[i] = 0;
-	}
+	m_lines.insert(index, lengths);
 }
 
 void LineListNoWrap::update(unsigned int index, unsigned int newend) {
 	wxASSERT(IsValidIndex(index));
 	wxASSERT(newend <= m_doc.GetLength());
 
-	// Calc the change
-	const int tdiff = newend - m_textOffsets[index];
-
-	// Update the changed and following offsets
-	for (std::vector<unsigned int>::iterator p = m_textOffsets.begin()+index; p != m_textOffsets.end(); ++p) {
-		*p += tdiff;
-	}
+	// Changing the length moves all following offsets
+	m_lines.set_length(index, newend - offset(index));
 
 	// Width of new line depends on syntax and theme
 	// so leave it for now, it will be updated when parsed
@@ -171,77 +154,35 @@ void LineListNoWrap::update(unsigned int index, unsigned int newend) {
 void LineListNoWrap::update_parsed_line(unsigned int index) {
 	wxASSERT(IsValidIndex(index));
 
-	m_line.SetLine((index ? m_textOffsets[index-1] : 0), m_textOffsets[index]);
-	const unsigned int oldWidth = m_lineWidths[index];
-	const unsigned int lineWidth = m_line.GetUnwrappedWidth();
-	m_lineWidths[index] = lineWidth;
-
-	// Calc maxWidth
-	if (lineWidth > m_maxWidth) m_maxWidth = lineWidth;
-	else if (oldWidth == m_maxWidth) {
-		// If this line could have been the widest, we have
-		// to calc m_maxWidth against all lines.
-		m_maxWidth = *max_element(m_lineWidths.begin(), m_lineWidths.end());
-	}
+	const unsigned int lineStart = offset(index);
+	m_line.SetLine(lineStart, lineStart + m_lines.line_length(index));
+	m_lines.set_width(index, m_line.GetUnwrappedWidth());
 }
 
 void LineListNoWrap::update_line_extent(unsigned int index, unsigned int extent) {
 	wxASSERT(IsValidIndex(index));
-	if (extent == m_lineWidths[index]) return; // no change
-
-	const unsigned int oldWidth = m_lineWidths[index];
-	m_lineWidths[index] = extent;
-
-	// Calc maxWidth
-	if (extent > m_maxWidth) m_maxWidth = extent;
-	else if (oldWidth == m_maxWidth) {
-		// If this line could have been the widest, we have
-		// to calc m_maxWidth against all lines.
-		m_maxWidth = *max_element(m_lineWidths.begin(), m_lineWidths.end());
-	}
+	m_lines.set_width(index, extent);
 }
 
 void LineListNoWrap::remove(unsigned int startline, unsigned int endline) {
-	wxASSERT(startline >= 0 && startline < m_textOffsets.size());
-	wxASSERT(endline > startline && endline <= m_textOffsets.size());
+	wxASSERT(startline >= 0 && startline < m_lines.size());
+	wxASSERT(endline > startline && endline <= m_lines.size());
 	wxASSERT(size());
 
-	const unsigned int maxWidth = *max_element(m_lineWidths.begin()+startline, m_lineWidths.begin()+endline);
-
-	// Remove text lines
-	const int diff = offset(startline) - end(endline-1);
-	m_textOffsets.erase(m_textOffsets.begin()+startline, m_textOffsets.begin()+endline);
-	m_lineWidths.erase(m_lineWidths.begin()+startline, m_lineWidths.begin()+endline);
-
-	if (m_textOffsets.empty()) {
-		m_maxWidth = 0;
-		return;
-	}
-
-	// Update the following offsets
-	for (vector<unsigned int>::iterator p = m_textOffsets.begin()+startline; p != m_textOffsets.end(); ++p) {
-		*p += diff;
-	}
-
-	// If one of the lines could have been the widest,
-	// we have to calc m_maxWidth against all lines.
-	if (maxWidth == m_maxWidth) {
-		m_maxWidth = *max_element(m_lineWidths.begin(), m_lineWidths.end());
-	}
+	// Following lines keep their lengths, so they move up
+	m_lines.erase(startline, endline);
 }
 
 void LineListNoWrap::clear() {
-	m_textOffsets.clear();
-	m_lineWidths.clear();
-	m_maxWidth = 0;
+	m_lines.clear();
+	vector<unsigned int>().swap(m_offsets);
 }
 
 int LineListNoWrap::find_offset(int pos) {
 	if (!size()) return 0;
-	wxASSERT(pos >= 0 && pos <= (int)m_textOffsets.back());
+	wxASSERT(pos >= 0 && pos <= (int)m_lines.length());
 
-	std::vector<unsigned int>::iterator posline = lower_bound(m_textOffsets.begin(), m_textOffsets.end(), (unsigned int)pos);
-	return distance(m_textOffsets.begin(), posline);
+	return m_lines.find_offset(pos);
 }
 
 int LineListNoWrap::find_ypos(unsigned int ypos) {
@@ -252,7 +193,9 @@ int LineListNoWrap::find_ypos(unsigned int ypos) {
 }
 
 void LineListNoWrap::invalidate(int WXUNUSED(index)) {
-	NewOffsets(); // to recalculate m_maxWidth
+	// Recalculate widths (and thereby width())
+	m_lines.get_ends(m_offsets);
+	NewOffsets();
 }
 
 void LineListNoWrap::Print() {
@@ -261,10 +204,13 @@ void LineListNoWrap::Print() {
 	wxLogDebug(wxT(" height:     %u"), height());
 
 	for (unsigned int i = 0; i < size(); ++i) {
-		wxLogDebug(wxT("  %u: %u %u"), i, m_textOffsets[i], m_lineWidths[i]);
+		wxLogDebug(wxT("  %u: %u %u"), i, m_lines.end(i), m_lines.line_width(i));
 	}
 }
 
-void LineListNoWrap::verify(bool WXUNUSED(deep)) const {
-	wxASSERT(m_textOffsets.size() == m_lineWidths.size());
+void LineListNoWrap::verify(bool deep) const {
+#ifdef  __WXDEBUG__
+	// The tree check visits all nodes, so it is only done when asked for
+	if (deep) wxASSERT(m_lines.verify());
+#endif // __WXDEBUG__
 }
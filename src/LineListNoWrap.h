@@ -15,6 +15,7 @@
 #define __LINELISTNOWRAP_H__
 
 #include "LineList.h"
+#include "LineIndex.h"
 
 class FixedLine;
 class DocumentWrapper;
@@ -33,7 +34,7 @@ public:
 	unsigned int last() const;
 	unsigned int height() const;
 	unsigned int length() const;
-	unsigned int width() const {return m_maxWidth;};
+	unsigned int width() const {return m_lines.max_width();};
 
 	bool IsLineEnd(unsigned int pos);
 	unsigned int EndFromPos(unsigned int pos);
@@ -70,9 +71,8 @@ private:
 	// Member variables
 	FixedLine& m_line;
 	const DocumentWrapper& m_doc;
-	unsigned int m_maxWidth;
-	std::vector<unsigned int> m_textOffsets;
-	std::vector<unsigned int> m_lineWidths;
+	LineIndex m_lines;
+	std::vector<unsigned int> m_offsets; // only used by GetOffsets()
 
 private:
 	LineListNoWrap& operator = (const LineListNoWrap& other);
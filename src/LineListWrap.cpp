@@ -12,78 +12,65 @@
  ******************************************************************************/
 
 #include "LineListWrap.h"
-#include <algorithm>
 #include "Document.h"
 #include "FixedLine.h"
+#include <algorithm>
 
 // Initializing static constants
 const unsigned int LineListWrap::WINSIZE = 200;
+const unsigned int LineListWrap::MEASURECHUNK = 512*1024;
+const unsigned int LineListWrap::MEASURERANGE = 256;
+const unsigned int LineListWrap::MAXTHREADS = 4;
 
 LineListWrap::LineListWrap(FixedLine& l, const DocumentWrapper& dw):
-	line(l), m_doc(dw), lastValidOffset(0), lastValidPos(0),
-	firstLoadedPos(0), lastLoadedPos(0), offsetDiff(0), posDiff(0), avr_lineheight(0) {}
+	line(l), m_doc(dw), m_runner(wxMin(TaskRunner::GetDefaultThreadCount(), MAXTHREADS + 1)), // gui thread counts as one
+	m_noBackground(false), m_jobActive(false), m_jobCancelled(false), m_jobFirstLine(0), m_jobRangeCount(0), m_jobRangesDone(0) {}
+
+LineListWrap::~LineListWrap() {
+	// The threads may be in the middle of a range,
+	// so we have to wait for them to finish
+	CancelMeasuring();
+	m_runner.Wait();
+}
 
 unsigned int LineListWrap::offset(unsigned int index) {
-	wxASSERT(0 <= index && index < textOffsets.size());
+	wxASSERT(0 <= index && index < m_lines.size());
 
 	if (!index) return 0;
-
-	validate_offsets(index-1);
-	return textOffsets[index-1];
+	return m_lines.offset(index);
 }
 
 unsigned int LineListWrap::end(unsigned int index) {
-	wxASSERT(0 <= index && index < textOffsets.size());
-
-	validate_offsets(index);
-	return textOffsets[index];
+	wxASSERT(0 <= index && index < m_lines.size());
+	return m_lines.end(index);
 }
 
+// Lines that have not been laid out yet count with the average height of
+// the measured ones, so positions below them are approximations until
+// they get measured in prepare() or OnIdle().
 unsigned int LineListWrap::top(unsigned int index) {
-	wxASSERT(index == 0 || (0 < index && index < yPositions.size()));
-	
-	if (!index) return 0;
+	wxASSERT(index == 0 || (0 < index && index < m_lines.size()));
 
-	validate_positions(index-1);
-	return yPositions[index-1];
+	if (!index) return 0;
+	return m_lines.top(index);
 }
 
 unsigned int LineListWrap::bottom(unsigned int index) {
-	wxASSERT(0 <= index && index < yPositions.size());
-
-	validate_positions(index);
-	return yPositions[index];
+	wxASSERT(0 <= index && index < m_lines.size());
+	return m_lines.bottom(index);
 }
 
 unsigned int LineListWrap::size() const {
-	wxASSERT(textOffsets.size() == yPositions.size());
-
-	return textOffsets.size();
+	return m_lines.size();
 }
 
 unsigned int LineListWrap::last() const {
-	wxASSERT(textOffsets.size() == yPositions.size());
-	wxASSERT(!textOffsets.empty());
-
-	return textOffsets.size()-1;
+	wxASSERT(m_lines.size());
+	return m_lines.size()-1;
 }
 
 unsigned int LineListWrap::height() const {
-	if (yPositions.empty()) return 0;
-
-	wxASSERT(lastLoadedPos != 0);
-	wxASSERT(yPositions.size() == size());
-
-	if (lastLoadedPos < yPositions.size()) {
-		int last = yPositions[lastLoadedPos-1];
-		if (lastValidPos < lastLoadedPos) last += posDiff;
-
-		return last + approxBottom;
-	}
-	
-	if (lastValidPos < yPositions.size()) return yPositions.back() + posDiff;
-	
-	return yPositions.back();
+	return m_lines.height();
 }
 
 unsigned int LineListWrap::width() const {
@@ -93,930 +80,412 @@ unsigned int LineListWrap::width() const {
 };
 
 unsigned int LineListWrap::length() const {
-	if (textOffsets.empty()) return 0;
-
-	if (lastValidOffset < textOffsets.size()) return textOffsets.back() + offsetDiff;
-	else return textOffsets.back();
-}
-
-void LineListWrap::add_line(int end) {
-	wxASSERT(!textOffsets.size() || end > (int)textOffsets.back());
-	wxASSERT(firstLoadedPos == 0 && lastLoadedPos == 0);
-
-	textOffsets.push_back(end);
+	return m_lines.length();
 }
 
+// The offsets are kept in the tree, so this is a copy. If it is
+// modified, NewOffsets() has to be called to put it into effect.
 vector<unsigned int>& LineListWrap::GetOffsets() {
-	return textOffsets;
+	m_lines.get_ends(m_offsets);
+	return m_offsets;
 }
 
 void LineListWrap::SetOffsets(const vector<unsigned int>& offsets) {
-	wxASSERT(lastValidOffset == 0); // LineList has to be cleared first
+	wxASSERT(m_lines.size() == 0); // LineList has to be cleared first
 
-	textOffsets = offsets;
-
-	if (textOffsets.size() != yPositions.size()) yPositions.resize(textOffsets.size());
-	lastValidOffset = textOffsets.size();
+	CancelMeasuring();
+	m_lines.assign(offsets);
+	m_lines.set_approx_height(wxMax((unsigned int)line.GetCharHeight(), 1u));
 }
 
 // You have to call this after textOffsets heve been modified using GetOffsets()
 void LineListWrap::NewOffsets() {
-	wxASSERT(lastValidOffset == 0);
-	if (textOffsets.size() != yPositions.size()) yPositions.resize(textOffsets.size());
-	lastValidOffset = textOffsets.size();
+	CancelMeasuring();
+	m_lines.assign(m_offsets);
+	vector<unsigned int>().swap(m_offsets); // release memory
 
 	invalidate();
 }
 
 void LineListWrap::insert(unsigned int index, int newend) {
-	// WARNING: ll only valid upto index
-	wxASSERT(index >= 0 && index <= textOffsets.size());
+	wxASSERT(index >= 0 && index <= m_lines.size());
 	wxASSERT(newend <= (int)m_doc.GetLength());
 
-	if (index) {
-		validate_offsets(index-1);
-		validate_positions(index-1);
-	}
-	wxASSERT(!index || newend > (int)end(index-1));
-
-	// Insert the text
-	textOffsets.insert(textOffsets.begin()+index, newend);
-
-	// Update the offsets
-	if (lastValidOffset > index) ++lastValidOffset; // pushed down by insertion
-	update_offsetDiff(index, newend - (index ? textOffsets[index-1] : 0));
-
-	// The height of the line depends on the markup, so for now we just
-	// set it to the unwrapped height. It will be updated when it has been
-	// syntax highlighted.
-	if (index) yPositions.insert(yPositions.begin()+index, yPositions[index-1] + line.GetCharHeight());
-	else yPositions.insert(yPositions.begin()+index, line.GetCharHeight());
-
-	// Extend the loaded positions window
-	if (lastLoadedPos == 0) {
-		wxASSERT(firstLoadedPos == 0);
-		//firstLoadedPos = 0;
-		lastLoadedPos = 1;
-	}
-	else {
-		wxASSERT(lastLoadedPos >= index);
-		++lastLoadedPos;
-	}
-
-	// Update the positions
-	if (lastValidPos > index) ++lastValidPos; // pushed down by insertion
-	update_posDiff(index, line.GetCharHeight());
+	const unsigned int lineStart = index ? m_lines.end(index-1) : 0;
+	wxASSERT(!index || newend > (int)lineStart);
 
-	recalc_approx();
-
-	wxASSERT(lastValidPos > firstLoadedPos && lastValidPos <= lastLoadedPos);
-	wxASSERT(lastValidPos < yPositions.size() || posDiff == 0);
+	// The height of the line depends on the markup, so for now it
+	// is left unmeasured. It will be updated when it has been
+	// syntax highlighted (or during idle time).
+	CancelMeasuring();
+	m_lines.insert(index, newend - lineStart);
 }
 
 void LineListWrap::insertlines(unsigned int index, vector<unsigned int>& newlines) {
-	// WARNING: ll only valid upto index
-	wxASSERT(index >= 0 && index <= textOffsets.size());
+	wxASSERT(index >= 0 && index <= m_lines.size());
 	wxASSERT(!newlines.empty());
 
-	if (index) {
-		validate_offsets(index-1);
-		validate_positions(index-1);
+	// Convert to line lengths
+	vector<unsigned int> lengths(newlines.size());
+	unsigned int lineStart = index ? m_lines.end(index-1) : 0;
+	for (unsigned int i = 0; i < newlines.size(); ++i) {
+		lengths[i] = newlines[i] - lineStart;
+		lineStart = newlines[i];
 	}
 
-	// Insert the lines
-	textOffsets.insert(textOffsets.begin()+index, newlines.begin(), newlines.end());
-
-	// Update the offsets
-	if (lastValidOffset > index) lastValidOffset += newlines.size(); // pushed down by insertion
-	update_offsetDiff(index + newlines.size()-1, newlines.back() - (index ? textOffsets[index-1] : 0));
-
-	// Extend the yPositions to match
-	yPositions.insert(yPositions.begin()+index, newlines.size(), 0);
-
-	// Set the positions
-	int textstart = 0, ypos = 0;
-	if (index) {
-		textstart = textOffsets[index-1];
-		ypos = yPositions[index-1];
-	}
-	for (unsigned int i = index ; i < index + newlines.size(); ++i) {
-		// The height of the line depends on the markup, so for now we just
-		// set it to the unwrapped height. It will be updated when it has been
-		// syntax highlighted.
-		yPositions[i] = ypos += line.GetCharHeight();
-		textstart = textOffsets[i];
-	}
-	
-	int last_index = index + newlines.size()-1;
-
-	// Extend l-window to hold new lines
-	if (lastLoadedPos == 0) {
-		wxASSERT(firstLoadedPos == 0);
-		//firstLoadedPos = 0;
-		lastLoadedPos = last_index+1;
-	}
-	else {
-		wxASSERT(lastLoadedPos >= index);
-		lastLoadedPos += newlines.size();
-	}
-
-	// Update the positions
-	if (lastValidPos > index) lastValidPos += newlines.size(); // pushed down by insertion
-	update_posDiff(last_index, ypos - (index ? yPositions[index-1] : 0));
-
-	recalc_approx();
-
-	wxASSERT(lastValidPos > firstLoadedPos && lastValidPos <= lastLoadedPos);
-	wxASSERT(lastValidPos < yPositions.size() || posDiff == 0);
+	CancelMeasuring();
+	m_lines.insert(index, lengths);
 }
 
 void LineListWrap::update(unsigned int index, unsigned int newend) {
-	//wxLogDebug("update %u %u", index, newend);
-	//wxLogDebug("  fLoaded=%u lValid=%u lLoaded=%u", firstLoadedPos, lastValidPos, lastLoadedPos);
+	wxASSERT(index >= 0 && index < m_lines.size());
 
-	// WARNING: ll only valid upto index
-	wxASSERT(index >= 0 && index < textOffsets.size());
-	//wxASSERT(newend <= m_doc.GetLength());
-	
-	validate_offsets(index);
-	if (index) validate_positions(index-1);
-
-	// Set the text
-	int tdiff = newend - textOffsets[index];
-	textOffsets[index] = newend;
-	update_offsetDiff(index, tdiff);
+	// Changing the length moves all following offsets
+	CancelMeasuring();
+	m_lines.set_length(index, newend - offset(index));
 
 	// The height of the line depends on the markup, so for now we just keep
 	// the old height. It will be updated when it has been syntax highlighted.
 }
 
 void LineListWrap::update_parsed_line(unsigned int index) {
-	wxASSERT(index < textOffsets.size());
-
-	// Only update if line is in_window or just beyond
-	if (index >= firstLoadedPos && index <= lastLoadedPos) {
-		// Recalculate line height
-		line.SetLine(index ? textOffsets[index-1] : 0, textOffsets[index]);
-		const unsigned int line_height = line.GetHeight();
-		const unsigned int top_xpos = index ? yPositions[index-1] : 0;
-
-		if (index == lastLoadedPos) {
-			yPositions[index] = top_xpos + line_height;
-			++lastLoadedPos;
-			recalc_approx();
-		}
-		else {
-			// Get the diffs
-			unsigned int bottom_xpos = yPositions[index];
-			if (index >= lastValidPos) {
-				bottom_xpos += posDiff;
-			}
-			const unsigned int old_height = bottom_xpos - top_xpos;
-			//wxLogDebug("  old_height=%d posDiff=%d top_xpos=%d bottom_xpos=%d", old_height, posDiff, top_xpos, bottom_xpos);
-			
-			// Update position
-			if (line_height != old_height || index >= lastValidPos) {
-				yPositions[index] = top_xpos + line_height;
-				update_posDiff(index, line_height - old_height);
-
-				wxASSERT((bottom(index) - top(index)) == line_height);
-
-				recalc_approx();
-			}
-		}
+	wxASSERT(index < m_lines.size());
 
-		wxASSERT(lastValidPos > firstLoadedPos && lastValidPos <= lastLoadedPos);
-		wxASSERT(lastValidPos < yPositions.size() || posDiff == 0);
-	}
+	// Lines that have not been laid out yet will get measured later
+	if (m_lines.line_height(index) == 0) return;
+
+	// Recalculate line height
+	const unsigned int lineStart = offset(index);
+	line.SetLine(lineStart, lineStart + m_lines.line_length(index));
+	set_measured_height(index, line.GetHeight());
 }
 
 void LineListWrap::update_line_extent(unsigned int index, unsigned int extent) {
-	wxASSERT(index < textOffsets.size());
-
-	// Only update if line is in_window or just beyond
-	if (index >= firstLoadedPos && index <= lastLoadedPos) {
-		// Make sure the positions we need are valid
-		if (index >= lastValidPos) {
-			const size_t end = index+1;
-			for (size_t i = lastValidPos; i < end; ++i) {
-				yPositions[i] += posDiff;
-			}
-			lastValidPos = end;
-			if (lastValidPos == yPositions.size()) posDiff = 0;
-		}
-
-		const unsigned int top_ypos = index ? yPositions[index-1] : 0;
-
-		if (index == lastLoadedPos) {
-			yPositions[index] = top_ypos + extent;
-			++lastLoadedPos;
-			recalc_approx();
-		}
-		else {
-			// Get the diffs
-			const unsigned int bottom_ypos = yPositions[index];
-			const unsigned int old_height = bottom_ypos - top_ypos;
-			//wxLogDebug("  old_height=%d posDiff=%d top_xpos=%d bottom_xpos=%d", old_height, posDiff, top_xpos, bottom_xpos);
-			
-			// Update position
-			if (extent != old_height || index >= lastValidPos) {
-				yPositions[index] = top_ypos + extent;
-				update_posDiff(index, extent - old_height);
-
-				wxASSERT((bottom(index) - top(index)) == extent);
-
-				recalc_approx();
-			}
-		}
-
-		wxASSERT(lastValidPos > firstLoadedPos && lastValidPos <= lastLoadedPos);
-		wxASSERT(lastValidPos < yPositions.size() || posDiff == 0);
-	}
-	verify();
+	wxASSERT(index < m_lines.size());
+	set_measured_height(index, extent);
 }
 
 void LineListWrap::remove(unsigned int startline, unsigned int endline) {
-	//wxLogDebug("remove %u %u", startline, endline);
-	//wxLogDebug("  fLoaded=%u lValid=%u lLoaded=%u", firstLoadedPos, lastValidPos, lastLoadedPos);
-	// WARNING: ll only valid upto startline
-	wxASSERT(startline >= 0 && startline < textOffsets.size());
-	wxASSERT(endline > startline && endline <= textOffsets.size());
+	wxASSERT(startline >= 0 && startline < m_lines.size());
+	wxASSERT(endline > startline && endline <= m_lines.size());
 	wxASSERT(size());
 
-	// Check if we are deleting the entire text
-	if (startline == 0 && endline == size()) {
-		clear();
-		return;
-	}
-
-	// Validate offsets up-to end of deletion (needed for diff)
-	validate_offsets(endline-1);
-	
-	if (startline) extendwindow(startline-1); // Make sure pos-win reaches top of deletion
-
-	// Remove text lines
-	int diff = offset(startline) - end(endline-1);
-	textOffsets.erase(textOffsets.begin()+startline, textOffsets.begin()+endline);
-	
-	// update offsets
-	wxASSERT(lastValidOffset >= endline - startline);
-	lastValidOffset -= endline - startline;
-	if (startline) update_offsetDiff(startline-1, diff);
-	else {
-		// Top line have been removed, so we have to update the new top
-		wxASSERT(!textOffsets.empty());
-		if (lastValidOffset == 0) textOffsets[0] += offsetDiff;
-		textOffsets[0] += diff;
-		update_offsetDiff(startline, diff);
-	}
-
-	if (startline >= lastLoadedPos) {
-		// We can delete positions without having to think about the pos-window
-		yPositions.erase(yPositions.begin()+startline, yPositions.begin()+endline);
-	}
-	else if (endline <= lastLoadedPos) {
-		// Calculate a diff on positions
-		int top_ypos = startline ? yPositions[startline-1] : 0;
-		if (startline > lastValidPos) top_ypos += posDiff;
-		int bottom_ypos = yPositions[endline-1];
-		if (endline > lastValidPos) bottom_ypos += posDiff;
-
-		int pdiff = top_ypos - bottom_ypos;
-
-		// resize l-window
-		if (startline <= firstLoadedPos && endline >= lastLoadedPos) {
-			firstLoadedPos = 0;
-			lastLoadedPos = 0;
-			lastValidPos = 0;
-		}
-		else if (startline >= firstLoadedPos) {
-			wxASSERT(startline < lastLoadedPos);
-			lastLoadedPos -= endline - startline; 
-		}
-		else wxASSERT(false);
-
-		// Remove position lines
-		yPositions.erase(yPositions.begin()+startline, yPositions.begin()+endline);
-		
-		// FIX: update lastValidPos upto startline
-		while (lastValidPos < startline) {
-			yPositions[lastValidPos] += posDiff;
-			++lastValidPos;
-		}
-		if (lastValidPos == yPositions.size()) posDiff = 0; // update complete
-		if (lastValidPos > startline) { // Have lastValidPos been moved?
-			if (lastValidPos <= endline) lastValidPos = startline;
-			else lastValidPos -= endline - startline;
-		}
-
-		if (startline) update_posDiff(startline-1, pdiff);
-		else {
-			// Top line have been removed, so we have to update the new top
-			wxASSERT(!yPositions.empty());
-			if (lastValidPos == 0) yPositions[0] += posDiff;
-			yPositions[0] += pdiff;
-			update_posDiff(startline, pdiff);
-		}
-	}
-	else {
-		// Overlap: We have to truncate pos-win
-		lastLoadedPos = startline;
-		if (lastValidPos > startline) {
-			lastValidPos = startline;
-			posDiff = 0;
-		}
-
-		// Remove position lines
-		yPositions.erase(yPositions.begin()+startline, yPositions.begin()+endline);
-	}
-
-	recalc_approx();
-
-	wxASSERT(lastValidPos > firstLoadedPos && lastValidPos <= lastLoadedPos);
-	wxASSERT(lastValidPos < yPositions.size() || posDiff == 0);
+	// Following lines keep their lengths and heights, so they move up
+	CancelMeasuring();
+	m_lines.erase(startline, endline);
 }
 
 void LineListWrap::clear() {
-	textOffsets.clear();
-	yPositions.clear();
-
-	lastValidOffset = 0;
-	lastValidPos = 0;
-	firstLoadedPos = 0;
-	lastLoadedPos = 0;
-	offsetDiff = 0;
-	posDiff = 0;
-	avr_lineheight = 0;
+	CancelMeasuring();
+	m_lines.clear();
+	vector<unsigned int>().swap(m_offsets);
 }
 
 bool LineListWrap::IsLineEnd(unsigned int pos) {
 	if (!size()) return false;
-	validate_offsets(size()-1);
-	wxASSERT(pos <= textOffsets.back());
+	wxASSERT(pos <= m_lines.length());
 
-	vector<unsigned int>::const_iterator posline = lower_bound(textOffsets.begin(), textOffsets.end(), pos);
-	return (pos == *posline);
+	const unsigned int posline = m_lines.find_offset(pos);
+	return (pos == m_lines.end(posline));
 }
 
 unsigned int LineListWrap::EndFromPos(unsigned int pos) {
-	if (!textOffsets.size()) return 0;
-	validate_offsets(textOffsets.size()-1);
-	wxASSERT(pos <= textOffsets.back());
+	if (!size()) return 0;
+	wxASSERT(pos <= m_lines.length());
 
-	vector<unsigned int>::const_iterator posline = lower_bound(textOffsets.begin(), textOffsets.end(), pos);
-	if (pos != *posline) return *posline;
-	return pos == textOffsets.back() ? pos : *(++posline);
+	const unsigned int posline = m_lines.find_offset(pos);
+	const unsigned int lineend = m_lines.end(posline);
+	if (pos != lineend) return lineend;
+	return pos == m_lines.length() ? pos : lineend + m_lines.line_length(posline+1);
 }
 
 unsigned int LineListWrap::StartFromPos(unsigned int pos) {
-	if (!textOffsets.size()) return 0;
-	validate_offsets(textOffsets.size()-1);
-	wxASSERT(pos <= textOffsets.back());
+	if (!size()) return 0;
+	wxASSERT(pos <= m_lines.length());
 
-	vector<unsigned int>::const_iterator posline = lower_bound(textOffsets.begin(), textOffsets.end(), pos);
-	if (pos == *posline) return pos;
-	return (posline == textOffsets.begin()) ? 0 : *(--posline);
+	const unsigned int posline = m_lines.find_offset(pos);
+	const unsigned int linestart = m_lines.offset(posline);
+	if (pos == linestart + m_lines.line_length(posline)) return pos;
+	return linestart;
 }
 
 int LineListWrap::find_offset(int pos) {
 	if (!size()) return 0;
-	validate_offsets(size()-1);
-	wxASSERT(0 <= pos && pos <= (int)textOffsets.back());
+	wxASSERT(0 <= pos && pos <= (int)m_lines.length());
 
-	vector<unsigned int>::iterator posline = lower_bound(textOffsets.begin(), textOffsets.end(), (unsigned int)pos);
-	return distance(textOffsets.begin(), posline);
+	return m_lines.find_offset(pos);
 }
 
 int LineListWrap::find_ypos(unsigned int ypos) {
 	wxASSERT(ypos >= 0 && ypos <= height());
-	wxASSERT(approxTop >= 0);
-	verify();
 
 	if (!size()) return 0;
-	wxASSERT(lastLoadedPos != 0 && firstLoadedPos < lastLoadedPos);
-
-	bool do_approx = true;
-
-	while (1) {
-		// Often we want one just above or below current window
-		if (ypos < (unsigned int)approxTop) {
-			// Expand window up a bit
-			int recalc = extendwindow(uMinus(firstLoadedPos, WINSIZE/2));
-
-			unsigned int new_ypos = uPluss(ypos, recalc);
-			new_ypos = wxMin(new_ypos, height());
-			if (new_ypos >= (unsigned int)approxTop) ypos = new_ypos;
-		}
-		else if (lastValidPos && ypos > yPositions[lastValidPos-1]) {
-			// Expand window down a bit
-			int recalc = extendwindow(wxMin(last(), lastLoadedPos+(WINSIZE/2)));
-			wxASSERT(recalc == 0); // there should be no change of approxTop
-		}
-
-		if (ypos >= (unsigned int)approxTop) {
-			validate_positions(lastLoadedPos-1); // Make sure lastValidPos is at end of window
-			wxASSERT(lastValidPos > 0);
-
-			if (ypos <= yPositions[lastValidPos-1]) { // ypos is inside window
-				vector<unsigned int>::iterator posline = lower_bound(yPositions.begin() + firstLoadedPos, yPositions.begin() + lastValidPos, (unsigned int)ypos);
-				int index = distance(yPositions.begin(), posline);
-				wxASSERT(top(index) <= ypos);
-				return index;
-			}
-			else if (lastValidPos == size()) return last(); // recalc of positions may end up with pos outside text
-		}
-
-		// Else we have to find the approximate line
-		if (do_approx) {
-			wxASSERT(avr_lineheight > 0);
-			unsigned int index = ypos / avr_lineheight;
-			index = wxMin(index, last());
-			extendwindow(index);
-			do_approx = false; // only try to approximate once
-		}
-	}
-
-	wxASSERT(false); // We should never reach here
-	return 0; 
+	return wxMin(m_lines.find_ypos(ypos), last());
 }
 
 void LineListWrap::invalidate(int index) {
-	// Width has changed, recalc new window
-	firstLoadedPos = 0;
-	lastLoadedPos = 0;
-	lastValidPos = 0;
-	approxBottom = 0;
-	approxTop = 0;
-	posDiff = 0;
-	avr_lineheight = 0;
-	if (index > 100) {
-		// We need the index to keep the right line in focus
-		extendwindow(index);
-		verify();
-	}
-	else initwindow();
-}
-
-void LineListWrap::validate_offsets(unsigned int index) {
-	wxASSERT(index >= 0 && index < textOffsets.size());
-	wxASSERT(lastValidOffset >= 0 || textOffsets.empty()); 
-	wxASSERT(lastValidOffset < textOffsets.size() || offsetDiff == 0);
-
-	if (index >= lastValidOffset && !textOffsets.empty()) {
-		vector<unsigned int>::iterator i2 = textOffsets.begin() + index;
-		for (vector<unsigned int>::iterator i = textOffsets.begin()+lastValidOffset; i <= i2; ++i) {
-			*i += offsetDiff;
-		}
-		lastValidOffset = index+1;
+	// Width has changed, so all lines have to be measured again
+	CancelMeasuring();
+	m_lines.clear_heights();
+	m_lines.set_approx_height(wxMax((unsigned int)line.GetCharHeight(), 1u));
+	if (!size() || !line.IsValid()) return;
 
-		// Check if everything is updated
-		wxASSERT(lastValidOffset <= textOffsets.size());
-		if (lastValidOffset == textOffsets.size()) {
-			offsetDiff = 0;
-		}
-	}
+	// Measure the lines around index, so that it is placed as correctly as
+	// possible. The rest of the lines are measured during idle time.
+	const unsigned int focus = wxMin((unsigned int)index, last());
+	measure(uMinus(focus, WINSIZE/2), wxMin(focus + WINSIZE, size()));
+	update_approx();
 }
 
-void LineListWrap::validate_positions(unsigned int index) {
-	wxASSERT(index >= 0 && index < yPositions.size());
-	wxASSERT(lastValidPos > firstLoadedPos && lastValidPos <= lastLoadedPos);
-	wxASSERT(lastValidPos < yPositions.size() || posDiff == 0);
+void LineListWrap::measure(unsigned int first, unsigned int last) {
+	if (!line.IsValid()) return;
 
-	// Extend window to include index
-	extendwindow(index);
-
-	if (index >= lastValidPos) {
-		vector<unsigned int>::iterator i2 = yPositions.begin() + index;
-		for (vector<unsigned int>::iterator i = yPositions.begin()+lastValidPos; i <= i2; ++i) {
-			*i += posDiff;
+	unsigned int lineStart = offset(first);
+	for (unsigned int i = first; i < last; ++i) {
+		const unsigned int lineEnd = lineStart + m_lines.line_length(i);
+		if (m_lines.line_height(i) == 0) {
+			set_measured_height(i, line.GetQuickLineHeight(lineStart, lineEnd));
 		}
-
-		lastValidPos = index+1;
-
-		// Check if everything is updated
-		if (lastValidPos >= yPositions.size()) posDiff = 0;
+		lineStart = lineEnd;
 	}
 }
 
-void LineListWrap::update_offsetDiff(unsigned int index, int diff) {
-	// index is to the offset just updated
-	wxASSERT(index >= 0 && index < textOffsets.size());
-
-	// Check if everything is updated
-	if (lastValidOffset == textOffsets.size()) {
-		wxASSERT(offsetDiff == 0);
-		if (index == textOffsets.size()-1) offsetDiff = 0;
-		else if (diff != 0) {
-			offsetDiff = diff;
-			lastValidOffset = index+1;
-		} 
-		return;
-	}
-
-	if (index+1 < lastValidOffset) {
-		// update up-to and including lastValidOffset
-		for (++index; index < lastValidOffset; ++index) {
-			textOffsets[index] += diff;
-			wxASSERT(textOffsets[index] <= m_doc.GetLength());
+void LineListWrap::measure_exact(unsigned int first, unsigned int last) {
+	unsigned int lineStart = offset(first);
+	for (unsigned int i = first; i < last; ++i) {
+		const unsigned int lineEnd = lineStart + m_lines.line_length(i);
+		if (m_lines.line_height(i) == 0) {
+			line.SetLine(lineStart, lineEnd);
+			set_measured_height(i, line.GetHeight());
 		}
+		lineStart = lineEnd;
 	}
-	else if (index >= lastValidOffset) {
-		// We know that index is updated
-		lastValidOffset = index+1;
-	}
-
-	if (lastValidOffset < textOffsets.size()) offsetDiff += diff;
-	else offsetDiff = 0;
 }
 
-void LineListWrap::update_posDiff(unsigned int index, int diff) {
-	//wxLogDebug("update_posDiff %u %d", index, diff);
-	//wxLogDebug("  fLoaded=%u lValid=%u lLoaded=%u", firstLoadedPos, lastValidPos, lastLoadedPos);
-
-	// index is to the position just updated
-	wxASSERT(index >= 0 && index < yPositions.size());
+void LineListWrap::set_measured_height(unsigned int index, unsigned int height) {
+	// Zero is used to mark unmeasured lines
+	m_lines.set_height(index, height ? height : wxMax((unsigned int)line.GetCharHeight(), 1u));
+}
 
-	// Check if everything is updated
-	if (lastValidPos == yPositions.size()) {
-		wxASSERT(posDiff == 0);
-		if (index == yPositions.size()-1) posDiff = 0;
-		else if (diff != 0) {
-			posDiff = diff;
-			lastValidPos = index+1;
-		}
-		return;
-	}
-	
-	if (index+1 < lastValidPos) {
-		// update up-to lastValidPos
-		for (++index; index < lastValidPos; ++index) {
-			yPositions[index] += diff;
-		}
-	}
-	else if (index >= lastValidPos) {
-		// We know that index is updated
-		lastValidPos = index+1;
-	}
+void LineListWrap::update_approx() {
+	const unsigned int measured = m_lines.size() - m_lines.unmeasured();
 
-	if (lastValidPos < lastLoadedPos) posDiff += diff;
-	else posDiff = 0;
+	if (measured) m_lines.set_approx_height(wxMax(m_lines.measured_height() / measured, 1u));
+	else m_lines.set_approx_height(wxMax((unsigned int)line.GetCharHeight(), 1u));
 }
 
 void LineListWrap::Print() {
 	wxLogDebug(wxT("\nLineList len=%d"), size());
-	wxLogDebug(wxT(" lastValidOffset: %u"), lastValidOffset);
-	wxLogDebug(wxT(" lastValidPos:    %u"), lastValidPos);
-	wxLogDebug(wxT(" firstLoadedPos:    %u"), firstLoadedPos);
-	wxLogDebug(wxT(" lastLoadedPos:    %u"), lastLoadedPos);
-	wxLogDebug(wxT(" offsetDiff:    %d"), offsetDiff);
-	wxLogDebug(wxT(" posDiff:    %d"), posDiff);
-	wxLogDebug(wxT(" approxTop:   %d"), approxTop);
+	wxLogDebug(wxT(" unmeasured: %u"), m_lines.unmeasured());
+	wxLogDebug(wxT(" approx:     %u"), m_lines.approx_height());
 	wxLogDebug(wxT(" height:     %u"), height());
-	if (lastLoadedPos == 0) wxLogDebug(wxT("  _linelist: %d-%d"), firstLoadedPos, lastLoadedPos);
-	else wxLogDebug(wxT("  linelist: %d %d (%d-%d -> %d-%d) %u"), lastValidOffset, lastValidPos, firstLoadedPos, lastLoadedPos, approxTop, yPositions[lastLoadedPos-1], height());
-	
+
 	for (unsigned int i = 0; i < size(); ++i) {
-		wxLogDebug(wxT("  %u: %u %u"), i, textOffsets[i], yPositions[i]);
+		wxLogDebug(wxT("  %u: %u %u"), i, m_lines.end(i), m_lines.bottom(i));
 	}
 }
 
-void LineListWrap::initwindow() {
-	if (!size()) return;
-
-	if (line.IsValid()) {
-		unsigned int endline = wxMin(100, size());
-		unsigned int top = 0;
+int LineListWrap::prepare(int ypos) {
+	verify();
 
-		for (unsigned int i = 0; i < endline; ++i) {
-			top = yPositions[i] = top + line.GetQuickLineHeight(offset(i), end(i));
-		}
+	if (!size()) return 0;
 
-		firstLoadedPos = 0;
-		lastLoadedPos = endline;
-		lastValidPos = endline;
+	if (ypos == -1) {
+		// Make sure the end of the text is laid out
+		measure(uMinus(size(), WINSIZE), size());
+		update_approx();
+		return 0;
+	}
 
-		// Calculate approximate height of space under window
-		if (endline < size()) {
-			avr_lineheight = top / endline;
-			approxBottom = (size() - endline) * avr_lineheight;
-		}
-		else approxBottom = 0;
+	// Measuring the lines above ypos (and updating the approximation)
+	// may move it, so we return the diff to let the caller adjust
+	const unsigned int topline = find_ypos(ypos);
+	const unsigned int oldTop = top(topline);
 
-		verify(true);
-	}
-	else {
-		// Fill positions with height of unwrapped lines
-		unsigned int ypos = 0;
-		const unsigned int charheight = line.GetCharHeight();
-		for (vector<unsigned int>::iterator p = yPositions.begin(); p != yPositions.end(); ++p) {
-			ypos += charheight;
-			*p = ypos;
-		}
+	// adjust ypos a bit so we are sure to get the line above as well
+	const unsigned int firstline = find_ypos(uMinus(ypos, 100));
+	measure(firstline, wxMin(topline + WINSIZE, size()));
+	update_approx();
 
-		firstLoadedPos = 0;
-		lastLoadedPos = lastValidPos = size();
-		avr_lineheight = charheight;
-	}
+	return (int)top(topline) - (int)oldTop;
 }
 
-int LineListWrap::extendwindow(unsigned int index) {
-	wxASSERT(index >= 0 && index < yPositions.size());
-
-	if (size() == 0) return 0;
-	if (index >= firstLoadedPos && index < lastLoadedPos) return 0; // in window
-
-	// Check if we can extend current window
-	if (index < firstLoadedPos) { // Index above window
-		if (WINSIZE > firstLoadedPos || index > firstLoadedPos-WINSIZE) {
-			// extend window to index
-			index = uMinus(firstLoadedPos, WINSIZE); // do a full block
-
-			// Load positions in extension
-			unsigned int line_bottom = 0;
-			for (unsigned int i = index; i < firstLoadedPos; ++i) {
-				line_bottom = yPositions[i] = line_bottom + line.GetQuickLineHeight(offset(i), end(i));
-			}
-
-			// Calculate new approxTop
-			unsigned int new_approxTop = 0;
-			if (index) {
-				unsigned int loadedheight = yPositions[lastLoadedPos-1] - (firstLoadedPos ? yPositions[firstLoadedPos] : 0);
-				avr_lineheight = (yPositions[firstLoadedPos-1] + loadedheight) / (lastLoadedPos - index);
-				new_approxTop = index * avr_lineheight;
-			}
-
-			// Adjust all positions to new approxTop
-			int ext_diff = line_bottom - approxTop;
-			for (unsigned int i2 = index; i2 < lastLoadedPos; ++i2) {
-				yPositions[i2] += new_approxTop;
-				if (i2 >= firstLoadedPos) yPositions[i2] += ext_diff;
-			}
-
-			approxTop = new_approxTop;
-			firstLoadedPos = index;
-			recalc_approx();
-			return ext_diff;
-		}
-	}
-	else { // Index below window
-		if (lastLoadedPos != 0 && index+1 < lastLoadedPos+WINSIZE) {
-			// extend window to index
-			//index = wxMin(last(), lastLoadedPos+WINSIZE); // do a full block
-			int top = yPositions[lastLoadedPos-1];
-			for (unsigned int i = lastLoadedPos; i <= index; ++i) {
-				yPositions[i] = top += line.GetQuickLineHeight(offset(i), end(i));
-			}
-			if (lastValidPos == lastLoadedPos) lastValidPos = index+1;
-			lastLoadedPos = index+1;
-
-			return recalc_approx(); // recalc approximations (below only)
-		}
-	}
+bool LineListWrap::in_window(unsigned int pos) {
+	if (pos == 0 && size() == 0) return true;
+	wxASSERT(size());
 
-	// We have to create a new window
-	// The window can't go beyond index
-	approxDiff = 0;
-	int endline = index;
-	index = uMinus(index, WINSIZE);
-
-	int top = 0; 
-	if (avr_lineheight > 0) top = approxTop = index * avr_lineheight;
-	else wxASSERT(approxTop == 0);
-	for (int i = index; i <= endline; ++i) {
-		top = yPositions[i] = top + line.GetQuickLineHeight(offset(i), end(i));
-	}
-	firstLoadedPos = index;
-	lastValidPos =lastLoadedPos = endline+1;
+	const unsigned int index = find_offset(pos);
+	return m_lines.line_height(index) != 0;
+}
 
-	wxASSERT(lastValidPos > firstLoadedPos && lastValidPos <= lastLoadedPos);
-	wxASSERT(lastValidPos < yPositions.size() || posDiff == 0);
+bool LineListWrap::NeedIdle() const {
+	if (!line.IsValid()) return false;
 
-	return recalc_approx(true); // recalc approximations;
+	// The measure threads wake us up when they are done
+	if (m_jobActive) return !IsMeasuring();
+	return m_lines.unmeasured() != 0;
 }
 
-int LineListWrap::recalc_approx(bool movetop) {
-	wxASSERT(lastLoadedPos != 0 && firstLoadedPos < lastLoadedPos);
+int LineListWrap::OnIdle() {
+	if (!size() || !line.IsValid()) return 0;
+	const unsigned int oldHeight = height();
 
-	unsigned int firsttop = firstLoadedPos > 0 ? yPositions[firstLoadedPos] : 0;
-	if (lastLoadedPos > firstLoadedPos) {
-		avr_lineheight = (yPositions[lastLoadedPos-1] - firsttop) / (lastLoadedPos - firstLoadedPos);
+	// Merge in the heights from the measure threads
+	unsigned int fallback = size();
+	if (m_jobActive) {
+		if (IsMeasuring()) return 0;
+		fallback = ApplyMeasurements();
 	}
-	else avr_lineheight = line.GetCharHeight();
 
-	if (lastLoadedPos == size()) approxBottom = 0;
-	else {
-		wxASSERT(lastLoadedPos < size());
-		approxBottom = (size() - lastLoadedPos) * avr_lineheight;
+	// Lines that can not be broken without the dc (and all lines with
+	// proportional fonts) are laid out here. The rest is handed over
+	// to the measure threads.
+	unsigned int first = m_lines.find_unmeasured();
+	if (first < size() && (first == fallback || m_noBackground || !line.GetLineBreaker().IsValid())) {
+		measure_exact(first, wxMin(first + 100, size()));
+		first = m_lines.find_unmeasured();
 	}
+	if (first < size()) StartMeasuring(first);
+	update_approx();
 
-	// Move top of window to fit with new approxTop
-	if (movetop) {
-		unsigned int new_approxTop = 0;
-		if (firstLoadedPos)	new_approxTop = firstLoadedPos * avr_lineheight;
-		wxASSERT(new_approxTop >= 0);
-
-		//line.SetLine(offset(firstLoadedPos), end(firstLoadedPos));
-		//wxASSERT((int)(yPositions[firstLoadedPos] - approxTop) == line.GetHeight());
+	verify();
+	return height() - oldHeight;
+}
 
-		int apr_diff = new_approxTop - approxTop;
-		wxASSERT(apr_diff >= 0 || -apr_diff <= (int)yPositions[firstLoadedPos]);
-		
-		for (unsigned int i = firstLoadedPos; i < lastLoadedPos; ++i) {
-			yPositions[i] += apr_diff;
-		}
-		wxASSERT(yPositions[firstLoadedPos] >= 0);
-		//wxASSERT((int)(yPositions[firstLoadedPos] - new_approxTop) == line.GetHeight());
-		wxASSERT(new_approxTop >= 0 && new_approxTop < yPositions[firstLoadedPos]);
+bool LineListWrap::StartMeasuring(unsigned int first) {
+	wxASSERT(first < size());
+	if (m_noBackground || m_jobActive) return false;
 
-		approxTop = new_approxTop;
+	const LineBreaker& breaker = line.GetLineBreaker();
+	if (!breaker.IsValid()) return false;
 
-		approxDiff += apr_diff;
-		return apr_diff;
+	// Find the next chunk of lines (at least one)
+	const unsigned int start = offset(first);
+	unsigned int len = 0;
+	unsigned int last = first;
+	m_jobStarts.clear();
+	while (last < size() && (len < MEASURECHUNK || last == first)) {
+		m_jobStarts.push_back(len);
+		len += m_lines.line_length(last);
+		++last;
 	}
-	else return 0; // No change of approxTop
-}
+	m_jobStarts.push_back(len);
+	if (len == 0) return false;
 
-int LineListWrap::prepare(int ypos) {
-	verify();
+	// Take a snapshot of the text
+	cxLOCKDOC_READ(m_doc)
+		doc.GetTextPart(start, start + len, m_jobText);
+	cxENDLOCK
 
-	approxDiff = 0;
-	if (!size()) return 0;
+	m_jobBreaker = breaker;
+	m_jobFirstLine = first;
+	m_jobCancelled = false;
+	m_jobMissing.clear();
+	m_jobHeights.assign(last - first, 0);
+	m_jobRangesDone = 0;
 
-	if (ypos == -1) {
-		validate_positions(last());
-	}
-	else {
-		// adjust ypos a bit so we are sure to get the line above as well
-		find_ypos(uMinus(ypos, 100));
+	// The lines are measured in short ranges, so that the job is shared between all threads
+	m_jobRangeCount = (last - first + MEASURERANGE - 1) / MEASURERANGE;
+	if (!m_runner.Add(m_jobRangeCount, OnMeasureRange, this)) {
+		wxLogDebug(wxT("LineListWrap: Could not start measure threads"));
+		m_noBackground = true;
+		return false;
 	}
-	return approxDiff;
+
+	m_jobActive = true;
+	return true;
 }
 
-bool LineListWrap::in_window(unsigned int pos) {
-	if (pos == 0 && size() == 0) return true;
-	wxASSERT(size());
+unsigned int LineListWrap::ApplyMeasurements() {
+	wxASSERT(m_jobActive && !IsMeasuring());
 
-	unsigned int index = find_offset(pos);
-	return (index >= firstLoadedPos && index < lastLoadedPos);
-}
+	// Returns the first line that has to be measured with the dc
+	unsigned int fallback = size();
 
-int LineListWrap::OnIdle() {
-	if (!size()) return 0;
-	wxASSERT(lastLoadedPos != 0 && firstLoadedPos < lastLoadedPos);
-
-	//wxLogDebug(wxT("ll.OnIdle %d %d (%d)"), firstLoadedPos, lastLoadedPos, size());
-
-	if (firstLoadedPos > 0) {
-		//wxLogDebug("OnIdle 1");
-		unsigned int index = uMinus(firstLoadedPos, 100);
-		
-		// Load positions in extension
-		unsigned int line_bottom = 0;
-		for (unsigned int i = index; i < firstLoadedPos; ++i) {
-			line.SetLine(offset(i), end(i));
-			line_bottom = yPositions[i] = line_bottom + line.GetHeight();
-		}
+	if (!m_jobCancelled) {
+		for (unsigned int i = 0; i < m_jobHeights.size(); ++i) {
+			const unsigned int index = m_jobFirstLine + i;
 
-		// Calculate new approxTop
-		unsigned int new_approxTop = 0;
-		if (index) {
-			unsigned int loadedheight = yPositions[lastLoadedPos-1] - (firstLoadedPos ? yPositions[firstLoadedPos] : 0);
-			avr_lineheight = (yPositions[firstLoadedPos-1] + loadedheight) / (lastLoadedPos - index);
-			new_approxTop = index * avr_lineheight;
-		}
+			// Lines may have been measured exactly in the meantime
+			if (m_lines.line_height(index) != 0) continue;
 
-		// Adjust all positions to new approxTop
-		int ext_diff = line_bottom - approxTop;
-		for (unsigned int i2 = index; i2 < lastLoadedPos; ++i2) {
-			yPositions[i2] += new_approxTop;
-			if (i2 >= firstLoadedPos) yPositions[i2] += ext_diff;
+			if (m_jobHeights[i]) set_measured_height(index, m_jobHeights[i]);
+			else if (fallback == size()) fallback = index;
 		}
 
-		approxTop = new_approxTop;
-		firstLoadedPos = index;
-		recalc_approx();
+		// If all missing glyphs could be cached, the
+		// threads can do the lines on the next round
+		if (!m_jobMissing.empty()) {
+			line.CacheGlyphs(m_jobMissing);
 
-/*		int bottom = yPositions[firstLoadedPos];
-		for (unsigned int i = firstLoadedPos; i >= index && i <= firstLoadedPos; --i) {
-			line.SetLine(offset(i), end(i));
-			yPositions[i] = bottom;
-			bottom -= line.GetHeight();
-		}
-		int diff = yPositions[firstLoadedPos-1] - bottom;
-		wxASSERT(bottom < (int)yPositions[firstLoadedPos-1]);
-		wxASSERT(diff >= 0);
-		approxTop -= diff;
-		firstLoadedPos = index;
-		int aprx = recalc_approx(true);*/
-		
-		verify();
-		return ext_diff;
-	}
-	else if (lastLoadedPos != size()) {
-		//wxLogDebug("OnIdle 2");
-		wxASSERT(lastLoadedPos < size());
-		int index = wxMin(lastLoadedPos+100, last());
-		int top = yPositions[lastLoadedPos-1];
-		for (int i = lastLoadedPos; i <= index; ++i) {
-			line.SetLine(offset(i), end(i));
-			yPositions[i] = top += line.GetHeight();
+			const LineBreaker& breaker = line.GetLineBreaker();
+			vector<unsigned int>::const_iterator p = m_jobMissing.begin();
+			while (p != m_jobMissing.end() && breaker.IsCached(*p)) ++p;
+			if (p == m_jobMissing.end()) fallback = size();
 		}
-		if (lastValidPos == lastLoadedPos && posDiff == 0) lastValidPos = index+1;
-		lastLoadedPos = index+1;
-		int aprx = recalc_approx(); // recalc approximations (below only)
-		
-		verify();
-		return aprx;
 	}
-	return 0;
-}
-
-// DEBUG ONLY
-void LineListWrap::verify(bool deep) const {
-#ifdef  __WXDEBUG__
-	//Print();
 
-	// Disable deep check for betatesters to avoid uacceptable slow handline of large files
-	deep = false;
+	m_jobActive = false;
+	m_jobHeights.clear();
+	vector<char>().swap(m_jobText); // release memory
+	vector<unsigned int>().swap(m_jobMissing);
 
-	// Make sure vector sizes are in sync
-	wxASSERT(textOffsets.size() == yPositions.size());
-	if (textOffsets.empty()) return;
+	return fallback;
+}
 
-	wxASSERT(lastValidPos <= yPositions.size());
-	wxASSERT(lastLoadedPos <= yPositions.size());
-	wxASSERT(lastValidPos > firstLoadedPos && lastValidPos <= lastLoadedPos);
+void LineListWrap::CancelMeasuring() {
+	if (!m_jobActive) return;
 
-	// Make sure the diff variables get reset
-	wxASSERT(lastValidOffset < textOffsets.size() || offsetDiff == 0);
-	wxASSERT(lastValidPos < yPositions.size() || posDiff == 0);
+	// Threads in the middle of a range will finish it, but
+	// no new ranges are handed out and the result is ignored
+	m_runner.Cancel();
+	wxCriticalSectionLocker lock(m_jobLock);
+	m_jobCancelled = true;
+}
 
-	wxASSERT(approxTop >= 0);
+bool LineListWrap::IsMeasuring() const {
+	return m_jobActive && m_runner.IsBusy();
+}
 
-	// Do a check to see if there is something in the pos-window
-	wxASSERT(lastValidPos == 0 || yPositions[lastValidPos-1] > 0);
+// static
+void LineListWrap::OnMeasureRange(void* data, unsigned int index) {
+	// Called from the measure threads
+	LineListWrap& lines = *(LineListWrap*)data;
+	const unsigned int first = index * MEASURERANGE;
+	const unsigned int last = wxMin(first + MEASURERANGE, (unsigned int)lines.m_jobHeights.size());
 
-	// Check that positions are sequential
-	if (lastValidPos > 0) {
-		unsigned int prevPos = yPositions[firstLoadedPos];
-		for (size_t i = firstLoadedPos+1; i < lastValidPos; ++i) {
-			wxASSERT(prevPos < yPositions[i]);
-			prevPos = yPositions[i];
-		}
+	vector<unsigned int> extents;
+	vector<unsigned int> missing;
+	const char* const text = &*lines.m_jobText.begin();
+	for (unsigned int i = first; i < last; ++i) {
+		const unsigned int lineStart = lines.m_jobStarts[i];
+		lines.m_jobHeights[i] = lines.m_jobBreaker.GetHeight(text + lineStart, lines.m_jobStarts[i+1] - lineStart, extents, &missing);
 	}
+	sort(missing.begin(), missing.end());
+	missing.erase(unique(missing.begin(), missing.end()), missing.end());
 
-	if (deep) {
-		// Check that textOffsets are sequential
-		if (lastValidOffset > 0) {
-			int offset = 0;
-			for (unsigned int i = 0; i < textOffsets.size(); ++i) {
-				int end = textOffsets[i];
-				if (i >= lastValidOffset) end += offsetDiff;
-
-				wxASSERT(end > offset);
-				offset = end;
-			}
-		}
+	bool done;
+	{
+		wxCriticalSectionLocker lock(lines.m_jobLock);
+		lines.m_jobMissing.insert(lines.m_jobMissing.end(), missing.begin(), missing.end());
+		done = (++lines.m_jobRangesDone == lines.m_jobRangeCount) || lines.m_jobCancelled;
 	}
-	
-	// textOffsets within range?
-	int t = lastValidOffset < textOffsets.size() ? textOffsets.back() + offsetDiff: textOffsets.back();
-	int l = m_doc.GetLength();
-	if (t != l) wxLogDebug(wxT("%d != %d"), t, l);
-	wxASSERT(t == l);
 
-	if (deep) {
+	if (done) wxWakeUpIdle();
+}
 
-		// SuperDebug: Verify that no lines contains newlines
-		int offset = 0;
-		for (unsigned int i = 0; i < textOffsets.size(); ++i) {
-			int end = (i >= lastValidOffset ? textOffsets[i] + offsetDiff : textOffsets[i]);
-			line.SetLine(offset, end); // verify during breaking
-			offset = end;
-		}
+// DEBUG ONLY
+void LineListWrap::verify(bool deep) const {
+#ifdef  __WXDEBUG__
+	if (m_lines.size() == 0) return;
 
-		// Check that all loaded positions are correct
-		if (lastLoadedPos != 0) {
-			wxASSERT(firstLoadedPos >= 0 && firstLoadedPos < lastLoadedPos);
-			wxASSERT(firstLoadedPos > 0 || approxTop == 0);
-			int top = approxTop;
-			int offset = 0; if (firstLoadedPos) offset = textOffsets[firstLoadedPos-1];
-			if (firstLoadedPos >= lastValidOffset) offset += offsetDiff;
-			for (unsigned int i = firstLoadedPos; i < lastLoadedPos; ++i) {
-				int bottom = yPositions[i];
-				int end = (i >= lastValidOffset ? textOffsets[i] + offsetDiff : textOffsets[i]);
-				if (i >= lastValidPos) bottom += posDiff;
-
-				wxASSERT(bottom > top);
-
-				line.SetLine(offset, end);
-				wxASSERT(bottom - top == line.GetHeight());
-
-				top = bottom;
-				offset = end;
-			}
-		}
-	}
+	// The tree check visits all nodes, so it is only done when asked for
+	if (deep) wxASSERT(m_lines.verify());
 
+	// textOffsets within range?
+	const int t = m_lines.length();
+	const int l = m_doc.GetLength();
+	if (t != l) wxLogDebug(wxT("%d != %d"), t, l);
+	wxASSERT(t == l);
 #endif // __WXDEBUG__
 }
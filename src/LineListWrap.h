@@ -14,7 +14,15 @@
 #ifndef __LINELISTWRAP_H__
 #define __LINELISTWRAP_H__
 
+#include "wx/wxprec.h"
+#ifndef WX_PRECOMP
+	#include <wx/wx.h>
+#endif
+
 #include "LineList.h"
+#include "LineIndex.h"
+#include "LineBreaker.h"
+#include "TaskRunner.h"
 
 class FixedLine;
 class DocumentWrapper;
@@ -22,7 +30,7 @@ class DocumentWrapper;
 class LineListWrap : public LineList {
 public:
 	LineListWrap(FixedLine& l, const DocumentWrapper& dw);
-	virtual ~LineListWrap() {};
+	virtual ~LineListWrap();
 
 	unsigned int offset(unsigned int index);
 	unsigned int end(unsigned int index);
@@ -60,23 +68,16 @@ public:
 	bool in_window(unsigned int pos);
 
 	int OnIdle();
-	bool NeedIdle() const {return (firstLoadedPos > 0 || lastLoadedPos != size());};
+	bool NeedIdle() const;
 
 	void Print();
 	void verify(bool deep=false) const;
 
 private:
-	void add_line(int end);
-
-	void validate_offsets(unsigned int index);
-	void validate_positions(unsigned int index);
-
-	void update_offsetDiff(unsigned int index, int diff);
-	void update_posDiff(unsigned int index, int diff);
-
-	void initwindow();
-	int extendwindow(unsigned int index);
-	int recalc_approx(bool movetop = false);
+	void measure(unsigned int first, unsigned int last);
+	void measure_exact(unsigned int first, unsigned int last);
+	void set_measured_height(unsigned int index, unsigned int height);
+	void update_approx();
 
 	// Safe unsigned minus (won't go below 0)
 	unsigned int uMinus(unsigned int a, unsigned int b) {
@@ -84,32 +85,42 @@ private:
 		else return a - b;
 	}
 
-	// Safe unsigned plus signed (won't go below 0)
-	unsigned int uPluss(unsigned int a, int b) {
-		if (b < 0 && (unsigned int)-b > a) return 0;
-		else return a + b;
-	}
+	// Measuring in background threads (only with fixed-width fonts)
+	bool StartMeasuring(unsigned int first);
+	unsigned int ApplyMeasurements();
+	void CancelMeasuring();
+	bool IsMeasuring() const;
+	static void OnMeasureRange(void* data, unsigned int index); // called from runner
 
 	// Constants
 	static const unsigned int WINSIZE;
+	static const unsigned int MEASURECHUNK;
+	static const unsigned int MEASURERANGE;
+	static const unsigned int MAXTHREADS;
 
 	// Private member variables
 	FixedLine& line;
 	const DocumentWrapper& m_doc;
-	std::vector<unsigned int> yPositions;
-	std::vector<unsigned int> textOffsets;
-
-	unsigned int lastValidOffset;
-	unsigned int lastValidPos;
-	unsigned int firstLoadedPos;
-	unsigned int lastLoadedPos;
-	int offsetDiff;
-	int posDiff;
-
-	unsigned int approxTop;
-	unsigned int approxBottom;
-	unsigned int avr_lineheight;
-	int approxDiff;
+	LineIndex m_lines;
+	std::vector<unsigned int> m_offsets; // only used by GetOffsets()
+	TaskRunner m_runner;
+	bool m_noBackground;
+
+	// The current measuring job. Each task measures a range of lines. The
+	// missing chars, the count of done ranges and the cancel flag are guarded
+	// by m_jobLock, and the rest is left alone by the gui thread until all
+	// ranges are done.
+	wxCriticalSection m_jobLock;
+	bool m_jobActive;
+	bool m_jobCancelled;
+	LineBreaker m_jobBreaker;
+	unsigned int m_jobFirstLine;
+	std::vector<char> m_jobText;
+	std::vector<unsigned int> m_jobStarts;  // line starts in m_jobText
+	std::vector<unsigned int> m_jobHeights; // zero if line needs the dc
+	std::vector<unsigned int> m_jobMissing; // chars not in glyph cache
+	unsigned int m_jobRangeCount;
+	unsigned int m_jobRangesDone;
 
 private:
 	LineListWrap& operator = (const LineListWrap& other);
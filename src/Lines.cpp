@@ -13,6 +13,7 @@
 
 #include "Lines.h"
 #include "doc_byte_iter.h"
+#include "doc_chunk_iter.h"
 #include "Document.h"
 #include "IFoldingEditor.h"
 #include "Fold.h"
@@ -684,14 +685,14 @@ void Lines::Clear() {
 	m_isSelShadow = false;
 }
 
-cxFileResult Lines::LoadText(const wxFileName& path, wxFontEncoding enc, const wxString& mirror) {
+cxFileResult Lines::LoadText(const wxFileName& path, wxFontEncoding enc, const wxString& mirror, ILoadProgress* progress) {
 	wxASSERT(path.IsOk());
 
 	// Load the text
 	vector<unsigned int> textOffsets;
 	cxFileResult result;
 	cxLOCKDOC_WRITE(m_doc)
-		result = doc.LoadText(path, textOffsets, enc, mirror);
+		result = doc.LoadText(path, textOffsets, enc, mirror, progress);
 	cxENDLOCK
 	if (result != cxFILE_OK) return result;
 
@@ -818,9 +819,10 @@ void Lines::Insert(unsigned int pos, unsigned int byte_len) {
 
 		// Create new lines
 		bool do_update = true;
-		for (dbi.SetIndex(pos); dbi.GetIndex() < (int)end_pos; ++dbi) {
-			if (*dbi == '\n') {
-				const unsigned int line_end = dbi.GetIndex()+1;
+		for (doc_chunk_iter chunk(doc, pos, end_pos); !chunk.AtEnd(); ++chunk) {
+			const char* const end = chunk.end();
+			for (const char* p = chunk.begin(); (p = (const char*)memchr(p, '\n', end - p)) != NULL; ++p) {
+				const unsigned int line_end = chunk.GetStart() + (p - chunk.begin()) + 1;
 				if (do_update) {
 					if (changedline != -1) {
 						if ((unsigned int)changedline <= ll->last()) { // don't update on virtual line
@@ -11,6 +11,7 @@
 
 class wxFileName;
 class IFoldingEditor;
+class ILoadProgress;
 struct tmTheme;
 class Styler;
 
@@ -119,10 +120,10 @@ public:
 	inline void StylersApplyDiff(vector<cxChange>& changes) { line.StylersApplyDiff(changes); }
 	inline void StylersInsert(unsigned int pos, unsigned int length) { line.StylersInsert(pos, length); }
 	inline void StylersDelete(unsigned int start, unsigned int end) { line.StylersDelete(start, end); }
-	inline bool StylersOnIdle() { return line.StylersOnIdle(); }
+	inline bool StylersOnIdle(const Styler* skip=NULL) { return line.StylersOnIdle(skip); }
 
 	void Clear();
-	cxFileResult LoadText(const wxFileName& path, wxFontEncoding enc, const wxString& mirror=wxEmptyString);
+	cxFileResult LoadText(const wxFileName& path, wxFontEncoding enc, const wxString& mirror=wxEmptyString, ILoadProgress* progress=NULL);
 	void ReLoadText();
 
 	void InsertChar(unsigned int pos, const wxChar& newtext, unsigned int byte_len);
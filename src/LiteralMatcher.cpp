@@ -0,0 +1,333 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#include "LiteralMatcher.h"
+#include <string.h>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+	#define LM_HAVE_SSE2
+	#include <emmintrin.h>
+#endif
+
+// AVX2 needs a compiler that can target it per function
+#if defined(LM_HAVE_SSE2)
+	#if defined(_MSC_VER) && _MSC_VER >= 1700
+		#define LM_HAVE_AVX2
+		#include <immintrin.h>
+		#include <intrin.h>
+	#elif defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+		#define LM_HAVE_AVX2
+		#define LM_TARGET_AVX2 __attribute__((target("avx2")))
+		#include <immintrin.h>
+	#elif defined(_MSC_VER)
+		#include <intrin.h>
+	#endif
+#endif
+
+#ifndef LM_TARGET_AVX2
+	#define LM_TARGET_AVX2
+#endif
+
+namespace {
+	inline unsigned int lowest_bit(unsigned int mask) {
+#if defined(_MSC_VER)
+		unsigned long ndx;
+		_BitScanForward(&ndx, mask);
+		return ndx;
+#else
+		return __builtin_ctz(mask);
+#endif
+	}
+
+	bool is_single_bit(unsigned char c) {
+		return c != 0 && (c & (c-1)) == 0;
+	}
+
+	LiteralMatcher::Kernel s_bestKernel = LiteralMatcher::KERNEL_AUTO;
+}
+
+LiteralMatcher::LiteralMatcher()
+: m_len(0), m_matchCase(true), m_kernel(KERNEL_SCALAR), m_needAlt(false) {
+}
+
+LiteralMatcher::LiteralMatcher(const char* pattern, const char* patternAlt, size_t len)
+: m_len(0), m_matchCase(true), m_kernel(KERNEL_SCALAR), m_needAlt(false) {
+	Set(pattern, patternAlt, len);
+}
+
+void LiteralMatcher::Set(const char* pattern, const char* patternAlt, size_t len) {
+	m_len = len;
+	m_matchCase = (patternAlt == NULL);
+	m_pattern.assign(pattern, pattern + len);
+	if (m_matchCase) m_patternAlt = m_pattern;
+	else m_patternAlt.assign(patternAlt, patternAlt + len);
+	SetKernel(KERNEL_AUTO);
+
+	if (len == 0) return;
+
+	// Build a dictionary of char-to-last distances in the search string
+	const size_t last_char_pos = len-1;
+	for (size_t c = 0; c < 256; ++c) m_skip[c] = len;
+	for (size_t i = 0; i < last_char_pos; ++i) {
+		m_skip[(unsigned char)m_pattern[i]] = last_char_pos-i;
+		m_skip[(unsigned char)m_patternAlt[i]] = last_char_pos-i;
+	}
+
+	// Prepare the first/last byte filters
+	const unsigned char first = m_pattern[0];
+	const unsigned char firstAlt = m_patternAlt[0];
+	const unsigned char last = m_pattern[last_char_pos];
+	const unsigned char lastAlt = m_patternAlt[last_char_pos];
+
+	m_needAlt = false;
+	m_firstFold = is_single_bit(first ^ firstAlt) ? (first ^ firstAlt) : 0;
+	m_firstVal = first | m_firstFold;
+	m_firstAlt = m_firstFold ? m_firstVal : firstAlt;
+	if (m_firstAlt != m_firstVal) m_needAlt = true;
+
+	m_lastFold = is_single_bit(last ^ lastAlt) ? (last ^ lastAlt) : 0;
+	m_lastVal = last | m_lastFold;
+	m_lastAlt = m_lastFold ? m_lastVal : lastAlt;
+	if (m_lastAlt != m_lastVal) m_needAlt = true;
+}
+
+void LiteralMatcher::SetKernel(Kernel kernel) {
+	if (kernel == KERNEL_AUTO || !IsKernelSupported(kernel)) kernel = GetBestKernel();
+	m_kernel = kernel;
+}
+
+bool LiteralMatcher::IsKernelSupported(Kernel kernel) { // static
+	switch (kernel) {
+	case KERNEL_AUTO:
+	case KERNEL_SCALAR:
+		return true;
+
+#ifdef LM_HAVE_SSE2
+	case KERNEL_SSE2:
+	#if defined(_M_X64) || defined(__x86_64__)
+		return true; // always available on x64
+	#elif defined(_MSC_VER)
+		{
+			int info[4];
+			__cpuid(info, 1);
+			return (info[3] & (1 << 26)) != 0;
+		}
+	#else
+		return __builtin_cpu_supports("sse2");
+	#endif
+#endif
+
+#ifdef LM_HAVE_AVX2
+	case KERNEL_AVX2:
+	#if defined(_MSC_VER)
+		{
+			// Needs both cpu support and the OS saving the ymm registers
+			int info[4];
+			__cpuid(info, 1);
+			const bool osxsave = (info[2] & (1 << 27)) != 0;
+			const bool avx = (info[2] & (1 << 28)) != 0;
+			if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) return false;
+			__cpuidex(info, 7, 0);
+			return (info[1] & (1 << 5)) != 0;
+		}
+	#else
+		return __builtin_cpu_supports("avx2");
+	#endif
+#endif
+
+	default:
+		return false;
+	}
+}
+
+LiteralMatcher::Kernel LiteralMatcher::GetBestKernel() { // static
+	if (s_bestKernel == KERNEL_AUTO) {
+		// Benign race, all threads will arrive at the same value
+		if (IsKernelSupported(KERNEL_AVX2)) s_bestKernel = KERNEL_AVX2;
+		else if (IsKernelSupported(KERNEL_SSE2)) s_bestKernel = KERNEL_SSE2;
+		else s_bestKernel = KERNEL_SCALAR;
+	}
+	return s_bestKernel;
+}
+
+const char* LiteralMatcher::GetKernelName(Kernel kernel) { // static
+	switch (kernel) {
+	case KERNEL_SCALAR: return "scalar";
+	case KERNEL_SSE2: return "sse2";
+	case KERNEL_AVX2: return "avx2";
+	default: return "auto";
+	}
+}
+
+bool LiteralMatcher::MatchAt(const char* subject) const {
+	if (m_matchCase) return memcmp(subject, &m_pattern[0], m_len) == 0;
+
+	for (size_t i = 0; i < m_len; ++i) {
+		const char c = subject[i];
+		if (c != m_pattern[i] && c != m_patternAlt[i]) return false;
+	}
+	return true;
+}
+
+const char* LiteralMatcher::Find(const char* start, const char* end) const {
+	if (m_len == 0 || end - start < (ptrdiff_t)m_len) return NULL;
+
+	switch (m_kernel) {
+	case KERNEL_AVX2: return FindAVX2(start, end);
+	case KERNEL_SSE2: return FindSSE2(start, end);
+	default:          return FindScalar(start, end);
+	}
+}
+
+const char* LiteralMatcher::FindScalar(const char* start, const char* end) const {
+	if (end - start < (ptrdiff_t)m_len) return NULL;
+
+	// Prepare vars to avoid lookups in loop
+	const size_t last_char_pos = m_len-1;
+	const char lastChar = m_pattern[last_char_pos];
+	const char lastCharAlt = m_patternAlt[last_char_pos];
+	const char* subject = start + last_char_pos; // start from last char in search string
+
+	while (subject < end) {
+		const char c = *subject; // Get candidate for last char
+
+		if (c == lastChar || c == lastCharAlt) {
+			const char* const first_byte_pos = subject - last_char_pos;
+			if (MatchAt(first_byte_pos)) return first_byte_pos; // text found!
+		}
+
+		// If we don't have a match, see how far we can move
+		subject += m_skip[(unsigned char)c];
+	}
+
+	return NULL; // reached end without finding text
+}
+
+#ifdef LM_HAVE_SSE2
+
+namespace {
+	// Filters 16 candidate start positions at a time. Returns the first
+	// match, or NULL with p advanced to where the scalar search should resume.
+	template<bool needAlt> const char* find_sse2(const LiteralMatcher& lm, const char*& p, const char* end,
+		unsigned char firstFold, unsigned char firstVal, unsigned char firstAlt,
+		unsigned char lastFold, unsigned char lastVal, unsigned char lastAlt)
+	{
+		const size_t last_char_pos = lm.Length()-1;
+		const __m128i fFold = _mm_set1_epi8((char)firstFold);
+		const __m128i fVal = _mm_set1_epi8((char)firstVal);
+		const __m128i fAlt = _mm_set1_epi8((char)firstAlt);
+		const __m128i lFold = _mm_set1_epi8((char)lastFold);
+		const __m128i lVal = _mm_set1_epi8((char)lastVal);
+		const __m128i lAlt = _mm_set1_epi8((char)lastAlt);
+
+		while (end - p >= (ptrdiff_t)(last_char_pos + 16)) {
+			const __m128i a = _mm_loadu_si128((const __m128i*)p);
+			const __m128i b = _mm_loadu_si128((const __m128i*)(p + last_char_pos));
+
+			__m128i eqFirst = _mm_cmpeq_epi8(_mm_or_si128(a, fFold), fVal);
+			__m128i eqLast = _mm_cmpeq_epi8(_mm_or_si128(b, lFold), lVal);
+			if (needAlt) {
+				eqFirst = _mm_or_si128(eqFirst, _mm_cmpeq_epi8(a, fAlt));
+				eqLast = _mm_or_si128(eqLast, _mm_cmpeq_epi8(b, lAlt));
+			}
+
+			unsigned int mask = _mm_movemask_epi8(_mm_and_si128(eqFirst, eqLast));
+			while (mask) {
+				const char* candidate = p + lowest_bit(mask);
+				if (lm.MatchAt(candidate)) return candidate;
+				mask &= mask - 1;
+			}
+			p += 16;
+		}
+
+		return NULL;
+	}
+}
+
+const char* LiteralMatcher::FindSSE2(const char* start, const char* end) const {
+	const char* p = start;
+	const char* match = m_needAlt
+		? find_sse2<true>(*this, p, end, m_firstFold, m_firstVal, m_firstAlt, m_lastFold, m_lastVal, m_lastAlt)
+		: find_sse2<false>(*this, p, end, m_firstFold, m_firstVal, m_firstAlt, m_lastFold, m_lastVal, m_lastAlt);
+	if (match) return match;
+
+	// Search the tail
+	return FindScalar(p, end);
+}
+
+#else
+
+const char* LiteralMatcher::FindSSE2(const char* start, const char* end) const {
+	return FindScalar(start, end);
+}
+
+#endif // LM_HAVE_SSE2
+
+#ifdef LM_HAVE_AVX2
+
+namespace {
+	// Same as find_sse2, but 32 positions at a time
+	template<bool needAlt> LM_TARGET_AVX2 const char* find_avx2(const LiteralMatcher& lm, const char*& p, const char* end,
+		unsigned char firstFold, unsigned char firstVal, unsigned char firstAlt,
+		unsigned char lastFold, unsigned char lastVal, unsigned char lastAlt)
+	{
+		const size_t last_char_pos = lm.Length()-1;
+		const __m256i fFold = _mm256_set1_epi8((char)firstFold);
+		const __m256i fVal = _mm256_set1_epi8((char)firstVal);
+		const __m256i fAlt = _mm256_set1_epi8((char)firstAlt);
+		const __m256i lFold = _mm256_set1_epi8((char)lastFold);
+		const __m256i lVal = _mm256_set1_epi8((char)lastVal);
+		const __m256i lAlt = _mm256_set1_epi8((char)lastAlt);
+
+		while (end - p >= (ptrdiff_t)(last_char_pos + 32)) {
+			const __m256i a = _mm256_loadu_si256((const __m256i*)p);
+			const __m256i b = _mm256_loadu_si256((const __m256i*)(p + last_char_pos));
+
+			__m256i eqFirst = _mm256_cmpeq_epi8(_mm256_or_si256(a, fFold), fVal);
+			__m256i eqLast = _mm256_cmpeq_epi8(_mm256_or_si256(b, lFold), lVal);
+			if (needAlt) {
+				eqFirst = _mm256_or_si256(eqFirst, _mm256_cmpeq_epi8(a, fAlt));
+				eqLast = _mm256_or_si256(eqLast, _mm256_cmpeq_epi8(b, lAlt));
+			}
+
+			unsigned int mask = (unsigned int)_mm256_movemask_epi8(_mm256_and_si256(eqFirst, eqLast));
+			while (mask) {
+				const char* candidate = p + lowest_bit(mask);
+				if (lm.MatchAt(candidate)) return candidate;
+				mask &= mask - 1;
+			}
+			p += 32;
+		}
+
+		return NULL;
+	}
+}
+
+const char* LiteralMatcher::FindAVX2(const char* start, const char* end) const {
+	const char* p = start;
+	const char* match = m_needAlt
+		? find_avx2<true>(*this, p, end, m_firstFold, m_firstVal, m_firstAlt, m_lastFold, m_lastVal, m_lastAlt)
+		: find_avx2<false>(*this, p, end, m_firstFold, m_firstVal, m_firstAlt, m_lastFold, m_lastVal, m_lastAlt);
+	if (match) return match;
+
+	// Less than 32 positions left, let the narrower kernel finish
+	return FindSSE2(p, end);
+}
+
+#else
+
+const char* LiteralMatcher::FindAVX2(const char* start, const char* end) const {
+	return FindSSE2(start, end);
+}
+
+#endif // LM_HAVE_AVX2
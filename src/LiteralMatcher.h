@@ -0,0 +1,82 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#ifndef __LITERALMATCHER_H__
+#define __LITERALMATCHER_H__
+
+#include <stddef.h>
+#include <vector>
+
+// Finds literal (utf-8) byte sequences in a buffer.
+//
+// For caseless search an alternative pattern (the uppercase version) with the
+// same byte length is given, and a byte in the subject matches if it is equal
+// to the byte at the same position in either of the patterns.
+//
+// Candidates are filtered 16 (SSE2) or 32 (AVX2) bytes at a time on the first
+// and last byte of the pattern, with the kernel chosen at runtime. The
+// Horspool skip-table search is kept as fallback, and all kernels give
+// exactly the same results.
+class LiteralMatcher {
+public:
+	enum Kernel {
+		KERNEL_AUTO,
+		KERNEL_SCALAR,
+		KERNEL_SSE2,
+		KERNEL_AVX2
+	};
+
+	LiteralMatcher();
+	LiteralMatcher(const char* pattern, const char* patternAlt, size_t len);
+	void Set(const char* pattern, const char* patternAlt, size_t len);
+
+	size_t Length() const {return m_len;};
+	bool IsEmpty() const {return m_len == 0;};
+
+	// Returns start of first match that lies entirely in [start, end), or NULL
+	const char* Find(const char* start, const char* end) const;
+	bool MatchAt(const char* subject) const;
+
+	// Kernel selection (mainly for testing and diagnostics)
+	Kernel GetKernel() const {return m_kernel;};
+	void SetKernel(Kernel kernel);
+	static Kernel GetBestKernel();
+	static bool IsKernelSupported(Kernel kernel);
+	static const char* GetKernelName(Kernel kernel);
+
+private:
+	const char* FindScalar(const char* start, const char* end) const;
+	const char* FindSSE2(const char* start, const char* end) const;
+	const char* FindAVX2(const char* start, const char* end) const;
+
+	// Member variables
+	std::vector<char> m_pattern;
+	std::vector<char> m_patternAlt;
+	size_t m_len;
+	bool m_matchCase;
+	unsigned int m_skip[256];
+	Kernel m_kernel;
+
+	// First & last byte filters. If the two variants of a byte only differ
+	// in a single bit, they can be folded in-register by or'ing with m_*Fold,
+	// otherwise both variants have to be compared.
+	unsigned char m_firstFold;
+	unsigned char m_firstVal;
+	unsigned char m_firstAlt;
+	unsigned char m_lastFold;
+	unsigned char m_lastVal;
+	unsigned char m_lastAlt;
+	bool m_needAlt;
+};
+
+#endif // __LITERALMATCHER_H__
@@ -0,0 +1,93 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#include "MatchIndex.h"
+
+using namespace std;
+
+interval MatchIndex::Get(unsigned int index) const {
+	const unsigned int end = m_index.end(index);
+	return interval(end - m_index.line_width(index), end);
+}
+
+unsigned int MatchIndex::FindEnd(unsigned int pos) const {
+	return m_index.find_offset(pos);
+}
+
+unsigned int MatchIndex::FindStart(unsigned int pos) const {
+	// Only a single match can contain pos
+	unsigned int index = m_index.find_offset(pos);
+	if (index < m_index.size() && GetStart(index) < pos) ++index;
+	return index;
+}
+
+void MatchIndex::Insert(unsigned int pos, unsigned int length) {
+	// Matches ending at pos are not moved
+	const unsigned int index = m_index.find_offset(pos+1);
+	if (index == m_index.size()) return;
+
+	// Remove match if the insertion is inside it
+	const unsigned int last = GetStart(index) < pos ? index+1 : index;
+	Remove(index, last, (int)length);
+}
+
+void MatchIndex::Delete(unsigned int start, unsigned int end) {
+	if (start >= end) return;
+
+	// Find matches touched by the deletion
+	const unsigned int first = m_index.find_offset(start+1);
+	unsigned int last = first;
+	while (last < m_index.size() && GetStart(last) < end) ++last;
+
+	Remove(first, last, -(int)(end - start));
+}
+
+void MatchIndex::Remove(unsigned int first, unsigned int last, int shift) {
+	// The match after the removed ones keeps its absolute position (plus shift)
+	const bool hasNext = last < m_index.size();
+	const unsigned int nextEnd = hasNext ? m_index.end(last) + shift : 0;
+	const unsigned int prevEnd = first < m_index.size() ? m_index.offset(first) : m_index.length();
+
+	m_index.erase(first, last);
+	if (hasNext) m_index.set_length(first, nextEnd - prevEnd);
+}
+
+unsigned int MatchIndex::Replace(unsigned int start, unsigned int end, const vector<interval>& matches) {
+	if (!matches.empty() && matches.back().end > end) end = matches.back().end;
+
+	// Remove old matches
+	const unsigned int first = FindStart(start);
+	const unsigned int last = FindStart(end);
+	if (first < last && m_index.end(last-1) > end) end = m_index.end(last-1);
+	Remove(first, last, 0);
+	if (matches.empty()) return end;
+
+	// Insert the new ones
+	const bool hasNext = first < m_index.size();
+	const unsigned int nextEnd = hasNext ? m_index.end(first) : 0;
+	unsigned int prevEnd = hasNext ? m_index.offset(first) : m_index.length();
+
+	vector<unsigned int> lengths(matches.size());
+	for (size_t i = 0; i < matches.size(); ++i) {
+		lengths[i] = matches[i].end - prevEnd;
+		prevEnd = matches[i].end;
+	}
+	m_index.insert(first, lengths);
+
+	for (size_t i = 0; i < matches.size(); ++i) {
+		m_index.set_width(first + i, matches[i].end - matches[i].start);
+	}
+	if (hasNext) m_index.set_length(first + matches.size(), nextEnd - prevEnd);
+
+	return end;
+}
@@ -0,0 +1,59 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#ifndef __MATCHINDEX_H__
+#define __MATCHINDEX_H__
+
+#include "LineIndex.h"
+#include "Interval.h"
+#include <vector>
+
+// Sorted, non-overlapping matches in a document (like the search
+// highlights), kept in a LineIndex so that edits only have to update
+// the path to the root instead of moving all following matches.
+//
+// Each entry covers the text from the end of the previous match to the
+// end of its own match, with the length of the match as the entry width.
+// All operations are O(log n) (plus the number of matches removed).
+class MatchIndex {
+public:
+	void Clear() {m_index.clear();};
+	unsigned int GetCount() const {return m_index.size();};
+	bool IsEmpty() const {return m_index.size() == 0;};
+
+	interval Get(unsigned int index) const;
+
+	// Searches (returns GetCount() if not found)
+	unsigned int FindEnd(unsigned int pos) const;   // first match with end >= pos
+	unsigned int FindStart(unsigned int pos) const; // first match with start >= pos
+
+	// Keep in sync with document (matches touched by the edit are removed)
+	void Insert(unsigned int pos, unsigned int length);
+	void Delete(unsigned int start, unsigned int end);
+
+	// Replace the matches starting in [start, end) with new (sorted) matches.
+	// Old matches overlapped by the new ones are also removed. Returns the
+	// end of the replaced area (which may be beyond end).
+	unsigned int Replace(unsigned int start, unsigned int end, const std::vector<interval>& matches);
+
+	bool Verify() const {return m_index.verify();};
+
+private:
+	unsigned int GetStart(unsigned int index) const {return m_index.end(index) - m_index.line_width(index);};
+	void Remove(unsigned int first, unsigned int last, int shift); // shift following matches
+
+	// Member variables
+	LineIndex m_index;
+};
+
+#endif // __MATCHINDEX_H__
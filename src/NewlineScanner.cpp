@@ -0,0 +1,110 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#include "NewlineScanner.h"
+#include <string.h>
+
+using namespace std;
+
+NewlineScanner::NewlineScanner(vector<unsigned int>& offsets)
+: m_offsets(offsets), m_pos(0), m_utfBytes(0), m_prevR(false), m_dosCount(0), m_unixCount(0), m_macCount(0) {
+}
+
+bool NewlineScanner::IsPlainWord(size_t w) { // static
+	// Bytes set to 0x01 and 0x80 in a full word
+	const size_t ones = ((size_t)-1) / 0xFF;
+	const size_t highs = ones * 0x80;
+
+	// Any non-ascii chars?
+	if (w & highs) return false;
+
+	// Any zero bytes in w, or bytes equal to '\n' or '\r'? (w is ascii, so
+	// subtracting one only sets the high bit of bytes that were zero)
+	const size_t nl = w ^ (ones * '\n');
+	const size_t cr = w ^ (ones * '\r');
+	return (((w - ones) | (nl - ones) | (cr - ones)) & highs) == 0;
+}
+
+bool NewlineScanner::Scan(const char* text, size_t len, vector<char>& out) {
+	const char* const end = text + len;
+	const char* runStart = text; // start of text not yet copied to out
+	const char* p = text;
+
+	while (p < end) {
+		// Skip plain ascii text a word at a time
+		if (m_utfBytes == 0 && !m_prevR) {
+			while ((size_t)(end - p) >= sizeof(size_t)) {
+				size_t w;
+				memcpy(&w, p, sizeof(w));
+				if (!IsPlainWord(w)) break;
+				p += sizeof(size_t);
+			}
+			if (p == end) break;
+		}
+
+		const char c = *p;
+
+		// Detect invalid UTF-8 sequences
+		if (m_utfBytes == 0) {
+			if ((c & 0xC0) == 0x80 || c == 0) return false;
+			else if ((c & 0x80) == 0x00) m_utfBytes = 0;
+			else if ((c & 0xE0) == 0xC0) m_utfBytes = 1;
+			else if ((c & 0xF0) == 0xE0) m_utfBytes = 2;
+			else if ((c & 0xF8) == 0xF0) m_utfBytes = 3;
+			else return false;
+		}
+		else if ((c & 0xC0) == 0x80) --m_utfBytes;
+		else return false;
+
+		switch (c) {
+		case '\r':
+			if (m_prevR) ++m_macCount;
+			out.insert(out.end(), runStart, p);
+			out.push_back('\n');
+			m_pos += (unsigned int)(p - runStart) + 1;
+			m_offsets.push_back(m_pos);
+			runStart = p+1;
+			m_prevR = true;
+			break;
+
+		case '\n':
+			if (!m_prevR) {
+				++m_unixCount;
+				m_offsets.push_back(m_pos + (unsigned int)(p+1 - runStart));
+			}
+			else {
+				// Already converted with the '\r'
+				++m_dosCount;
+				out.insert(out.end(), runStart, p);
+				m_pos += (unsigned int)(p - runStart);
+				runStart = p+1;
+			}
+			m_prevR = false;
+			break;
+
+		default:
+			if (m_prevR) ++m_macCount;
+			m_prevR = false;
+		}
+
+		++p;
+	}
+
+	out.insert(out.end(), runStart, end);
+	m_pos += (unsigned int)(end - runStart);
+	return true;
+}
+
+void NewlineScanner::Finish() {
+	if (m_pos && (m_offsets.empty() || m_offsets.back() != m_pos)) m_offsets.push_back(m_pos);
+}
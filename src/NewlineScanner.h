@@ -0,0 +1,55 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#ifndef __NEWLINESCANNER_H__
+#define __NEWLINESCANNER_H__
+
+#include <stddef.h>
+#include <vector>
+
+// Scans utf-8 text for newlines while it is being loaded. The text can be
+// given in chunks of any size (sequences may span chunks).
+//
+// All newlines (dos, mac and unix) are converted to '\n', and the offset
+// after each is added to the line offsets. Plain ascii text without
+// newlines is skipped a full word at a time.
+class NewlineScanner {
+public:
+	NewlineScanner(std::vector<unsigned int>& offsets);
+
+	// Appends the converted text to out.
+	// Returns false if the text is not valid utf-8 (or contains nulls).
+	bool Scan(const char* text, size_t len, std::vector<char>& out);
+
+	// Adds the end of text after last newline
+	void Finish();
+
+	unsigned int GetLength() const {return m_pos;};
+	unsigned int GetDosCount() const {return m_dosCount;};
+	unsigned int GetUnixCount() const {return m_unixCount;};
+	unsigned int GetMacCount() const {return m_macCount;};
+
+private:
+	static bool IsPlainWord(size_t w);
+
+	// Member variables
+	std::vector<unsigned int>& m_offsets;
+	unsigned int m_pos;
+	unsigned int m_utfBytes; // remaining in current sequence
+	bool m_prevR;
+	unsigned int m_dosCount;
+	unsigned int m_unixCount;
+	unsigned int m_macCount;
+};
+
+#endif // __NEWLINESCANNER_H__
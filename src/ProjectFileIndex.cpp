@@ -0,0 +1,695 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#include "ProjectFileIndex.h"
+#include <wx/ffile.h>
+#include <wx/filename.h>
+#include <wx/tokenzr.h>
+#include "ProjectInfoHandler.h"
+#include "DirWatcher.h"
+
+using namespace std;
+
+// Initializing static constants
+const unsigned int ProjectFileIndex::SNAPSHOT_MAGIC = 0x49465045; // "EPFI"
+const unsigned int ProjectFileIndex::SNAPSHOT_VERSION = 1;
+
+// A dir in the index. Files and subdirs are kept in the same
+// (caseless) order as ProjectInfoHandler::GetDirAndFileLists().
+class ProjectFileIndex::Dir {
+public:
+	~Dir() {
+		for (vector<Dir*>::iterator p = dirs.begin(); p != dirs.end(); ++p) delete *p;
+	};
+
+	Dir* GetDir(const wxString& dirName) const {
+		for (vector<Dir*>::const_iterator p = dirs.begin(); p != dirs.end(); ++p) {
+			if ((*p)->name == dirName) return *p;
+		}
+		return NULL;
+	};
+
+	Dir* AddDir(const wxString& dirName) {
+		Dir* dir = new Dir;
+		dir->name = dirName.c_str(); // wxString is not threadsafe, so we have to force copy
+		InsertDir(dir);
+		return dir;
+	};
+
+	void InsertDir(Dir* dir) {
+		vector<Dir*>::iterator p = dirs.begin();
+		for (; p != dirs.end(); ++p) {
+			if ((*p)->name.CmpNoCase(dir->name) > 0) break;
+		}
+		dirs.insert(p, dir);
+	};
+
+	Dir* TakeDir(const wxString& dirName) {
+		for (vector<Dir*>::iterator p = dirs.begin(); p != dirs.end(); ++p) {
+			if ((*p)->name == dirName) {
+				Dir* dir = *p;
+				dirs.erase(p);
+				return dir;
+			}
+		}
+		return NULL;
+	};
+
+	bool RemoveDir(const wxString& dirName) {
+		Dir* dir = TakeDir(dirName);
+		delete dir;
+		return dir != NULL;
+	};
+
+	void AddFile(const wxString& fileName) {
+		if (files.Index(fileName) != wxNOT_FOUND) return;
+
+		size_t ndx = 0;
+		while (ndx < files.GetCount() && files[ndx].CmpNoCase(fileName) <= 0) ++ndx;
+		files.Insert(fileName.c_str(), ndx); // wxString is not threadsafe, so we have to force copy
+	};
+
+	bool RemoveFile(const wxString& fileName) {
+		const int ndx = files.Index(fileName);
+		if (ndx == wxNOT_FOUND) return false;
+
+		files.RemoveAt(ndx);
+		return true;
+	};
+
+	wxString name;
+	wxArrayString files;
+	vector<Dir*> dirs;
+};
+
+class ProjectFileIndex::ScanThread : public wxThread {
+public:
+	ScanThread(ProjectFileIndex& index, const wxString& rootPath, const wxString& snapshotPath, bool fullScan)
+	: wxThread(wxTHREAD_JOINABLE), m_index(index),
+	  m_rootPath(rootPath.c_str()), m_snapshotPath(snapshotPath.c_str()), m_fullScan(fullScan) {
+		Create();
+		Run();
+	};
+
+	virtual void* Entry() {
+		if (m_fullScan && !m_index.Scan(m_rootPath, m_snapshotPath)) return NULL;
+
+		// Then the dirs that were queued for scanning (new or changed
+		// dirs), until there are no more
+		wxString dirPath;
+		while (m_index.NextScan(dirPath)) {
+			if (!m_index.ScanSubDir(m_rootPath, dirPath)) break;
+		}
+		return NULL;
+	};
+
+private:
+	ProjectFileIndex& m_index;
+	const wxString m_rootPath;
+	const wxString m_snapshotPath;
+	const bool m_fullScan;
+};
+
+ProjectFileIndex::ProjectFileIndex(const ProjectInfoHandler& filters)
+: m_filters(filters), m_root(NULL), m_generation(0), m_isModified(false),
+  m_thread(NULL), m_isScanning(false), m_stopScan(false) {
+}
+
+ProjectFileIndex::~ProjectFileIndex() {
+	Clear();
+}
+
+void ProjectFileIndex::SetRoot(const wxString& rootPath, const wxString& snapshotDir) {
+	Clear();
+
+	m_rootPath = rootPath;
+	if (!m_rootPath.EndsWith(wxString(wxFILE_SEP_PATH))) m_rootPath += wxFILE_SEP_PATH;
+	m_snapshotPath = GetSnapshotPath(snapshotDir, m_rootPath);
+
+	m_isScanning = true;
+	StartThread(true);
+}
+
+void ProjectFileIndex::Clear() {
+	if (m_thread) {
+		m_stopScan = true;
+		m_thread->Wait();
+		delete m_thread;
+		m_thread = NULL;
+		m_stopScan = false;
+	}
+
+	// Keep changes made since last scan for next start
+	if (m_root && m_isModified) SaveSnapshot(*m_root, m_rootPath, m_snapshotPath);
+
+	wxCriticalSectionLocker lock(m_lock);
+	delete m_root;
+	m_root = NULL;
+	m_rootPath.clear();
+	m_snapshotPath.clear();
+	m_isModified = false;
+	m_isScanning = false;
+	m_pending.clear();
+	m_toScan.clear();
+	++m_generation;
+}
+
+bool ProjectFileIndex::IsReady() const {
+	wxCriticalSectionLocker lock(m_lock);
+	return m_root != NULL;
+}
+
+bool ProjectFileIndex::IsScanning() const {
+	wxCriticalSectionLocker lock(m_lock);
+	return m_isScanning;
+}
+
+unsigned int ProjectFileIndex::GetGeneration() const {
+	wxCriticalSectionLocker lock(m_lock);
+	return m_generation;
+}
+
+void ProjectFileIndex::GetFiles(vector<wxString>& paths) const {
+	wxCriticalSectionLocker lock(m_lock);
+	if (!m_root) return;
+
+	GetFiles(*m_root, m_rootPath.c_str(), paths);
+}
+
+void ProjectFileIndex::GetFiles(const Dir& dir, const wxString& prefix, vector<wxString>& paths) { // static
+	for (size_t i = 0; i < dir.files.GetCount(); ++i) {
+		paths.push_back(prefix + dir.files[i].c_str());
+	}
+
+	for (vector<Dir*>::const_iterator p = dir.dirs.begin(); p != dir.dirs.end(); ++p) {
+		GetFiles(**p, prefix + (*p)->name.c_str() + wxFILE_SEP_PATH, paths);
+	}
+}
+
+void ProjectFileIndex::GetDirs(const wxString& path, vector<wxString>& dirs) const {
+	wxCriticalSectionLocker lock(m_lock);
+	if (!m_root) return;
+
+	wxString prefix = path;
+	if (!prefix.EndsWith(wxString(wxFILE_SEP_PATH))) prefix += wxFILE_SEP_PATH;
+
+	// Find the dir
+	wxString relPath;
+	if (!prefix.StartsWith(m_rootPath, &relPath)) return;
+
+	const Dir* dir = m_root;
+	wxStringTokenizer tokens(relPath, wxFileName::GetPathSeparators(), wxTOKEN_STRTOK);
+	while (dir && tokens.HasMoreTokens()) dir = dir->GetDir(tokens.GetNextToken());
+	if (!dir) return;
+
+	GetDirs(*dir, prefix, dirs);
+}
+
+void ProjectFileIndex::GetDirs(const Dir& dir, const wxString& prefix, vector<wxString>& dirs) { // static
+	for (vector<Dir*>::const_iterator p = dir.dirs.begin(); p != dir.dirs.end(); ++p) {
+		const wxString dirPath = prefix + (*p)->name.c_str();
+		dirs.push_back(dirPath);
+		GetDirs(**p, dirPath + wxFILE_SEP_PATH, dirs);
+	}
+}
+
+void ProjectFileIndex::OnDirChanged(int changeType, const wxString& path, const wxString& newPath) {
+	if (changeType == DIRWATCHER_FILE_MODIFIED) return;
+	if (m_rootPath.empty()) return;
+	if (changeType == DIRWATCHER_RESCAN) {
+		Rescan(path);
+		return;
+	}
+
+	Change change;
+	change.changeType = changeType;
+	change.path = path.c_str(); // wxString is not threadsafe, so we have to force copy
+	change.newPath = newPath.c_str();
+
+	bool startThread = false;
+	{
+		wxCriticalSectionLocker lock(m_lock);
+
+		// The scan may already have passed the changed dir,
+		// so it has to be replayed on the new tree when done
+		if (m_isScanning) m_pending.push_back(change);
+
+		if (m_root) {
+			ApplyChange(*m_root, change, m_filters);
+			m_isModified = true;
+		}
+
+		// New dirs are scanned in the background
+		if (!m_toScan.empty() && !m_isScanning) {
+			m_isScanning = true;
+			startThread = true;
+		}
+	}
+
+	if (startThread) StartThread(false);
+}
+
+void ProjectFileIndex::StartThread(bool fullScan) {
+	// The last thread has run out of dirs to scan
+	if (m_thread) {
+		m_thread->Wait();
+		delete m_thread;
+	}
+
+	m_thread = new ScanThread(*this, m_rootPath, m_snapshotPath, fullScan);
+}
+
+bool ProjectFileIndex::Scan(const wxString& rootPath, const wxString& snapshotPath) {
+	// Make the last snapshot available while we scan
+	Dir* snapshot = LoadSnapshot(rootPath, snapshotPath);
+	if (snapshot) {
+		wxCriticalSectionLocker lock(m_lock);
+		m_root = snapshot;
+		++m_generation;
+	}
+	if (snapshot) wxWakeUpIdle();
+
+	// The filters are shared with the gui thread, so we need our own
+	ProjectInfoHandler filters;
+	filters.SetRoot(wxFileName(rootPath));
+
+	Dir* tree = new Dir;
+	if (!ScanDir(rootPath, *tree, filters)) {
+		delete tree;
+		return false;
+	}
+
+	// The snapshot is only a starting point, so it does not
+	// matter if it misses the changes made during the scan.
+	SaveSnapshot(*tree, rootPath, snapshotPath);
+
+	Dir* oldTree = NULL;
+	{
+		wxCriticalSectionLocker lock(m_lock);
+
+		for (vector<Change>::const_iterator p = m_pending.begin(); p != m_pending.end(); ++p) {
+			ApplyChange(*tree, *p, filters);
+		}
+		m_isModified = !m_pending.empty();
+		m_pending.clear();
+
+		oldTree = m_root;
+		m_root = tree;
+		++m_generation;
+	}
+
+	delete oldTree;
+	wxWakeUpIdle();
+	return true;
+}
+
+void ProjectFileIndex::Rescan(const wxString& path) {
+	if (m_rootPath.empty()) return;
+
+	wxString dirPath = path;
+	if (!dirPath.EndsWith(wxString(wxFILE_SEP_PATH))) dirPath += wxFILE_SEP_PATH;
+	if (!dirPath.StartsWith(m_rootPath)) return;
+
+	// A running scan picks it up when done with the current dir
+	bool startThread = false;
+	{
+		wxCriticalSectionLocker lock(m_lock);
+		QueueScan(dirPath);
+		if (!m_isScanning) {
+			m_isScanning = true;
+			startThread = true;
+		}
+	}
+
+	if (startThread) StartThread(false);
+}
+
+void ProjectFileIndex::QueueScan(const wxString& dirPath) {
+	// Assumes m_lock is locked
+	for (vector<wxString>::iterator p = m_toScan.begin(); p != m_toScan.end();) {
+		if (dirPath.StartsWith(*p)) return; // already queued
+		if (p->StartsWith(dirPath)) p = m_toScan.erase(p); // covered by new dir
+		else ++p;
+	}
+	m_toScan.push_back(dirPath.c_str()); // wxString is not threadsafe, so we have to force copy
+}
+
+bool ProjectFileIndex::NextScan(wxString& dirPath) {
+	wxCriticalSectionLocker lock(m_lock);
+
+	if (m_toScan.empty() || m_stopScan) {
+		m_isScanning = false;
+		return false;
+	}
+
+	// Parent dirs are queued before their subdirs
+	dirPath = m_toScan.front().c_str();
+	m_toScan.erase(m_toScan.begin());
+	return true;
+}
+
+bool ProjectFileIndex::ScanSubDir(const wxString& rootPath, const wxString& dirPath) {
+	ProjectInfoHandler filters;
+	filters.SetRoot(wxFileName(rootPath));
+
+	// Only dirs included in the project are indexed
+	const wxString path = dirPath.substr(0, dirPath.size()-1);
+	const wxString name = path.AfterLast(wxFILE_SEP_PATH);
+	bool isIncluded = true;
+	if (dirPath != rootPath) {
+		const wxString parentPath = path.substr(0, path.size() - name.size());
+		isIncluded = filters.GetDirFilters(parentPath).IsDirIncluded(name);
+#ifndef __WXMSW__
+		if (name.StartsWith(wxT("."))) isIncluded = false; // hidden
+#endif
+	}
+
+	// The dir may be gone
+	Dir* tree = NULL;
+	if (isIncluded && wxDirExists(dirPath)) {
+		tree = new Dir;
+		if (!ScanDir(dirPath, *tree, filters)) {
+			delete tree;
+			return false;
+		}
+	}
+
+	Dir* oldTree = NULL;
+	{
+		wxCriticalSectionLocker lock(m_lock);
+
+		if (dirPath == rootPath) {
+			oldTree = m_root;
+			m_root = tree ? tree : new Dir;
+			tree = NULL;
+		}
+		else if (m_root && isIncluded) {
+			// Replace the dir in the current tree (the new dir is moved in
+			// rather than copied, so that no strings are shared with it)
+			wxString dirName;
+			Dir* parent = FindParent(*m_root, path, dirName);
+			if (parent) {
+				parent->RemoveDir(dirName);
+				if (tree) {
+					tree->name = dirName;
+					parent->InsertDir(tree);
+					tree = NULL;
+				}
+			}
+		}
+
+		// The changes may be in the tree already, but
+		// as they can be applied again it does not matter
+		if (m_root) {
+			for (vector<Change>::const_iterator p = m_pending.begin(); p != m_pending.end(); ++p) {
+				ApplyChange(*m_root, *p, filters);
+			}
+		}
+		m_pending.clear();
+
+		m_isModified = true;
+		++m_generation;
+	}
+
+	delete tree;
+	delete oldTree;
+	wxWakeUpIdle();
+	return true;
+}
+
+bool ProjectFileIndex::ScanDir(const wxString& path, Dir& dir, const ProjectInfoHandler& filters) const {
+	wxArrayString dirNames;
+	filters.GetDirAndFileLists(path, dirNames, dir.files);
+
+	for (size_t i = 0; i < dirNames.GetCount(); ++i) {
+		if (m_stopScan) return false;
+
+		Dir* subDir = new Dir;
+		subDir->name = dirNames[i];
+		dir.dirs.push_back(subDir);
+
+		if (!ScanDir(path + dirNames[i] + wxFILE_SEP_PATH, *subDir, filters)) return false;
+	}
+
+	return true;
+}
+
+void ProjectFileIndex::ApplyChange(Dir& root, const Change& change, const ProjectInfoHandler& filters) {
+	switch (change.changeType) {
+	case DIRWATCHER_FILE_ADDED:
+		AddPath(root, change.path, filters);
+		break;
+
+	case DIRWATCHER_FILE_REMOVED:
+		RemovePath(root, change.path);
+		break;
+
+	case DIRWATCHER_FILE_RENAMED:
+		if (!MoveDir(root, change.path, change.newPath, filters)) {
+			RemovePath(root, change.path);
+			AddPath(root, change.newPath, filters);
+		}
+		break;
+	}
+}
+
+bool ProjectFileIndex::AddPath(Dir& root, const wxString& path, const ProjectInfoHandler& filters) {
+	wxString name;
+	Dir* parent = FindParent(root, path, name);
+	if (!parent) return false;
+
+	if (wxDirExists(path)) {
+		if (!IsIncluded(path, name, true, filters)) return false;
+
+		// A new dir may be a big tree (like an unpacked archive), so it
+		// is scanned in the background rather than while holding the lock.
+		// If already indexed, it is kept until then, as the scan that
+		// found it may have been done before it was filled.
+		if (!parent->GetDir(name)) parent->AddDir(name);
+		QueueScan(path + wxFILE_SEP_PATH);
+		return true;
+	}
+
+	// It may have been deleted again
+	if (!wxFileExists(path)) return false;
+	if (!IsIncluded(path, name, false, filters)) return false;
+
+	parent->AddFile(name);
+	return true;
+}
+
+bool ProjectFileIndex::MoveDir(Dir& root, const wxString& path, const wxString& newPath, const ProjectInfoHandler& filters) const {
+	wxString name;
+	Dir* parent = FindParent(root, path, name);
+	if (!parent || !parent->GetDir(name)) return false; // not an indexed dir
+
+	wxString newName;
+	Dir* newParent = FindParent(root, newPath, newName);
+	if (!newParent || !wxDirExists(newPath) || !IsIncluded(newPath, newName, true, filters)) {
+		// Moved out of the index
+		parent->RemoveDir(name);
+		return true;
+	}
+
+	// The dir keeps its contents, so it does not have to be scanned again
+	Dir* dir = parent->TakeDir(name);
+	dir->name = newName.c_str(); // wxString is not threadsafe, so we have to force copy
+	newParent->RemoveDir(newName); // replaced
+	newParent->InsertDir(dir);
+	return true;
+}
+
+bool ProjectFileIndex::IsIncluded(const wxString& path, const wxString& name, bool isDir, const ProjectInfoHandler& filters) const {
+	// Hidden files are not indexed (same as when walking the dirs)
+#ifdef __WXMSW__
+	const DWORD dwAttrs = ::GetFileAttributes(path.c_str());
+	if (dwAttrs != INVALID_FILE_ATTRIBUTES && (dwAttrs & FILE_ATTRIBUTE_HIDDEN)) return false;
+#else
+	if (name.StartsWith(wxT("."))) return false;
+#endif
+
+	// Get filters for parent dir
+	const wxString parentPath = path.substr(0, path.size() - name.size());
+	const ProjectFilters& dirFilters = filters.GetDirFilters(parentPath);
+
+	return isDir ? dirFilters.IsDirIncluded(name) : dirFilters.IsFileIncluded(name);
+}
+
+bool ProjectFileIndex::RemovePath(Dir& root, const wxString& path) const {
+	wxString name;
+	Dir* parent = FindParent(root, path, name);
+	if (!parent) return false;
+
+	// We can't check the type of something that is gone
+	return parent->RemoveFile(name) || parent->RemoveDir(name);
+}
+
+ProjectFileIndex::Dir* ProjectFileIndex::FindParent(Dir& root, const wxString& path, wxString& name) const {
+	wxString relPath;
+	if (!path.StartsWith(m_rootPath, &relPath)) return NULL;
+
+	wxArrayString dirs = wxStringTokenize(relPath, wxFileName::GetPathSeparators(), wxTOKEN_STRTOK);
+	if (dirs.IsEmpty()) return NULL;
+
+	// We need the target file- or dir-name separate from the dirs
+	name = dirs.Last();
+	dirs.RemoveAt(dirs.GetCount()-1);
+
+	// Changes in dirs that are not indexed are ignored
+	Dir* dir = &root;
+	for (size_t i = 0; dir && i < dirs.GetCount(); ++i) dir = dir->GetDir(dirs[i]);
+	return dir;
+}
+
+wxString ProjectFileIndex::GetSnapshotPath(const wxString& snapshotDir, const wxString& rootPath) { // static
+	if (!wxDirExists(snapshotDir)) wxMkdir(snapshotDir);
+
+	// Name the snapshot by hash of root path (FNV-1a)
+	unsigned int hash = 2166136261u;
+	for (size_t i = 0; i < rootPath.size(); ++i) {
+		hash = (hash ^ (unsigned int)rootPath[i]) * 16777619u;
+	}
+
+	wxFileName path(snapshotDir, wxString::Format(wxT("%08x.idx"), hash));
+	return path.GetFullPath();
+}
+
+// Snapshot format (all integers are 32bit little-endian, strings are utf-8
+// prefixed with their byte length):
+//
+//   magic, version, root path, root dir
+//
+// where each dir is written as
+//
+//   file count, file names, dir count, (dir name, dir) for each subdir
+
+static void projectfileindex_write_uint(unsigned int value, vector<char>& out) {
+	out.push_back((char)(value & 0xFF));
+	out.push_back((char)((value >> 8) & 0xFF));
+	out.push_back((char)((value >> 16) & 0xFF));
+	out.push_back((char)((value >> 24) & 0xFF));
+}
+
+static void projectfileindex_write_string(const wxString& str, vector<char>& out) {
+	const wxCharBuffer buf = str.mb_str(wxConvUTF8);
+	const size_t len = strlen(buf.data());
+	projectfileindex_write_uint((unsigned int)len, out);
+	out.insert(out.end(), buf.data(), buf.data() + len);
+}
+
+static bool projectfileindex_read_uint(const char*& p, const char* end, unsigned int& value) {
+	if (end - p < 4) return false;
+
+	const unsigned char* b = (const unsigned char*)p;
+	value = b[0] | (b[1] << 8) | (b[2] << 16) | (b[3] << 24);
+	p += 4;
+	return true;
+}
+
+static bool projectfileindex_read_string(const char*& p, const char* end, wxString& str) {
+	unsigned int len;
+	if (!projectfileindex_read_uint(p, end, len)) return false;
+	if ((unsigned int)(end - p) < len) return false;
+
+	str = wxString(p, wxConvUTF8, len);
+	p += len;
+	return true;
+}
+
+bool ProjectFileIndex::SaveSnapshot(const Dir& root, const wxString& rootPath, const wxString& snapshotPath) { // static
+	vector<char> out;
+	projectfileindex_write_uint(SNAPSHOT_MAGIC, out);
+	projectfileindex_write_uint(SNAPSHOT_VERSION, out);
+	projectfileindex_write_string(rootPath, out);
+	WriteDir(root, out);
+
+	// Write to temp file first, so that we never leave a partial snapshot
+	const wxString tempPath = snapshotPath + wxT(".tmp");
+	{
+		wxFFile file(tempPath, wxT("wb"));
+		if (!file.IsOpened()) return false;
+		if (file.Write(&*out.begin(), out.size()) != out.size()) return false;
+	}
+
+	return wxRenameFile(tempPath, snapshotPath, true);
+}
+
+void ProjectFileIndex::WriteDir(const Dir& dir, vector<char>& out) { // static
+	projectfileindex_write_uint((unsigned int)dir.files.GetCount(), out);
+	for (size_t i = 0; i < dir.files.GetCount(); ++i) {
+		projectfileindex_write_string(dir.files[i], out);
+	}
+
+	projectfileindex_write_uint((unsigned int)dir.dirs.size(), out);
+	for (vector<Dir*>::const_iterator p = dir.dirs.begin(); p != dir.dirs.end(); ++p) {
+		projectfileindex_write_string((*p)->name, out);
+		WriteDir(**p, out);
+	}
+}
+
+ProjectFileIndex::Dir* ProjectFileIndex::LoadSnapshot(const wxString& rootPath, const wxString& snapshotPath) { // static
+	if (!wxFileExists(snapshotPath)) return NULL;
+
+	vector<char> buf;
+	{
+		wxFFile file(snapshotPath, wxT("rb"));
+		if (!file.IsOpened()) return NULL;
+
+		const wxFileOffset len = file.Length();
+		if (len <= 0) return NULL;
+
+		buf.resize((size_t)len);
+		if (file.Read(&*buf.begin(), buf.size()) != buf.size()) return NULL;
+	}
+
+	const char* p = &*buf.begin();
+	const char* const end = p + buf.size();
+
+	unsigned int magic;
+	unsigned int version;
+	wxString path;
+	if (!projectfileindex_read_uint(p, end, magic) || magic != SNAPSHOT_MAGIC) return NULL;
+	if (!projectfileindex_read_uint(p, end, version) || version != SNAPSHOT_VERSION) return NULL;
+	if (!projectfileindex_read_string(p, end, path) || path != rootPath) return NULL;
+
+	Dir* root = new Dir;
+	if (!ReadDir(*root, p, end)) {
+		delete root;
+		return NULL;
+	}
+	return root;
+}
+
+bool ProjectFileIndex::ReadDir(Dir& dir, const char*& p, const char* end) { // static
+	unsigned int fileCount;
+	if (!projectfileindex_read_uint(p, end, fileCount)) return false;
+
+	wxString name;
+	for (unsigned int i = 0; i < fileCount; ++i) {
+		if (!projectfileindex_read_string(p, end, name)) return false;
+		dir.files.Add(name);
+	}
+
+	unsigned int dirCount;
+	if (!projectfileindex_read_uint(p, end, dirCount)) return false;
+
+	for (unsigned int i = 0; i < dirCount; ++i) {
+		Dir* subDir = new Dir;
+		dir.dirs.push_back(subDir);
+
+		if (!projectfileindex_read_string(p, end, subDir->name)) return false;
+		if (!ReadDir(*subDir, p, end)) return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,122 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#ifndef __PROJECTFILEINDEX_H__
+#define __PROJECTFILEINDEX_H__
+
+#include "wx/wxprec.h"
+#ifndef WX_PRECOMP
+	#include <wx/wx.h>
+#endif
+
+#include <wx/thread.h>
+#include <vector>
+
+class ProjectInfoHandler;
+
+// All files in the project (matching the project filters), kept in memory
+// so that Go to File, Find in Project and the dir watching do not have to
+// walk the filesystem.
+//
+// When a root is set, the index is first loaded from the last snapshot
+// and then rescanned in a background thread. After that it is kept current
+// by the changes reported by the DirWatcher.
+//
+// The queries can be called from any thread.
+class ProjectFileIndex {
+public:
+	ProjectFileIndex(const ProjectInfoHandler& filters);
+	~ProjectFileIndex();
+
+	void SetRoot(const wxString& rootPath, const wxString& snapshotDir);
+	void Clear();
+
+	bool IsReady() const;
+	bool IsScanning() const;
+	unsigned int GetGeneration() const; // changes when the index is replaced by snapshot or scan
+
+	// Full paths of all files (in depth-first order, files before subdirs)
+	void GetFiles(std::vector<wxString>& paths) const;
+
+	// Full paths of all indexed dirs below path
+	void GetDirs(const wxString& path, std::vector<wxString>& dirs) const;
+
+	// Update from DirWatcher events (gui thread only)
+	void OnDirChanged(int changeType, const wxString& path, const wxString& newPath);
+
+	// Rescan dir (and subdirs) in background, when the changes are not known
+	void Rescan(const wxString& path);
+
+private:
+	class Dir;
+	class ScanThread;
+	friend class ScanThread;
+
+	struct Change {
+		int changeType;
+		wxString path;
+		wxString newPath;
+	};
+
+	void StartThread(bool fullScan);
+	void QueueScan(const wxString& dirPath);
+
+	// Called from scan thread
+	bool Scan(const wxString& rootPath, const wxString& snapshotPath);
+	bool NextScan(wxString& dirPath);
+	bool ScanSubDir(const wxString& rootPath, const wxString& dirPath);
+
+	bool ScanDir(const wxString& path, Dir& dir, const ProjectInfoHandler& filters) const;
+	void ApplyChange(Dir& root, const Change& change, const ProjectInfoHandler& filters);
+	bool AddPath(Dir& root, const wxString& path, const ProjectInfoHandler& filters);
+	bool MoveDir(Dir& root, const wxString& path, const wxString& newPath, const ProjectInfoHandler& filters) const;
+	bool RemovePath(Dir& root, const wxString& path) const;
+	bool IsIncluded(const wxString& path, const wxString& name, bool isDir, const ProjectInfoHandler& filters) const;
+	Dir* FindParent(Dir& root, const wxString& path, wxString& name) const;
+
+	static void GetFiles(const Dir& dir, const wxString& prefix, std::vector<wxString>& paths);
+	static void GetDirs(const Dir& dir, const wxString& prefix, std::vector<wxString>& dirs);
+
+	// Snapshots
+	static wxString GetSnapshotPath(const wxString& snapshotDir, const wxString& rootPath);
+	static bool SaveSnapshot(const Dir& root, const wxString& rootPath, const wxString& snapshotPath);
+	static Dir* LoadSnapshot(const wxString& rootPath, const wxString& snapshotPath);
+	static void WriteDir(const Dir& dir, std::vector<char>& out);
+	static bool ReadDir(Dir& dir, const char*& p, const char* end);
+
+	// Constants
+	static const unsigned int SNAPSHOT_MAGIC;
+	static const unsigned int SNAPSHOT_VERSION;
+
+	// Member variables
+	const ProjectInfoHandler& m_filters;
+	mutable wxCriticalSection m_lock;
+	wxString m_rootPath; // with trailing separator
+	wxString m_snapshotPath;
+	Dir* m_root; // NULL until first loaded
+	unsigned int m_generation;
+	bool m_isModified; // since last snapshot
+
+	// Scan state (guarded by m_lock)
+	ScanThread* m_thread;
+	bool m_isScanning; // until the thread has no more dirs to scan
+	volatile bool m_stopScan;
+	std::vector<Change> m_pending; // changes to replay on the new tree
+	std::vector<wxString> m_toScan; // dirs waiting for the scan thread
+
+private:
+	ProjectFileIndex(const ProjectFileIndex&);
+	ProjectFileIndex& operator=(const ProjectFileIndex&);
+};
+
+#endif // __PROJECTFILEINDEX_H__
@@ -1,7 +1,18 @@
 #include "ProjectInfoHandler.h"
+#include "ProjectFileIndex.h"
 #include "Strings.h"
 #include "wx/dir.h"
 
+ProjectInfoHandler::ProjectInfoHandler() : m_rootFilters(NULL) {
+	m_fileIndex = new ProjectFileIndex(*this);
+	ClearFilterCache();
+}
+
+ProjectInfoHandler::~ProjectInfoHandler() {
+	delete m_fileIndex;
+	for (std::vector<ProjectFilters*>::iterator p = m_filters.begin(); p != m_filters.end(); ++p) delete *p;
+}
+
 void ProjectInfoHandler::SetRoot(const wxFileName& path) {
 	m_prjPath = path;
 	m_projectInfo.Clear();
@@ -9,6 +20,8 @@ void ProjectInfoHandler::SetRoot(const wxFileName& path) {
 	const wxString rootPath = path.GetPath() + wxFILE_SEP_PATH;
 	m_projectInfo.Load(rootPath, rootPath, false);
 	//LoadProjectInfo(rootPath, false, m_projectInfo);
+
+	ClearFilterCache();
 }
 
 void ProjectInfoHandler::SaveRootInfo() const {
@@ -25,11 +38,7 @@ bool ProjectInfoHandler::GetDirAndFileLists(const wxString& path, wxArrayString&
 	if (!d.IsOpened()) return false;
 
 	// Check for project settings
-	wxArrayString includeDirs;
-	wxArrayString excludeDirs;
-	wxArrayString includeFiles;
-	wxArrayString excludeFiles;
-	GetFilters(path, includeDirs, excludeDirs, includeFiles, excludeFiles);
+	const ProjectFilters& filters = GetDirFilters(path);
 
 	// Get all subdirs
 	wxString eachFilename;
@@ -40,7 +49,7 @@ bool ProjectInfoHandler::GetDirAndFileLists(const wxString& path, wxArrayString&
         {
             if ((eachFilename != wxT(".")) && (eachFilename != wxT("..")))
             {
-                if (MatchFilter(eachFilename, includeDirs, excludeDirs)) {
+                if (filters.IsDirIncluded(eachFilename)) {
 					dirs.Add(eachFilename);
 				}
             }
@@ -57,7 +66,7 @@ bool ProjectInfoHandler::GetDirAndFileLists(const wxString& path, wxArrayString&
         {
             if ((eachFilename != wxT(".")) && (eachFilename != wxT("..")))
             {
-                if (MatchFilter(eachFilename, includeFiles, excludeFiles)) {
+                if (filters.IsFileIncluded(eachFilename)) {
 					files.Add(eachFilename);
 				}
             }
@@ -70,33 +79,48 @@ bool ProjectInfoHandler::GetDirAndFileLists(const wxString& path, wxArrayString&
 }
 
 void ProjectInfoHandler::GetFilters(const wxString& path, wxArrayString& incDirs, wxArrayString& excDirs, wxArrayString& incFiles, wxArrayString& excFiles) const {
+	GetDirFilters(path).GetPatterns(incDirs, excDirs, incFiles, excFiles);
+}
+
+const ProjectFilters& ProjectInfoHandler::GetDirFilters(const wxString& path) const {
 	wxFileName dirPath(path, wxEmptyString);
+	return FindDirFilters(dirPath);
+}
 
-	while(1) { // Eventually we will walk back to the project root, so the first if condition will return.
-		if (m_prjPath == dirPath) {
-			// Return root filters
-			incDirs = m_projectInfo.includeDirs;
-			excDirs = m_projectInfo.excludeDirs;
-			incFiles = m_projectInfo.includeFiles;
-			excFiles = m_projectInfo.excludeFiles;
-			return;
-		}
+const ProjectFilters& ProjectInfoHandler::FindDirFilters(wxFileName& dirPath) const {
+	const wxString key = dirPath.GetPath();
 
+	std::map<wxString, const ProjectFilters*>::const_iterator p = m_dirFilters.find(key);
+	if (p != m_dirFilters.end()) return *p->second;
+
+	// Eventually we will walk back to the project root
+	const ProjectFilters* filters = m_rootFilters;
+	if (dirPath.GetDirCount() > m_prjPath.GetDirCount()) {
 		cxProjectInfo info;
-		
-		if (info.Load(m_prjPath, dirPath.GetPath(), true)) {
-			incDirs = info.includeDirs;
-			excDirs = info.excludeDirs;
-			incFiles = info.includeFiles;
-			excFiles = info.excludeFiles;
-			return;
+		if (info.Load(m_prjPath, key, true)) {
+			ProjectFilters* dirFilters = new ProjectFilters(info);
+			m_filters.push_back(dirFilters);
+			filters = dirFilters;
+		}
+		else {
+			// See if we can inherit filters from parent
+			dirPath.RemoveLastDir();
+			filters = &FindDirFilters(dirPath);
 		}
-
-		// See if we can inherit filters from parent
-		dirPath.RemoveLastDir();
 	}
+
+	m_dirFilters[key] = filters;
+	return *filters;
 }
 
+void ProjectInfoHandler::ClearFilterCache() {
+	m_dirFilters.clear();
+	for (std::vector<ProjectFilters*>::iterator p = m_filters.begin(); p != m_filters.end(); ++p) delete *p;
+	m_filters.clear();
+
+	m_rootFilters = new ProjectFilters(m_projectInfo);
+	m_filters.push_back(m_rootFilters);
+}
 
 void ProjectInfoHandler::SetTrigger(const wxString& trigger, const wxString& path) {
 	m_projectInfo.triggers[trigger] = path;
@@ -128,3 +152,23 @@ bool ProjectInfoHandler::MatchFilter(const wxString& name, const wxArrayString&
 
 	return true;
 }
+
+// ---- ProjectFilters ----------------------------------------------------
+
+ProjectFilters::ProjectFilters(const cxProjectInfo& info)
+: m_includeDirs(info.includeDirs), m_excludeDirs(info.excludeDirs),
+  m_includeFiles(info.includeFiles), m_excludeFiles(info.excludeFiles) {
+	m_info.SetFilters(info.includeDirs, info.excludeDirs, info.includeFiles, info.excludeFiles);
+}
+
+void ProjectFilters::GetPatterns(wxArrayString& incDirs, wxArrayString& excDirs, wxArrayString& incFiles, wxArrayString& excFiles) const {
+	incDirs = m_info.includeDirs;
+	excDirs = m_info.excludeDirs;
+	incFiles = m_info.includeFiles;
+	excFiles = m_info.excludeFiles;
+}
+
+bool ProjectFilters::Match(const wxString& name, const WildcardSet& incFilter, const WildcardSet& excFilter) { // static
+	if (!incFilter.IsEmpty() && !incFilter.Match(name)) return false;
+	return !excFilter.Match(name);
+}
@@ -7,12 +7,40 @@
 #endif
 
 #include <map>
+#include <vector>
 
 #include <wx/filename.h>
 #include "ProjectInfo.h"
+#include "WildcardSet.h"
+
+class ProjectFileIndex;
+
+// The filters that apply to a dir, compiled for matching
+class ProjectFilters {
+public:
+	ProjectFilters(const cxProjectInfo& info);
+
+	bool IsDirIncluded(const wxString& name) const {return Match(name, m_includeDirs, m_excludeDirs);};
+	bool IsFileIncluded(const wxString& name) const {return Match(name, m_includeFiles, m_excludeFiles);};
+
+	void GetPatterns(wxArrayString& incDirs, wxArrayString& excDirs, wxArrayString& incFiles, wxArrayString& excFiles) const;
+
+private:
+	static bool Match(const wxString& name, const WildcardSet& incFilter, const WildcardSet& excFilter);
+
+	// Member variables
+	cxProjectInfo m_info;
+	WildcardSet m_includeDirs;
+	WildcardSet m_excludeDirs;
+	WildcardSet m_includeFiles;
+	WildcardSet m_excludeFiles;
+};
 
 class ProjectInfoHandler {
 public:
+	ProjectInfoHandler();
+	~ProjectInfoHandler();
+
 	void SetRoot(const wxFileName& path);
 	const wxFileName& GetRoot() const {return m_prjPath;};
 	bool HasProject() const {return m_prjPath.IsOk();};
@@ -23,20 +51,37 @@ public:
 
 	bool GetDirAndFileLists(const wxString& path, wxArrayString& dirs, wxArrayString& files) const;
 
-	// Filters
+	// Filters (cached per dir until ClearFilterCache is called)
+	const ProjectFilters& GetDirFilters(const wxString& path) const;
 	void GetFilters(const wxString& path, wxArrayString& incDirs, wxArrayString& excDirs, wxArrayString& incFiles, wxArrayString& excFiles) const;
 	static bool MatchFilter(const wxString& name, const wxArrayString& incFilter, const wxArrayString& excFilter);
+	void ClearFilterCache();
 
 	// GotoFile triggers
 	const std::map<wxString,wxString>& GetTriggers() const {return m_projectInfo.triggers;};
 	void SetTrigger(const wxString& trigger, const wxString& path);
 	void ClearTrigger(const wxString& trigger);
 
+	// File index (has to be started with SetRoot on the index)
+	ProjectFileIndex& GetFileIndex() {return *m_fileIndex;};
+	const ProjectFileIndex& GetFileIndex() const {return *m_fileIndex;};
+
 private:
+	const ProjectFilters& FindDirFilters(wxFileName& dirPath) const;
 
 	// Member variables
 	wxFileName m_prjPath;
 	cxProjectInfo m_projectInfo;
+	ProjectFileIndex* m_fileIndex;
+
+	// Filter cache (dirs without their own filters share the parents)
+	ProjectFilters* m_rootFilters;
+	mutable std::map<wxString, const ProjectFilters*> m_dirFilters;
+	mutable std::vector<ProjectFilters*> m_filters;
+
+private:
+	ProjectInfoHandler(const ProjectInfoHandler&);
+	ProjectInfoHandler& operator=(const ProjectInfoHandler&);
 };
 
 #endif // __PROJECTINFOHANDLER_H__
@@ -28,6 +28,8 @@
 #include "DirWatcher.h"
 #include "RemoteThread.h"
 #include "eDocumentPath.h"
+#include "ProjectFileIndex.h"
+#include "IAppPaths.h"
 
 #include "images/NewFolder.xpm"
 #include "images/NewDocument.xpm"
@@ -176,9 +178,6 @@ ProjectPane::ProjectPane(IFrameProjectService& projectServce, wxWindow*parent, w
 	wxAcceleratorTable accel(accelcount, entries);
 	SetAcceleratorTable(accel);
 
-#ifdef __WXGTK__
-	isDirWatched = false;
-#endif
 	// Start icon retrieval thread
 	wxThreadHelper::Create();
 	GetThread()->Run();
@@ -253,6 +252,7 @@ void ProjectPane::Clear() {
 		m_projectService.GetDirWatcher().UnwatchDirectory(m_dirWatchHandle);
 		m_dirWatchHandle = NULL;
 	}
+	m_infoHandler.GetFileIndex().Clear();
 	ResetBusy();
 }
 
@@ -297,7 +297,10 @@ void ProjectPane::Init() {
 	}
 
 	// Load project info (if available)
-	if (!m_isRemote) m_infoHandler.SetRoot(m_prjPath);
+	if (!m_isRemote) {
+		m_infoHandler.SetRoot(m_prjPath);
+		m_infoHandler.GetFileIndex().SetRoot(m_prjPath.GetPath(), GetAppPaths().AppDataPath() + wxT("ProjectIndex"));
+	}
 
 	// Always start with root expanded
 	Freeze();
@@ -308,16 +311,7 @@ void ProjectPane::Init() {
 	// Watch for changes to the dir
 	if (!m_isRemote) {
 		wxASSERT(m_dirWatchHandle == NULL);
-#ifdef __WXMSW__
 		m_dirWatchHandle = m_projectService.GetDirWatcher().WatchDirectory(m_prjPath.GetPath(), *this, true);
-#else
-		if (!isDirWatched) {
-			m_dirWatchHandle = m_projectService.GetDirWatcher().WatchDirectory(m_prjPath.GetPath(),
-				*this, true);
-			WatchTree(m_prjPath.GetPath());
-			isDirWatched = true;
-		}
-#endif
 	}
 }
 
@@ -790,6 +784,36 @@ void ProjectPane::RefreshDirs() {
 	Thaw();
 }
 
+void ProjectPane::RefreshDir(const wxString& path) {
+	const wxTreeItemId item = GetItemFromPath(path);
+	if (!item.IsOk()) return; // not visible
+
+	// Contents of collapsed dirs are read when expanded
+	DirItemData *data = (DirItemData *) m_prjTree->GetItemData(item);
+	if (!data->m_isExpanded) {
+		m_prjTree->SetItemHasChildren(item);
+		return;
+	}
+
+	// Remember expanded subdirs and selections
+	wxArrayString expandedDirs;
+	GetExpandedDirs(item, expandedDirs);
+	wxArrayString selections = GetSelections();
+	const int scrollPos = m_prjTree->GetScrollPos(wxVERTICAL);
+
+	Freeze();
+	{
+		// Collapse and reload
+		CollapseDir(item);
+		ExpandDir(item);
+		m_prjTree->Expand(item);
+
+		ExpandAndSelect(item, expandedDirs, selections);
+		m_prjTree->SetScrollPos(wxVERTICAL, scrollPos);
+	}
+	Thaw();
+}
+
 void ProjectPane::ExpandAndSelect(wxTreeItemId item, wxArrayString& expandedDirs, wxArrayString& selections) {
 	wxASSERT(item);
 
@@ -1347,6 +1371,15 @@ void ProjectPane::OnDirChanged(wxDirWatcherEvent& event) {
 
 	//const wxString msg = wxString::Format(wxT("%s Changed (%d)\n"), path.c_str(), changeType);
 	//OutputDebugString(msg);
+
+	// Too many changes to handle one by one (or they were lost)
+	if (changeType == DIRWATCHER_RESCAN) {
+		m_atomicPath.clear();
+		m_infoHandler.ClearFilterCache();
+		m_infoHandler.GetFileIndex().OnDirChanged(changeType, path, wxEmptyString);
+		RefreshDir(path);
+		return;
+	}
 	
 	// On atomic saves we just ignore any changes
 	if (path.EndsWith(wxT(".etmp"))) {
@@ -1357,6 +1390,19 @@ void ProjectPane::OnDirChanged(wxDirWatcherEvent& event) {
 		else if (changeType == DIRWATCHER_FILE_RENAMED) m_atomicPath.clear(); // atomic save done
 	}
 	if (changeType == DIRWATCHER_FILE_REMOVED && path == m_atomicPath) return;
+
+	// Changed project settings may change the filters, so the
+	// dir they are in has to be indexed again with the new ones
+	wxString settingsPath;
+	if (path.AfterLast(wxFILE_SEP_PATH) == wxT(".eprj")) settingsPath = path;
+	else if (changeType == DIRWATCHER_FILE_RENAMED && event.GetNewFile().AfterLast(wxFILE_SEP_PATH) == wxT(".eprj")) settingsPath = event.GetNewFile();
+	if (!settingsPath.empty()) {
+		m_infoHandler.ClearFilterCache();
+		m_infoHandler.GetFileIndex().Rescan(settingsPath.BeforeLast(wxFILE_SEP_PATH));
+	}
+
+	// Keep the file index current (also for dirs that are not expanded)
+	m_infoHandler.GetFileIndex().OnDirChanged(changeType, path, event.GetNewFile());
 	
 	// Make path relative to project
 	wxString relativePath;
@@ -1436,15 +1482,6 @@ void ProjectPane::OnDirChanged(wxDirWatcherEvent& event) {
 	case DIRWATCHER_FILE_REMOVED:
 	case DIRWATCHER_FILE_RENAMED:
 		{
-#ifdef __WXGTK__
-			if (event.IsDir()) {
-				wxLogDebug(wxT("ProjectPane::%s() remove directory %s"),
-					 wxString(__FUNCTION__,wxConvUTF8).c_str(), path.c_str());
-				// need to remove dir watcher for this dir and all subdirs
-				m_projectService.GetDirWatcher().UnwatchDirByName(path, true);
-				// and for all subdirs
-			}
-#endif
 			// Find the file
 			wxTreeItemIdValue cookie;
 			wxTreeItemId subItem = m_prjTree->GetFirstChild(item, cookie);
@@ -1467,26 +1504,12 @@ void ProjectPane::OnDirChanged(wxDirWatcherEvent& event) {
 				wxFileName newFile(event.GetNewFile());
 
 				// If the new name does not match filter, remove it
-				wxArrayString includeDirs;
-				wxArrayString excludeDirs;
-				wxArrayString includeFiles;
-				wxArrayString excludeFiles;
 				const wxFileName parentPath(path);
-				m_infoHandler.GetFilters(parentPath.GetPath(), includeDirs, excludeDirs, includeFiles, excludeFiles);
-				if (!m_infoHandler.MatchFilter(newFile.GetFullName(), includeDirs, excludeDirs)) {
+				const ProjectFilters& filters = m_infoHandler.GetDirFilters(parentPath.GetPath());
+				if (!filters.IsDirIncluded(newFile.GetFullName())) {
 					if (itemFound) m_prjTree->Delete(subItem);
 					return;
 				}
-#ifdef __WXGTK__
-				if (event.IsDir()) {
-					// need to watch directory
-					m_projectService.GetDirWatcher().WatchDirectory(event.GetNewFile(), *this, true);
-					wxLogDebug(wxT("ProjectPane::%s() changed directory directory %s"),
-					 	wxString(__FUNCTION__,wxConvUTF8).c_str(), path.c_str());
-					// watch subdirs if exists
-					WatchTree(event.GetNewFile());
-				}
-#endif
 				if (itemFound) {
 					// Rename the file
 					m_prjTree->SetItemText(subItem, newFile.GetFullName());
@@ -1509,16 +1532,6 @@ void ProjectPane::OnDirChanged(wxDirWatcherEvent& event) {
 		}
 	case DIRWATCHER_FILE_ADDED:
 		{
-#ifdef __WXGTK__
-			if (event.IsDir()) {
-				// need to watch directory
-				m_projectService.GetDirWatcher().WatchDirectory(path, *this, true);
-				wxLogDebug(wxT("ProjectPane::%s() new directory %s"),
-					 wxString(__FUNCTION__,wxConvUTF8).c_str(), path.c_str());
-				// watch subdirs if exists
-				WatchTree(path);
-			}
-#endif
 #ifdef __WXMSW__
 			// Ignore hidden files
 			const DWORD dwAttrs = ::GetFileAttributes(path.c_str());
@@ -1526,15 +1539,11 @@ void ProjectPane::OnDirChanged(wxDirWatcherEvent& event) {
 #endif //__WXMSW__
 
 			// Get filters for parent dir
-			wxArrayString includeDirs;
-			wxArrayString excludeDirs;
-			wxArrayString includeFiles;
-			wxArrayString excludeFiles;
 			const wxFileName parentPath(path);
-			m_infoHandler.GetFilters(parentPath.GetPath(), includeDirs, excludeDirs, includeFiles, excludeFiles);
+			const ProjectFilters& filters = m_infoHandler.GetDirFilters(parentPath.GetPath());
 
 			if (wxDir::Exists(path)) {
-				if (!m_infoHandler.MatchFilter(fileName, includeDirs, excludeDirs)) return;
+				if (!filters.IsDirIncluded(fileName)) return;
 				wxTreeItemId id = FindSubItem(item, fileName);
 				if (!id.IsOk()) {
 					// The dir may have been deleted/renamed again
@@ -1545,13 +1554,6 @@ void ProjectPane::OnDirChanged(wxDirWatcherEvent& event) {
 					DirItemData *dir_item = new DirItemData(path, fileName, true, image_id, m_freeImages);
 					id = m_prjTree->AppendItem(item, fileName, image_id, -1, dir_item);
 
-					// Get filters for subdir
-					includeDirs.Empty();
-					excludeDirs.Empty();
-					includeFiles.Empty();
-					excludeFiles.Empty();
-					m_infoHandler.GetFilters(path, includeDirs, excludeDirs, includeFiles, excludeFiles);
-
 					if (!projectpane_is_dir_empty(path))
 						m_prjTree->SetItemHasChildren(id);
 				}
@@ -1566,7 +1568,7 @@ void ProjectPane::OnDirChanged(wxDirWatcherEvent& event) {
 				}
 			}
 			else {
-				if (!m_infoHandler.MatchFilter(fileName, includeFiles, excludeFiles)) return;
+				if (!filters.IsFileIncluded(fileName)) return;
 
 				wxTreeItemId id = FindSubItem(item, fileName);
 				if (!id.IsOk()) {
@@ -1748,6 +1750,10 @@ void ProjectPane::OnButtonSettings(wxCommandEvent& WXUNUSED(event)) {
 		wxLogDebug(wxT("projectInfo ok and modified"));
 		dlg.GetSettings(currentInfo);
 		currentInfo.Save(m_prjPath.GetPath());
+
+		// The cached filters are out of date (the file index gets the
+		// new filters when the watcher reports the changed settings)
+		m_infoHandler.ClearFilterCache();
 		RefreshDirs();
 	}
 }
@@ -1883,40 +1889,6 @@ bool ProjectPane::GetIconFromFilePath(const wxString& path, wxIcon &icon) {
 	icon.CopyFromBitmap(newIcon.ConvertToImage().Rescale(16, 16, wxIMAGE_QUALITY_HIGH));
 	return true;
 }
-
-/*
-	Watch all subdirs except itself
-*/
-void ProjectPane::WatchTree(const wxString &path) {
-	wxDir d;
-	wxLogDebug(wxT("ProjectPane::%s() path=%s"), wxString(__FUNCTION__, wxConvUTF8).c_str(), path.c_str());
-	d.Open(path);
-	if (!d.IsOpened()) {
-		return;
-	}
-	// Check for project settings
-	wxArrayString includeDirs;
-	wxArrayString excludeDirs;
-	wxArrayString includeFiles;
-	wxArrayString excludeFiles;
-	m_infoHandler.GetFilters(path, includeDirs, excludeDirs, includeFiles, excludeFiles);
-
-	// Get all subdirs
-	wxString CurrentDir;
- 	int style = wxDIR_DIRS;
-	if (d.GetFirst(&CurrentDir, wxEmptyString, style)) {
-		do {
-			if (eDocumentPath::IsDotDirectory(CurrentDir)) continue;
-
-			if (ProjectInfoHandler::MatchFilter(CurrentDir, includeDirs, excludeDirs)) {
-				// watch dir and all subdirs
-				wxString FullPath = path + wxT("/") + CurrentDir;
-				m_projectService.GetDirWatcher().WatchDirectory(FullPath, *this, true);
-				WatchTree(FullPath);
-			}
-		} while (d.GetNext(&CurrentDir));
-	}
-}
 #endif
 
 void* ProjectPane::Entry() {
@@ -82,7 +82,6 @@ private:
 #ifdef __WXGTK__
 	static bool GetIconFromFilePath(const wxString& path, wxIcon &icon);
 	static bool GetDefaultIcon(wxIcon &icon);
-	void WatchTree(const wxString &path);
 #endif
 
 	void Init();
@@ -96,6 +95,7 @@ private:
 	wxTreeItemId GetItemFromUrl(const wxString& url) const;
 	wxTreeItemId GetItemFromNames(const wxArrayString& dirs) const;
 
+	void RefreshDir(const wxString& path);
 	void RefreshIcon(const wxTreeItemId& item);
 	void RefreshSubItemPaths(const wxTreeItemId& item);
 
@@ -207,9 +207,6 @@ private:
 	};
 
 	std::vector<PathIcon> m_newIcons;
-#ifdef __WXGTK__
-	bool isDirWatched;
-#endif
 
 	friend class DropTarget;
 };
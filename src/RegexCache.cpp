@@ -0,0 +1,199 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#include "RegexCache.h"
+#include "pcre.h"
+
+using namespace std;
+
+struct CompiledRegex::Entry {
+	string key;
+	pcre* re;          // NULL if the pattern is invalid
+	pcre_extra* study; // NULL if study found nothing to speed up
+	unsigned int refCount;
+	bool inCache;
+	list<Entry*>::iterator lruPos;
+};
+
+// ---- CompiledRegex ----------------------------------------------------------------------------------
+
+CompiledRegex::CompiledRegex(const CompiledRegex& cr) : m_entry(cr.m_entry) {
+	if (m_entry) RegexCache::Get().AddRef(m_entry);
+}
+
+CompiledRegex::~CompiledRegex() {
+	if (m_entry) RegexCache::Get().Release(m_entry);
+}
+
+CompiledRegex& CompiledRegex::operator=(const CompiledRegex& cr) {
+	if (cr.m_entry == m_entry) return *this;
+
+	if (cr.m_entry) RegexCache::Get().AddRef(cr.m_entry);
+	if (m_entry) RegexCache::Get().Release(m_entry);
+	m_entry = cr.m_entry;
+	return *this;
+}
+
+bool CompiledRegex::IsOk() const {
+	return m_entry && m_entry->re;
+}
+
+const pcre* CompiledRegex::GetPattern() const {
+	return m_entry ? m_entry->re : NULL;
+}
+
+const pcre_extra* CompiledRegex::GetStudy() const {
+	return m_entry ? m_entry->study : NULL;
+}
+
+// ---- RegexCache -------------------------------------------------------------------------------------
+
+RegexCache RegexCache::s_instance;
+
+RegexCache::RegexCache()
+: m_capacity(256), m_hits(0), m_misses(0), m_evictions(0) {
+}
+
+RegexCache::~RegexCache() {
+	Clear();
+}
+
+RegexCache& RegexCache::Get() { // static
+	return s_instance;
+}
+
+CompiledRegex RegexCache::Lookup(const wxString& pattern, int options) {
+	return Lookup(pattern.mb_str(wxConvUTF8), options);
+}
+
+CompiledRegex RegexCache::Lookup(const char* pattern, int options) {
+	wxASSERT(pattern);
+
+	// The key is the options followed by the pattern bytes
+	string key((const char*)&options, sizeof(options));
+	key += pattern;
+
+	{
+		wxCriticalSectionLocker lock(m_crit);
+
+		EntryMap::iterator p = m_entries.find(key);
+		if (p != m_entries.end()) {
+			CompiledRegex::Entry* entry = p->second;
+			++m_hits;
+			++entry->refCount;
+
+			// Move to front of lru list
+			m_lru.splice(m_lru.begin(), m_lru, entry->lruPos);
+			return CompiledRegex(entry);
+		}
+		++m_misses;
+	}
+
+	// Compile outside the lock, so that other threads are not held up.
+	// Invalid patterns are cached as well, to avoid repeated compiles.
+	const char *error;
+	int erroffset;
+	CompiledRegex::Entry* entry = new CompiledRegex::Entry;
+	entry->key = key;
+	entry->refCount = 1;
+	entry->inCache = true;
+	entry->study = NULL;
+	entry->re = pcre_compile(
+		pattern,              // the pattern
+		options,              // options
+		&error,               // for error message
+		&erroffset,           // for error offset
+		NULL);                // use default character tables
+	if (entry->re) entry->study = pcre_study(entry->re, 0, &error);
+
+	wxCriticalSectionLocker lock(m_crit);
+
+	// Another thread may have added the same pattern while we compiled it
+	EntryMap::iterator p = m_entries.find(key);
+	if (p != m_entries.end()) {
+		FreeEntry(entry);
+		entry = p->second;
+		++entry->refCount;
+		m_lru.splice(m_lru.begin(), m_lru, entry->lruPos);
+		return CompiledRegex(entry);
+	}
+
+	m_entries[key] = entry;
+	m_lru.push_front(entry);
+	entry->lruPos = m_lru.begin();
+	Evict();
+
+	return CompiledRegex(entry);
+}
+
+void RegexCache::AddRef(CompiledRegex::Entry* entry) {
+	wxCriticalSectionLocker lock(m_crit);
+	++entry->refCount;
+}
+
+void RegexCache::Release(CompiledRegex::Entry* entry) {
+	wxCriticalSectionLocker lock(m_crit);
+
+	wxASSERT(entry->refCount > 0);
+	--entry->refCount;
+
+	// Evicted entries are freed when last reference goes
+	if (entry->refCount == 0 && !entry->inCache) FreeEntry(entry);
+}
+
+void RegexCache::Evict() {
+	// Assumes m_crit is locked
+	while (m_entries.size() > m_capacity && !m_lru.empty()) {
+		CompiledRegex::Entry* entry = m_lru.back();
+		m_lru.pop_back();
+		m_entries.erase(entry->key);
+		entry->inCache = false;
+		++m_evictions;
+
+		if (entry->refCount == 0) FreeEntry(entry);
+	}
+}
+
+void RegexCache::FreeEntry(CompiledRegex::Entry* entry) { // static
+	if (entry->study) pcre_free(entry->study);
+	if (entry->re) pcre_free(entry->re);
+	delete entry;
+}
+
+void RegexCache::Clear() {
+	wxCriticalSectionLocker lock(m_crit);
+
+	const size_t capacity = m_capacity;
+	m_capacity = 0;
+	Evict();
+	m_capacity = capacity;
+}
+
+void RegexCache::SetCapacity(size_t capacity) {
+	wxCriticalSectionLocker lock(m_crit);
+
+	m_capacity = capacity;
+	Evict();
+}
+
+RegexCache::Stats RegexCache::GetStats() const {
+	wxCriticalSectionLocker lock(m_crit);
+
+	const Stats stats = {m_hits, m_misses, m_evictions, m_entries.size(), m_capacity};
+	return stats;
+}
+
+void RegexCache::ResetStats() {
+	wxCriticalSectionLocker lock(m_crit);
+	m_hits = m_misses = m_evictions = 0;
+}
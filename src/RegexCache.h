@@ -0,0 +1,103 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#ifndef __REGEXCACHE_H__
+#define __REGEXCACHE_H__
+
+#include "wx/wxprec.h"
+#ifndef WX_PRECOMP
+	#include <wx/wx.h>
+#endif
+
+#include <wx/thread.h>
+#include <list>
+#include <map>
+#include <string>
+
+struct real_pcre;                 // This double pre-definition is needed
+typedef struct real_pcre pcre;    // because of the way it is defined in pcre.h
+struct pcre_extra;
+
+class RegexCache;
+
+// Reference to a compiled (and studied) pattern owned by the RegexCache.
+// The pattern stays valid as long as the reference exists, even if the
+// cache evicts it in the meantime.
+class CompiledRegex {
+public:
+	CompiledRegex() : m_entry(NULL) {};
+	CompiledRegex(const CompiledRegex& cr);
+	~CompiledRegex();
+	CompiledRegex& operator=(const CompiledRegex& cr);
+
+	bool IsOk() const;
+	const pcre* GetPattern() const;
+	const pcre_extra* GetStudy() const;
+
+private:
+	friend class RegexCache;
+	struct Entry;
+	explicit CompiledRegex(Entry* entry) : m_entry(entry) {};
+
+	Entry* m_entry;
+};
+
+// Process-wide LRU cache of compiled patterns, keyed on the pattern
+// bytes and the compile options. Safe to use from worker threads.
+class RegexCache {
+public:
+	static RegexCache& Get();
+
+	CompiledRegex Lookup(const char* pattern, int options);
+	CompiledRegex Lookup(const wxString& pattern, int options);
+
+	void Clear();
+	void SetCapacity(size_t capacity);
+
+	// Diagnostics
+	struct Stats {
+		unsigned int hits;
+		unsigned int misses;
+		unsigned int evictions;
+		size_t size;
+		size_t capacity;
+	};
+	Stats GetStats() const;
+	void ResetStats();
+
+private:
+	friend class CompiledRegex;
+	RegexCache();
+	~RegexCache();
+
+	void AddRef(CompiledRegex::Entry* entry);
+	void Release(CompiledRegex::Entry* entry);
+	void Evict();
+	static void FreeEntry(CompiledRegex::Entry* entry);
+
+	typedef std::map<std::string, CompiledRegex::Entry*> EntryMap;
+	typedef std::list<CompiledRegex::Entry*> LruList;
+
+	static RegexCache s_instance;
+
+	// Member variables
+	mutable wxCriticalSection m_crit;
+	EntryMap m_entries;
+	LruList m_lru; // most recently used first
+	size_t m_capacity;
+	unsigned int m_hits;
+	unsigned int m_misses;
+	unsigned int m_evictions;
+};
+
+#endif // __REGEXCACHE_H__
@@ -0,0 +1,199 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#include "ScopeAtoms.h"
+#include <algorithm>
+
+using namespace std;
+
+// Initializing static constants
+const ScopeAtoms::Atom ScopeAtoms::NOATOM = 0;
+const unsigned int ScopeAtoms::NOSCOPE = 0;
+const unsigned int ScopeAtoms::EMPTYSTACK = 0;
+
+namespace {
+	// A stack is interned as its parent stack plus the innermost scope
+	struct StackKey {
+		StackKey(unsigned int p, unsigned int s) : parent(p), scope(s) {};
+		unsigned int parent;
+		unsigned int scope;
+	};
+
+	class StackKeyHash {
+	public:
+		StackKeyHash() {};
+		unsigned long operator()(const StackKey& k) const {return (k.parent * 2654435761U) ^ k.scope;};
+		StackKeyHash& operator=(const StackKeyHash&) {return *this;};
+	};
+
+	class StackKeyEqual {
+	public:
+		StackKeyEqual() {};
+		bool operator()(const StackKey& a, const StackKey& b) const {return a.parent == b.parent && a.scope == b.scope;};
+		StackKeyEqual& operator=(const StackKeyEqual&) {return *this;};
+	};
+
+	WX_DECLARE_STRING_HASH_MAP(ScopeAtoms::Atom, AtomMap);
+	WX_DECLARE_STRING_HASH_MAP(unsigned int, ScopeMap);
+	WX_DECLARE_HASH_MAP(StackKey, unsigned int, StackKeyHash, StackKeyEqual, StackMap);
+
+	// The tables (all guarded by the lock)
+	struct AtomTables {
+		AtomTables() : words(1), scopes(1), stackKeys(1, StackKey(0, 0)), generation(1) { // atom 0, scope 0 and stack 0 are reserved
+			scopes[0].id = ScopeAtoms::NOSCOPE;
+			scopeIds[wxEmptyString] = ScopeAtoms::NOSCOPE;
+		};
+
+		wxCriticalSection lock;
+		AtomMap atoms;
+		vector<wxString> words;
+		ScopeMap scopeIds;
+		deque<ScopeAtoms::Scope> scopes; // deque so that references stay valid
+		StackMap stacks;
+		vector<StackKey> stackKeys; // by stack id
+		unsigned int generation;
+	};
+
+	AtomTables& GetTables() {
+		static AtomTables tables;
+		return tables;
+	}
+
+	ScopeAtoms::Atom DoGetAtom(AtomTables& t, const wxString& word) {
+		AtomMap::const_iterator p = t.atoms.find(word);
+		if (p != t.atoms.end()) return p->second;
+
+		const ScopeAtoms::Atom atom = t.words.size();
+		t.atoms[word] = atom;
+		t.words.push_back(word);
+		return atom;
+	}
+
+	const ScopeAtoms::Scope& DoGetScope(AtomTables& t, const wxString& name) {
+		ScopeMap::const_iterator p = t.scopeIds.find(name);
+		if (p != t.scopeIds.end()) return t.scopes[p->second];
+
+		ScopeAtoms::Scope scope;
+		scope.id = t.scopes.size();
+
+		// Split in words (a trailing dot does not give an empty word)
+		const size_t len = name.size();
+		size_t wordstart = 0;
+		for (size_t i = 0; i < len; ++i) {
+			if (name[i] == wxT('.')) {
+				scope.atoms.push_back(DoGetAtom(t, name.substr(wordstart, i - wordstart)));
+				wordstart = i+1;
+			}
+		}
+		if (wordstart < len) scope.atoms.push_back(DoGetAtom(t, name.substr(wordstart)));
+
+		t.scopeIds[name] = scope.id;
+		t.scopes.push_back(scope);
+		return t.scopes.back();
+	}
+
+	unsigned int DoPushScope(AtomTables& t, unsigned int stackId, unsigned int scopeId) {
+		if (scopeId == ScopeAtoms::NOSCOPE) return stackId;
+		wxASSERT(stackId < t.stackKeys.size());
+
+		const StackKey key(stackId, scopeId);
+		StackMap::const_iterator p = t.stacks.find(key);
+		if (p != t.stacks.end()) return p->second;
+
+		const unsigned int newId = t.stackKeys.size();
+		t.stacks[key] = newId;
+		t.stackKeys.push_back(key);
+		return newId;
+	}
+}
+
+// static
+ScopeAtoms::Atom ScopeAtoms::GetAtom(const wxString& word) {
+	AtomTables& t = GetTables();
+	wxCriticalSectionLocker lock(t.lock);
+	return DoGetAtom(t, word);
+}
+
+// static
+wxString ScopeAtoms::GetWord(Atom atom) {
+	AtomTables& t = GetTables();
+	wxCriticalSectionLocker lock(t.lock);
+	wxASSERT(atom < t.words.size());
+	return t.words[atom];
+}
+
+// static
+const ScopeAtoms::Scope& ScopeAtoms::GetScope(const wxString& name) {
+	AtomTables& t = GetTables();
+	wxCriticalSectionLocker lock(t.lock);
+	return DoGetScope(t, name);
+}
+
+// static
+unsigned int ScopeAtoms::GetStack(const deque<const wxString*>& scopes, vector<const Scope*>& levels) {
+	AtomTables& t = GetTables();
+	wxCriticalSectionLocker lock(t.lock);
+
+	levels.reserve(scopes.size());
+	unsigned int stackId = EMPTYSTACK;
+	for (deque<const wxString*>::const_iterator p = scopes.begin(); p != scopes.end(); ++p) {
+		const Scope& scope = DoGetScope(t, **p);
+		levels.push_back(&scope);
+		stackId = DoPushScope(t, stackId, scope.id);
+	}
+
+	return stackId;
+}
+
+// static
+unsigned int ScopeAtoms::PushScope(unsigned int stackId, unsigned int scopeId) {
+	AtomTables& t = GetTables();
+	wxCriticalSectionLocker lock(t.lock);
+	return DoPushScope(t, stackId, scopeId);
+}
+
+// static
+void ScopeAtoms::GetLevels(unsigned int stackId, vector<const Scope*>& levels) {
+	AtomTables& t = GetTables();
+	wxCriticalSectionLocker lock(t.lock);
+	wxASSERT(stackId < t.stackKeys.size());
+
+	// Walk up from the innermost scope
+	levels.clear();
+	for (unsigned int s = stackId; s != EMPTYSTACK; s = t.stackKeys[s].parent) {
+		levels.push_back(&t.scopes[t.stackKeys[s].scope]);
+	}
+	reverse(levels.begin(), levels.end());
+}
+
+// static
+void ScopeAtoms::ClearStacks() {
+	AtomTables& t = GetTables();
+	wxCriticalSectionLocker lock(t.lock);
+
+	t.stacks.clear();
+	t.stackKeys.erase(t.stackKeys.begin() + 1, t.stackKeys.end()); // keep the empty stack
+	++t.generation;
+}
+
+// static
+unsigned int ScopeAtoms::GetGeneration() {
+	AtomTables& t = GetTables();
+	wxCriticalSectionLocker lock(t.lock);
+	return t.generation;
+}
+
+// static
+wxCriticalSection& ScopeAtoms::GetLock() {
+	return GetTables().lock;
+}
@@ -0,0 +1,163 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#ifndef __SCOPEATOMS_H__
+#define __SCOPEATOMS_H__
+
+#include "wx/wxprec.h"
+#ifndef WX_PRECOMP
+	#include <wx/wx.h>
+#endif
+
+#include <wx/hashmap.h>
+#include <vector>
+#include <deque>
+
+// Scope names like "meta.function.ruby" are matched against the selectors
+// one dotted word at a time. To avoid building and comparing strings on
+// each query, words are interned as atoms (small integers) and scope names
+// as the list of atoms of their words.
+//
+// Scope stacks are interned as well, so that the result of a query can be
+// cached by the id of the stack. The syntax parser interns the scope of
+// each match when it creates it (from the scope id of its matcher), so
+// styling a match is just integer lookups.
+//
+// The tables are shared by all grammars and themes and can be used from
+// any thread. Atoms and scopes are never cleared (they are bounded by the
+// names in the bundles), but the stacks are cleared when themes and bundles
+// are reloaded (along with the caches keyed by them).
+class ScopeAtoms {
+public:
+	typedef unsigned int Atom;
+	typedef std::vector<Atom> AtomList;
+
+	// Interned scope name
+	struct Scope {
+		unsigned int id;
+		AtomList atoms;
+	};
+
+	static Atom GetAtom(const wxString& word);
+	static wxString GetWord(Atom atom);
+	static const Scope& GetScope(const wxString& name); // empty name is NOSCOPE
+
+	// Interns all levels of the stack, returning the id of the stack
+	static unsigned int GetStack(const std::deque<const wxString*>& scopes, std::vector<const Scope*>& levels);
+
+	// Id of the stack with scope added innermost (same stack for NOSCOPE)
+	static unsigned int PushScope(unsigned int stackId, unsigned int scopeId);
+	static void GetLevels(unsigned int stackId, std::vector<const Scope*>& levels);
+
+	// Invalidates all stack ids. Holders of ids have to check the generation
+	// (and intern their stacks again when it changes).
+	static void ClearStacks();
+	static unsigned int GetGeneration(); // never zero
+
+	// Lock for caches keyed by stack ids
+	static wxCriticalSection& GetLock();
+
+	static const Atom NOATOM;
+	static const unsigned int NOSCOPE;
+	static const unsigned int EMPTYSTACK;
+};
+
+// Interned scope stack, outermost scope first
+class ScopeStack {
+public:
+	ScopeStack(const std::deque<const wxString*>& scopes) {m_id = ScopeAtoms::GetStack(scopes, m_levels);};
+	explicit ScopeStack(unsigned int stackId) : m_id(stackId) {ScopeAtoms::GetLevels(stackId, m_levels);};
+
+	bool empty() const {return m_levels.empty();};
+	size_t size() const {return m_levels.size();};
+	const ScopeAtoms::AtomList& operator[](size_t level) const {return m_levels[level]->atoms;};
+	unsigned int GetId() const {return m_id;};
+
+private:
+	std::vector<const ScopeAtoms::Scope*> m_levels;
+	unsigned int m_id;
+};
+
+// Cache from stack ids to query results
+WX_DECLARE_HASH_MAP(unsigned int, const void*, wxIntegerHash, wxIntegerEqual, ScopeMemo);
+
+// Flat hash table from atoms to values (open addressing with linear probing).
+// Values default to V() when not found, so it is meant for pointers.
+template<class V> class AtomTable {
+public:
+	AtomTable() : m_count(0) {};
+
+	V Find(ScopeAtoms::Atom atom) const {
+		if (m_slots.empty()) return V();
+
+		const size_t mask = m_slots.size() - 1;
+		for (size_t i = Hash(atom) & mask; ; i = (i + 1) & mask) {
+			const Slot& slot = m_slots[i];
+			if (slot.atom == atom) return slot.value;
+			if (slot.atom == ScopeAtoms::NOATOM) return V();
+		}
+	};
+
+	void Set(ScopeAtoms::Atom atom, V value) {
+		wxASSERT(atom != ScopeAtoms::NOATOM);
+
+		// Keep the load below one half
+		if ((m_count + 1) * 2 > m_slots.size()) Grow();
+
+		Slot& slot = FindSlot(atom);
+		if (slot.atom == ScopeAtoms::NOATOM) {
+			slot.atom = atom;
+			++m_count;
+		}
+		slot.value = value;
+	};
+
+	size_t size() const {return m_count;};
+
+	// For iterating over the contents (empty slots have NOATOM)
+	size_t GetSlotCount() const {return m_slots.size();};
+	ScopeAtoms::Atom GetAtom(size_t slot) const {return m_slots[slot].atom;};
+	V GetValue(size_t slot) const {return m_slots[slot].value;};
+
+private:
+	struct Slot {
+		Slot() : atom(ScopeAtoms::NOATOM), value() {};
+		ScopeAtoms::Atom atom;
+		V value;
+	};
+
+	static size_t Hash(ScopeAtoms::Atom atom) {return atom * 2654435761U;};
+
+	Slot& FindSlot(ScopeAtoms::Atom atom) {
+		const size_t mask = m_slots.size() - 1;
+		size_t i = Hash(atom) & mask;
+		while (m_slots[i].atom != atom && m_slots[i].atom != ScopeAtoms::NOATOM) i = (i + 1) & mask;
+		return m_slots[i];
+	};
+
+	void Grow() {
+		std::vector<Slot> old;
+		old.swap(m_slots);
+		m_slots.resize(old.empty() ? 4 : old.size() * 2);
+
+		for (typename std::vector<Slot>::const_iterator p = old.begin(); p != old.end(); ++p) {
+			if (p->atom != ScopeAtoms::NOATOM) FindSlot(p->atom) = *p;
+		}
+	};
+
+	// Member variables
+	std::vector<Slot> m_slots;
+	size_t m_count;
+};
+
+#endif // __SCOPEATOMS_H__
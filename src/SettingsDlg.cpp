@@ -50,6 +50,7 @@ enum {
 	CTRL_LASTTAB,
 	CTRL_HIGHLIGHTVARIABLES,
 	CTRL_HIGHLIGHTHTML,
+	CTRL_COMPLETEALLTABS,
 	CTRL_LINEENDING,
 	CTRL_ENCODING,
 	CTRL_BOM,
@@ -74,6 +75,7 @@ BEGIN_EVENT_TABLE(SettingsDlg, wxDialog)
 	EVT_CHECKBOX(CTRL_LASTTAB, SettingsDlg::OnCheckLastTab)
 	EVT_CHECKBOX(CTRL_HIGHLIGHTVARIABLES, SettingsDlg::OnCheckHighlightVariables)
 	EVT_CHECKBOX(CTRL_HIGHLIGHTHTML, SettingsDlg::OnCheckHighlightHtml)
+	EVT_CHECKBOX(CTRL_COMPLETEALLTABS, SettingsDlg::OnCheckCompleteAllTabs)
 	EVT_SPINCTRL(CTRL_MARGINSPIN, SettingsDlg::OnMarginSpin) 
 	EVT_COMBOBOX(CTRL_LINEENDING, SettingsDlg::OnComboEol)
 	EVT_COMBOBOX(CTRL_ENCODING, SettingsDlg::OnComboEncoding)
@@ -185,6 +187,7 @@ wxPanel* SettingsDlg::CreateSettingsPage(wxWindow* parent) {
 	wxCheckBox* lastTab = new wxCheckBox(settingsPage, CTRL_LASTTAB, _("Go to last active tab on Ctrl-Tab"));
 	wxCheckBox* highlightVariables = new wxCheckBox(settingsPage, CTRL_HIGHLIGHTVARIABLES, _("Highlight occurances of a variable when clicked."));
 	wxCheckBox* highlightHtml = new wxCheckBox(settingsPage, CTRL_HIGHLIGHTHTML, _("Highlight matching html tags."));
+	wxCheckBox* completeAllTabs = new wxCheckBox(settingsPage, CTRL_COMPLETEALLTABS, _("Complete words from all open tabs"));
 
 	wxBoxSizer* settingsSizer = new wxBoxSizer(wxVERTICAL);
 		settingsSizer->Add(autoPair, 0, wxALL, 5);
@@ -200,6 +203,7 @@ wxPanel* SettingsDlg::CreateSettingsPage(wxWindow* parent) {
 		settingsSizer->Add(lastTab, 0, wxALL, 5);
 		settingsSizer->Add(highlightVariables, 0, wxALL, 5);
 		settingsSizer->Add(highlightHtml, 0, wxALL, 5);
+		settingsSizer->Add(completeAllTabs, 0, wxALL, 5);
 	settingsPage->SetSizer(settingsSizer);
 
 	// Settings defaults.
@@ -213,6 +217,7 @@ wxPanel* SettingsDlg::CreateSettingsPage(wxWindow* parent) {
 	bool doLastTab = false;
 	bool doHighlightVariables = false;
 	bool doHighlightHtml = false;
+	bool doCompleteAllTabs = false;
 	int marginChars = 80;  
 
 	m_settings.GetSettingBool(wxT("autoPair"), doAutoPair);
@@ -226,6 +231,7 @@ wxPanel* SettingsDlg::CreateSettingsPage(wxWindow* parent) {
 	m_settings.GetSettingBool(wxT("gotoLastTab"), doLastTab);
 	m_settings.GetSettingBool(wxT("highlightVariables"), doHighlightVariables);
 	m_settings.GetSettingBool(wxT("highlightHtml"), doHighlightHtml);
+	m_settings.GetSettingBool(wxT("completeFromAllTabs"), doCompleteAllTabs);
 
 	// Update ctrls
 	autoPair->SetValue(doAutoPair);
@@ -243,6 +249,7 @@ wxPanel* SettingsDlg::CreateSettingsPage(wxWindow* parent) {
 	lastTab->SetValue(doLastTab);
 	highlightVariables->SetValue(doHighlightVariables);
 	highlightHtml->SetValue(doHighlightHtml);
+	completeAllTabs->SetValue(doCompleteAllTabs);
 
 	return settingsPage;
 }
@@ -596,3 +603,7 @@ void SettingsDlg::OnCheckHighlightVariables(wxCommandEvent& event) {
 void SettingsDlg::OnCheckHighlightHtml(wxCommandEvent& event) {
 	m_settings.SetSettingBool(wxT("highlightHtml"), event.IsChecked());
 }
+
+void SettingsDlg::OnCheckCompleteAllTabs(wxCommandEvent& event) {
+	m_settings.SetSettingBool(wxT("completeFromAllTabs"), event.IsChecked());
+}
@@ -60,6 +60,7 @@ private:
 	void OnCheckLastTab(wxCommandEvent& event);
 	void OnCheckHighlightVariables(wxCommandEvent& event);
 	void OnCheckHighlightHtml(wxCommandEvent& event);
+	void OnCheckCompleteAllTabs(wxCommandEvent& event);
 	void OnMarginSpin(wxSpinEvent& event);
 	void OnComboEol(wxCommandEvent& event);
 	void OnComboEncoding(wxCommandEvent& event);
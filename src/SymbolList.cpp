@@ -40,7 +40,7 @@ SymbolList::SymbolList(IFrameSymbolService& services, bool keepOpen):
 	wxPanel(dynamic_cast<wxWindow*>(&services), wxID_ANY),
 	m_parentFrame(services), 
 	m_editorSymbols(NULL),
-	m_keepOpen(keepOpen)
+	m_keepOpen(keepOpen), m_searchPending(false)
 {
 	// Create ctrls
 	m_searchCtrl = new wxTextCtrl(this, CTRL_SEARCH, wxEmptyString, wxDefaultPosition, wxDefaultSize, wxTE_PROCESS_ENTER);
@@ -67,6 +67,9 @@ bool SymbolList::Destroy() {
 }
 
 void SymbolList::OnIdle(wxIdleEvent& WXUNUSED(event)) {
+	// Search when all queued keystrokes have been handled
+	if (m_searchPending) UpdateSearch();
+
 	EditorChangeType newStatus;
 	IEditorSymbols* editorSymbols = dynamic_cast<IEditorSymbols*>(m_parentFrame.GetEditorAndChangeType(this->m_editorChangeState, newStatus));
 
@@ -114,17 +117,26 @@ void SymbolList::OnIdle(wxIdleEvent& WXUNUSED(event)) {
 	}
 }
 
-void SymbolList::OnSearch(wxCommandEvent& event) {
-	m_listBox->Find(event.GetString());
+void SymbolList::OnSearch(wxCommandEvent& WXUNUSED(event)) {
+	// Wait for idle, so that fast typing does not
+	// search for text that has already been changed
+	m_searchPending = true;
+}
+
+void SymbolList::UpdateSearch() {
+	m_searchPending = false;
+	m_listBox->Find(m_searchCtrl->GetValue());
 }
 
 void SymbolList::OnSearchChar(wxKeyEvent& event) {
 	switch ( event.GetKeyCode() )
     {
 	case WXK_UP:
+		if (m_searchPending) UpdateSearch();
 		m_listBox->SelectPrev();
 		return;
 	case WXK_DOWN:
+		if (m_searchPending) UpdateSearch();
 		m_listBox->SelectNext();
 		return;
 	case WXK_ESCAPE:
@@ -139,6 +151,7 @@ void SymbolList::OnSearchChar(wxKeyEvent& event) {
 
 void SymbolList::OnAction(wxCommandEvent& WXUNUSED(event)) {
 	if (!m_editorSymbols) return;
+	if (m_searchPending) UpdateSearch();
 	if(m_listBox->GetSelectedCount() != 1) return;
 
 	const int hit = m_listBox->GetSelectedAction();
@@ -171,18 +184,15 @@ SymbolList::ActionList::ActionList(wxWindow* parent, wxWindowID id, const wxArra
 }
 
 void SymbolList::ActionList::SetAllItems() {
-	m_items.clear();
+	m_matcher.Clear();
+	for (unsigned int i = 0; i < m_actions.size(); ++i) {
+		m_matcher.AddName(m_actions[i]);
+	}
 
 	Freeze();
 
 	if (m_searchText.empty()) {
-		m_items.resize(m_actions.size());
-		for (unsigned int i = 0; i < m_actions.size(); ++i) {
-			m_items[i].id = i;
-			m_items[i].action = &m_actions[i];
-		}
-
-		SetItemCount(m_items.size());
+		SetItemCount(m_actions.size());
 	}
 	else {
 		Find(m_searchText, false);
@@ -199,53 +209,33 @@ void SymbolList::ActionList::OnDrawItem(wxDC& dc, const wxRect& rect, size_t n)
 	if (isCurrent) dc.SetTextForeground(m_hlTextColor);
 	else dc.SetTextForeground(m_textColor);
 
-	const aItem& ai = m_items[n];
-	const vector<unsigned int>& hl = ai.hlChars;
-	const wxString& name = *ai.action;
+	const unsigned int id = GetActionId(n);
+	const wxString& name = m_actions[id];
+
+	// Only the rows that are drawn need the matched chars
+	if (m_searchText.empty()) m_hlChars.clear();
+	else m_matcher.GetHighlights(id, m_hlChars);
 
 	// Draw action name
-	DrawItemText(dc, rect, name, hl, isCurrent);
+	DrawItemText(dc, rect, name, m_hlChars, isCurrent);
 }
 
 void SymbolList::ActionList::Find(const wxString& searchtext, bool refresh) {
 	m_searchText = searchtext; // cache for later updates
 
 	if (searchtext.empty()) {
+		m_matcher.Find(wxEmptyString);
 		SetAllItems();
 		return;
 	}
 
-	// Convert to upper case for case insensitive search
-	const wxString text = searchtext.Upper();
-
-	m_items.clear();
-	vector<unsigned int> hlChars;
-	for (unsigned int i = 0; i < m_actions.GetCount(); ++i) {
-		const wxString& name = m_actions[i];
-		unsigned int charpos = 0;
-		wxChar c = text[charpos];
-		hlChars.clear();
-
-		for (unsigned int textpos = 0; textpos < name.size(); ++textpos) {
-			if ((wxChar)wxToupper(name[textpos]) == c) {
-				hlChars.push_back(textpos);
-				++charpos;
-				if (charpos == text.size()) {
-					// All chars found.
-					m_items.push_back(aItem(i, &m_actions[i], hlChars));
-					break;
-				}
-				else c = text[charpos];
-			}
-		}
-	}
-
-	sort(m_items.begin(), m_items.end());
+	// Matching ignores case (ranked when drawn)
+	m_matcher.Find(searchtext);
 
 	Freeze();
-	SetItemCount(m_items.size());
+	SetItemCount(m_matcher.GetMatchCount());
 	if (refresh) {
-		if (m_items.empty()) SetSelection(-1); // deselect
+		if (m_matcher.GetMatchCount() == 0) SetSelection(-1); // deselect
 		else SetSelection(0);
 
 		RefreshAll();
@@ -253,10 +243,14 @@ void SymbolList::ActionList::Find(const wxString& searchtext, bool refresh) {
 	Thaw();
 }
 
+unsigned int SymbolList::ActionList::GetActionId(unsigned int n) const {
+	return m_searchText.empty() ? n : m_matcher.GetMatch(n);
+}
+
 int SymbolList::ActionList::GetSelectedAction() const {
 	const int sel = GetSelection();
 	if (sel == -1) return wxNOT_FOUND;
-	else return m_items[sel].id;
+	else return GetActionId(sel);
 }
 
 void SymbolList::ActionList::OnLeftDown(wxMouseEvent& event)
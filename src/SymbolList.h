@@ -21,6 +21,7 @@
 #endif
 
 #include "SearchListBox.h"
+#include "FuzzyMatcher.h"
 #include "IEditorSymbols.h"
 
 #include <vector>
@@ -33,6 +34,9 @@ public:
 	bool Destroy();
 
 private:
+	void UpdateSearch();
+
+	// Event handlers
 	void OnIdle(wxIdleEvent& event);
 	void OnSearch(wxCommandEvent& event);
 	void OnAction(wxCommandEvent& event);
@@ -49,29 +53,14 @@ private:
 
 	private:
 		void OnDrawItem(wxDC& dc, const wxRect& rect, size_t n) const;
+		unsigned int GetActionId(unsigned int n) const;
 
 		void OnLeftDown(wxMouseEvent& event);
 		DECLARE_EVENT_TABLE();
 
-		class aItem {
-		public:
-			aItem() : id(0), action(NULL), rank(0) {};
-			aItem(unsigned int id, const wxString* a, const std::vector<unsigned int>& hl)
-				: id(id), action(a), hlChars(hl), rank(SearchListBox::CalcRank(hl)) {};
-			bool operator<(const aItem& ai) const {
-				if (rank < ai.rank) return true;
-				else if (rank > ai.rank) return false;
-				else if (action && ai.action) return *action < *ai.action;
-				else return false;
-			}
-			unsigned int id;
-			const wxString* action;
-			std::vector<unsigned int> hlChars;
-			unsigned int rank;
-		};
-
 		const wxArrayString& m_actions;
-		std::vector<aItem> m_items;
+		FuzzyMatcher m_matcher;
+		mutable std::vector<unsigned int> m_hlChars;
 		wxString m_searchText;
 	};
 
@@ -85,6 +74,7 @@ private:
 	EditorChangeState m_editorChangeState;
 
 	bool m_keepOpen;
+	bool m_searchPending;
 
 	std::vector<SymbolRef> m_symbols;
 	wxArrayString m_symbolStrings;
@@ -0,0 +1,760 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#include "TagIndex.h"
+#include "WordIndex.h"
+#include "Catalyst.h"
+#include <limits.h>
+
+using namespace std;
+
+// Initializing static constants
+const unsigned int TagIndex::CHUNKSIZE = 64 * 1024;
+const unsigned int TagIndex::MAXNAMELEN = 64;
+
+// Tag names are alphanumeric (without underscore)
+static inline bool IsNameChar(wxChar c) {
+	return c != wxT('_') && WordIndex::IsWordChar(c);
+}
+
+// ---- TagIndex::Tree ----------------------------------------------------------
+//
+// A treap of tokens in document order. Like the entries in a LineIndex, each
+// node holds the length from the end of the previous token to its own end,
+// so edits only have to update a single node and the path to the root.
+// Each node also sums up the nesting depth change of its subtree, with the
+// lowest depth reached from the left and the highest from the right, so
+// that the point where the depth first drops can be found in O(log n).
+
+class TagIndex::Tree {
+public:
+	Tree() : m_root(NULL), m_seed(0x2545F491) {};
+	~Tree() {Free(m_root);};
+
+	void Clear() {Free(m_root); m_root = NULL;};
+	unsigned int GetCount() const {return Count(m_root);};
+
+	Token Get(unsigned int index) const;
+	unsigned int FindEnd(unsigned int pos) const; // first token with end >= pos
+	unsigned int FindStart(unsigned int pos) const; // first token with start >= pos
+
+	// Keep in sync with document (tokens touched by the edit are removed)
+	void Insert(unsigned int pos, unsigned int length);
+	void Delete(unsigned int start, unsigned int end);
+
+	// Replace tokens [first, last) with new tokens (absolute positions)
+	void Replace(unsigned int first, unsigned int last, const vector<Token>& tokens, vector<Token>* removed=NULL);
+
+	// Searches on the depth (return GetCount() if not found)
+	unsigned int FindForward(unsigned int first, int target) const; // first index where depth from first <= target
+	unsigned int FindBackward(unsigned int last, int target) const; // last index where depth to last >= target
+
+private:
+	struct Node {
+		Node* left;
+		Node* right;
+		unsigned int priority;
+		unsigned int len;   // from end of previous token
+		unsigned int width; // token length
+		unsigned int nameId;
+		unsigned short nameLen;
+		unsigned short flags;
+		int delta;
+
+		// Subtree sums
+		unsigned int count;
+		unsigned int total;
+		int sum;
+		int minPrefix;
+		int maxSuffix;
+	};
+
+	static unsigned int Count(const Node* n) {return n ? n->count : 0;};
+	static unsigned int Total(const Node* n) {return n ? n->total : 0;};
+	static void Update(Node* n);
+	static void UpdateAll(Node* n);
+	static void Free(Node* n);
+
+	static void Split(Node* n, unsigned int count, Node*& left, Node*& right);
+	static Node* Merge(Node* left, Node* right);
+	static void AddFirstLength(Node* n, int shift);
+	static void Collect(const Node* n, unsigned int offset, vector<Token>& tokens);
+
+	static int Forward(const Node* n, int skip, int target, int& depth);
+	static int Backward(const Node* n, int count, int target, int& depth);
+
+	Node* Build(const vector<Token>& tokens, unsigned int prevEnd);
+	void Shift(unsigned int index, int shift);
+
+	// Member variables
+	Node* m_root;
+	unsigned int m_seed;
+};
+
+TagIndex::Token TagIndex::Tree::Get(unsigned int index) const {
+	wxASSERT(index < GetCount());
+
+	const Node* n = m_root;
+	unsigned int offset = 0;
+	for (;;) {
+		const unsigned int leftCount = Count(n->left);
+		if (index < leftCount) {
+			n = n->left;
+			continue;
+		}
+
+		offset += Total(n->left) + n->len;
+		if (index == leftCount) break;
+		index -= leftCount + 1;
+		n = n->right;
+	}
+
+	Token token;
+	token.start = offset - n->width;
+	token.end = offset;
+	token.nameId = n->nameId;
+	token.nameLen = n->nameLen;
+	token.flags = n->flags;
+	return token;
+}
+
+unsigned int TagIndex::Tree::FindEnd(unsigned int pos) const {
+	// Token ends are strictly increasing
+	unsigned int result = GetCount();
+	unsigned int index = 0;
+	unsigned int offset = 0;
+	const Node* n = m_root;
+
+	while (n) {
+		const unsigned int end = offset + Total(n->left) + n->len;
+		if (end >= pos) {
+			result = index + Count(n->left);
+			n = n->left;
+		}
+		else {
+			index += Count(n->left) + 1;
+			offset = end;
+			n = n->right;
+		}
+	}
+	return result;
+}
+
+unsigned int TagIndex::Tree::FindStart(unsigned int pos) const {
+	// Only a single token can contain pos
+	unsigned int index = FindEnd(pos+1);
+	if (index < GetCount() && Get(index).start < pos) ++index;
+	return index;
+}
+
+void TagIndex::Tree::Insert(unsigned int pos, unsigned int length) {
+	// Tokens ending at pos are not moved
+	const unsigned int index = FindEnd(pos+1);
+	if (index == GetCount()) return;
+
+	// Remove token if the insertion is inside it
+	if (Get(index).start < pos) Replace(index, index+1, vector<Token>());
+	Shift(index, (int)length);
+}
+
+void TagIndex::Tree::Delete(unsigned int start, unsigned int end) {
+	if (start >= end) return;
+
+	// Find tokens touched by the deletion
+	const unsigned int first = FindEnd(start+1);
+	unsigned int last = first;
+	while (last < GetCount() && Get(last).start < end) ++last;
+
+	if (first < last) Replace(first, last, vector<Token>());
+	Shift(first, -(int)(end - start));
+}
+
+void TagIndex::Tree::Shift(unsigned int index, int shift) {
+	if (index >= GetCount()) return;
+
+	Node* left;
+	Node* right;
+	Split(m_root, index, left, right);
+	AddFirstLength(right, shift);
+	m_root = Merge(left, right);
+}
+
+void TagIndex::Tree::Replace(unsigned int first, unsigned int last, const vector<Token>& tokens, vector<Token>* removed) {
+	wxASSERT(first <= last && last <= GetCount());
+
+	Node* left;
+	Node* rest;
+	Node* middle;
+	Node* right;
+	Split(m_root, first, left, rest);
+	Split(rest, last - first, middle, right);
+
+	const unsigned int prevEnd = Total(left);
+	const unsigned int removedLen = Total(middle);
+	if (removed) Collect(middle, prevEnd, *removed);
+	Free(middle);
+
+	// The token after the replaced ones keeps its absolute position
+	Node* const added = Build(tokens, prevEnd);
+	const unsigned int newEnd = tokens.empty() ? prevEnd : tokens.back().end;
+	if (right) AddFirstLength(right, (int)(prevEnd + removedLen) - (int)newEnd);
+
+	m_root = Merge(Merge(left, added), right);
+}
+
+TagIndex::Tree::Node* TagIndex::Tree::Build(const vector<Token>& tokens, unsigned int prevEnd) {
+	// Build the treap in linear time, keeping the right spine on a stack
+	vector<Node*> spine;
+	for (vector<Token>::const_iterator p = tokens.begin(); p != tokens.end(); ++p) {
+		wxASSERT(p->end > prevEnd && p->start < p->end);
+
+		Node* const n = new Node;
+		m_seed ^= m_seed << 13; m_seed ^= m_seed >> 17; m_seed ^= m_seed << 5;
+		n->priority = m_seed;
+		n->len = p->end - prevEnd;
+		n->width = p->end - p->start;
+		n->nameId = p->nameId;
+		n->nameLen = (unsigned short)p->nameLen;
+		n->flags = (unsigned short)p->flags;
+		if (p->flags & (TAG_COMMENT|TAG_SELFCLOSING)) n->delta = 0;
+		else n->delta = (p->flags & TAG_CLOSING) ? -1 : 1;
+		n->right = NULL;
+		prevEnd = p->end;
+
+		Node* last = NULL;
+		while (!spine.empty() && spine.back()->priority < n->priority) {
+			last = spine.back();
+			spine.pop_back();
+		}
+		n->left = last;
+		if (!spine.empty()) spine.back()->right = n;
+		spine.push_back(n);
+	}
+	if (spine.empty()) return NULL;
+
+	UpdateAll(spine.front());
+	return spine.front();
+}
+
+void TagIndex::Tree::Update(Node* n) { // static
+	const Node* const left = n->left;
+	const Node* const right = n->right;
+
+	n->count = Count(left) + 1 + Count(right);
+	n->total = Total(left) + n->len + Total(right);
+
+	// Depth seen from the left
+	int sum = left ? left->sum : 0;
+	int minPrefix = left ? left->minPrefix : INT_MAX;
+	sum += n->delta;
+	if (sum < minPrefix) minPrefix = sum;
+	if (right) {
+		if (sum + right->minPrefix < minPrefix) minPrefix = sum + right->minPrefix;
+		sum += right->sum;
+	}
+	n->sum = sum;
+	n->minPrefix = minPrefix;
+
+	// Depth seen from the right
+	int rsum = right ? right->sum : 0;
+	int maxSuffix = right ? right->maxSuffix : INT_MIN;
+	rsum += n->delta;
+	if (rsum > maxSuffix) maxSuffix = rsum;
+	if (left && rsum + left->maxSuffix > maxSuffix) maxSuffix = rsum + left->maxSuffix;
+	n->maxSuffix = maxSuffix;
+}
+
+void TagIndex::Tree::UpdateAll(Node* n) { // static
+	if (!n) return;
+	UpdateAll(n->left);
+	UpdateAll(n->right);
+	Update(n);
+}
+
+void TagIndex::Tree::Free(Node* n) { // static
+	if (!n) return;
+	Free(n->left);
+	Free(n->right);
+	delete n;
+}
+
+void TagIndex::Tree::Split(Node* n, unsigned int count, Node*& left, Node*& right) { // static
+	if (!n) {
+		left = right = NULL;
+		return;
+	}
+
+	const unsigned int leftCount = Count(n->left);
+	if (leftCount < count) {
+		Split(n->right, count - leftCount - 1, n->right, right);
+		left = n;
+	}
+	else {
+		Split(n->left, count, left, n->left);
+		right = n;
+	}
+	Update(n);
+}
+
+TagIndex::Tree::Node* TagIndex::Tree::Merge(Node* left, Node* right) { // static
+	if (!left) return right;
+	if (!right) return left;
+
+	if (left->priority > right->priority) {
+		left->right = Merge(left->right, right);
+		Update(left);
+		return left;
+	}
+	else {
+		right->left = Merge(left, right->left);
+		Update(right);
+		return right;
+	}
+}
+
+void TagIndex::Tree::AddFirstLength(Node* n, int shift) { // static
+	if (!n) return;
+	if (n->left) AddFirstLength(n->left, shift);
+	else n->len += shift;
+	Update(n);
+}
+
+void TagIndex::Tree::Collect(const Node* n, unsigned int offset, vector<Token>& tokens) { // static
+	if (!n) return;
+	Collect(n->left, offset, tokens);
+
+	Token token;
+	token.end = offset + Total(n->left) + n->len;
+	token.start = token.end - n->width;
+	token.nameId = n->nameId;
+	token.nameLen = n->nameLen;
+	token.flags = n->flags;
+	tokens.push_back(token);
+
+	Collect(n->right, token.end, tokens);
+}
+
+unsigned int TagIndex::Tree::FindForward(unsigned int first, int target) const {
+	int depth = 0;
+	const int index = Forward(m_root, first, target, depth);
+	return index < 0 ? GetCount() : index;
+}
+
+unsigned int TagIndex::Tree::FindBackward(unsigned int last, int target) const {
+	int depth = 0;
+	const int index = Backward(m_root, last, target, depth);
+	return index < 0 ? GetCount() : index;
+}
+
+int TagIndex::Tree::Forward(const Node* n, int skip, int target, int& depth) { // static
+	// Searches the subtree after the first skip tokens
+	if (!n || skip >= (int)n->count) return -1;
+	if (skip == 0 && depth + n->minPrefix > target) {
+		depth += n->sum;
+		return -1;
+	}
+
+	const int leftCount = Count(n->left);
+	if (skip < leftCount) {
+		const int index = Forward(n->left, skip, target, depth);
+		if (index >= 0) return index;
+	}
+	if (skip <= leftCount) {
+		depth += n->delta;
+		if (depth <= target) return leftCount;
+	}
+
+	const int index = Forward(n->right, skip > leftCount ? skip - leftCount - 1 : 0, target, depth);
+	return index >= 0 ? leftCount + 1 + index : -1;
+}
+
+int TagIndex::Tree::Backward(const Node* n, int count, int target, int& depth) { // static
+	// Searches the first count tokens of the subtree, from the back
+	if (!n || count <= 0) return -1;
+	if (count >= (int)n->count) {
+		if (depth + n->maxSuffix < target) {
+			depth += n->sum;
+			return -1;
+		}
+		count = n->count;
+	}
+
+	const int leftCount = Count(n->left);
+	if (count > leftCount + 1) {
+		const int index = Backward(n->right, count - leftCount - 1, target, depth);
+		if (index >= 0) return leftCount + 1 + index;
+	}
+	if (count > leftCount) {
+		depth += n->delta;
+		if (depth >= target) return leftCount;
+	}
+
+	return Backward(n->left, count < leftCount ? count : leftCount, target, depth);
+}
+
+// ---- TagIndex ----------------------------------------------------------------
+
+TagIndex::TagIndex() : m_isBuilt(false), m_length(0), m_tags(new Tree) {
+}
+
+TagIndex::~TagIndex() {
+	Clear();
+	delete m_tags;
+}
+
+void TagIndex::Clear() {
+	m_tags->Clear();
+	for (vector<Tree*>::iterator p = m_nameTrees.begin(); p != m_nameTrees.end(); ++p) {
+		delete *p;
+	}
+	m_nameTrees.clear();
+	m_nameIds.clear();
+	m_dirty.clear();
+	m_isBuilt = false;
+	m_length = 0;
+}
+
+unsigned int TagIndex::GetTagCount() const {
+	return m_tags->GetCount();
+}
+
+void TagIndex::Insert(unsigned int pos, unsigned int length) {
+	if (!m_isBuilt || length == 0) return;
+	wxASSERT(pos <= m_length);
+
+	m_tags->Insert(pos, length);
+	for (vector<Tree*>::iterator p = m_nameTrees.begin(); p != m_nameTrees.end(); ++p) {
+		(*p)->Insert(pos, length);
+	}
+	m_length += length;
+
+	// Move the dirty text after the insertion
+	for (vector<interval>::iterator p = m_dirty.begin(); p != m_dirty.end(); ++p) {
+		if (p->start >= pos) p->start += length;
+		if (p->end >= pos) p->end += length;
+	}
+	MarkDirty(pos, pos + length);
+}
+
+void TagIndex::Delete(unsigned int start, unsigned int end) {
+	if (!m_isBuilt || start >= end) return;
+	wxASSERT(end <= m_length);
+
+	m_tags->Delete(start, end);
+	for (vector<Tree*>::iterator p = m_nameTrees.begin(); p != m_nameTrees.end(); ++p) {
+		(*p)->Delete(start, end);
+	}
+	m_length -= end - start;
+
+	// Move the dirty text after the deletion
+	const unsigned int len = end - start;
+	for (vector<interval>::iterator p = m_dirty.begin(); p != m_dirty.end(); ++p) {
+		if (p->start >= end) p->start -= len;
+		else if (p->start > start) p->start = start;
+		if (p->end >= end) p->end -= len;
+		else if (p->end > start) p->end = start;
+	}
+	MarkDirty(start, start);
+}
+
+void TagIndex::ApplyDiff(const vector<cxChange>& changes) {
+	// Deletions are offset by the changes before them
+	int offset = 0;
+	for (vector<cxChange>::const_iterator p = changes.begin(); p != changes.end(); ++p) {
+		const unsigned int len = p->end - p->start;
+
+		if (p->type == cxINSERTION) {
+			Insert(p->start, len);
+			offset += len;
+		}
+		else { // if (p->type == cxDELETION)
+			Delete(p->start + offset, p->end + offset);
+			offset -= len;
+		}
+	}
+}
+
+void TagIndex::MarkDirty(unsigned int start, unsigned int end) {
+	// Keep the dirty ranges sorted, merging the ones that touch
+	vector<interval>::iterator p = m_dirty.begin();
+	while (p != m_dirty.end() && p->end < start) ++p;
+
+	vector<interval>::iterator last = p;
+	while (last != m_dirty.end() && last->start <= end) {
+		if (last->start < start) start = last->start;
+		if (last->end > end) end = last->end;
+		++last;
+	}
+
+	p = m_dirty.erase(p, last);
+	m_dirty.insert(p, interval(start, end));
+}
+
+void TagIndex::Update(const TextSource& source) {
+	// Rebuild if the index has missed an edit
+	const unsigned int length = source.GetLength();
+	wxASSERT(!m_isBuilt || m_length == length);
+	if (!m_isBuilt || m_length != length) {
+		Build(source);
+		return;
+	}
+
+	while (!m_dirty.empty()) {
+		const unsigned int start = m_dirty.front().start;
+		ScanRange(source, start);
+	}
+}
+
+void TagIndex::Build(const TextSource& source) {
+	Clear();
+	m_length = source.GetLength();
+	m_isBuilt = true;
+
+	// Rescanning the whole document
+	m_dirty.push_back(interval(0, m_length));
+	ScanRange(source, 0);
+}
+
+void TagIndex::ScanRange(const TextSource& source, unsigned int start) {
+	// Restart after the last token before the dirty text (the scanner is idle there)
+	const unsigned int first = m_tags->FindEnd(start+1);
+	const unsigned int restart = first ? m_tags->Get(first-1).end : 0;
+
+	vector<Token> tokens;
+	ScanState state;
+	state.haveOpenBracket = false;
+	state.inComment = false;
+	unsigned int syncEnd = 0;
+	unsigned int last = m_tags->GetCount();
+	bool inSync = false;
+
+	for (unsigned int pos = restart; pos < m_length && !inSync; pos += CHUNKSIZE) {
+		// Chunks overlap a bit, so the text around the brackets can be checked
+		const unsigned int chunkEnd = wxMin(pos + CHUNKSIZE, m_length);
+		const unsigned int textStart = pos < 2 ? 0 : pos - 2;
+		const unsigned int textEnd = wxMin(chunkEnd + MAXNAMELEN + 4, m_length);
+		m_buffer.clear();
+		source.GetTextPart(textStart, textEnd, m_buffer);
+		wxASSERT(m_buffer.size() == textEnd - textStart);
+
+		inSync = ScanChunk(&*m_buffer.begin(), textStart, textEnd, pos, chunkEnd, state, tokens, syncEnd, last);
+	}
+
+	// Reaching the end, all the dirty text has been scanned
+	if (!inSync) m_dirty.clear();
+
+	ReplaceTokens(first, last, tokens);
+}
+
+bool TagIndex::ScanChunk(const char* text, unsigned int textStart, unsigned int textEnd, unsigned int start, unsigned int end, ScanState& state, vector<Token>& tokens, unsigned int& syncEnd, unsigned int& syncIndex) {
+	const char* const chunkEnd = text + (end - textStart);
+	for (const char* p = text + (start - textStart); p < chunkEnd; ++p) {
+		if (*p != '<' && *p != '>') continue;
+		const unsigned int pos = textStart + (p - text);
+
+		if (state.inComment) {
+			// -->
+			if (*p == '>' && pos >= 2 && p[-1] == '-' && p[-2] == '-') {
+				state.inComment = false;
+				state.haveOpenBracket = false;
+
+				state.open.end = pos + 1;
+				state.open.nameId = 0;
+				state.open.nameLen = 0;
+				state.open.flags = TAG_COMMENT;
+				tokens.push_back(state.open);
+				if (CheckSync(pos + 1, syncEnd, syncIndex)) return true;
+			}
+			continue;
+		}
+
+		if (*p == '<') {
+			// A new bracket restarts the tag
+			ReadOpenBracket(text, textStart, textEnd, pos, state);
+			state.haveOpenBracket = true;
+			continue;
+		}
+
+		if (!state.haveOpenBracket) continue;
+		state.haveOpenBracket = false;
+
+		// It is a tag if it is empty or the name starts with an alphanumeric char
+		if (state.nameLen == 0 && state.nameStart != pos) continue;
+
+		Token& tag = state.open;
+		tag.end = pos + 1;
+		tag.nameId = GetNameId(state.name);
+		tag.nameLen = state.nameLen;
+		if (p[-1] == '/') tag.flags |= TAG_SELFCLOSING;
+		tokens.push_back(tag);
+		if (CheckSync(pos + 1, syncEnd, syncIndex)) return true;
+	}
+
+	return false;
+}
+
+void TagIndex::ReadOpenBracket(const char* text, unsigned int textStart, unsigned int textEnd, unsigned int pos, ScanState& state) {
+	const char* p = text + (pos - textStart) + 1;
+	const char* const end = text + (textEnd - textStart);
+
+	state.open.start = pos;
+	state.open.flags = 0;
+
+	// <!--
+	state.inComment = (end - p) >= 3 && p[0] == '!' && p[1] == '-' && p[2] == '-';
+	if (state.inComment) return;
+
+	if (p < end && *p == '/') {
+		state.open.flags = TAG_CLOSING;
+		++p;
+	}
+	state.nameStart = textStart + (p - text);
+
+	// Tag names are matched case-insensitively
+	const char* const nameStart = p;
+	while (p < end && (unsigned int)(p - nameStart) < MAXNAMELEN) {
+		unsigned int charLen;
+		if (!IsNameChar(WordIndex::DecodeChar(p, end, charLen))) break;
+		p += charLen;
+	}
+	state.nameLen = p - nameStart;
+
+	state.name.assign(nameStart, p);
+	for (string::iterator c = state.name.begin(); c != state.name.end(); ++c) {
+		if (*c >= 'A' && *c <= 'Z') *c += 'a' - 'A';
+	}
+}
+
+bool TagIndex::CheckSync(unsigned int pos, unsigned int& syncEnd, unsigned int& syncIndex) {
+	// Take over the dirty ranges the scan has reached
+	while (!m_dirty.empty() && m_dirty.front().start < pos) {
+		if (m_dirty.front().end > syncEnd) syncEnd = m_dirty.front().end;
+		m_dirty.erase(m_dirty.begin());
+	}
+	if (pos < syncEnd) return false;
+
+	// In sync when a tag ends where an old one does (the scanner is idle after both)
+	const unsigned int index = m_tags->FindEnd(pos);
+	if (index == m_tags->GetCount() || m_tags->Get(index).end != pos) return false;
+
+	syncIndex = index + 1;
+	return true;
+}
+
+void TagIndex::ReplaceTokens(unsigned int first, unsigned int last, const vector<Token>& tokens) {
+	vector<Token> removed;
+	m_tags->Replace(first, last, tokens, &removed);
+
+	// Update the trees for the names
+	vector<Token> tag(1);
+	for (vector<Token>::const_iterator p = removed.begin(); p != removed.end(); ++p) {
+		if (p->flags & (TAG_COMMENT|TAG_SELFCLOSING)) continue;
+		Tree& tree = GetNameTree(p->nameId);
+		const unsigned int index = tree.FindEnd(p->end);
+		wxASSERT(index < tree.GetCount() && tree.Get(index).end == p->end);
+		tree.Replace(index, index+1, vector<Token>());
+	}
+
+	map<unsigned int, vector<Token> > added;
+	for (vector<Token>::const_iterator p = tokens.begin(); p != tokens.end(); ++p) {
+		if (p->flags & (TAG_COMMENT|TAG_SELFCLOSING)) continue;
+		added[p->nameId].push_back(*p);
+	}
+	for (map<unsigned int, vector<Token> >::const_iterator n = added.begin(); n != added.end(); ++n) {
+		Tree& tree = GetNameTree(n->first);
+
+		// New names can be built in one go
+		if (tree.GetCount() == 0) {
+			tree.Replace(0, 0, n->second);
+			continue;
+		}
+
+		for (vector<Token>::const_iterator p = n->second.begin(); p != n->second.end(); ++p) {
+			const unsigned int index = tree.FindEnd(p->end);
+			tag[0] = *p;
+			tree.Replace(index, index, tag);
+		}
+	}
+}
+
+unsigned int TagIndex::GetNameId(const string& name) {
+	map<string, unsigned int>::const_iterator p = m_nameIds.find(name);
+	if (p != m_nameIds.end()) return p->second;
+
+	const unsigned int id = m_nameTrees.size();
+	m_nameIds[name] = id;
+	m_nameTrees.push_back(new Tree);
+	return id;
+}
+
+TagIndex::Tree& TagIndex::GetNameTree(unsigned int nameId) {
+	wxASSERT(nameId < m_nameTrees.size());
+	return *m_nameTrees[nameId];
+}
+
+void TagIndex::SetTag(const Token& token, Tag& tag) { // static
+	tag.start = token.start;
+	tag.end = token.end - 1;
+	tag.nameEnd = token.start + ((token.flags & TAG_CLOSING) ? 2 : 1) + token.nameLen;
+	tag.isSelfClosing = (token.flags & TAG_SELFCLOSING) != 0;
+	tag.isClosing = tag.isSelfClosing || (token.flags & TAG_CLOSING);
+}
+
+bool TagIndex::FindTag(unsigned int pos, Tag& tag) const {
+	wxASSERT(IsValid());
+
+	// First token where the '>' is at or after pos
+	const unsigned int index = m_tags->FindEnd(pos+1);
+	if (index == m_tags->GetCount()) return false;
+
+	const Token token = m_tags->Get(index);
+	if (token.start > pos || (token.flags & TAG_COMMENT)) return false;
+
+	SetTag(token, tag);
+	return true;
+}
+
+bool TagIndex::FindMatchingTag(const Tag& tag, Tag& match) const {
+	wxASSERT(IsValid());
+
+	const unsigned int index = m_tags->FindEnd(tag.end+1);
+	if (index == m_tags->GetCount()) return false;
+	const Token token = m_tags->Get(index);
+	if (token.start != tag.start) return false;
+	if (token.flags & (TAG_COMMENT|TAG_SELFCLOSING)) return false;
+
+	// Count the tags with the same name until the depth drops
+	const Tree& tree = *m_nameTrees[token.nameId];
+	const unsigned int nameIndex = tree.FindEnd(token.end);
+	wxASSERT(nameIndex < tree.GetCount() && tree.Get(nameIndex).end == token.end);
+
+	const unsigned int matchIndex = (token.flags & TAG_CLOSING)
+		? tree.FindBackward(nameIndex, 1)
+		: tree.FindForward(nameIndex+1, -1);
+	if (matchIndex == tree.GetCount()) return false;
+
+	SetTag(tree.Get(matchIndex), match);
+	return true;
+}
+
+bool TagIndex::FindParentClosingTag(unsigned int pos, Tag& closingTag) const {
+	wxASSERT(IsValid());
+
+	// Comments and self-closing tags do not change the depth
+	const unsigned int first = m_tags->FindStart(pos);
+	const unsigned int index = m_tags->FindForward(first, -1);
+	if (index == m_tags->GetCount()) return false;
+
+	SetTag(m_tags->Get(index), closingTag);
+	return true;
+}
@@ -0,0 +1,129 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#ifndef __TAGINDEX_H__
+#define __TAGINDEX_H__
+
+#include "wx/wxprec.h"
+#ifndef WX_PRECOMP
+	#include <wx/wx.h>
+#endif
+
+#include "Interval.h"
+#include "TextSource.h"
+#include <vector>
+#include <map>
+#include <string>
+
+struct cxChange;
+
+// The html tags (and comments) in a document, for the tag highlighting.
+//
+// The tags are kept in a balanced tree where each node also holds the
+// nesting depth change of its subtree, so that the matching tag and the
+// parent tag can be found without walking through the tags in between.
+// Each tag name has its own tree as well, as matching only counts tags
+// with the same name.
+//
+// Edits move the following tags and mark the edited text as dirty. The
+// dirty text is scanned again on next update, continuing until the
+// scan gets back in step with the old tags.
+class TagIndex {
+public:
+	struct Tag {
+		unsigned int start;   // the '<'
+		unsigned int end;     // the '>'
+		unsigned int nameEnd;
+		bool isClosing;       // also true for self-closing tags
+		bool isSelfClosing;
+	};
+
+	TagIndex();
+	~TagIndex();
+
+	// Drop everything (index is rebuilt on next update)
+	void Clear();
+
+	// Keep in sync with document
+	void Insert(unsigned int pos, unsigned int length);
+	void Delete(unsigned int start, unsigned int end);
+	void ApplyDiff(const std::vector<cxChange>& changes);
+
+	// Scan the dirty text (builds the index on first call)
+	void Update(const TextSource& source);
+	bool IsValid() const {return m_isBuilt && m_dirty.empty();};
+
+	unsigned int GetTagCount() const;
+
+	// Queries (valid after update)
+	bool FindTag(unsigned int pos, Tag& tag) const; // tag containing pos
+	bool FindMatchingTag(const Tag& tag, Tag& match) const;
+	bool FindParentClosingTag(unsigned int pos, Tag& closingTag) const; // first unmatched closing tag after pos
+
+private:
+	class Tree;
+
+	enum {
+		TAG_CLOSING = 1,
+		TAG_SELFCLOSING = 2,
+		TAG_COMMENT = 4
+	};
+
+	struct Token {
+		unsigned int start;
+		unsigned int end; // after the '>'
+		unsigned int nameId;
+		unsigned int nameLen;
+		unsigned int flags;
+	};
+
+	// State of the scanner (between the brackets)
+	struct ScanState {
+		bool haveOpenBracket;
+		bool inComment;
+		Token open;
+		unsigned int nameStart;
+		unsigned int nameLen;
+		std::string name; // lowercase
+	};
+
+	void Build(const TextSource& source);
+	void ScanRange(const TextSource& source, unsigned int start);
+	bool ScanChunk(const char* text, unsigned int textStart, unsigned int textEnd, unsigned int start, unsigned int end, ScanState& state, std::vector<Token>& tokens, unsigned int& syncEnd, unsigned int& syncIndex);
+	void ReadOpenBracket(const char* text, unsigned int textStart, unsigned int textEnd, unsigned int pos, ScanState& state);
+	bool CheckSync(unsigned int pos, unsigned int& syncEnd, unsigned int& syncIndex);
+	void ReplaceTokens(unsigned int first, unsigned int last, const std::vector<Token>& tokens);
+
+	void MarkDirty(unsigned int start, unsigned int end);
+	unsigned int GetNameId(const std::string& name);
+	Tree& GetNameTree(unsigned int nameId);
+	static void SetTag(const Token& token, Tag& tag);
+
+	static const unsigned int CHUNKSIZE;
+	static const unsigned int MAXNAMELEN;
+
+	// Member variables
+	bool m_isBuilt;
+	unsigned int m_length;
+	Tree* m_tags; // tags and comments
+	std::vector<Tree*> m_nameTrees; // tags by name (without self-closing)
+	std::map<std::string, unsigned int> m_nameIds; // lowercase names
+	std::vector<interval> m_dirty; // sorted
+	std::vector<char> m_buffer;
+
+	// Not copyable
+	TagIndex(const TagIndex&);
+	TagIndex& operator=(const TagIndex&);
+};
+
+#endif // __TAGINDEX_H__
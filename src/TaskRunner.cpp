@@ -0,0 +1,176 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#include "TaskRunner.h"
+
+using namespace std;
+
+// Sleeps until there are tasks, and does them until there are no more
+class TaskRunner::Worker : public wxThread {
+public:
+	Worker(TaskRunner& runner) : wxThread(wxTHREAD_JOINABLE), m_runner(runner) {};
+
+	virtual void* Entry() {
+		for (;;) {
+			m_runner.m_wake.Wait();
+			if (m_runner.m_stop) break;
+
+			m_runner.Work();
+		}
+		return NULL;
+	};
+
+private:
+	TaskRunner& m_runner;
+};
+
+TaskRunner::TaskRunner(unsigned int maxThreads)
+: m_maxThreads(maxThreads ? maxThreads : GetDefaultThreadCount()), m_stop(false),
+  m_idle(m_mutex), m_running(0), m_busy(false), m_cancelled(false) {
+}
+
+TaskRunner::~TaskRunner() {
+	// Running tasks may still use their data, so
+	// we have to wait for them before stopping
+	Cancel();
+	Wait();
+
+	m_stop = true;
+	for (unsigned int i = 0; i < m_workers.size(); ++i) m_wake.Post();
+	for (vector<Worker*>::iterator p = m_workers.begin(); p != m_workers.end(); ++p) {
+		(*p)->Wait();
+		delete *p;
+	}
+}
+
+// static
+unsigned int TaskRunner::GetDefaultThreadCount() {
+	const int cpus = wxThread::GetCPUCount();
+	return cpus > 1 ? cpus : 1;
+}
+
+// static
+unsigned int TaskRunner::Run(unsigned int taskCount, TASK_CALLBACK callback, void* data, unsigned int maxThreads) {
+	if (!maxThreads) maxThreads = GetDefaultThreadCount();
+	TaskRunner runner(wxMin(maxThreads, wxMax(taskCount, 1u)));
+	return runner.RunBatch(taskCount, callback, data);
+}
+
+unsigned int TaskRunner::StartWorkers(unsigned int count) {
+	// If a thread can't be started, we just use fewer
+	while (m_workers.size() < count) {
+		Worker* worker = new Worker(*this);
+		if (worker->Create() != wxTHREAD_NO_ERROR || worker->Run() != wxTHREAD_NO_ERROR) {
+			delete worker;
+			break;
+		}
+		m_workers.push_back(worker);
+	}
+	return m_workers.size();
+}
+
+unsigned int TaskRunner::RunBatch(unsigned int taskCount, TASK_CALLBACK callback, void* data) {
+	wxASSERT(callback);
+	if (taskCount == 0) return 0;
+
+	const unsigned int workers = wxMin(StartWorkers(m_maxThreads - 1), taskCount - 1);
+	{
+		wxMutexLocker lock(m_mutex);
+		const Batch batch = {callback, data, 0, taskCount};
+		m_batches.push_back(batch);
+		m_busy = true;
+		m_cancelled = false;
+	}
+	for (unsigned int i = 0; i < workers; ++i) m_wake.Post();
+
+	// Help out until there are no more tasks
+	Work();
+	Wait();
+
+	return workers + 1;
+}
+
+bool TaskRunner::Add(unsigned int taskCount, TASK_CALLBACK callback, void* data) {
+	wxASSERT(callback);
+
+	// The calling thread does not help, so we need at least one worker
+	const unsigned int workers = StartWorkers(wxMax(m_maxThreads - 1, 1u));
+	if (workers == 0) return false;
+	if (taskCount == 0) return true;
+
+	{
+		wxMutexLocker lock(m_mutex);
+		const Batch batch = {callback, data, 0, taskCount};
+		m_batches.push_back(batch);
+		m_busy = true;
+		m_cancelled = false;
+	}
+	for (unsigned int i = 0; i < wxMin(workers, taskCount); ++i) m_wake.Post();
+
+	return true;
+}
+
+bool TaskRunner::IsBusy() const {
+	wxMutexLocker lock(m_mutex);
+	return m_busy;
+}
+
+void TaskRunner::Cancel() {
+	wxMutexLocker lock(m_mutex);
+	m_batches.clear();
+	m_cancelled = true;
+
+	if (m_busy && m_running == 0) {
+		m_busy = false;
+		m_idle.Broadcast();
+	}
+}
+
+bool TaskRunner::IsCancelled() const {
+	wxMutexLocker lock(m_mutex);
+	return m_cancelled;
+}
+
+void TaskRunner::Wait() {
+	wxMutexLocker lock(m_mutex);
+	while (m_busy) m_idle.Wait();
+}
+
+void TaskRunner::Work() {
+	Batch task;
+	bool finished = false;
+	while (GetNext(task, finished)) {
+		task.callback(task.data, task.next);
+		finished = true;
+	}
+}
+
+bool TaskRunner::GetNext(Batch& task, bool finished) {
+	wxMutexLocker lock(m_mutex);
+	if (finished) --m_running;
+
+	if (m_batches.empty()) {
+		// Last one done wakes up anyone waiting
+		if (m_busy && m_running == 0) {
+			m_busy = false;
+			m_idle.Broadcast();
+		}
+		return false;
+	}
+
+	Batch& batch = m_batches.front();
+	task = batch;
+	if (++batch.next == batch.end) m_batches.pop_front();
+	++m_running;
+	return true;
+}
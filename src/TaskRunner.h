@@ -0,0 +1,94 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#ifndef __TASKRUNNER_H__
+#define __TASKRUNNER_H__
+
+#include "wx/wxprec.h"
+#ifndef WX_PRECOMP
+	#include <wx/wx.h>
+#endif
+
+#include <wx/thread.h>
+#include <deque>
+#include <vector>
+
+// Runs independent tasks on worker threads. A runner keeps its threads
+// (started on first use) between tasks, so it can be used both for
+// batches that the calling thread waits for (and works on as well, so
+// small batches add little overhead), and for work in the background.
+//
+// The tasks must only touch their own data; anything shared (like the
+// bundle database) has to be updated afterwards, from the calling thread.
+class TaskRunner {
+public:
+	// Does the task with the given index
+	typedef void (*TASK_CALLBACK)(void* data, unsigned int index);
+
+	// maxThreads includes the calling thread (zero is one per cpu)
+	TaskRunner(unsigned int maxThreads=0);
+	~TaskRunner();
+
+	// Does the tasks with the help of the calling thread, and waits for
+	// them (and any added before) to finish. Returns the number of threads used.
+	unsigned int RunBatch(unsigned int taskCount, TASK_CALLBACK callback, void* data);
+
+	// Adds tasks to be done in the background (after the ones already
+	// added). Returns false if no thread could be started for them.
+	bool Add(unsigned int taskCount, TASK_CALLBACK callback, void* data);
+
+	bool IsBusy() const; // tasks are waiting or being done
+	void Cancel(); // drops the waiting tasks (running ones have to finish)
+	bool IsCancelled() const; // for long tasks to check (reset when tasks are added)
+	void Wait(); // until the running tasks are done
+
+	// Runs a single batch on a temporary runner
+	static unsigned int Run(unsigned int taskCount, TASK_CALLBACK callback, void* data, unsigned int maxThreads=0);
+
+	static unsigned int GetDefaultThreadCount();
+
+private:
+	class Worker;
+	friend class Worker;
+
+	struct Batch {
+		TASK_CALLBACK callback;
+		void* data;
+		unsigned int next;
+		unsigned int end;
+	};
+
+	unsigned int StartWorkers(unsigned int count);
+	void Work();
+	bool GetNext(Batch& task, bool finished);
+
+	// Member variables
+	const unsigned int m_maxThreads;
+	std::vector<Worker*> m_workers;
+	wxSemaphore m_wake;
+	volatile bool m_stop;
+
+	// The waiting tasks (all guarded by m_mutex)
+	mutable wxMutex m_mutex;
+	wxCondition m_idle;
+	std::deque<Batch> m_batches;
+	unsigned int m_running;
+	bool m_busy;
+	bool m_cancelled;
+
+private:
+	TaskRunner(const TaskRunner&);
+	TaskRunner& operator=(const TaskRunner&);
+};
+
+#endif // __TASKRUNNER_H__
@@ -0,0 +1,28 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#ifndef __TEXTSOURCE_H__
+#define __TEXTSOURCE_H__
+
+#include <vector>
+
+// Gives the indexes that are kept in sync with a document (TagIndex,
+// WordIndex) access to its text, as utf-8.
+class TextSource {
+public:
+	virtual ~TextSource() {};
+	virtual unsigned int GetLength() const = 0;
+	virtual void GetTextPart(unsigned int start, unsigned int end, std::vector<char>& text) const = 0;
+};
+
+#endif // __TEXTSOURCE_H__
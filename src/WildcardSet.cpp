@@ -0,0 +1,77 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#include "WildcardSet.h"
+#include <algorithm>
+
+using namespace std;
+
+WildcardSet::WildcardSet() : m_isEmpty(true), m_matchAll(false) {
+}
+
+WildcardSet::WildcardSet(const wxArrayString& patterns) : m_isEmpty(true), m_matchAll(false) {
+	Set(patterns);
+}
+
+void WildcardSet::Set(const wxArrayString& patterns) {
+	m_isEmpty = patterns.IsEmpty();
+	m_matchAll = false;
+	m_literals.clear();
+	m_prefixes.clear();
+	m_suffixes.clear();
+	m_globs.clear();
+
+	for (size_t i = 0; i < patterns.GetCount(); ++i) {
+		const wxString& pattern = patterns[i];
+		const size_t len = pattern.length();
+
+		// Count the wildcards ('\\' quotes next char in wxMatchWild)
+		size_t stars = 0;
+		bool isGlob = false;
+		for (size_t n = 0; n < len; ++n) {
+			const wxChar c = pattern[n];
+			if (c == wxT('*')) ++stars;
+			else if (c == wxT('?') || c == wxT('\\')) isGlob = true;
+		}
+
+		if (isGlob) m_globs.push_back(pattern);
+		else if (stars == 0) m_literals.push_back(pattern);
+		else if (stars == len) m_matchAll = true;
+		else if (stars == 1 && pattern[0] == wxT('*')) m_suffixes.push_back(pattern.substr(1));
+		else if (stars == 1 && pattern[len-1] == wxT('*')) m_prefixes.push_back(pattern.substr(0, len-1));
+		else m_globs.push_back(pattern);
+	}
+
+	sort(m_literals.begin(), m_literals.end());
+}
+
+bool WildcardSet::Match(const wxString& name) const {
+	// wxMatchWild never matches an empty name with a wildcard
+	if (m_matchAll && !name.empty()) return true;
+
+	if (!m_literals.empty() && binary_search(m_literals.begin(), m_literals.end(), name)) return true;
+
+	for (vector<wxString>::const_iterator p = m_suffixes.begin(); p != m_suffixes.end(); ++p) {
+		if (name.EndsWith(*p)) return true;
+	}
+
+	for (vector<wxString>::const_iterator p = m_prefixes.begin(); p != m_prefixes.end(); ++p) {
+		if (name.StartsWith(*p)) return true;
+	}
+
+	for (vector<wxString>::const_iterator p = m_globs.begin(); p != m_globs.end(); ++p) {
+		if (wxMatchWild(*p, name, false)) return true;
+	}
+
+	return false;
+}
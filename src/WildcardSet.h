@@ -0,0 +1,48 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#ifndef __WILDCARDSET_H__
+#define __WILDCARDSET_H__
+
+#include "wx/wxprec.h"
+#ifndef WX_PRECOMP
+	#include <wx/wx.h>
+#endif
+
+#include <vector>
+
+// A list of wildcard patterns, compiled for matching many names.
+// Matches the same names as trying each pattern with wxMatchWild,
+// but literal names, prefixes ("name*") and suffixes ("*.ext")
+// are compared directly.
+class WildcardSet {
+public:
+	WildcardSet();
+	WildcardSet(const wxArrayString& patterns);
+
+	void Set(const wxArrayString& patterns);
+
+	bool IsEmpty() const {return m_isEmpty;};
+	bool Match(const wxString& name) const;
+
+private:
+	// Member variables
+	bool m_isEmpty;
+	bool m_matchAll;
+	std::vector<wxString> m_literals; // sorted
+	std::vector<wxString> m_prefixes;
+	std::vector<wxString> m_suffixes;
+	std::vector<wxString> m_globs; // anything else
+};
+
+#endif // __WILDCARDSET_H__
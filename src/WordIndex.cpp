@@ -0,0 +1,495 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#include "WordIndex.h"
+#include "Catalyst.h"
+#include <algorithm>
+#include <limits.h>
+
+using namespace std;
+
+// Initializing static constants
+const unsigned int WordIndex::BLOCKSIZE = 4096;
+const unsigned int WordIndex::LINEARSEARCH = 16;
+
+WordIndex::WordIndex() : m_isBuilt(false), m_length(0), m_invalidCount(0), m_hasLastBlock(false) {
+}
+
+void WordIndex::Clear() {
+	m_blocks.clear();
+	m_words.clear();
+	m_wordIters.clear();
+	m_wordRefs.clear();
+	m_freeIds.clear();
+	m_isBuilt = false;
+	m_length = 0;
+	m_invalidCount = 0;
+	m_hasLastBlock = false;
+}
+
+bool WordIndex::IsValid() const {
+	return m_isBuilt && m_invalidCount == 0;
+}
+
+WordIndex::BlockList::iterator WordIndex::FindBlock(unsigned int pos, unsigned int& blockStart) {
+	// Block containing pos (the last block if pos is at the end)
+	wxASSERT(!m_blocks.empty());
+
+	// Edits are usually close to the last one
+	BlockList::iterator p = m_blocks.begin();
+	blockStart = 0;
+	if (m_hasLastBlock) {
+		p = m_lastBlock;
+		blockStart = m_lastBlockStart;
+	}
+	while (pos < blockStart) {
+		--p;
+		blockStart -= p->len;
+	}
+
+	for (;;) {
+		BlockList::iterator next = p;
+		if (++next == m_blocks.end()) break;
+
+		const unsigned int blockEnd = blockStart + p->len;
+		if (pos < blockEnd) break;
+		blockStart = blockEnd;
+		p = next;
+	}
+
+	// Only the found block changes (so its start stays valid)
+	m_lastBlock = p;
+	m_lastBlockStart = blockStart;
+	m_hasLastBlock = true;
+	return p;
+}
+
+void WordIndex::InvalidateBlock(Block& block) {
+	if (!block.isValid) return;
+
+	// Release the words (each word is only counted once per block)
+	unsigned int prevId = UINT_MAX;
+	for (vector<Occurrence>::const_iterator p = block.words.begin(); p != block.words.end(); ++p) {
+		if (p->id == prevId) continue;
+		prevId = p->id;
+
+		if (--m_wordRefs[p->id] == 0) {
+			m_words.erase(m_wordIters[p->id]);
+			m_freeIds.push_back(p->id);
+		}
+	}
+
+	vector<Occurrence>().swap(block.words);
+	block.isValid = false;
+	++m_invalidCount;
+}
+
+void WordIndex::Insert(unsigned int pos, unsigned int length) {
+	if (!m_isBuilt || length == 0) return;
+	m_length += length;
+
+	if (m_blocks.empty()) {
+		m_blocks.push_back(Block(length));
+		++m_invalidCount;
+		return;
+	}
+
+	// Blocks end after a newline, so text inserted at the
+	// start of a block can only join words in that block
+	unsigned int blockStart;
+	Block& block = *FindBlock(pos, blockStart);
+	block.len += length;
+	InvalidateBlock(block);
+}
+
+void WordIndex::Delete(unsigned int start, unsigned int end) {
+	if (!m_isBuilt || start == end) return;
+	wxASSERT(start < end && end <= m_length);
+	m_length -= end - start;
+
+	// Deleting a newline joins the lines around it, so the block containing
+	// start is merged with all blocks until (and including) the one containing end
+	unsigned int firstStart;
+	unsigned int lastStart;
+	const BlockList::iterator first = FindBlock(start, firstStart);
+	BlockList::iterator last = FindBlock(end, lastStart);
+	InvalidateBlock(*first);
+
+	BlockList::iterator next = first;
+	++next;
+	++last;
+	for (BlockList::iterator p = next; p != last; ++p) {
+		InvalidateBlock(*p);
+		first->len += p->len;
+		--m_invalidCount;
+	}
+	m_blocks.erase(next, last);
+
+	wxASSERT(first->len >= end - start);
+	first->len -= end - start;
+	m_lastBlock = first;
+	m_lastBlockStart = firstStart;
+	if (first->len == 0) {
+		m_blocks.erase(first);
+		--m_invalidCount;
+		m_hasLastBlock = false;
+	}
+}
+
+void WordIndex::ApplyDiff(const vector<cxChange>& changes) {
+	// Deletions are offset by the changes before them
+	int offset = 0;
+	for (vector<cxChange>::const_iterator p = changes.begin(); p != changes.end(); ++p) {
+		const unsigned int len = p->end - p->start;
+
+		if (p->type == cxINSERTION) {
+			Insert(p->start, len);
+			offset += len;
+		}
+		else { // if (p->type == cxDELETION)
+			Delete(p->start + offset, p->end + offset);
+			offset -= len;
+		}
+	}
+}
+
+void WordIndex::Update(const TextSource& source) {
+	// Rebuild if the index has missed an edit
+	const unsigned int length = source.GetLength();
+	wxASSERT(!m_isBuilt || m_length == length);
+	if (!m_isBuilt || m_length != length) {
+		Clear();
+		ReadBlocks(source, 0, length, m_blocks);
+		m_isBuilt = true;
+		m_length = length;
+		return;
+	}
+	if (m_invalidCount == 0) return;
+	m_hasLastBlock = false;
+
+	unsigned int blockStart = 0;
+	BlockList blocks;
+	for (BlockList::iterator p = m_blocks.begin(); p != m_blocks.end(); ) {
+		const unsigned int len = p->len;
+		if (!p->isValid) {
+			// Read again (blocks that have grown are split)
+			ReadBlocks(source, blockStart, blockStart + len, blocks);
+			m_blocks.splice(p, blocks);
+			p = m_blocks.erase(p);
+			--m_invalidCount;
+		}
+		else ++p;
+
+		blockStart += len;
+	}
+
+	wxASSERT(m_invalidCount == 0);
+	wxASSERT(blockStart == length);
+}
+
+void WordIndex::ReadBlocks(const TextSource& source, unsigned int start, unsigned int end, BlockList& blocks) {
+	vector<char> text;
+	vector<char> more;
+
+	unsigned int pos = start;
+	while (pos < end) {
+		unsigned int readEnd = wxMin(pos + BLOCKSIZE, end);
+		source.GetTextPart(pos, readEnd, text);
+		unsigned int len = readEnd - pos;
+
+		// Blocks end after a newline (lines longer than a block are kept whole)
+		if (readEnd < end) {
+			unsigned int searched = 0;
+			for (;;) {
+				unsigned int i = text.size();
+				while (i > searched && text[i-1] != '\n') --i;
+				if (i > searched) {
+					len = i;
+					break;
+				}
+				if (readEnd == end) {
+					len = text.size();
+					break;
+				}
+
+				searched = text.size();
+				const unsigned int moreEnd = wxMin(readEnd + BLOCKSIZE, end);
+				source.GetTextPart(readEnd, moreEnd, more);
+				text.insert(text.end(), more.begin(), more.end());
+				readEnd = moreEnd;
+			}
+		}
+
+		blocks.push_back(Block(len));
+		AddWords(blocks.back(), &*text.begin(), len);
+		pos += len;
+	}
+}
+
+void WordIndex::AddWords(Block& block, const char* text, unsigned int len) {
+	wxASSERT(!block.isValid && block.words.empty());
+
+	// The char before a word (if any)
+	const char* baseStart = NULL;
+	wxChar baseChar = 0;
+	bool baseAfterWord = false;
+	bool prevIsWord = false; // blocks start after a newline
+
+	const char* const end = text + len;
+	const char* p = text;
+	Occurrence occ;
+	while (p < end) {
+		unsigned int charLen;
+		wxChar c = DecodeChar(p, end, charLen);
+		if (!IsWordChar(c)) {
+			baseStart = p;
+			baseChar = c;
+			baseAfterWord = prevIsWord;
+			prevIsWord = false;
+			p += charLen;
+			continue;
+		}
+
+		// Find end of word
+		const char* const wordStart = p;
+		p += charLen;
+		while (p < end) {
+			c = DecodeChar(p, end, charLen);
+			if (!IsWordChar(c)) break;
+			p += charLen;
+		}
+		prevIsWord = true;
+
+		occ.id = AddWord(wordStart, p - wordStart);
+		occ.offset = wordStart - text;
+		block.words.push_back(occ);
+
+		// Also index it with a single non-space char before it, if
+		// that char is not part of a word itself
+		if (wordStart > text && !baseAfterWord && !wxIsspace(baseChar)) {
+			occ.id = AddWord(baseStart, p - baseStart);
+			occ.offset = baseStart - text;
+			block.words.push_back(occ);
+		}
+	}
+
+	// Count the words in the block
+	sort(block.words.begin(), block.words.end());
+	unsigned int prevId = UINT_MAX;
+	for (vector<Occurrence>::const_iterator w = block.words.begin(); w != block.words.end(); ++w) {
+		if (w->id == prevId) continue;
+		prevId = w->id;
+		++m_wordRefs[w->id];
+	}
+
+	block.isValid = true;
+}
+
+unsigned int WordIndex::AddWord(const char* word, unsigned int len) {
+	const string key(word, len);
+	WordMap::iterator p = m_words.lower_bound(key);
+	if (p != m_words.end() && p->first == key) return p->second;
+
+	unsigned int id;
+	if (m_freeIds.empty()) {
+		id = m_wordIters.size();
+		m_wordIters.push_back(p);
+		m_wordRefs.push_back(0);
+	}
+	else {
+		id = m_freeIds.back();
+		m_freeIds.pop_back();
+		m_wordRefs[id] = 0;
+	}
+
+	m_wordIters[id] = m_words.insert(p, make_pair(key, id));
+	return id;
+}
+
+void WordIndex::GetCandidates(const wxString& prefix, vector<unsigned int>& ids) const {
+	const wxCharBuffer buf = prefix.mb_str(wxConvUTF8);
+	if (!buf.data()) return;
+	const string key(buf.data());
+	if (key.empty()) return;
+
+	// Words are sorted, so the ones with the prefix follow each other
+	for (WordMap::const_iterator p = m_words.lower_bound(key); p != m_words.end(); ++p) {
+		if (p->first.compare(0, key.size(), key) != 0) break;
+		if (p->first.size() > key.size()) ids.push_back(p->second);
+	}
+}
+
+void WordIndex::Find(const wxString& prefix, unsigned int pos, vector<wxString>& words) const {
+	wxASSERT(IsValid() || !m_isBuilt);
+
+	vector<unsigned int> ids;
+	GetCandidates(prefix, ids);
+	if (ids.empty() || m_blocks.empty()) return;
+
+	// Find the block containing pos
+	BlockList::const_iterator right = m_blocks.begin();
+	unsigned int rightStart = 0;
+	for (;;) {
+		BlockList::const_iterator next = right;
+		if (++next == m_blocks.end() || pos < rightStart + right->len) break;
+		rightStart += right->len;
+		right = next;
+	}
+	BlockList::const_iterator left = right;
+	unsigned int leftEnd = rightStart;
+
+	// Search the blocks outwards from pos, until all words are found
+	// and the remaining blocks are farther away than all of them
+	Search search;
+	search.ids.swap(ids);
+	search.dists.resize(search.ids.size(), UINT_MAX);
+	search.remaining = search.ids.size();
+	if (search.ids.size() > LINEARSEARCH) {
+		// Many words (each possibly in few blocks), so we
+		// will rather look at all words in the blocks
+		search.slots.resize(m_wordIters.size(), UINT_MAX);
+		for (unsigned int i = 0; i < search.ids.size(); ++i) search.slots[search.ids[i]] = i;
+	}
+
+	unsigned int maxDist = UINT_MAX;
+	for (;;) {
+		const bool hasRight = right != m_blocks.end();
+		const bool hasLeft = left != m_blocks.begin();
+		if (!hasRight && !hasLeft) break;
+
+		const unsigned int rightDist = hasRight ? (rightStart > pos ? rightStart - pos : 0) : UINT_MAX;
+		const unsigned int leftDist = hasLeft ? pos - leftEnd : UINT_MAX;
+		if (search.remaining == 0 && wxMin(rightDist, leftDist) > maxDist) break;
+
+		bool isCloser;
+		if (rightDist <= leftDist) {
+			isCloser = SearchBlock(*right, rightStart, pos, search);
+			rightStart += right->len;
+			++right;
+		}
+		else {
+			--left;
+			leftEnd -= left->len;
+			isCloser = SearchBlock(*left, leftEnd, pos, search);
+		}
+
+		if (isCloser && search.remaining == 0) {
+			maxDist = *max_element(search.dists.begin(), search.dists.end());
+		}
+	}
+
+	// Nearest first (same distance ordered by word)
+	vector<Ranked> ranked;
+	ranked.reserve(search.ids.size());
+	for (unsigned int i = 0; i < search.ids.size(); ++i) {
+		const Ranked r = {search.dists[i], &m_wordIters[search.ids[i]]->first};
+		ranked.push_back(r);
+	}
+	sort(ranked.begin(), ranked.end());
+
+	words.reserve(words.size() + ranked.size());
+	for (vector<Ranked>::const_iterator r = ranked.begin(); r != ranked.end(); ++r) {
+		const string& word = *r->word;
+		words.push_back(wxString(word.c_str(), wxConvUTF8, word.size()));
+	}
+}
+
+bool WordIndex::SearchBlock(const Block& block, unsigned int blockStart, unsigned int pos, Search& search) { // static
+	// Returns true if any word was found closer than before
+	bool isCloser = false;
+
+	if (!search.slots.empty() && search.ids.size() > block.words.size() / LINEARSEARCH) {
+		for (vector<Occurrence>::const_iterator p = block.words.begin(); p != block.words.end(); ++p) {
+			const unsigned int i = search.slots[p->id];
+			if (i == UINT_MAX) continue;
+
+			const unsigned int wordPos = blockStart + p->offset;
+			const unsigned int dist = wordPos < pos ? pos - wordPos : wordPos - pos;
+			if (dist < search.dists[i]) {
+				if (search.dists[i] == UINT_MAX) --search.remaining;
+				search.dists[i] = dist;
+				isCloser = true;
+			}
+		}
+		return isCloser;
+	}
+
+	Occurrence target;
+	target.offset = pos > blockStart ? pos - blockStart : 0;
+
+	for (unsigned int i = 0; i < search.ids.size(); ++i) {
+		// Occurrences of the word on either side of pos
+		target.id = search.ids[i];
+		vector<Occurrence>::const_iterator p = lower_bound(block.words.begin(), block.words.end(), target);
+
+		unsigned int dist = UINT_MAX;
+		if (p != block.words.end() && p->id == target.id) {
+			dist = (blockStart + p->offset) - pos;
+		}
+		if (p != block.words.begin() && (--p)->id == target.id) {
+			dist = wxMin(dist, pos - (blockStart + p->offset));
+		}
+
+		if (dist < search.dists[i]) {
+			if (search.dists[i] == UINT_MAX) --search.remaining;
+			search.dists[i] = dist;
+			isCloser = true;
+		}
+	}
+
+	return isCloser;
+}
+
+void WordIndex::GetWords(const wxString& prefix, vector<wxString>& words) const {
+	vector<unsigned int> ids;
+	GetCandidates(prefix, ids);
+
+	words.reserve(words.size() + ids.size());
+	for (vector<unsigned int>::const_iterator p = ids.begin(); p != ids.end(); ++p) {
+		const string& word = m_wordIters[*p]->first;
+		words.push_back(wxString(word.c_str(), wxConvUTF8, word.size()));
+	}
+}
+
+bool WordIndex::IsWordChar(wxChar c) { // static
+#ifdef __WXMSW__
+	return ::IsCharAlphaNumeric(c) != 0 || c == wxT('_');
+#else
+	return wxIsalnum(c) || c == wxT('_');
+#endif
+}
+
+wxChar WordIndex::DecodeChar(const char* p, const char* end, unsigned int& len) { // static
+	// Invalid utf-8 is returned as single (non-word) bytes
+	const unsigned char lead = (unsigned char)*p;
+	len = 1;
+	if (lead < 0x80) return lead;
+
+	unsigned int extra;
+	unsigned int c;
+	if ((lead & 0xE0) == 0xC0) {extra = 1; c = lead & 0x1F;}
+	else if ((lead & 0xF0) == 0xE0) {extra = 2; c = lead & 0x0F;}
+	else if ((lead & 0xF8) == 0xF0) {extra = 3; c = lead & 0x07;}
+	else return 0;
+	if ((unsigned int)(end - p) <= extra) return 0;
+
+	for (unsigned int i = 1; i <= extra; ++i) {
+		const unsigned char b = (unsigned char)p[i];
+		if ((b & 0xC0) != 0x80) return 0;
+		c = (c << 6) | (b & 0x3F);
+	}
+
+	len = extra + 1;
+	if (sizeof(wxChar) == 2 && c > 0xFFFF) return 0; // outside BMP
+	return (wxChar)c;
+}
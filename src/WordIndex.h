@@ -0,0 +1,127 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#ifndef __WORDINDEX_H__
+#define __WORDINDEX_H__
+
+#include "wx/wxprec.h"
+#ifndef WX_PRECOMP
+	#include <wx/wx.h>
+#endif
+
+#include "TextSource.h"
+#include <vector>
+#include <list>
+#include <map>
+#include <string>
+
+struct cxChange;
+
+// The words (runs of alphanumerics and '_') in a document, so that the
+// completion does not have to search the whole text on each request.
+//
+// The text is divided into blocks of whole lines, each holding the
+// words it contains and their positions. Edits only change the length
+// of the blocks they touch and mark them as invalid. Invalid blocks are
+// read again from the document on the next query. The index is empty
+// until the first query, so documents without completions pay nothing.
+//
+// Words directly preceded by a single non-space char (as in $var or @ivar)
+// are also indexed with that char, for completions based on the char
+// before the caret.
+class WordIndex {
+public:
+	WordIndex();
+
+	// Drop everything (index is rebuilt on next update)
+	void Clear();
+
+	// Keep in sync with document
+	void Insert(unsigned int pos, unsigned int length);
+	void Delete(unsigned int start, unsigned int end);
+	void ApplyDiff(const std::vector<cxChange>& changes);
+
+	// Read the invalid blocks (builds the index on first call)
+	void Update(const TextSource& source);
+	bool IsValid() const;
+
+	// Words starting with prefix (and longer than it), nearest to pos first
+	void Find(const wxString& prefix, unsigned int pos, std::vector<wxString>& words) const;
+
+	// Words starting with prefix (and longer than it), in sorted order
+	void GetWords(const wxString& prefix, std::vector<wxString>& words) const;
+
+	unsigned int GetWordCount() const {return m_words.size();};
+
+	// Word chars in utf-8 text
+	static bool IsWordChar(wxChar c);
+	static wxChar DecodeChar(const char* p, const char* end, unsigned int& len);
+
+private:
+	struct Occurrence {
+		unsigned int id;
+		unsigned int offset; // from start of block
+		bool operator<(const Occurrence& o) const {return id < o.id || (id == o.id && offset < o.offset);};
+	};
+
+	struct Block {
+		Block(unsigned int l) : len(l), isValid(false) {};
+		unsigned int len;
+		bool isValid;
+		std::vector<Occurrence> words; // sorted by word, then pos
+	};
+
+	struct Ranked {
+		unsigned int dist;
+		const std::string* word;
+		bool operator<(const Ranked& r) const {return dist < r.dist || (dist == r.dist && *word < *r.word);};
+	};
+
+	struct Search {
+		std::vector<unsigned int> ids;
+		std::vector<unsigned int> dists;
+		std::vector<unsigned int> slots; // index in ids for each word
+		unsigned int remaining; // words not found yet
+	};
+
+	typedef std::list<Block> BlockList;
+	typedef std::map<std::string, unsigned int> WordMap;
+
+	BlockList::iterator FindBlock(unsigned int pos, unsigned int& blockStart);
+	void InvalidateBlock(Block& block);
+	void ReadBlocks(const TextSource& source, unsigned int start, unsigned int end, BlockList& blocks);
+	void AddWords(Block& block, const char* text, unsigned int len);
+	unsigned int AddWord(const char* word, unsigned int len);
+	static bool SearchBlock(const Block& block, unsigned int blockStart, unsigned int pos, Search& search);
+	void GetCandidates(const wxString& prefix, std::vector<unsigned int>& ids) const;
+
+	static const unsigned int BLOCKSIZE; // preferred block size in bytes
+	static const unsigned int LINEARSEARCH; // words to search before looking at whole blocks
+
+	// Member variables
+	BlockList m_blocks; // a list, so that blocks can be split and merged without copying
+	bool m_isBuilt;
+	unsigned int m_length;
+	unsigned int m_invalidCount;
+	BlockList::iterator m_lastBlock; // last edited
+	unsigned int m_lastBlockStart;
+	bool m_hasLastBlock;
+
+	// Words (utf-8), with the number of blocks that contain them
+	WordMap m_words;
+	std::vector<WordMap::iterator> m_wordIters;
+	std::vector<unsigned int> m_wordRefs;
+	std::vector<unsigned int> m_freeIds;
+};
+
+#endif // __WORDINDEX_H__
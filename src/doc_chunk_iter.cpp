@@ -0,0 +1,39 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#include "doc_chunk_iter.h"
+#include "Document.h"
+
+doc_chunk_iter::doc_chunk_iter(const Document& doc, unsigned int start, unsigned int end)
+: m_dbi(doc, start), m_start(start), m_chunkEnd(start), m_end(end), m_data(NULL) {
+	wxASSERT(start <= end && end <= doc.GetLength());
+	SetStart(start);
+}
+
+void doc_chunk_iter::SetStart(unsigned int pos) {
+	m_start = pos;
+	if (pos >= m_end) {
+		m_chunkEnd = m_end;
+		m_data = NULL;
+		return;
+	}
+
+	// The byte iterator points into the segment holding pos,
+	// and knows where that segment ends
+	m_dbi.SetIndex(pos);
+	m_data = (const char*)&*m_dbi;
+
+	const unsigned int segEnd = m_dbi.GetSegEnd();
+	if (segEnd <= pos) m_chunkEnd = pos + 1; // single byte
+	else m_chunkEnd = segEnd < m_end ? segEnd : m_end;
+}
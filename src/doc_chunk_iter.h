@@ -0,0 +1,58 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#ifndef __DOCCHUNKITER_H__
+#define __DOCCHUNKITER_H__
+
+#include "doc_byte_iter.h"
+
+// Predefinitions
+class Document;
+
+// Iterates over a range of the document text in contiguous utf-8 spans,
+// pointing straight into the segments the text is stored in (no copying
+// or decoding). A span may end in the middle of a multi-byte character.
+//
+// The span is only valid until the iterator is moved, and while the
+// document is locked:
+//
+//   for (doc_chunk_iter chunk(doc, start, end); !chunk.AtEnd(); ++chunk) {
+//       const char* p = memchr(chunk.begin(), '\n', chunk.GetLength());
+//       ...
+//   }
+class doc_chunk_iter {
+public:
+	doc_chunk_iter(const Document& doc, unsigned int start, unsigned int end);
+
+	bool AtEnd() const {return m_start >= m_end;};
+	doc_chunk_iter& operator++() {SetStart(m_chunkEnd); return *this;};
+
+	// Current span
+	const char* begin() const {return m_data;};
+	const char* end() const {return m_data + (m_chunkEnd - m_start);};
+	unsigned int GetStart() const {return m_start;};
+	unsigned int GetEnd() const {return m_chunkEnd;};
+	unsigned int GetLength() const {return m_chunkEnd - m_start;};
+
+private:
+	void SetStart(unsigned int pos);
+
+	// Member variables
+	doc_byte_iter m_dbi;
+	unsigned int m_start;
+	unsigned int m_chunkEnd;
+	const unsigned int m_end;
+	const char* m_data;
+};
+
+#endif // __DOCCHUNKITER_H__
@@ -9,3 +9,11 @@ bool RequireEdb(wxString& path) {
 
 	return wxFileExists(path);
 }
+
+// The Bundles and Themes folders are found relative to the app path
+bool RequireBundles(wxString& appPath) {
+	appPath = wxGetCwd();
+	appPath += wxFILE_SEP_PATH;
+
+	return wxDirExists(appPath + wxT("Bundles")) && wxDirExists(appPath + wxT("Themes"));
+}
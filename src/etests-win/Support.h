@@ -4,5 +4,6 @@
 class wxString;
 
 bool RequireEdb(wxString& path);
+bool RequireBundles(wxString& appPath);
 
 #endif
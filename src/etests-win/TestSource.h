@@ -0,0 +1,31 @@
+#ifndef __TESTSOURCE_H__
+#define __TESTSOURCE_H__
+
+#include "TextSource.h"
+#include <string>
+#include <vector>
+
+// The document text (as utf-8) for the indexes that keep in sync with
+// a document. Edits go through here, so that index and text stay in step.
+class TestSource : public TextSource {
+public:
+	TestSource(const char* text) : m_text(text) {};
+
+	unsigned int GetLength() const {return m_text.size();};
+	void GetTextPart(unsigned int start, unsigned int end, std::vector<char>& text) const {
+		text.assign(m_text.begin() + start, m_text.begin() + end);
+	};
+
+	template<class Index> void Insert(Index& index, unsigned int pos, const std::string& text) {
+		m_text.insert(pos, text);
+		index.Insert(pos, text.size());
+	};
+	template<class Index> void Delete(Index& index, unsigned int start, unsigned int end) {
+		m_text.erase(start, end - start);
+		index.Delete(start, end);
+	};
+
+	std::string m_text;
+};
+
+#endif
@@ -0,0 +1,154 @@
+#include "stdafx.h"
+#include <limits.h>
+#include "Document.h"
+#include "doc_byte_iter.h"
+#include "doc_chunk_iter.h"
+#include "ISettings.h"
+#include "Support.h"
+#include <wx/ffile.h>
+#include <wx/stopwatch.h>
+#include <gtest/gtest.h>
+#include <string.h>
+#include <algorithm>
+
+class NoChunkSettings: public ISettings {
+public:
+	virtual bool GetSettingBool(const wxString& name, bool& value) const { return false; };
+	virtual bool GetSettingInt(const wxString& name, int& value) const { return false; };
+	virtual bool GetSettingLong(const wxString& name, wxLongLong& value) const { return false; };
+	virtual bool GetSettingString(const wxString& name, wxString& value) const { return false; };
+};
+
+class DocChunkIterTest: public ::testing::Test {
+protected:
+	virtual void SetUp() {
+		wxString edb;
+		if (!RequireEdb(edb)) {
+			FAIL() << "Need to copy a registered e.db into this folder for this test to run.";
+		}
+
+		pCatalyst = new Catalyst(edb);
+		cw = new CatalystWrapper(*pCatalyst);
+	};
+
+	virtual void TearDown() {
+		if (cw) {delete cw;cw=NULL;}
+		if (pCatalyst) {delete pCatalyst;pCatalyst=NULL;}
+	};
+
+	// Joins the chunks, checking that they follow each other
+	static void GetChunks(const Document& doc, unsigned int start, unsigned int end, std::vector<char>& text) {
+		text.clear();
+		unsigned int pos = start;
+		for (doc_chunk_iter chunk(doc, start, end); !chunk.AtEnd(); ++chunk) {
+			EXPECT_EQ(pos, chunk.GetStart());
+			EXPECT_LT(chunk.GetStart(), chunk.GetEnd());
+			text.insert(text.end(), chunk.begin(), chunk.end());
+			pos = chunk.GetEnd();
+		}
+		EXPECT_EQ(end, pos);
+	}
+
+	Catalyst* pCatalyst;
+	CatalystWrapper* cw;
+};
+
+TEST_F(DocChunkIterTest, SameAsTextPart) {
+	Document doc(*cw);
+	const NoChunkSettings settings;
+	doc.CreateNew(settings);
+
+	// Several inserts, so that the text is stored in several segments
+	std::string line = "A line of text with \xC3\xA6\xC3\xB8\xC3\xA5 in it.\n";
+	std::string text;
+	for (unsigned int i = 0; i < 2000; ++i) text += line;
+	doc.Insert(0, text.c_str());
+	doc.Insert(1000, "inserted\n");
+	doc.Insert(50000, text.c_str());
+	doc.Delete(20000, 30000);
+
+	const unsigned int len = doc.GetLength();
+	const unsigned int ranges[][2] = {{0, len}, {1000, 1009}, {40000, 100000}, {len, len}};
+	for (unsigned int i = 0; i < sizeof(ranges) / sizeof(ranges[0]); ++i) {
+		std::vector<char> expected, chunks;
+		doc.GetTextPart(ranges[i][0], ranges[i][1], expected);
+		GetChunks(doc, ranges[i][0], ranges[i][1], chunks);
+		EXPECT_TRUE(chunks == expected);
+	}
+
+	// Line offsets are found in the chunks
+	std::vector<char> all;
+	doc.GetTextPart(0, len, all);
+	std::vector<unsigned int> lines;
+	doc.GetLines(lines);
+	ASSERT_EQ((size_t)std::count(all.begin(), all.end(), '\n'), lines.size());
+	for (unsigned int i = 0; i < lines.size(); ++i) EXPECT_EQ('\n', all[lines[i]-1]);
+	EXPECT_EQ(len, lines.back());
+}
+
+// Compares the ways of going through the text of a 50MB document. Run with
+// --gtest_also_run_disabled_tests
+TEST_F(DocChunkIterTest, DISABLED_Benchmark) {
+	wxFileName path(wxT("testdata/bench50mb.txt"));
+	path.MakeAbsolute();
+	{
+		const std::string line = "<p class=\"text\">Some text in a line, to have something to scan.</p>\n";
+		std::string text;
+		while (text.size() < 1024 * 1024) text += line;
+
+		wxFFile file(path.GetFullPath(), wxT("wb"));
+		for (unsigned int i = 0; i < 50; ++i) file.Write(text.data(), text.size());
+	}
+
+	Document doc(*cw);
+	const NoChunkSettings settings;
+	doc.CreateNew(settings);
+	std::vector<unsigned int> offsets;
+	ASSERT_EQ(cxFILE_OK, doc.LoadText(path, offsets));
+	const unsigned int len = doc.GetLength();
+
+	// Document::GetChar
+	wxStopWatch sw;
+	unsigned int charCount = 0;
+	for (unsigned int pos = 0; pos < len; ++pos) {
+		if (doc.GetChar(pos) == wxT('\n')) ++charCount;
+	}
+	const long charTime = sw.Time();
+
+	// doc_byte_iter
+	sw.Start();
+	unsigned int byteCount = 0;
+	for (doc_byte_iter dbi(doc); dbi.GetIndex() < (int)len; ++dbi) {
+		if (*dbi == '\n') ++byteCount;
+	}
+	const long byteTime = sw.Time();
+
+	// doc_chunk_iter (byte loop and memchr)
+	sw.Start();
+	unsigned int chunkCount = 0;
+	for (doc_chunk_iter chunk(doc, 0, len); !chunk.AtEnd(); ++chunk) {
+		for (const char* p = chunk.begin(); p < chunk.end(); ++p) {
+			if (*p == '\n') ++chunkCount;
+		}
+	}
+	const long chunkTime = sw.Time();
+
+	sw.Start();
+	unsigned int memchrCount = 0;
+	for (doc_chunk_iter chunk(doc, 0, len); !chunk.AtEnd(); ++chunk) {
+		const char* const end = chunk.end();
+		for (const char* p = chunk.begin(); (p = (const char*)memchr(p, '\n', end - p)) != NULL; ++p) ++memchrCount;
+	}
+	const long memchrTime = sw.Time();
+
+	EXPECT_EQ(charCount, byteCount);
+	EXPECT_EQ(charCount, chunkCount);
+	EXPECT_EQ(charCount, memchrCount);
+	EXPECT_EQ(offsets.size(), charCount); // text ends with newline
+
+	printf("%u bytes: GetChar %ldms, doc_byte_iter %ldms, doc_chunk_iter %ldms, doc_chunk_iter+memchr %ldms\n",
+		len, charTime, byteTime, chunkTime, memchrTime);
+
+	doc.Close();
+	wxRemoveFile(path.GetFullPath());
+}
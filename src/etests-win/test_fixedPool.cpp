@@ -0,0 +1,41 @@
+#include "stdafx.h"
+#include "FixedPool.h"
+#include <gtest/gtest.h>
+#include <vector>
+#include <set>
+
+TEST(FixedPoolTest, AllocFree) {
+	FixedPool pool(12, 4);
+	EXPECT_EQ(0, pool.GetBlockSize() % sizeof(void*));
+	EXPECT_GE(pool.GetBlockSize(), 12);
+	EXPECT_EQ(0, pool.GetReservedSize());
+
+	// Blocks from the same chunk come in address order
+	std::vector<char*> blocks;
+	for (unsigned int i = 0; i < 10; ++i) blocks.push_back((char*)pool.Alloc());
+	EXPECT_EQ(10, pool.GetUsedCount());
+	EXPECT_EQ(3 * 4 * pool.GetBlockSize(), pool.GetReservedSize());
+	EXPECT_EQ(blocks[0] + pool.GetBlockSize(), blocks[1]);
+
+	// No overlaps
+	std::set<char*> unique(blocks.begin(), blocks.end());
+	EXPECT_EQ(blocks.size(), unique.size());
+	for (unsigned int i = 0; i < blocks.size(); ++i) memset(blocks[i], i, 12);
+	for (unsigned int i = 0; i < blocks.size(); ++i) EXPECT_EQ((char)i, blocks[i][11]);
+
+	// Freed blocks are reused
+	pool.Free(blocks[3]);
+	EXPECT_EQ(blocks[3], pool.Alloc());
+
+	// Chunks are only released when all blocks are free
+	EXPECT_FALSE(pool.Release());
+	for (unsigned int i = 0; i < blocks.size(); ++i) pool.Free(blocks[i]);
+	EXPECT_EQ(0, pool.GetUsedCount());
+	EXPECT_TRUE(pool.Release());
+	EXPECT_EQ(0, pool.GetReservedSize());
+
+	// and can be used again after that
+	void* p = pool.Alloc();
+	EXPECT_TRUE(p != NULL);
+	pool.Free(p);
+}
@@ -0,0 +1,169 @@
+#include "stdafx.h"
+#include "FoldIndex.h"
+#include <wx/stopwatch.h>
+#include <gtest/gtest.h>
+#include <vector>
+#include <stdlib.h>
+#include <stdio.h>
+
+// Reference implementation: shifts all the following folds on each edit
+static size_t RefFind(const std::vector<cxFold>& folds, unsigned int line_id) {
+	return lower_bound(folds.begin(), folds.end(), cxFold(line_id)) - folds.begin();
+}
+
+static void RefEdit(std::vector<cxFold>& folds, size_t first, size_t last, const std::vector<cxFold>& newFolds, int lines) {
+	folds.erase(folds.begin() + first, folds.begin() + last);
+	folds.insert(folds.begin() + first, newFolds.begin(), newFolds.end());
+	for (size_t i = first + newFolds.size(); i < folds.size(); ++i) folds[i].line_id += lines;
+}
+
+// A fold on every fourth line, like in well-structured code
+static void MakeFolds(unsigned int lineCount, std::vector<cxFold>& folds) {
+	for (unsigned int i = 0; i < lineCount; i += 4) {
+		folds.push_back(cxFold(i, (i % 8) ? cxFOLD_END : cxFOLD_START, 0));
+	}
+}
+
+// Inserts (or deletes) lines after line_id like EditorCtrl::FoldingInsert/Delete,
+// re-parsing the first line (which gets a fold if it is on a fourth line)
+static void Edit(FoldIndex& index, std::vector<cxFold>& ref, unsigned int line_id, int lines) {
+	size_t first = index.Find(line_id);
+	size_t last = first;
+	if (first < index.size() && index.GetLine(first) == line_id) ++last;
+	if (lines < 0) last = index.Find(line_id - lines + 1, last);
+
+	std::vector<cxFold> newFolds;
+	if (line_id % 4 == 0) newFolds.push_back(cxFold(line_id, cxFOLD_START, 1));
+
+	const size_t refFirst = RefFind(ref, line_id);
+	ASSERT_EQ(refFirst, first);
+	size_t refLast = RefFind(ref, (lines < 0) ? line_id - lines + 1 : line_id + 1);
+	ASSERT_EQ(refLast, last);
+
+	const size_t next = index.Replace(first, last, newFolds);
+	index.Shift(next, lines);
+	RefEdit(ref, refFirst, refLast, newFolds, lines);
+}
+
+static void CheckEqual(const FoldIndex& index, const std::vector<cxFold>& ref) {
+	ASSERT_EQ(ref.size(), index.size());
+	for (size_t i = 0; i < ref.size(); ++i) {
+		ASSERT_EQ(ref[i].line_id, index.GetLine(i));
+		ASSERT_EQ(ref[i].type, index.GetType(i));
+	}
+
+	const std::vector<cxFold>& folds = index.GetFolds();
+	for (size_t i = 0; i < ref.size(); ++i) {
+		ASSERT_EQ(ref[i].line_id, folds[i].line_id);
+	}
+}
+
+TEST(FoldIndexTest, Find) {
+	FoldIndex index;
+	std::vector<cxFold> folds;
+	MakeFolds(40, folds);
+	index.Replace(0, 0, folds);
+	EXPECT_EQ(10, index.size());
+
+	EXPECT_EQ(0, index.Find(0));
+	EXPECT_EQ(1, index.Find(1));
+	EXPECT_EQ(1, index.Find(4));
+	EXPECT_EQ(10, index.Find(37));
+	EXPECT_EQ(5, index.Find(20, 3));
+
+	// Finding works across a pending shift
+	index.Shift(5, 3);
+	EXPECT_EQ(16, index.GetLine(4));
+	EXPECT_EQ(23, index.GetLine(5));
+	EXPECT_EQ(5, index.Find(17));
+	EXPECT_EQ(5, index.Find(23));
+	EXPECT_EQ(6, index.Find(24));
+
+	const std::vector<cxFold>& shifted = index.GetFolds();
+	EXPECT_EQ(16, shifted[4].line_id);
+	EXPECT_EQ(23, shifted[5].line_id);
+	EXPECT_EQ(39, shifted[9].line_id);
+
+	index.Clear();
+	EXPECT_EQ(0, index.size());
+	EXPECT_EQ(0, index.Find(10));
+}
+
+TEST(FoldIndexTest, SameAsReference) {
+	FoldIndex index;
+	std::vector<cxFold> ref;
+	MakeFolds(2000, ref);
+	index.Replace(0, 0, ref);
+
+	srand(7);
+	unsigned int lineCount = 2000;
+	unsigned int line_id = 1000;
+	for (unsigned int i = 0; i < 5000; ++i) {
+		// Mostly near the last edit, sometimes anywhere
+		if (rand() % 10 == 0) line_id = rand() % lineCount;
+		else {
+			const int near = (int)line_id + (rand() % 21) - 10;
+			line_id = wxMin(lineCount-1, (unsigned int)wxMax(0, near));
+		}
+
+		int lines = (rand() % 7) - 3;
+		if (lineCount < 1000) lines = abs(lines); // keep it from running out of lines
+		if (lines < 0) lines = -(int)wxMin((unsigned int)-lines, lineCount - line_id - 1);
+
+		Edit(index, ref, line_id, lines);
+		lineCount += lines;
+
+		if (i % 500 == 0) CheckEqual(index, ref);
+		else {
+			// Checking single folds leaves the shift pending
+			const size_t f = rand() % (ref.size() + 1);
+			if (f < ref.size()) ASSERT_EQ(ref[f].line_id, index.GetLine(f));
+		}
+	}
+	CheckEqual(index, ref);
+}
+
+TEST(FoldIndexTest, DISABLED_Benchmark) {
+	// Typing new lines in a 100k line document
+	const unsigned int lineCount = 100000;
+	const unsigned int edits = 10000;
+
+	std::vector<cxFold> folds;
+	MakeFolds(lineCount, folds);
+	printf("%u lines, %u folds, %u line inserts and deletes\n", lineCount, (unsigned int)folds.size(), edits);
+
+	const unsigned int starts[] = {0, lineCount / 2, lineCount - 100};
+	for (unsigned int s = 0; s < sizeof(starts) / sizeof(starts[0]); ++s) {
+		FoldIndex index;
+		index.Replace(0, 0, folds);
+		std::vector<cxFold> ref = folds;
+
+		// The index
+		wxStopWatch sw;
+		for (unsigned int i = 0; i < edits; ++i) {
+			// Re-parsing the edited line mostly gives the same fold
+			const unsigned int line_id = starts[s] + (i / 2);
+			size_t first = index.Find(line_id);
+			std::vector<cxFold> newFolds;
+			if (first < index.size() && index.GetLine(first) == line_id) newFolds.push_back(cxFold(line_id, index.GetType(first), 0));
+			const size_t next = index.Replace(first, first + newFolds.size(), newFolds);
+			index.Shift(next, (i % 2) ? -1 : 1);
+		}
+		const long indexTime = sw.Time();
+		index.GetFolds(); // as when drawn
+
+		// Shifting all the following folds on each edit
+		sw.Start();
+		for (unsigned int i = 0; i < edits; ++i) {
+			const unsigned int line_id = starts[s] + (i / 2);
+			const size_t first = RefFind(ref, line_id);
+			std::vector<cxFold> newFolds;
+			if (first < ref.size() && ref[first].line_id == line_id) newFolds.push_back(ref[first]);
+			RefEdit(ref, first, first + newFolds.size(), newFolds, (i % 2) ? -1 : 1);
+		}
+		const long refTime = sw.Time();
+		EXPECT_EQ(ref.size(), index.size());
+
+		printf("  from line %u: fold index %ldms, shifting all %ldms\n", starts[s], indexTime, refTime);
+	}
+}
@@ -0,0 +1,49 @@
+#include "stdafx.h"
+#include <limits.h>
+#include "FoldMatcher.h"
+#include <gtest/gtest.h>
+#include <string>
+
+static FoldMatcher::Result MatchLine(const FoldMatcher& fm, const std::string& line) {
+	return fm.Match(line.data(), line.size());
+}
+
+TEST(FoldMatcherTest, Braces) {
+	const FoldMatcher fm("(/\\*\\*|\\{\\s*$)", "(\\*\\*/|^\\s*\\})");
+	EXPECT_TRUE(fm.IsCombined());
+
+	EXPECT_EQ(FoldMatcher::FOLD_START, MatchLine(fm, "function x() {\n"));
+	EXPECT_EQ(FoldMatcher::FOLD_START, MatchLine(fm, "/** doc\n"));
+	EXPECT_EQ(FoldMatcher::FOLD_END, MatchLine(fm, "  }\n"));
+	EXPECT_EQ(FoldMatcher::FOLD_END, MatchLine(fm, "  **/"));
+	EXPECT_EQ(FoldMatcher::FOLD_NONE, MatchLine(fm, "plain\n"));
+	EXPECT_EQ(FoldMatcher::FOLD_NONE, MatchLine(fm, ""));
+
+	// starter and ender on same line cancels out
+	EXPECT_EQ(FoldMatcher::FOLD_NONE, MatchLine(fm, "/** doc **/\n"));
+}
+
+TEST(FoldMatcherTest, CapturesInMarkers) {
+	// Groups in the start marker must not confuse the end marker
+	const FoldMatcher fm("^\\s*(<(\\w+)[^/>]*>)(?!.*</\\w+>)", "^\\s*(</\\w+>)");
+	EXPECT_TRUE(fm.IsCombined());
+
+	EXPECT_EQ(FoldMatcher::FOLD_START, MatchLine(fm, "<div class=\"a\">\n"));
+	EXPECT_EQ(FoldMatcher::FOLD_END, MatchLine(fm, "  </div>\n"));
+	EXPECT_EQ(FoldMatcher::FOLD_NONE, MatchLine(fm, "<b>x</b>\n"));
+}
+
+TEST(FoldMatcherTest, Fallback) {
+	// Back references can not be combined, but must still match
+	const FoldMatcher fm("^(\\w+):\\s*\\1$", "^end");
+	EXPECT_FALSE(fm.IsCombined());
+
+	EXPECT_EQ(FoldMatcher::FOLD_START, MatchLine(fm, "ab: ab"));
+	EXPECT_EQ(FoldMatcher::FOLD_NONE, MatchLine(fm, "ab: cd"));
+	EXPECT_EQ(FoldMatcher::FOLD_END, MatchLine(fm, "end"));
+
+	// Invalid markers never match
+	const FoldMatcher invalid("(", "^end");
+	EXPECT_EQ(FoldMatcher::FOLD_NONE, MatchLine(invalid, "("));
+	EXPECT_EQ(FoldMatcher::FOLD_END, MatchLine(invalid, "end"));
+}
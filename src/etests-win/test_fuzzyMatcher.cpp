@@ -0,0 +1,228 @@
+#include "stdafx.h"
+#include <limits.h>
+#include "FuzzyMatcher.h"
+#include <gtest/gtest.h>
+#include <wx/stopwatch.h>
+#include <algorithm>
+#include <vector>
+#include <stdlib.h>
+
+// Reference implementation (the matching that GotoFileDlg did before)
+static bool RefMatch(const wxString& text, const wxString& name, std::vector<unsigned int>& hl, unsigned int& rank) {
+	const wxString t = text.Lower();
+	const wxString n = name.Lower();
+	hl.clear();
+
+	unsigned int charpos = 0;
+	for (unsigned int i = 0; i < n.size() && charpos < t.size(); ++i) {
+		if (n[i] == t[charpos]) {
+			hl.push_back(i);
+			++charpos;
+		}
+	}
+	if (charpos != t.size()) return false;
+
+	rank = 0;
+	for (unsigned int i = 1; i < hl.size(); ++i) rank += hl[i] - hl[i-1] - 1;
+	return true;
+}
+
+static wxString RandomName(unsigned int len) {
+	static const wxChar chars[] = wxT("abcdeABCDE._-01 ");
+	wxString name;
+	for (unsigned int i = 0; i < len; ++i) name += chars[rand() % (WXSIZEOF(chars)-1)];
+	return name;
+}
+
+static void CheckSameAsRef(const FuzzyMatcher& matcher, const std::vector<wxString>& names, const wxString& text) {
+	std::vector<unsigned int> hl;
+	std::vector<unsigned int> refHl;
+	unsigned int refRank = 0;
+
+	// All matches are found
+	unsigned int refCount = 0;
+	for (unsigned int i = 0; i < names.size(); ++i) {
+		if (RefMatch(text, names[i], refHl, refRank)) ++refCount;
+	}
+	ASSERT_EQ(refCount, matcher.GetMatchCount());
+
+	// Ranking is ordered and highlights are the same
+	for (unsigned int n = 0; n < matcher.GetMatchCount(); ++n) {
+		const unsigned int index = matcher.GetMatch(n);
+		ASSERT_TRUE(RefMatch(text, names[index], refHl, refRank));
+		EXPECT_EQ(refRank, matcher.GetRank(n));
+		EXPECT_TRUE(matcher.GetHighlights(index, hl));
+		EXPECT_EQ(refHl, hl);
+		if (n > 0) EXPECT_LE(matcher.GetRank(n-1), matcher.GetRank(n));
+	}
+}
+
+TEST(FuzzyMatcherTest, Empty) {
+	FuzzyMatcher matcher;
+	EXPECT_EQ(0, matcher.GetNameCount());
+
+	matcher.Find(wxT("abc"));
+	EXPECT_EQ(0, matcher.GetMatchCount());
+
+	matcher.AddName(wxT("abc"));
+	matcher.AddName(wxEmptyString);
+	EXPECT_EQ(2, matcher.GetNameCount());
+
+	matcher.Find(wxEmptyString);
+	EXPECT_EQ(0, matcher.GetMatchCount());
+}
+
+TEST(FuzzyMatcherTest, Ranking) {
+	FuzzyMatcher matcher;
+	matcher.AddName(wxT("EditorCtrl.cpp"));  // 0
+	matcher.AddName(wxT("eDocument.h"));     // 1
+	matcher.AddName(wxT("EditorFrame.cpp")); // 2
+	matcher.AddName(wxT("Document.cpp"));    // 3
+	matcher.AddName(wxT("ed"));              // 4
+	matcher.AddName(wxT("e_d.txt"));         // 5
+
+	matcher.Find(wxT("ED"));
+	ASSERT_EQ(5, matcher.GetMatchCount());
+	EXPECT_EQ(5, matcher.GetMatch(4));
+	EXPECT_EQ(1, matcher.GetRank(4));
+
+	// Same rank is ordered by name (ignoring case)
+	EXPECT_EQ(4, matcher.GetMatch(0));
+	EXPECT_EQ(0, matcher.GetMatch(1));
+	EXPECT_EQ(2, matcher.GetMatch(2));
+	EXPECT_EQ(1, matcher.GetMatch(3));
+	EXPECT_EQ(0, matcher.GetRank(3));
+
+	EXPECT_EQ(1, matcher.FindMatch(0));
+	EXPECT_EQ(wxNOT_FOUND, matcher.FindMatch(3));
+
+	std::vector<unsigned int> hl;
+	EXPECT_TRUE(matcher.GetHighlights(1, hl));
+	ASSERT_EQ(2, hl.size());
+	EXPECT_EQ(0, hl[0]);
+	EXPECT_EQ(1, hl[1]);
+	EXPECT_FALSE(matcher.GetHighlights(3, hl));
+	EXPECT_TRUE(hl.empty());
+
+	matcher.Clear();
+	EXPECT_EQ(0, matcher.GetNameCount());
+	EXPECT_EQ(0, matcher.GetMatchCount());
+}
+
+TEST(FuzzyMatcherTest, SameRankByName) {
+	// Names that only differ after the chars in the sort keys
+	FuzzyMatcher matcher;
+	matcher.AddName(wxT("includes_b.h"));      // 0
+	matcher.AddName(wxT("Includes_a.h"));      // 1
+	matcher.AddName(wxT("\x0100\x0101x"));     // 2
+	matcher.AddName(wxT("\x0100\x0100x"));     // 3
+	matcher.AddName(wxT("includes"));          // 4
+
+	matcher.Find(wxT("s"));
+	ASSERT_EQ(3, matcher.GetMatchCount());
+	EXPECT_EQ(4, matcher.GetMatch(0));
+	EXPECT_EQ(1, matcher.GetMatch(1));
+	EXPECT_EQ(0, matcher.GetMatch(2));
+
+	matcher.Find(wxT("x"));
+	ASSERT_EQ(2, matcher.GetMatchCount());
+	EXPECT_EQ(3, matcher.GetMatch(0));
+	EXPECT_EQ(2, matcher.GetMatch(1));
+}
+
+TEST(FuzzyMatcherTest, FindMatchBeforeSort) {
+	FuzzyMatcher matcher;
+	std::vector<wxString> names;
+	srand(1);
+	for (unsigned int i = 0; i < 2000; ++i) {
+		names.push_back(RandomName(5 + rand() % 20));
+		matcher.AddName(names.back());
+	}
+
+	matcher.Find(wxT("a.c"));
+	for (unsigned int i = 0; i < names.size(); ++i) {
+		const int pos = matcher.FindMatch(i);
+		if (pos != wxNOT_FOUND) EXPECT_EQ(i, matcher.GetMatch(pos));
+	}
+}
+
+TEST(FuzzyMatcherTest, SameAsReference) {
+	// Enough names to be matched on the threads
+	FuzzyMatcher matcher;
+	std::vector<wxString> names;
+	srand(2);
+	for (unsigned int i = 0; i < 50000; ++i) {
+		names.push_back(RandomName(rand() % 30));
+		matcher.AddName(names.back());
+	}
+
+	const wxChar* texts[] = {wxT("a"), wxT("AB"), wxT("e.c"), wxT("0-_ "), wxT("abcdeabcde"), wxT("x")};
+	for (unsigned int i = 0; i < WXSIZEOF(texts); ++i) {
+		matcher.Find(texts[i]);
+		CheckSameAsRef(matcher, names, texts[i]);
+	}
+}
+
+TEST(FuzzyMatcherTest, Refine) {
+	FuzzyMatcher matcher;
+	std::vector<wxString> names;
+	srand(4);
+	for (unsigned int i = 0; i < 30000; ++i) {
+		names.push_back(RandomName(rand() % 30));
+		matcher.AddName(names.back());
+	}
+
+	// Typing, deleting and changing case (refines and full searches)
+	const wxChar* texts[] = {wxT("a"), wxT("ab"), wxT("abc"), wxT("abc."), wxT("ab"), wxT("aB"), wxT("aBe"), wxT("ae"), wxT(""), wxT("0 ")};
+	for (unsigned int i = 0; i < WXSIZEOF(texts); ++i) {
+		matcher.Find(texts[i]);
+		EXPECT_EQ(wxString(texts[i]), matcher.GetText());
+		if (i != 8) CheckSameAsRef(matcher, names, texts[i]);
+	}
+	EXPECT_EQ(0, FuzzyMatcher().GetMatchCount());
+
+	// Added names are searched
+	matcher.AddName(wxT("00"));
+	matcher.Find(wxT("00"));
+	EXPECT_NE(wxNOT_FOUND, matcher.FindMatch(matcher.GetNameCount()-1));
+}
+
+// Run with --gtest_also_run_disabled_tests
+TEST(FuzzyMatcherTest, DISABLED_Benchmark) {
+	// A big project: the names of 500k files
+	const wxChar* prefixes[] = {wxT("src"), wxT("include"), wxT("lib"), wxT("test"), wxT("docs"), wxT("build")};
+	const wxChar* exts[] = {wxT(".cpp"), wxT(".h"), wxT(".txt"), wxT(".py"), wxT(".rb"), wxT(".xml")};
+	const unsigned int count = 500000;
+
+	FuzzyMatcher matcher;
+	srand(3);
+	wxStopWatch sw;
+	for (unsigned int i = 0; i < count; ++i) {
+		wxString name = prefixes[rand() % WXSIZEOF(prefixes)];
+		name += RandomName(4 + rand() % 16);
+		name += exts[rand() % WXSIZEOF(exts)];
+		matcher.AddName(name);
+	}
+	printf("Added %u names in %ldms\n", count, sw.Time());
+
+	// Each text is typed a char at a time
+	const wxChar* texts[] = {wxT("srcab.cpp"), wxT("include"), wxT("test_a.py"), wxT("zzz")};
+	std::vector<unsigned int> hl;
+	for (unsigned int t = 0; t < WXSIZEOF(texts); ++t) {
+		const wxString text = texts[t];
+		long worst = 0;
+		for (unsigned int len = 1; len <= text.size(); ++len) {
+			sw.Start();
+			matcher.Find(text.substr(0, len));
+
+			// Draw a screenfull
+			const unsigned int rows = wxMin(matcher.GetMatchCount(), 40u);
+			for (unsigned int n = 0; n < rows; ++n) matcher.GetHighlights(matcher.GetMatch(n), hl);
+
+			const long time = sw.Time();
+			worst = wxMax(worst, time);
+			printf("  '%s': %u matches in %ldms\n", (const char*)wxString(text.substr(0, len)).mb_str(), matcher.GetMatchCount(), time);
+		}
+		printf("'%s': worst keystroke %ldms\n", (const char*)text.mb_str(), worst);
+	}
+}
@@ -0,0 +1,117 @@
+#include "stdafx.h"
+#include "GrammarCache.h"
+#include "pcre.h"
+#include <wx/filename.h>
+#include <wx/ffile.h>
+#include <gtest/gtest.h>
+#include <string.h>
+
+class GrammarCacheTest : public ::testing::Test {
+protected:
+	virtual void SetUp() {
+		m_path = wxFileName::CreateTempFileName(wxT("grc"));
+		wxRemoveFile(m_path);
+		GrammarCache::Get().Clear();
+	};
+
+	virtual void TearDown() {
+		wxRemoveFile(m_path);
+		GrammarCache::Get().Clear();
+	};
+
+	static void AddPattern(const char* pattern) {
+		const char* error;
+		int erroffset;
+		pcre* re = pcre_compile(pattern, PCRE_UTF8, &error, &erroffset, NULL);
+		ASSERT_TRUE(re != NULL);
+		pcre_extra* study = pcre_study(re, 0, &error);
+		GrammarCache::Get().AddCompiled(pattern, PCRE_UTF8, re, study);
+		free(re);
+		if (study) free(study);
+	};
+
+	static int Exec(const char* pattern, int options, const char* subject) {
+		pcre* re = NULL;
+		pcre_extra* study = NULL;
+		if (!GrammarCache::Get().GetCompiled(pattern, options, re, study)) return -100;
+
+		int ovector[30];
+		const int rc = pcre_exec(re, study, subject, strlen(subject), 0, 0, ovector, 30);
+		free(re);
+		if (study) free(study);
+		return rc < 0 ? rc : ovector[0];
+	};
+
+	wxString m_path;
+};
+
+TEST_F(GrammarCacheTest, SaveAndLoad) {
+	GrammarCache& cache = GrammarCache::Get();
+	cache.AddConverted(wxT("\\h+"), wxT("[[:xdigit:]]+"));
+	AddPattern("\\b(?:def|end)\\b");
+	AddPattern("[a-z]+(?=\\()");
+	EXPECT_EQ(0, Exec("\\b(?:def|end)\\b", PCRE_UTF8, "def foo"));
+
+	ASSERT_TRUE(cache.Save(m_path));
+	cache.Clear();
+	EXPECT_EQ(-100, Exec("[a-z]+(?=\\()", PCRE_UTF8, "x = foo(1)"));
+
+	ASSERT_TRUE(cache.Load(m_path, 0));
+	EXPECT_EQ(1, cache.GetConvertedCount());
+	EXPECT_EQ(2, cache.GetCompiledCount());
+
+	wxString converted;
+	EXPECT_TRUE(cache.GetConverted(wxT("\\h+"), converted));
+	EXPECT_EQ(wxString(wxT("[[:xdigit:]]+")), converted);
+	EXPECT_FALSE(cache.GetConverted(wxT("\\w+"), converted));
+
+	// Loaded patterns match like the originals
+	EXPECT_EQ(4, Exec("[a-z]+(?=\\()", PCRE_UTF8, "x = foo(1)"));
+	EXPECT_EQ(PCRE_ERROR_NOMATCH, Exec("\\b(?:def|end)\\b", PCRE_UTF8, "undefined"));
+
+	// Options are part of the key
+	EXPECT_EQ(-100, Exec("[a-z]+(?=\\()", PCRE_UTF8|PCRE_CASELESS, "x = foo(1)"));
+}
+
+TEST_F(GrammarCacheTest, StampMismatch) {
+	GrammarCache& cache = GrammarCache::Get();
+	ASSERT_FALSE(cache.Load(m_path, 7)); // no file yet
+	AddPattern("x+");
+	ASSERT_TRUE(cache.Save(m_path));
+
+	EXPECT_FALSE(cache.Load(m_path, 8));
+	EXPECT_EQ(0, cache.GetCompiledCount());
+
+	AddPattern("x+");
+	cache.SetStamp(7);
+	EXPECT_EQ(0, cache.GetCompiledCount());
+	AddPattern("x+");
+	ASSERT_TRUE(cache.Save(m_path));
+	EXPECT_TRUE(cache.Load(m_path, 7));
+	EXPECT_EQ(1, cache.GetCompiledCount());
+}
+
+TEST_F(GrammarCacheTest, Corrupt) {
+	GrammarCache& cache = GrammarCache::Get();
+	cache.AddConverted(wxT("a"), wxT("b"));
+	AddPattern("y+");
+	ASSERT_TRUE(cache.Save(m_path));
+
+	// Cut the file short
+	char buffer[4096];
+	size_t count;
+	{
+		wxFFile in(m_path, wxT("rb"));
+		ASSERT_TRUE(in.IsOpened());
+		count = in.Read(buffer, sizeof(buffer));
+	}
+	ASSERT_GT(count, 3);
+	{
+		wxFFile out(m_path, wxT("wb"));
+		out.Write(buffer, count - 3);
+	}
+
+	EXPECT_FALSE(cache.Load(m_path, 0));
+	EXPECT_EQ(0, cache.GetConvertedCount());
+	EXPECT_EQ(0, cache.GetCompiledCount());
+}
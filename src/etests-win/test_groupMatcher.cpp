@@ -0,0 +1,184 @@
+#include "stdafx.h"
+#include "matchers.h"
+#include "pcre.h"
+#include <wx/ffile.h>
+#include <wx/dir.h>
+#include <wx/stopwatch.h>
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+
+// Patterns in the style of the grammars (the \G ones can not be searched normally)
+static const char* const s_patterns[] = {
+	"\\b(?:if|else|elsif|unless|while|until|for|in|do|end|begin|rescue|ensure|return|yield)\\b",
+	"\\b(?:def|class|module)\\s+([A-Za-z_]\\w*)",
+	"(#).*$\\n?",
+	"//.*$",
+	"/\\*",
+	"\"",
+	"'",
+	"\\b(?:0[xX][0-9a-fA-F]+|[0-9]+(?:\\.[0-9]+)?)\\b",
+	"@{1,2}[a-zA-Z_]\\w*",
+	":[a-zA-Z_]\\w*[?!]?",
+	"\\b[A-Z]\\w*\\b",
+	"(?<=\\.)[a-z_]\\w*",
+	"\\G\\s*=",
+	"(?i)\\bnull\\b",
+	"=>|==|!=|<=|>=|&&|\\|\\|",
+	"[{}()\\[\\]]",
+	"\\bx*\\b", // zero-length matches
+	"\xC3\xA6\\w*",
+	"$",
+};
+
+// Moves past the match like the syntax parser does
+static void Advance(const int* ovector, unsigned int callout_id, unsigned int& pos, int& zeromatch) {
+	if (ovector[0] != ovector[1]) zeromatch = -1;
+	else if (zeromatch != -1 && (unsigned int)ovector[0] == pos) {
+		// Another zero-length match at the same place
+		++pos;
+		zeromatch = -1;
+		return;
+	}
+	else zeromatch = callout_id;
+	pos = ovector[1];
+}
+
+class GroupMatcherTest : public ::testing::Test {
+protected:
+	virtual void SetUp() {
+		for (unsigned int i = 0; i < sizeof(s_patterns) / sizeof(s_patterns[0]); ++i) {
+			match_matcher* m = new match_matcher;
+			m->SetPattern(s_patterns[i]);
+			m_members.push_back(m);
+			m_group.AddMember(m);
+		}
+		m_group.Init();
+	};
+
+	virtual void TearDown() {
+		for (unsigned int i = 0; i < m_members.size(); ++i) delete m_members[i];
+	};
+
+	// Reference: tries all members anchored at each position
+	int RefMatch(char* line, unsigned int start, unsigned int len, unsigned int& callout_id, int *ovector, int ovecsize, int zeromatch) {
+		for (unsigned int pos = start; pos < len; ++pos) {
+			if ((line[pos] & 0xC0) == 0x80) continue;
+
+			for (unsigned int i = 0; i < m_members.size(); ++i) {
+				match_matcher& m = *m_members[i];
+				const int rc = pcre_exec(m.GetMatchPattern(), m.GetPatternStudy(), line, len, pos, PCRE_ANCHORED|PCRE_NO_UTF8_CHECK, ovector, ovecsize);
+				if (rc >= 0) {
+					if (pos == start && (int)i == zeromatch) continue;
+					callout_id = i;
+					return rc;
+				}
+			}
+		}
+		return PCRE_ERROR_NOMATCH;
+	};
+
+	// Tokenizes the line like the syntax parser does, checking each match against the reference
+	void CheckLine(std::string line) {
+		m_cache.LineChanged();
+
+		const unsigned int len = line.size();
+		unsigned int pos = 0;
+		int zeromatch = -1;
+		while (pos < len) {
+			int ovector[30], refOvector[30];
+			unsigned int callout_id = 0, refCallout_id = 0;
+			const int rc = m_group.Match(&line[0], pos, len, callout_id, ovector, 30, zeromatch, m_cache);
+			const int refRc = RefMatch(&line[0], pos, len, refCallout_id, refOvector, 30, zeromatch);
+
+			ASSERT_EQ(refRc, rc) << line << " at " << pos;
+			if (rc < 0) break;
+			EXPECT_EQ(refCallout_id, callout_id) << line << " at " << pos;
+			for (int i = 0; i < 2 * rc; ++i) EXPECT_EQ(refOvector[i], ovector[i]) << line << " at " << pos;
+
+			Advance(ovector, callout_id, pos, zeromatch);
+		}
+	};
+
+	std::vector<match_matcher*> m_members;
+	group_matcher m_group;
+	MatchCache m_cache;
+};
+
+TEST_F(GroupMatcherTest, SameAsAnchored) {
+	CheckLine("def foo(a, b) # comment\n");
+	CheckLine("  x = @bar.baz(:sym, \"str\", 'c') if a >= 0x1F && b != null\n");
+	CheckLine("class Foo < Bar; NULL; end\n");
+	CheckLine("= \xC3\xA6\xC3\xB8 \xC3\xA6bc /* x */ // y\n");
+	CheckLine("xxx   xx x\n");
+	CheckLine("no newline");
+	CheckLine("\n");
+}
+
+TEST_F(GroupMatcherTest, Random) {
+	static const char* const pieces[] = {"def ", "end", " ", "x", "(", ")", "\"", "#", ".", "foo", "Bar", "12", ":a", "@b", "=", "=>", "\xC3\xA6", "\xC3\xB8", "/*", "//", "null", "\t"};
+	const unsigned int pieceCount = sizeof(pieces) / sizeof(pieces[0]);
+	srand(7);
+
+	for (unsigned int i = 0; i < 500; ++i) {
+		std::string line;
+		const unsigned int count = rand() % 30;
+		for (unsigned int p = 0; p < count; ++p) line += pieces[rand() % pieceCount];
+		if (rand() % 4) line += '\n';
+		CheckLine(line);
+		if (HasFatalFailure()) return;
+	}
+}
+
+// Compares the reference scan with the group matcher on the language samples.
+// Run with --gtest_also_run_disabled_tests
+TEST_F(GroupMatcherTest, DISABLED_Benchmark) {
+	wxArrayString files;
+	wxDir::GetAllFiles(wxT("../../testfiles/languages"), &files);
+	ASSERT_FALSE(files.empty());
+
+	for (unsigned int f = 0; f < files.size(); ++f) {
+		if (files[f].EndsWith(wxT("readme.txt"))) continue;
+		wxFFile file(files[f], wxT("rb"));
+		wxString text;
+		if (!file.ReadAll(&text, wxConvUTF8)) continue;
+		const wxCharBuffer buf = text.mb_str(wxConvUTF8);
+
+		// Split in lines (repeated to get measurable times)
+		std::vector<std::string> lines;
+		for (unsigned int r = 0; r < 200; ++r) {
+			for (const char* p = buf.data(); *p; ) {
+				const char* const newline = strchr(p, '\n');
+				const char* const end = newline ? newline+1 : p + strlen(p);
+				lines.push_back(std::string(p, end));
+				p = end;
+			}
+		}
+
+		long times[2];
+		for (unsigned int pass = 0; pass < 2; ++pass) {
+			wxStopWatch sw;
+			for (unsigned int l = 0; l < lines.size(); ++l) {
+				std::string& line = lines[l];
+				m_cache.LineChanged();
+
+				const unsigned int len = line.size();
+				unsigned int pos = 0;
+				int zeromatch = -1;
+				while (pos < len) {
+					int ovector[30];
+					unsigned int callout_id;
+					const int rc = pass ? m_group.Match(&line[0], pos, len, callout_id, ovector, 30, zeromatch, m_cache)
+					                    : RefMatch(&line[0], pos, len, callout_id, ovector, 30, zeromatch);
+					if (rc < 0) break;
+					Advance(ovector, callout_id, pos, zeromatch);
+				}
+			}
+			times[pass] = wxMax(sw.Time(), 1L);
+		}
+
+		printf("%s: %u lines, anchored scan %.0f lines/s, group matcher %.0f lines/s\n", (const char*)files[f].mb_str(wxConvUTF8),
+			(unsigned int)lines.size(), (lines.size() * 1000.0) / times[0], (lines.size() * 1000.0) / times[1]);
+	}
+}
@@ -0,0 +1,105 @@
+#include "stdafx.h"
+#include "IdleScheduler.h"
+#include <gtest/gtest.h>
+#include <vector>
+
+// Scheduler with a clock that only moves when the jobs work
+class TestScheduler : public IdleScheduler {
+public:
+	TestScheduler(unsigned int passBudget) : IdleScheduler(passBudget), m_time(0) {};
+	wxLongLong GetTime() const {return m_time;};
+	wxLongLong m_time;
+};
+
+struct TestJob {
+	TestJob(TestScheduler& s, unsigned int c, unsigned int w) : scheduler(s), cost(c), work(w), stopEarly(true), runs(0) {};
+
+	// Works in steps of cost until the slice has expired (or there is no more work)
+	static bool Run(TestJob* job, const IdleScheduler::Slice& slice) {
+		++job->runs;
+		job->order.push_back(job);
+		while (job->work) {
+			job->scheduler.m_time += job->cost;
+			--job->work;
+			if (job->stopEarly && slice.IsExpired()) break;
+		}
+		return job->work > 0;
+	};
+
+	TestScheduler& scheduler;
+	unsigned int cost;
+	unsigned int work;
+	bool stopEarly;
+	unsigned int runs;
+	static std::vector<TestJob*> order;
+};
+
+std::vector<TestJob*> TestJob::order;
+
+TEST(IdleSchedulerTest, Budgets) {
+	TestScheduler scheduler(1000);
+	TestJob viewport(scheduler, 100, 50);
+	TestJob doc1(scheduler, 100, 50);
+	TestJob doc2(scheduler, 100, 50);
+
+	// Registered out of order, viewport jobs still go first
+	scheduler.AddJob(wxT("doc1"), IdleScheduler::PRIORITY_DOCUMENT, 600, (IdleScheduler::JOB_CALLBACK)TestJob::Run, &doc1);
+	scheduler.AddJob(wxT("doc2"), IdleScheduler::PRIORITY_DOCUMENT, 600, (IdleScheduler::JOB_CALLBACK)TestJob::Run, &doc2);
+	const unsigned int v = scheduler.AddJob(wxT("viewport"), IdleScheduler::PRIORITY_VIEWPORT, 500, (IdleScheduler::JOB_CALLBACK)TestJob::Run, &viewport);
+
+	// The viewport job uses its budget, doc1 gets the rest of the pass
+	TestJob::order.clear();
+	EXPECT_TRUE(scheduler.Run());
+	ASSERT_EQ(2, TestJob::order.size());
+	EXPECT_EQ(&viewport, TestJob::order[0]);
+	EXPECT_EQ(&doc1, TestJob::order[1]);
+	EXPECT_EQ(45, viewport.work);
+	EXPECT_EQ(45, doc1.work);
+	EXPECT_EQ(0, doc2.runs);
+	EXPECT_EQ(1, scheduler.GetJobStats(1).deferred);
+
+	// doc2 has waited longest, so it goes before doc1
+	TestJob::order.clear();
+	EXPECT_TRUE(scheduler.Run());
+	ASSERT_EQ(2, TestJob::order.size());
+	EXPECT_EQ(&doc2, TestJob::order[1]);
+
+	// Stats
+	const IdleScheduler::JobStats& stats = scheduler.GetJobStats(v);
+	EXPECT_TRUE(stats.name == wxT("viewport"));
+	EXPECT_EQ(2, stats.runs);
+	EXPECT_EQ(1000, stats.totalTime.GetValue());
+	EXPECT_EQ(500, stats.maxTime.GetValue());
+	EXPECT_EQ(0, stats.overruns);
+
+	// A job that does not watch the clock is counted as over budget,
+	// and the document jobs have to wait
+	viewport.stopEarly = false;
+	TestJob::order.clear();
+	EXPECT_TRUE(scheduler.Run());
+	ASSERT_EQ(1, TestJob::order.size());
+	EXPECT_EQ(0, viewport.work);
+	EXPECT_EQ(1, stats.overruns);
+	EXPECT_EQ(4000, stats.maxTime.GetValue());
+	EXPECT_EQ(2, scheduler.GetJobStats(0).deferred);
+	EXPECT_EQ(2, scheduler.GetJobStats(1).deferred);
+
+	// Run until all is done
+	unsigned int passes = 0;
+	while (scheduler.Run()) ++passes;
+	EXPECT_EQ(0, doc1.work);
+	EXPECT_EQ(0, doc2.work);
+	EXPECT_LT(passes, 20);
+
+	scheduler.ResetStats();
+	EXPECT_EQ(0, stats.runs);
+	EXPECT_EQ(0, stats.totalTime.GetValue());
+}
+
+TEST(IdleSchedulerTest, Ticks) {
+	const wxLongLong start = IdleScheduler::GetTicks();
+	wxMilliSleep(20);
+	const wxLongLong elapsed = IdleScheduler::GetTicks() - start;
+	EXPECT_GE(elapsed.GetValue(), 15000);
+	EXPECT_LT(elapsed.GetValue(), 2000000);
+}
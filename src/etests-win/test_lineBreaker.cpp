@@ -0,0 +1,77 @@
+#include "stdafx.h"
+#include <limits.h>
+#include "LineBreaker.h"
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+// All latin-1 chars are 7 pixels wide, lines are 10 chars wide
+static void InitBreaker(LineBreaker& lb, bool smartWrap) {
+	for (unsigned int c = 1; c < 256; ++c) lb.SetAdvance(c, 7);
+	lb.SetLayout(70, 28, 10, smartWrap);
+}
+
+static unsigned int LineHeight(const LineBreaker& lb, const std::string& line, std::vector<unsigned int>* missing=NULL) {
+	std::vector<unsigned int> extents;
+	return lb.GetHeight(line.data(), line.size(), extents, missing);
+}
+
+TEST(LineBreakerTest, Breaking) {
+	LineBreaker lb;
+	InitBreaker(lb, false);
+	ASSERT_TRUE(lb.IsValid());
+
+	EXPECT_EQ(10u, LineHeight(lb, "hello\n"));
+	EXPECT_EQ(10u, LineHeight(lb, ""));
+
+	// Break after whitespace
+	EXPECT_EQ(20u, LineHeight(lb, "aaaa bbbb cccc\n"));
+
+	// Words too long to fit line are broken at char level
+	EXPECT_EQ(30u, LineHeight(lb, "xxxxxxxxxxxxxxxxxxxxxxxxx\n"));
+
+	// Tabs extend to next tab stop
+	EXPECT_EQ(20u, LineHeight(lb, "\tabcdefgh\n"));
+}
+
+TEST(LineBreakerTest, SmartWrap) {
+	LineBreaker lb;
+	InitBreaker(lb, true);
+
+	// Wrapped lines are indented like the first line
+	EXPECT_EQ(30u, LineHeight(lb, "\tabcdefgh\n"));
+	EXPECT_EQ(30u, LineHeight(lb, "    aaaa bbbb cccc\n"));
+}
+
+TEST(LineBreakerTest, GlyphCache) {
+	LineBreaker lb;
+	InitBreaker(lb, false);
+
+	// Multibyte chars in the cache
+	EXPECT_TRUE(lb.IsCached(0xE5));
+	EXPECT_EQ(10u, LineHeight(lb, "\xC3\xA5\xC3\xA5\xC3\xA5\n"));
+
+	// Missing chars are reported
+	const std::string cjk = "\xE4\xB8\xAD\xE4\xB8\xAD\xE4\xB8\xAD\xE4\xB8\xAD\xE4\xB8\xAD\xE4\xB8\xAD\n";
+	std::vector<unsigned int> missing;
+	EXPECT_EQ(0u, LineHeight(lb, cjk, &missing));
+	ASSERT_FALSE(missing.empty());
+	EXPECT_EQ(0x4E2Du, missing[0]);
+
+	lb.SetAdvance(0x4E2D, 14);
+	EXPECT_TRUE(lb.IsCached(0x4E2D));
+	EXPECT_EQ(20u, LineHeight(lb, cjk));
+
+	// Chars outside basic multilingual plane always need the dc
+	missing.clear();
+	EXPECT_EQ(0u, LineHeight(lb, "\xF0\x9F\x98\x80\n", &missing));
+	EXPECT_TRUE(missing.empty());
+
+	// No breaking without a layout
+	lb.SetLayout(0, 0, 0, false);
+	EXPECT_FALSE(lb.IsValid());
+	EXPECT_EQ(0u, LineHeight(lb, "hello\n"));
+
+	lb.ClearAdvances();
+	EXPECT_FALSE(lb.IsCached('a'));
+}
@@ -0,0 +1,144 @@
+#include "stdafx.h"
+#include <limits.h>
+#include "LineIndex.h"
+#include <gtest/gtest.h>
+#include <vector>
+#include <stdlib.h>
+
+// Reference implementation: flat vectors of line values
+struct RefLines {
+	std::vector<unsigned int> lengths;
+	std::vector<unsigned int> heights;
+	std::vector<unsigned int> widths;
+};
+
+static void CheckEqual(const LineIndex& li, const RefLines& ref, unsigned int approx) {
+	ASSERT_TRUE(li.verify());
+	ASSERT_EQ(ref.lengths.size(), li.size());
+
+	unsigned int offset = 0;
+	unsigned int ypos = 0;
+	unsigned int maxWidth = 0;
+	unsigned int firstUnmeasured = li.size();
+	for (unsigned int i = 0; i < ref.lengths.size(); ++i) {
+		const unsigned int height = ref.heights[i] ? ref.heights[i] : approx;
+		ASSERT_EQ(offset, li.offset(i));
+		ASSERT_EQ(offset + ref.lengths[i], li.end(i));
+		ASSERT_EQ(ypos, li.top(i));
+		ASSERT_EQ(ypos + height, li.bottom(i));
+		ASSERT_EQ(ref.widths[i], li.line_width(i));
+
+		offset += ref.lengths[i];
+		ypos += height;
+		if (ref.widths[i] > maxWidth) maxWidth = ref.widths[i];
+		if (ref.heights[i] == 0 && firstUnmeasured == li.size()) firstUnmeasured = i;
+	}
+	EXPECT_EQ(offset, li.length());
+	EXPECT_EQ(ypos, li.height());
+	EXPECT_EQ(maxWidth, li.max_width());
+	EXPECT_EQ(firstUnmeasured, li.find_unmeasured());
+
+	// Searches are lower bounds on line ends and bottoms
+	unsigned int end = 0;
+	unsigned int bottom = 0;
+	for (unsigned int i = 0; i < ref.lengths.size(); ++i) {
+		const unsigned int start = end;
+		end += ref.lengths[i];
+		if (end > start) {
+			ASSERT_EQ(i, li.find_offset(start+1));
+			ASSERT_EQ(i, li.find_offset(end));
+		}
+
+		const unsigned int top = bottom;
+		bottom += ref.heights[i] ? ref.heights[i] : approx;
+		if (bottom > top) {
+			ASSERT_EQ(i, li.find_ypos(top+1));
+			ASSERT_EQ(i, li.find_ypos(bottom));
+		}
+	}
+	EXPECT_EQ(li.size(), li.find_offset(end+1));
+	EXPECT_EQ(li.size(), li.find_ypos(bottom+1));
+}
+
+TEST(LineIndexTest, AssignAndGetEnds) {
+	std::vector<unsigned int> ends;
+	for (unsigned int i = 1; i <= 10000; ++i) ends.push_back(i * 3);
+
+	LineIndex li;
+	li.assign(ends);
+	EXPECT_TRUE(li.verify());
+	EXPECT_EQ(10000u, li.size());
+	EXPECT_EQ(30000u, li.length());
+	EXPECT_EQ(2999u, li.find_offset(9000));
+	EXPECT_EQ(3000u, li.find_offset(9001));
+
+	std::vector<unsigned int> result;
+	li.get_ends(result);
+	EXPECT_EQ(ends, result);
+
+	li.erase(0, li.size());
+	EXPECT_EQ(0u, li.size());
+	EXPECT_EQ(0u, li.length());
+}
+
+TEST(LineIndexTest, RandomEdits) {
+	const unsigned int approx = 7;
+	LineIndex li;
+	li.set_approx_height(approx);
+	RefLines ref;
+	srand(42);
+
+	for (unsigned int i = 0; i < 3000; ++i) {
+		const unsigned int size = ref.lengths.size();
+		const int op = rand() % 6;
+
+		if (op < 2 || size == 0) {
+			// Insert a run of lines (sometimes large enough to split nodes)
+			const unsigned int index = rand() % (size+1);
+			const unsigned int count = (rand() % 10 == 0) ? rand() % 1000 : 1 + rand() % 3;
+			std::vector<unsigned int> lengths;
+			for (unsigned int n = 0; n < count; ++n) lengths.push_back(1 + rand() % 50);
+
+			li.insert(index, lengths);
+			ref.lengths.insert(ref.lengths.begin() + index, lengths.begin(), lengths.end());
+			ref.heights.insert(ref.heights.begin() + index, count, 0);
+			ref.widths.insert(ref.widths.begin() + index, count, 0);
+		}
+		else if (op == 2) {
+			const unsigned int first = rand() % size;
+			const unsigned int last = first + 1 + ((rand() % 10 == 0) ? rand() % 800 : rand() % 3);
+			const unsigned int end = last < size ? last : size;
+
+			li.erase(first, end);
+			ref.lengths.erase(ref.lengths.begin() + first, ref.lengths.begin() + end);
+			ref.heights.erase(ref.heights.begin() + first, ref.heights.begin() + end);
+			ref.widths.erase(ref.widths.begin() + first, ref.widths.begin() + end);
+		}
+		else if (op == 3) {
+			const unsigned int index = rand() % size;
+			const unsigned int length = 1 + rand() % 50;
+			li.set_length(index, length);
+			ref.lengths[index] = length;
+		}
+		else if (op == 4) {
+			const unsigned int index = rand() % size;
+			const unsigned int height = rand() % 30;
+			li.set_height(index, height);
+			ref.heights[index] = height;
+		}
+		else {
+			const unsigned int index = rand() % size;
+			const unsigned int width = rand() % 1000;
+			li.set_width(index, width);
+			ref.widths[index] = width;
+		}
+
+		if (i % 50 == 0) CheckEqual(li, ref, approx);
+	}
+	CheckEqual(li, ref, approx);
+
+	// Clearing heights makes all lines count with the approximation
+	li.clear_heights();
+	ref.heights.assign(ref.heights.size(), 0);
+	CheckEqual(li, ref, approx);
+}
@@ -0,0 +1,93 @@
+#include "stdafx.h"
+#include <limits.h>
+#include "LiteralMatcher.h"
+#include <gtest/gtest.h>
+#include <string>
+#include <stdlib.h>
+
+// Reference implementation: test every position
+static const char* NaiveFind(const char* start, const char* end, const std::string& pattern, const std::string& patternAlt) {
+	const size_t len = pattern.size();
+	for (const char* p = start; p + len <= end; ++p) {
+		size_t i = 0;
+		for (; i < len; ++i) {
+			if (p[i] != pattern[i] && p[i] != patternAlt[i]) break;
+		}
+		if (i == len) return p;
+	}
+	return NULL;
+}
+
+// All kernels (supported by this cpu) have to give exactly the same result as the reference
+static void CheckAllKernels(const std::string& text, const std::string& pattern, const std::string& patternAlt, bool matchCase) {
+	const char* start = text.data();
+	const char* end = start + text.size();
+
+	const LiteralMatcher::Kernel kernels[] = {LiteralMatcher::KERNEL_SCALAR, LiteralMatcher::KERNEL_SSE2, LiteralMatcher::KERNEL_AVX2};
+	for (size_t k = 0; k < sizeof(kernels)/sizeof(kernels[0]); ++k) {
+		if (!LiteralMatcher::IsKernelSupported(kernels[k])) continue;
+
+		LiteralMatcher lm(pattern.data(), matchCase ? NULL : patternAlt.data(), pattern.size());
+		lm.SetKernel(kernels[k]);
+
+		for (size_t offset = 0; offset <= text.size(); ++offset) {
+			const char* expected = NaiveFind(start + offset, end, pattern, matchCase ? pattern : patternAlt);
+			const char* found = lm.Find(start + offset, end);
+			ASSERT_EQ(expected, found) << LiteralMatcher::GetKernelName(kernels[k]) << " pattern: " << pattern << " offset: " << offset;
+		}
+	}
+}
+
+TEST(LiteralMatcherTest, Basic) {
+	const std::string text = "The quick brown fox jumps over the lazy dog. THE QUICK BROWN FOX JUMPS OVER THE LAZY DOG.";
+
+	CheckAllKernels(text, "the", "THE", false);
+	CheckAllKernels(text, "the", "the", true);
+	CheckAllKernels(text, "dog.", "DOG.", false);
+	CheckAllKernels(text, "x", "X", false);
+	CheckAllKernels(text, "cat", "CAT", false);
+	CheckAllKernels(text, text, text, true);
+}
+
+TEST(LiteralMatcherTest, Utf8) {
+	// e-acute, upper- & lowercase differ in the continuation byte
+	const std::string text = "caf\xc3\xa9 CAF\xc3\x89 caf\xc3\x89 \xc3\xa9\xc3\xa9\xc3\x89";
+
+	CheckAllKernels(text, "caf\xc3\xa9", "CAF\xc3\x89", false);
+	CheckAllKernels(text, "\xc3\xa9", "\xc3\x89", false);
+	CheckAllKernels(text, "\xc3\xa9", "\xc3\xa9", true);
+}
+
+TEST(LiteralMatcherTest, ChunkBorders) {
+	// Place matches around the 16 & 32 byte block borders
+	for (size_t pos = 0; pos < 70; ++pos) {
+		std::string text(80, '.');
+		text.replace(pos, 5, "a...b");
+		CheckAllKernels(text, "a...b", "A...B", false);
+		CheckAllKernels(text, "a...b", "a...b", true);
+	}
+}
+
+TEST(LiteralMatcherTest, RandomCorpus) {
+	// Small alphabet to get plenty of partial matches
+	const char alphabet[] = "aAbB\xc3\xa9\xc3\x89 \n";
+	const size_t alphabetLen = sizeof(alphabet)-1;
+	srand(42);
+
+	for (unsigned int i = 0; i < 500; ++i) {
+		const size_t patternLen = 1 + rand() % 10;
+		std::string pattern;
+		std::string patternAlt;
+		for (size_t p = 0; p < patternLen; ++p) {
+			const char c = alphabet[rand() % alphabetLen];
+			pattern += c;
+			patternAlt += (c >= 'a' && c <= 'z') ? (char)(c - 32) : ((c == '\xa9') ? '\x89' : c);
+		}
+
+		std::string text;
+		const size_t textLen = rand() % 200;
+		for (size_t t = 0; t < textLen; ++t) text += alphabet[rand() % alphabetLen];
+
+		CheckAllKernels(text, pattern, patternAlt, (i % 2) == 0);
+	}
+}
@@ -0,0 +1,154 @@
+#include "stdafx.h"
+#include "MatchIndex.h"
+#include <gtest/gtest.h>
+#include <vector>
+#include <stdlib.h>
+
+typedef std::vector<interval> Matches;
+
+// Reference implementations on a plain vector
+static void RefInsert(Matches& matches, unsigned int pos, unsigned int len) {
+	for (Matches::iterator p = matches.begin(); p != matches.end();) {
+		if (p->end > pos) {
+			if (p->start < pos) {p = matches.erase(p); continue;}
+			p->start += len;
+			p->end += len;
+		}
+		++p;
+	}
+}
+
+static void RefDelete(Matches& matches, unsigned int start, unsigned int end) {
+	const unsigned int len = end - start;
+	for (Matches::iterator p = matches.begin(); p != matches.end();) {
+		if (p->end > start) {
+			if (p->start < end) {p = matches.erase(p); continue;}
+			p->start -= len;
+			p->end -= len;
+		}
+		++p;
+	}
+}
+
+static void CheckSame(const MatchIndex& index, const Matches& matches) {
+	ASSERT_TRUE(index.Verify());
+	ASSERT_EQ(matches.size(), index.GetCount());
+	for (unsigned int i = 0; i < matches.size(); ++i) {
+		EXPECT_EQ(matches[i].start, index.Get(i).start);
+		EXPECT_EQ(matches[i].end, index.Get(i).end);
+	}
+}
+
+TEST(MatchIndexTest, Edits) {
+	MatchIndex index;
+	Matches matches;
+	EXPECT_TRUE(index.IsEmpty());
+	EXPECT_EQ(0, index.FindEnd(0));
+
+	matches.push_back(interval(2, 5));
+	matches.push_back(interval(5, 5)); // zero-length
+	matches.push_back(interval(10, 12));
+	EXPECT_EQ(20, index.Replace(0, 20, matches));
+	CheckSame(index, matches);
+
+	EXPECT_EQ(0, index.FindEnd(3));
+	EXPECT_EQ(1, index.FindStart(3));
+	EXPECT_EQ(2, index.FindStart(6));
+	EXPECT_EQ(3, index.FindStart(11));
+
+	// Insert before, inside and after matches
+	index.Insert(0, 3); RefInsert(matches, 0, 3);
+	CheckSame(index, matches);
+	index.Insert(6, 1); RefInsert(matches, 6, 1); // inside first match
+	CheckSame(index, matches);
+	index.Insert(20, 1); RefInsert(matches, 20, 1);
+	CheckSame(index, matches);
+
+	// Delete touching a match
+	index.Delete(14, 15); RefDelete(matches, 14, 15);
+	CheckSame(index, matches);
+	EXPECT_EQ(1, index.GetCount());
+}
+
+TEST(MatchIndexTest, Replace) {
+	MatchIndex index;
+	Matches matches;
+	for (unsigned int i = 0; i < 1000; ++i) matches.push_back(interval(i*10, i*10 + 3));
+	index.Replace(0, 10000, matches);
+	CheckSame(index, matches);
+
+	// Replace in the middle
+	Matches newMatches;
+	newMatches.push_back(interval(101, 104));
+	newMatches.push_back(interval(108, 115)); // overlaps match at 110
+	EXPECT_EQ(115, index.Replace(100, 110, newMatches));
+
+	matches.erase(matches.begin() + 10, matches.begin() + 12);
+	matches.insert(matches.begin() + 10, newMatches.begin(), newMatches.end());
+	CheckSame(index, matches);
+
+	// Removing overlapped match extends the area
+	EXPECT_EQ(9993, index.Replace(9990, 9991, Matches()));
+	matches.pop_back();
+	CheckSame(index, matches);
+}
+
+TEST(MatchIndexTest, Random) {
+	MatchIndex index;
+	Matches matches;
+	unsigned int length = 100000;
+	srand(3);
+
+	for (unsigned int i = 0; i < 2000; ++i) {
+		const unsigned int pos = rand() % (length + 1);
+		switch (rand() % 3) {
+		case 0:
+			{
+				const unsigned int len = 1 + rand() % 100;
+				index.Insert(pos, len); RefInsert(matches, pos, len);
+				length += len;
+			}
+			break;
+		case 1:
+			{
+				const unsigned int end = wxMin(pos + rand() % 100, length);
+				index.Delete(pos, end); RefDelete(matches, pos, end);
+				length -= end - pos;
+			}
+			break;
+		case 2:
+			{
+				// New matches after any match covering pos
+				const unsigned int end = wxMin(pos + rand() % 500, length);
+				unsigned int start = pos;
+				const unsigned int cover = index.FindEnd(pos+1);
+				if (cover < index.GetCount() && index.Get(cover).start < pos) start = index.Get(cover).end;
+
+				Matches found;
+				for (unsigned int p = start + rand() % 10; p < end; p += 1 + rand() % 30) {
+					const unsigned int mlen = rand() % 5;
+					if (p + mlen > length) break;
+					found.push_back(interval(p, p + mlen));
+					p += mlen;
+				}
+				const unsigned int replEnd = index.Replace(start, end, found);
+
+				Matches::iterator first = matches.begin();
+				while (first != matches.end() && first->start < start) ++first;
+				Matches::iterator last = first;
+				const unsigned int limit = wxMax(end, found.empty() ? 0 : found.back().end);
+				unsigned int refEnd = limit;
+				for (; last != matches.end() && last->start < limit; ++last) {
+					if (last->end > refEnd) refEnd = last->end;
+				}
+				EXPECT_EQ(refEnd, replEnd);
+				first = matches.erase(first, last);
+				matches.insert(first, found.begin(), found.end());
+			}
+			break;
+		}
+
+		if (i % 20 == 0) CheckSame(index, matches);
+	}
+	CheckSame(index, matches);
+}
@@ -0,0 +1,82 @@
+#include "stdafx.h"
+#include <limits.h>
+#include "NewlineScanner.h"
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+// Scans the text in chunks of the given size
+static bool ScanText(const std::string& text, size_t chunkSize, std::string& result, NewlineScanner& scanner) {
+	std::vector<char> out;
+	for (size_t i = 0; i < text.size(); i += chunkSize) {
+		const size_t len = (text.size() - i < chunkSize) ? text.size() - i : chunkSize;
+		if (!scanner.Scan(text.data() + i, len, out)) return false;
+	}
+	scanner.Finish();
+
+	result.assign(out.begin(), out.end());
+	return true;
+}
+
+TEST(NewlineScannerTest, Newlines) {
+	const std::string text = "unix\ndos\r\nmac\rmac2\r\rlast line without newline, long enough to be skipped in words";
+
+	// Result must not depend on how the text is chunked
+	for (size_t chunkSize = 1; chunkSize <= text.size(); ++chunkSize) {
+		std::vector<unsigned int> offsets;
+		NewlineScanner scanner(offsets);
+		std::string result;
+		ASSERT_TRUE(ScanText(text, chunkSize, result, scanner));
+
+		EXPECT_EQ("unix\ndos\nmac\nmac2\n\nlast line without newline, long enough to be skipped in words", result);
+		EXPECT_EQ(result.size(), scanner.GetLength());
+
+		ASSERT_EQ(6u, offsets.size());
+		EXPECT_EQ(5u, offsets[0]);
+		EXPECT_EQ(9u, offsets[1]);
+		EXPECT_EQ(13u, offsets[2]);
+		EXPECT_EQ(18u, offsets[3]);
+		EXPECT_EQ(19u, offsets[4]);
+		EXPECT_EQ(result.size(), offsets[5]);
+
+		EXPECT_EQ(1u, scanner.GetUnixCount());
+		EXPECT_EQ(1u, scanner.GetDosCount());
+		EXPECT_EQ(3u, scanner.GetMacCount());
+	}
+}
+
+TEST(NewlineScannerTest, EndsWithNewline) {
+	std::vector<unsigned int> offsets;
+	NewlineScanner scanner(offsets);
+	std::string result;
+	ASSERT_TRUE(ScanText("first\r\nsecond\r\n", 4, result, scanner));
+
+	EXPECT_EQ("first\nsecond\n", result);
+	ASSERT_EQ(2u, offsets.size());
+	EXPECT_EQ(6u, offsets[0]);
+	EXPECT_EQ(13u, offsets[1]);
+}
+
+TEST(NewlineScannerTest, Utf8) {
+	// Multibyte chars split between chunks
+	const std::string text = "\xC3\xA5\xE4\xB8\xAD\n\xF0\x9F\x98\x80";
+	for (size_t chunkSize = 1; chunkSize <= text.size(); ++chunkSize) {
+		std::vector<unsigned int> offsets;
+		NewlineScanner scanner(offsets);
+		std::string result;
+		ASSERT_TRUE(ScanText(text, chunkSize, result, scanner));
+		EXPECT_EQ(text, result);
+		ASSERT_EQ(2u, offsets.size());
+		EXPECT_EQ(6u, offsets[0]);
+	}
+
+	// Invalid sequences
+	const char* invalid[] = {"abc\x80", "\xC3\x41", "\xF8\x80\x80\x80\x80", "null\0char"};
+	const size_t lengths[] = {4, 2, 5, 9};
+	for (size_t i = 0; i < 4; ++i) {
+		std::vector<unsigned int> offsets;
+		NewlineScanner scanner(offsets);
+		std::vector<char> out;
+		EXPECT_FALSE(scanner.Scan(invalid[i], lengths[i], out));
+	}
+}
@@ -0,0 +1,198 @@
+#include "stdafx.h"
+#include <limits.h>
+#include "ProjectFileIndex.h"
+#include "ProjectInfoHandler.h"
+#include "DirWatcher.h"
+#include <gtest/gtest.h>
+#include <wx/dir.h>
+#include <wx/ffile.h>
+#include <wx/filename.h>
+#include <vector>
+
+class ProjectFileIndexTest : public testing::Test {
+protected:
+	virtual void SetUp() {
+		m_root = CreateTempDir();
+		m_snapshotDir = CreateTempDir();
+
+		// root/a.txt, root/b/c.txt, root/b/d/e.txt
+		AddFile(wxT("a.txt"));
+		AddDir(wxT("b"));
+		AddFile(wxT("b") + Sep() + wxT("c.txt"));
+		AddDir(wxT("b") + Sep() + wxT("d"));
+		AddFile(wxT("b") + Sep() + wxT("d") + Sep() + wxT("e.txt"));
+
+		m_handler.SetRoot(wxFileName(m_root));
+	}
+
+	virtual void TearDown() {
+		m_handler.GetFileIndex().Clear();
+		RemoveDir(m_root);
+		RemoveDir(m_snapshotDir);
+	}
+
+	static wxString Sep() {return wxString(wxFILE_SEP_PATH);};
+
+	static wxString CreateTempDir() {
+		const wxString path = wxFileName::CreateTempFileName(wxT("prj"));
+		wxRemoveFile(path);
+		wxMkdir(path);
+		return path + wxFILE_SEP_PATH;
+	}
+
+	static void RemoveDir(const wxString& path) {
+		wxArrayString files;
+		wxDir::GetAllFiles(path, &files, wxEmptyString, wxDIR_FILES|wxDIR_DIRS|wxDIR_HIDDEN);
+		for (size_t i = 0; i < files.GetCount(); ++i) wxRemoveFile(files[i]);
+
+		// Remove the (now empty) dirs, deepest first
+		wxDir dir(path);
+		wxString name;
+		std::vector<wxString> subDirs;
+		for (bool cont = dir.GetFirst(&name, wxEmptyString, wxDIR_DIRS|wxDIR_HIDDEN); cont; cont = dir.GetNext(&name)) {
+			subDirs.push_back(path + name + wxFILE_SEP_PATH);
+		}
+		for (size_t i = 0; i < subDirs.size(); ++i) RemoveDir(subDirs[i]);
+		wxRmdir(path);
+	}
+
+	void AddFile(const wxString& relPath) {
+		wxFFile file(m_root + relPath, wxT("wb"));
+	}
+
+	void AddDir(const wxString& relPath) {
+		wxMkdir(m_root + relPath);
+	}
+
+	void StartAndWait() {
+		ProjectFileIndex& index = m_handler.GetFileIndex();
+		index.SetRoot(m_root, m_snapshotDir);
+		while (index.IsScanning()) wxMilliSleep(10);
+	}
+
+	std::vector<wxString> GetFiles() const {
+		std::vector<wxString> paths;
+		m_handler.GetFileIndex().GetFiles(paths);
+		return paths;
+	}
+
+	wxString m_root;
+	wxString m_snapshotDir;
+	ProjectInfoHandler m_handler;
+};
+
+TEST_F(ProjectFileIndexTest, Scan) {
+	StartAndWait();
+	ASSERT_TRUE(m_handler.GetFileIndex().IsReady());
+
+	// Files come before subdirs
+	const std::vector<wxString> files = GetFiles();
+	ASSERT_EQ(3u, files.size());
+	EXPECT_EQ(m_root + wxT("a.txt"), files[0]);
+	EXPECT_EQ(m_root + wxT("b") + Sep() + wxT("c.txt"), files[1]);
+	EXPECT_EQ(m_root + wxT("b") + Sep() + wxT("d") + Sep() + wxT("e.txt"), files[2]);
+
+	std::vector<wxString> dirs;
+	m_handler.GetFileIndex().GetDirs(m_root, dirs);
+	ASSERT_EQ(2u, dirs.size());
+	EXPECT_EQ(m_root + wxT("b"), dirs[0]);
+	EXPECT_EQ(m_root + wxT("b") + Sep() + wxT("d"), dirs[1]);
+
+	// The scan is saved as snapshot for next start
+	wxArrayString snapshots;
+	wxDir::GetAllFiles(m_snapshotDir, &snapshots, wxT("*.idx"));
+	EXPECT_EQ(1u, snapshots.GetCount());
+}
+
+TEST_F(ProjectFileIndexTest, Changes) {
+	StartAndWait();
+	ProjectFileIndex& index = m_handler.GetFileIndex();
+	const unsigned int generation = index.GetGeneration();
+
+	// Added file
+	AddFile(wxT("b") + Sep() + wxT("b.txt"));
+	index.OnDirChanged(DIRWATCHER_FILE_ADDED, m_root + wxT("b") + Sep() + wxT("b.txt"), wxEmptyString);
+
+	// Removed file
+	wxRemoveFile(m_root + wxT("a.txt"));
+	index.OnDirChanged(DIRWATCHER_FILE_REMOVED, m_root + wxT("a.txt"), wxEmptyString);
+
+	// Renamed dir (with contents)
+	const wxString oldDir = m_root + wxT("b") + Sep() + wxT("d");
+	const wxString newDir = m_root + wxT("b") + Sep() + wxT("g");
+	wxRenameFile(oldDir, newDir);
+	index.OnDirChanged(DIRWATCHER_FILE_RENAMED, oldDir, newDir);
+
+	// Changes outside the project are ignored
+	index.OnDirChanged(DIRWATCHER_FILE_ADDED, m_snapshotDir + wxT("x.txt"), wxEmptyString);
+
+	const std::vector<wxString> files = GetFiles();
+	ASSERT_EQ(3u, files.size());
+	EXPECT_EQ(m_root + wxT("b") + Sep() + wxT("b.txt"), files[0]);
+	EXPECT_EQ(m_root + wxT("b") + Sep() + wxT("c.txt"), files[1]);
+	EXPECT_EQ(newDir + Sep() + wxT("e.txt"), files[2]);
+
+	// Updates do not replace the index
+	EXPECT_EQ(generation, index.GetGeneration());
+}
+
+TEST_F(ProjectFileIndexTest, Rescan) {
+	StartAndWait();
+	ProjectFileIndex& index = m_handler.GetFileIndex();
+
+	// Changes that were not reported
+	AddFile(wxT("b") + Sep() + wxT("d") + Sep() + wxT("f.txt"));
+	wxRemoveFile(m_root + wxT("b") + Sep() + wxT("c.txt"));
+	AddFile(wxT("g.txt"));
+
+	// Only the dir is rescanned
+	index.OnDirChanged(DIRWATCHER_RESCAN, m_root + wxT("b"), wxEmptyString);
+	while (index.IsScanning()) wxMilliSleep(10);
+
+	std::vector<wxString> files = GetFiles();
+	ASSERT_EQ(3u, files.size());
+	EXPECT_EQ(m_root + wxT("a.txt"), files[0]);
+	EXPECT_EQ(m_root + wxT("b") + Sep() + wxT("d") + Sep() + wxT("e.txt"), files[1]);
+	EXPECT_EQ(m_root + wxT("b") + Sep() + wxT("d") + Sep() + wxT("f.txt"), files[2]);
+
+	// Rescanning the root finds the rest
+	index.Rescan(m_root);
+	while (index.IsScanning()) wxMilliSleep(10);
+
+	files = GetFiles();
+	ASSERT_EQ(4u, files.size());
+	EXPECT_EQ(m_root + wxT("g.txt"), files[1]);
+}
+
+TEST_F(ProjectFileIndexTest, NewDir) {
+	StartAndWait();
+	ProjectFileIndex& index = m_handler.GetFileIndex();
+
+	// A new dir with contents (like an unpacked archive)
+	AddDir(wxT("n"));
+	AddDir(wxT("n") + Sep() + wxT("m"));
+	AddFile(wxT("n") + Sep() + wxT("m") + Sep() + wxT("x.txt"));
+	AddFile(wxT("n") + Sep() + wxT("y.txt"));
+	index.OnDirChanged(DIRWATCHER_FILE_ADDED, m_root + wxT("n"), wxEmptyString);
+
+	// The dir is there right away, its contents when scanned
+	std::vector<wxString> dirs;
+	index.GetDirs(m_root, dirs);
+	ASSERT_EQ(3u, dirs.size());
+	EXPECT_EQ(m_root + wxT("n"), dirs[2]);
+
+	while (index.IsScanning()) wxMilliSleep(10);
+
+	const std::vector<wxString> files = GetFiles();
+	ASSERT_EQ(5u, files.size());
+	EXPECT_EQ(m_root + wxT("n") + Sep() + wxT("y.txt"), files[3]);
+	EXPECT_EQ(m_root + wxT("n") + Sep() + wxT("m") + Sep() + wxT("x.txt"), files[4]);
+
+	// Reported again, it keeps its contents until scanned again
+	AddFile(wxT("n") + Sep() + wxT("z.txt"));
+	index.OnDirChanged(DIRWATCHER_FILE_ADDED, m_root + wxT("n"), wxEmptyString);
+	EXPECT_LE(5u, GetFiles().size());
+
+	while (index.IsScanning()) wxMilliSleep(10);
+	EXPECT_EQ(6u, GetFiles().size());
+}
@@ -0,0 +1,80 @@
+#include "stdafx.h"
+#include "RegexCache.h"
+#include "pcre.h"
+#include <gtest/gtest.h>
+#include <string.h>
+
+class RegexCacheTest : public ::testing::Test {
+protected:
+	virtual void SetUp() {
+		RegexCache::Get().Clear();
+		RegexCache::Get().ResetStats();
+	};
+
+	virtual void TearDown() {
+		RegexCache::Get().SetCapacity(256);
+		RegexCache::Get().Clear();
+	};
+
+	static int Exec(const CompiledRegex& cr, const char* subject) {
+		int ovector[30];
+		const int rc = pcre_exec(cr.GetPattern(), cr.GetStudy(), subject, strlen(subject), 0, 0, ovector, 30);
+		return rc < 0 ? rc : ovector[0];
+	};
+};
+
+TEST_F(RegexCacheTest, HitsAndMisses) {
+	RegexCache& cache = RegexCache::Get();
+
+	const CompiledRegex a = cache.Lookup("b+", 0);
+	const CompiledRegex b = cache.Lookup("b+", 0);
+	const CompiledRegex c = cache.Lookup("b+", PCRE_CASELESS); // options are part of the key
+	ASSERT_TRUE(a.IsOk());
+	EXPECT_EQ(a.GetPattern(), b.GetPattern());
+	EXPECT_NE(a.GetPattern(), c.GetPattern());
+	EXPECT_EQ(1, Exec(a, "abbc"));
+	EXPECT_EQ(1, Exec(c, "aBc"));
+
+	const RegexCache::Stats stats = cache.GetStats();
+	EXPECT_EQ(1, stats.hits);
+	EXPECT_EQ(2, stats.misses);
+	EXPECT_EQ(0, stats.evictions);
+	EXPECT_EQ(2, stats.size);
+}
+
+TEST_F(RegexCacheTest, InvalidPattern) {
+	RegexCache& cache = RegexCache::Get();
+
+	// Invalid patterns are cached too, so they are only compiled once
+	EXPECT_FALSE(cache.Lookup("a(b", 0).IsOk());
+	EXPECT_FALSE(cache.Lookup("a(b", 0).IsOk());
+
+	const RegexCache::Stats stats = cache.GetStats();
+	EXPECT_EQ(1, stats.hits);
+	EXPECT_EQ(1, stats.misses);
+}
+
+TEST_F(RegexCacheTest, Eviction) {
+	RegexCache& cache = RegexCache::Get();
+	cache.SetCapacity(2);
+
+	const CompiledRegex x = cache.Lookup("x", 0);
+	cache.Lookup("y", 0);
+	cache.Lookup("x", 0); // y is now least recently used
+	cache.Lookup("z", 0);
+
+	RegexCache::Stats stats = cache.GetStats();
+	EXPECT_EQ(1, stats.evictions);
+	EXPECT_EQ(2, stats.size);
+	EXPECT_EQ(2, stats.capacity);
+
+	cache.Lookup("x", 0);
+	EXPECT_EQ(2, cache.GetStats().hits);
+	cache.Lookup("y", 0);
+	EXPECT_EQ(4, cache.GetStats().misses);
+
+	// References stay valid after their pattern is evicted
+	cache.Clear();
+	EXPECT_EQ(0, cache.GetStats().size);
+	EXPECT_EQ(2, Exec(x, "abx"));
+}
@@ -0,0 +1,118 @@
+#include "stdafx.h"
+#include "ScopeAtoms.h"
+#include <gtest/gtest.h>
+#include <deque>
+
+TEST(ScopeAtomsTest, Intern) {
+	const ScopeAtoms::Atom meta = ScopeAtoms::GetAtom(wxT("meta"));
+	EXPECT_NE(ScopeAtoms::NOATOM, meta);
+	EXPECT_EQ(meta, ScopeAtoms::GetAtom(wxT("meta")));
+	EXPECT_NE(meta, ScopeAtoms::GetAtom(wxT("function")));
+	EXPECT_TRUE(ScopeAtoms::GetWord(meta) == wxT("meta"));
+
+	const ScopeAtoms::Scope& scope = ScopeAtoms::GetScope(wxT("meta.function.ruby"));
+	ASSERT_EQ(3, scope.atoms.size());
+	EXPECT_EQ(meta, scope.atoms[0]);
+	EXPECT_EQ(ScopeAtoms::GetAtom(wxT("ruby")), scope.atoms[2]);
+	EXPECT_EQ(&scope, &ScopeAtoms::GetScope(wxT("meta.function.ruby")));
+
+	// A trailing dot does not give an empty word
+	EXPECT_EQ(1, ScopeAtoms::GetScope(wxT("meta.")).atoms.size());
+	EXPECT_TRUE(ScopeAtoms::GetScope(wxT("")).atoms.empty());
+}
+
+TEST(ScopeAtomsTest, Stacks) {
+	const wxString source(wxT("source.ruby"));
+	const wxString string(wxT("string.quoted.double.ruby"));
+	const wxString copy(string);
+
+	std::deque<const wxString*> scopes;
+	const ScopeStack empty(scopes);
+	EXPECT_TRUE(empty.empty());
+	EXPECT_EQ(ScopeAtoms::EMPTYSTACK, empty.GetId());
+
+	scopes.push_back(&source);
+	scopes.push_back(&string);
+	const ScopeStack stack(scopes);
+	ASSERT_EQ(2, stack.size());
+	EXPECT_EQ(4, stack[1].size());
+
+	// Stacks are identified by content
+	scopes[1] = &copy;
+	EXPECT_EQ(stack.GetId(), ScopeStack(scopes).GetId());
+
+	scopes.pop_back();
+	EXPECT_NE(stack.GetId(), ScopeStack(scopes).GetId());
+
+	// Order matters
+	std::deque<const wxString*> reversed;
+	reversed.push_back(&string);
+	reversed.push_back(&source);
+	EXPECT_NE(stack.GetId(), ScopeStack(reversed).GetId());
+}
+
+TEST(ScopeAtomsTest, PushScope) {
+	const ScopeAtoms::Scope& source = ScopeAtoms::GetScope(wxT("source.python"));
+	const ScopeAtoms::Scope& comment = ScopeAtoms::GetScope(wxT("comment.line.python"));
+	EXPECT_EQ(ScopeAtoms::NOSCOPE, ScopeAtoms::GetScope(wxT("")).id);
+
+	// Same ids as when interned from names
+	const unsigned int top = ScopeAtoms::PushScope(ScopeAtoms::EMPTYSTACK, source.id);
+	const unsigned int inner = ScopeAtoms::PushScope(top, comment.id);
+	EXPECT_EQ(inner, ScopeAtoms::PushScope(inner, ScopeAtoms::NOSCOPE));
+
+	const wxString sourceName(wxT("source.python"));
+	const wxString commentName(wxT("comment.line.python"));
+	std::deque<const wxString*> scopes;
+	scopes.push_back(&sourceName);
+	scopes.push_back(&commentName);
+	EXPECT_EQ(inner, ScopeStack(scopes).GetId());
+
+	// The levels are found from the id
+	const ScopeStack stack(inner);
+	ASSERT_EQ(2, stack.size());
+	EXPECT_TRUE(stack[0] == source.atoms);
+	EXPECT_TRUE(stack[1] == comment.atoms);
+	EXPECT_TRUE(ScopeStack(ScopeAtoms::EMPTYSTACK).empty());
+}
+
+TEST(ScopeAtomsTest, ClearStacks) {
+	const ScopeAtoms::Scope& scope = ScopeAtoms::GetScope(wxT("text.html.basic"));
+	const unsigned int generation = ScopeAtoms::GetGeneration();
+	ScopeAtoms::PushScope(ScopeAtoms::EMPTYSTACK, ScopeAtoms::GetScope(wxT("source.css")).id);
+
+	ScopeAtoms::ClearStacks();
+	EXPECT_NE(generation, ScopeAtoms::GetGeneration());
+
+	// Scopes are kept, stacks are numbered again
+	EXPECT_EQ(&scope, &ScopeAtoms::GetScope(wxT("text.html.basic")));
+	const unsigned int stackId = ScopeAtoms::PushScope(ScopeAtoms::EMPTYSTACK, scope.id);
+	EXPECT_EQ(1, stackId);
+	ASSERT_EQ(1, ScopeStack(stackId).size());
+	EXPECT_TRUE(ScopeStack(stackId)[0] == scope.atoms);
+}
+
+TEST(ScopeAtomsTest, AtomTable) {
+	AtomTable<const char*> table;
+	EXPECT_TRUE(table.Find(1) == NULL);
+
+	static const char* const values[] = {"a", "b", "c"};
+	for (unsigned int i = 1; i <= 100; ++i) table.Set(i * 7, values[i % 3]);
+	EXPECT_EQ(100, table.size());
+
+	for (unsigned int i = 1; i <= 100; ++i) {
+		EXPECT_EQ(values[i % 3], table.Find(i * 7));
+		EXPECT_TRUE(table.Find(i * 7 + 1) == NULL);
+	}
+
+	// Replacing a value
+	table.Set(7, values[0]);
+	EXPECT_EQ(values[0], table.Find(7));
+	EXPECT_EQ(100, table.size());
+
+	unsigned int count = 0;
+	for (size_t s = 0; s < table.GetSlotCount(); ++s) {
+		if (table.GetAtom(s) != ScopeAtoms::NOATOM) ++count;
+	}
+	EXPECT_EQ(100, count);
+}
@@ -0,0 +1,190 @@
+#include "stdafx.h"
+#include "Document.h"
+#include "Lines.h"
+#include "IFoldingEditor.h"
+#include "BracketHighlight.h"
+#include "Fold.h"
+#include "Dispatcher.h"
+#include "plistHandler.h"
+#include "tm_syntaxhandler.h"
+#include "styler_syntax.h"
+#include "Support.h"
+#include <wx/init.h>
+#include <wx/ffile.h>
+#include <wx/filename.h>
+#include <wx/stopwatch.h>
+#include <gtest/gtest.h>
+#include <stdio.h>
+
+// Lines only asks the editor about folds and bracket highlights
+class NoFoldEditor: public IFoldingEditor {
+public:
+	virtual bool IsPosInFold(unsigned int pos, unsigned int* fold_start=NULL, unsigned int* fold_end=NULL) { return false; };
+	virtual void UnFoldParents(unsigned int line_id) {};
+	virtual const std::vector<cxFold>& GetFolds() const { return m_folds; };
+	virtual const BracketHighlight& GetHlBracket() const { return m_brackets; };
+
+private:
+	std::vector<cxFold> m_folds;
+	BracketHighlight m_brackets;
+};
+
+// The files (repeated to get measurable times) and their syntaxes
+static const struct {
+	const wxChar* path;
+	const wxChar* syntax;
+} s_files[] = {
+	{wxT("../../testfiles/languages/ruby/Rakefile"), wxT("Ruby")},
+	{wxT("../../testfiles/languages/CSharp/raw_string.cs"), wxT("C#")},
+};
+static const unsigned int s_minSize = 1024 * 1024;
+
+// The edit script: single chars that tend to open spans, inserted and
+// deleted again at the top, middle and end of the document
+static const wxChar* const s_chars = wxT("x\"'(/*<#");
+static const unsigned int s_positions[] = {0, 50, 100}; // percent of the document
+static const unsigned int s_iterations = 50;
+
+class SyntaxEditsTest: public ::testing::Test {
+protected:
+	virtual void SetUp() {
+		isWxStarted = false;
+		pCatalyst = NULL;
+		cw = NULL;
+		plistHandler = NULL;
+		syntaxHandler = NULL;
+
+		wxString edb;
+		if (!RequireEdb(edb)) {
+			FAIL() << "Need to copy a registered e.db into this folder for this test to run.";
+		}
+		wxString appPath;
+		if (!RequireBundles(appPath)) {
+			FAIL() << "Need to copy the Bundles and Themes folders into this folder for this test to run.";
+		}
+
+		// The syntax handler gets its settings from the app (which is not run)
+		int argc = 0;
+		isWxStarted = wxEntryStart(argc, (wxChar**)NULL);
+		ASSERT_TRUE(isWxStarted);
+
+		pCatalyst = new Catalyst(edb);
+		cw = new CatalystWrapper(*pCatalyst);
+
+		const wxString dataPath = wxFileName::CreateTempFileName(wxT("etests"));
+		wxRemoveFile(dataPath);
+		wxMkdir(dataPath);
+		plistHandler = new PListHandler(appPath, dataPath + wxFILE_SEP_PATH, true);
+		syntaxHandler = new TmSyntaxHandler(dispatcher, *plistHandler);
+	};
+
+	virtual void TearDown() {
+		if (syntaxHandler) {delete syntaxHandler;syntaxHandler=NULL;}
+		if (plistHandler) {delete plistHandler;plistHandler=NULL;}
+		if (cw) {delete cw;cw=NULL;}
+		if (pCatalyst) {delete pCatalyst;pCatalyst=NULL;}
+		if (isWxStarted) wxEntryCleanup();
+	};
+
+	// Updates the views like EditorCtrl::RawInsert/RawDelete
+	static void Insert(DocumentWrapper& dw, Lines& lines, Styler_Syntax& styler, unsigned int pos, const wxString& text) {
+		unsigned int byte_len;
+		cxLOCKDOC_WRITE(dw)
+			byte_len = doc.Insert(pos, text);
+		cxENDLOCK
+		lines.Insert(pos, byte_len);
+		styler.Insert(pos, byte_len);
+	}
+
+	static void Delete(DocumentWrapper& dw, Lines& lines, Styler_Syntax& styler, unsigned int start, unsigned int end) {
+		cxLOCKDOC_WRITE(dw)
+			doc.Delete(start, end);
+		cxENDLOCK
+		lines.Delete(start, end);
+		styler.Delete(start, end);
+	}
+
+	bool isWxStarted;
+	Catalyst* pCatalyst;
+	CatalystWrapper* cw;
+	Dispatcher dispatcher;
+	PListHandler* plistHandler;
+	TmSyntaxHandler* syntaxHandler;
+};
+
+TEST_F(SyntaxEditsTest, DISABLED_Benchmark) {
+	for (unsigned int f = 0; f < sizeof(s_files) / sizeof(s_files[0]); ++f) {
+		wxFFile file(s_files[f].path, wxT("rb"));
+		wxString text;
+		ASSERT_TRUE(file.ReadAll(&text, wxConvUTF8));
+		ASSERT_FALSE(text.empty());
+		if (!text.EndsWith(wxT("\n"))) text += wxT('\n');
+
+		wxString docText;
+		while (docText.size() < s_minSize) docText += text;
+
+		DocumentWrapper dw(*cw, true);
+		cxLOCKDOC_WRITE(dw)
+			doc.Insert(0, docText);
+		cxENDLOCK
+
+		NoFoldEditor editor;
+		wxMemoryDC mdc;
+		mdc.SetFont(syntaxHandler->GetTheme().font);
+		Lines lines(mdc, dw, editor, syntaxHandler->GetTheme());
+		lines.Init();
+		lines.ReLoadText();
+
+		Styler_Syntax styler(dw, lines, syntaxHandler);
+		styler.SetSyntax(s_files[f].syntax);
+		ASSERT_TRUE(styler.IsOk());
+
+		// Full parse (compare lines/s between builds)
+		wxStopWatch sw;
+		styler.ParseAll();
+		const long parseTime = wxMax(sw.Time(), 1L);
+		const unsigned int lineCount = lines.GetLineCount();
+		const unsigned int docLen = lines.GetLength();
+		printf("%s (%s): %u bytes, %u lines\n", (const char*)wxString(s_files[f].path).mb_str(wxConvUTF8),
+			(const char*)styler.GetName().mb_str(wxConvUTF8), docLen, lineCount);
+		printf("  full parse: %ldms (%.0f lines/s)\n", parseTime, (lineCount * 1000.0) / parseTime);
+
+#ifdef __WXDEBUG__
+		unsigned int matchCount;
+		size_t treeSize;
+		styler.GetTreeStats(matchCount, treeSize);
+		printf("  match tree: %u matches, %u KB (%.0f KB per MB of text)\n", matchCount, (unsigned int)(treeSize / 1024), (treeSize * 1024.0) / docLen);
+#endif //__WXDEBUG__
+
+		for (unsigned int p = 0; p < sizeof(s_positions) / sizeof(s_positions[0]); ++p) {
+			// Edits go at the start of a line, so that they are the same in every run
+			const unsigned int line = ((lineCount-1) * s_positions[p]) / 100;
+			const unsigned int pos = lines.GetLineStartpos(line);
+
+			for (const wxChar* c = s_chars; *c; ++c) {
+				const wxString ch(*c, 1);
+				long insertTime = 0;
+				long deleteTime = 0;
+				unsigned int minKept = docLen;
+
+				for (unsigned int i = 0; i < s_iterations; ++i) {
+					sw.Start();
+					Insert(dw, lines, styler, pos, ch);
+					insertTime += sw.Time();
+					const unsigned int parsed = styler.GetLastParsedPos();
+					minKept = wxMin(minKept, parsed > pos ? parsed - pos : 0);
+
+					sw.Start();
+					Delete(dw, lines, styler, pos, pos+1);
+					deleteTime += sw.Time();
+
+					styler.ParseAll(); // restore full syntax between runs
+				}
+				EXPECT_EQ(docLen, lines.GetLength());
+
+				printf("  line %u, '%s': insert %ldms, delete %ldms (%u runs), syntax kept after edit: %u bytes\n",
+					line, (const char*)ch.mb_str(wxConvUTF8), insertTime, deleteTime, s_iterations, minKept);
+			}
+		}
+	}
+}
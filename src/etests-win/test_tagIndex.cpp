@@ -0,0 +1,233 @@
+#include "stdafx.h"
+#include "TagIndex.h"
+#include "TestSource.h"
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+
+// Reference implementation (the linear scan that the html highlighter did before)
+struct RefTag {
+	unsigned int start, end;
+	std::string name;
+	bool isClosing, isSelfClosing;
+};
+
+static void RefFindTags(const std::string& text, std::vector<RefTag>& tags) {
+	tags.clear();
+	bool haveOpenBracket = false, inComment = false;
+	unsigned int open = 0;
+
+	for (unsigned int i = 0; i < text.size(); ++i) {
+		const char c = text[i];
+		if (c != '<' && c != '>') continue;
+
+		if (inComment) {
+			if (c == '>' && i >= 2 && text[i-1] == '-' && text[i-2] == '-') inComment = haveOpenBracket = false;
+			continue;
+		}
+		if (c == '<') {
+			open = i;
+			haveOpenBracket = true;
+			inComment = i+3 < text.size() && text.compare(i+1, 3, "!--") == 0;
+			continue;
+		}
+		if (!haveOpenBracket) continue;
+		haveOpenBracket = false;
+
+		unsigned int nameStart = open+1;
+		if (text[nameStart] == '/') ++nameStart;
+		unsigned int nameEnd = nameStart;
+		while (isalnum((unsigned char)text[nameEnd])) ++nameEnd;
+		if (nameEnd == nameStart && nameStart != i) continue; // not a valid tag
+
+		RefTag tag;
+		tag.start = open;
+		tag.end = i;
+		tag.name = text.substr(nameStart, nameEnd - nameStart);
+		for (unsigned int n = 0; n < tag.name.size(); ++n) tag.name[n] = (char)tolower(tag.name[n]);
+		tag.isSelfClosing = text[i-1] == '/';
+		tag.isClosing = tag.isSelfClosing || text[open+1] == '/';
+		tags.push_back(tag);
+	}
+}
+
+static int RefMatch(const std::vector<RefTag>& tags, int t) {
+	const RefTag& tag = tags[t];
+	if (tag.isSelfClosing) return -1;
+	int stack = 1;
+	const int dir = tag.isClosing ? -1 : 1;
+	for (int c = t + dir; c >= 0 && c < (int)tags.size(); c += dir) {
+		if (tags[c].isSelfClosing || tags[c].name != tag.name) continue;
+		stack += (tags[c].isClosing == tag.isClosing) ? 1 : -1;
+		if (stack == 0) return c;
+	}
+	return -1;
+}
+
+static int RefParent(const std::vector<RefTag>& tags, unsigned int pos) {
+	int stack = 1;
+	for (unsigned int c = 0; c < tags.size(); ++c) {
+		if (tags[c].start < pos || tags[c].isSelfClosing) continue;
+		stack += tags[c].isClosing ? -1 : 1;
+		if (stack == 0) return c;
+	}
+	return -1;
+}
+
+static void CheckSame(TagIndex& index, const TestSource& source) {
+	index.Update(source);
+	ASSERT_TRUE(index.IsValid());
+
+	std::vector<RefTag> tags;
+	RefFindTags(source.m_text, tags);
+
+	unsigned int tagCount = 0;
+	for (unsigned int pos = 0; pos <= source.m_text.size(); ++pos) {
+		// Tag at pos
+		int t = 0;
+		while (t < (int)tags.size() && tags[t].end < pos) ++t;
+		if (t < (int)tags.size() && tags[t].start > pos) t = (int)tags.size();
+
+		TagIndex::Tag tag;
+		const bool found = index.FindTag(pos, tag);
+		ASSERT_EQ(t < (int)tags.size(), found) << "at " << pos;
+		if (found) {
+			EXPECT_EQ(tags[t].start, tag.start);
+			EXPECT_EQ(tags[t].end, tag.end);
+			EXPECT_EQ(tags[t].isClosing, tag.isClosing);
+			EXPECT_EQ(tags[t].isSelfClosing, tag.isSelfClosing);
+			EXPECT_EQ(tags[t].start + (source.m_text[tag.start+1] == '/' ? 2 : 1) + tags[t].name.size(), tag.nameEnd);
+
+			// Matching tag
+			const int m = RefMatch(tags, t);
+			TagIndex::Tag match;
+			ASSERT_EQ(m >= 0, index.FindMatchingTag(tag, match)) << "at " << pos;
+			if (m >= 0) EXPECT_EQ(tags[m].start, match.start);
+			if (tag.start == pos) ++tagCount;
+		}
+
+		// Parent tag
+		const int p = RefParent(tags, pos);
+		TagIndex::Tag parent;
+		ASSERT_EQ(p >= 0, index.FindParentClosingTag(pos, parent)) << "at " << pos;
+		if (p >= 0) EXPECT_EQ(tags[p].start, parent.start);
+	}
+	EXPECT_EQ(tags.size(), tagCount);
+}
+
+TEST(TagIndexTest, Tags) {
+	TestSource source("<html><body class=\"x\"><p>a < b</P><br/><!-- <p> --><div><DIV></div></div></body></html>");
+	TagIndex index;
+	index.Update(source);
+
+	TagIndex::Tag tag, match;
+	ASSERT_TRUE(index.FindTag(1, tag)); // <html>
+	EXPECT_EQ(0, tag.start);
+	EXPECT_EQ(5, tag.end);
+	EXPECT_EQ(5, tag.nameEnd);
+	EXPECT_FALSE(tag.isClosing);
+	ASSERT_TRUE(index.FindMatchingTag(tag, match));
+	EXPECT_EQ(source.m_text.rfind("</html>"), match.start);
+
+	// Names are matched case-insensitively
+	ASSERT_TRUE(index.FindTag(source.m_text.find("</P>"), tag));
+	EXPECT_TRUE(tag.isClosing);
+	ASSERT_TRUE(index.FindMatchingTag(tag, match));
+	EXPECT_EQ(source.m_text.find("<p>"), match.start);
+	ASSERT_TRUE(index.FindTag(source.m_text.find("<DIV>"), tag));
+	ASSERT_TRUE(index.FindMatchingTag(tag, match));
+	EXPECT_EQ(source.m_text.find("</div>"), match.start);
+
+	// Self-closing tags and comments
+	ASSERT_TRUE(index.FindTag(source.m_text.find("<br/>"), tag));
+	EXPECT_TRUE(tag.isSelfClosing);
+	EXPECT_FALSE(index.FindMatchingTag(tag, match));
+	EXPECT_FALSE(index.FindTag(source.m_text.find("<p> --"), tag));
+
+	// Parent of the comment is the body
+	ASSERT_TRUE(index.FindParentClosingTag(source.m_text.find("<!--"), tag));
+	EXPECT_EQ(source.m_text.find("</body>"), tag.start);
+
+	CheckSame(index, source);
+}
+
+TEST(TagIndexTest, Edits) {
+	TestSource source("<a><b>text</b><!-- x --></a>");
+	TagIndex index;
+	CheckSame(index, source);
+
+	// Breaking and restoring a tag
+	source.Delete(index, 3, 4); // a>text
+	CheckSame(index, source);
+	source.Insert(index, 3, "<");
+	CheckSame(index, source);
+
+	// Opening a comment hides the rest
+	source.Insert(index, 0, "<!--");
+	CheckSame(index, source);
+	EXPECT_EQ(2, index.GetTagCount()); // the comment and </a>
+	source.Delete(index, 0, 4);
+	CheckSame(index, source);
+
+	// Several edits before update
+	source.Insert(index, 0, "<x>");
+	source.Insert(index, source.m_text.size(), "</x>");
+	source.Delete(index, 6, 7);
+	CheckSame(index, source);
+}
+
+TEST(TagIndexTest, Large) {
+	// Text read in several chunks
+	std::string text;
+	for (unsigned int i = 0; i < 20000; ++i) text += "<a>xx</A>";
+	TestSource source(text.c_str());
+	TagIndex index;
+	index.Update(source);
+	EXPECT_EQ(40000, index.GetTagCount());
+
+	TagIndex::Tag tag, match;
+	ASSERT_TRUE(index.FindTag(65536, tag));
+	ASSERT_TRUE(index.FindMatchingTag(tag, match));
+	EXPECT_EQ(tag.isClosing ? tag.start - 5 : tag.start + 5, match.start);
+
+	// Unbalanced tag at the start
+	source.Insert(index, 0, "<a>");
+	index.Update(source);
+	ASSERT_TRUE(index.FindTag(0, tag));
+	EXPECT_FALSE(index.FindMatchingTag(tag, match));
+	ASSERT_TRUE(index.FindTag(source.m_text.size() - 1, tag));
+	ASSERT_TRUE(index.FindMatchingTag(tag, match));
+	EXPECT_EQ(source.m_text.size() - 9, match.start);
+
+	// Commenting out everything
+	source.Insert(index, 3, "<!--");
+	index.Update(source);
+	EXPECT_EQ(1, index.GetTagCount());
+	source.Delete(index, 3, 7);
+	index.Update(source);
+	EXPECT_EQ(40001, index.GetTagCount());
+}
+
+TEST(TagIndexTest, Random) {
+	static const char* const pieces[] = {"<", ">", "/", "<!--", "-->", "a", "b", "B", "<a>", "</a>", "<b>", "</b>", "<br/>", " ", "x", "\n"};
+	const unsigned int pieceCount = sizeof(pieces) / sizeof(pieces[0]);
+	srand(5);
+
+	std::string text;
+	for (unsigned int i = 0; i < 300; ++i) text += pieces[rand() % pieceCount];
+	TestSource source(text.c_str());
+	TagIndex index;
+	CheckSame(index, source);
+
+	for (unsigned int i = 0; i < 400; ++i) {
+		const unsigned int edits = 1 + rand() % 3;
+		for (unsigned int e = 0; e < edits; ++e) {
+			const unsigned int pos = rand() % (source.m_text.size() + 1);
+			if (rand() % 2) source.Insert(index, pos, pieces[rand() % pieceCount]);
+			else source.Delete(index, pos, std::min<unsigned int>(pos + rand() % 5, source.m_text.size()));
+		}
+		CheckSame(index, source);
+		if (HasFatalFailure()) return;
+	}
+}
@@ -0,0 +1,110 @@
+#include "stdafx.h"
+#include "TaskRunner.h"
+#include <gtest/gtest.h>
+#include <vector>
+
+struct CountJob {
+	CountJob(unsigned int count) : runs(count, 0) {};
+	std::vector<int> runs;
+	wxCriticalSection lock;
+};
+
+static void OnCount(void* data, unsigned int index) {
+	CountJob& job = *(CountJob*)data;
+	wxCriticalSectionLocker lock(job.lock);
+	++job.runs[index];
+}
+
+static void CheckRunsOnce(unsigned int taskCount, unsigned int maxThreads) {
+	CountJob job(taskCount);
+	const unsigned int threads = TaskRunner::Run(taskCount, OnCount, &job, maxThreads);
+
+	if (taskCount) {
+		EXPECT_GE(threads, 1);
+		EXPECT_LE(threads, taskCount);
+		if (maxThreads) EXPECT_LE(threads, maxThreads);
+	}
+	else EXPECT_EQ(0, threads);
+
+	for (unsigned int i = 0; i < taskCount; ++i) {
+		EXPECT_EQ(1, job.runs[i]) << "task " << i;
+	}
+}
+
+TEST(TaskRunnerTest, EachTaskOnce) {
+	CheckRunsOnce(0, 0);
+	CheckRunsOnce(1, 0);
+	CheckRunsOnce(3, 8);
+	CheckRunsOnce(1000, 0);
+	CheckRunsOnce(1000, 1);
+	CheckRunsOnce(1000, 4);
+}
+
+TEST(TaskRunnerTest, DefaultThreadCount) {
+	EXPECT_GE(TaskRunner::GetDefaultThreadCount(), 1);
+}
+
+TEST(TaskRunnerTest, ReusedThreads) {
+	TaskRunner runner(4);
+	for (unsigned int i = 0; i < 20; ++i) {
+		CountJob job(100 + i);
+		EXPECT_GE(runner.RunBatch(100 + i, OnCount, &job), 1);
+		EXPECT_FALSE(runner.IsBusy());
+		for (unsigned int t = 0; t < job.runs.size(); ++t) {
+			EXPECT_EQ(1, job.runs[t]) << "task " << t;
+		}
+	}
+	EXPECT_EQ(0, runner.RunBatch(0, OnCount, NULL));
+}
+
+TEST(TaskRunnerTest, Background) {
+	// Single thread, so that the tasks are done in order
+	TaskRunner runner(1);
+	CountJob first(500);
+	CountJob second(10);
+	ASSERT_TRUE(runner.Add(500, OnCount, &first));
+	ASSERT_TRUE(runner.Add(10, OnCount, &second));
+	runner.Wait();
+	EXPECT_FALSE(runner.IsBusy());
+
+	for (unsigned int i = 0; i < first.runs.size(); ++i) EXPECT_EQ(1, first.runs[i]);
+	for (unsigned int i = 0; i < second.runs.size(); ++i) EXPECT_EQ(1, second.runs[i]);
+}
+
+struct BlockJob {
+	BlockJob() : runs(0) {};
+	wxSemaphore started;
+	wxSemaphore release;
+	int runs;
+};
+
+static void OnBlock(void* data, unsigned int WXUNUSED(index)) {
+	BlockJob& job = *(BlockJob*)data;
+	++job.runs;
+	job.started.Post();
+	job.release.Wait();
+}
+
+TEST(TaskRunnerTest, Cancel) {
+	TaskRunner runner(1);
+	BlockJob job;
+	ASSERT_TRUE(runner.Add(3, OnBlock, &job));
+
+	// The running task finishes, but the rest are dropped
+	job.started.Wait();
+	EXPECT_TRUE(runner.IsBusy());
+	runner.Cancel();
+	EXPECT_TRUE(runner.IsCancelled());
+	EXPECT_TRUE(runner.IsBusy());
+	job.release.Post();
+	runner.Wait();
+	EXPECT_FALSE(runner.IsBusy());
+	EXPECT_EQ(1, job.runs);
+
+	// Adding tasks again resets it
+	job.release.Post();
+	ASSERT_TRUE(runner.Add(1, OnBlock, &job));
+	EXPECT_FALSE(runner.IsCancelled());
+	runner.Wait();
+	EXPECT_EQ(2, job.runs);
+}
@@ -0,0 +1,57 @@
+#include "stdafx.h"
+#include <limits.h>
+#include "WildcardSet.h"
+#include <gtest/gtest.h>
+
+static wxArrayString MakePatterns(const wxChar** patterns, size_t count) {
+	wxArrayString result;
+	for (size_t i = 0; i < count; ++i) result.Add(patterns[i]);
+	return result;
+}
+
+TEST(WildcardSetTest, Empty) {
+	WildcardSet set;
+	EXPECT_TRUE(set.IsEmpty());
+	EXPECT_FALSE(set.Match(wxT("file.txt")));
+}
+
+TEST(WildcardSetTest, PatternTypes) {
+	const wxChar* patterns[] = {wxT("CVS"), wxT("*.o"), wxT("*~"), wxT("tmp*"), wxT("a*b*c"), wxT("?.c")};
+	const WildcardSet set(MakePatterns(patterns, 6));
+	EXPECT_FALSE(set.IsEmpty());
+
+	// Literal
+	EXPECT_TRUE(set.Match(wxT("CVS")));
+	EXPECT_FALSE(set.Match(wxT("cvs")));
+	EXPECT_FALSE(set.Match(wxT("CVSROOT")));
+
+	// Suffix
+	EXPECT_TRUE(set.Match(wxT("main.o")));
+	EXPECT_TRUE(set.Match(wxT(".o")));
+	EXPECT_TRUE(set.Match(wxT("notes.txt~")));
+	EXPECT_FALSE(set.Match(wxT("main.obj")));
+
+	// Prefix
+	EXPECT_TRUE(set.Match(wxT("tmp")));
+	EXPECT_TRUE(set.Match(wxT("tmpfile")));
+	EXPECT_FALSE(set.Match(wxT("atmp")));
+
+	// Globs
+	EXPECT_TRUE(set.Match(wxT("a_b_c")));
+	EXPECT_TRUE(set.Match(wxT("x.c")));
+	EXPECT_FALSE(set.Match(wxT("xy.c")));
+}
+
+TEST(WildcardSetTest, SameAsMatchWild) {
+	const wxChar* patterns[] = {wxT("*"), wxT("**"), wxT("*.*"), wxT(".*"), wxT("*.svn"), wxT("Makefile"), wxT("build*"), wxT("*a*"), wxT("?"), wxT("\\*x"), wxT("")};
+	const wxChar* names[] = {wxT("a"), wxT(".svn"), wxT("x.svn"), wxT("Makefile"), wxT("makefile"), wxT("build"), wxT("build.xml"), wxT("*x"), wxT("bx"), wxT("readme")};
+
+	for (size_t p = 0; p < WXSIZEOF(patterns); ++p) {
+		const WildcardSet set(MakePatterns(&patterns[p], 1));
+
+		for (size_t n = 0; n < WXSIZEOF(names); ++n) {
+			EXPECT_EQ(wxMatchWild(patterns[p], names[n], false), set.Match(names[n]))
+				<< "pattern: " << wxString(patterns[p]).mb_str() << " name: " << wxString(names[n]).mb_str();
+		}
+	}
+}
@@ -0,0 +1,213 @@
+#include "stdafx.h"
+#include <limits.h>
+#include "WordIndex.h"
+#include "TestSource.h"
+#include "Catalyst.h"
+#include <gtest/gtest.h>
+#include <map>
+#include <vector>
+#include <stdlib.h>
+
+static bool IsWordChar(char c) {
+	return isalnum((unsigned char)c) || c == '_';
+}
+
+// Reference implementation (the search that the completion did before,
+// but keeping the nearest match and ordering same distances by word)
+static void RefFind(const std::string& text, const std::string& prefix, unsigned int pos, std::vector<wxString>& words) {
+	std::map<std::string, unsigned int> found;
+	for (unsigned int i = 0; i + prefix.size() <= text.size(); ++i) {
+		if (!std::equal(prefix.begin(), prefix.end(), text.begin() + i)) continue;
+		if (i && IsWordChar(text[i-1])) continue; // start of word
+
+		unsigned int end = i + prefix.size();
+		while (end < text.size() && IsWordChar(text[end])) ++end;
+		if (end == i + prefix.size()) continue;
+
+		const std::string word(text.begin() + i, text.begin() + end);
+		const unsigned int dist = i < pos ? pos - i : i - pos;
+		std::map<std::string, unsigned int>::iterator p = found.find(word);
+		if (p == found.end() || dist < p->second) found[word] = dist;
+	}
+
+	std::vector< std::pair<unsigned int, std::string> > ranked;
+	for (std::map<std::string, unsigned int>::const_iterator p = found.begin(); p != found.end(); ++p) {
+		ranked.push_back(std::make_pair(p->second, p->first));
+	}
+	std::sort(ranked.begin(), ranked.end());
+
+	words.clear();
+	for (unsigned int i = 0; i < ranked.size(); ++i) words.push_back(wxString(ranked[i].second.c_str(), wxConvUTF8));
+}
+
+static void CheckSameAsRef(WordIndex& index, const TestSource& source, const char* prefix, unsigned int pos) {
+	index.Update(source);
+	ASSERT_TRUE(index.IsValid());
+
+	std::vector<wxString> words;
+	std::vector<wxString> refWords;
+	index.Find(wxString(prefix, wxConvUTF8), pos, words);
+	RefFind(source.m_text, prefix, pos, refWords);
+	EXPECT_EQ(refWords, words);
+}
+
+TEST(WordIndexTest, Empty) {
+	WordIndex index;
+	TestSource source("");
+	std::vector<wxString> words;
+
+	index.Find(wxT("a"), 0, words);
+	EXPECT_TRUE(words.empty());
+
+	index.Update(source);
+	EXPECT_TRUE(index.IsValid());
+	EXPECT_EQ(0, index.GetWordCount());
+
+	source.Insert(index, 0, "abc abd");
+	EXPECT_FALSE(index.IsValid());
+	CheckSameAsRef(index, source, "ab", 0);
+	EXPECT_EQ(2, index.GetWordCount());
+
+	source.Delete(index, 0, 7);
+	CheckSameAsRef(index, source, "ab", 0);
+	EXPECT_EQ(0, index.GetWordCount());
+}
+
+TEST(WordIndexTest, Ranking) {
+	WordIndex index;
+	TestSource source("function foo_bar\nfoo fooBaz\n\tfoo_bar2 = foo_bar; fo\nxfoo $foo_x a$foo_y foo_bar\n");
+	index.Update(source);
+
+	// Nearest occurrence counts, same word is not a completion
+	std::vector<wxString> words;
+	index.Find(wxT("foo"), 47, words);
+	ASSERT_EQ(5, words.size());
+	EXPECT_EQ(wxT("foo_bar"), words[0]);
+	EXPECT_EQ(wxT("foo_x"), words[1]);
+	EXPECT_EQ(wxT("foo_bar2"), words[2]);
+	EXPECT_EQ(wxT("foo_y"), words[3]);
+	EXPECT_EQ(wxT("fooBaz"), words[4]);
+	CheckSameAsRef(index, source, "foo", 47);
+	CheckSameAsRef(index, source, "f", 0);
+
+	// Words after a single char (that is not part of a word)
+	words.clear();
+	index.Find(wxT("$"), 0, words);
+	ASSERT_EQ(1, words.size());
+	EXPECT_EQ(wxT("$foo_x"), words[0]);
+
+	// All words, sorted
+	words.clear();
+	index.GetWords(wxT("foo_"), words);
+	ASSERT_EQ(4, words.size());
+	EXPECT_EQ(wxT("foo_bar"), words[0]);
+	EXPECT_EQ(wxT("foo_bar2"), words[1]);
+	EXPECT_EQ(wxT("foo_x"), words[2]);
+	EXPECT_EQ(wxT("foo_y"), words[3]);
+}
+
+TEST(WordIndexTest, Unicode) {
+	WordIndex index;
+	TestSource source("caf\xC3\xA9 caf\xC3\xA9s caf\xE2\x80\x9C cafe\n");
+	index.Update(source);
+
+	// Letters are part of words, punctuation is not
+	std::vector<wxString> words;
+	index.Find(wxT("caf"), 0, words);
+	ASSERT_EQ(3, words.size());
+	EXPECT_EQ(wxString("caf\xC3\xA9", wxConvUTF8), words[0]);
+	EXPECT_EQ(wxString("caf\xC3\xA9s", wxConvUTF8), words[1]);
+	EXPECT_EQ(wxT("cafe"), words[2]);
+}
+
+TEST(WordIndexTest, Edits) {
+	// Random edits on a text that spans many blocks
+	const char* words[] = {"alpha", "alphabet", "al_1", "beta", "bet", "b2", " ", " ", "\n", ".", "("};
+	std::string text;
+	srand(1);
+	for (unsigned int i = 0; i < 10000; ++i) text += words[rand() % WXSIZEOF(words)];
+
+	WordIndex index;
+	TestSource source(text.c_str());
+	CheckSameAsRef(index, source, "al", 0);
+
+	for (unsigned int i = 0; i < 500; ++i) {
+		const unsigned int len = source.GetLength();
+		const unsigned int pos = rand() % (len + 1);
+		if (i % 50 == 0) source.Delete(index, pos, wxMin(pos + rand() % 5000, len)); // over many blocks
+		else if (rand() % 3 == 0) source.Delete(index, pos, wxMin(pos + rand() % 20, len));
+		else source.Insert(index, pos, words[rand() % WXSIZEOF(words)]);
+
+		if (i % 10 == 0) {
+			CheckSameAsRef(index, source, "al", pos);
+			CheckSameAsRef(index, source, "b", source.GetLength() / 2);
+		}
+	}
+}
+
+TEST(WordIndexTest, ApplyDiff) {
+	WordIndex index;
+	TestSource source("one two\nthree\nfour\n");
+	index.Update(source);
+
+	// "one two\nthree\nfour\n" -> "one tw\nthreeX\ntwelve\n"
+	std::vector<cxChange> changes;
+	cxChange ch;
+	ch.type = cxDELETION; ch.start = 6; ch.end = 7; // "o"
+	changes.push_back(ch);
+	ch.type = cxINSERTION; ch.start = 12; ch.end = 13; // "X"
+	changes.push_back(ch);
+	ch.type = cxDELETION; ch.start = 14; ch.end = 18; // "four"
+	changes.push_back(ch);
+	ch.type = cxINSERTION; ch.start = 14; ch.end = 20; // "twelve"
+	changes.push_back(ch);
+	index.ApplyDiff(changes);
+
+	const char* newText = "one tw\nthreeX\ntwelve\n";
+	source.m_text.assign(newText, newText + strlen(newText));
+	CheckSameAsRef(index, source, "t", 0);
+	CheckSameAsRef(index, source, "tw", 20);
+}
+
+// Run with --gtest_also_run_disabled_tests
+TEST(WordIndexTest, DISABLED_Benchmark) {
+	// A 10MB source file
+	const char* words[] = {"int", "index", "indexOf", "identifier", "value", "values", "m_value", "x", "i"};
+	const char* seps[] = {" ", " = ", "(", ");\n", ", ", "->", "\n\t"};
+	std::string text;
+	srand(5);
+	while (text.size() < 10*1024*1024) {
+		text += words[rand() % WXSIZEOF(words)];
+		text += seps[rand() % WXSIZEOF(seps)];
+		if (rand() % 100 == 0) { // a few rare words
+			char id[16];
+			sprintf(id, "ident%d", rand());
+			text += id;
+		}
+	}
+
+	WordIndex index;
+	TestSource source(text.c_str());
+	wxStopWatch sw;
+	index.Update(source);
+	printf("Indexed %u bytes (%u words) in %ldms\n", source.GetLength(), index.GetWordCount(), sw.Time());
+
+	// Typing in the middle of the document, completing after each char
+	const unsigned int pos = source.GetLength() / 2;
+	const char* typed = "ident";
+	std::vector<wxString> result;
+	for (unsigned int i = 0; typed[i]; ++i) {
+		const char c[] = {typed[i], '\0'};
+		sw.Start();
+		for (unsigned int n = 0; n < 100; ++n) {
+			source.Insert(index, pos + i, c);
+			source.Delete(index, pos + i, pos + i + 1);
+		}
+		source.Insert(index, pos + i, c);
+		index.Update(source);
+
+		result.clear();
+		index.Find(wxString(typed, wxConvUTF8).substr(0, i + 1), pos, result);
+		printf("  '%.*s': %u completions in %ldms (with 200 edits)\n", i + 1, typed, (unsigned int)result.size(), sw.Time());
+	}
+}
@@ -15,12 +15,17 @@
 #include <wx/file.h>
 #include "pcre.h"
 #include "Interval.h"
+#include "GrammarCache.h"
 #include <wx/regex.h>
 
 #include <set>
+#include <limits.h>
+#include <string.h>
+#include <ctype.h>
 
 // Initialize statics
 const wxString matcher::s_emptyString;
+unsigned int group_matcher::s_groupCount = 0;
 wxRegEx matcher::s_alternatives(wxT("(^|\\(|\\(\\?:)([[:alnum:]_]+(\\|[[:alnum:]_]+)+)($|\\))"));
 wxRegEx matcher::s_tabspattern(wxT("^\\t+"));
 wxRegEx matcher::s_repfromzero(wxT("{,([[:digit:]]+)}"));
@@ -127,6 +132,21 @@ void matcher::RegExConvert(wxString& pattern) {
 	beforenewline.ReplaceAll(&pattern, wxT("\\z(?<!\\n)"));
 }
 
+// static
+void matcher::ConvertPattern(wxString& pattern) {
+	GrammarCache& cache = GrammarCache::Get();
+	wxString converted;
+	if (cache.GetConverted(pattern, converted)) {
+		pattern = converted;
+		return;
+	}
+
+	converted = pattern;
+	RegExConvert(converted);
+	cache.AddConverted(pattern, converted);
+	pattern = converted;
+}
+
 #ifdef __WXDEBUG__
 bool matcher::RegExVerify(const wxString& pattern, bool matchcase) {
 	const char *error;
@@ -172,9 +192,17 @@ bool match_matcher::RegExCompile(const wxString& pattern, bool matchcase) {
 	int options = PCRE_UTF8; // We need multiline until we change to line basis
 	if (!matchcase) options |= PCRE_CASELESS;
 
+	// Grammar patterns may have been compiled in an earlier session
+	const wxCharBuffer patternBuf = pattern.mb_str(wxConvUTF8);
+	if (m_isCached && GrammarCache::Get().GetCompiled(patternBuf.data(), options, m_compiledPattern, m_patternStudy)) {
+		m_isStartDependent = IsStartDependent(pattern);
+		SetStartBytes();
+		return true;
+	}
+
 	// Compile the pattern
 	m_compiledPattern = pcre_compile(
-			pattern.mb_str(wxConvUTF8),   /* the pattern */
+			patternBuf.data(),    /* the pattern */
 			options,              /* options */
 			&error,               /* for error message */
 			&erroffset,           /* for error offset */
@@ -182,6 +210,9 @@ bool match_matcher::RegExCompile(const wxString& pattern, bool matchcase) {
 
 	if (m_compiledPattern) {
 		m_patternStudy = pcre_study(m_compiledPattern, 0, &error);
+		if (m_isCached) GrammarCache::Get().AddCompiled(patternBuf.data(), options, m_compiledPattern, m_patternStudy);
+		m_isStartDependent = IsStartDependent(pattern);
+		SetStartBytes();
 		return true;
 	}
 
@@ -199,6 +230,41 @@ bool match_matcher::RegExCompile(const wxString& pattern, bool matchcase) {
 	return false;
 }
 
+void match_matcher::SetStartBytes() {
+	wxASSERT(m_compiledPattern);
+
+	// Use the first byte or the start bits from the study if the pattern has them
+	int firstByte = -1;
+	const unsigned char* firstTable = NULL;
+	pcre_fullinfo(m_compiledPattern, m_patternStudy, PCRE_INFO_FIRSTBYTE, &firstByte);
+	if (firstByte == -2) pcre_fullinfo(m_compiledPattern, m_patternStudy, PCRE_INFO_FIRSTTABLE, &firstTable);
+
+	if (firstByte >= 0) {
+		// The first byte may be caseless
+		memset(m_startBytes, 0, sizeof(m_startBytes));
+		const unsigned char lower = (unsigned char)tolower(firstByte);
+		const unsigned char upper = (unsigned char)toupper(firstByte);
+		m_startBytes[lower/8] |= 1 << (lower%8);
+		m_startBytes[upper/8] |= 1 << (upper%8);
+	}
+	else if (firstTable) memcpy(m_startBytes, firstTable, sizeof(m_startBytes));
+	else memset(m_startBytes, 0xFF, sizeof(m_startBytes)); // may start anywhere
+}
+
+// static
+bool match_matcher::IsStartDependent(const wxString& pattern) {
+	// With \G or \K (or backtracking verbs) searching from a position does
+	// not give the same result as trying each position anchored
+	for (size_t i = 0; i+1 < pattern.size(); ++i) {
+		const wxChar c = pattern[i];
+		if (c == wxT('\\')) {
+			const wxChar next = pattern[++i];
+			if (next == wxT('G') || next == wxT('K')) return true;
+		}
+		else if (c == wxT('(') && pattern[i+1] == wxT('*')) return true;
+	}
+	return false;
+}
 
 // -------------------------------------------------------------------------------------
 
@@ -212,6 +278,14 @@ void match_matcher::SetPattern(const char* pattern) {
 }
 
 void match_matcher::SetPattern(const wxString& pattern) {
+	DoSetPattern(pattern, true);
+}
+
+void match_matcher::SetDynamicPattern(const wxString& pattern) {
+	DoSetPattern(pattern, false);
+}
+
+void match_matcher::DoSetPattern(const wxString& pattern, bool isCached) {
 	// Clean up first (spans might reset endpatterns)
 	if (m_compiledPattern) free(m_compiledPattern);
 	if (m_patternStudy) free(m_patternStudy);
@@ -219,7 +293,9 @@ void match_matcher::SetPattern(const wxString& pattern) {
 	m_patternStudy = NULL;
 
 	m_pattern = pattern;
-	RegExConvert(m_pattern);
+	m_isCached = isCached;
+	if (isCached) ConvertPattern(m_pattern);
+	else RegExConvert(m_pattern);
 	wxASSERT(RegExVerify(m_pattern));
 
 	// Convert backrefs to named refs
@@ -255,21 +331,27 @@ void match_matcher::AddCapture(unsigned int capkey, const wxString& name) {
 
 	if (capkey == 0) {
 		// If the capture cover the entire pattern we have to replace the name
-		m_name = name;
+		SetName(name);
 	}
 	else {
 		m_hasCaptures = true;
-		m_captures[capkey] = name;
+		Capture& cap = m_captures[capkey];
+		cap.name = name;
+		cap.scopeId = ScopeAtoms::GetScope(name).id;
 	}
 }
 
-const wxString& match_matcher::GetCaptureName(unsigned int capkey) const {
-	std::map<unsigned int,wxString>::const_iterator p = m_captures.find(capkey);
-	if (p != m_captures.end()) return p->second;
-	else return s_emptyString;
+const wxString& match_matcher::GetCaptureName(unsigned int capkey, unsigned int& scopeId) const {
+	std::map<unsigned int,Capture>::const_iterator p = m_captures.find(capkey);
+	if (p != m_captures.end()) {
+		scopeId = p->second.scopeId;
+		return p->second.name;
+	}
+	scopeId = ScopeAtoms::NOSCOPE;
+	return s_emptyString;
 }
 
-int match_matcher::Match(char* line, unsigned int start, unsigned int len, unsigned int& callout_id, int *ovector, int ovecsize, int WXUNUSED(zeromatch)) {
+int match_matcher::Match(char* line, unsigned int start, unsigned int len, unsigned int& callout_id, int *ovector, int ovecsize, int WXUNUSED(zeromatch), MatchCache& WXUNUSED(cache)) {
 	wxASSERT(start < len);
 
 	// Get search pattern from matcher
@@ -293,6 +375,39 @@ int match_matcher::Match(char* line, unsigned int start, unsigned int len, unsig
 	return rc;
 }
 
+unsigned int match_matcher::FindFirst(const char* line, unsigned int from, unsigned int len) {
+	const pcre* re = GetMatchPattern();
+	wxASSERT(re);
+	const pcre_extra* study = GetPatternStudy();
+
+	// Only start at valid utf8 chars
+	while (from < len && (line[from] & 0xC0) == 0x80) ++from;
+	if (from == len) return len;
+
+	// A normal search finds the same position as trying each one anchored
+	// (and it skips the positions that can not start a match)
+	if (!m_isStartDependent) {
+		int ovector[3];
+		const int rc = pcre_exec(re, study, line, len, from, PCRE_NO_UTF8_CHECK, ovector, 3);
+		if (rc >= 0) return wxMin((unsigned int)ovector[0], len); // matches at end-of-line do not count
+		if (rc == PCRE_ERROR_NOMATCH) return len;
+		// on other errors, fall back to trying each position
+	}
+
+	static const int search_options = PCRE_ANCHORED|PCRE_NO_UTF8_CHECK;
+	int ovector[30];
+	for (unsigned int pos = from; pos < len; ++pos) {
+		const unsigned char c = line[pos];
+		if ((c & 0xC0) == 0x80) continue;
+		if (!(m_startBytes[c/8] & (1 << (c%8)))) continue;
+
+		const int rc = pcre_exec(re, study, line, len, pos, search_options, ovector, 30);
+		if (rc >= 0) return pos;
+	}
+
+	return len;
+}
+
 // -------------------------------------------------------------------------------------
 
 bool span_matcher::Init(bool WXUNUSED(deep)) {
@@ -306,7 +421,7 @@ bool span_matcher::Init(bool WXUNUSED(deep)) {
 
 	// Add the end pattern first (always ref 0)
 	if (!m_endPattern.empty()) {
-		RegExConvert(m_endPattern);
+		ConvertPattern(m_endPattern);
 
 		// The end pattern is special in that it may contain references
 		// to captures from the start matcher
@@ -400,7 +515,10 @@ void span_matcher::ReInit(const std::vector<char>& text, const int* captures, un
 	//if (!m_groupPattern.empty()) m_pattern += wxT("|") + m_groupPattern;
 
 	// We also have to set the new pattern in the matcher used for captures
-	if (patternModified) m_endMatcher->SetPattern(updatedPattern);
+	if (patternModified) {
+		m_endMatcher->SetDynamicPattern(updatedPattern);
+		ClearMatchCache();
+	}
 }
 
 bool span_matcher::IsSpanEnd(unsigned int callout_id) {
@@ -514,49 +632,64 @@ unsigned int group_matcher::GetSubId(unsigned int id) {
 	return cf.matchptr->SubGetId(cf.callout_id);
 }
 
-int group_matcher::Match(char* line, unsigned int start, unsigned int len, unsigned int& callout_id, int *ovector, int ovecsize, int zeromatch) {
+int group_matcher::Match(char* line, unsigned int start, unsigned int len, unsigned int& callout_id, int *ovector, int ovecsize, int zeromatch, MatchCache& cache) {
 	wxASSERT(m_isInitialized);
 	wxASSERT(start < len);
 
 	static const int search_options = PCRE_ANCHORED|PCRE_NO_UTF8_CHECK;
 	const size_t ref_count = m_refs.size();
 
-	for (unsigned int pos = start; pos < len; ++pos) {
-		// Only start at valid utf8 chars
-		if ((line[pos] & 0xC0) == 0x80) continue;
-
-		for (unsigned int i = 0; i < ref_count; ++i) {
-			match_matcher& m = *m_refs[i].realMatchptr;
-			//wxLogDebug(wxT("%d: %s (%x)"), i, m_refs[i].matchptr->GetName().c_str(), m_refs[i].matchptr);
-			//wxLogDebug(wxT("    (%x) %s"), m_refs[i].realMatchptr, m_refs[i].realMatchptr->GetPattern().c_str());
-
-			// Get search pattern from matcher
-			const pcre* re = m.GetMatchPattern();
-			if (!re) return PCRE_ERROR_NULL;
-			const pcre_extra* study = m.GetPatternStudy();
-			
-			// Do the search
-			const int rc = pcre_exec(
-				re,                   // the compiled pattern
-				study,                // extra data - if we study the pattern
-				line,                 // the subject string
-				len,                  // the length of the subject
-				pos,                  // start at offset in the subject
-				search_options,       // options
-				ovector,              // output vector for substring information
-				ovecsize);            // number of elements in the output vector
-
-
-			// Do we have a match?
-			if (rc >= 0) {
-				if (pos == start && (int)i == zeromatch) continue; // don't match same place twice
-
-				callout_id = i;
-				return rc;
-			}
+	// Drop the cached matches if the line or our patterns have changed
+	if (m_cacheIndex >= cache.m_groups.size()) cache.m_groups.resize(m_cacheIndex+1);
+	MatchCache::GroupMatches& cached = cache.m_groups[m_cacheIndex];
+	if (cached.lineId != cache.m_lineId || cached.version != m_version || cached.matches.size() != ref_count) {
+		const MatchCache::NextMatch invalid = {UINT_MAX, 0};
+		cached.matches.assign(ref_count, invalid);
+		cached.lineId = cache.m_lineId;
+		cached.version = m_version;
+	}
+
+	// Find the member with the first match (the first member if several
+	// match at the same position). Members are only searched again
+	// when the search has passed their cached match.
+	unsigned int firstPos = len;
+	unsigned int firstRef = 0;
+	for (unsigned int i = 0; i < ref_count; ++i) {
+		match_matcher& m = *m_refs[i].realMatchptr;
+		//wxLogDebug(wxT("%d: %s (%x)"), i, m_refs[i].matchptr->GetName().c_str(), m_refs[i].matchptr);
+		//wxLogDebug(wxT("    (%x) %s"), m_refs[i].realMatchptr, m_refs[i].realMatchptr->GetPattern().c_str());
+		if (!m.GetMatchPattern()) return PCRE_ERROR_NULL;
+
+		// don't match same place twice
+		const unsigned int from = ((int)i == zeromatch) ? start+1 : start;
+
+		MatchCache::NextMatch& next = cached.matches[i];
+		if (from < next.from || from > next.pos) {
+			next.from = from;
+			next.pos = m.FindFirst(line, from, len);
+		}
+
+		if (next.pos < firstPos) {
+			firstPos = next.pos;
+			firstRef = i;
 		}
 	}
 
-	// If we reach here, no match was found
-	return PCRE_ERROR_NOMATCH;
+	if (firstPos == len) return PCRE_ERROR_NOMATCH;
+
+	// Get the captures
+	match_matcher& m = *m_refs[firstRef].realMatchptr;
+	const int rc = pcre_exec(
+		m.GetMatchPattern(),      // the compiled pattern
+		m.GetPatternStudy(),      // extra data - if we study the pattern
+		line,                     // the subject string
+		len,                      // the length of the subject
+		firstPos,                 // start at offset in the subject
+		search_options,           // options
+		ovector,                  // output vector for substring information
+		ovecsize);                // number of elements in the output vector
+	wxASSERT(rc >= 0);
+
+	callout_id = firstRef;
+	return rc;
 }
@@ -8,6 +8,7 @@
 
 #include <vector>
 #include <map>
+#include "ScopeAtoms.h"
 
 // pre-declarations
 class wxRegEx;
@@ -18,23 +19,58 @@ typedef struct real_pcre pcre;    // because of the way it is defined in pcre.h
 struct pcre_extra;
 class match_matcher;
 
+// The state a parse keeps for the group matchers: the next match of each
+// member in the current line. The grammars are shared by all documents
+// (and their background parsers), so it can't be kept in the matchers.
+class MatchCache {
+public:
+	MatchCache() : m_lineId(1) {};
+
+	// Has to be called each time the text of the
+	// line passed to Match changes
+	void LineChanged() {if (++m_lineId == 0) ++m_lineId;};
+
+private:
+	friend class group_matcher;
+
+	// The next match of a member is valid for searches starting between from
+	// and pos, so members only have to be searched again when the search
+	// passes their match.
+	struct NextMatch {
+		unsigned int from;
+		unsigned int pos; // line length if no match
+	};
+	struct GroupMatches {
+		GroupMatches() : lineId(0), version(0) {};
+		unsigned int lineId;
+		unsigned int version; // of the group's patterns
+		std::vector<NextMatch> matches;
+	};
+
+	// Member variables
+	std::vector<GroupMatches> m_groups; // by group index
+	unsigned int m_lineId;
+};
+
 
 class matcher {
 public:
 	matcher()
-	: m_isEnabled(true), m_isInitialized(false) {};
+	: m_isEnabled(true), m_scopeId(ScopeAtoms::NOSCOPE), m_isInitialized(false) {};
 	virtual ~matcher() {};
 
-	void SetName(const wxString& name) {m_name =  name;};
+	void SetName(const wxString& name) {m_name =  name; m_scopeId = ScopeAtoms::GetScope(name).id;};
 	const wxString& GetName() const {return m_name;};
+	unsigned int GetScopeId() const {return m_scopeId;}; // interned name
 	virtual bool Init(bool deep=false) = 0;
 	
 	bool IsInitialized() const {return m_isInitialized;};
 	bool IsEnabled() const {return m_isEnabled;};
 	void Disable() {m_isEnabled = false;};
 
-	virtual const wxString& GetCaptureName(unsigned int WXUNUSED(capkey)) const {wxASSERT(false); return s_emptyString;};
+	virtual const wxString& GetCaptureName(unsigned int WXUNUSED(capkey), unsigned int& WXUNUSED(scopeId)) const {wxASSERT(false); return s_emptyString;};
 	virtual const wxString& GetContentName() const {return s_emptyString;};
+	virtual unsigned int GetContentScopeId() const {return ScopeAtoms::NOSCOPE;};
 
 	virtual matcher& GetCallout(unsigned int callout_id) = 0;
 
@@ -48,7 +84,7 @@ public:
 	virtual unsigned int GetSubId(unsigned int) {return 0;};
 
 	// Matching
-	virtual int Match(char* line, unsigned int start, unsigned int len, unsigned int& callout_id, int *ovector, int ovecsize, int zeromatch) = 0;
+	virtual int Match(char* line, unsigned int start, unsigned int len, unsigned int& callout_id, int *ovector, int ovecsize, int zeromatch, MatchCache& cache) = 0;
 
 	struct calloutref {
 		matcher* matchptr;
@@ -70,6 +106,9 @@ protected:
 	static bool RegExVerify(const wxString& pattern, bool matchcase=true);
 #endif
 
+	// RegExConvert with the result kept in the grammar cache
+	static void ConvertPattern(wxString& pattern);
+
 	// Regex optimization
 	typedef std::map<wxChar, void*> NodeMap;
 	static void OptimizeRegex(wxString& pattern);
@@ -79,6 +118,7 @@ protected:
 	// Member variables
 	bool m_isEnabled;
 	wxString m_name;
+	unsigned int m_scopeId;
 	bool m_isInitialized;
 	static const wxString s_emptyString;
 
@@ -92,7 +132,7 @@ protected:
 class group_matcher : public matcher {
 public:
 	group_matcher()
-	: matcher(), m_initializing(false) {};
+	: matcher(), m_initializing(false), m_cacheIndex(s_groupCount++), m_version(0) {};
 	~group_matcher() {};
 	void AddMember(matcher* m);
 
@@ -110,39 +150,56 @@ public:
 	size_t GetMembers(std::vector<calloutref>& refs);
 
 	// Matching
-	int Match(char* line, unsigned int start, unsigned int len, unsigned int& callout_id, int *ovector, int ovecsize, int zeromatch);
+	int Match(char* line, unsigned int start, unsigned int len, unsigned int& callout_id, int *ovector, int ovecsize, int zeromatch, MatchCache& cache);
 
 	bool SubIsSpanStart(unsigned int callout_id) {return IsSpanStart(callout_id);};
 	matcher& SubGetCallout(unsigned int callout_id) {return GetCallout(callout_id);};
 	unsigned int SubGetId(unsigned int id) {return GetSubId(id);};
 
 protected:
+	// Drops the matches cached for the group in all parses
+	void ClearMatchCache() {++m_version;};
+
 	std::vector<matcher*> m_members;
 	std::vector<calloutref> m_refs;
 
 	bool m_initializing;
+
+private:
+	// Where the group keeps its matches in a MatchCache
+	// (groups are created with the parse lock held)
+	static unsigned int s_groupCount;
+	const unsigned int m_cacheIndex;
+	unsigned int m_version;
 };
 
 class match_matcher : public matcher {
 public:
-	match_matcher() : matcher(), m_hasCaptures(false), m_compiledPattern(NULL), m_patternStudy(NULL) {};
+	match_matcher() : matcher(), m_hasCaptures(false), m_compiledPattern(NULL), m_patternStudy(NULL), m_isCached(true), m_isStartDependent(false) {};
 	~match_matcher();
 	bool Init(bool) {return true;};
 
 	void SetPattern(const wxString& pattern);
 	void SetPattern(const char* pattern);
+
+	// For patterns built while parsing (like end patterns with captures),
+	// which should not be kept in the grammar cache
+	void SetDynamicPattern(const wxString& pattern);
 	const wxString& GetPattern() {return m_pattern;};
 
 	pcre* GetMatchPattern();
 	pcre_extra* GetPatternStudy() {return m_patternStudy;};
 
 	// Matching
-	int Match(char* line, unsigned int start, unsigned int len, unsigned int& callout_id, int *ovector, int ovecsize, int zeromatch);
+	int Match(char* line, unsigned int start, unsigned int len, unsigned int& callout_id, int *ovector, int ovecsize, int zeromatch, MatchCache& cache);
+
+	// First position at or after from where the pattern matches (len if none)
+	unsigned int FindFirst(const char* line, unsigned int from, unsigned int len);
 
 	// Captures
 	bool HasCaptures() const {return m_hasCaptures;};
 	void AddCapture(unsigned int capkey, const wxString& name);
-	const wxString& GetCaptureName(unsigned int capkey) const;
+	const wxString& GetCaptureName(unsigned int capkey, unsigned int& scopeId) const;
 
 	// Generic class functions
 	matcher& GetCallout(unsigned int callout_id);
@@ -155,6 +212,9 @@ public:
 
 private:
 	bool RegExCompile(const wxString& pattern, bool matchcase=true);
+	void DoSetPattern(const wxString& pattern, bool isCached);
+	void SetStartBytes();
+	static bool IsStartDependent(const wxString& pattern);
 
 	// Member variables
 	wxString m_pattern;
@@ -162,13 +222,22 @@ private:
 	bool m_hasCaptures;
 	pcre* m_compiledPattern;
 	pcre_extra* m_patternStudy;
-	std::map<unsigned int,wxString> m_captures;
+	bool m_isCached; // pattern comes from the grammar
+	struct Capture {
+		wxString name;
+		unsigned int scopeId;
+	};
+	std::map<unsigned int,Capture> m_captures;
+
+	// Search optimization
+	bool m_isStartDependent; // result depends on where the search starts (\G, \K)
+	unsigned char m_startBytes[32]; // bitmap of the bytes a match can start with
 };
 
 class span_matcher : public group_matcher {
 public:
 	span_matcher()
-	: group_matcher(), m_startMatcher(NULL), m_endMatcher(NULL), m_hasEndCaptures(false) {};
+	: group_matcher(), m_startMatcher(NULL), m_endMatcher(NULL), m_hasEndCaptures(false), m_contentScopeId(ScopeAtoms::NOSCOPE) {};
 	~span_matcher() {};
 
 	bool Init(bool deep=false);
@@ -179,8 +248,9 @@ public:
 	void SetEndPattern(const wxString& pattern) {m_endPattern = pattern;};
 	bool HasEndCaptures() const {return m_hasEndCaptures;};
 
-	void SetContentName(const wxString& name) {m_contentName = name;};
+	void SetContentName(const wxString& name) {m_contentName = name; m_contentScopeId = ScopeAtoms::GetScope(name).id;};
 	const wxString& GetContentName() const {return m_contentName;};
+	unsigned int GetContentScopeId() const {return m_contentScopeId;};
 
 	bool IsSpan() const {return true;};
 	bool IsSpanEnd(unsigned int callout_id);
@@ -201,6 +271,7 @@ private:
 	wxString m_groupPattern;
 	bool m_hasEndCaptures;
 	wxString m_contentName;
+	unsigned int m_contentScopeId;
 
 	static wxRegEx s_refToCapture;
 };
@@ -15,6 +15,7 @@
 
 #include <wx/dir.h>
 #include <wx/ffile.h>
+#include <wx/stopwatch.h>
 
 #include "FileActionThread.h"
 #include "Catalyst.h"
@@ -30,6 +31,9 @@
     #pragma warning(pop)
 #endif
 
+#include <memory>
+#include <set>
+
 enum {
 	REF_STRING = 0,
 	REF_DICT,
@@ -223,6 +227,8 @@ PListHandler::PListHandler(const wxString& appPath, const wxString& appDataPath,
 }
 
 PListHandler::~PListHandler() {
+	ClearPreParsed();
+
 	if (m_dbChanged) {
 		m_storage.Commit();
 	}
@@ -258,6 +264,16 @@ void PListHandler::OnCommitTimer(wxTimerEvent& WXUNUSED(event)) {
 void PListHandler::Update(cxUpdateMode mode) {
 	m_allBundlesUpdated = false;
 
+	wxStopWatch sw;
+
+	// Find all the new plists (on first start that is all of them)
+	// and parse them in parallel, before they are loaded one by one
+	wxArrayString newPaths;
+	FindNewPlists(mode, newPaths);
+	const long findTime = sw.Time();
+	PreParsePlists(newPaths);
+	const long parseTime = sw.Time() - findTime;
+
 	if (mode != UPDATE_REST) {
 		// Update Themes
 		wxFileName themePath = m_appPath;
@@ -265,7 +281,7 @@ void PListHandler::Update(cxUpdateMode mode) {
 		if (themePath.DirExists()) {
 			// Update Pristine Themes
 			wxSortedArrayString themeFiles;
-			wxDir::GetAllFiles(themePath.GetPath(), &themeFiles, wxT("*.tmTheme"), wxDIR_FILES);
+			GetDirFiles(themePath, wxT("*.tmTheme"), NULL, themeFiles);
 
 			UpdatePlists(themePath, themeFiles, PLIST_PRISTINE, m_vThemes);
 		}
@@ -276,7 +292,7 @@ void PListHandler::Update(cxUpdateMode mode) {
 		localThemePath.AppendDir(wxT("Themes"));
 		if (localThemePath.DirExists()) {
 			wxSortedArrayString localFiles;
-			wxDir::GetAllFiles(localThemePath.GetPath(), &localFiles, wxT("*.tmTheme"), wxDIR_FILES);
+			GetDirFiles(localThemePath, wxT("*.tmTheme"), NULL, localFiles);
 
 			UpdatePlists(localThemePath, localFiles, PLIST_LOCAL, m_vThemes);
 		}
@@ -307,6 +323,180 @@ void PListHandler::Update(cxUpdateMode mode) {
 	// Mark for commit in next idle time
 	m_dbChanged = true;
 	if (mode != UPDATE_SYNTAXONLY) m_allBundlesUpdated = true;
+
+	// Drop whatever was not used
+	ClearPreParsed();
+	m_dirFiles.clear();
+
+	// Compare cold (empty db) and warm starts with this
+	wxLogDebug(wxT("PListHandler::Update(%d): %ldms (found %u new plists in %ldms, parsed them in %ldms)"),
+		mode, sw.Time(), (unsigned int)newPaths.GetCount(), findTime, parseTime);
+}
+
+void PListHandler::FindNewPlists(cxUpdateMode mode, wxArrayString& paths) {
+	if (mode != UPDATE_REST) {
+		wxFileName themePath = m_appPath;
+		themePath.AppendDir(wxT("Themes"));
+		FindNewThemes(themePath, PLIST_PRISTINE, paths);
+
+		wxFileName localThemePath = m_appDataPath;
+		localThemePath.AppendDir(wxT("Themes"));
+		FindNewThemes(localThemePath, PLIST_LOCAL, paths);
+	}
+
+	FindNewBundlePlists(m_installedBundleDir, PLIST_INSTALLED, mode, paths);
+	FindNewBundlePlists(m_bundleDir, PLIST_PRISTINE, mode, paths);
+	FindNewBundlePlists(m_localBundleDir, PLIST_LOCAL, mode, paths);
+}
+
+void PListHandler::FindNewThemes(const wxFileName& path, int loc, wxArrayString& paths) {
+	if (!path.DirExists()) return;
+
+	// The listing is kept for the update
+	wxSortedArrayString files;
+	GetDirFiles(path, wxT("*.tmTheme"), NULL, files);
+	m_dirFiles[path.GetPath()] = files;
+
+	// Get the names of the themes we already have
+	set<wxString> known;
+	for (int i = 0; i < m_vThemes.GetSize(); ++i) {
+		const c4_RowRef rTheme = m_vThemes[i];
+		if (!(pLocality(rTheme) & loc)) continue;
+
+		const int plistRef = (loc == PLIST_LOCAL) ? pLocalRef(rTheme) : pPristineRef(rTheme);
+		known.insert(wxString(pFilename(m_vPlists[plistRef]), wxConvUTF8));
+	}
+
+	for (unsigned int i = 0; i < files.GetCount(); ++i) {
+		const wxFileName filePath(files[i]);
+		if (known.find(filePath.GetFullName()) == known.end()) paths.Add(files[i]);
+	}
+}
+
+void PListHandler::FindNewBundlePlists(const wxFileName& path, int loc, cxUpdateMode mode, wxArrayString& paths) {
+	if (!path.DirExists()) return;
+	wxDir d(path.GetPath());
+	if (!d.IsOpened()) return;
+
+	// Only the bundles (or parts of them) that have not been loaded are
+	// searched, so that a warm start does not stat anything extra. Files
+	// added to loaded bundles are just parsed when they are found.
+	wxString dirName;
+	for (bool cont = d.GetFirst(&dirName, wxT("*.tmbundle"), wxDIR_DIRS); cont; cont = d.GetNext(&dirName)) {
+		bool isNew = true;
+		bool restIsNew = true;
+
+		const int bundleId = m_vBundles.Find(pBundlePath[dirName.mb_str(wxConvUTF8)]);
+		if (bundleId != -1) {
+			const c4_RowRef rBundle = m_vBundles[bundleId];
+			const int locality = pLocality(rBundle);
+			if (loc == PLIST_PRISTINE && locality & PLIST_INSTALLED) continue; // installed overrides pristine
+
+			if (locality & loc) {
+				// The rest is only loaded after the syntaxes
+				isNew = false;
+				restIsNew = !HasItems(pCommands(rBundle), loc) && !HasItems(pSnippets(rBundle), loc)
+					&& !HasItems(pDragCommands(rBundle), loc) && !HasItems(pPrefs(rBundle), loc);
+			}
+		}
+
+		wxFileName bundlePath = path;
+		bundlePath.AppendDir(dirName);
+
+		if (mode != UPDATE_REST && isNew) {
+			wxFileName infoPath = bundlePath;
+			infoPath.SetFullName(wxT("info.plist"));
+			if (infoPath.FileExists()) paths.Add(infoPath.GetFullPath());
+
+			FindNewDirPlists(bundlePath, wxT("Syntaxes"), wxT("*.tmLanguage"), paths);
+		}
+
+		if (mode != UPDATE_SYNTAXONLY && restIsNew) {
+			FindNewDirPlists(bundlePath, wxT("Commands"), wxT("*.tmCommand"), paths);
+			FindNewDirPlists(bundlePath, wxT("Snippets"), wxT("*.tmSnippet"), paths);
+			FindNewDirPlists(bundlePath, wxT("DragCommands"), wxT("*.tmDragCommand"), paths);
+			FindNewDirPlists(bundlePath, wxT("Preferences"), wxT("*.tmPreferences"), paths);
+		}
+	}
+}
+
+void PListHandler::FindNewDirPlists(const wxFileName& bundlePath, const wxChar* subDir, const wxChar* spec, wxArrayString& paths) {
+	wxFileName dirPath = bundlePath;
+	dirPath.AppendDir(subDir);
+	if (!dirPath.DirExists()) return;
+
+	// The listing is kept for the update
+	wxSortedArrayString files;
+	GetDirFiles(dirPath, wxT("*.plist"), spec, files);
+	m_dirFiles[dirPath.GetPath()] = files;
+
+	for (unsigned int i = 0; i < files.GetCount(); ++i) paths.Add(files[i]);
+}
+
+void PListHandler::GetDirFiles(const wxFileName& path, const wxChar* spec, const wxChar* spec2, wxSortedArrayString& files) {
+	// Use the listing from FindNewPlists if we have it
+	map<wxString, wxSortedArrayString>::iterator p = m_dirFiles.find(path.GetPath());
+	if (p != m_dirFiles.end()) {
+		files = p->second;
+		m_dirFiles.erase(p);
+		return;
+	}
+
+	wxDir::GetAllFiles(path.GetPath(), &files, spec, wxDIR_FILES);
+	if (spec2) wxDir::GetAllFiles(path.GetPath(), &files, spec2, wxDIR_FILES);
+}
+
+// static
+bool PListHandler::HasItems(const c4_View& vList, int loc) {
+	for (int i = 0; i < vList.GetSize(); ++i) {
+		if (pLocality(vList[i]) & loc) return true;
+	}
+	return false;
+}
+
+// Opens and parses a plist file. Returns NULL if it could not be opened.
+static TiXmlDocument* ParsePlistFile(const wxString& path) {
+	// We have to open the file manually to allow
+	// filenames with unicode chars
+	wxFFile file(path, wxT("rb"));
+	if (!file.IsOpened()) return NULL;
+
+	TiXmlDocument* doc = new TiXmlDocument;
+	doc->LoadFile(file.fp()); // errors are checked when loading into the db
+	return doc;
+}
+
+struct PlistParseJob {
+	vector<wxString> threadPaths; // unshared copies (wxString refcounts are not thread safe)
+	vector<TiXmlDocument*> docs;
+};
+
+// static
+void PListHandler::OnParsePlist(void* data, unsigned int index) {
+	PlistParseJob& job = *(PlistParseJob*)data;
+	job.docs[index] = ParsePlistFile(job.threadPaths[index]);
+}
+
+void PListHandler::PreParsePlists(const wxArrayString& paths) {
+	if (paths.GetCount() < 2) return;
+
+	PlistParseJob job;
+	for (unsigned int i = 0; i < paths.GetCount(); ++i) {
+		job.threadPaths.push_back(wxString(paths[i].c_str()));
+	}
+	job.docs.resize(paths.GetCount(), NULL);
+	m_runner.RunBatch(paths.GetCount(), OnParsePlist, &job);
+
+	for (unsigned int i = 0; i < paths.GetCount(); ++i) {
+		m_preParsed[paths[i]] = job.docs[i];
+	}
+}
+
+void PListHandler::ClearPreParsed() {
+	for (map<wxString, TiXmlDocument*>::iterator p = m_preParsed.begin(); p != m_preParsed.end(); ++p) {
+		delete p->second;
+	}
+	m_preParsed.clear();
 }
 
 void PListHandler::UpdatePlists(const wxFileName& path, wxArrayString& filePaths, int loc, c4_View vList) {
@@ -359,7 +549,7 @@ void PListHandler::UpdatePlists(const wxFileName& path, wxArrayString& filePaths
 		filePaths.RemoveAt(ndx);
 	}
 
-	// Any files left in themeFiles are new
+	// Any files left in themeFiles are new (most were parsed by PreParsePlists)
 	for (unsigned int i2 = 0; i2 < filePaths.GetCount(); ++i2) {
 		const wxString& path = filePaths[i2];
 		const int ref = LoadPList(path);
@@ -574,8 +764,7 @@ void PListHandler::UpdateBundleSubDirs(const wxFileName& path, int loc, unsigned
 		c4_View vSyntaxes = pSyntaxes(rBundle);
 		if (syntaxDir.DirExists()) {
 			wxSortedArrayString syntaxFiles;
-			wxDir::GetAllFiles(syntaxDir.GetPath(), &syntaxFiles, wxT("*.plist"), wxDIR_FILES);
-			wxDir::GetAllFiles(syntaxDir.GetPath(), &syntaxFiles, wxT("*.tmLanguage"), wxDIR_FILES);
+			GetDirFiles(syntaxDir, wxT("*.plist"), wxT("*.tmLanguage"), syntaxFiles);
 
 			UpdatePlists(syntaxDir, syntaxFiles, loc, vSyntaxes);
 		}
@@ -589,8 +778,7 @@ void PListHandler::UpdateBundleSubDirs(const wxFileName& path, int loc, unsigned
 		c4_View vCommands = pCommands(rBundle);
 		if (commandsDir.DirExists()) {
 			wxSortedArrayString files;
-			wxDir::GetAllFiles(commandsDir.GetPath(), &files, wxT("*.plist"), wxDIR_FILES);
-			wxDir::GetAllFiles(commandsDir.GetPath(), &files, wxT("*.tmCommand"), wxDIR_FILES);
+			GetDirFiles(commandsDir, wxT("*.plist"), wxT("*.tmCommand"), files);
 
 			UpdatePlists(commandsDir, files, loc, vCommands);
 		}
@@ -602,8 +790,7 @@ void PListHandler::UpdateBundleSubDirs(const wxFileName& path, int loc, unsigned
 		c4_View vSnippets = pSnippets(rBundle);
 		if (snippetsDir.DirExists()) {
 			wxSortedArrayString files;
-			wxDir::GetAllFiles(snippetsDir.GetPath(), &files, wxT("*.plist"), wxDIR_FILES);
-			wxDir::GetAllFiles(snippetsDir.GetPath(), &files, wxT("*.tmSnippet"), wxDIR_FILES);
+			GetDirFiles(snippetsDir, wxT("*.plist"), wxT("*.tmSnippet"), files);
 
 			UpdatePlists(snippetsDir, files, loc, vSnippets);
 		}
@@ -615,8 +802,7 @@ void PListHandler::UpdateBundleSubDirs(const wxFileName& path, int loc, unsigned
 		c4_View vDragCommands = pDragCommands(rBundle);
 		if (dragCommandsDir.DirExists()) {
 			wxSortedArrayString files;
-			wxDir::GetAllFiles(dragCommandsDir.GetPath(), &files, wxT("*.plist"), wxDIR_FILES);
-			wxDir::GetAllFiles(dragCommandsDir.GetPath(), &files, wxT("*.tmDragCommand"), wxDIR_FILES);
+			GetDirFiles(dragCommandsDir, wxT("*.plist"), wxT("*.tmDragCommand"), files);
 
 			UpdatePlists(dragCommandsDir, files, loc, vDragCommands);
 		}
@@ -628,8 +814,7 @@ void PListHandler::UpdateBundleSubDirs(const wxFileName& path, int loc, unsigned
 		c4_View vPrefs= pPrefs(rBundle);
 		if (prefsDir.DirExists()) {
 			wxSortedArrayString files;
-			wxDir::GetAllFiles(prefsDir.GetPath(), &files, wxT("*.plist"), wxDIR_FILES);
-			wxDir::GetAllFiles(prefsDir.GetPath(), &files, wxT("*.tmPreferences"), wxDIR_FILES);
+			GetDirFiles(prefsDir, wxT("*.plist"), wxT("*.tmPreferences"), files);
 
 			UpdatePlists(prefsDir, files, loc, vPrefs);
 		}
@@ -655,6 +840,32 @@ wxDateTime PListHandler::GetBundleModDate(unsigned int bundleId) const {
 	return path.GetModificationTime();
 }
 
+unsigned int PListHandler::GetSyntaxStamp() const {
+	// Combine the modification dates of all the syntax plists in use
+	unsigned int stamp = 0;
+	for (int b = 0; b < m_vBundles.GetSize(); ++b) {
+		const c4_RowRef rBundle = m_vBundles[b];
+		if (pLocality(rBundle) & (PLIST_DISABLED|PLIST_DELETED)) continue;
+
+		const c4_View vSyntaxes = pSyntaxes(rBundle);
+		for (int i = 0; i < vSyntaxes.GetSize(); ++i) {
+			const c4_RowRef rSyntax = vSyntaxes[i];
+			const int loc = pLocality(rSyntax);
+			stamp = stamp * 31 + loc;
+
+			if (loc & (PLIST_PRISTINE|PLIST_INSTALLED)) {
+				const t4_i64 modDate = pModDate(m_vPlists[pPristineRef(rSyntax)]);
+				stamp = (stamp * 31 + (unsigned int)modDate) * 31 + (unsigned int)(modDate >> 32);
+			}
+			if (loc & PLIST_LOCAL) {
+				const t4_i64 modDate = pModDate(m_vPlists[pLocalRef(rSyntax)]);
+				stamp = (stamp * 31 + (unsigned int)modDate) * 31 + (unsigned int)(modDate >> 32);
+			}
+		}
+	}
+	return stamp;
+}
+
 vector<cxBundleInfo> PListHandler::GetInstalledBundlesInfo() const {
 	vector<cxBundleInfo> bInfo;
 
@@ -2055,14 +2266,18 @@ unsigned int PListHandler::CopyPlist(unsigned int ndx) {
 }
 
 int PListHandler::LoadPList(const wxString& path) {
-	// We have to open the file manually to allow
-	// filenames with unicode chars
-	wxFFile file(path, wxT("rb"));
-	if (!file.IsOpened()) return -1;
-
-	// Load xml document
-	TiXmlDocument doc;
-	if (!doc.LoadFile(file.fp())) {
+	// Load xml document (it may have been parsed in advance)
+	auto_ptr<TiXmlDocument> docPtr;
+	map<wxString, TiXmlDocument*>::iterator p = m_preParsed.find(path);
+	if (p != m_preParsed.end()) {
+		docPtr.reset(p->second);
+		m_preParsed.erase(p);
+	}
+	else docPtr.reset(ParsePlistFile(path));
+	if (!docPtr.get()) return -1;
+
+	TiXmlDocument& doc = *docPtr;
+	if (doc.Error()) {
 #ifdef __WXDEBUG__
 		const char * error = doc.ErrorDesc();
 		const int row = doc.ErrorRow();
@@ -24,10 +24,13 @@
 
 #include "BundleItemType.h"
 #include "BundleInfo.h"
+#include "TaskRunner.h"
 
 #include <vector>
+#include <map>
 
 // Pre-definitions
+class TiXmlDocument;
 class TiXmlElement;
 class PListDict;
 class PListArray;
@@ -84,6 +87,7 @@ public:
 	wxFileName GetBundleItemPath(BundleItemType type, unsigned int bundleId, unsigned int itemId) const;
 	wxFileName GetBundleSupportPath(unsigned int bundleId) const;
 	wxDateTime GetBundleModDate(unsigned int bundleId) const;
+	unsigned int GetSyntaxStamp() const; // changes when any syntax is modified
 
 	// Exports
 	bool ExportBundle(const wxFileName& dstPath, unsigned int bundleId) const;
@@ -121,6 +125,17 @@ private:
 	void UpdateBundles(const wxFileName& path, int loc, cxUpdateMode mode);
 	void UpdateBundleSubDirs(const wxFileName& path, int loc, unsigned int bundleId, cxUpdateMode mode);
 
+	// Parsing of new plists on worker threads (ahead of loading them)
+	void FindNewPlists(cxUpdateMode mode, wxArrayString& paths);
+	void FindNewThemes(const wxFileName& path, int loc, wxArrayString& paths);
+	void FindNewBundlePlists(const wxFileName& path, int loc, cxUpdateMode mode, wxArrayString& paths);
+	void FindNewDirPlists(const wxFileName& bundlePath, const wxChar* subDir, const wxChar* spec, wxArrayString& paths);
+	void GetDirFiles(const wxFileName& path, const wxChar* spec, const wxChar* spec2, wxSortedArrayString& files);
+	static bool HasItems(const c4_View& vList, int loc);
+	void PreParsePlists(const wxArrayString& paths);
+	void ClearPreParsed();
+	static void OnParsePlist(void* data, unsigned int index);
+
 	// Bundle handling
 	unsigned int NewManifest(const wxString& name);
 	wxFileName GetLocalBundlePath(unsigned int bundleId);
@@ -194,6 +209,9 @@ private:
 	wxFileName m_bundleDir;
 	wxFileName m_installedBundleDir;
 	wxFileName m_localBundleDir;
+	TaskRunner m_runner; // kept between the syntax and the full update
+	std::map<wxString, TiXmlDocument*> m_preParsed; // NULL if file could not be opened
+	std::map<wxString, wxSortedArrayString> m_dirFiles; // listings made by FindNewPlists
 
 	// Static constants
 	static const char* DB_THEMES_FORMAT;
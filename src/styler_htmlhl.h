@@ -23,6 +23,7 @@
 #include "Catalyst.h"
 #include "styler.h"
 #include "eSettings.h"
+#include "TagIndex.h"
 
 #include <vector>
 
@@ -36,14 +37,6 @@ class Lines;
 
 class Styler_HtmlHL : public Styler {
 public:
-	class TagInterval {
-	public:
-		unsigned int start, end, tagNameEnd;
-		bool isClosingTag, isSelfClosingTag;
-		
-		TagInterval(unsigned int start, unsigned int end, const Document& doc);
-	};
-
 	Styler_HtmlHL(const DocumentWrapper& rev, const Lines& lines, const tmTheme& theme, eSettings& settings, EditorCtrl& editorCtrl);
 	virtual ~Styler_HtmlHL() {};
 
@@ -55,16 +48,6 @@ public:
 	
 	bool ShouldStyle();
 	void Reparse();
-	bool IsValidTag(unsigned int start, unsigned int end, const Document& doc);
-	bool SameTag(TagInterval& openTag, TagInterval& closeTag, const Document& doc);
-	bool FindBrackets(unsigned int start, unsigned int end, const Document& doc);
-	void FindAllBrackets(const Document& doc);
-	bool IsOpenComment(const Document& doc, int bracket);
-	bool IsCloseComment(const Document& doc, int bracket);
-	void FindTags(const Document& doc);
-	int FindMatchingTag(const Document& doc, int tag);
-	int FindCurrentTag();
-	int FindParentClosingTag(unsigned int searchPosition);
 
 	// Handle document changes
 	void Insert(unsigned int pos, unsigned int length);
@@ -72,6 +55,8 @@ public:
 	void ApplyDiff(const std::vector<cxChange>& changes);
 
 private:
+	void UpdateTags(const Document& doc);
+
 	// Member variables
 	const DocumentWrapper& m_doc;
 	const Lines& m_lines;
@@ -80,9 +65,9 @@ private:
 
 	unsigned int m_cursorPosition;
 	bool needReparse, needReparseTags;
-	int m_currentTag, m_matchingTag;
-	std::vector<unsigned int> m_brackets;
-	std::vector<TagInterval> m_tags;
+	TagIndex m_tags;
+	bool m_hasMatchingTag;
+	TagIndex::Tag m_matchingTag;
 
 	// Theme variables
 	const tmTheme& m_theme;
@@ -17,36 +17,70 @@
 #include "Lines.h"
 #include "Document.h"
 #include "FindFlags.h"
+#include "WordIndex.h"
+#include "pcre.h"
 
+// Initializing static constants
 const unsigned int Styler_SearchHL::EXTSIZE = 1000;
+const unsigned int Styler_SearchHL::CONTEXTSIZE = 4; // room for a utf-8 char on each side
+const unsigned int Styler_SearchHL::BGCHUNKSIZE = 1024*1024;
 
 Styler_SearchHL::Styler_SearchHL(const DocumentWrapper& rev, const Lines& lines, const vector<interval>& ranges, const tmTheme& theme)
-: m_doc(rev), m_lines(lines), m_searchRanges(ranges),
+: m_doc(rev), m_lines(lines), m_wholeWord(false), m_searchRanges(ranges),
   m_theme(theme), m_hlcolor(m_theme.searchHighlightColor),
-  m_rangeColor(m_theme.shadowColor) 
+  m_rangeColor(m_theme.shadowColor), m_runner(1), m_noBackground(false),
+  m_jobState(JOB_NONE), m_generation(0)
 {
 	Clear(); // Make sure all variables are empty
 }
 
+Styler_SearchHL::~Styler_SearchHL() {
+	// The search thread may be in the middle of a job
+	m_runner.Wait();
+}
+
 void Styler_SearchHL::Clear() {
 	m_text.Clear();
 	m_options = 0;
-	m_matches.clear();
-	m_search_start = 0;
-	m_search_end = 0;
+	m_hasPattern = false;
+	m_pattern = Pattern();
+	Invalidate();
 }
 
 void Styler_SearchHL::Invalidate() {
-	m_matches.clear();
-	m_search_start = 0;
-	m_search_end = 0;
+	if (!m_matches.IsEmpty()) m_matches.Clear();
+	m_searched.clear();
+	++m_generation; // drop results from search thread
 }
 
 void Styler_SearchHL::SetSearch(const wxString& text, int options) {
-	if (text != m_text || options != m_options) {
-		Clear();
-		m_text = text;
-		m_options = options;
+	if (text == m_text && options == m_options) return;
+
+	Clear();
+	m_text = text;
+	m_options = options;
+	if (m_text.empty()) return;
+
+	const bool matchcase = (m_options & FIND_MATCHCASE) != 0;
+	m_pattern.wholeWord = m_wholeWord;
+
+	if (m_options & FIND_USE_REGEX) {
+		int regexOptions = PCRE_UTF8|PCRE_MULTILINE;
+		if (!matchcase) regexOptions |= PCRE_CASELESS;
+
+		m_pattern.isRegex = true;
+		m_pattern.regex = RegexCache::Get().Lookup(m_text, regexOptions);
+		m_hasPattern = m_pattern.regex.IsOk();
+	}
+	else {
+		// Caseless search needs upper- & lowercase versions (with same byte length)
+		const wxCharBuffer lower = wxConvUTF8.cWC2MB(matchcase ? m_text : m_text.Lower());
+		const wxCharBuffer upper = wxConvUTF8.cWC2MB(m_text.Upper());
+		const size_t len = strlen(lower);
+		const bool useUpper = !matchcase && strlen(upper) == len;
+
+		m_pattern.literal.Set(lower.data(), useUpper ? upper.data() : NULL, len);
+		m_hasPattern = !m_pattern.literal.IsEmpty();
 	}
 }
 
@@ -64,7 +98,7 @@ void Styler_SearchHL::Style(StyleRun& sr) {
 	}
 
 	// No need for more styling if no search text
-	if (m_text.empty()) return;
+	if (!m_hasPattern) return;
 
 	// Extend stylerun start/end to get better search results (round up to whole EXTSIZEs)
 	unsigned int sr_start = rstart> 100 ? rstart - 100 : 0;
@@ -77,45 +111,23 @@ void Styler_SearchHL::Style(StyleRun& sr) {
 		if (sr_end != m_lines.GetLength()) sr_end = doc.GetValidCharPos(sr_end);
 	cxENDLOCK
 
-	//wxLogDebug("Style %u %u", rstart, rend);
-	//wxLogDebug(" %u %u - %u %u", sr_start, sr_end, m_search_start, m_search_end);
-	// Check if we need to do a new search
-	if (sr_start < m_search_start || m_search_end < sr_end) {
-		// Check if there is overlap so we can just extend the search area
-		if (sr_end > m_search_start && sr_start < m_search_end) {
-			sr_start = wxMin(sr_start, m_search_start);
-			sr_end = wxMax(sr_end, m_search_end);
-		}
-		else {
-			// Else we have to move it
-			m_matches.clear();
-			m_search_start = 0;
-			m_search_end = 0;
-		}
-
-		// Do the search
-		if (sr_start < m_search_start) {
-			// Search from top
-			DoSearch(sr_start, sr_end);
-		}
-		else if (sr_end > m_search_end) {
-			// Search from bottom
-			DoSearch(sr_start, sr_end, true);
-		}
-		else wxASSERT(false);
-
-		m_search_start = sr_start;
-		m_search_end = sr_end;
+	// Search the parts that the background search has not got to yet
+	unsigned int search_start = sr_start;
+	unsigned int search_end;
+	while (FindUnsearched(search_start, sr_end, search_start, search_end)) {
+		SearchRange(search_start, search_end);
+		search_start = search_end;
 	}
 
 	// Style the run with matches
-	for (vector<interval>::iterator p = m_matches.begin(); p != m_matches.end(); ++p) {
-		if (p->start > rend) break;
+	for (unsigned int i = m_matches.FindEnd(rstart); i < m_matches.GetCount(); ++i) {
+		const interval p = m_matches.Get(i);
+		if (p.start > rend) break;
 
 		// Check for overlap (or zero-length sel at start-of-line)
-		if ((p->end > rstart && p->start < rend) || (p->start == p->end && p->end == rstart)) {
-			unsigned int start = wxMax(rstart, p->start);
-			unsigned int end   = wxMin(rend, p->end);
+		if ((p.end > rstart && p.start < rend) || (p.start == p.end && p.end == rstart)) {
+			unsigned int start = wxMax(rstart, p.start);
+			unsigned int end   = wxMin(rend, p.end);
 
 			// Only draw it if it is in range
 			if (!m_searchRanges.empty()) {
@@ -139,176 +151,336 @@ void Styler_SearchHL::ApplyStyle(StyleRun& sr, unsigned int start, unsigned int
 	sr.SetShowHidden(start, end, true);
 }
 
-void Styler_SearchHL::DoSearch(unsigned int start, unsigned int end, bool from_last) {
-	wxASSERT(0 <= start && start < m_doc.GetLength());
-	wxASSERT(start < end && end <= m_doc.GetLength());
+void Styler_SearchHL::SearchRange(unsigned int start, unsigned int end) {
+	// Matches do not overlap, so we continue after any match containing start
+	const unsigned int searchStart = GetSearchStart(start);
 
-	bool matchcase = m_options & FIND_MATCHCASE;
+	vector<interval> matches;
+	if (searchStart < end) {
+		unsigned int textStart;
+		unsigned int docLen;
+		cxLOCKDOC_READ(m_doc)
+			textStart = ReadText(doc, searchStart, end, m_buffer);
+			docLen = doc.GetLength();
+		cxENDLOCK
 
-	vector<interval>::iterator next_match = m_matches.begin();
-	if (from_last) {
-		// Start search from last match
-		if (!m_matches.empty())	start = m_matches.back().end;
+		Search(m_pattern, m_buffer, textStart, searchStart, end, docLen, matches);
 	}
-	else {
-		// Find the match before start pos (if there is any)
-		for (; next_match != m_matches.end(); ++next_match) {
-			if (next_match->end > start) break;
+
+	AddMatches(start, end, matches);
+}
+
+unsigned int Styler_SearchHL::GetSearchStart(unsigned int pos) const {
+	const unsigned int index = m_matches.FindEnd(pos+1);
+	if (index < m_matches.GetCount()) {
+		const interval iv = m_matches.Get(index);
+		if (iv.start < pos) return iv.end;
+	}
+	return pos;
+}
+
+unsigned int Styler_SearchHL::ReadText(const Document& doc, unsigned int start, unsigned int end, vector<char>& text) const {
+	// Include the chars around the range for word boundaries, and
+	// enough text after it to find matches crossing the end
+	const unsigned int docLen = doc.GetLength();
+	const unsigned int ext = (m_pattern.isRegex ? EXTSIZE : m_pattern.literal.Length()) + CONTEXTSIZE;
+
+	unsigned int textStart = start > CONTEXTSIZE ? doc.GetValidCharPos(start - CONTEXTSIZE) : 0;
+	if (textStart > start) textStart = start;
+	unsigned int textEnd = end + ext < docLen ? doc.GetValidCharPos(end + ext) : docLen;
+	if (textEnd < end) textEnd = end;
+
+	doc.GetTextPart(textStart, textEnd, text);
+	return textStart;
+}
+
+void Styler_SearchHL::AddMatches(unsigned int start, unsigned int end, const vector<interval>& matches) {
+	const unsigned int replaceEnd = m_matches.Replace(start, end, matches);
+	MarkSearched(start, end);
+
+	// If old matches after the range were replaced, the
+	// text following them has to be searched again
+	if (replaceEnd > end) MarkUnsearched(end, replaceEnd);
+}
+
+bool Styler_SearchHL::FindUnsearched(unsigned int pos, unsigned int limit, unsigned int& start, unsigned int& end) const {
+	for (vector<interval>::const_iterator p = m_searched.begin(); p != m_searched.end() && pos < limit; ++p) {
+		if (p->end <= pos) continue;
+		if (p->start > pos) {
+			start = pos;
+			end = wxMin(p->start, limit);
+			return true;
 		}
+		pos = p->end;
 	}
 
-	//wxLogDebug("  DoSearch %u %u %d", start, end, from_last);
+	if (pos >= limit) return false;
+	start = pos;
+	end = limit;
+	return true;
+}
 
-	// Search from start until we hit a previous match (or end)
-	search_result result = {-1, 0, start};
-	while(result.end < end) {
-		bool skip = false;
-		cxLOCKDOC_READ(m_doc)
-			if (m_options & FIND_USE_REGEX) result = doc.RegExFind(m_text, result.end, matchcase, NULL, end);
-			else result = doc.Find(m_text, result.end, matchcase, end);
-			
-			skip = !FilterMatch(result, doc);
-		cxENDLOCK
+void Styler_SearchHL::MarkSearched(unsigned int start, unsigned int end) {
+	if (start >= end) return;
+
+	// Merge with the ranges it touches
+	vector<interval>::iterator p = m_searched.begin();
+	while (p != m_searched.end() && p->end < start) ++p;
+	vector<interval>::iterator last = p;
+	while (last != m_searched.end() && last->start <= end) {
+		start = wxMin(start, last->start);
+		end = wxMax(end, last->end);
+		++last;
+	}
 
-		if (result.error_code < 0 || result.start >= end) break;
-
-		if(!skip) {
-			// Add new match to list
-			const interval iv(result.start, result.end);
-			if (from_last) m_matches.push_back(iv);
-			else {
-				// Check if we have hit a previous match
-				while (next_match != m_matches.end() && result.end > next_match->start) {
-					// if not equivalent, replace and continue
-					if (next_match->start == result.start && next_match->end == result.end)	break;
-					next_match = m_matches.erase(next_match);
-				}
-	
-				next_match = m_matches.insert(next_match, iv);
-				++next_match;
-			}
+	p = m_searched.erase(p, last);
+	m_searched.insert(p, interval(start, end));
+}
+
+void Styler_SearchHL::MarkUnsearched(unsigned int start, unsigned int end) {
+	if (start >= end) return;
+
+	for (vector<interval>::iterator p = m_searched.begin(); p != m_searched.end();) {
+		if (p->start >= end) break;
+		if (p->end <= start) {++p; continue;}
+
+		if (p->start < start && p->end > end) {
+			// Split range
+			const interval tail(end, p->end);
+			p->end = start;
+			m_searched.insert(p+1, tail);
+			break;
 		}
 
-		// Avoid never ending loop if zero-length match
-		if (result.start == result.end) ++result.end;
+		if (p->start < start) {p->end = start; ++p;}
+		else if (p->end > end) {p->start = end; break;}
+		else p = m_searched.erase(p);
 	}
 }
 
+void Styler_SearchHL::UnsearchEdit(unsigned int start, unsigned int end) {
+	// Matches may change in the edited lines, and literal
+	// matches may cross them
+	const unsigned int len = m_lines.GetLength();
+	if (!m_pattern.isRegex) {
+		const unsigned int patternLen = m_pattern.literal.Length();
+		start = start > patternLen ? start - patternLen : 0;
+		end = wxMin(end + patternLen, len);
+	}
+	start = m_lines.GetLineStartFromPos(start);
+	end = m_lines.GetLineEndFromPos(end);
+	if (end < len) ++end; // for word boundaries
+
+	MarkUnsearched(start, end);
+}
+
 void Styler_SearchHL::Insert(unsigned int pos, unsigned int length) {
 	wxASSERT(0 <= pos && pos < m_doc.GetLength());
 	wxASSERT(0 <= length && pos+length <= m_doc.GetLength());
-	if (m_text.empty()) return;
-
-	// Adjust start & end
-	if (m_search_start >= pos) m_search_start += length;
-	if (m_search_end > pos)	m_search_end += length;
-	else return; // Change outside search area
-
-	unsigned int search_start = m_search_start;
+	if (!m_hasPattern) return;
+	++m_generation; // results from search thread are now out of date
 
-	if (!m_matches.empty()) {
-		if (pos >= m_matches.back().end) {
-			// Do a new search from end of last match
-			DoSearch(search_start, m_search_end, true);
-			return;
-		}
-
-		// Find first match containing or bigger than pos
-		bool is_first = true;
-		vector<interval>::iterator p = m_matches.begin();
-		while (p != m_matches.end()) {
-			if (p->end > pos) {
-				// Remember first valid match before pos
-				if (is_first) {
-					if (p != m_matches.begin()) search_start = (p-1)->end;
-					is_first = false;
-				}
+	m_matches.Insert(pos, length);
 
-				if (p->start < pos) {
-					// pos inside match. Delete and continue
-					p = m_matches.erase(p);
-					if (p != m_matches.end()) continue; // new iterator
-					else break;
-				}
-				else {
-					// Move match to correct position
-					p->start += length;
-					p->end += length;
-				}
-			}
-			++p;
-		}
+	// Move searched ranges
+	for (vector<interval>::iterator p = m_searched.begin(); p != m_searched.end(); ++p) {
+		if (p->start >= pos) p->start += length;
+		if (p->end >= pos) p->end += length;
 	}
 
-	// Do a new search starting from end of first match before pos
-	DoSearch(search_start, m_search_end, false);
+	UnsearchEdit(pos, pos + length);
 }
 
 void Styler_SearchHL::Delete(unsigned int start_pos, unsigned int end_pos) {
 	wxASSERT(0 <= start_pos && start_pos <= m_doc.GetLength());
-	if (m_text.empty()) return;
+	if (!m_hasPattern) return;
 
 	if (start_pos == end_pos) return;
 	wxASSERT(end_pos > start_pos);
 
 	// Check if we have deleted the entire document
-	if (m_doc.GetLength() == 0) {
+	if (m_lines.GetLength() == 0) {
 		Invalidate();
 		return;
 	}
+	++m_generation; // results from search thread are now out of date
 
-	// Adjust start & end
-	unsigned int length = end_pos - start_pos;
-	if (m_search_start >= start_pos) {
-		if (m_search_start > end_pos) m_search_start -= length;
-		else m_search_start = start_pos;
-	}
-	if (m_search_end > start_pos) {
-		if (m_search_end > end_pos) m_search_end -= length;
-		else m_search_end = start_pos;
+	m_matches.Delete(start_pos, end_pos);
+
+	// Move searched ranges (dropping the ones that were deleted)
+	const unsigned int length = end_pos - start_pos;
+	for (vector<interval>::iterator p = m_searched.begin(); p != m_searched.end();) {
+		if (p->start >= end_pos) p->start -= length;
+		else if (p->start > start_pos) p->start = start_pos;
+		if (p->end >= end_pos) p->end -= length;
+		else if (p->end > start_pos) p->end = start_pos;
+
+		if (p->start == p->end) p = m_searched.erase(p);
+		else ++p;
 	}
-	else return; // Change after search area, no need to re-search
 
-	unsigned int search_start = m_search_start;
+	UnsearchEdit(start_pos, start_pos);
+}
+
+void Styler_SearchHL::ApplyDiff(const vector<cxChange>& WXUNUSED(changes)) {
+	Invalidate();
+}
+
+bool Styler_SearchHL::OnIdle() {
+	if (!m_hasPattern) return false;
 
-	if (!m_matches.empty()) {
-		if (start_pos >= m_matches.back().end) {
-			// Do a new search from end of last match
-			DoSearch(search_start, m_search_end, true);
-			return;
+	// Add the results from the search thread
+	{
+		wxCriticalSectionLocker lock(m_jobLock);
+		if (m_jobState == JOB_PENDING) return false;
+		if (m_jobState == JOB_DONE) {
+			if (m_job.generation == m_generation) AddMatches(m_job.start, m_job.end, m_job.matches);
+			m_jobState = JOB_NONE;
 		}
+	}
 
-		// Find matches touched by deletion and remove those. Update all following
-		bool is_first = true;
-		vector<interval>::iterator p = m_matches.begin();
-		while (p != m_matches.end()) {
-			if (p->end > start_pos) {
-				// Remember first valid match before pos
-				if (is_first) {
-					if (p != m_matches.begin()) search_start = (p-1)->end;
-					is_first = false;
-				}
+	StartBackgroundSearch();
+	return false; // search thread wakes us up when done
+}
 
-				if (p->start < end_pos) {
-					// pos inside match. Delete and continue
-					p = m_matches.erase(p);
-					if (p != m_matches.end()) continue; // new iterator
-					else break;
-				}
-				else {
-					// Move match to correct position
-					p->start -= length;
-					p->end -= length;
-				}
+void Styler_SearchHL::StartBackgroundSearch() {
+	if (m_noBackground) return;
+
+	const unsigned int docLen = m_lines.GetLength();
+	unsigned int start = 0;
+	unsigned int end;
+	unsigned int searchStart;
+	for (;;) {
+		// Find the next part of the document that has not been searched
+		if (!FindUnsearched(start, docLen, start, end)) return;
+		const bool isSplit = end > start + BGCHUNKSIZE;
+
+		// Take a snapshot of the text (the thread does not touch the job until pending)
+		cxLOCKDOC_READ(m_doc)
+			if (isSplit) end = doc.GetValidCharPos(start + BGCHUNKSIZE);
+			searchStart = GetSearchStart(start);
+			if (searchStart < end) m_job.textStart = ReadText(doc, searchStart, end, m_job.text);
+		cxENDLOCK
+
+		if (searchStart < end) break;
+		AddMatches(start, end, vector<interval>()); // inside last match
+		start = end;
+	}
+
+	m_job.pattern = m_pattern;
+	m_job.start = start;
+	m_job.searchStart = searchStart;
+	m_job.end = end;
+	m_job.docLen = docLen;
+	m_job.generation = m_generation;
+	m_job.matches.clear();
+
+	{
+		wxCriticalSectionLocker lock(m_jobLock);
+		m_jobState = JOB_PENDING;
+	}
+
+	// The worker is started on first use
+	if (!m_runner.Add(1, OnRunJob, this)) {
+		wxLogDebug(wxT("Styler_SearchHL: Could not start search thread"));
+		m_noBackground = true;
+
+		wxCriticalSectionLocker lock(m_jobLock);
+		m_jobState = JOB_NONE;
+	}
+}
+
+// static
+void Styler_SearchHL::OnRunJob(void* data, unsigned int WXUNUSED(index)) {
+	// Called from the search thread
+	Styler_SearchHL& styler = *(Styler_SearchHL*)data;
+	{
+		wxCriticalSectionLocker lock(styler.m_jobLock);
+		if (styler.m_jobState != JOB_PENDING) return;
+	}
+
+	// The job is ours until we set it as done
+	Job& job = styler.m_job;
+	Search(job.pattern, job.text, job.textStart, job.searchStart, job.end, job.docLen, job.matches);
+
+	{
+		wxCriticalSectionLocker lock(styler.m_jobLock);
+		styler.m_jobState = JOB_DONE;
+	}
+	wxWakeUpIdle();
+}
+
+void Styler_SearchHL::Search(const Pattern& pattern, const vector<char>& text, unsigned int textStart, unsigned int start, unsigned int end, unsigned int docLen, vector<interval>& matches) { // static
+	if (text.empty()) return;
+	const char* const subject = &*text.begin();
+	const unsigned int textLen = text.size();
+
+	if (!pattern.isRegex) {
+		const size_t len = pattern.literal.Length();
+		const char* p = subject + (start - textStart);
+		const char* const subjectEnd = subject + textLen;
+
+		while (const char* match = pattern.literal.Find(p, subjectEnd)) {
+			const unsigned int offset = match - subject;
+			if (textStart + offset >= end) break;
+
+			if (!pattern.wholeWord || IsWholeWord(text, offset, offset + len)) {
+				matches.push_back(interval(textStart + offset, textStart + offset + len));
 			}
-			++p;
+			p = match + len;
 		}
+		return;
 	}
 
-	// Do a new search starting from end of first match before pos
-	DoSearch(search_start, m_search_end, false);
+	// Text outside the buffer is not start or end of a line
+	int options = PCRE_NO_UTF8_CHECK;
+	if (textStart > 0) options |= PCRE_NOTBOL;
+	if (textStart + textLen < docLen) options |= PCRE_NOTEOL;
+
+	const int OVECCOUNT = 30;
+	int ovector[OVECCOUNT];
+	unsigned int offset = start - textStart;
+	while (offset <= textLen) {
+		const int rc = pcre_exec(pattern.regex.GetPattern(), pattern.regex.GetStudy(), subject, textLen, offset, options, ovector, OVECCOUNT);
+		if (rc < 0 || textStart + ovector[0] >= end) break;
+
+		if (!pattern.wholeWord || IsWholeWord(text, ovector[0], ovector[1])) {
+			matches.push_back(interval(textStart + ovector[0], textStart + ovector[1]));
+		}
+
+		// Avoid never ending loop if zero-length match
+		offset = ovector[1];
+		if (ovector[0] == ovector[1]) {
+			++offset;
+			while (offset < textLen && (subject[offset] & 0xC0) == 0x80) ++offset;
+		}
+	}
 }
 
-void Styler_SearchHL::ApplyDiff(const vector<cxChange>& WXUNUSED(changes)) {
-	Invalidate();
+/**
+ * say we search for the variable var..
+ * We want to filter out matches like these:
+     variable
+	 avar
+	 a_var
+ * But allow matches like these:
+   var.method();
+   function(var);
+   var+2;
+ */
+bool Styler_SearchHL::IsWholeWord(const vector<char>& text, unsigned int start, unsigned int end) { // static
+	const char* const subject = &*text.begin();
+	unsigned int len;
+
+	if (start > 0) {
+		// Find start of previous char
+		unsigned int prev = start - 1;
+		while (prev > 0 && start - prev < CONTEXTSIZE && (subject[prev] & 0xC0) == 0x80) --prev;
+		if (WordIndex::IsWordChar(WordIndex::DecodeChar(subject + prev, subject + start, len))) return false;
+	}
+	if (end < text.size()) {
+		if (WordIndex::IsWordChar(WordIndex::DecodeChar(subject + end, subject + text.size(), len))) return false;
+	}
+
+	return true;
 }
@@ -22,7 +22,12 @@
 
 #include "Catalyst.h"
 #include "styler.h"
+#include "MatchIndex.h"
+#include "LiteralMatcher.h"
+#include "RegexCache.h"
+#include "TaskRunner.h"
 
+#include <wx/thread.h>
 #include <vector>
 
 
@@ -31,15 +36,22 @@ class StyleRun;
 struct tmTheme;
 class Lines;
 
+// Highlights all matches of the search text.
+//
+// The visible text is searched when it is styled, and the rest of the
+// document is searched in the background, in chunks handed to a worker
+// thread on idle. The matches are kept in a MatchIndex, so that edits
+// just shift them and only the text around the edit is searched again.
 class Styler_SearchHL : public Styler {
 public:
 	Styler_SearchHL(const DocumentWrapper& rev, const Lines& lines, const std::vector<interval>& ranges, const tmTheme& theme);
-	virtual ~Styler_SearchHL() {};
+	virtual ~Styler_SearchHL();
 
 	void Clear();
 	void Invalidate();
 	void SetSearch(const wxString& text, int options);
 	virtual void Style(StyleRun& sr);
+	virtual bool OnIdle();
 
 	// Handle document changes
 	virtual void Insert(unsigned int pos, unsigned int length);
@@ -47,18 +59,65 @@ public:
 	virtual void ApplyDiff(const std::vector<cxChange>& changes);
 	
 	virtual void ApplyStyle(StyleRun& sr, unsigned int start, unsigned int pos);
-	virtual bool FilterMatch(search_result& WXUNUSED(result), const Document& WXUNUSED(doc)) { return true; }
-	
 
 protected:
-	void DoSearch(unsigned int start, unsigned int end, bool from_last=false);
+	// The compiled search text (copied to the search thread)
+	struct Pattern {
+		Pattern() : isRegex(false), wholeWord(false) {};
+		LiteralMatcher literal;
+		CompiledRegex regex;
+		bool isRegex;
+		bool wholeWord; // skip matches inside other words
+	};
+
+	// A chunk of text to search in the background
+	struct Job {
+		Pattern pattern;
+		std::vector<char> text;
+		unsigned int textStart;
+		unsigned int start;
+		unsigned int searchStart; // after match containing start
+		unsigned int end;
+		unsigned int docLen;
+		unsigned int generation;
+		std::vector<interval> matches;
+	};
+
+	enum JobState {
+		JOB_NONE,
+		JOB_PENDING, // owned by search thread
+		JOB_DONE
+	};
+
+	void SearchRange(unsigned int start, unsigned int end);
+	unsigned int GetSearchStart(unsigned int pos) const;
+	unsigned int ReadText(const Document& doc, unsigned int start, unsigned int end, std::vector<char>& text) const;
+	void AddMatches(unsigned int start, unsigned int end, const std::vector<interval>& matches);
+
+	// Searched ranges
+	bool FindUnsearched(unsigned int pos, unsigned int limit, unsigned int& start, unsigned int& end) const;
+	void MarkSearched(unsigned int start, unsigned int end);
+	void MarkUnsearched(unsigned int start, unsigned int end);
+	void UnsearchEdit(unsigned int start, unsigned int end);
+
+	// Background search
+	void StartBackgroundSearch();
+	static void OnRunJob(void* data, unsigned int index); // called from runner
+
+	static void Search(const Pattern& pattern, const std::vector<char>& text, unsigned int textStart, unsigned int start, unsigned int end, unsigned int docLen, std::vector<interval>& matches);
+	static bool IsWholeWord(const std::vector<char>& text, unsigned int start, unsigned int end);
 
 	// Member variables
 	const DocumentWrapper& m_doc;
 	const Lines& m_lines;
 	wxString m_text;
 	int m_options;
-	std::vector<interval> m_matches;
+	bool m_wholeWord;
+	Pattern m_pattern;
+	bool m_hasPattern;
+	MatchIndex m_matches;
+	std::vector<interval> m_searched; // sorted and non-overlapping
+	std::vector<char> m_buffer;
 	const std::vector<interval>& m_searchRanges;
 
 	// Theme variables
@@ -66,9 +125,17 @@ protected:
 	const wxColour& m_hlcolor;
 	const wxColour& m_rangeColor;
 
-	unsigned int m_search_start;
-	unsigned int m_search_end;
+	// Background search (m_jobState guarded by m_jobLock)
+	TaskRunner m_runner;
+	bool m_noBackground;
+	wxCriticalSection m_jobLock;
+	JobState m_jobState;
+	Job m_job;
+	unsigned int m_generation;
+
 	static const unsigned int EXTSIZE;
+	static const unsigned int CONTEXTSIZE;
+	static const unsigned int BGCHUNKSIZE;
 };
 
 #endif // __STYLER_SEARCHHL_H__
@@ -14,6 +14,7 @@
 #include "styler_syntax.h"
 
 #include <algorithm>
+#include <wx/thread.h>
 
 #include "StyleRun.h"
 #include "Document.h"
@@ -24,9 +25,19 @@
 #include "pcre.h"
 
 const unsigned int Styler_Syntax::EXTSIZE = 1000;
+const unsigned int Styler_Syntax::BGMINSIZE = 64*1024;
+const unsigned int Styler_Syntax::BGCHUNKSIZE = 1024*1024;
+const unsigned int Styler_Syntax::BGSLICESIZE = 16*1024;
+const unsigned int Styler_Syntax::NOTDEFERRED = (unsigned int)-1;
+const unsigned int Styler_Syntax::REPARSESIZE = 16*1024;
+
+FixedPool Styler_Syntax::s_matchPool(sizeof(Styler_Syntax::stxmatch));
+FixedPool Styler_Syntax::s_submatchPool(sizeof(Styler_Syntax::submatch));
 
 Styler_Syntax::Styler_Syntax(const DocumentWrapper& dw, Lines& lines, TmSyntaxHandler* syntaxHandler)
-: m_doc(dw), m_syntaxHandler(syntaxHandler), m_lines(lines), m_syntax_end(0), m_updateLineHeight(false) {
+: m_doc(dw), m_syntaxHandler(syntaxHandler), m_lines(lines), m_syntax_end(0), m_updateLineHeight(false), m_parsedEnd(0),
+  m_runner(1), m_noBackground(false), m_snapshotStart(0), m_snapshotEnd(0), m_snapshotGeneration(0), m_redrawPos(0),
+  m_deferredStart(NOTDEFERRED), m_topStack(ScopeAtoms::EMPTYSTACK), m_stackGeneration(0) {
 	m_topMatches.subMatcher = NULL;
 	m_topStyle = NULL;
 
@@ -35,24 +46,54 @@ Styler_Syntax::Styler_Syntax(const DocumentWrapper& dw, Lines& lines, TmSyntaxHa
 #endif
 }
 
+Styler_Syntax::~Styler_Syntax() {
+	// The worker may be in the middle of a slice, so we
+	// have to wait for it without holding the lock
+	m_runner.Cancel();
+	m_runner.Wait();
+
+	Clear();
+}
+
 bool Styler_Syntax::IsParsed() const {
-	return !IsOk() || m_syntax_end == m_doc.GetLength();
+	return !IsOk() || m_parsedEnd == m_doc.GetLength();
+}
+
+unsigned int Styler_Syntax::GetLastParsedPos() const {
+	return m_parsedEnd;
 }
 
 void Styler_Syntax::Clear() {
+	RecursiveCriticalSectionLocker lock(m_syntaxHandler->GetParseLock());
+	RecursiveCriticalSectionLocker treeLock(m_treeLock);
+
 	Invalidate();
 	m_topMatches.subMatcher = NULL;
 	m_topStyle = NULL;
 	m_syntaxName.Clear();
+	m_stackGeneration = 0; // the top scope changes with the syntax
 }
 
 void Styler_Syntax::Invalidate() {
+	RecursiveCriticalSectionLocker lock(m_syntaxHandler->GetParseLock());
+	RecursiveCriticalSectionLocker treeLock(m_treeLock);
+
+	CancelBackgroundParse();
 	m_topMatches.flags = 0;
 	m_topMatches.matches.clear();
 	m_syntax_end = 0;
+	m_parsedEnd = 0;
+	m_deferredStart = NOTDEFERRED;
+
+	// Give the memory back if no document has a match tree left
+	s_matchPool.Release();
+	s_submatchPool.Release();
 }
 
 void Styler_Syntax::ReStyle() {
+	RecursiveCriticalSectionLocker lock(m_syntaxHandler->GetParseLock());
+	RecursiveCriticalSectionLocker treeLock(m_treeLock);
+
 	// Check if base syntax has a style
 	// (disabled until styles get more dynamic handling of transparency)
 	/*const wxString& topScope = m_topMatches.subMatcher->GetName();
@@ -63,9 +104,29 @@ void Styler_Syntax::ReStyle() {
 	}*/
 
 	// Style matches
+	UpdateStackIds();
 	ReStyleSub(m_topMatches);
 }
 
+void Styler_Syntax::UpdateStackIds() {
+	// Themes and bundles may have been reloaded since we last parsed
+	const unsigned int generation = ScopeAtoms::GetGeneration();
+	if (generation == m_stackGeneration || !m_topMatches.subMatcher) return;
+
+	m_topStack = ScopeAtoms::PushScope(ScopeAtoms::EMPTYSTACK, m_topMatches.subMatcher->GetScopeId());
+	UpdateSubStackIds(m_topMatches, m_topStack);
+	m_stackGeneration = generation;
+}
+
+void Styler_Syntax::UpdateSubStackIds(const submatch& sm, unsigned int parentStack) {
+	for (auto_vector<stxmatch>::const_iterator p = sm.matches.begin(); p != sm.matches.end(); ++p) {
+		stxmatch& m = *(*p);
+		m.stackId = ScopeAtoms::PushScope(parentStack, m.scopeId);
+
+		if (m.subMatch.get()) UpdateSubStackIds(*m.subMatch, m.stackId);
+	}
+}
+
 void Styler_Syntax::ReStyleSub(const submatch& sm) {
 	for (auto_vector<stxmatch>::const_iterator p = sm.matches.begin(); p != sm.matches.end(); ++p) {
 		stxmatch& m = *(*p);
@@ -80,6 +141,9 @@ void Styler_Syntax::ReStyleSub(const submatch& sm) {
 }
 
 bool Styler_Syntax::UpdateSyntax() {
+	RecursiveCriticalSectionLocker lock(m_syntaxHandler->GetParseLock());
+	RecursiveCriticalSectionLocker treeLock(m_treeLock);
+
 	const cxSyntaxInfo* si = m_syntaxHandler->GetSyntax(m_doc);
 	if (!si) return false; // No new syntax found
 
@@ -93,6 +157,9 @@ bool Styler_Syntax::UpdateSyntax() {
 }
 
 void Styler_Syntax::SetSyntax(const wxString& syntaxName, const wxString& ext) {
+	RecursiveCriticalSectionLocker lock(m_syntaxHandler->GetParseLock());
+	RecursiveCriticalSectionLocker treeLock(m_treeLock);
+
 	const cxSyntaxInfo* si = m_syntaxHandler->GetSyntax(syntaxName, ext);
 	if (!si) {
 		wxASSERT(false);
@@ -121,7 +188,8 @@ const deque<const wxString*> Styler_Syntax::GetScope(unsigned int pos) {
 	if(!HaveActiveSyntax()) return deque<const wxString*>();
 
 	// Make sure the syntax is valid
-	ParseTo(pos);
+	if (pos > m_parsedEnd) ParseTo(pos);
+	RecursiveCriticalSectionLocker treeLock(m_treeLock);
 
 	deque<const wxString*> scopes;
 	const wxString& topScope = m_topMatches.subMatcher->GetName();
@@ -153,6 +221,7 @@ void Styler_Syntax::GetSubScope(unsigned int pos, const submatch& sm, deque<cons
 
 const deque<interval> Styler_Syntax::GetScopeIntervals(unsigned int pos) const {
 	wxASSERT(pos <= m_doc.GetLength());
+	RecursiveCriticalSectionLocker treeLock(m_treeLock);
 	if(!HaveActiveSyntax()) return deque<interval>();
 
 	deque<interval> scopes;
@@ -186,23 +255,12 @@ void Styler_Syntax::GetSubScopeIntervals(unsigned int pos, unsigned int offset,
 }
 
 const style* Styler_Syntax::GetStyle(stxmatch& m) const {
-	// Build the list of scopes
-	deque<const wxString*> scopes;
-	if (!m.m_name.empty()) scopes.push_back(&m.m_name);
-	const stxmatch* p = m.parent;
-	while (p) {
-		if (!p->m_name.empty()) {
-			scopes.push_front(&p->m_name);
-		}
-		p = p->parent;
-	}
+	// The stack of the match is that of its parent (which is
+	// always styled first) with the scope of the match added
+	const unsigned int parentStack = m.parent ? m.parent->stackId : m_topStack;
+	m.stackId = ScopeAtoms::PushScope(parentStack, m.scopeId);
 
-	const wxString& topScope = m_topMatches.subMatcher->GetName();
-	if (!topScope.empty()) {
-		scopes.push_front(&topScope);
-	}
-
-	const style* st = m_syntaxHandler->GetStyle(scopes);
+	const style* st = m_syntaxHandler->GetStyle(m.stackId);
 	return st;
 }
 
@@ -211,10 +269,13 @@ void Styler_Syntax::GetTextWithScopes(unsigned int start, unsigned int end, vect
 	wxASSERT(end <= m_doc.GetLength());
 
 	// Make sure syntax is valid
-	if (m_syntax_end < end) {
-		DoSearch(m_syntax_end, end, end);
+	if (m_parsedEnd < end) {
+		RecursiveCriticalSectionLocker lock(m_syntaxHandler->GetParseLock());
+		RecursiveCriticalSectionLocker treeLock(m_treeLock);
+		if (m_syntax_end < end) DoSearch(m_syntax_end, end, end);
 	}
 
+	RecursiveCriticalSectionLocker treeLock(m_treeLock);
 	text.reserve((end - start) * 2);
 
 	// Start tag
@@ -305,6 +366,7 @@ void Styler_Syntax::XmlText(unsigned int offset, const submatch& sm, unsigned in
 }
 
 void Styler_Syntax::GetSymbols(vector<SymbolRef>& symbols) const {
+	RecursiveCriticalSectionLocker treeLock(m_treeLock);
 	if(!HaveActiveSyntax()) return;
 
 	deque<const wxString*> scopes;
@@ -359,27 +421,43 @@ void Styler_Syntax::GetSubSymbols(unsigned int offset, const submatch& sm, deque
 }
 
 void Styler_Syntax::Style(StyleRun& sr) {
+	// The syntax is only set from the gui thread, so it can be checked without locking
 	if (!HaveActiveSyntax()) return;
 
 	unsigned int sr_end = sr.GetRunEnd();
 
-	// Check if we need to do a new search
-	if (sr_end > m_syntax_end) {
-		// Make sure the extended position is valid and extends
-		// from start-of-line to end-of-line
-		unsigned int sr_start;
-		cxLOCKDOC_READ(m_doc)
-			sr_start = doc.GetLineStart(m_syntax_end);
-		cxENDLOCK
+	// Check if we need to do a new search (drawing text that is already parsed,
+	// or that the background parser will redraw, does not have to wait for
+	// the parsing of other documents)
+	if (sr_end > m_parsedEnd && sr_end > m_redrawPos) {
+		RecursiveCriticalSectionLocker lock(m_syntaxHandler->GetParseLock());
+		RecursiveCriticalSectionLocker treeLock(m_treeLock);
+		if (sr_end > m_syntax_end) {
+			// Big gaps are left to the background parser, and the
+			// text is drawn unstyled until it has caught up
+			if (sr_end - m_syntax_end > BGMINSIZE && StartBackgroundParse()) {
+				if (sr_end > m_redrawPos) m_redrawPos = sr_end;
+			}
+			else {
+				// Make sure the extended position is valid and extends
+				// from start-of-line to end-of-line
+				unsigned int sr_start;
+				cxLOCKDOC_READ(m_doc)
+					sr_start = doc.GetLineStart(m_syntax_end);
+				cxENDLOCK
 
-		// Extend stylerun to get better search results (round up to whole EXTSIZEs)
-		const unsigned int ext = ((sr_end / EXTSIZE) + 1) * EXTSIZE;
-		sr_end =  ext < m_lines.GetLength() ? ext : m_lines.GetLength();
-		sr_end = m_lines.GetLineEndFromPos(sr_end);
+				// Extend stylerun to get better search results (round up to whole EXTSIZEs)
+				const unsigned int ext = ((sr_end / EXTSIZE) + 1) * EXTSIZE;
+				sr_end =  ext < m_lines.GetLength() ? ext : m_lines.GetLength();
+				sr_end = m_lines.GetLineEndFromPos(sr_end);
 
-		DoSearch(sr_start, sr_end, sr_end);
+				DoSearch(sr_start, sr_end, sr_end);
+			}
+		}
 	}
 
+	RecursiveCriticalSectionLocker treeLock(m_treeLock);
+
 	// Apply base style
 	if (m_topStyle) {
 		const unsigned int start =  sr.GetRunStart();
@@ -461,21 +539,64 @@ void Styler_Syntax::DoSearch(unsigned int start, unsigned int end, unsigned int
 		doc.GetTextPart(si.lineStart, si.lineEnd, si.line);
 	cxENDLOCK
 	si.lineLen = si.lineEnd - si.lineStart;
+	m_matchCache.LineChanged();
 	si.changeEnd = end;
 	si.limit = limit;
 	si.hitLimit = false;
 	si.done = false;
+	si.snapshot = NULL;
+	si.snapshotStart = si.snapshotEnd = 0;
 
 	//wxLogDebug(wxT("  si %u-%u-%u,%u"), si.pos,si.line_id, si.lineStart, si.lineEnd);
 
 	// Do the search
+	UpdateStackIds();
 	m_syntax_end = Search(m_topMatches, si, 0, m_syntax_end, NULL);
+	m_parsedEnd = m_syntax_end;
 
 #ifdef __WXDEBUG__
 	Verify();
 #endif  //__WXDEBUG__
 }
 
+void Styler_Syntax::GetSearchLine(SearchInfo& si) {
+	if (si.snapshot) {
+		// Lines in snapshots are only delimited by newlines
+		const char* const lineStart = si.snapshot + (si.lineStart - si.snapshotStart);
+		const char* const newline = (const char*)memchr(lineStart, '\n', si.snapshotEnd - si.lineStart);
+		si.lineEnd = newline ? si.lineStart + (newline - lineStart) + 1 : si.snapshotEnd;
+		si.line.assign(lineStart, lineStart + (si.lineEnd - si.lineStart));
+	}
+	else {
+		si.lineEnd = m_lines.GetLineEndpos(si.line_id, false);
+		cxLOCKDOC_READ(m_doc)
+			doc.GetTextPart(si.lineStart, si.lineEnd, si.line);
+		cxENDLOCK
+	}
+	si.lineLen = si.lineEnd - si.lineStart;
+	m_matchCache.LineChanged(); // drop cached match positions
+}
+
+bool Styler_Syntax::IsEndScope(const auto_vector<stxmatch>& matches, auto_vector<stxmatch>::const_iterator first, unsigned int pos) const {
+	const stxmatch target(wxEmptyString, NULL, 0, pos, NULL, NULL, NULL);
+	auto_vector<stxmatch>::const_iterator end_match = lower_bound(first, matches.end(), &target, stxmatch_end_less());
+
+	// We are only the endscope if pos is free and there is no open span
+	// bordering up to it.
+	return (end_match == matches.end() || (*end_match)->start >= pos ||
+		((*end_match)->end == pos && (!(*end_match)->subMatch.get() || (*end_match)->subMatch->flags & cxSPAN_IS_CLOSED)));
+}
+
+unsigned int Styler_Syntax::GetReparseLimit(unsigned int changeEnd) const {
+	// The syntax will usually converge with the old one shortly after the
+	// change. If it has not done so at the limit, the rest is dropped and
+	// parsed again later.
+	const unsigned int limit = wxMin(changeEnd + REPARSESIZE, wxMax(changeEnd, m_syntax_end));
+	if (limit == changeEnd) return changeEnd;
+
+	return m_lines.GetLineEndFromPos(limit);
+}
+
 unsigned int Styler_Syntax::Search(submatch& submatches, SearchInfo& si, unsigned int scopeStart, unsigned int scopeEnd, stxmatch* scope) {
 	const unsigned int adjPos = si.pos - scopeStart;
 	//const unsigned int adjEnd = si.changeEnd - scopeStart;
@@ -489,16 +610,7 @@ unsigned int Styler_Syntax::Search(submatch& submatches, SearchInfo& si, unsigne
 	// (if we contain changeEnd and has no submatches containing it)
 	bool isEndScope = false;
 	if (scopeStart < si.changeEnd && scopeEnd > si.changeEnd) {
-		m.end = si.changeEnd - scopeStart;
-		auto_vector<stxmatch>::iterator end_match = lower_bound(next_match, matches.end(), &m, stxmatch_end_less());
-
-		// We are only the endscope if changeEnd is free and there is no open span
-		// bordering up to it.
-		if (end_match == matches.end() || (*end_match)->start >= m.end ||
-			((*end_match)->end == m.end && (!(*end_match)->subMatch.get() || (*end_match)->subMatch->flags & cxSPAN_IS_CLOSED)))
-		{
-			isEndScope = true;
-		}
+		isEndScope = IsEndScope(matches, next_match, si.changeEnd - scopeStart);
 	}
 
 	// Check if we should enter and search inside match
@@ -583,6 +695,13 @@ unsigned int Styler_Syntax::Search(submatch& submatches, SearchInfo& si, unsigne
 			si.done = true;
 			return wxMax(scopeEnd, si.pos);
 		}
+		else if (!si.hitLimit && si.pos > si.changeEnd && si.pos == si.lineEnd &&
+				 scopeStart < si.pos && scopeEnd > si.pos && IsEndScope(matches, next_match, si.pos - scopeStart)) {
+			// Past the change the old matches act as checkpoints. As soon as
+			// a line ends in the same scope as before, the rest is still valid.
+			si.done = true;
+			return scopeEnd;
+		}
 		else if (si.pos >= si.limit) {
 			// If we hit limit before closing a span we have to keep it open
 			// and remove all following matches
@@ -595,18 +714,14 @@ unsigned int Styler_Syntax::Search(submatch& submatches, SearchInfo& si, unsigne
 			// Advance to next line
 			++si.line_id;
 			si.lineStart = si.lineEnd;
-			si.lineEnd = m_lines.GetLineEndpos(si.line_id, false);
-			cxLOCKDOC_READ(m_doc)
-				doc.GetTextPart(si.lineStart, si.lineEnd, si.line);
-			cxENDLOCK
-			si.lineLen = si.lineEnd - si.lineStart;
+			GetSearchLine(si);
 			zeromatch = -1;
 		}
 
 		// Do the search
 		const unsigned int offset = si.pos - si.lineStart;
 		unsigned int callout_id;
-		const int rc = subMatcher.Match(&*si.line.begin(), offset, si.lineLen, callout_id, ovector, OVECCOUNT, zeromatch);
+		const int rc = subMatcher.Match(&*si.line.begin(), offset, si.lineLen, callout_id, ovector, OVECCOUNT, zeromatch, m_matchCache);
 		zeromatch = -1;
 
 		if (rc < 0) {
@@ -680,7 +795,7 @@ unsigned int Styler_Syntax::Search(submatch& submatches, SearchInfo& si, unsigne
 				}
 				else {
 					// Create the new match
-					auto_ptr<stxmatch> iv(new stxmatch(m.GetName(), &m, matchStart, matchEnd, NULL, NULL, scope));
+					auto_ptr<stxmatch> iv(new stxmatch(m.GetName(), m.GetScopeId(), &m, matchStart, matchEnd, NULL, NULL, scope));
 
 					// Style It
 					iv->st = GetStyle(*iv);
@@ -751,7 +866,8 @@ void Styler_Syntax::AddCaptures(matcher& m, stxmatch& sm, unsigned int offset, c
 	for (unsigned int i = 1; (int)i < rc; ++i) {
 		if (ovector[2*i] == -1) continue;
 
-		const wxString& name = m.GetCaptureName(i);
+		unsigned int scopeId;
+		const wxString& name = m.GetCaptureName(i, scopeId);
 		if (name.empty()) continue;
 
 		const interval capiv(si.lineStart + ovector[2*i], si.lineStart + ovector[2*i+1]);
@@ -781,7 +897,7 @@ void Styler_Syntax::AddCaptures(matcher& m, stxmatch& sm, unsigned int offset, c
 		}
 
 		// Create the new match
-		auto_ptr<stxmatch> cap(new stxmatch(name, &m, cap_start, cap_end, NULL, NULL, &parent));
+		auto_ptr<stxmatch> cap(new stxmatch(name, scopeId, &m, cap_start, cap_end, NULL, NULL, &parent));
 
 		wxASSERT(capiv.end <= offset + sm.end);
 
@@ -813,7 +929,7 @@ void Styler_Syntax::CreateSpan(unsigned int starterStart, unsigned int starterEn
 		const unsigned int span_id = subMatcher.GetSubId(id);
 		matcher* const spanstarter = sm->GetStartMember(span_id);
 
-		auto_ptr<stxmatch> spanstart(new stxmatch(spanstarter->GetName(), spanstarter, 0, starterEnd - starterStart, NULL, NULL, scope));
+		auto_ptr<stxmatch> spanstart(new stxmatch(spanstarter->GetName(), spanstarter->GetScopeId(), spanstarter, 0, starterEnd - starterStart, NULL, NULL, scope));
 		spanstart->st = GetStyle(*spanstart); // style the match
 
 		// Check if the match has any captures
@@ -833,7 +949,7 @@ void Styler_Syntax::CreateSpan(unsigned int starterStart, unsigned int starterEn
 		const unsigned int contentStart = span_sub.matches.empty() ? 0 : span_sub.matches[0]->end;
 
 		// Create content span
-		auto_ptr<stxmatch> contentIv(new stxmatch(contentName, NULL, contentStart, contentStart, NULL, NULL, scope));
+		auto_ptr<stxmatch> contentIv(new stxmatch(contentName, span_sub.subMatcher->GetContentScopeId(), NULL, contentStart, contentStart, NULL, NULL, scope));
 		contentIv->subMatch = auto_ptr<submatch>(new submatch);
 		contentIv->subMatch->subMatcher = span_sub.subMatcher; // same as parent
 		contentIv->subMatch->flags |= cxSPAN_IS_CONTENT;
@@ -860,7 +976,7 @@ void Styler_Syntax::CreateSpan(unsigned int starterStart, unsigned int starterEn
 	// scope->end has to be set in calling functions (to adj for scope start)
 }
 
-void Styler_Syntax::ReInitSpan(span_matcher& sm, unsigned int start, const SearchInfo& si, int rc, int* ovector) {
+void Styler_Syntax::ReInitSpan(span_matcher& sm, unsigned int start, SearchInfo& si, int rc, int* ovector) {
 	if (!sm.HasEndCaptures()) return;
 
 	match_matcher& spanstarter = *sm.GetStartMatcher();
@@ -880,6 +996,26 @@ void Styler_Syntax::ReInitSpan(span_matcher& sm, unsigned int start, const Searc
 		lineLen = si.lineLen;
 		ptrLine = &*si.line.begin();
 	}
+	else if (si.snapshot) {
+		// The snapshot is made to contain the starters of all spans
+		// we can re-enter (see GetResumeStart). If it does not, the ender
+		// can't be updated here, so the slice is stopped before parsing
+		// anything and the next snapshot is taken from the starter.
+		if (start < si.snapshotStart || start >= si.snapshotEnd) {
+			m_deferredStart = wxMin(m_deferredStart, start);
+			si.done = true;
+			return;
+		}
+
+		usingSi = false;
+		lineStart = start;
+		const char* const ptrStart = si.snapshot + (start - si.snapshotStart);
+		const char* const newline = (const char*)memchr(ptrStart, '\n', si.snapshotEnd - start);
+		lineEnd = newline ? start + (newline - ptrStart) + 1 : si.snapshotEnd;
+		line.assign(ptrStart, ptrStart + (lineEnd - start));
+		lineLen = lineEnd - lineStart;
+		ptrLine = &*line.begin();
+	}
 	else {
 		usingSi = false;
 		lineStart = start; // TODO: set to start-of-line
@@ -917,6 +1053,10 @@ void Styler_Syntax::ReInitSpan(span_matcher& sm, unsigned int start, const Searc
 }
 
 void Styler_Syntax::Insert(unsigned int pos, unsigned int length) {
+	RecursiveCriticalSectionLocker lock(m_syntaxHandler->GetParseLock());
+	RecursiveCriticalSectionLocker treeLock(m_treeLock);
+	CancelBackgroundParse();
+
 #ifdef __WXDEBUG__
 	Verify();
 
@@ -927,6 +1067,7 @@ void Styler_Syntax::Insert(unsigned int pos, unsigned int length) {
 
 	// Adjust end
 	if (m_syntax_end > pos)	m_syntax_end += length;
+	m_parsedEnd = m_syntax_end;
 	//else return; // Change outside search area
 
 	unsigned int change_start;
@@ -946,12 +1087,16 @@ void Styler_Syntax::Insert(unsigned int pos, unsigned int length) {
 
 	// In case the change invalidates the whole rest of the doc
 	// we don't want to parse it all. There can also come other
-	// changes before next redraw, so we set the limit to change_end.
-	DoSearch(change_start, change_end, change_end);
+	// changes before next redraw, so we set a limit shortly after change_end.
+	DoSearch(change_start, change_end, GetReparseLimit(change_end));
 	m_updateLineHeight = false;
 }
 
 void Styler_Syntax::Delete(unsigned int start_pos, unsigned int end_pos) {
+	RecursiveCriticalSectionLocker lock(m_syntaxHandler->GetParseLock());
+	RecursiveCriticalSectionLocker treeLock(m_treeLock);
+	CancelBackgroundParse();
+
 	const unsigned int docLen = m_doc.GetLength();
 	wxASSERT(start_pos >= 0 && start_pos <= docLen);
 
@@ -969,6 +1114,7 @@ void Styler_Syntax::Delete(unsigned int start_pos, unsigned int end_pos) {
 	if (m_syntax_end > start_pos) {
 		if (m_syntax_end > end_pos) m_syntax_end -= length;
 		else m_syntax_end = start_pos;
+		m_parsedEnd = m_syntax_end;
 	}
 	else return; // Change after search area, no need to re-search
 
@@ -992,13 +1138,17 @@ void Styler_Syntax::Delete(unsigned int start_pos, unsigned int end_pos) {
 
 		// In case the change invalidates the whole rest of the doc
 		// we don't want to parse it all. There can also come other
-		// changes before next redraw, so we set the limit to change_end.
-		DoSearch(change_start, change_end, change_end);
+		// changes before next redraw, so we set a limit shortly after change_end.
+		DoSearch(change_start, change_end, GetReparseLimit(change_end));
 		m_updateLineHeight = false;
 	}
 }
 
 void Styler_Syntax::ApplyDiff(const vector<cxLineChange>& linechanges) {
+	RecursiveCriticalSectionLocker lock(m_syntaxHandler->GetParseLock());
+	RecursiveCriticalSectionLocker treeLock(m_treeLock);
+	CancelBackgroundParse();
+
 	if (m_lines.GetLength() == 0) {
 		Invalidate();
 		return;
@@ -1030,12 +1180,13 @@ void Styler_Syntax::ApplyDiff(const vector<cxLineChange>& linechanges) {
 		unsigned int limit;
 		vector<cxLineChange>::const_iterator nextchange = l+1;
 		if (nextchange != linechanges.end()) limit = nextchange->start;
-		else limit = m_lines.GetLineEndFromPos(change_end);
+		else limit = GetReparseLimit(m_lines.GetLineEndFromPos(change_end));
 		
 		if (l->start < limit) DoSearch(l->start, l->end, limit); 	
 	}
 
 cleanup_and_return:
+	m_parsedEnd = m_syntax_end;
 	m_updateLineHeight = false;
 
 #ifdef __WXDEBUG__
@@ -1187,6 +1338,9 @@ unsigned int Styler_Syntax::AdjustForDeletion(unsigned int start, unsigned int e
 }
 
 void Styler_Syntax::ParseAll() {
+	RecursiveCriticalSectionLocker lock(m_syntaxHandler->GetParseLock());
+	RecursiveCriticalSectionLocker treeLock(m_treeLock);
+
 	const unsigned int len = m_doc.GetLength();
 	if (m_syntax_end < len) {
 		DoSearch(m_syntax_end, len, len);
@@ -1195,6 +1349,8 @@ void Styler_Syntax::ParseAll() {
 
 void Styler_Syntax::ParseTo(unsigned int pos) {
 	wxASSERT(pos <= m_doc.GetLength());
+	RecursiveCriticalSectionLocker lock(m_syntaxHandler->GetParseLock());
+	RecursiveCriticalSectionLocker treeLock(m_treeLock);
 
 	if (m_syntax_end < pos) {
 		const unsigned int sr_end = m_lines.GetLineEndFromPos(pos); // always parse to end-of-line
@@ -1203,10 +1359,16 @@ void Styler_Syntax::ParseTo(unsigned int pos) {
 }
 
 bool Styler_Syntax::OnIdle() {
+	RecursiveCriticalSectionLocker lock(m_syntaxHandler->GetParseLock());
+	RecursiveCriticalSectionLocker treeLock(m_treeLock);
 	if (!HaveActiveSyntax()) return false;
 
 	// Extend syntax a bit longer
 	if (m_syntax_end < m_doc.GetLength()) {
+		// Bigger parts are parsed in the background. The worker
+		// wakes us up when it needs the next chunk of text.
+		if (m_doc.GetLength() - m_syntax_end > BGMINSIZE && StartBackgroundParse()) return false;
+
 		// Make sure the extended position is valid and extends to end-of-line
 		unsigned int ext = wxMin(m_syntax_end+EXTSIZE, m_doc.GetLength());
 		cxLOCKDOC_READ(m_doc)
@@ -1219,6 +1381,151 @@ bool Styler_Syntax::OnIdle() {
 	return m_syntax_end != m_doc.GetLength(); // true if we want more idle events
 }
 
+bool Styler_Syntax::NeedRedraw() {
+	// Check if the background parser has caught up with text that was drawn unstyled
+	if (m_redrawPos == 0 || m_parsedEnd < wxMin(m_redrawPos, m_lines.GetLength())) return false;
+
+	m_redrawPos = 0;
+	return true;
+}
+
+unsigned int Styler_Syntax::GetResumeStart(unsigned int pos) const {
+	// Parsing resumes inside the spans containing pos, and spans with
+	// back-references in the ender re-read the line with their starter.
+	unsigned int resumeStart = pos;
+	unsigned int offset = 0;
+	const submatch* sm = &m_topMatches;
+
+	for (;;) {
+		const stxmatch target(wxEmptyString, NULL, 0, pos - offset, NULL, NULL, NULL);
+		auto_vector<stxmatch>::const_iterator p = lower_bound(sm->matches.begin(), sm->matches.end(), &target, stxmatch_end_less());
+
+		const stxmatch* span = NULL;
+		for (; p != sm->matches.end() && offset + (*p)->start <= pos; ++p) {
+			const stxmatch& m = *(*p);
+			if (m.subMatch.get() && m.subMatch->subMatcher) {
+				if (((span_matcher*)m.subMatch->subMatcher)->HasEndCaptures()) {
+					resumeStart = wxMin(resumeStart, offset + m.start);
+				}
+				span = &m;
+			}
+		}
+		if (!span) break;
+
+		offset += span->start;
+		sm = span->subMatch.get();
+	}
+
+	return resumeStart;
+}
+
+bool Styler_Syntax::StartBackgroundParse() {
+	if (m_noBackground) return false;
+
+	// Check if the current snapshot still has text to parse
+	if (!m_snapshot.empty() && m_syntax_end >= m_snapshotStart && m_syntax_end < m_snapshotEnd) return true;
+
+	const unsigned int docLen = m_lines.GetLength();
+	if (m_syntax_end >= docLen) return false;
+
+	// Take a snapshot of the next chunk of text
+	const unsigned int end = m_lines.GetLineEndFromPos(wxMin(m_syntax_end + BGCHUNKSIZE, docLen));
+	cxLOCKDOC_READ(m_doc)
+		const unsigned int resumeStart = GetResumeStart(doc.GetLineStart(m_syntax_end));
+		m_snapshotStart = doc.GetLineStart(wxMin(resumeStart, m_deferredStart));
+		doc.GetTextPart(m_snapshotStart, end, m_snapshot);
+	cxENDLOCK
+	m_snapshotEnd = end;
+	m_snapshotGeneration = m_syntaxHandler->GetSyntaxGeneration();
+	m_deferredStart = NOTDEFERRED;
+
+	// The worker is started on first use
+	if (!m_runner.Add(1, OnParseSlices, this)) {
+		wxLogDebug(wxT("Styler_Syntax: Could not start parse thread"));
+		m_noBackground = true;
+		CancelBackgroundParse();
+		return false;
+	}
+
+	return true;
+}
+
+// static
+void Styler_Syntax::OnParseSlices(void* data, unsigned int WXUNUSED(index)) {
+	// Parses ahead in the snapshot. The work is done in short
+	// slices, so that the gui thread never has to wait long for the lock.
+	Styler_Syntax& styler = *(Styler_Syntax*)data;
+	while (!styler.m_runner.IsCancelled() && styler.ParseSlice()) wxThread::Yield();
+}
+
+void Styler_Syntax::CancelBackgroundParse() {
+	// The worker only touches the matches while holding the parse
+	// lock, so it will just find the snapshot gone on next slice
+	m_snapshot.clear();
+	m_snapshotStart = m_snapshotEnd = 0;
+}
+
+bool Styler_Syntax::ParseSlice() {
+	// Called from the worker thread
+	bool more;
+	bool wakeIdle;
+	{
+		RecursiveCriticalSectionLocker lock(m_syntaxHandler->GetParseLock());
+		RecursiveCriticalSectionLocker treeLock(m_treeLock);
+		if (m_snapshot.empty()) return false;
+
+		// Drop the snapshot if the grammars have been released
+		// or the gui thread has parsed past it
+		if (!HaveActiveSyntax() || m_snapshotGeneration != m_syntaxHandler->GetSyntaxGeneration() ||
+			m_syntax_end < m_snapshotStart || m_syntax_end >= m_snapshotEnd)
+		{
+			CancelBackgroundParse();
+			return false;
+		}
+
+		// Resume from start-of-line
+		const char* const text = &*m_snapshot.begin();
+		unsigned int start = m_syntax_end;
+		while (start > m_snapshotStart && text[start - m_snapshotStart - 1] != '\n') --start;
+
+		// Parse up to end-of-line after the slice
+		unsigned int end = m_snapshotEnd;
+		if (start + BGSLICESIZE < m_snapshotEnd) {
+			const char* const sliceEnd = text + (start + BGSLICESIZE - m_snapshotStart);
+			const char* const newline = (const char*)memchr(sliceEnd, '\n', m_snapshotEnd - (start + BGSLICESIZE));
+			if (newline) end = m_snapshotStart + (newline - text) + 1;
+		}
+
+		SearchInfo si;
+		si.pos = start;
+		si.line_id = 0; // lines are not used with snapshots
+		si.lineStart = start;
+		si.snapshot = text;
+		si.snapshotStart = m_snapshotStart;
+		si.snapshotEnd = m_snapshotEnd;
+		GetSearchLine(si);
+		si.changeEnd = end;
+		si.limit = end;
+		si.hitLimit = false;
+		si.done = false;
+
+		const unsigned int oldEnd = m_syntax_end;
+		UpdateStackIds();
+		m_syntax_end = Search(m_topMatches, si, 0, m_syntax_end, NULL);
+		m_parsedEnd = m_syntax_end;
+
+		// Release the snapshot when done, so that the gui thread
+		// can hand us the next chunk
+		more = (m_syntax_end > oldEnd && m_syntax_end < m_snapshotEnd);
+		if (!more) CancelBackgroundParse();
+
+		wakeIdle = !more || (m_redrawPos && m_syntax_end >= m_redrawPos);
+	}
+
+	if (wakeIdle) wxWakeUpIdle();
+	return more;
+}
+
 
 #ifdef __WXDEBUG__
 void Styler_Syntax::Print() const {
@@ -1252,6 +1559,27 @@ void Styler_Syntax::PrintMatches(unsigned int level, const submatch& submatches)
 }
 
 
+void Styler_Syntax::GetTreeStats(unsigned int& matchCount, size_t& treeSize) const {
+	RecursiveCriticalSectionLocker treeLock(m_treeLock);
+
+	matchCount = 0;
+	treeSize = m_topMatches.matches.capacity() * sizeof(stxmatch*);
+	GetSubTreeStats(m_topMatches, matchCount, treeSize);
+}
+
+void Styler_Syntax::GetSubTreeStats(const submatch& sm, unsigned int& matchCount, size_t& treeSize) const {
+	for (auto_vector<stxmatch>::const_iterator p = sm.matches.begin(); p != sm.matches.end(); ++p) {
+		const stxmatch& m = *(*p);
+		++matchCount;
+		treeSize += s_matchPool.GetBlockSize();
+
+		if (m.subMatch.get()) {
+			treeSize += s_submatchPool.GetBlockSize() + m.subMatch->matches.capacity() * sizeof(stxmatch*);
+			GetSubTreeStats(*m.subMatch, matchCount, treeSize);
+		}
+	}
+}
+
 void Styler_Syntax::Verify() const {
 	if (!m_verifyEnabled) return;
 
@@ -1315,8 +1643,30 @@ void Styler_Syntax::VerifyMatch(const stxmatch* m) const {
 
 #endif  //__WXDEBUG__
 
-Styler_Syntax::stxmatch::stxmatch(const wxString& name, const matcher* m, unsigned int start, unsigned int end, style *st, submatch* subMatch, stxmatch* parent)
-: m_name(name), m_matcher(m), start(start), end(end), st(st), subMatch(subMatch), parent(parent) {
+// static
+void* Styler_Syntax::stxmatch::operator new(size_t size) {
+	wxASSERT(size <= s_matchPool.GetBlockSize());
+	return s_matchPool.Alloc();
+}
+
+// static
+void Styler_Syntax::stxmatch::operator delete(void* p) {
+	s_matchPool.Free(p);
+}
+
+// static
+void* Styler_Syntax::submatch::operator new(size_t size) {
+	wxASSERT(size <= s_submatchPool.GetBlockSize());
+	return s_submatchPool.Alloc();
+}
+
+// static
+void Styler_Syntax::submatch::operator delete(void* p) {
+	s_submatchPool.Free(p);
+}
+
+Styler_Syntax::stxmatch::stxmatch(const wxString& name, unsigned int scopeId, const matcher* m, unsigned int start, unsigned int end, style *st, submatch* subMatch, stxmatch* parent)
+: m_name(name), m_matcher(m), scopeId(scopeId), stackId(ScopeAtoms::EMPTYSTACK), start(start), end(end), st(st), subMatch(subMatch), parent(parent) {
 }
 
 Styler_Syntax::stxmatch::~stxmatch() {
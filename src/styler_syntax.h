@@ -25,6 +25,10 @@
 #include "SymbolRef.h"
 
 #include "auto_vector.h"
+#include "FixedPool.h"
+#include "matchers.h"
+#include "RecursiveCriticalSection.h"
+#include "TaskRunner.h"
 #include <deque>
 
 class DocumentWrapper;
@@ -33,19 +37,16 @@ class StyleRun;
 class Lines;
 struct style;
 
-class matcher;
-class span_matcher;
-
 class Styler_Syntax : public Styler {
 public:
 	Styler_Syntax(const DocumentWrapper& dw, Lines& lines, TmSyntaxHandler* syntaxHandler);
-	virtual ~Styler_Syntax() {Clear();};
+	virtual ~Styler_Syntax();
 
 	const wxString& GetName() const {return m_syntaxName;};
 
 	bool IsOk() const {return m_topMatches.subMatcher != NULL;};
 	bool IsParsed() const;
-	unsigned int GetLastParsedPos() const {return m_syntax_end;};
+	unsigned int GetLastParsedPos() const;
 
 	bool UpdateSyntax();
 	void SetSyntax(const wxString& syntaxName, const wxString& ext=wxEmptyString);
@@ -66,18 +67,36 @@ public:
 	void ApplyDiff(const vector<cxLineChange>& linechanges);
 
 	bool OnIdle();
+	bool NeedRedraw();
 
 	void GetSymbols(vector<SymbolRef>& symbols) const;
 
+#ifdef __WXDEBUG__
+	// Number of matches and memory used by the match tree
+	void GetTreeStats(unsigned int& matchCount, size_t& treeSize) const;
+#endif  //__WXDEBUG__
+
 private:
 	// Definitions
+	//
+	// TODO: The match tree is still a tree of pooled nodes linked by pointers
+	// (56 bytes per match plus 40 per submatch list on 64bit). A flat arena
+	// with 32bit indices (start, end, stack id, style, parent, first child,
+	// next sibling) would get it to about half, but the incremental reparse
+	// (Search, SubSearch, AdjustForInsertion/Deletion, the background slices)
+	// edits the tree through auto_ptr/auto_vector ownership and parent
+	// pointers, so it has to be rewritten along with it.
 	class submatch; // pre-def
 	class stxmatch {
 	public:
-		stxmatch(const wxString& name, const matcher* m, unsigned int start, unsigned int end, style *st, submatch* submatch, stxmatch* parent);
+		stxmatch(const wxString& name, unsigned int scopeId, const matcher* m, unsigned int start, unsigned int end, style *st, submatch* submatch, stxmatch* parent);
 		~stxmatch();
+		static void* operator new(size_t size);
+		static void operator delete(void* p);
 		const wxString& m_name;
 		const matcher* m_matcher;
+		unsigned int scopeId; // interned m_name
+		unsigned int stackId; // interned scopes from the top (set when styled)
 		unsigned int start;
 		unsigned int end;
 		const style *st;
@@ -95,6 +114,8 @@ private:
 	class submatch {
 	public:
 		submatch() : flags(0), subMatcher(NULL) {};
+		static void* operator new(size_t size);
+		static void operator delete(void* p);
 		int flags;
 		auto_vector<stxmatch> matches;
 		matcher* subMatcher;
@@ -110,6 +131,11 @@ private:
 		vector<char> line;
 		bool hitLimit;
 		bool done;
+
+		// Background parsing reads from a snapshot instead of the document
+		const char* snapshot;
+		unsigned int snapshotStart;
+		unsigned int snapshotEnd;
 	};
 	class stxmatch_start_less : public binary_function<stxmatch*, stxmatch*, bool> {
 	public:
@@ -121,21 +147,26 @@ private:
 	};
 
 	unsigned int Search(submatch& submatches, SearchInfo& si, unsigned int scopeStart, unsigned int scopeEnd, stxmatch* scope);
+	bool IsEndScope(const auto_vector<stxmatch>& matches, auto_vector<stxmatch>::const_iterator first, unsigned int pos) const;
+	unsigned int GetReparseLimit(unsigned int changeEnd) const;
 
 	// Private methods
 	bool HaveActiveSyntax() const { return m_topMatches.subMatcher != NULL; };
 	void DoStyle(StyleRun& sr, unsigned int offset, const auto_vector<stxmatch>& matches);
 	void DoSearch(unsigned int start, unsigned int end, unsigned int limit);
+	void GetSearchLine(SearchInfo& si);
 	unsigned int SubSearch(unsigned int offset, unsigned int start, unsigned int end, submatch& submatches, stxmatch* parent, bool doAdjust, bool& done);
 	void CreateSpan(unsigned int starterStart, unsigned int starterEnd, matcher& subMatcher, unsigned int id, SearchInfo& si, stxmatch* scope, int rc, int* ovector);
 	const style* GetStyle(stxmatch& m) const;
 	void ReStyleSub(const submatch& sm);
+	void UpdateStackIds();
+	void UpdateSubStackIds(const submatch& sm, unsigned int parentStack);
 
 	void GetSubScope(unsigned int pos, const submatch& sm, deque<const wxString*>& scopes) const;
 	void GetSubScopeIntervals(unsigned int pos, unsigned int offset, const submatch& sm, deque<interval>& scopes) const;
 
 	void AddCaptures(matcher& m, stxmatch& sm, unsigned int offset, const SearchInfo& si, int rc, int* ovector);
-	void ReInitSpan(span_matcher& sm, unsigned int start, const SearchInfo& si, int rc=0, int* ovector=NULL);
+	void ReInitSpan(span_matcher& sm, unsigned int start, SearchInfo& si, int rc=0, int* ovector=NULL);
 
 	unsigned int AdjustForInsertion(unsigned int pos, unsigned int length, submatch& submatches, unsigned int o, unsigned int lineStart);
 	unsigned int AdjustForDeletion(unsigned int start, unsigned int end, submatch& submatches, unsigned int o, unsigned int lineStart);
@@ -144,19 +175,62 @@ private:
 
 	void GetSubSymbols(unsigned int offset, const submatch& sm, deque<const wxString*>& scopes, vector<SymbolRef>& symbols) const;
 
+	// Background parsing
+	bool StartBackgroundParse();
+	void CancelBackgroundParse();
+	static void OnParseSlices(void* data, unsigned int index); // called from runner
+	bool ParseSlice();
+	unsigned int GetResumeStart(unsigned int pos) const;
+
 	// Member variables
 	const DocumentWrapper& m_doc;
 	TmSyntaxHandler* m_syntaxHandler;
 	Lines& m_lines;
 	unsigned int m_syntax_end;
 	static const unsigned int EXTSIZE;
+	static const unsigned int REPARSESIZE;
 	wxString m_syntaxName;
 	bool m_updateLineHeight;
 
 	submatch m_topMatches;
 	const style* m_topStyle;
+	MatchCache m_matchCache; // protected by the parse lock
+
+	// Stack ids have to be interned again when the stacks are cleared
+	// (protected by the parse lock)
+	unsigned int m_topStack;
+	unsigned int m_stackGeneration;
+
+	// The parse lock is shared by all documents (the grammars are), so
+	// it is only taken for parsing. The match tree of this document is
+	// guarded by its own lock, and how far it is parsed is published
+	// in m_parsedEnd, which can be read without any lock.
+	mutable RecursiveCriticalSection m_treeLock;
+	volatile unsigned int m_parsedEnd;
+
+	// The nodes of all match trees are allocated from these
+	// (protected by the syntax handler's parse lock)
+	static FixedPool s_matchPool;
+	static FixedPool s_submatchPool;
+
+	// Background parsing (protected by the syntax handler's parse lock, except
+	// that the gui thread resets m_redrawPos, which the worker only reads)
+	static const unsigned int BGMINSIZE;
+	static const unsigned int BGCHUNKSIZE;
+	static const unsigned int BGSLICESIZE;
+	static const unsigned int NOTDEFERRED;
+	TaskRunner m_runner;
+	bool m_noBackground;
+	vector<char> m_snapshot;
+	unsigned int m_snapshotStart;
+	unsigned int m_snapshotEnd;
+	unsigned int m_snapshotGeneration;
+	unsigned int m_redrawPos;
+	unsigned int m_deferredStart; // starter the worker could not re-read
 
 #ifdef __WXDEBUG__
+	void GetSubTreeStats(const submatch& sm, unsigned int& matchCount, size_t& treeSize) const;
+
 	void Print() const;
 	void PrintMatches(unsigned int level, const submatch& submatches) const;
 	void Verify() const;
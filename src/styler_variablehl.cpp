@@ -28,6 +28,7 @@ Styler_SearchHL(rev, lines, ranges, theme), m_settings(settings),
   m_searchHighlightColor(m_theme.searchHighlightColor) ,
   m_cursorPosition(0), m_editorCtrl(editorCtrl)
 {
+	m_wholeWord = true; // only whole variables (see IsWholeWord)
 	Clear(); // Make sure all variables are empty
 }
 
@@ -46,9 +47,12 @@ bool Styler_VariableHL::OnIdle() {
 		return false;
 	}
 
+	// Add matches from the background search
+	Styler_SearchHL::OnIdle();
+
 	const wxString text = m_editorCtrl.GetWord(m_cursorPosition);
-	//Instead of parsing the document in the styler, I moved it to an OnIdle function so the editor doesn't appear to lag as much.
-	//It will perform a full document search about 1 second after the most recent change to the document.
+	//The word is only updated about 1 second after the most recent change to the document, so the
+	//highlights do not flicker while typing. The visible text is searched when drawn, the rest in the background.
 	//TODO: use miliseconds for much more accurate timing
 	if(time(NULL) - m_lastUpdateTime <= 0) {
 		return false;
@@ -59,11 +63,7 @@ bool Styler_VariableHL::OnIdle() {
 		return false;
 	} else if (text != m_text) {
 		//wxLogDebug(wxT("Search: %s"), text);
-		Clear();
-		if(text.Len() > 0) {
-			m_text = text;
-			DoSearch(0, m_doc.GetLength());
-		}
+		SetSearch(text, FIND_MATCHCASE);
 		//we have to force a redraw now because the selections have probably changed
 		m_editorCtrl.DrawLayout();
 
@@ -102,39 +102,6 @@ void Styler_VariableHL::Style(StyleRun& sr) {
 	Styler_SearchHL::Style(sr);
 }
 
-inline bool isAlphaNumeric(wxChar c) {
-#ifdef __WXMSW__
-	return ::IsCharAlphaNumeric(c) != 0;
-#else
-	return wxIsalnum(c);
-#endif
-}
-
-/**
- * say we click on the variable var..
- * We want to filter out matches like these:
-     variable
-	 avar
-	 a_var
- * But allow matches like these:
-   var.method();
-   function(var);
-   var+2;
- */
-bool Styler_VariableHL::FilterMatch(search_result& result, const Document& doc) {
-	wxChar c;
-	if(result.start > 0) {
-		c = doc.GetChar(result.start-1);
-		if(isAlphaNumeric(c) || c == '_') return false;
-	}
-	if(result.end < doc.GetLength()) {
-		c = doc.GetChar(result.end);
-		if(isAlphaNumeric(c) || c == '_') return false;
-	}
-	
-	return true;
-}
-
 void Styler_VariableHL::Insert(unsigned int pos, unsigned int length) {
 	if(!ShouldStyle()) {
 		Invalidate();
@@ -54,7 +54,6 @@ public:
 	void Delete(unsigned int start_pos, unsigned int end_pos);
 	
 	void ApplyStyle(StyleRun& sr, unsigned int start, unsigned int pos);
-	bool FilterMatch(search_result& result, const Document& doc);
 
 private:
 	eSettings& m_settings;
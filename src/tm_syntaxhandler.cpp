@@ -15,6 +15,7 @@
 
 #include <wx/ffile.h>
 #include <wx/dir.h>
+#include <wx/stopwatch.h>
 
 #include "pcre.h"
 
@@ -27,6 +28,7 @@
 #include "tmStyle.h"
 
 #include "IAppPaths.h"
+#include "GrammarCache.h"
 #include "IEditorDoAction.h"
 
 // tinyxml includes unused vars so it can't compile with Level 4
@@ -127,9 +129,13 @@ private:
 // Initialize static variables
 const wxString TmSyntaxHandler::s_emptyString;
 
+static wxString GetGrammarCachePath() {
+	return GetAppPaths().AppDataPath() + wxT("grammars.cache");
+}
+
 TmSyntaxHandler::TmSyntaxHandler(Dispatcher& disp, PListHandler& plistHandler)
 : m_plistHandler(plistHandler),
-  m_dispatcher(disp), m_styleNode(NULL), m_bundleMenu(NULL), m_nextMenuID(9000), m_nextFoldID(0), m_doUpdateBundles(true),
+  m_dispatcher(disp), m_styleNode(NULL), m_syntaxGeneration(0), m_bundleMenu(NULL), m_nextMenuID(9000), m_nextFoldID(0), m_doUpdateBundles(true),
   m_nextBundle(0), m_currentSyntax(NULL), m_currentMatchers(NULL), m_currentParsedReps(NULL), m_repsInParsing(NULL) {
 	// Initialize TinyXml
 	TiXmlBase::SetCondenseWhiteSpace(false);
@@ -171,6 +177,12 @@ TmSyntaxHandler::TmSyntaxHandler(Dispatcher& disp, PListHandler& plistHandler)
 		m_bundleMenu->Enable(m_nextMenuID, false);
 	}
 
+	// Load the patterns converted and compiled in earlier sessions
+	wxStopWatch sw;
+	GrammarCache& grammarCache = GrammarCache::Get();
+	grammarCache.Load(GetGrammarCachePath(), m_plistHandler.GetSyntaxStamp());
+	wxLogDebug(wxT("Loaded grammar cache (%u patterns) in %ldms"), (unsigned int)grammarCache.GetCompiledCount(), sw.Time());
+
 	// The syntaxes are the only parts initially updated
 	// (commands, snippets.. are updated in next idle time)
 	LoadSyntaxes(m_bundleList);
@@ -178,6 +190,8 @@ TmSyntaxHandler::TmSyntaxHandler(Dispatcher& disp, PListHandler& plistHandler)
 
 TmSyntaxHandler::~TmSyntaxHandler() {
 	ClearBundleInfo();
+
+	GrammarCache::Get().Save(GetGrammarCachePath());
 }
 
 bool TmSyntaxHandler::DoIdle() {
@@ -211,6 +225,9 @@ bool TmSyntaxHandler::DoIdle() {
 }
 
 void TmSyntaxHandler::ClearBundleInfo() {
+	RecursiveCriticalSectionLocker lock(m_parseLock);
+	++m_syntaxGeneration;
+
 	// Release allocated syntaxes
 	for (vector<cxSyntaxInfo*>::iterator x = m_syntaxes.begin(); x != m_syntaxes.end(); ++x) {
 		delete *x;
@@ -288,6 +305,7 @@ void TmSyntaxHandler::ClearBundleInfo() {
 	m_foldNode.clear();
 
 	ClearBundleActions();
+	ClearScopeCaches();
 }
 
 void TmSyntaxHandler::ClearBundleActions() {
@@ -312,7 +330,31 @@ void TmSyntaxHandler::ClearBundleActions() {
 	m_nextMenuID = 9000; // range is 9000-11999
 }
 
+void TmSyntaxHandler::ClearScopeCaches() {
+	// The interned scope stacks grow with every distinct stack in the parsed
+	// documents, so they are dropped on reloads. All the results cached by
+	// stack id have to go with them (the parsers intern their stacks again).
+	if (m_styleNode) m_styleNode->ClearMemo();
+	m_prefsNode.ClearMemo();
+	m_shellVarNode.ClearMemo();
+	m_smartPairsNode.ClearMemo();
+	m_completionsNode.ClearMemo();
+	m_completionCmdNode.ClearMemo();
+	m_disableCompletionNode.ClearMemo();
+	m_symbolNode.ClearMemo();
+	m_foldNode.ClearMemo();
+	m_actionNode.ClearMemo();
+	m_dragNode.ClearMemo();
+	for (map<const wxString, sNode<tmAction>*>::iterator t = m_actionTriggers.begin(); t != m_actionTriggers.end(); ++t) {
+		t->second->ClearMemo();
+	}
+
+	ScopeAtoms::ClearStacks();
+}
+
 void TmSyntaxHandler::LoadSyntaxes(const vector<unsigned int>& bundles) {
+	wxStopWatch sw;
+
 	for (unsigned int b = 0; b < bundles.size(); ++b) {
 		const unsigned int bundleId = bundles[b];
 
@@ -332,6 +374,8 @@ void TmSyntaxHandler::LoadSyntaxes(const vector<unsigned int>& bundles) {
 			}
 		}
 	}
+
+	wxLogDebug(wxT("Loaded syntaxes of %u bundles in %ldms"), (unsigned int)bundles.size(), sw.Time());
 }
 
 void TmSyntaxHandler::LoadBundle(unsigned int bundleId) {
@@ -387,7 +431,10 @@ void TmSyntaxHandler::LoadBundle(unsigned int bundleId) {
 void TmSyntaxHandler::LoadBundles(cxBundleLoad mode) {
 	if (mode == cxUPDATE || mode == cxRELOAD) {
 		ClearBundleInfo();
-		if (mode == cxUPDATE) m_plistHandler.Update();
+		if (mode == cxUPDATE) {
+			m_plistHandler.Update();
+			GrammarCache::Get().SetStamp(m_plistHandler.GetSyntaxStamp());
+		}
 	}
 
 	m_bundleMenu = new wxMenu;
@@ -400,10 +447,12 @@ void TmSyntaxHandler::LoadBundles(cxBundleLoad mode) {
 	LoadSyntaxes(m_bundleList);
 
 	// Parse Bundle Actions
+	wxStopWatch sw;
 	for (unsigned int b = 0; b < m_bundleList.size(); ++b) {
 		const unsigned int bundleId = m_bundleList[b];
 		LoadBundle(bundleId);
 	}
+	wxLogDebug(wxT("Loaded actions of %u bundles in %ldms"), (unsigned int)m_bundleList.size(), sw.Time());
 
 	if (mode == cxUPDATE || mode == cxRELOAD) {
 		// We also have to reload the current theme
@@ -578,7 +627,16 @@ const style* TmSyntaxHandler::GetStyle(const deque<const wxString*>& scopes) con
 #endif //__WXDEBUG__
 
 	if (m_styleNode) {
-		const vector<const style*>* s = m_styleNode->GetMatch(scopes);
+		const vector<const style*>* s = m_styleNode->GetMatch(ScopeStack(scopes));
+		if (s && !s->empty()) return (*s)[0];
+	}
+
+	return NULL;
+}
+
+const style* TmSyntaxHandler::GetStyle(unsigned int stackId) const {
+	if (m_styleNode) {
+		const vector<const style*>* s = m_styleNode->GetMatch(stackId);
 		if (s && !s->empty()) return (*s)[0];
 	}
 
@@ -589,7 +647,7 @@ const wxString& TmSyntaxHandler::GetIndentNonePattern(const deque<const wxString
 	// Find all matching indentation rules
 	vector<const tmPrefs*> result;
 	PrefsMatch pred(PrefsMatch::unIndentedLinePattern);
-	m_prefsNode.GetMatches(scopes, result, pred);
+	m_prefsNode.GetMatches(ScopeStack(scopes), result, pred);
 
 	// Return the best match
 	if (!result.empty()) return result[0]->unIndentedLinePattern;
@@ -600,7 +658,7 @@ const wxString& TmSyntaxHandler::GetIndentNextPattern(const deque<const wxString
 	// Find all matching indentation rules
 	vector<const tmPrefs*> result;
 	PrefsMatch pred(PrefsMatch::indentNextLinePattern);
-	m_prefsNode.GetMatches(scopes, result, pred);
+	m_prefsNode.GetMatches(ScopeStack(scopes), result, pred);
 
 	// Return the best match
 	if (!result.empty()) return result[0]->indentNextLinePattern;
@@ -611,7 +669,7 @@ const wxString& TmSyntaxHandler::GetIndentIncreasePattern(const deque<const wxSt
 	// Find all matching indentation rules
 	vector<const tmPrefs*> result;
 	PrefsMatch pred(PrefsMatch::increaseIndentPattern);
-	m_prefsNode.GetMatches(scopes, result, pred);
+	m_prefsNode.GetMatches(ScopeStack(scopes), result, pred);
 
 	// Return the best match
 	if (!result.empty()) return result[0]->increaseIndentPattern;
@@ -622,7 +680,7 @@ const wxString& TmSyntaxHandler::GetIndentDecreasePattern(const deque<const wxSt
 	// Find all matching indentation rules
 	vector<const tmPrefs*> result;
 	PrefsMatch pred(PrefsMatch::decreaseIndentPattern);
-	m_prefsNode.GetMatches(scopes, result, pred);
+	m_prefsNode.GetMatches(ScopeStack(scopes), result, pred);
 
 	// Return the best match
 	if (!result.empty()) return result[0]->decreaseIndentPattern;
@@ -633,7 +691,7 @@ map<wxString, wxString> TmSyntaxHandler::GetShellVariables(const deque<const wxS
 	m_shellVarNode.Print();
 
 	// Get all shell variables
-	const vector<const map<wxString, wxString>*>* result = m_shellVarNode.GetMatch(scopes);
+	const vector<const map<wxString, wxString>*>* result = m_shellVarNode.GetMatch(ScopeStack(scopes));
 	if (result && !result->empty()) {
 		/*for (unsigned int i = 0; i < result->size(); ++i) {
 			wxLogDebug(wxT("%d:"), i);
@@ -662,30 +720,30 @@ map<wxString, wxString> TmSyntaxHandler::GetShellVariables(const deque<const wxS
 }
 
 map<wxString, wxString> TmSyntaxHandler::GetSmartTypingPairs(const deque<const wxString*>& scopes) const {
-	const vector<const map<wxString, wxString>*>* result = m_smartPairsNode.GetMatch(scopes);
+	const vector<const map<wxString, wxString>*>* result = m_smartPairsNode.GetMatch(ScopeStack(scopes));
 	if (result && !result->empty()) return *(*result)[0];
 	return map<wxString, wxString>();
 }
 
 const vector<wxString>* TmSyntaxHandler::GetCompletionList(const deque<const wxString*>& scopes) const {
-	const vector<const vector<wxString>*>* result = m_completionsNode.GetMatch(scopes);
+	const vector<const vector<wxString>*>* result = m_completionsNode.GetMatch(ScopeStack(scopes));
 	if (result && !result->empty()) return (*result)[0];
 	return NULL;
 }
 
 const tmCompletionCmd* TmSyntaxHandler::GetCompletionCmd(const deque<const wxString*>& scopes) const {
-	const vector<const tmCompletionCmd*>* result = m_completionCmdNode.GetMatch(scopes);
+	const vector<const tmCompletionCmd*>* result = m_completionCmdNode.GetMatch(ScopeStack(scopes));
 	if (result && !result->empty()) return (*result)[0];
 	return NULL;
 }
 
 bool TmSyntaxHandler::DisableDefaultCompletion(const deque<const wxString*>& scopes) const {
-	const vector<const void*>* result = m_disableCompletionNode.GetMatch(scopes);
+	const vector<const void*>* result = m_disableCompletionNode.GetMatch(ScopeStack(scopes));
 	return result != NULL;
 }
 
 bool TmSyntaxHandler::ShowSymbol(const deque<const wxString*>& scopes, const wxString*& transform) const {
-	const vector<const wxString*>* result = m_symbolNode.GetMatch(scopes);
+	const vector<const wxString*>* result = m_symbolNode.GetMatch(ScopeStack(scopes));
 	if (result && !result->empty()) {
 		transform = (*result)[0];
 		wxASSERT(transform->size() >= 0); // just to check it is a valid pointer
@@ -695,18 +753,18 @@ bool TmSyntaxHandler::ShowSymbol(const deque<const wxString*>& scopes, const wxS
 }
 
 const TmSyntaxHandler::cxFoldRule* TmSyntaxHandler::GetFoldRule(const deque<const wxString*>& scopes) const {
-	const vector<const cxFoldRule*>* result = m_foldNode.GetMatch(scopes);
+	const vector<const cxFoldRule*>* result = m_foldNode.GetMatch(ScopeStack(scopes));
 	if (result && !result->empty())  return (*result)[0];
 	return NULL;
 }
 
 void TmSyntaxHandler::GetAllActions(const deque<const wxString*>& scopes, vector<const tmAction*>& result) const {
-	m_actionNode.GetMatches(scopes, result);
+	m_actionNode.GetMatches(ScopeStack(scopes), result);
 }
 
 void TmSyntaxHandler::GetActions(const deque<const wxString*>& scopes, vector<const tmAction*>& result, const ShortcutMatch& matchfun) const {
 	// Find all matching snippets and commands
-	m_actionNode.GetMatches(scopes, result, matchfun);
+	m_actionNode.GetMatches(ScopeStack(scopes), result, matchfun);
 
 	// Find all matching syntaxes
 	for (vector<cxSyntaxInfo*>::const_iterator x = m_syntaxes.begin(); x != m_syntaxes.end(); ++x) {
@@ -715,7 +773,7 @@ void TmSyntaxHandler::GetActions(const deque<const wxString*>& scopes, vector<co
 }
 
 void TmSyntaxHandler::GetDragActions(const deque<const wxString*>& scopes, vector<const tmDragCommand*>& result, const ExtMatch& matchfun) const {
-	m_dragNode.GetMatches(scopes, result, matchfun);
+	m_dragNode.GetMatches(ScopeStack(scopes), result, matchfun);
 }
 
 const vector<const tmAction*> TmSyntaxHandler::GetActions(const wxString& trigger, const deque<const wxString*>& scopes) const {
@@ -723,7 +781,7 @@ const vector<const tmAction*> TmSyntaxHandler::GetActions(const wxString& trigge
 
 	if (p != m_actionTriggers.end()) {
 		p->second->Print();
-		const vector<const tmAction*>* s = (const vector<const tmAction*>*)p->second->GetMatch(scopes);
+		const vector<const tmAction*>* s = (const vector<const tmAction*>*)p->second->GetMatch(ScopeStack(scopes));
 		if (s) return *s;
 	}
 
@@ -804,6 +862,8 @@ cxSyntaxInfo* TmSyntaxHandler::GetSyntaxInfo(unsigned int bundleId, unsigned int
 }
 
 const cxSyntaxInfo* TmSyntaxHandler::InitSyntax(cxSyntaxInfo& si, bool WXUNUSED(isTop)) {
+	RecursiveCriticalSectionLocker lock(m_parseLock);
+
 	if (si.topmatcher) return &si;
 	if (ParseSyntax(si)) {
 		//if (isTop && si.topmatcher) si.topmatcher->Init(true);
@@ -1011,7 +1071,8 @@ bool TmSyntaxHandler::ParseSpan(span_matcher* sm, const PListDict& patternDict)
 	// Scope name for entire contents
 	const char* contentName = patternDict.GetString("contentName");
 	if (contentName) {
-		sm->SetContentName(wxString(contentName, wxConvUTF8));
+		const wxString name(contentName, wxConvUTF8);
+		sm->SetContentName(name);
 	}
 
 	// Captures
@@ -1051,7 +1112,8 @@ bool TmSyntaxHandler::ParseCaptures(match_matcher& m, const PListDict& captureDi
 
 		PListDict capnameDict;
 		if (!captureDict.GetDict(key, capnameDict)) return false;
-		m.AddCapture(capkey, capnameDict.wxGetString("name"));
+		const wxString name = capnameDict.wxGetString("name");
+		m.AddCapture(capkey, name);
 	}
 
 	return true;
@@ -1221,6 +1283,8 @@ bool TmSyntaxHandler::GetThemeName(const wxFileName& path, wxString& name) {
 }
 
 bool TmSyntaxHandler::LoadTheme(const char* uuid) {
+	RecursiveCriticalSectionLocker lock(m_parseLock);
+
 	PListDict theme;
 	const int themeNdx = m_plistHandler.GetThemeFromUuid(uuid);
 	if (themeNdx == -1 || !m_plistHandler.GetTheme(themeNdx, theme)) return false;
@@ -1275,6 +1339,7 @@ bool TmSyntaxHandler::LoadTheme(const char* uuid) {
 		m_styles = styles;
 		delete m_styleNode;
 		m_styleNode = rootNode;
+		ClearScopeCaches();
 	}
 	return true;
 
@@ -1896,7 +1961,8 @@ wxMenu* TmSyntaxHandler::ParseMenu(const PListArray& itemsArray, const PListDict
 TmSyntaxHandler::cxFoldRule::cxFoldRule(unsigned int id, const char* startMarker, const char* endMarker):
 	ruleId(id),
 	foldingStartMarker(startMarker, startMarker + strlen(startMarker)+1),
-	foldingEndMarker(endMarker, endMarker + strlen(endMarker)+1) {}
+	foldingEndMarker(endMarker, endMarker + strlen(endMarker)+1),
+	matcher(startMarker, endMarker) {}
 
 // ---- SelectorParser ------------------------------------------------
 
@@ -2039,9 +2105,9 @@ template<class T> bool SelectorParser<T>::ParseScope() {
 		// Add the new word to current scope
 		sNode<T>* newNode = new sNode<T>(m_tokenValue);
 		if (!m_currentNode->postfix)
-			m_currentNode->postfix = new map<wxString,sNode<T>*>;
+			m_currentNode->postfix = new typename sNode<T>::NodeMap;
 
-		(*m_currentNode->postfix)[m_tokenValue] = newNode;
+		m_currentNode->postfix->Set(newNode->atom, newNode);
 		m_currentNode = newNode;
 	}
 
@@ -2051,18 +2117,18 @@ template<class T> bool SelectorParser<T>::ParseScope() {
 // ---- sNode ------------------------------------------------
 
 template<class T> sNode<T>::sNode():
-	word(wxEmptyString), postfix(NULL), orNodes(NULL), ancestors(NULL), targets(NULL) {};
+	atom(ScopeAtoms::NOATOM), postfix(NULL), orNodes(NULL), ancestors(NULL), targets(NULL), memo(NULL) {};
 
 template<class T> sNode<T>::sNode(const wxString& word):
-	word(word), postfix(NULL), orNodes(NULL), ancestors(NULL), targets(NULL) {};
+	atom(ScopeAtoms::GetAtom(word)), postfix(NULL), orNodes(NULL), ancestors(NULL), targets(NULL), memo(NULL) {};
 
 template<class T> sNode<T>::~sNode() {clear();}
 
 template<class T> void sNode<T>::clear() {
 	// Delete all postfix nodes
 	if (postfix) {
-		for (typename NodeMap::iterator p = postfix->begin(); p != postfix->end(); ++p) {
-			delete p->second;
+		for (size_t i = 0; i < postfix->GetSlotCount(); ++i) {
+			delete postfix->GetValue(i);
 		}
 		delete postfix;
 		postfix = NULL;
@@ -2070,8 +2136,8 @@ template<class T> void sNode<T>::clear() {
 
 	// Delete all "or" nodes
 	if (orNodes) {
-		for (typename NodeMap::iterator p = orNodes->begin(); p != orNodes->end(); ++p) {
-			delete p->second;
+		for (size_t i = 0; i < orNodes->GetSlotCount(); ++i) {
+			delete orNodes->GetValue(i);
 		}
 		delete orNodes;
 		orNodes = NULL;
@@ -2079,8 +2145,8 @@ template<class T> void sNode<T>::clear() {
 
 	// Delete all ancestor nodes
 	if (ancestors) {
-		for (typename NodeMap::iterator p = ancestors->begin(); p != ancestors->end(); ++p) {
-			delete p->second;
+		for (size_t i = 0; i < ancestors->GetSlotCount(); ++i) {
+			delete ancestors->GetValue(i);
 		}
 		delete ancestors;
 		ancestors = NULL;
@@ -2090,41 +2156,59 @@ template<class T> void sNode<T>::clear() {
 	delete targets;
 	targets = NULL;
 
-	word.clear();
+	ClearMemo();
+	atom = ScopeAtoms::NOATOM;
 }
 
-template<class T> void sNode<T>::Tokenize(const wxString& scope, wxArrayString& words) const {
-	const size_t len = scope.size();
-	size_t wordstart = 0;
-	size_t i = 0;
+template<class T> void sNode<T>::ClearMemo() {
+	wxCriticalSectionLocker lock(ScopeAtoms::GetLock());
+	delete memo;
+	memo = NULL;
+}
 
-	while (i < len) {
-		if (scope[i] == '.') {
-			words.Add(scope.substr(wordstart, i - wordstart));
-			wordstart = ++i;
-		}
-		else ++i;
-	}
+template<class T> bool sNode<T>::GetMemo(unsigned int stackId, const vector<const T*>*& result) const {
+	wxCriticalSectionLocker lock(ScopeAtoms::GetLock());
+	if (!memo) return false;
 
-	if (wordstart < len) {
-		words.Add(scope.substr(wordstart));
-	}
+	ScopeMemo::const_iterator p = memo->find(stackId);
+	if (p == memo->end()) return false;
+
+	result = (const vector<const T*>*)p->second;
+	return true;
+}
+
+template<class T> void sNode<T>::SetMemo(unsigned int stackId, const vector<const T*>* result) const {
+	wxCriticalSectionLocker lock(ScopeAtoms::GetLock());
+	if (!memo) memo = new ScopeMemo;
+	(*memo)[stackId] = result;
 }
 
-static inline wxString NextWord(const wxString& scope, size_t& pos) {
-	const size_t len = scope.size();
-	const size_t wordstart = pos;
-	size_t i = pos;
+template<class T> const vector<const T*>* sNode<T>::GetMatch(const ScopeStack& scopes) const {
+	if (scopes.empty()) return targets;
 
-	while (i < len && scope[i] != '.') ++i;
+	// The same scope stack always gives the same match
+	const vector<const T*>* res;
+	if (GetMemo(scopes.GetId(), res)) return res;
 
-	pos = i+1;
-	return scope.substr(wordstart, i-wordstart);
+	res = DoGetMatch(scopes);
+	SetMemo(scopes.GetId(), res);
+	return res;
 }
 
-template<class T> const vector<const T*>* sNode<T>::GetMatch(const deque<const wxString*>& scopes) const {
-	if (scopes.empty()) return targets;
+template<class T> const vector<const T*>* sNode<T>::GetMatch(unsigned int stackId) const {
+	if (stackId == ScopeAtoms::EMPTYSTACK) return targets;
+
+	// Only look up the levels of the stack the first time it is seen
+	const vector<const T*>* res;
+	if (GetMemo(stackId, res)) return res;
 
+	res = DoGetMatch(ScopeStack(stackId));
+	SetMemo(stackId, res);
+	return res;
+}
+
+template<class T> const vector<const T*>* sNode<T>::DoGetMatch(const ScopeStack& scopes) const {
+	const vector<const T*>* res = targets;
 	if (orNodes) {
 		// We start at the bottom of the scope and we keep going
 		// a level up until we hit a match
@@ -2132,26 +2216,26 @@ template<class T> const vector<const T*>* sNode<T>::GetMatch(const deque<const w
 		while (ndx > 0) {
 			--ndx;
 
-			// Parse the current scope
-			const wxString& scope = *scopes[ndx];
-			size_t scopePos = 0;
-			const wxString w = NextWord(scope, scopePos);
+			const ScopeAtoms::AtomList& words = scopes[ndx];
+			if (words.empty()) continue;
 
-			typename NodeMap::const_iterator p = orNodes->find(w);
-			if (p != orNodes->end()) {
-				const vector<const T*>* res = p->second->Match(scope, scopePos, scopes, ndx);
-				if (res) return res;
+			const sNode<T>* n = orNodes->Find(words[0]);
+			if (n) {
+				const vector<const T*>* s = n->Match(words, 0, scopes, ndx);
+				if (s) {
+					res = s;
+					break;
+				}
 			}
 
 			// If no match, go one level up in scope and try again
 		}
 	}
 
-	return targets;
+	return res;
 }
 
-
-template<class T> void sNode<T>::GetMatches(const deque<const wxString*>& scopes, vector<const T*>& result) const {
+template<class T> void sNode<T>::GetMatches(const ScopeStack& scopes, vector<const T*>& result) const {
 	if (scopes.empty()) {
 		if (targets) result = *targets;
 		return;
@@ -2163,14 +2247,12 @@ template<class T> void sNode<T>::GetMatches(const deque<const wxString*>& scopes
 		while (ndx > 0) {
 			--ndx;
 
-			// Parse the current scope
-			wxArrayString words;
-			Tokenize(*scopes[ndx], words);
-			const wxString& w = words[0];
+			const ScopeAtoms::AtomList& words = scopes[ndx];
+			if (words.empty()) continue;
 
-			typename NodeMap::const_iterator p = orNodes->find(w);
-			if (p != orNodes->end()) {
-				p->second->Matches(words, 0, scopes, ndx, result);
+			const sNode<T>* n = orNodes->Find(words[0]);
+			if (n) {
+				n->Matches(words, 0, scopes, ndx, result);
 
 				// TODO: Add a ref to the triggering scope level
 			}
@@ -2179,61 +2261,27 @@ template<class T> void sNode<T>::GetMatches(const deque<const wxString*>& scopes
 
 	if (targets) result.insert(result.end(), targets->begin(), targets->end());
 }
-/*
-template<class T> template<class P> void sNode<T>::GetMatches(const deque<const wxString*>& scopes, vector<const T*>& result, P pred) const {
-	if (!scopes.empty()) {
-		if (orNodes) {
-			// We start at the bottom of the scope and we keep going a level up
-			for (int ndx = scopes.size()-1; ndx >= 0; --ndx) {
-				// Parse the current scope
-				wxArrayString words;
-				Tokenize(*scopes[ndx], words);
-				const wxString& w = words[0];
-
-				map<wxString,sNode*>::const_iterator p = orNodes->find(w);
-				if (p != orNodes->end()) {
-					if (p->second->MatchPredicate(words, 0, scopes, ndx, result, pred)) return;
-
-					// TODO: Add a ref to the triggering scope level
-				}
-			}
-		}
-	}
 
-	// match (but there may be no targes here)
-	if (targets) {
-		vector<const T*>::const_iterator p = targets->begin();
-		while (p != targets->end()) {
-			const T* t = *p;
+template<class T> const vector<const T*>* sNode<T>::Match(const ScopeAtoms::AtomList& words, unsigned int pos, const ScopeStack& scopes, size_t level) const {
+	wxASSERT(atom == words[pos]);
 
-			if (pred(t)) {
-				result.insert(result.end(), *p);
-			}
-		}
-	}
-}
-*/
-template<class T> const vector<const T*>* sNode<T>::Match(const wxString& scope, size_t scopePos, const deque<const wxString*>& scopes, size_t level) const {
-	if (postfix && scopePos < scope.size()) {
-		const wxString w = NextWord(scope, scopePos);
-		typename NodeMap::const_iterator p = postfix->find(w);
-		if (p != postfix->end()) {
-			const vector<const T*>* s = p->second->Match(scope, scopePos, scopes, level);
+	const unsigned int nextPos = pos+1;
+	if (postfix && nextPos < words.size()) {
+		const sNode<T>* n = postfix->Find(words[nextPos]);
+		if (n) {
+			const vector<const T*>* s = n->Match(words, nextPos, scopes, level);
 			if (s) return s;
 		}
 	}
 
 	// If we didn't find a match look for ancestors
 	if (level && ancestors) {
-		// Parse the ancestor scope
 		const size_t ndx = level - 1;
-		const wxString& scope2 = *scopes[ndx];
-		scopePos = 0;
-		const wxString w = NextWord(scope2, scopePos);
+		const ScopeAtoms::AtomList& words2 = scopes[ndx];
 
-		typename NodeMap::const_iterator p = ancestors->find(w);
-		if (p != ancestors->end()) {
-			const vector<const T*>* s = p->second->Match(scope2, scopePos, scopes, ndx);
+		const sNode<T>* n = words2.empty() ? NULL : ancestors->Find(words2[0]);
+		if (n) {
+			const vector<const T*>* s = n->Match(words2, 0, scopes, ndx);
 			if (s) return s;
 		}
 	}
@@ -2241,169 +2289,69 @@ template<class T> const vector<const T*>* sNode<T>::Match(const wxString& scope,
 	return targets; // match (but there may be no styles here)
 }
 
-template<class T> void sNode<T>::Matches(const wxArrayString& words, unsigned int pos, const deque<const wxString*>& scopes, size_t level, vector<const T*>& result) const {
-	wxASSERT(word == words[pos]);
+template<class T> void sNode<T>::Matches(const ScopeAtoms::AtomList& words, unsigned int pos, const ScopeStack& scopes, size_t level, vector<const T*>& result) const {
+	wxASSERT(atom == words[pos]);
 
 	const unsigned int nextPos = pos+1;
-	if (postfix && nextPos < words.Count()) {
-		typename NodeMap::const_iterator p = postfix->find(words[nextPos]);
-		if (p != postfix->end()) {
-			p->second->Matches(words, nextPos, scopes, level, result);
+	if (postfix && nextPos < words.size()) {
+		const sNode<T>* n = postfix->Find(words[nextPos]);
+		if (n) {
+			n->Matches(words, nextPos, scopes, level, result);
 		}
 	}
 
 	// If we didn't find a match look for ancestors
 	if (level && ancestors) {
-		// Parse the ancestor scope
 		const size_t ndx = level - 1;
-		wxArrayString words2;
-		Tokenize(*scopes[ndx], words2);
-		const wxString& w = words2[0];
+		const ScopeAtoms::AtomList& words2 = scopes[ndx];
 
-		typename NodeMap::const_iterator p = ancestors->find(w);
-		if (p != ancestors->end()) {
-			p->second->Matches(words2, 0, scopes, ndx, result);
+		const sNode<T>* n = words2.empty() ? NULL : ancestors->Find(words2[0]);
+		if (n) {
+			n->Matches(words2, 0, scopes, ndx, result);
 		}
 	}
 
 	// match (but there may be no targes here)
 	if (targets) result.insert(result.end(), targets->begin(), targets->end());
 }
-/*
-template<class T> bool sNode<T>::MatchPredicate(const wxArrayString& words, unsigned int pos, const deque<const wxString*>& scopes, unsigned int level, vector<const T*>& result, const unary_function<const T*, bool>& pred) const {
-	wxASSERT(word == words[pos]);
-
-	const unsigned int nextPos = pos+1;
-	if (postfix && nextPos < words.Count()) {
-		map<wxString,sNode*>::const_iterator p = postfix->find(words[nextPos]);
-		if (p != postfix->end()) {
-			if (p->second->MatchPredicate(words, nextPos, scopes, level, result, pred)) return true;
-		}
-	}
-
-	// If we didn't find a match look for ancestors
-	if (level && ancestors) {
-		// Parse the ancestor scope
-		const unsigned int ndx = level - 1;
-		wxArrayString words2;
-		Tokenize(*scopes[ndx], words2);
-		const wxString& w = words2[0];
-
-		map<wxString,sNode*>::const_iterator p = ancestors->find(w);
-		if (p != ancestors->end()) {
-			if (p->second->MatchPredicate(words2, 0, scopes, ndx, result, pred)) return true;
-		}
-	}
 
-	// match (but there may be no targes here)
-	bool isFound = false;
-	if (targets) {
-		vector<const T*>::const_iterator p = targets->begin();
-		while (p != targets->end()) {
-			if (pred(*p)) {
-				result.insert(result.end(), p);
-				isFound = true;
-			}
-		}
-	}
+template<class T> void sNode<T>::AddNode(NodeMap*& nodes, sNode<T>* n) {
+	if (!nodes) nodes = new NodeMap;
 
-	return isFound;
+	sNode<T>* s = nodes->Find(n->atom);
+	if (s) s->Merge(n);
+	else nodes->Set(n->atom, n);
 }
-*/
+
 template<class T> void sNode<T>::AddOrNode(sNode<T>* n) {
-	if (orNodes) {
-		typename NodeMap::iterator p = orNodes->find(n->word);
-		if (p == orNodes->end()) {
-			(*orNodes)[n->word] = n;
-		}
-		else {
-			p->second->Merge(n);
-		}
-	}
-	else {
-		orNodes = new map<wxString,sNode*>;
-		(*orNodes)[n->word] = n;
-	}
+	AddNode(orNodes, n);
+	ClearMemo();
 }
 
 template<class T> void sNode<T>::AddAncestor(sNode<T>* n) {
-	if (ancestors) {
-		typename NodeMap::iterator p = ancestors->find(n->word);
-		if (p == ancestors->end()) {
-			(*ancestors)[n->word] = n;
-		}
-		else {
-			p->second->Merge(n);
-		}
-	}
-	else {
-		ancestors = new map<wxString,sNode*>;
-		(*ancestors)[n->word] = n;
-	}
+	AddNode(ancestors, n);
 }
 
-template<class T> void sNode<T>::Merge(sNode<T>* n) {
-	wxASSERT(word == n->word);
-
-	// Merge all postfix nodes
-	if (postfix) {
-		if (n->postfix) {
-			for (typename NodeMap::iterator p = n->postfix->begin(); p != n->postfix->end(); ++p) {
-				const wxString& w = p->second->word;
-
-				typename NodeMap::iterator s = postfix->find(w);
-				if (s == postfix->end()) {
-					(*postfix)[w] = p->second;
-				}
-				else {
-					(s->second)->Merge(p->second);
-				}
-			}
-		}
-		delete n->postfix; // All nodes have been copied or merged
-	}
-	else postfix = n->postfix;
-	n->postfix = NULL; // Avoid trouble when deleting node
-
-	// Merge all "or" nodes
-	if (orNodes) {
-		if (n->orNodes) {
-			for (typename NodeMap::iterator p = n->orNodes->begin(); p != n->orNodes->end(); ++p) {
-				const wxString& w = p->second->word;
-
-				typename NodeMap::iterator s = orNodes->find(w);
-				if (s == orNodes->end()) {
-					(*orNodes)[w] = p->second;
-				}
-				else {
-					(s->second)->Merge(p->second);
-				}
+template<class T> void sNode<T>::MergeNodes(NodeMap*& nodes, NodeMap*& newNodes) {
+	if (nodes) {
+		if (newNodes) {
+			for (size_t i = 0; i < newNodes->GetSlotCount(); ++i) {
+				sNode<T>* n = newNodes->GetValue(i);
+				if (n) AddNode(nodes, n);
 			}
 		}
-		delete n->orNodes; // All nodes have been copied or merged
+		delete newNodes; // All nodes have been copied or merged
 	}
-	else orNodes = n->orNodes;
-	n->orNodes = NULL; // Avoid trouble when deleting node
+	else nodes = newNodes;
+	newNodes = NULL; // Avoid trouble when deleting node
+}
 
-	// Merge all ancestor nodes
-	if (ancestors) {
-		if (n->ancestors) {
-			for (typename NodeMap::iterator p = n->ancestors->begin(); p != n->ancestors->end(); ++p) {
-				const wxString& w = p->second->word;
+template<class T> void sNode<T>::Merge(sNode<T>* n) {
+	wxASSERT(atom == n->atom);
 
-				typename NodeMap::iterator s = ancestors->find(w);
-				if (s == ancestors->end()) {
-					(*ancestors)[w] = p->second;
-				}
-				else {
-					(s->second)->Merge(p->second);
-				}
-			}
-		}
-		delete n->ancestors; // All nodes have been copied or merged
-	}
-	else ancestors = n->ancestors;
-	n->ancestors = NULL; // Avoid trouble when deleting node
+	MergeNodes(postfix, n->postfix);
+	MergeNodes(orNodes, n->orNodes);
+	MergeNodes(ancestors, n->ancestors);
 
 	// Merge styles
 	if (targets) {
@@ -2416,50 +2364,36 @@ template<class T> void sNode<T>::Merge(sNode<T>* n) {
 	else targets = n->targets;
 	n->targets = NULL;
 
+	// Cached matches may have changed
+	ClearMemo();
+
 	// Delete the contributing node
 	delete n;
 }
 
 template<class T> void sNode<T>::Print(size_t indent) const {
 	const wxString pre(' ', indent);
-	if (indent == 0) wxLogDebug(wxT("%s%s"), pre.c_str(), word.c_str());
-
-	if (postfix) {
-		wxLogDebug(wxT("%spostfix:"), pre.c_str());
-		for (typename NodeMap::const_iterator p = postfix->begin(); p != postfix->end(); ++p) {
-			wxLogDebug(wxT("%s  %s"), pre.c_str(), p->second->word.c_str());
-
-			if (p->second->targets) {
-				wxLogDebug(wxT("%s    -> %d"), pre.c_str(), p->second->targets->size());
-			}
-
-			p->second->Print(indent+5);
-		}
-	}
+	if (indent == 0) wxLogDebug(wxT("%s%s"), pre.c_str(), ScopeAtoms::GetWord(atom).c_str());
 
-	if (orNodes) {
-		wxLogDebug(wxT("%sor:"), pre.c_str());
-		for (typename NodeMap::const_iterator p2 = orNodes->begin(); p2 != orNodes->end(); ++p2) {
-			wxLogDebug(wxT("%s  %s"), pre.c_str(), p2->second->word.c_str());
+	const NodeMap* const maps[] = {postfix, orNodes, ancestors};
+	const wxChar* const names[] = {wxT("postfix"), wxT("or"), wxT("ancestors")};
 
-			if (p2->second->targets) {
-				wxLogDebug(wxT("%s    -> %d"), pre.c_str(), p2->second->targets->size());
-			}
+	for (unsigned int m = 0; m < 3; ++m) {
+		const NodeMap* nodes = maps[m];
+		if (!nodes) continue;
 
-			p2->second->Print(indent+5);
-		}
-	}
+		wxLogDebug(wxT("%s%s:"), pre.c_str(), names[m]);
+		for (size_t i = 0; i < nodes->GetSlotCount(); ++i) {
+			const sNode<T>* n = nodes->GetValue(i);
+			if (!n) continue;
 
-	if (ancestors) {
-		wxLogDebug(wxT("%sancestors:"), pre.c_str());
-		for (typename NodeMap::const_iterator p3 = ancestors->begin(); p3 != ancestors->end(); ++p3) {
-			wxLogDebug(wxT("%s  %s"), pre.c_str(), p3->second->word.c_str());
+			wxLogDebug(wxT("%s  %s"), pre.c_str(), ScopeAtoms::GetWord(n->atom).c_str());
 
-			if (p3->second->targets) {
-				wxLogDebug(wxT("%s    -> %d"), pre.c_str(), p3->second->targets->size());
+			if (n->targets) {
+				wxLogDebug(wxT("%s    -> %d"), pre.c_str(), n->targets->size());
 			}
 
-			p3->second->Print(indent+5);
+			n->Print(indent+5);
 		}
 	}
 }
@@ -28,6 +28,7 @@
 #include "tmBundle.h"
 #include "tmAction.h"
 #include "tmCommand.h"
+#include "ScopeAtoms.h"
 #include "tmTheme.h"
 #include "tmKey.h"
 #include "SyntaxInfo.h"
@@ -36,6 +37,8 @@
 #include "ITmThemeHandler.h"
 #include "ITmGetSyntaxes.h"
 #include "ITmLoadBundles.h"
+#include "RecursiveCriticalSection.h"
+#include "FoldMatcher.h"
 
 
 class PListHandler;
@@ -83,11 +86,12 @@ public:
 	~sNode();
 	void clear();
 
-	typedef std::map<wxString,sNode<T>*> NodeMap;
+	typedef AtomTable<sNode<T>*> NodeMap;
 
-	const std::vector<const T*>* GetMatch(const std::deque<const wxString*>& scopes) const;
-	void GetMatches(const std::deque<const wxString*>& scopes, std::vector<const T*>& result) const;
-	template<class P> void GetMatches(const std::deque<const wxString*>& scopes, std::vector<const T*>& result, P& pred) const {
+	const std::vector<const T*>* GetMatch(const ScopeStack& scopes) const;
+	const std::vector<const T*>* GetMatch(unsigned int stackId) const;
+	void GetMatches(const ScopeStack& scopes, std::vector<const T*>& result) const;
+	template<class P> void GetMatches(const ScopeStack& scopes, std::vector<const T*>& result, P& pred) const {
 		if (!scopes.empty()) {
 			if (orNodes) {
 				// We start at the bottom of the scope and we keep going a level up
@@ -95,14 +99,12 @@ public:
 				while (ndx > 0) {
 					--ndx;
 
-					// Parse the current scope
-					wxArrayString words;
-					Tokenize(*scopes[ndx], words);
-					const wxString& w = words[0];
+					const ScopeAtoms::AtomList& words = scopes[ndx];
+					if (words.empty()) continue;
 
-					typename NodeMap::const_iterator p = orNodes->find(w);
-					if (p != orNodes->end()) {
-						if (p->second->MatchPredicate(words, 0, scopes, ndx, result, pred)) return;
+					const sNode<T>* n = orNodes->Find(words[0]);
+					if (n) {
+						if (n->MatchPredicate(words, 0, scopes, ndx, result, pred)) return;
 
 						// TODO: Add a ref to the triggering scope level
 					}
@@ -124,30 +126,27 @@ public:
 		}
 	};
 
-	const std::vector<const T*>* Match(const wxString& scope, size_t scopePos, const std::deque<const wxString*>& scopes, size_t level) const;
-	void Matches(const wxArrayString& words, unsigned int pos, const std::deque<const wxString*>& scopes, size_t level, std::vector<const T*>& result) const;
-	template<class P> bool MatchPredicate(const wxArrayString& words, unsigned int pos, const std::deque<const wxString*>& scopes, size_t level, std::vector<const T*>& result, P& pred) const {
-		wxASSERT(word == words[pos]);
+	const std::vector<const T*>* Match(const ScopeAtoms::AtomList& words, unsigned int pos, const ScopeStack& scopes, size_t level) const;
+	void Matches(const ScopeAtoms::AtomList& words, unsigned int pos, const ScopeStack& scopes, size_t level, std::vector<const T*>& result) const;
+	template<class P> bool MatchPredicate(const ScopeAtoms::AtomList& words, unsigned int pos, const ScopeStack& scopes, size_t level, std::vector<const T*>& result, P& pred) const {
+		wxASSERT(atom == words[pos]);
 
 		const unsigned int nextPos = pos+1;
-		if (postfix && nextPos < words.Count()) {
-			typename NodeMap::const_iterator p = postfix->find(words[nextPos]);
-			if (p != postfix->end()) {
-				if (p->second->MatchPredicate(words, nextPos, scopes, level, result, pred)) return true;
+		if (postfix && nextPos < words.size()) {
+			const sNode<T>* n = postfix->Find(words[nextPos]);
+			if (n) {
+				if (n->MatchPredicate(words, nextPos, scopes, level, result, pred)) return true;
 			}
 		}
 
 		// If we didn't find a match look for ancestors
 		if (level && ancestors) {
-			// Parse the ancestor scope
 			const size_t ndx = level - 1;
-			wxArrayString words2;
-			Tokenize(*scopes[ndx], words2);
-			const wxString& w = words2[0];
+			const ScopeAtoms::AtomList& words2 = scopes[ndx];
 
-			typename NodeMap::const_iterator p = ancestors->find(w);
-			if (p != ancestors->end()) {
-				if (p->second->MatchPredicate(words2, 0, scopes, ndx, result, pred)) return true;
+			const sNode<T>* n = words2.empty() ? NULL : ancestors->Find(words2[0]);
+			if (n) {
+				if (n->MatchPredicate(words2, 0, scopes, ndx, result, pred)) return true;
 			}
 		}
 
@@ -172,16 +171,24 @@ public:
 	void Merge(sNode* n);
 
 	// Member variables
-	wxString word;
+	ScopeAtoms::Atom atom;
 	NodeMap* postfix;
 	NodeMap* orNodes;
 	NodeMap* ancestors;
 	std::vector<const T*>* targets;
 
 	void Print(size_t indent=0) const;
+	void ClearMemo();
 
 private:
-	void Tokenize(const wxString& scope, wxArrayString& words) const;
+	void AddNode(NodeMap*& nodes, sNode* n);
+	void MergeNodes(NodeMap*& nodes, NodeMap*& newNodes);
+	const std::vector<const T*>* DoGetMatch(const ScopeStack& scopes) const;
+	bool GetMemo(unsigned int stackId, const std::vector<const T*>*& result) const;
+	void SetMemo(unsigned int stackId, const std::vector<const T*>* result) const;
+
+	// Results of GetMatch by scope stack (only used on root nodes)
+	mutable ScopeMemo* memo;
 };
 
 class TmSyntaxHandler:
@@ -251,6 +258,13 @@ public:
 
 	// Style
 	const style* GetStyle(const std::deque<const wxString*>& scopes) const;
+	const style* GetStyle(unsigned int stackId) const; // interned by ScopeAtoms
+
+	// Matchers and styles are shared between all syntax parsers (some of
+	// which run in background threads), so they have to hold this lock
+	// while parsing, and it is held while syntaxes and themes change.
+	RecursiveCriticalSection& GetParseLock() const {return m_parseLock;};
+	unsigned int GetSyntaxGeneration() const {return m_syntaxGeneration;}; // changes when matchers are released
 
 	// Actions
 	void GetAllActions(const std::deque<const wxString*>& scopes, std::vector<const tmAction*>& result) const;
@@ -286,12 +300,14 @@ public:
 		const unsigned int ruleId;
 		const std::vector<char> foldingStartMarker;
 		const std::vector<char> foldingEndMarker;
+		const FoldMatcher matcher;
 	};
 	const cxFoldRule* GetFoldRule(const std::deque<const wxString*>& scopes) const;
 
 private:
 	void ClearBundleInfo();
 	void ClearBundleActions();
+	void ClearScopeCaches();
 
 	// Syntax parsing
 	cxSyntaxInfo* GetSyntaxInfo(unsigned int bundleId, unsigned int syntaxId);
@@ -350,6 +366,8 @@ private:
 	std::vector<matcher*> m_matchers;
 	std::vector<style*> m_styles;
 	sNode<style>* m_styleNode;
+	mutable RecursiveCriticalSection m_parseLock;
+	unsigned int m_syntaxGeneration;
 	sNode<tmAction> m_actionNode;
 	sNode<tmDragCommand> m_dragNode;
 	std::map<const wxString, tmAction*> m_actions;